@@ -1,8 +1,16 @@
 #include "std_include.hpp"
 
 #include <windows_emulator.hpp>
+#include <sampling_profiler.hpp>
+#include <path_explorer.hpp>
+#include <unpack_detector.hpp>
 #include <debugging/win_x64_gdb_stub_handler.hpp>
 
+#include <utils/io.hpp>
+#include <utils/json.hpp>
+#include <utils/finally.hpp>
+#include <network/socket.hpp>
+
 #include "object_watching.hpp"
 
 namespace
@@ -11,37 +19,204 @@ namespace
     {
         bool use_gdb{false};
         bool concise_logging{false};
+        bool skip_idle_waits{false};
+        bool fast_forward_spin_loops{false};
+        bool create_registry_snapshot{false};
+        bool persist_syscall_tables{false};
+        std::filesystem::path syscall_profile{};
+        // Block coverage of the loaded modules in drcov format
+        std::filesystem::path coverage_file{};
+        // Sampled guest stacks in the folded format of flame graph tools
+        std::filesystem::path folded_stacks_file{};
+        uint64_t sample_interval{1000};
+        // Allocations holding code the guest wrote and executed, dumped as they were at the first execution
+        std::filesystem::path unpacked_directory{};
+        std::filesystem::path log_file{};
+        std::filesystem::path trace_file{};
+        std::filesystem::path execution_trace_file{};
+        bool trace_registers{false};
+        // Filters of the exports whose calls are recorded into the trace file, see api_tracer
+        std::vector<std::string> traced_apis{};
+        std::filesystem::path input_recording_file{};
+        std::filesystem::path input_replay_file{};
+        std::filesystem::path boot_template{};
+        std::chrono::nanoseconds timeout{};
+        bool follow_child_processes{false};
+        bool virtualize_file_writes{false};
+        uint64_t memory_commit_limit{};
+        bool use_huge_pages{false};
+        // Merges identical read-only pages of all emulators of the process, mostly useful for batch runs
+        bool share_guest_pages{false};
+        bool emulate_library_functions{false};
+        bool emulate_heap{false};
+        bool sanitize_heap{false};
+        // Environment queries whose answers are explored in parallel, see path_explorer
+        std::vector<environment_query> explored_queries{};
+        uint64_t path_instructions{1000000};
+        // Hex byte patterns, one per line, that are matched against memory once it becomes executable
+        std::filesystem::path signature_file{};
+        // Runs the samples listed in this file on a pool of workers, writing their results into the output directory
+        std::filesystem::path batch_file{};
+        std::filesystem::path batch_output{"batch-results"};
+        size_t batch_workers{0};
+        // Accepts jobs on this local UDP port, see run_service
+        uint16_t service_port{0};
+    };
+
+    constexpr size_t MAX_CHILD_PROCESSES = 16;
+
+    struct sample_result
+    {
+        std::optional<NTSTATUS> exit_status{};
+        uint64_t executed_instructions{};
+        std::vector<child_process_request> child_processes{};
     };
 
-    void watch_system_objects(windows_emulator& win_emu, const bool cache_logging)
+    void write_syscall_profile(const windows_emulator& win_emu, const std::filesystem::path& file)
+    {
+        const auto& dispatcher = win_emu.dispatcher();
+        const auto profile =
+            file.extension() == ".csv" ? dispatcher.get_profile_csv() : dispatcher.get_profile_json();
+
+        if (!utils::io::write_file(file, std::vector<uint8_t>(profile.begin(), profile.end())))
+        {
+            win_emu.log.print(color::red, "Failed to write syscall profile to %s\n", file.string().c_str());
+        }
+    }
+
+    using block_map = std::unordered_map<uint64_t, uint32_t>;
+
+    // drcov version 2, as read by lighthouse and similar tools. Blocks are resolved against the modules loaded at
+    // exit, blocks outside of them are dropped.
+    void write_coverage(const windows_emulator& win_emu, const block_map& blocks, const std::filesystem::path& file)
+    {
+        const auto& modules = win_emu.process().mod_manager.get_modules();
+
+        std::string header = "DRCOV VERSION: 2\nDRCOV FLAVOR: drcov\n";
+        header += "Module Table: version 2, count " + std::to_string(modules.size()) + "\n";
+        header += "Columns: id, base, end, entry, checksum, timestamp, path\n";
+
+        std::unordered_map<uint64_t, uint16_t> module_ids{};
+
+        for (const auto& mod : modules | std::views::values)
+        {
+            const auto id = static_cast<uint16_t>(module_ids.size());
+            module_ids[mod.image_base] = id;
+
+            char line[128]{};
+            snprintf(line, sizeof(line), "%u, 0x%" PRIx64 ", 0x%" PRIx64 ", 0x%" PRIx64 ", 0x00000000, 0x00000000, ",
+                     static_cast<uint32_t>(id), mod.image_base, mod.image_base + mod.size_of_image, mod.entry_point);
+
+            header += line;
+            header += mod.path.string();
+            header += "\n";
+        }
+
+        struct bb_entry
+        {
+            uint32_t start;
+            uint16_t size;
+            uint16_t module_id;
+        };
+
+        static_assert(sizeof(bb_entry) == 8);
+
+        std::vector<bb_entry> entries{};
+        entries.reserve(blocks.size());
+
+        for (const auto& [address, size] : blocks)
+        {
+            auto mod = modules.upper_bound(address);
+            if (mod == modules.begin() || !(--mod)->second.is_within(address))
+            {
+                continue;
+            }
+
+            entries.push_back({
+                .start = static_cast<uint32_t>(address - mod->first),
+                .size = static_cast<uint16_t>(std::min(size, static_cast<uint32_t>(UINT16_MAX))),
+                .module_id = module_ids.at(mod->first),
+            });
+        }
+
+        header += "BB Table: " + std::to_string(entries.size()) + " bbs\n";
+
+        std::vector<uint8_t> data(header.begin(), header.end());
+        const auto* entry_data = reinterpret_cast<const uint8_t*>(entries.data());
+        data.insert(data.end(), entry_data, entry_data + (entries.size() * sizeof(bb_entry)));
+
+        if (!utils::io::write_file(file, data))
+        {
+            win_emu.log.print(color::red, "Failed to write coverage to %s\n", file.string().c_str());
+        }
+    }
+
+    void write_folded_stacks(const windows_emulator& win_emu, const sampling_profiler& profiler,
+                             const std::filesystem::path& file)
+    {
+        const auto stacks = profiler.get_folded_stacks();
+
+        if (!utils::io::write_file(file, std::vector<uint8_t>(stacks.begin(), stacks.end())))
+        {
+            win_emu.log.print(color::red, "Failed to write stack samples to %s\n", file.string().c_str());
+        }
+    }
+
+    void write_unpacked_memory(const windows_emulator& win_emu, const unpack_detector& detector,
+                               const std::filesystem::path& directory)
+    {
+        std::error_code ec{};
+        std::filesystem::create_directories(directory, ec);
+
+        for (const auto& unpacked : detector.get_unpacked_memory())
+        {
+            char name[64]{};
+            snprintf(name, sizeof(name), "%016" PRIx64 ".bin", unpacked.allocation_base);
+
+            const auto* data = reinterpret_cast<const uint8_t*>(unpacked.data.data());
+            const auto file = directory / name;
+
+            if (!utils::io::write_file(file, std::vector<uint8_t>(data, data + unpacked.data.size())))
+            {
+                win_emu.log.print(color::red, "Failed to write unpacked memory to %s\n", file.string().c_str());
+            }
+        }
+    }
+
+    void watch_system_objects(windows_emulator& win_emu, memory_watcher& watcher, const bool cache_logging)
     {
         (void)win_emu;
+        (void)watcher;
         (void)cache_logging;
 
 #ifdef OS_WINDOWS
-        watch_object(win_emu, *win_emu.current_thread().teb, cache_logging);
-        watch_object(win_emu, win_emu.process().peb, cache_logging);
-        watch_object(win_emu, emulator_object<KUSER_SHARED_DATA64>{win_emu.emu(), kusd_mmio::address()}, cache_logging);
+        watch_object(win_emu, watcher, *win_emu.current_thread().teb, cache_logging);
+        watch_object(win_emu, watcher, win_emu.process().peb, cache_logging);
+        watch_object(win_emu, watcher, emulator_object<KUSER_SHARED_DATA64>{win_emu.emu(), kusd_mmio::address()},
+                     cache_logging);
+
+        auto params_watch = watch_object(win_emu, watcher, win_emu.process().process_params, cache_logging);
 
-        auto* params_hook = watch_object(win_emu, win_emu.process().process_params, cache_logging);
+        const auto params_address = win_emu.process().peb.value() + offsetof(PEB64, ProcessParameters);
 
-        win_emu.emu().hook_memory_write(
-            win_emu.process().peb.value() + offsetof(PEB64, ProcessParameters), 0x8,
-            [&win_emu, cache_logging, params_hook](const uint64_t address, size_t, const uint64_t value) mutable {
+        watcher.watch(
+            params_address, 0x8, memory_operation::write,
+            [&win_emu, &watcher, cache_logging, params_watch](const uint64_t address, size_t, const uint64_t value,
+                                                              memory_operation) mutable {
                 const auto target_address = win_emu.process().peb.value() + offsetof(PEB64, ProcessParameters);
 
                 if (address == target_address)
                 {
                     const emulator_object<RTL_USER_PROCESS_PARAMETERS64> obj{win_emu.emu(), value};
 
-                    win_emu.emu().delete_hook(params_hook);
-                    params_hook = watch_object(win_emu, obj, cache_logging);
+                    watcher.unwatch(params_watch);
+                    params_watch = watch_object(win_emu, watcher, obj, cache_logging);
                 }
             });
 #endif
     }
 
-    void run_emulation(windows_emulator& win_emu, const analysis_options& options)
+    void run_emulation(windows_emulator& win_emu, const analysis_options& options, path_explorer* explorer)
     {
         try
         {
@@ -53,9 +228,13 @@ namespace
                 win_x64_gdb_stub_handler handler{win_emu};
                 run_gdb_stub(handler, "i386:x86-64", gdb_registers.size(), address);
             }
+            else if (explorer)
+            {
+                explorer->start(options.timeout);
+            }
             else
             {
-                win_emu.start();
+                win_emu.start(options.timeout);
             }
         }
         catch (const std::exception& e)
@@ -80,6 +259,90 @@ namespace
         {
             win_emu.log.print(color::red, "Emulation terminated without status!\n");
         }
+
+        const auto& invalidations = win_emu.emu().get_code_invalidation_statistics();
+        win_emu.log.print(color::dark_gray,
+                          "Code invalidations: %" PRIu64 " protection changes (%" PRIu64 " skipped), %" PRIu64
+                          " executable unmaps, %" PRIu64 " full flushes\n",
+                          invalidations.protection_changes, invalidations.skipped_protection_changes,
+                          invalidations.executable_unmaps, invalidations.full_flushes);
+
+        const auto usage = win_emu.emu().get_memory_usage();
+        win_emu.log.print(color::dark_gray,
+                          "Memory: %" PRIu64 " bytes committed (%" PRIu64 " shared) in %zu mapped regions, %" PRIu64
+                          " bytes reserved\n",
+                          usage.committed_bytes, usage.shared_bytes, usage.mapped_regions, usage.reserved_bytes);
+    }
+
+    void print_startup_statistics(const windows_emulator& win_emu)
+    {
+        const auto& statistics = win_emu.get_startup_statistics();
+        const auto to_us = [](const std::chrono::nanoseconds duration) {
+            return static_cast<long long>(std::chrono::duration_cast<std::chrono::microseconds>(duration).count());
+        };
+
+        win_emu.log.print(color::dark_gray,
+                          "Startup: %lld us (registry %lld, context %lld, modules %lld, syscalls %lld, threads %lld, "
+                          "boot template %lld)\n",
+                          to_us(statistics.total), to_us(statistics.registry), to_us(statistics.process_context),
+                          to_us(statistics.module_mapping), to_us(statistics.syscall_setup),
+                          to_us(statistics.thread_setup), to_us(statistics.boot_template));
+    }
+
+    std::vector<std::vector<std::byte>> load_signatures(const std::filesystem::path& file)
+    {
+        const auto data = utils::io::read_file(file);
+        const std::string_view text(reinterpret_cast<const char*>(data.data()), data.size());
+
+        std::vector<std::vector<std::byte>> signatures{};
+        std::string digits{};
+
+        const auto add_signature = [&] {
+            if (digits.size() % 2)
+            {
+                throw std::runtime_error("Bad signature: " + digits);
+            }
+
+            std::vector<std::byte> signature{};
+            for (size_t i = 0; i < digits.size(); i += 2)
+            {
+                signature.push_back(static_cast<std::byte>(std::stoul(digits.substr(i, 2), nullptr, 16)));
+            }
+
+            if (!signature.empty())
+            {
+                signatures.push_back(std::move(signature));
+            }
+
+            digits.clear();
+        };
+
+        for (const auto chr : text)
+        {
+            if (chr == '\n')
+            {
+                add_signature();
+            }
+            else if (isxdigit(static_cast<unsigned char>(chr)))
+            {
+                digits.push_back(chr);
+            }
+        }
+
+        add_signature();
+        return signatures;
+    }
+
+    void scan_for_signatures(windows_emulator& win_emu, const utils::pattern_matcher& signatures,
+                             const uint64_t address, const uint64_t size)
+    {
+        win_emu.emu().scan_memory(
+            signatures,
+            [&](const uint64_t match, const size_t signature) {
+                win_emu.log.print(color::pink, "Signature %zu matched at 0x%" PRIx64 " (%s)\n", signature, match,
+                                  win_emu.process().mod_manager.find_name(match));
+            },
+            address, size);
     }
 
     std::vector<std::u16string> parse_arguments(const std::span<const std::string_view> args)
@@ -96,24 +359,129 @@ namespace
         return wide_args;
     }
 
-    void run(const analysis_options& options, const std::span<const std::string_view> args)
+    std::shared_ptr<page_deduplicator> get_shared_page_deduplicator(const analysis_options& options)
     {
-        if (args.empty())
-        {
-            return;
-        }
+        static const auto deduplicator = std::make_shared<page_deduplicator>();
+        return options.share_guest_pages ? deduplicator : nullptr;
+    }
+
+    sample_result run_application(const analysis_options& options, const std::filesystem::path& application,
+                                  std::vector<std::u16string> arguments,
+                                  const std::filesystem::path& working_directory = {})
+    {
+        std::vector<child_process_request> child_processes{};
 
         emulator_settings settings{
-            .application = args[0],
-            .arguments = parse_arguments(args),
+            .application = application,
+            .working_directory = working_directory,
+            .persist_syscall_tables = options.persist_syscall_tables,
+            .arguments = std::move(arguments),
+            .log_file = options.log_file,
+            .async_logging = !options.log_file.empty(),
             .silent_until_main = options.concise_logging,
+            .virtualize_file_writes = options.virtualize_file_writes,
+            .skip_idle_waits = options.skip_idle_waits,
+            .fast_forward_spin_loops = options.fast_forward_spin_loops,
+            .shared_page_deduplicator = get_shared_page_deduplicator(options),
+            .memory_commit_limit = options.memory_commit_limit,
+            .use_huge_pages = options.use_huge_pages,
+            .trace_file = options.trace_file,
+            .execution_trace_file = options.execution_trace_file,
+            .execution_trace_registers = options.trace_registers,
+            .traced_apis = options.traced_apis,
+            .input_recording_file = options.input_recording_file,
+            .input_replay_file = options.input_replay_file,
+            .boot_template = options.boot_template,
+            .emulate_library_functions = options.emulate_library_functions,
+            .emulate_heap = options.emulate_heap,
+            .sanitize_heap = options.sanitize_heap,
         };
 
+        if (options.follow_child_processes)
+        {
+            settings.child_process_callback = [&child_processes](const child_process_request& request) {
+                child_processes.push_back(request);
+                return true;
+            };
+        }
+
         windows_emulator win_emu{std::move(settings)};
+        print_startup_statistics(win_emu);
+
+        utils::pattern_matcher signatures{};
+
+        if (!options.signature_file.empty())
+        {
+            signatures = utils::pattern_matcher(load_signatures(options.signature_file));
+            scan_for_signatures(win_emu, signatures, 0, std::numeric_limits<uint64_t>::max());
+
+            win_emu.emu().set_executable_memory_callback([&](const uint64_t address, const size_t size) {
+                scan_for_signatures(win_emu, signatures, address, size); //
+            });
+        }
+
+        if (!options.syscall_profile.empty())
+        {
+            win_emu.dispatcher().enable_profiling();
+        }
+
+        auto profile_writer = utils::finally([&] {
+            if (!options.syscall_profile.empty())
+            {
+                write_syscall_profile(win_emu, options.syscall_profile);
+            }
+        });
+
+        block_map executed_blocks{};
+
+        if (!options.coverage_file.empty())
+        {
+            win_emu.emu().enable_block_trace(executed_blocks);
+        }
+
+        auto coverage_writer = utils::finally([&] {
+            if (!options.coverage_file.empty())
+            {
+                win_emu.emu().disable_block_trace();
+                write_coverage(win_emu, executed_blocks, options.coverage_file);
+            }
+        });
+
+        std::unique_ptr<sampling_profiler> profiler{};
+
+        if (!options.folded_stacks_file.empty())
+        {
+            profiler = std::make_unique<sampling_profiler>(win_emu, options.sample_interval);
+        }
+
+        auto stacks_writer = utils::finally([&] {
+            if (profiler)
+            {
+                write_folded_stacks(win_emu, *profiler, options.folded_stacks_file);
+            }
+        });
+
+        std::unique_ptr<unpack_detector> detector{};
+
+        if (!options.unpacked_directory.empty())
+        {
+            detector = std::make_unique<unpack_detector>(win_emu);
+        }
+
+        auto unpacked_writer = utils::finally([&] {
+            if (detector)
+            {
+                write_unpacked_memory(win_emu, *detector, options.unpacked_directory);
+            }
+        });
+
+        // All watches share a few emulator hooks
+        memory_watcher watcher{win_emu.emu()};
 
         (void)&watch_system_objects;
-        watch_system_objects(win_emu, options.concise_logging);
+        watch_system_objects(win_emu, watcher, options.concise_logging);
         win_emu.buffer_stdout = true;
+        win_emu.count_instructions_per_block = !options.use_gdb;
         // win_emu.verbose_calls = true;
 
         const auto& exe = *win_emu.process().executable;
@@ -127,7 +495,8 @@ namespace
                 continue;
             }
 
-            auto read_handler = [&, section, concise_logging](const uint64_t address, size_t, uint64_t) {
+            auto read_handler = [&, section, concise_logging](const uint64_t address, size_t, uint64_t,
+                                                              memory_operation) {
                 const auto rip = win_emu.emu().read_instruction_pointer();
                 if (win_emu.process().mod_manager.find_by_address(rip) != win_emu.process().executable)
                 {
@@ -136,7 +505,7 @@ namespace
 
                 if (concise_logging)
                 {
-                    static uint64_t count{0};
+                    static thread_local uint64_t count{0};
                     ++count;
                     if (count > 100 && count % 10000 != 0)
                         return;
@@ -147,7 +516,8 @@ namespace
                                   section.name.c_str(), address, rip);
             };
 
-            const auto write_handler = [&, section, concise_logging](const uint64_t address, size_t, uint64_t) {
+            const auto write_handler = [&, section, concise_logging](const uint64_t address, size_t, uint64_t,
+                                                                     memory_operation) {
                 const auto rip = win_emu.emu().read_instruction_pointer();
                 if (win_emu.process().mod_manager.find_by_address(rip) != win_emu.process().executable)
                 {
@@ -156,7 +526,7 @@ namespace
 
                 if (concise_logging)
                 {
-                    static uint64_t count{0};
+                    static thread_local uint64_t count{0};
                     ++count;
                     if (count > 100 && count % 10000 != 0)
                         return;
@@ -166,11 +536,550 @@ namespace
                                   section.name.c_str(), address, rip);
             };
 
-            win_emu.emu().hook_memory_read(section.region.start, section.region.length, std::move(read_handler));
-            win_emu.emu().hook_memory_write(section.region.start, section.region.length, std::move(write_handler));
+            watcher.watch(section.region.start, section.region.length, memory_operation::read, std::move(read_handler));
+            watcher.watch(section.region.start, section.region.length, memory_operation::write, write_handler);
+        }
+
+        std::unique_ptr<path_explorer> explorer{};
+
+        if (!options.explored_queries.empty() && !options.use_gdb)
+        {
+            explorer = std::make_unique<path_explorer>(win_emu, path_exploration_settings{
+                                                                    .queries = options.explored_queries,
+                                                                    .path_instructions = options.path_instructions,
+                                                                });
+        }
+
+        run_emulation(win_emu, options, explorer.get());
+
+        return {
+            .exit_status = win_emu.process().exit_status,
+            .executed_instructions = win_emu.process().executed_instructions,
+            .child_processes = std::move(child_processes),
+        };
+    }
+
+    sample_result run(const analysis_options& options, const std::span<const std::string_view> args)
+    {
+        if (args.empty())
+        {
+            return {};
+        }
+
+        return run_application(options, args[0], parse_arguments(args));
+    }
+
+    // The command line without the application, which may be quoted
+    std::vector<std::u16string> get_child_arguments(const std::u16string_view command_line)
+    {
+        size_t end = 0;
+
+        if (command_line.starts_with(u'"'))
+        {
+            end = command_line.find(u'"', 1);
+            end = end == std::u16string_view::npos ? command_line.size() : end + 1;
+        }
+        else
+        {
+            end = std::min(command_line.find(u' '), command_line.size());
+        }
+
+        const auto start = command_line.find_first_not_of(u' ', end);
+        if (start == std::u16string_view::npos)
+        {
+            return {};
+        }
+
+        return {std::u16string(command_line.substr(start))};
+    }
+
+    // Children only log, into their own files if the parent logs into one
+    analysis_options get_child_options(const analysis_options& options, const size_t index)
+    {
+        auto child_options = options;
+        child_options.syscall_profile.clear();
+        child_options.coverage_file.clear();
+        child_options.folded_stacks_file.clear();
+        child_options.unpacked_directory.clear();
+        child_options.trace_file.clear();
+        child_options.execution_trace_file.clear();
+        child_options.input_recording_file.clear();
+        child_options.input_replay_file.clear();
+        child_options.boot_template.clear();
+
+        if (!options.log_file.empty())
+        {
+            child_options.log_file.replace_filename(options.log_file.stem().string() + "-child" +
+                                                    std::to_string(index) + options.log_file.extension().string());
+        }
+
+        return child_options;
+    }
+
+    // Children run after their parent in sibling emulators, which share the module and registry caches
+    void run_child_processes(const analysis_options& options, std::vector<child_process_request> child_processes)
+    {
+        for (size_t i = 0; i < child_processes.size(); ++i)
+        {
+            const auto request = child_processes[i];
+            const auto command_line = u16_to_u8(request.command_line);
+
+            if (i >= MAX_CHILD_PROCESSES)
+            {
+                printf("Skipping child process: %s\n", command_line.c_str());
+                continue;
+            }
+
+            printf("Running child process: %s\n", command_line.c_str());
+
+            try
+            {
+                auto result = run_application(get_child_options(options, i), request.image_path,
+                                              get_child_arguments(request.command_line), request.current_directory);
+
+                child_processes.insert(child_processes.end(), std::make_move_iterator(result.child_processes.begin()),
+                                       std::make_move_iterator(result.child_processes.end()));
+            }
+            catch (const std::exception& e)
+            {
+                printf("Child process failed: %s\n", e.what());
+            }
+        }
+    }
+
+    std::vector<std::vector<std::string>> read_batch_file(const std::filesystem::path& file)
+    {
+        std::ifstream stream(file);
+        if (!stream)
+        {
+            throw std::runtime_error("Failed to open batch file: " + file.string());
+        }
+
+        std::vector<std::vector<std::string>> samples{};
+
+        std::string line{};
+        while (std::getline(stream, line))
+        {
+            std::vector<std::string> args{};
+            std::istringstream line_stream(line);
+
+            for (std::string arg{}; line_stream >> arg;)
+            {
+                args.push_back(std::move(arg));
+            }
+
+            if (!args.empty() && !args.front().starts_with('#'))
+            {
+                samples.push_back(std::move(args));
+            }
+        }
+
+        return samples;
+    }
+
+    std::string get_result_json(const std::string_view job, const std::string_view application,
+                                const std::optional<sample_result>& result, const std::string_view error,
+                                const std::chrono::nanoseconds duration)
+    {
+        std::string json = "{\"job\":";
+        utils::json::append_string(json, job);
+        json.append(",\"application\":");
+        utils::json::append_string(json, application);
+
+        json.append(",\"result\":");
+        if (!result)
+        {
+            json.append("\"error\",\"error\":");
+            utils::json::append_string(json, error);
+        }
+        else if (!result->exit_status)
+        {
+            json.append("\"timeout\"");
+        }
+        else
+        {
+            char status[32]{};
+            (void)snprintf(status, sizeof(status), "\"0x%08X\"", static_cast<uint32_t>(*result->exit_status));
+            json.append("\"exited\",\"exit_status\":");
+            json.append(status);
+        }
+
+        if (result)
+        {
+            json.append(",\"instructions\":" + std::to_string(result->executed_instructions));
         }
 
-        run_emulation(win_emu, options);
+        const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(duration).count();
+        json.append(",\"duration_ms\":" + std::to_string(ms) + "}\n");
+
+        return json;
+    }
+
+    struct sample_report
+    {
+        bool analyzed{false};
+        std::string json{};
+    };
+
+    // Logs and traces of every sample get their own files, named after the job
+    sample_report analyze_sample(const analysis_options& options, const std::string& job,
+                                 const std::vector<std::string>& sample)
+    {
+        const auto application = std::filesystem::path(sample.front());
+        const auto prefix = options.batch_output / (job + "-" + application.stem().string());
+
+        const auto with_extension = [&](const std::string_view extension) {
+            auto file = prefix;
+            file += extension;
+            return file;
+        };
+
+        auto sample_options = options;
+        sample_options.log_file = with_extension(".log");
+
+        // Templates are kept per application, samples running the same one share it
+        if (!options.boot_template.empty())
+        {
+            const auto key = std::hash<std::string>{}(std::filesystem::absolute(application).string());
+            sample_options.boot_template =
+                options.boot_template / (application.stem().string() + "-" + std::to_string(key) + ".template");
+        }
+
+        if (!options.trace_file.empty())
+        {
+            sample_options.trace_file = with_extension(".trace");
+        }
+
+        if (!options.execution_trace_file.empty())
+        {
+            sample_options.execution_trace_file = with_extension(".exec");
+        }
+
+        if (!options.syscall_profile.empty())
+        {
+            sample_options.syscall_profile = with_extension(".profile" + options.syscall_profile.extension().string());
+        }
+
+        if (!options.coverage_file.empty())
+        {
+            sample_options.coverage_file = with_extension(".drcov");
+        }
+
+        if (!options.folded_stacks_file.empty())
+        {
+            sample_options.folded_stacks_file = with_extension(".folded");
+        }
+
+        if (!options.unpacked_directory.empty())
+        {
+            sample_options.unpacked_directory = with_extension(".unpacked");
+        }
+
+        const std::vector<std::string_view> args(sample.begin(), sample.end());
+
+        std::optional<sample_result> result{};
+        std::string error{};
+
+        const auto start = std::chrono::steady_clock::now();
+
+        try
+        {
+            result = run(sample_options, args);
+        }
+        catch (const std::exception& e)
+        {
+            error = e.what();
+        }
+
+        const auto duration = std::chrono::steady_clock::now() - start;
+        auto json = get_result_json(job, sample.front(), result, error, duration);
+
+        if (!utils::io::write_file(with_extension(".json"), std::vector<uint8_t>(json.begin(), json.end())))
+        {
+            throw std::runtime_error("Failed to write result of " + sample.front());
+        }
+
+        return {.analyzed = result.has_value(), .json = std::move(json)};
+    }
+
+    void prepare_sample_pool(const analysis_options& options)
+    {
+        if (options.use_gdb || !options.input_recording_file.empty() || !options.input_replay_file.empty())
+        {
+            throw std::runtime_error("Debugging and input recording are not supported in batch mode");
+        }
+
+        std::filesystem::create_directories(options.batch_output);
+
+        if (!options.boot_template.empty())
+        {
+            std::filesystem::create_directories(options.boot_template);
+        }
+    }
+
+    size_t get_worker_count(const analysis_options& options)
+    {
+        return options.batch_workers ? options.batch_workers : std::max(std::thread::hardware_concurrency(), 1U);
+    }
+
+    // Module images and registry hives are cached process-wide, samples after the first ones skip parsing them
+    void run_batch(const analysis_options& options)
+    {
+        prepare_sample_pool(options);
+
+        const auto samples = read_batch_file(options.batch_file);
+        const auto worker_count = std::min(samples.size(), get_worker_count(options));
+
+        std::atomic_size_t next_sample{0};
+        std::atomic_size_t failed_samples{0};
+
+        std::mutex error_mutex{};
+        std::exception_ptr error{};
+
+        const auto worker = [&] {
+            try
+            {
+                for (auto index = next_sample++; index < samples.size(); index = next_sample++)
+                {
+                    if (!analyze_sample(options, std::to_string(index), samples[index]).analyzed)
+                    {
+                        ++failed_samples;
+                    }
+                }
+            }
+            catch (...)
+            {
+                std::scoped_lock _{error_mutex};
+                error = std::current_exception();
+                next_sample = samples.size();
+            }
+        };
+
+        std::vector<std::thread> workers{};
+        workers.reserve(worker_count);
+
+        for (size_t i = 0; i < worker_count; ++i)
+        {
+            workers.emplace_back(worker);
+        }
+
+        for (auto& w : workers)
+        {
+            w.join();
+        }
+
+        if (error)
+        {
+            std::rethrow_exception(error);
+        }
+
+        printf("Analyzed %zu samples, %zu failed\n", samples.size(), failed_samples.load());
+    }
+
+    struct service_job
+    {
+        network::address client{};
+        std::string id{};
+        analysis_options options{};
+        std::vector<std::string> sample{};
+    };
+
+    // Ids name the output files, so they are restricted to characters that are safe in paths
+    bool is_valid_job_id(const std::string_view id)
+    {
+        return !id.empty() && id.size() <= 64 && std::ranges::all_of(id, [](const char c) {
+                   return std::isalnum(static_cast<unsigned char>(c)) || c == '-' || c == '_'; //
+               });
+    }
+
+    // A job is a single datagram: "<id> <timeout seconds> [trace] [exec-trace] [registers] [profile]", followed by
+    // the application and its arguments, one per line. A timeout of 0 keeps the one of the service.
+    std::optional<service_job> parse_job(const std::string& packet, const analysis_options& options)
+    {
+        std::istringstream stream(packet);
+
+        std::string header{};
+        std::getline(stream, header);
+
+        service_job job{};
+        job.options = options;
+
+        std::istringstream header_stream(header);
+        uint64_t timeout = 0;
+
+        if (!(header_stream >> job.id >> timeout) || !is_valid_job_id(job.id))
+        {
+            return std::nullopt;
+        }
+
+        if (timeout)
+        {
+            job.options.timeout = std::chrono::seconds(timeout);
+        }
+
+        // The actual file names are derived from the job id
+        for (std::string flag{}; header_stream >> flag;)
+        {
+            if (flag == "trace")
+            {
+                job.options.trace_file = "trace";
+            }
+            else if (flag == "exec-trace")
+            {
+                job.options.execution_trace_file = "exec";
+            }
+            else if (flag == "registers")
+            {
+                job.options.trace_registers = true;
+            }
+            else if (flag == "profile")
+            {
+                job.options.syscall_profile = "profile.json";
+            }
+            else
+            {
+                return std::nullopt;
+            }
+        }
+
+        for (std::string line{}; std::getline(stream, line);)
+        {
+            if (!line.empty() && line.back() == '\r')
+            {
+                line.pop_back();
+            }
+
+            if (!line.empty())
+            {
+                job.sample.push_back(std::move(line));
+            }
+        }
+
+        if (job.sample.empty())
+        {
+            return std::nullopt;
+        }
+
+        return job;
+    }
+
+    std::string get_job_state_json(const std::string_view job, const std::string_view state)
+    {
+        std::string json = "{\"job\":";
+        utils::json::append_string(json, job);
+        json.append(",\"result\":");
+        utils::json::append_string(json, state);
+        json.append("}\n");
+
+        return json;
+    }
+
+    // Samples keep being analyzed while the process lives, boot templates and the module and registry caches
+    // stay warm between jobs. Only local clients are accepted, jobs name arbitrary host files.
+    void run_service(const analysis_options& options)
+    {
+        prepare_sample_pool(options);
+
+        network::socket socket{AF_INET};
+        network::address local_address{"127.0.0.1", AF_INET};
+        local_address.set_port(options.service_port);
+
+        if (!socket.bind_port(local_address))
+        {
+            throw std::runtime_error("Failed to bind service port " + std::to_string(options.service_port));
+        }
+
+        std::mutex mutex{};
+        std::condition_variable condition_variable{};
+        std::deque<service_job> jobs{};
+        bool stop{false};
+
+        const auto worker = [&] {
+            while (true)
+            {
+                std::unique_lock lock{mutex};
+                condition_variable.wait(lock, [&] { return stop || !jobs.empty(); });
+
+                // Jobs that were queued before the shutdown still get their results
+                if (jobs.empty())
+                {
+                    return;
+                }
+
+                auto job = std::move(jobs.front());
+                jobs.pop_front();
+                lock.unlock();
+
+                std::string json{};
+
+                try
+                {
+                    json = analyze_sample(job.options, job.id, job.sample).json;
+                }
+                catch (const std::exception& e)
+                {
+                    json = get_result_json(job.id, job.sample.front(), std::nullopt, e.what(), {});
+                }
+
+                (void)socket.send(job.client, json);
+            }
+        };
+
+        std::vector<std::thread> workers{};
+        const auto worker_count = get_worker_count(options);
+        workers.reserve(worker_count);
+
+        for (size_t i = 0; i < worker_count; ++i)
+        {
+            workers.emplace_back(worker);
+        }
+
+        printf("Waiting for jobs on %s...\n", local_address.to_string().c_str());
+
+        network::address client{};
+        std::string packet{};
+
+        while (true)
+        {
+            if (!socket.receive(client, packet))
+            {
+                continue;
+            }
+
+            if (packet == "shutdown")
+            {
+                break;
+            }
+
+            auto job = parse_job(packet, options);
+            if (!job)
+            {
+                (void)socket.send(client, get_job_state_json("", "invalid"));
+                continue;
+            }
+
+            job->client = client;
+            (void)socket.send(client, get_job_state_json(job->id, "queued"));
+
+            {
+                std::scoped_lock _{mutex};
+                jobs.push_back(std::move(*job));
+            }
+
+            condition_variable.notify_one();
+        }
+
+        {
+            std::scoped_lock _{mutex};
+            stop = true;
+        }
+
+        condition_variable.notify_all();
+
+        for (auto& w : workers)
+        {
+            w.join();
+        }
     }
 
     std::vector<std::string_view> bundle_arguments(const int argc, char** argv)
@@ -202,6 +1111,159 @@ namespace
             {
                 options.concise_logging = true;
             }
+            else if (arg == "-s")
+            {
+                options.skip_idle_waits = true;
+            }
+            else if (arg == "-sl")
+            {
+                options.fast_forward_spin_loops = true;
+            }
+            else if (arg == "-r")
+            {
+                options.create_registry_snapshot = true;
+            }
+            else if (arg == "-rs")
+            {
+                options.persist_syscall_tables = true;
+            }
+            else if (arg == "-p" && args.size() > 1)
+            {
+                options.syscall_profile = args[1];
+                args.erase(arg_it);
+            }
+            else if (arg == "-cov" && args.size() > 1)
+            {
+                options.coverage_file = args[1];
+                args.erase(arg_it);
+            }
+            else if (arg == "-fs" && args.size() > 1)
+            {
+                options.folded_stacks_file = args[1];
+                args.erase(arg_it);
+            }
+            else if (arg == "-ud" && args.size() > 1)
+            {
+                options.unpacked_directory = args[1];
+                args.erase(arg_it);
+            }
+            else if (arg == "-fsi" && args.size() > 1)
+            {
+                options.sample_interval = std::stoull(std::string(args[1]));
+                args.erase(arg_it);
+            }
+            else if (arg == "-l" && args.size() > 1)
+            {
+                options.log_file = args[1];
+                args.erase(arg_it);
+            }
+            else if (arg == "-t" && args.size() > 1)
+            {
+                options.trace_file = args[1];
+                args.erase(arg_it);
+            }
+            else if (arg == "-x" && args.size() > 1)
+            {
+                options.execution_trace_file = args[1];
+                args.erase(arg_it);
+            }
+            else if (arg == "-xr")
+            {
+                options.trace_registers = true;
+            }
+            else if (arg == "-ta" && args.size() > 1)
+            {
+                options.traced_apis.emplace_back(args[1]);
+                args.erase(arg_it);
+            }
+            else if (arg == "-i" && args.size() > 1)
+            {
+                options.input_recording_file = args[1];
+                args.erase(arg_it);
+            }
+            else if (arg == "-ir" && args.size() > 1)
+            {
+                options.input_replay_file = args[1];
+                args.erase(arg_it);
+            }
+            else if (arg == "-b" && args.size() > 1)
+            {
+                options.boot_template = args[1];
+                args.erase(arg_it);
+            }
+            else if (arg == "-cp")
+            {
+                options.follow_child_processes = true;
+            }
+            else if (arg == "-vf")
+            {
+                options.virtualize_file_writes = true;
+            }
+            else if (arg == "-m" && args.size() > 1)
+            {
+                options.memory_commit_limit = std::stoull(std::string(args[1])) * 1024 * 1024;
+                args.erase(arg_it);
+            }
+            else if (arg == "-hle")
+            {
+                options.emulate_library_functions = true;
+            }
+            else if (arg == "-y" && args.size() > 1)
+            {
+                options.signature_file = args[1];
+                args.erase(arg_it);
+            }
+            else if (arg == "-eh")
+            {
+                options.emulate_heap = true;
+            }
+            else if (arg == "-sh")
+            {
+                options.sanitize_heap = true;
+            }
+            else if (arg == "-px" && args.size() > 1)
+            {
+                options.explored_queries.push_back(parse_environment_query(args[1]));
+                args.erase(arg_it);
+            }
+            else if (arg == "-pi" && args.size() > 1)
+            {
+                options.path_instructions = std::stoull(std::string(args[1]));
+                args.erase(arg_it);
+            }
+            else if (arg == "-hp")
+            {
+                options.use_huge_pages = true;
+            }
+            else if (arg == "-sp")
+            {
+                options.share_guest_pages = true;
+            }
+            else if (arg == "-T" && args.size() > 1)
+            {
+                options.timeout = std::chrono::seconds(std::stoull(std::string(args[1])));
+                args.erase(arg_it);
+            }
+            else if (arg == "-B" && args.size() > 1)
+            {
+                options.batch_file = args[1];
+                args.erase(arg_it);
+            }
+            else if (arg == "-o" && args.size() > 1)
+            {
+                options.batch_output = args[1];
+                args.erase(arg_it);
+            }
+            else if (arg == "-S" && args.size() > 1)
+            {
+                options.service_port = static_cast<uint16_t>(std::stoul(std::string(args[1])));
+                args.erase(arg_it);
+            }
+            else if (arg == "-j" && args.size() > 1)
+            {
+                options.batch_workers = std::stoull(std::string(args[1]));
+                args.erase(arg_it);
+            }
             else
             {
                 break;
@@ -221,6 +1283,25 @@ int main(const int argc, char** argv)
         auto args = bundle_arguments(argc, argv);
         const auto options = parse_options(args);
 
+        if (options.create_registry_snapshot)
+        {
+            const emulator_settings settings{};
+            registry_manager::create_snapshot(settings.registry_directory);
+            return 0;
+        }
+
+        if (!options.batch_file.empty())
+        {
+            run_batch(options);
+            return 0;
+        }
+
+        if (options.service_port)
+        {
+            run_service(options);
+            return 0;
+        }
+
         if (args.empty())
         {
             throw std::runtime_error("Application not specified!");
@@ -228,7 +1309,8 @@ int main(const int argc, char** argv)
 
         do
         {
-            run(options, args);
+            const auto result = run(options, args);
+            run_child_processes(options, result.child_processes);
         } while (options.use_gdb);
 
         return 0;
@@ -1,15 +1,23 @@
 #pragma once
 
+#include <memory_watcher.hpp>
+#include <event_trace.hpp>
+
 #include "reflect_type_info.hpp"
 
 template <typename T>
-emulator_hook* watch_object(windows_emulator& emu, emulator_object<T> object, const bool cache_logging = false)
+memory_watcher::watch_id watch_object(windows_emulator& emu, memory_watcher& watcher, emulator_object<T> object,
+                                      const bool cache_logging = false)
 {
     const reflect_type_info<T> info{};
 
-    return emu.emu().hook_memory_read(
-        object.value(), object.size(),
-        [i = std::move(info), object, &emu, cache_logging](const uint64_t address, size_t, uint64_t) {
+    // Offsets of the object that were logged already, each watch has its own
+    std::vector<bool> logged_offsets(cache_logging ? object.size() : 0);
+
+    return watcher.watch(
+        object.value(), object.size(), memory_operation::read,
+        [i = info, object, &emu, logged = std::move(logged_offsets)](
+            const uint64_t address, const size_t size, uint64_t, const memory_operation operation) mutable {
             const auto rip = emu.emu().read_instruction_pointer();
             const auto* mod = emu.process().mod_manager.find_by_address(rip);
             const auto is_main_access = mod == emu.process().executable;
@@ -19,16 +27,25 @@ emulator_hook* watch_object(windows_emulator& emu, emulator_object<T> object, co
                 return;
             }
 
-            if (cache_logging)
+            const auto offset = address - object.value();
+
+            if (is_main_access && offset < logged.size())
             {
-                static std::unordered_set<uint64_t> logged_addresses{};
-                if (is_main_access && !logged_addresses.insert(address).second)
+                if (logged[offset])
                 {
                     return;
                 }
+
+                logged[offset] = true;
+            }
+
+            if (auto* trace = emu.trace())
+            {
+                trace->log_object_access(address, rip, static_cast<uint32_t>(offset), size, operation,
+                                         i.get_type_name(), i.get_member_name(offset));
+                return;
             }
 
-            const auto offset = address - object.value();
             emu.log.print(is_main_access ? color::green : color::dark_gray,
                           "Object access: %s - 0x%llX (%s) at 0x%llX (%s)\n", i.get_type_name().c_str(), offset,
                           i.get_member_name(offset).c_str(), rip, mod ? mod->name.c_str() : "<N/A>");
@@ -12,53 +12,80 @@
 #pragma GCC diagnostic pop
 #endif
 
+// Member lookup goes through a table of member indices by offset, built once per type
 template <typename T>
 class reflect_type_info
 {
   public:
-    reflect_type_info()
-    {
-        this->type_name_ = reflect::type_name<T>();
-
-        reflect::for_each<T>([this](auto I) {
-            const auto member_name = reflect::member_name<I, T>();
-            const auto member_offset = reflect::offset_of<I, T>();
-
-            this->members_[member_offset] = member_name;
-        });
-    }
-
     std::string get_member_name(const size_t offset) const
     {
-        size_t last_offset{};
-        std::string_view last_member{};
+        const auto& info = get_info();
+        if (offset >= info.member_by_offset.size())
+        {
+            return "<N/A>";
+        }
 
-        for (const auto& member : this->members_)
+        const auto& member = info.members[info.member_by_offset[offset]];
+        if (offset == member.offset)
         {
-            if (offset == member.first)
-            {
-                return member.second;
-            }
-
-            if (offset < member.first)
-            {
-                const auto diff = offset - last_offset;
-                return std::string(last_member) + "+" + std::to_string(diff);
-            }
-
-            last_offset = member.first;
-            last_member = member.second;
+            return member.name;
         }
 
-        return "<N/A>";
+        return member.name + "+" + std::to_string(offset - member.offset);
     }
 
     const std::string& get_type_name() const
     {
-        return this->type_name_;
+        return get_info().type_name;
     }
 
   private:
-    std::string type_name_{};
-    std::map<size_t, std::string> members_{};
+    struct member_info
+    {
+        size_t offset{};
+        std::string name{};
+    };
+
+    struct type_info
+    {
+        std::string type_name{};
+        std::vector<member_info> members{};
+        // Index of the member covering each byte of the type
+        std::vector<uint32_t> member_by_offset{};
+    };
+
+    static const type_info& get_info()
+    {
+        static const type_info info = create_info();
+        return info;
+    }
+
+    static type_info create_info()
+    {
+        type_info info{};
+        info.type_name = reflect::type_name<T>();
+
+        std::map<size_t, std::string> members{};
+        reflect::for_each<T>([&members](auto I) {
+            members[reflect::offset_of<I, T>()] = reflect::member_name<I, T>(); //
+        });
+
+        if (members.empty())
+        {
+            return info;
+        }
+
+        info.member_by_offset.resize(sizeof(T));
+
+        for (auto& [offset, name] : members)
+        {
+            const auto index = static_cast<uint32_t>(info.members.size());
+            info.members.push_back({.offset = offset, .name = std::move(name)});
+
+            std::fill(info.member_by_offset.begin() + static_cast<ptrdiff_t>(std::min(offset, sizeof(T))),
+                      info.member_by_offset.end(), index);
+        }
+
+        return info;
+    }
 };
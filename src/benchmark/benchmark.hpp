@@ -0,0 +1,26 @@
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <vector>
+#include <functional>
+#include <string_view>
+
+struct benchmark_result
+{
+    size_t operations{};
+    size_t instructions{};
+    size_t syscalls{};
+    // Time of the measured part, the whole run if zero
+    std::chrono::nanoseconds duration{};
+};
+
+struct benchmark
+{
+    std::string name{};
+    std::function<benchmark_result()> run{};
+};
+
+std::vector<benchmark> get_memory_benchmarks();
+std::vector<benchmark> get_execution_benchmarks();
+std::vector<benchmark> get_windows_benchmarks();
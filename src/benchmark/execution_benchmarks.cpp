@@ -0,0 +1,139 @@
+#include "benchmark.hpp"
+
+#include <span>
+#include <cstdint>
+#include <stdexcept>
+
+#include <windows_emulator.hpp>
+
+namespace
+{
+    constexpr size_t DATA_SIZE = 0x4000000;
+
+    // mov rcx, 0x1000000; l: dec rcx; jnz l
+    constexpr uint8_t LOOP_CODE[] = {
+        0x48, 0xC7, 0xC1, 0x00, 0x00, 0x00, 0x01, 0x48, 0xFF, 0xC9, 0x75, 0xFB,
+    };
+    constexpr size_t LOOP_INSTRUCTIONS = 1 + 2 * 0x1000000;
+
+    // mov r8, 64; o: mov rcx, 0x20000; i: mov [rdi+rcx*8-8], rcx; dec rcx; jnz i; dec r8; jnz o
+    constexpr uint8_t MEMORY_CODE[] = {
+        0x49, 0xC7, 0xC0, 0x40, 0x00, 0x00, 0x00, 0x48, 0xC7, 0xC1, 0x00, 0x00, 0x02, 0x00, 0x48,
+        0x89, 0x4C, 0xCF, 0xF8, 0x48, 0xFF, 0xC9, 0x75, 0xF6, 0x49, 0xFF, 0xC8, 0x75, 0xEA,
+    };
+    constexpr size_t MEMORY_INSTRUCTIONS = 1 + 64 * (3 + 3 * 0x20000);
+
+    // mov r12, 0x40000; l: xor eax, eax; syscall; dec r12; jnz l
+    constexpr uint8_t SYSCALL_CODE[] = {
+        0x49, 0xC7, 0xC4, 0x00, 0x00, 0x04, 0x00, 0x31, 0xC0, 0x0F, 0x05, 0x49, 0xFF, 0xCC, 0x75, 0xF7,
+    };
+    constexpr size_t SYSCALL_COUNT = 0x40000;
+
+    // mov rcx, 256; l: mov [rdi], rcx; add rdi, 0x1000; dec rcx; jnz l
+    constexpr uint8_t DIRTY_PAGES_CODE[] = {
+        0x48, 0xC7, 0xC1, 0x00, 0x01, 0x00, 0x00, 0x48, 0x89, 0x0F, 0x48,
+        0x81, 0xC7, 0x00, 0x10, 0x00, 0x00, 0x48, 0xFF, 0xC9, 0x75, 0xF1,
+    };
+
+    struct guest
+    {
+        std::unique_ptr<x64_emulator> emu{};
+        uint64_t code{};
+        uint64_t code_end{};
+        uint64_t data{};
+
+        guest(const std::span<const uint8_t> code_bytes)
+            : emu(create_default_x64_emulator())
+        {
+            this->code = this->emu->allocate_memory(0x1000, memory_permission::read | memory_permission::exec);
+            this->code_end = this->code + code_bytes.size();
+            this->emu->write_memory(this->code, code_bytes.data(), code_bytes.size());
+
+            this->data = this->emu->allocate_memory(DATA_SIZE, memory_permission::read_write);
+        }
+
+        void run()
+        {
+            this->emu->reg(x64_register::rdi, this->data);
+            this->emu->start(this->code, this->code_end);
+        }
+    };
+
+    benchmark_result benchmark_loop()
+    {
+        guest g{LOOP_CODE};
+        g.run();
+
+        return {.operations = LOOP_INSTRUCTIONS, .instructions = LOOP_INSTRUCTIONS};
+    }
+
+    benchmark_result benchmark_memory_writes()
+    {
+        guest g{MEMORY_CODE};
+        g.run();
+
+        return {.operations = MEMORY_INSTRUCTIONS, .instructions = MEMORY_INSTRUCTIONS};
+    }
+
+    benchmark_result benchmark_syscalls()
+    {
+        guest g{SYSCALL_CODE};
+
+        size_t syscalls = 0;
+        g.emu->hook_instruction(x64_hookable_instructions::syscall, [&] {
+            ++syscalls;
+            return instruction_hook_continuation::skip_instruction;
+        });
+
+        g.run();
+
+        if (syscalls != SYSCALL_COUNT)
+        {
+            throw std::runtime_error("Unexpected syscall count: " + std::to_string(syscalls));
+        }
+
+        return {.operations = syscalls, .instructions = 1 + 4 * SYSCALL_COUNT, .syscalls = syscalls};
+    }
+
+    // Dirties 256 pages between snapshot resets, only the time of the resets is measured
+    benchmark_result benchmark_snapshot_cycles(const bool full_restore, const size_t iterations)
+    {
+        guest g{DIRTY_PAGES_CODE};
+        g.emu->save_snapshot();
+
+        std::chrono::nanoseconds duration{};
+
+        for (size_t i = 0; i < iterations; ++i)
+        {
+            g.run();
+
+            const auto start = std::chrono::high_resolution_clock::now();
+
+            if (full_restore)
+            {
+                g.emu->restore_snapshot();
+            }
+            else if (!g.emu->reset_to_snapshot())
+            {
+                throw std::runtime_error("Snapshot reset failed");
+            }
+
+            duration += std::chrono::high_resolution_clock::now() - start;
+        }
+
+        return {.operations = iterations, .duration = duration};
+    }
+}
+
+std::vector<benchmark> get_execution_benchmarks()
+{
+    const std::string prefix = "execution/";
+
+    return {
+        {prefix + "loop", [] { return benchmark_loop(); }},
+        {prefix + "memory-writes", [] { return benchmark_memory_writes(); }},
+        {prefix + "syscalls", [] { return benchmark_syscalls(); }},
+        {prefix + "snapshot-reset", [] { return benchmark_snapshot_cycles(false, 2000); }},
+        {prefix + "snapshot-restore", [] { return benchmark_snapshot_cycles(true, 200); }},
+    };
+}
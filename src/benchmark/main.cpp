@@ -0,0 +1,123 @@
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <stdexcept>
+#include <vector>
+
+#include <windows_emulator.hpp>
+
+#include "benchmark.hpp"
+
+#ifdef _WIN32
+#include <Psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+using namespace std::literals;
+
+namespace
+{
+    double get_rate(const size_t count, const double seconds)
+    {
+        return seconds > 0 ? static_cast<double>(count) / seconds : 0.0;
+    }
+
+    uint64_t get_peak_resident_memory()
+    {
+#ifdef _WIN32
+        PROCESS_MEMORY_COUNTERS counters{};
+        if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        {
+            return 0;
+        }
+
+        return counters.PeakWorkingSetSize;
+#else
+        rusage usage{};
+        if (getrusage(RUSAGE_SELF, &usage) != 0)
+        {
+            return 0;
+        }
+
+#ifdef __APPLE__
+        return static_cast<uint64_t>(usage.ru_maxrss);
+#else
+        return static_cast<uint64_t>(usage.ru_maxrss) * 1024;
+#endif
+#endif
+    }
+
+    void run_benchmark(const benchmark& b)
+    {
+        const auto start = std::chrono::high_resolution_clock::now();
+        const auto result = b.run();
+        const auto total_duration = std::chrono::high_resolution_clock::now() - start;
+
+        const auto duration = result.duration.count() ? result.duration : total_duration;
+
+        const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(duration).count();
+        const auto seconds = std::chrono::duration<double>(duration).count();
+        const auto ns_per_operation =
+            result.operations ? std::chrono::duration<double, std::nano>(duration).count() / result.operations : 0.0;
+
+        std::string details{};
+
+        if (result.instructions)
+        {
+            char buffer[64]{};
+            (void)snprintf(buffer, sizeof(buffer), "  %10.1f Minstr/s", get_rate(result.instructions, seconds) / 1e6);
+            details.append(buffer);
+        }
+
+        if (result.syscalls)
+        {
+            char buffer[64]{};
+            (void)snprintf(buffer, sizeof(buffer), "  %12.0f syscalls/s", get_rate(result.syscalls, seconds));
+            details.append(buffer);
+        }
+
+        printf("%-40s %12zu ops  %8lld ms  %14.0f ops/s  %12.0f ns/op%s\n", b.name.c_str(), result.operations,
+               static_cast<long long>(ms), get_rate(result.operations, seconds), ns_per_operation, details.c_str());
+    }
+
+    std::vector<benchmark> get_benchmarks()
+    {
+        std::vector<benchmark> benchmarks{};
+
+        for (auto* get : {get_memory_benchmarks, get_execution_benchmarks, get_windows_benchmarks})
+        {
+            auto entries = get();
+            benchmarks.insert(benchmarks.end(), std::make_move_iterator(entries.begin()),
+                              std::make_move_iterator(entries.end()));
+        }
+
+        return benchmarks;
+    }
+}
+
+int main(const int argc, char** argv)
+{
+    const std::string_view filter = argc > 1 ? argv[1] : ""sv;
+
+    try
+    {
+        for (const auto& b : get_benchmarks())
+        {
+            if (filter.empty() || b.name.starts_with(filter))
+            {
+                run_benchmark(b);
+            }
+        }
+
+        printf("Peak resident memory: %.1f MiB\n", static_cast<double>(get_peak_resident_memory()) / (1024 * 1024));
+        return 0;
+    }
+    catch (std::exception& e)
+    {
+        puts(e.what());
+    }
+
+    return 1;
+}
@@ -0,0 +1,137 @@
+#include "benchmark.hpp"
+
+#include <windows_emulator.hpp>
+
+namespace
+{
+    benchmark_result benchmark_commit_decommit()
+    {
+        constexpr size_t iterations = 20000;
+        constexpr size_t region_size = 0x100000;
+
+        const auto emu = create_default_x64_emulator();
+        const auto base = emu->allocate_memory(region_size, memory_permission::read_write, true);
+
+        for (size_t i = 0; i < iterations; ++i)
+        {
+            const auto address = base + ((i * 0x3000) % (region_size - 0x4000));
+            emu->commit_memory(address, 0x4000, memory_permission::read_write);
+            emu->decommit_memory(address, 0x4000);
+        }
+
+        return {.operations = iterations * 2};
+    }
+
+    benchmark_result benchmark_protect()
+    {
+        constexpr size_t iterations = 50000;
+        constexpr size_t region_size = 0x100000;
+
+        const auto emu = create_default_x64_emulator();
+        const auto base = emu->allocate_memory(region_size, memory_permission::read_write);
+
+        for (size_t i = 0; i < iterations; ++i)
+        {
+            const auto address = base + ((i * 0x1000) % region_size);
+            const auto permissions = (i & 1) ? memory_permission::read : memory_permission::read_write;
+            emu->protect_memory(address, 0x1000, permissions);
+        }
+
+        return {.operations = iterations};
+    }
+
+    benchmark_result benchmark_region_queries()
+    {
+        constexpr size_t allocations = 2000;
+        constexpr size_t iterations = 1000000;
+
+        const auto emu = create_default_x64_emulator();
+
+        std::vector<uint64_t> bases{};
+        bases.reserve(allocations);
+
+        for (size_t i = 0; i < allocations; ++i)
+        {
+            bases.push_back(emu->allocate_memory(0x2000, memory_permission::read_write, (i % 3) == 0));
+        }
+
+        size_t committed = 0;
+
+        for (size_t i = 0; i < iterations; ++i)
+        {
+            const auto info = emu->get_region_info(bases[(i * 7919) % bases.size()] + 0x1000);
+            committed += info.is_committed ? 1 : 0;
+        }
+
+        (void)committed;
+        return {.operations = iterations};
+    }
+
+    benchmark_result benchmark_allocation_spray()
+    {
+        constexpr size_t allocations = 100000;
+
+        const auto emu = create_default_x64_emulator();
+
+        std::vector<uint64_t> bases{};
+        bases.reserve(allocations);
+
+        for (size_t i = 0; i < allocations; ++i)
+        {
+            bases.push_back(emu->allocate_memory(0x10000, memory_permission::read_write, true));
+        }
+
+        for (size_t i = 0; i < allocations; i += 2)
+        {
+            emu->release_memory(bases[i], 0);
+        }
+
+        for (size_t i = 0; i < allocations / 2; ++i)
+        {
+            emu->allocate_memory(0x10000, memory_permission::read_write, true);
+        }
+
+        return {.operations = allocations + allocations};
+    }
+
+    benchmark_result benchmark_fragmented_allocation_spray()
+    {
+        constexpr size_t allocations = 100000;
+
+        const auto emu = create_default_x64_emulator();
+
+        std::vector<uint64_t> bases{};
+        bases.reserve(allocations);
+
+        for (size_t i = 0; i < allocations; ++i)
+        {
+            bases.push_back(emu->allocate_memory(0x10000, memory_permission::read_write, true));
+        }
+
+        for (size_t i = 0; i < allocations; i += 2)
+        {
+            emu->release_memory(bases[i], 0);
+        }
+
+        // None of the holes is large enough, a linear first-fit search would step over all of them every time
+        for (size_t i = 0; i < allocations / 2; ++i)
+        {
+            emu->allocate_memory(0x20000, memory_permission::read_write, true);
+        }
+
+        return {.operations = allocations + allocations};
+    }
+}
+
+std::vector<benchmark> get_memory_benchmarks()
+{
+    const std::string prefix = "memory/";
+
+    return {
+        {prefix + "commit-decommit", [] { return benchmark_commit_decommit(); }},
+        {prefix + "protect", [] { return benchmark_protect(); }},
+        {prefix + "region-info", [] { return benchmark_region_queries(); }},
+        {prefix + "allocation-spray", [] { return benchmark_allocation_spray(); }},
+        {prefix + "allocation-spray-fragmented", [] { return benchmark_fragmented_allocation_spray(); }},
+    };
+}
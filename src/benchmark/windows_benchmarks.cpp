@@ -0,0 +1,96 @@
+#include "benchmark.hpp"
+
+#include <stdexcept>
+
+#include <windows_emulator.hpp>
+
+namespace
+{
+    constexpr auto SAMPLE_APPLICATION = "./test-sample.exe";
+
+    windows_emulator create_sample_emulator()
+    {
+        emulator_settings settings{
+            .application = SAMPLE_APPLICATION,
+            .disable_logging = true,
+            .use_relative_time = true,
+        };
+
+        return windows_emulator{std::move(settings)};
+    }
+
+    benchmark_result benchmark_sample()
+    {
+        auto win_emu = create_sample_emulator();
+
+        size_t syscalls = 0;
+        win_emu.add_syscall_hook([&] {
+            ++syscalls;
+            return instruction_hook_continuation::run_instruction;
+        });
+
+        win_emu.start();
+
+        if (win_emu.process().exit_status != STATUS_SUCCESS)
+        {
+            throw std::runtime_error("Sample did not terminate successfully");
+        }
+
+        const auto instructions = static_cast<size_t>(win_emu.process().executed_instructions);
+        return {.operations = instructions, .instructions = instructions, .syscalls = syscalls};
+    }
+
+    // Fixed cost of every sample and fuzzing worker, the phases are at windows_emulator::get_startup_statistics
+    benchmark_result benchmark_startup()
+    {
+        constexpr size_t iterations = 20;
+
+        for (size_t i = 0; i < iterations; ++i)
+        {
+            const auto win_emu = create_sample_emulator();
+            (void)win_emu;
+        }
+
+        return {.operations = iterations};
+    }
+
+    // Restores the whole process state, threads and objects included, like the fuzzer does after crashes
+    benchmark_result benchmark_sample_restore()
+    {
+        constexpr size_t iterations = 100;
+        constexpr size_t instructions_between_restores = 10000;
+
+        auto win_emu = create_sample_emulator();
+        win_emu.start({}, 200000);
+        win_emu.save_snapshot();
+
+        std::chrono::nanoseconds duration{};
+
+        for (size_t i = 0; i < iterations; ++i)
+        {
+            win_emu.start({}, instructions_between_restores);
+
+            const auto start = std::chrono::high_resolution_clock::now();
+            win_emu.restore_snapshot();
+            duration += std::chrono::high_resolution_clock::now() - start;
+        }
+
+        return {.operations = iterations, .duration = duration};
+    }
+}
+
+std::vector<benchmark> get_windows_benchmarks()
+{
+    if (!std::filesystem::exists(SAMPLE_APPLICATION))
+    {
+        return {};
+    }
+
+    const std::string prefix = "windows/";
+
+    return {
+        {prefix + "test-sample", [] { return benchmark_sample(); }},
+        {prefix + "startup", [] { return benchmark_startup(); }},
+        {prefix + "snapshot-restore", [] { return benchmark_sample_restore(); }},
+    };
+}
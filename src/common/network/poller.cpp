@@ -0,0 +1,279 @@
+#include "poller.hpp"
+
+#include <array>
+#include <stdexcept>
+
+#if defined(__linux__)
+#include <sys/epoll.h>
+#elif defined(__APPLE__)
+#include <sys/event.h>
+#endif
+
+namespace network
+{
+    namespace
+    {
+        constexpr size_t MAX_EVENTS_PER_WAIT = 64;
+    }
+
+#if defined(__linux__)
+
+    poller::poller()
+    {
+        this->handle_ = epoll_create1(EPOLL_CLOEXEC);
+        if (this->handle_ < 0)
+        {
+            throw std::runtime_error("Failed to create epoll instance");
+        }
+    }
+
+    poller::~poller()
+    {
+        close(this->handle_);
+    }
+
+    bool poller::watch(const SOCKET s, const bool in_poll)
+    {
+        const auto entry = this->watched_.find(s);
+        if (entry != this->watched_.end() && entry->second == in_poll)
+        {
+            return true;
+        }
+
+        epoll_event event{};
+        event.events = in_poll ? EPOLLIN : EPOLLOUT;
+        event.data.fd = s;
+
+        const auto operation = entry != this->watched_.end() ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+        if (epoll_ctl(this->handle_, operation, s, &event) != 0)
+        {
+            return false;
+        }
+
+        this->watched_[s] = in_poll;
+        return true;
+    }
+
+    void poller::unwatch(const SOCKET s)
+    {
+        if (this->watched_.erase(s) == 0)
+        {
+            return;
+        }
+
+        this->ready_.erase(s);
+        (void)epoll_ctl(this->handle_, EPOLL_CTL_DEL, s, nullptr);
+    }
+
+    size_t poller::wait(const std::chrono::milliseconds timeout)
+    {
+        this->ready_.clear();
+
+        std::array<epoll_event, MAX_EVENTS_PER_WAIT> events{};
+        auto timeout_ms = static_cast<int>(timeout.count());
+
+        while (true)
+        {
+            const auto count = epoll_wait(this->handle_, events.data(), static_cast<int>(events.size()), timeout_ms);
+            if (count <= 0)
+            {
+                break;
+            }
+
+            for (int i = 0; i < count; ++i)
+            {
+                this->ready_.insert(events[static_cast<size_t>(i)].data.fd);
+            }
+
+            if (static_cast<size_t>(count) < events.size())
+            {
+                break;
+            }
+
+            timeout_ms = 0;
+        }
+
+        return this->ready_.size();
+    }
+
+#elif defined(__APPLE__)
+
+    poller::poller()
+    {
+        this->handle_ = kqueue();
+        if (this->handle_ < 0)
+        {
+            throw std::runtime_error("Failed to create kqueue instance");
+        }
+    }
+
+    poller::~poller()
+    {
+        close(this->handle_);
+    }
+
+    bool poller::watch(const SOCKET s, const bool in_poll)
+    {
+        const auto entry = this->watched_.find(s);
+        if (entry != this->watched_.end() && entry->second == in_poll)
+        {
+            return true;
+        }
+
+        if (entry != this->watched_.end())
+        {
+            this->unwatch(s);
+        }
+
+        struct kevent change{};
+        EV_SET(&change, s, in_poll ? EVFILT_READ : EVFILT_WRITE, EV_ADD, 0, 0, nullptr);
+
+        if (kevent(this->handle_, &change, 1, nullptr, 0, nullptr) != 0)
+        {
+            return false;
+        }
+
+        this->watched_[s] = in_poll;
+        return true;
+    }
+
+    void poller::unwatch(const SOCKET s)
+    {
+        const auto entry = this->watched_.find(s);
+        if (entry == this->watched_.end())
+        {
+            return;
+        }
+
+        struct kevent change{};
+        EV_SET(&change, s, entry->second ? EVFILT_READ : EVFILT_WRITE, EV_DELETE, 0, 0, nullptr);
+        (void)kevent(this->handle_, &change, 1, nullptr, 0, nullptr);
+
+        this->watched_.erase(entry);
+        this->ready_.erase(s);
+    }
+
+    size_t poller::wait(const std::chrono::milliseconds timeout)
+    {
+        this->ready_.clear();
+
+        std::array<struct kevent, MAX_EVENTS_PER_WAIT> events{};
+
+        const auto seconds = std::chrono::duration_cast<std::chrono::seconds>(timeout);
+        timespec wait_time{};
+        wait_time.tv_sec = static_cast<time_t>(seconds.count());
+        wait_time.tv_nsec = static_cast<long>(std::chrono::nanoseconds(timeout - seconds).count());
+
+        while (true)
+        {
+            const auto count =
+                kevent(this->handle_, nullptr, 0, events.data(), static_cast<int>(events.size()), &wait_time);
+            if (count <= 0)
+            {
+                break;
+            }
+
+            for (int i = 0; i < count; ++i)
+            {
+                this->ready_.insert(static_cast<SOCKET>(events[static_cast<size_t>(i)].ident));
+            }
+
+            if (static_cast<size_t>(count) < events.size())
+            {
+                break;
+            }
+
+            wait_time = {};
+        }
+
+        return this->ready_.size();
+    }
+
+#else
+
+    poller::poller()
+    {
+        initialize_wsa();
+    }
+
+    poller::~poller() = default;
+
+    bool poller::watch(const SOCKET s, const bool in_poll)
+    {
+        const auto entry = this->watched_.find(s);
+        if (entry != this->watched_.end() && entry->second == in_poll)
+        {
+            return true;
+        }
+
+        const auto events = static_cast<int16_t>(in_poll ? POLLIN : POLLOUT);
+
+        if (entry != this->watched_.end())
+        {
+            for (auto& pfd : this->poll_data_)
+            {
+                if (pfd.fd == s)
+                {
+                    pfd.events = events;
+                }
+            }
+        }
+        else
+        {
+            pollfd pfd{};
+            pfd.fd = s;
+            pfd.events = events;
+            this->poll_data_.push_back(pfd);
+        }
+
+        this->watched_[s] = in_poll;
+        return true;
+    }
+
+    void poller::unwatch(const SOCKET s)
+    {
+        if (this->watched_.erase(s) == 0)
+        {
+            return;
+        }
+
+        this->ready_.erase(s);
+        std::erase_if(this->poll_data_, [s](const pollfd& pfd) { return pfd.fd == s; });
+    }
+
+    size_t poller::wait(const std::chrono::milliseconds timeout)
+    {
+        this->ready_.clear();
+
+        if (this->poll_data_.empty())
+        {
+            return 0;
+        }
+
+        const auto count = poll(this->poll_data_.data(), static_cast<ULONG>(this->poll_data_.size()),
+                                static_cast<int>(timeout.count()));
+        if (count <= 0)
+        {
+            return 0;
+        }
+
+        for (auto& pfd : this->poll_data_)
+        {
+            if (pfd.revents != 0)
+            {
+                this->ready_.insert(pfd.fd);
+                pfd.revents = 0;
+            }
+        }
+
+        return this->ready_.size();
+    }
+
+#endif
+
+    bool poller::is_watching(const SOCKET s, const bool in_poll) const
+    {
+        const auto entry = this->watched_.find(s);
+        return entry != this->watched_.end() && entry->second == in_poll;
+    }
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "socket.hpp"
+
+#include <chrono>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace network
+{
+    // Persistent readiness multiplexer for many sockets.
+    // Uses epoll on Linux, kqueue on macOS and WSAPoll over a persistent set on Windows.
+    class poller
+    {
+      public:
+        poller();
+        ~poller();
+
+        poller(const poller& obj) = delete;
+        poller& operator=(const poller& obj) = delete;
+
+        poller(poller&& obj) = delete;
+        poller& operator=(poller&& obj) = delete;
+
+        // Waits for readability if in_poll is set, for writability otherwise.
+        // Returns false if the socket can't be watched, callers then have to poll it themselves.
+        bool watch(SOCKET s, bool in_poll);
+        void unwatch(SOCKET s);
+
+        bool is_watching(SOCKET s, bool in_poll) const;
+
+        bool empty() const
+        {
+            return this->watched_.empty();
+        }
+
+        // Refreshes the ready set, returns the number of ready sockets
+        size_t wait(std::chrono::milliseconds timeout);
+
+        // Readiness as of the last wait
+        bool is_ready(const SOCKET s) const
+        {
+            return this->ready_.contains(s);
+        }
+
+      private:
+        std::unordered_map<SOCKET, bool> watched_{};
+        std::unordered_set<SOCKET> ready_{};
+
+#if defined(__linux__) || defined(__APPLE__)
+        int handle_{-1};
+#else
+        std::vector<pollfd> poll_data_{};
+#endif
+    };
+}
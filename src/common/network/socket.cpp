@@ -197,6 +197,38 @@ namespace network
         return !socket_is_ready;
     }
 
+    bool socket::sleep_sockets(const std::span<const std::pair<SOCKET, bool>> sockets,
+                               const std::chrono::milliseconds timeout)
+    {
+        std::vector<pollfd> pfds{};
+        pfds.resize(sockets.size());
+
+        for (size_t i = 0; i < sockets.size(); ++i)
+        {
+            auto& pfd = pfds.at(i);
+            const auto& [s, in_poll] = sockets[i];
+
+            pfd.fd = s;
+            pfd.events = in_poll ? POLLIN : POLLOUT;
+            pfd.revents = 0;
+        }
+
+        const auto retval = poll(pfds.data(), static_cast<uint32_t>(pfds.size()), static_cast<int>(timeout.count()));
+
+        if (retval == SOCKET_ERROR)
+        {
+            std::this_thread::sleep_for(1ms);
+            return socket_is_ready;
+        }
+
+        if (retval > 0)
+        {
+            return socket_is_ready;
+        }
+
+        return !socket_is_ready;
+    }
+
     bool socket::is_socket_ready(const SOCKET s, const bool in_poll)
     {
         pollfd pfd{};
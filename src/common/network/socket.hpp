@@ -59,6 +59,8 @@ namespace network
                                         std::chrono::high_resolution_clock::time_point time_point);
 
         static bool is_socket_ready(SOCKET s, bool in_poll);
+        static bool sleep_sockets(std::span<const std::pair<SOCKET, bool>> sockets,
+                                  std::chrono::milliseconds timeout);
 
       private:
         int address_family_{AF_UNSPEC};
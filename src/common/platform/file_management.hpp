@@ -261,6 +261,21 @@ struct IO_STATUS_BLOCK
     typename Traits::ULONG_PTR Information;
 };
 
+template <typename Traits>
+struct FILE_COMPLETION_INFORMATION
+{
+    typename Traits::HANDLE Port;
+    typename Traits::PVOID Key;
+};
+
+template <typename Traits>
+struct FILE_IO_COMPLETION_INFORMATION
+{
+    typename Traits::PVOID KeyContext;
+    typename Traits::PVOID ApcContext;
+    IO_STATUS_BLOCK<Traits> IoStatusBlock;
+};
+
 template <typename Traits>
 struct OBJECT_ATTRIBUTES
 {
@@ -6,11 +6,13 @@ using NTSTATUS = std::uint32_t;
 
 #ifndef OS_WINDOWS
 #define STATUS_WAIT_0              ((NTSTATUS)0x00000000L)
+#define STATUS_ABANDONED_WAIT_0    ((NTSTATUS)0x00000080L)
 #define STATUS_TIMEOUT             ((NTSTATUS)0x00000102L)
 
 #define STATUS_ACCESS_VIOLATION    ((NTSTATUS)0xC0000005L)
 #define STATUS_INVALID_HANDLE      ((NTSTATUS)0xC0000008L)
 #define STATUS_INVALID_PARAMETER   ((NTSTATUS)0xC000000DL)
+#define STATUS_NO_MEMORY           ((NTSTATUS)0xC0000017L)
 #define STATUS_ILLEGAL_INSTRUCTION ((NTSTATUS)0xC000001DL)
 
 #define STATUS_PENDING             ((NTSTATUS)0x00000103L)
@@ -26,6 +28,8 @@ using NTSTATUS = std::uint32_t;
 
 #define STATUS_NO_MORE_FILES              ((NTSTATUS)0x80000006L)
 
+#define STATUS_INFO_LENGTH_MISMATCH       ((NTSTATUS)0xC0000004L)
+#define STATUS_END_OF_FILE                ((NTSTATUS)0xC0000011L)
 #define STATUS_ACCESS_DENIED              ((NTSTATUS)0xC0000022L)
 #define STATUS_BUFFER_TOO_SMALL           ((NTSTATUS)0xC0000023L)
 #define STATUS_OBJECT_NAME_NOT_FOUND      ((NTSTATUS)0xC0000034L)
@@ -38,6 +42,7 @@ using NTSTATUS = std::uint32_t;
 #define STATUS_NOT_FOUND                  ((NTSTATUS)0xC0000225L)
 #define STATUS_CONNECTION_REFUSED         ((NTSTATUS)0xC0000236L)
 #define STATUS_ADDRESS_ALREADY_ASSOCIATED ((NTSTATUS)0xC0000328L)
+#define STATUS_HEAP_CORRUPTION            ((NTSTATUS)0xC0000374L)
 
 #define STATUS_BUFFER_OVERFLOW            ((NTSTATUS)0x80000005L)
 
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 
 template <typename Traits>
 struct UNICODE_STRING
@@ -10,55 +11,196 @@ struct UNICODE_STRING
     EMULATOR_CAST(typename Traits::PVOID, char16_t*) Buffer;
 };
 
-inline std::string u16_to_u8(const std::u16string_view u16_view)
+namespace unicode_detail
 {
-    std::string utf8_str;
-    utf8_str.reserve(u16_view.size() * 2);
-    for (const char16_t ch : u16_view)
+    inline void append_utf8(std::string& str, const char32_t code_point)
     {
-        if (ch <= 0x7F)
+        if (code_point <= 0x7F)
+        {
+            str.push_back(static_cast<char>(code_point));
+        }
+        else if (code_point <= 0x7FF)
         {
-            utf8_str.push_back(static_cast<char>(ch));
+            str.push_back(static_cast<char>(0xC0 | (code_point >> 6)));
+            str.push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
         }
-        else if (ch <= 0x7FF)
+        else if (code_point <= 0xFFFF)
         {
-            utf8_str.push_back(static_cast<char>(0xC0 | (ch >> 6)));
-            utf8_str.push_back(static_cast<char>(0x80 | (ch & 0x3F)));
+            str.push_back(static_cast<char>(0xE0 | (code_point >> 12)));
+            str.push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+            str.push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
         }
         else
         {
-            utf8_str.push_back(static_cast<char>(0xE0 | (ch >> 12)));
-            utf8_str.push_back(static_cast<char>(0x80 | ((ch >> 6) & 0x3F)));
-            utf8_str.push_back(static_cast<char>(0x80 | (ch & 0x3F)));
+            str.push_back(static_cast<char>(0xF0 | (code_point >> 18)));
+            str.push_back(static_cast<char>(0x80 | ((code_point >> 12) & 0x3F)));
+            str.push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+            str.push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+        }
+    }
+
+    inline bool is_high_surrogate(const char32_t c)
+    {
+        return c >= 0xD800 && c <= 0xDBFF;
+    }
+
+    inline bool is_low_surrogate(const char32_t c)
+    {
+        return c >= 0xDC00 && c <= 0xDFFF;
+    }
+}
+
+// Runs of ASCII, which most names and paths consist of, are converted in blocks the compiler vectorizes.
+// Unpaired surrogates are encoded as they are, so names round-trip even if they aren't valid UTF-16.
+inline std::string u16_to_u8(const std::u16string_view u16_view)
+{
+    constexpr size_t BLOCK_SIZE = 8;
+
+    std::string utf8_str{};
+    utf8_str.reserve(u16_view.size());
+
+    const auto* data = u16_view.data();
+    const auto size = u16_view.size();
+
+    for (size_t i = 0; i < size;)
+    {
+        if (size - i >= BLOCK_SIZE)
+        {
+            char16_t combined = 0;
+            for (size_t j = 0; j < BLOCK_SIZE; ++j)
+            {
+                combined |= data[i + j];
+            }
+
+            if (combined <= 0x7F)
+            {
+                const auto offset = utf8_str.size();
+                utf8_str.resize(offset + BLOCK_SIZE);
+
+                for (size_t j = 0; j < BLOCK_SIZE; ++j)
+                {
+                    utf8_str[offset + j] = static_cast<char>(data[i + j]);
+                }
+
+                i += BLOCK_SIZE;
+                continue;
+            }
+        }
+
+        const char32_t ch = data[i++];
+
+        if (unicode_detail::is_high_surrogate(ch) && i < size && unicode_detail::is_low_surrogate(data[i]))
+        {
+            const char32_t low = data[i++];
+            unicode_detail::append_utf8(utf8_str, 0x10000 + ((ch - 0xD800) << 10) + (low - 0xDC00));
+            continue;
         }
+
+        unicode_detail::append_utf8(utf8_str, ch);
     }
+
     return utf8_str;
 }
 
-inline std::string w_to_u8(const std::wstring_view w_view)
+// Invalid sequences turn into U+FFFD
+inline std::u16string u8_to_u16(const std::string_view u8_view)
 {
-    std::string utf8_str;
-    utf8_str.reserve(w_view.size() * 2);
-    for (const wchar_t w_ch : w_view)
+    constexpr size_t BLOCK_SIZE = 8;
+
+    std::u16string u16_str{};
+    u16_str.reserve(u8_view.size());
+
+    const auto* data = reinterpret_cast<const unsigned char*>(u8_view.data());
+    const auto size = u8_view.size();
+
+    const auto is_continuation = [&](const size_t index) {
+        return index < size && (data[index] & 0xC0) == 0x80; //
+    };
+
+    for (size_t i = 0; i < size;)
     {
-        const auto ch = static_cast<char16_t>(w_ch);
-        if (ch <= 0x7F)
+        if (size - i >= BLOCK_SIZE)
+        {
+            unsigned char combined = 0;
+            for (size_t j = 0; j < BLOCK_SIZE; ++j)
+            {
+                combined |= data[i + j];
+            }
+
+            if (combined <= 0x7F)
+            {
+                u16_str.append(data + i, data + i + BLOCK_SIZE);
+                i += BLOCK_SIZE;
+                continue;
+            }
+        }
+
+        const auto lead = data[i];
+        char32_t code_point = 0xFFFD;
+        size_t length = 1;
+
+        if (lead <= 0x7F)
+        {
+            code_point = lead;
+        }
+        else if ((lead & 0xE0) == 0xC0 && is_continuation(i + 1))
+        {
+            code_point = ((lead & 0x1FU) << 6) | (data[i + 1] & 0x3FU);
+            length = 2;
+        }
+        else if ((lead & 0xF0) == 0xE0 && is_continuation(i + 1) && is_continuation(i + 2))
+        {
+            code_point = ((lead & 0x0FU) << 12) | ((data[i + 1] & 0x3FU) << 6) | (data[i + 2] & 0x3FU);
+            length = 3;
+        }
+        else if ((lead & 0xF8) == 0xF0 && is_continuation(i + 1) && is_continuation(i + 2) && is_continuation(i + 3))
+        {
+            code_point = ((lead & 0x07U) << 18) | ((data[i + 1] & 0x3FU) << 12) | ((data[i + 2] & 0x3FU) << 6) |
+                         (data[i + 3] & 0x3FU);
+            length = 4;
+        }
+
+        i += length;
+
+        if (code_point > 0x10FFFF)
         {
-            utf8_str.push_back(static_cast<char>(ch));
+            code_point = 0xFFFD;
         }
-        else if (ch <= 0x7FF)
+
+        if (code_point >= 0x10000)
         {
-            utf8_str.push_back(static_cast<char>(0xC0 | (ch >> 6)));
-            utf8_str.push_back(static_cast<char>(0x80 | (ch & 0x3F)));
+            code_point -= 0x10000;
+            u16_str.push_back(static_cast<char16_t>(0xD800 + (code_point >> 10)));
+            u16_str.push_back(static_cast<char16_t>(0xDC00 + (code_point & 0x3FF)));
         }
         else
         {
-            utf8_str.push_back(static_cast<char>(0xE0 | (ch >> 12)));
-            utf8_str.push_back(static_cast<char>(0x80 | ((ch >> 6) & 0x3F)));
-            utf8_str.push_back(static_cast<char>(0x80 | (ch & 0x3F)));
+            u16_str.push_back(static_cast<char16_t>(code_point));
         }
     }
-    return utf8_str;
+
+    return u16_str;
+}
+
+inline std::string w_to_u8(const std::wstring_view w_view)
+{
+    if constexpr (sizeof(wchar_t) == sizeof(char16_t))
+    {
+        return u16_to_u8(std::u16string_view(reinterpret_cast<const char16_t*>(w_view.data()), w_view.size()));
+    }
+    else
+    {
+        std::string utf8_str{};
+        utf8_str.reserve(w_view.size());
+
+        for (const wchar_t w_ch : w_view)
+        {
+            const auto code_point = static_cast<char32_t>(w_ch);
+            unicode_detail::append_utf8(utf8_str, code_point <= 0x10FFFF ? code_point : 0xFFFD);
+        }
+
+        return utf8_str;
+    }
 }
 
 #ifndef OS_WINDOWS
@@ -1,6 +1,11 @@
 #pragma once
 
 #include <mutex>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <exception>
 
 namespace utils::concurrency
 {
@@ -60,4 +65,61 @@ namespace utils::concurrency
         mutable MutexType mutex_{};
         T object_{};
     };
+
+    // Calls f(i) for every i in [0, count) on up to thread_count threads, the calling thread included.
+    // The first exception thrown by f is rethrown once all threads are done.
+    template <typename F>
+    void parallel_for(const size_t count, const size_t thread_count, const F& f)
+    {
+        std::atomic_size_t next_index{0};
+
+        std::mutex mutex{};
+        std::exception_ptr exception{};
+
+        const auto worker = [&] {
+            while (true)
+            {
+                const auto index = next_index++;
+                if (index >= count)
+                {
+                    return;
+                }
+
+                try
+                {
+                    f(index);
+                }
+                catch (...)
+                {
+                    std::lock_guard _{mutex};
+                    if (!exception)
+                    {
+                        exception = std::current_exception();
+                    }
+
+                    next_index = count;
+                }
+            }
+        };
+
+        std::vector<std::thread> threads{};
+        const auto worker_count = std::min(thread_count, count);
+
+        for (size_t i = 1; i < worker_count; ++i)
+        {
+            threads.emplace_back(worker);
+        }
+
+        worker();
+
+        for (auto& thread : threads)
+        {
+            thread.join();
+        }
+
+        if (exception)
+        {
+            std::rethrow_exception(exception);
+        }
+    }
 }
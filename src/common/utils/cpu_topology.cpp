@@ -0,0 +1,208 @@
+#include "cpu_topology.hpp"
+
+#include <map>
+#include <string>
+#include <ranges>
+#include <cstdlib>
+#include <fstream>
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#elif defined(__linux__)
+#include <sched.h>
+#include <filesystem>
+#endif
+
+namespace utils::cpu
+{
+    namespace
+    {
+        using node_map = std::map<uint32_t, std::vector<logical_processor>>;
+
+        std::vector<logical_processor> interleave_nodes(const node_map& nodes)
+        {
+            std::vector<logical_processor> processors{};
+
+            for (size_t i = 0;; ++i)
+            {
+                const auto previous_size = processors.size();
+
+                for (const auto& node : nodes | std::views::values)
+                {
+                    if (i < node.size())
+                    {
+                        processors.push_back(node[i]);
+                    }
+                }
+
+                if (processors.size() == previous_size)
+                {
+                    return processors;
+                }
+            }
+        }
+
+#ifdef _WIN32
+        node_map get_nodes()
+        {
+            DWORD length = 0;
+            (void)GetLogicalProcessorInformationEx(RelationNumaNode, nullptr, &length);
+
+            std::vector<uint8_t> buffer(length);
+            auto* info = reinterpret_cast<SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX*>(buffer.data());
+
+            if (!length || !GetLogicalProcessorInformationEx(RelationNumaNode, info, &length))
+            {
+                return {};
+            }
+
+            node_map nodes{};
+
+            for (DWORD offset = 0; offset < length;)
+            {
+                const auto* entry =
+                    reinterpret_cast<const SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX*>(buffer.data() + offset);
+                offset += entry->Size;
+
+                const auto& node = entry->NumaNode;
+                const auto& mask = node.GroupMask;
+
+                for (uint32_t i = 0; i < sizeof(mask.Mask) * 8; ++i)
+                {
+                    if (mask.Mask & (static_cast<KAFFINITY>(1) << i))
+                    {
+                        nodes[node.NodeNumber].push_back({mask.Group, i, node.NodeNumber});
+                    }
+                }
+            }
+
+            return nodes;
+        }
+#elif defined(__linux__)
+        // Parses lists like "0-3,8-11"
+        std::vector<uint32_t> parse_cpu_list(const std::string& list)
+        {
+            std::vector<uint32_t> cpus{};
+
+            size_t position = 0;
+            while (position < list.size())
+            {
+                auto end = list.find(',', position);
+                if (end == std::string::npos)
+                {
+                    end = list.size();
+                }
+
+                const auto range = list.substr(position, end - position);
+                position = end + 1;
+
+                const auto separator = range.find('-');
+                const auto first = static_cast<uint32_t>(strtoul(range.c_str(), nullptr, 10));
+                const auto last =
+                    separator == std::string::npos
+                        ? first
+                        : static_cast<uint32_t>(strtoul(range.c_str() + separator + 1, nullptr, 10));
+
+                for (auto cpu = first; cpu <= last; ++cpu)
+                {
+                    cpus.push_back(cpu);
+                }
+            }
+
+            return cpus;
+        }
+
+        node_map get_nodes()
+        {
+            cpu_set_t allowed{};
+            if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+            {
+                return {};
+            }
+
+            const auto is_allowed = [&](const uint32_t cpu) {
+                return cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed); //
+            };
+
+            node_map nodes{};
+
+            std::error_code ec{};
+            for (const auto& entry : std::filesystem::directory_iterator("/sys/devices/system/node", ec))
+            {
+                const auto name = entry.path().filename().string();
+                if (name.size() <= 4 || name.compare(0, 4, "node") != 0)
+                {
+                    continue;
+                }
+
+                std::ifstream file(entry.path() / "cpulist");
+                std::string list{};
+                std::getline(file, list);
+
+                const auto node = static_cast<uint32_t>(strtoul(name.c_str() + 4, nullptr, 10));
+
+                for (const auto cpu : parse_cpu_list(list))
+                {
+                    if (is_allowed(cpu))
+                    {
+                        nodes[node].push_back({0, cpu, node});
+                    }
+                }
+            }
+
+            if (!nodes.empty())
+            {
+                return nodes;
+            }
+
+            // No NUMA information, everything is one node
+            for (uint32_t cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+            {
+                if (is_allowed(cpu))
+                {
+                    nodes[0].push_back({0, cpu, 0});
+                }
+            }
+
+            return nodes;
+        }
+#else
+        node_map get_nodes()
+        {
+            return {};
+        }
+#endif
+    }
+
+    std::vector<logical_processor> get_processors()
+    {
+        return interleave_nodes(get_nodes());
+    }
+
+    bool pin_current_thread(const logical_processor& processor)
+    {
+#ifdef _WIN32
+        GROUP_AFFINITY affinity{};
+        affinity.Group = processor.group;
+        affinity.Mask = static_cast<KAFFINITY>(1) << processor.number;
+
+        return SetThreadGroupAffinity(GetCurrentThread(), &affinity, nullptr) != FALSE;
+#elif defined(__linux__)
+        if (processor.number >= CPU_SETSIZE)
+        {
+            return false;
+        }
+
+        cpu_set_t set{};
+        CPU_ZERO(&set);
+        CPU_SET(processor.number, &set);
+
+        return sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+        (void)processor;
+        return false;
+#endif
+    }
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+namespace utils::cpu
+{
+    struct logical_processor
+    {
+        uint16_t group{};
+        uint32_t number{};
+        uint32_t node{};
+    };
+
+    // Processors the process is allowed to run on. Consecutive entries alternate between NUMA nodes,
+    // assigning them in order spreads threads evenly. Empty if the host doesn't expose its topology.
+    std::vector<logical_processor> get_processors();
+
+    // Memory the thread touches first afterwards is usually allocated on the node of the processor
+    bool pin_current_thread(const logical_processor& processor);
+}
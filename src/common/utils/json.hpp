@@ -0,0 +1,49 @@
+#pragma once
+#include <cstdio>
+#include <string>
+#include <string_view>
+
+namespace utils::json
+{
+    // Appends the string quoted and escaped, control characters become \u escapes
+    inline void append_string(std::string& buffer, const std::string_view str)
+    {
+        buffer.push_back('"');
+
+        for (const auto chr : str)
+        {
+            switch (chr)
+            {
+            case '"':
+                buffer.append("\\\"");
+                break;
+            case '\\':
+                buffer.append("\\\\");
+                break;
+            case '\n':
+                buffer.append("\\n");
+                break;
+            case '\r':
+                buffer.append("\\r");
+                break;
+            case '\t':
+                buffer.append("\\t");
+                break;
+            default:
+                if (static_cast<unsigned char>(chr) < 0x20)
+                {
+                    char escaped[8]{};
+                    (void)snprintf(escaped, sizeof(escaped), "\\u%04X", static_cast<unsigned>(chr));
+                    buffer.append(escaped);
+                }
+                else
+                {
+                    buffer.push_back(chr);
+                }
+                break;
+            }
+        }
+
+        buffer.push_back('"');
+    }
+}
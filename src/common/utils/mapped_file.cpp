@@ -0,0 +1,230 @@
+#include "mapped_file.hpp"
+
+#include <stdexcept>
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+namespace utils
+{
+#ifdef _WIN32
+    mapped_file::mapped_file(const std::filesystem::path& file, const access mode, const size_t size)
+    {
+        const auto writable = mode == access::read_write;
+        const auto copy_on_write = mode == access::copy_on_write;
+
+        this->file_handle_ = CreateFileW(file.wstring().c_str(), GENERIC_READ | (writable ? GENERIC_WRITE : 0),
+                                         FILE_SHARE_READ | (writable ? 0 : FILE_SHARE_WRITE), nullptr,
+                                         writable ? OPEN_ALWAYS : OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+        if (this->file_handle_ == INVALID_HANDLE_VALUE)
+        {
+            this->file_handle_ = {};
+            throw std::runtime_error("Failed to open file for mapping: " + file.string());
+        }
+
+        LARGE_INTEGER file_size{};
+        GetFileSizeEx(this->file_handle_, &file_size);
+
+        this->size_ = static_cast<size_t>(file_size.QuadPart);
+
+        if (writable && size > this->size_)
+        {
+            LARGE_INTEGER new_size{};
+            new_size.QuadPart = static_cast<LONGLONG>(size);
+
+            if (!SetFilePointerEx(this->file_handle_, new_size, nullptr, FILE_BEGIN) ||
+                !SetEndOfFile(this->file_handle_))
+            {
+                this->release();
+                throw std::runtime_error("Failed to resize mapped file: " + file.string());
+            }
+
+            this->size_ = size;
+        }
+
+        if (!this->size_)
+        {
+            return;
+        }
+
+        const auto protection = writable ? PAGE_READWRITE : (copy_on_write ? PAGE_WRITECOPY : PAGE_READONLY);
+        this->mapping_handle_ = CreateFileMappingW(this->file_handle_, nullptr, protection, 0, 0, nullptr);
+
+        if (!this->mapping_handle_)
+        {
+            this->release();
+            throw std::runtime_error("Failed to create file mapping: " + file.string());
+        }
+
+        const auto view_access = writable ? FILE_MAP_WRITE : (copy_on_write ? FILE_MAP_COPY : FILE_MAP_READ);
+        this->data_ = static_cast<std::byte*>(MapViewOfFile(this->mapping_handle_, view_access, 0, 0, this->size_));
+
+        if (!this->data_)
+        {
+            this->release();
+            throw std::runtime_error("Failed to map file: " + file.string());
+        }
+    }
+
+    void mapped_file::flush() const
+    {
+        if (this->data_)
+        {
+            FlushViewOfFile(this->data_, this->size_);
+        }
+    }
+
+    void mapped_file::release()
+    {
+        if (this->data_)
+        {
+            UnmapViewOfFile(this->data_);
+        }
+
+        if (this->mapping_handle_)
+        {
+            CloseHandle(this->mapping_handle_);
+        }
+
+        if (this->file_handle_)
+        {
+            CloseHandle(this->file_handle_);
+        }
+
+        this->data_ = {};
+        this->size_ = {};
+        this->mapping_handle_ = {};
+        this->file_handle_ = {};
+    }
+
+    mapped_file& mapped_file::operator=(mapped_file&& obj) noexcept
+    {
+        if (this != &obj)
+        {
+            this->release();
+
+            this->data_ = obj.data_;
+            this->size_ = obj.size_;
+            this->file_handle_ = obj.file_handle_;
+            this->mapping_handle_ = obj.mapping_handle_;
+
+            obj.data_ = {};
+            obj.size_ = {};
+            obj.file_handle_ = {};
+            obj.mapping_handle_ = {};
+        }
+
+        return *this;
+    }
+#else
+    mapped_file::mapped_file(const std::filesystem::path& file, const access mode, const size_t size)
+    {
+        const auto writable = mode == access::read_write;
+
+        this->file_descriptor_ = open(file.c_str(), writable ? (O_RDWR | O_CREAT) : O_RDONLY, 0644);
+        if (this->file_descriptor_ < 0)
+        {
+            throw std::runtime_error("Failed to open file for mapping: " + file.string());
+        }
+
+        struct stat file_stat{};
+        if (fstat(this->file_descriptor_, &file_stat) != 0)
+        {
+            this->release();
+            throw std::runtime_error("Failed to query mapped file: " + file.string());
+        }
+
+        this->size_ = static_cast<size_t>(file_stat.st_size);
+
+        if (writable && size > this->size_)
+        {
+            if (ftruncate(this->file_descriptor_, static_cast<off_t>(size)) != 0)
+            {
+                this->release();
+                throw std::runtime_error("Failed to resize mapped file: " + file.string());
+            }
+
+            this->size_ = size;
+        }
+
+        if (!this->size_)
+        {
+            return;
+        }
+
+        const auto copy_on_write = mode == access::copy_on_write;
+        auto* data = mmap(nullptr, this->size_, PROT_READ | (writable || copy_on_write ? PROT_WRITE : 0),
+                          copy_on_write ? MAP_PRIVATE : MAP_SHARED, this->file_descriptor_, 0);
+
+        if (data == MAP_FAILED)
+        {
+            this->release();
+            throw std::runtime_error("Failed to map file: " + file.string());
+        }
+
+        this->data_ = static_cast<std::byte*>(data);
+    }
+
+    void mapped_file::flush() const
+    {
+        if (this->data_)
+        {
+            msync(this->data_, this->size_, MS_ASYNC);
+        }
+    }
+
+    void mapped_file::release()
+    {
+        if (this->data_)
+        {
+            munmap(this->data_, this->size_);
+        }
+
+        if (this->file_descriptor_ >= 0)
+        {
+            close(this->file_descriptor_);
+        }
+
+        this->data_ = {};
+        this->size_ = {};
+        this->file_descriptor_ = -1;
+    }
+
+    mapped_file& mapped_file::operator=(mapped_file&& obj) noexcept
+    {
+        if (this != &obj)
+        {
+            this->release();
+
+            this->data_ = obj.data_;
+            this->size_ = obj.size_;
+            this->file_descriptor_ = obj.file_descriptor_;
+
+            obj.data_ = {};
+            obj.size_ = {};
+            obj.file_descriptor_ = -1;
+        }
+
+        return *this;
+    }
+#endif
+
+    mapped_file::~mapped_file()
+    {
+        this->release();
+    }
+
+    mapped_file::mapped_file(mapped_file&& obj) noexcept
+    {
+        this->operator=(std::move(obj));
+    }
+}
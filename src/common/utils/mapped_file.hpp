@@ -0,0 +1,77 @@
+#pragma once
+
+#include <span>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+
+namespace utils
+{
+    class mapped_file
+    {
+      public:
+        enum class access
+        {
+            read,
+            read_write,
+            // Writable, but writes stay private to the mapping and never reach the file
+            copy_on_write,
+        };
+
+        mapped_file() = default;
+
+        // A non-zero size grows or creates the file, which requires read_write access
+        mapped_file(const std::filesystem::path& file, access mode = access::read, size_t size = 0);
+        ~mapped_file();
+
+        mapped_file(const mapped_file&) = delete;
+        mapped_file& operator=(const mapped_file&) = delete;
+
+        mapped_file(mapped_file&& obj) noexcept;
+        mapped_file& operator=(mapped_file&& obj) noexcept;
+
+        [[nodiscard]] operator bool() const
+        {
+            return this->data_ != nullptr;
+        }
+
+        std::byte* data()
+        {
+            return this->data_;
+        }
+
+        const std::byte* data() const
+        {
+            return this->data_;
+        }
+
+        size_t size() const
+        {
+            return this->size_;
+        }
+
+        std::span<std::byte> get_buffer()
+        {
+            return {this->data_, this->size_};
+        }
+
+        std::span<const std::byte> get_buffer() const
+        {
+            return {this->data_, this->size_};
+        }
+
+        void flush() const;
+        void release();
+
+      private:
+        std::byte* data_{};
+        size_t size_{};
+
+#ifdef _WIN32
+        void* file_handle_{};
+        void* mapping_handle_{};
+#else
+        int file_descriptor_{-1};
+#endif
+    };
+}
@@ -0,0 +1,89 @@
+#include "pattern_matcher.hpp"
+
+#include <queue>
+
+namespace utils
+{
+    namespace
+    {
+        constexpr auto NO_STATE = static_cast<uint32_t>(-1);
+    }
+
+    pattern_matcher::pattern_matcher(const std::vector<std::vector<std::byte>>& patterns)
+    {
+        std::array<uint32_t, 256> empty_state{};
+        empty_state.fill(NO_STATE);
+
+        this->transitions_.push_back(empty_state);
+        this->outputs_.emplace_back();
+
+        for (size_t i = 0; i < patterns.size(); ++i)
+        {
+            const auto& pattern = patterns[i];
+            this->pattern_lengths_.push_back(pattern.size());
+
+            // Empty patterns would match everywhere
+            if (pattern.empty())
+            {
+                continue;
+            }
+
+            uint32_t state = 0;
+
+            for (const auto value : pattern)
+            {
+                auto& next = this->transitions_[state][static_cast<uint8_t>(value)];
+                if (next == NO_STATE)
+                {
+                    next = static_cast<uint32_t>(this->transitions_.size());
+                    this->transitions_.push_back(empty_state);
+                    this->outputs_.emplace_back();
+                }
+
+                state = this->transitions_[state][static_cast<uint8_t>(value)];
+            }
+
+            this->outputs_[state].push_back(i);
+        }
+
+        // Breadth first, so the failure state of every state is complete before it's used
+        std::vector<uint32_t> failures(this->transitions_.size(), 0);
+        std::queue<uint32_t> states{};
+
+        for (auto& next : this->transitions_[0])
+        {
+            if (next == NO_STATE)
+            {
+                next = 0;
+            }
+            else
+            {
+                states.push(next);
+            }
+        }
+
+        while (!states.empty())
+        {
+            const auto state = states.front();
+            states.pop();
+
+            const auto failure = failures[state];
+            const auto& failure_outputs = this->outputs_[failure];
+            this->outputs_[state].insert(this->outputs_[state].end(), failure_outputs.begin(), failure_outputs.end());
+
+            for (size_t value = 0; value < 256; ++value)
+            {
+                auto& next = this->transitions_[state][value];
+
+                if (next == NO_STATE)
+                {
+                    next = this->transitions_[failure][value];
+                    continue;
+                }
+
+                failures[next] = this->transitions_[failure][value];
+                states.push(next);
+            }
+        }
+    }
+}
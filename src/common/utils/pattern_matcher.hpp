@@ -0,0 +1,62 @@
+#pragma once
+
+#include <span>
+#include <array>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+namespace utils
+{
+    // Finds all occurrences of many byte patterns in a single pass over the data (Aho-Corasick).
+    // The automaton is a full transition table, every input byte costs one table lookup regardless of the
+    // number of patterns. Each state takes 1 KB, which is meant for signature sets, not dictionaries.
+    class pattern_matcher
+    {
+      public:
+        pattern_matcher() = default;
+        pattern_matcher(const std::vector<std::vector<std::byte>>& patterns);
+
+        bool empty() const
+        {
+            return this->pattern_lengths_.empty();
+        }
+
+        size_t get_pattern_count() const
+        {
+            return this->pattern_lengths_.size();
+        }
+
+        size_t get_pattern_length(const size_t pattern) const
+        {
+            return this->pattern_lengths_.at(pattern);
+        }
+
+        // Callback gets the offset of each match and the index of its pattern
+        template <typename F>
+        void find(const std::span<const std::byte> data, F&& callback) const
+        {
+            if (this->empty())
+            {
+                return;
+            }
+
+            uint32_t state = 0;
+
+            for (size_t i = 0; i < data.size(); ++i)
+            {
+                state = this->transitions_[state][static_cast<uint8_t>(data[i])];
+
+                for (const auto pattern : this->outputs_[state])
+                {
+                    callback(i + 1 - this->pattern_lengths_[pattern], pattern);
+                }
+            }
+        }
+
+      private:
+        std::vector<std::array<uint32_t, 256>> transitions_{};
+        std::vector<std::vector<size_t>> outputs_{};
+        std::vector<size_t> pattern_lengths_{};
+    };
+}
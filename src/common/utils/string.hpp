@@ -6,19 +6,24 @@
 
 namespace utils::string
 {
+    // Branchless, so lowercasing whole strings gets vectorized. Only ASCII letters are folded, like tolower does
+    // in the C locale.
     inline char char_to_lower(const char val)
     {
-        return static_cast<char>(std::tolower(static_cast<unsigned char>(val)));
+        const auto is_upper = static_cast<unsigned char>(val - 'A') < 26;
+        return static_cast<char>(val + (is_upper * 32));
     }
 
     inline char16_t char_to_lower(const char16_t val)
     {
-        if (val >= u'A' && val <= u'Z')
-        {
-            return val + 32;
-        }
+        const auto is_upper = static_cast<char16_t>(val - u'A') < 26;
+        return static_cast<char16_t>(val + (is_upper * 32));
+    }
 
-        return val;
+    inline char16_t char_to_upper(const char16_t val)
+    {
+        const auto is_lower = static_cast<char16_t>(val - u'a') < 26;
+        return static_cast<char16_t>(val - (is_lower * 32));
     }
 
     inline wchar_t char_to_lower(const wchar_t val)
@@ -23,4 +23,29 @@ namespace utils
       private:
         typename Clock::time_point point_{Clock::now()};
     };
+
+    // Adds the time until its destruction to the duration
+    template <typename Clock = std::chrono::high_resolution_clock>
+    class scoped_timer
+    {
+      public:
+        explicit scoped_timer(std::chrono::nanoseconds& duration)
+            : duration_(&duration)
+        {
+        }
+
+        ~scoped_timer()
+        {
+            *this->duration_ += std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - this->start_);
+        }
+
+        scoped_timer(const scoped_timer&) = delete;
+        scoped_timer& operator=(const scoped_timer&) = delete;
+        scoped_timer(scoped_timer&&) = delete;
+        scoped_timer& operator=(scoped_timer&&) = delete;
+
+      private:
+        std::chrono::nanoseconds* duration_{};
+        typename Clock::time_point start_{Clock::now()};
+    };
 }
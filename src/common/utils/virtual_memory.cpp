@@ -0,0 +1,145 @@
+#include "virtual_memory.hpp"
+
+#include <new>
+#include <cstdint>
+#include <utility>
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+namespace utils
+{
+#if defined(__linux__)
+    namespace
+    {
+        constexpr size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+        // Over-allocates by one huge page and trims the mapping, so it starts on a huge page boundary
+        std::byte* map_huge_page_aligned(const size_t size)
+        {
+            constexpr size_t page_size = 0x1000;
+            const auto mapped_size = ((size + page_size - 1) & ~(page_size - 1)) + HUGE_PAGE_SIZE;
+
+            auto* data = mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (data == MAP_FAILED)
+            {
+                return nullptr;
+            }
+
+            auto* start = static_cast<std::byte*>(data);
+            const auto address = reinterpret_cast<uintptr_t>(start);
+            const auto head = ((address + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1)) - address;
+            const auto tail = HUGE_PAGE_SIZE - head;
+
+            if (head)
+            {
+                munmap(start, head);
+            }
+
+            if (tail)
+            {
+                munmap(start + mapped_size - tail, tail);
+            }
+
+            auto* aligned_data = start + head;
+            (void)madvise(aligned_data, mapped_size - HUGE_PAGE_SIZE, MADV_HUGEPAGE);
+
+            return aligned_data;
+        }
+    }
+#endif
+
+    virtual_memory::virtual_memory(const size_t size, const bool huge_pages)
+        : size_(size)
+    {
+        if (!size)
+        {
+            return;
+        }
+
+#ifdef _WIN32
+        // Large pages need SeLockMemoryPrivilege and can't be discarded, so they aren't used
+        (void)huge_pages;
+        this->data_ = static_cast<std::byte*>(VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE));
+#else
+#if defined(__linux__)
+        if (huge_pages)
+        {
+            this->data_ = map_huge_page_aligned(size);
+        }
+#else
+        (void)huge_pages;
+#endif
+
+        if (!this->data_)
+        {
+            auto* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            this->data_ = data == MAP_FAILED ? nullptr : static_cast<std::byte*>(data);
+        }
+#endif
+
+        if (!this->data_)
+        {
+            this->size_ = 0;
+            throw std::bad_alloc();
+        }
+    }
+
+    virtual_memory::~virtual_memory()
+    {
+        this->release();
+    }
+
+    virtual_memory::virtual_memory(virtual_memory&& obj) noexcept
+    {
+        this->operator=(std::move(obj));
+    }
+
+    virtual_memory& virtual_memory::operator=(virtual_memory&& obj) noexcept
+    {
+        if (this != &obj)
+        {
+            this->release();
+            this->data_ = std::exchange(obj.data_, nullptr);
+            this->size_ = std::exchange(obj.size_, 0);
+        }
+
+        return *this;
+    }
+
+    void virtual_memory::discard(const size_t offset, const size_t size) const
+    {
+        if (!this->data_ || !size)
+        {
+            return;
+        }
+
+#ifdef _WIN32
+        VirtualFree(this->data_ + offset, size, MEM_DECOMMIT);
+#else
+        madvise(this->data_ + offset, size, MADV_DONTNEED);
+#endif
+    }
+
+    void virtual_memory::release()
+    {
+        if (!this->data_)
+        {
+            return;
+        }
+
+#ifdef _WIN32
+        VirtualFree(this->data_, 0, MEM_RELEASE);
+#else
+        munmap(this->data_, this->size_);
+#endif
+
+        this->data_ = nullptr;
+        this->size_ = 0;
+    }
+}
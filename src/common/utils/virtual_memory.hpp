@@ -0,0 +1,51 @@
+#pragma once
+
+#include <span>
+#include <cstddef>
+
+namespace utils
+{
+    // Page aligned, zero initialized host memory. Pages only become resident once they are touched.
+    class virtual_memory
+    {
+      public:
+        virtual_memory() = default;
+        // Huge pages are a hint, the memory is 2 MB aligned and transparent huge pages are requested for it
+        virtual_memory(size_t size, bool huge_pages = false);
+        ~virtual_memory();
+
+        virtual_memory(const virtual_memory&) = delete;
+        virtual_memory& operator=(const virtual_memory&) = delete;
+
+        virtual_memory(virtual_memory&& obj) noexcept;
+        virtual_memory& operator=(virtual_memory&& obj) noexcept;
+
+        [[nodiscard]] operator bool() const
+        {
+            return this->data_ != nullptr;
+        }
+
+        std::byte* data() const
+        {
+            return this->data_;
+        }
+
+        size_t size() const
+        {
+            return this->size_;
+        }
+
+        std::span<std::byte> get_buffer() const
+        {
+            return {this->data_, this->size_};
+        }
+
+        // Hands the pages of the range back to the host, they must not be accessed anymore
+        void discard(size_t offset, size_t size) const;
+        void release();
+
+      private:
+        std::byte* data_{};
+        size_t size_{};
+    };
+}
@@ -1,12 +1,17 @@
 #pragma once
+#include <span>
 #include <chrono>
+#include <memory>
 #include <functional>
+#include <unordered_map>
 #include <cassert>
 
 #include "memory_manager.hpp"
 
 struct emulator_hook;
 
+using snapshot_id = uint64_t;
+
 using memory_operation = memory_permission;
 
 enum class instruction_hook_continuation : bool
@@ -41,12 +46,22 @@ using basic_block_hook_callback = std::function<void(const basic_block& block)>;
 using instruction_hook_callback = std::function<instruction_hook_continuation()>;
 
 using interrupt_hook_callback = std::function<void(int interrupt)>;
+using comparison_hook_callback = std::function<void(uint64_t address, uint64_t first, uint64_t second, size_t size)>;
 using simple_memory_hook_callback = std::function<void(uint64_t address, size_t size, uint64_t value)>;
 using complex_memory_hook_callback =
     std::function<void(uint64_t address, size_t size, uint64_t value, memory_operation operation)>;
 using memory_violation_hook_callback = std::function<memory_violation_continuation(
     uint64_t address, size_t size, memory_operation operation, memory_violation_type type)>;
 
+// State of a hook that is owned by the emulator and destroyed together with the hook
+struct hook_context
+{
+    virtual ~hook_context() = default;
+};
+
+using raw_memory_hook_callback = void (*)(hook_context& context, uint64_t address, size_t size, uint64_t value,
+                                          memory_operation operation);
+
 class emulator : public memory_manager
 {
   public:
@@ -61,17 +76,30 @@ class emulator : public memory_manager
     virtual void start(uint64_t start, uint64_t end = 0, std::chrono::nanoseconds timeout = {}, size_t count = 0) = 0;
     virtual void stop() = 0;
 
+    // Emulation stops in front of exit addresses, also when it starts at one. Unlike stopping from a hook, this
+    // costs nothing while running, only adding or removing an exit drops the translated code at the address.
+    virtual void add_exit_address(uint64_t address) = 0;
+    virtual void remove_exit_address(uint64_t address) = 0;
+
     virtual void read_raw_register(int reg, void* value, size_t size) = 0;
     virtual void write_raw_register(int reg, const void* value, size_t size) = 0;
 
+    // Transfers all registers in a single backend call, every value has to be large enough for its register
+    virtual void read_raw_registers(std::span<const int> regs, std::span<void* const> values) = 0;
+    virtual void write_raw_registers(std::span<const int> regs, std::span<const void* const> values) = 0;
+
     virtual std::vector<std::byte> save_registers() = 0;
+    // Reuses the capacity of register_data, so repeated saves into the same buffer don't allocate
+    virtual void save_registers(std::vector<std::byte>& register_data) = 0;
     virtual void restore_registers(const std::vector<std::byte>& register_data) = 0;
 
     virtual emulator_hook* hook_memory_violation(uint64_t address, size_t size,
                                                  memory_violation_hook_callback callback) = 0;
 
-    virtual emulator_hook* hook_memory_access(uint64_t address, size_t size, memory_operation filter,
-                                              complex_memory_hook_callback callback) = 0;
+    // Memory accesses are passed straight to the callback, the hook keeps the context alive
+    virtual emulator_hook* hook_raw_memory_access(uint64_t address, size_t size, memory_operation filter,
+                                                  raw_memory_hook_callback callback,
+                                                  std::unique_ptr<hook_context> context) = 0;
     virtual emulator_hook* hook_instruction(int instruction_type, instruction_hook_callback callback) = 0;
 
     virtual emulator_hook* hook_interrupt(interrupt_hook_callback callback) = 0;
@@ -79,25 +107,73 @@ class emulator : public memory_manager
     virtual emulator_hook* hook_edge_generation(edge_generation_hook_callback callback) = 0;
     virtual emulator_hook* hook_basic_block(basic_block_hook_callback callback) = 0;
 
+    // Reports both operands of compare instructions, sizes are in bytes
+    virtual emulator_hook* hook_comparison(comparison_hook_callback callback) = 0;
+
     virtual void delete_hook(emulator_hook* hook) = 0;
 
+    // Records AFL-style edge hit counts into the bitmap without invoking a hook callback.
+    // The bitmap size must be a power of two and it must stay valid until coverage is disabled.
+    virtual void enable_block_coverage(std::span<uint8_t> bitmap) = 0;
+    virtual void disable_block_coverage() = 0;
+
+    // Records the size of every executed block by its address, again without a hook callback.
+    // The map must stay valid until the trace is disabled.
+    virtual void enable_block_trace(std::unordered_map<uint64_t, uint32_t>& blocks) = 0;
+    virtual void disable_block_trace() = 0;
+
+    // Translates the blocks at the addresses ahead of their first execution, so the translation doesn't add to the
+    // latency of a run. Returns how many blocks could be translated.
+    virtual size_t prewarm_blocks(std::span<const uint64_t> addresses) = 0;
+
     emulator_hook* hook_memory_violation(memory_violation_hook_callback callback)
     {
         return this->hook_memory_violation(0, std::numeric_limits<size_t>::max(), std::move(callback));
     }
 
-    emulator_hook* hook_memory_read(const uint64_t address, const size_t size, simple_memory_hook_callback callback)
+    // The callback type is bound at compile time, so every access costs a single indirect call into a thunk
+    // with the callback inlined. std::function callbacks work as well, they just add their own indirection.
+    template <typename F>
+        requires(std::is_invocable_v<F&, uint64_t, size_t, uint64_t, memory_operation>)
+    emulator_hook* hook_memory_access(const uint64_t address, const size_t size, const memory_operation filter,
+                                      F callback)
+    {
+        struct callback_context : hook_context
+        {
+            explicit callback_context(F&& c)
+                : callback(std::move(c))
+            {
+            }
+
+            F callback;
+        };
+
+        constexpr raw_memory_hook_callback thunk = +[](hook_context& context, const uint64_t a, const size_t s,
+                                                       const uint64_t value, const memory_operation operation) {
+            static_cast<callback_context&>(context).callback(a, s, value, operation);
+        };
+
+        return this->hook_raw_memory_access(address, size, filter, thunk,
+                                            std::make_unique<callback_context>(std::move(callback)));
+    }
+
+    template <typename F>
+        requires(std::is_invocable_v<F&, uint64_t, size_t, uint64_t>)
+    emulator_hook* hook_memory_read(const uint64_t address, const size_t size, F callback)
     {
         return this->hook_simple_memory_access(address, size, std::move(callback), memory_operation::read);
     }
 
-    emulator_hook* hook_memory_write(const uint64_t address, const size_t size, simple_memory_hook_callback callback)
+    template <typename F>
+        requires(std::is_invocable_v<F&, uint64_t, size_t, uint64_t>)
+    emulator_hook* hook_memory_write(const uint64_t address, const size_t size, F callback)
     {
         return this->hook_simple_memory_access(address, size, std::move(callback), memory_operation::write);
     }
 
-    emulator_hook* hook_memory_execution(const uint64_t address, const size_t size,
-                                         simple_memory_hook_callback callback)
+    template <typename F>
+        requires(std::is_invocable_v<F&, uint64_t, size_t, uint64_t>)
+    emulator_hook* hook_memory_execution(const uint64_t address, const size_t size, F callback)
     {
         return this->hook_simple_memory_access(address, size, std::move(callback), memory_operation::exec);
     }
@@ -110,51 +186,221 @@ class emulator : public memory_manager
     void deserialize(utils::buffer_deserializer& buffer)
     {
         this->perform_deserialization(buffer, false);
+        this->snapshots_.clear();
+        this->current_snapshot_.reset();
+        this->default_snapshot_.reset();
     }
 
-    void save_snapshot()
+    // Leaves the memory contents to the image, which the state can only be loaded with
+    void serialize(utils::buffer_serializer& buffer, memory_image_writer& image) const
+    {
+        this->serialize_state(buffer, false);
+        this->serialize_memory_state(buffer, &image);
+    }
+
+    // The memory is mapped from a copy-on-write mapping of the image instead of being copied
+    void deserialize(utils::buffer_deserializer& buffer, std::shared_ptr<utils::mapped_file> image)
+    {
+        this->deserialize_state(buffer, false);
+        this->deserialize_memory_state(buffer, std::move(image));
+        this->snapshots_.clear();
+        this->current_snapshot_.reset();
+        this->default_snapshot_.reset();
+    }
+
+    // Live migration: after a full serialization, each round only carries the pages changed since the previous one.
+    // The receiver deserializes the full state, then applies the rounds in order.
+    void start_migration_tracking()
+    {
+        this->track_dirty_pages();
+        this->start_migration_page_tracking();
+    }
+
+    void serialize_migration_delta(utils::buffer_serializer& buffer)
+    {
+        this->serialize_state(buffer, false);
+        this->serialize_memory_delta(buffer);
+    }
+
+    void deserialize_migration_delta(utils::buffer_deserializer& buffer)
+    {
+        this->deserialize_state(buffer, false);
+        this->deserialize_memory_delta(buffer);
+        this->snapshots_.clear();
+        this->current_snapshot_.reset();
+        this->default_snapshot_.reset();
+    }
+
+    // Page trackers collect the pages changed while they run, any number of them can run at once
+    uint64_t start_page_tracker()
+    {
+        this->track_dirty_pages();
+        return this->add_page_tracker();
+    }
+
+    // Reports the first execution of every page the guest wrote while the watch runs, until stop_execution_watch
+    void start_execution_watch(written_execution_callback callback)
+    {
+        this->track_dirty_pages();
+        this->start_written_execution_watch(std::move(callback));
+    }
+
+    void track_dirty_pages()
+    {
+        if (!this->dirty_page_hook_)
+        {
+            this->dirty_page_hook_ =
+                this->hook_memory_write(0, std::numeric_limits<size_t>::max(),
+                                        [this](const uint64_t address, const size_t size, uint64_t) {
+                                            this->record_memory_write(address, size, true);
+                                        });
+        }
+
+        this->start_dirty_page_tracking();
+    }
+
+    // Snapshots form a tree, each one is derived from the snapshot that was current when it was created.
+    // Snapshots share their unchanged pages, and while the memory layout stays the same, creating or restoring
+    // one only costs the pages that differ from the current snapshot.
+    snapshot_id create_snapshot()
     {
+        const auto id = this->next_snapshot_id_++;
+
         utils::buffer_serializer serializer{};
-        this->perform_serialization(serializer, true);
-        this->last_snapshot_data_ = serializer.move_buffer();
+        this->serialize_state(serializer, true);
+
+        auto& snapshot = this->snapshots_[id];
+        snapshot.state = serializer.move_buffer();
+        snapshot.registers = this->save_registers();
+        snapshot.parent = this->current_snapshot_;
+
+        this->track_dirty_pages();
+        this->save_memory_snapshot(id);
+        this->current_snapshot_ = id;
+
+        return id;
+    }
+
+    bool restore_snapshot(const snapshot_id id)
+    {
+        const auto entry = this->snapshots_.find(id);
+        if (entry == this->snapshots_.end())
+        {
+            return false;
+        }
+
+        utils::buffer_deserializer deserializer{entry->second.state};
+        this->deserialize_state(deserializer, true);
+
+        this->restore_memory_snapshot(id);
+        this->current_snapshot_ = id;
+
+        return true;
+    }
+
+    void delete_snapshot(const snapshot_id id)
+    {
+        this->snapshots_.erase(id);
+        this->delete_memory_snapshot(id);
+
+        if (this->current_snapshot_ == id)
+        {
+            this->current_snapshot_.reset();
+        }
+
+        if (this->default_snapshot_ == id)
+        {
+            this->default_snapshot_.reset();
+        }
+    }
+
+    bool has_snapshot(const snapshot_id id) const
+    {
+        return this->snapshots_.contains(id);
+    }
+
+    std::optional<snapshot_id> get_snapshot_parent(const snapshot_id id) const
+    {
+        const auto entry = this->snapshots_.find(id);
+        return entry != this->snapshots_.end() ? entry->second.parent : std::nullopt;
+    }
+
+    // The snapshot last created or restored
+    std::optional<snapshot_id> get_current_snapshot() const
+    {
+        return this->current_snapshot_;
+    }
+
+    // Replaces the default snapshot
+    void save_snapshot()
+    {
+        const auto previous = this->default_snapshot_;
+        this->default_snapshot_ = this->create_snapshot();
+
+        if (previous)
+        {
+            this->delete_snapshot(*previous);
+        }
     }
 
     void restore_snapshot()
     {
-        if (this->last_snapshot_data_.empty())
+        if (this->default_snapshot_)
         {
-            return;
+            this->restore_snapshot(*this->default_snapshot_);
         }
+    }
 
-        utils::buffer_deserializer deserializer{this->last_snapshot_data_};
-        this->perform_deserialization(deserializer, true);
+    // Resets the registers and the written pages to the current snapshot, which is much cheaper than
+    // restore_snapshot. Returns false if the memory layout changed since, restore_snapshot is needed then.
+    bool reset_to_snapshot()
+    {
+        if (!this->current_snapshot_ || !this->revert_dirty_pages())
+        {
+            return false;
+        }
+
+        this->restore_registers(this->snapshots_.at(*this->current_snapshot_).registers);
+        return true;
     }
 
     virtual bool has_violation() const = 0;
 
   private:
-    std::vector<std::byte> last_snapshot_data_{};
-
-    emulator_hook* hook_simple_memory_access(const uint64_t address, const size_t size,
-                                             simple_memory_hook_callback callback, const memory_operation operation)
+    struct snapshot
+    {
+        std::vector<std::byte> state{};
+        std::vector<std::byte> registers{};
+        std::optional<snapshot_id> parent{};
+    };
+
+    std::map<snapshot_id, snapshot> snapshots_{};
+    snapshot_id next_snapshot_id_{1};
+    std::optional<snapshot_id> current_snapshot_{};
+    std::optional<snapshot_id> default_snapshot_{};
+    emulator_hook* dirty_page_hook_{};
+
+    template <typename F>
+    emulator_hook* hook_simple_memory_access(const uint64_t address, const size_t size, F callback,
+                                             const memory_operation operation)
     {
         assert((static_cast<uint8_t>(operation) & (static_cast<uint8_t>(operation) - 1)) == 0);
         return this->hook_memory_access(address, size, operation,
                                         [c = std::move(callback)](const uint64_t a, const size_t s,
                                                                   const uint64_t value,
-                                                                  memory_operation) { c(a, s, value); });
+                                                                  memory_operation) mutable { c(a, s, value); });
     }
 
     void perform_serialization(utils::buffer_serializer& buffer, const bool is_snapshot) const
     {
         this->serialize_state(buffer, is_snapshot);
-        this->serialize_memory_state(buffer, is_snapshot);
+        this->serialize_memory_state(buffer);
     }
 
     void perform_deserialization(utils::buffer_deserializer& buffer, const bool is_snapshot)
     {
         this->deserialize_state(buffer, is_snapshot);
-        this->deserialize_memory_state(buffer, is_snapshot);
+        this->deserialize_memory_state(buffer);
     }
 
     virtual void serialize_state(utils::buffer_serializer& buffer, bool is_snapshot) const = 0;
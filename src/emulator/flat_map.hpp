@@ -0,0 +1,151 @@
+#pragma once
+#include <vector>
+#include <tuple>
+#include <utility>
+#include <algorithm>
+
+// Sorted vector with the subset of the std::map interface used by the memory manager.
+// Unlike std::map, insertions and erasures invalidate iterators.
+template <typename Key, typename Value>
+class flat_map
+{
+  public:
+    using key_type = Key;
+    using mapped_type = Value;
+    using value_type = std::pair<Key, Value>;
+    using storage_type = std::vector<value_type>;
+    using iterator = typename storage_type::iterator;
+    using const_iterator = typename storage_type::const_iterator;
+
+    iterator begin()
+    {
+        return this->entries_.begin();
+    }
+
+    iterator end()
+    {
+        return this->entries_.end();
+    }
+
+    const_iterator begin() const
+    {
+        return this->entries_.begin();
+    }
+
+    const_iterator end() const
+    {
+        return this->entries_.end();
+    }
+
+    bool empty() const
+    {
+        return this->entries_.empty();
+    }
+
+    size_t size() const
+    {
+        return this->entries_.size();
+    }
+
+    void clear()
+    {
+        this->entries_.clear();
+    }
+
+    void reserve(const size_t size)
+    {
+        this->entries_.reserve(size);
+    }
+
+    iterator lower_bound(const Key& key)
+    {
+        return std::ranges::lower_bound(this->entries_, key, {}, &value_type::first);
+    }
+
+    const_iterator lower_bound(const Key& key) const
+    {
+        return std::ranges::lower_bound(this->entries_, key, {}, &value_type::first);
+    }
+
+    iterator upper_bound(const Key& key)
+    {
+        return std::ranges::upper_bound(this->entries_, key, {}, &value_type::first);
+    }
+
+    const_iterator upper_bound(const Key& key) const
+    {
+        return std::ranges::upper_bound(this->entries_, key, {}, &value_type::first);
+    }
+
+    iterator find(const Key& key)
+    {
+        const auto entry = this->lower_bound(key);
+        if (entry == this->end() || entry->first != key)
+        {
+            return this->end();
+        }
+
+        return entry;
+    }
+
+    const_iterator find(const Key& key) const
+    {
+        const auto entry = this->lower_bound(key);
+        if (entry == this->end() || entry->first != key)
+        {
+            return this->end();
+        }
+
+        return entry;
+    }
+
+    bool contains(const Key& key) const
+    {
+        return this->find(key) != this->end();
+    }
+
+    template <typename... Args>
+    std::pair<iterator, bool> try_emplace(const Key& key, Args&&... args)
+    {
+        const auto entry = this->lower_bound(key);
+        if (entry != this->end() && entry->first == key)
+        {
+            return {entry, false};
+        }
+
+        const auto result = this->entries_.emplace(entry, std::piecewise_construct, std::forward_as_tuple(key),
+                                                   std::forward_as_tuple(std::forward<Args>(args)...));
+        return {result, true};
+    }
+
+    template <typename K, typename V>
+    std::pair<iterator, bool> emplace(K&& key, V&& value)
+    {
+        return this->try_emplace(std::forward<K>(key), std::forward<V>(value));
+    }
+
+    Value& operator[](const Key& key)
+    {
+        return this->try_emplace(key).first->second;
+    }
+
+    iterator erase(const const_iterator entry)
+    {
+        return this->entries_.erase(entry);
+    }
+
+    size_t erase(const Key& key)
+    {
+        const auto entry = this->find(key);
+        if (entry == this->end())
+        {
+            return 0;
+        }
+
+        this->entries_.erase(entry);
+        return 1;
+    }
+
+  private:
+    storage_type entries_{};
+};
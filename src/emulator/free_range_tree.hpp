@@ -0,0 +1,240 @@
+#pragma once
+#include <vector>
+#include <limits>
+#include <cstdint>
+#include <utility>
+#include <optional>
+#include <algorithm>
+
+struct free_range
+{
+    uint64_t start{};
+    uint64_t end{};
+};
+
+// Disjoint address ranges ordered by start. Every node knows the largest range in its subtree, so a first-fit
+// lookup skips whole subtrees of holes that are too small instead of stepping over them one by one.
+// The tree is a treap whose priorities are derived from the range start, so its shape is deterministic.
+class free_range_tree
+{
+  public:
+    free_range_tree() = default;
+
+    free_range_tree(const free_range range)
+    {
+        this->insert(range);
+    }
+
+    void clear()
+    {
+        this->nodes_.clear();
+        this->free_nodes_.clear();
+        this->root_ = NO_NODE;
+    }
+
+    // Replaces the range that starts at the same address
+    void insert(const free_range range)
+    {
+        this->erase(range.start);
+
+        const auto node = this->allocate_node(range);
+
+        const auto [left, right] = this->split(this->root_, range.start);
+        this->root_ = this->merge(this->merge(left, node), right);
+    }
+
+    void erase(const uint64_t start)
+    {
+        if (!this->find(start))
+        {
+            return;
+        }
+
+        const auto [left, rest] = this->split(this->root_, start);
+        const auto [node, right] = this->split(rest, start + 1);
+
+        this->free_nodes_.push_back(node);
+        this->root_ = this->merge(left, right);
+    }
+
+    std::optional<free_range> find(const uint64_t start) const
+    {
+        const auto range = this->find_preceding(start);
+        if (!range || range->start != start)
+        {
+            return std::nullopt;
+        }
+
+        return range;
+    }
+
+    // The last range that starts at or before the address
+    std::optional<free_range> find_preceding(const uint64_t address) const
+    {
+        std::optional<free_range> result{};
+
+        auto current = this->root_;
+        while (current != NO_NODE)
+        {
+            const auto& node = this->nodes_[current];
+            if (node.range.start <= address)
+            {
+                result = node.range;
+                current = node.right;
+            }
+            else
+            {
+                current = node.left;
+            }
+        }
+
+        return result;
+    }
+
+    // The first range that ends after min_address, holds at least size bytes and is accepted by fits
+    template <typename F>
+    std::optional<free_range> find_first_fit(const uint64_t min_address, const uint64_t size, const F& fits) const
+    {
+        const auto node = this->find_first_fit(this->root_, min_address, size, fits);
+        if (node == NO_NODE)
+        {
+            return std::nullopt;
+        }
+
+        return this->nodes_[node].range;
+    }
+
+  private:
+    static constexpr uint32_t NO_NODE = std::numeric_limits<uint32_t>::max();
+
+    struct node
+    {
+        free_range range{};
+        uint64_t priority{};
+        uint64_t max_size{};
+        uint32_t left{NO_NODE};
+        uint32_t right{NO_NODE};
+    };
+
+    std::vector<node> nodes_{};
+    std::vector<uint32_t> free_nodes_{};
+    uint32_t root_{NO_NODE};
+
+    static uint64_t get_priority(uint64_t value)
+    {
+        value += 0x9E3779B97F4A7C15ULL;
+        value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        value = (value ^ (value >> 27)) * 0x94D049BB133111EBULL;
+        return value ^ (value >> 31);
+    }
+
+    uint32_t allocate_node(const free_range range)
+    {
+        node n{};
+        n.range = range;
+        n.priority = get_priority(range.start);
+        n.max_size = range.end - range.start;
+
+        if (this->free_nodes_.empty())
+        {
+            this->nodes_.push_back(n);
+            return static_cast<uint32_t>(this->nodes_.size() - 1);
+        }
+
+        const auto index = this->free_nodes_.back();
+        this->free_nodes_.pop_back();
+        this->nodes_[index] = n;
+
+        return index;
+    }
+
+    uint64_t get_max_size(const uint32_t index) const
+    {
+        return index == NO_NODE ? 0 : this->nodes_[index].max_size;
+    }
+
+    void update(const uint32_t index)
+    {
+        auto& n = this->nodes_[index];
+        n.max_size = std::max({n.range.end - n.range.start, this->get_max_size(n.left), this->get_max_size(n.right)});
+    }
+
+    // Ranges starting before the key go left, all others right
+    std::pair<uint32_t, uint32_t> split(const uint32_t index, const uint64_t key)
+    {
+        if (index == NO_NODE)
+        {
+            return {NO_NODE, NO_NODE};
+        }
+
+        auto& n = this->nodes_[index];
+
+        if (n.range.start < key)
+        {
+            const auto [left, right] = this->split(n.right, key);
+            this->nodes_[index].right = left;
+            this->update(index);
+            return {index, right};
+        }
+
+        const auto [left, right] = this->split(n.left, key);
+        this->nodes_[index].left = right;
+        this->update(index);
+        return {left, index};
+    }
+
+    uint32_t merge(const uint32_t left, const uint32_t right)
+    {
+        if (left == NO_NODE)
+        {
+            return right;
+        }
+
+        if (right == NO_NODE)
+        {
+            return left;
+        }
+
+        if (this->nodes_[left].priority > this->nodes_[right].priority)
+        {
+            const auto merged = this->merge(this->nodes_[left].right, right);
+            this->nodes_[left].right = merged;
+            this->update(left);
+            return left;
+        }
+
+        const auto merged = this->merge(left, this->nodes_[right].left);
+        this->nodes_[right].left = merged;
+        this->update(right);
+        return right;
+    }
+
+    template <typename F>
+    uint32_t find_first_fit(const uint32_t index, const uint64_t min_address, const uint64_t size,
+                            const F& fits) const
+    {
+        if (index == NO_NODE || this->nodes_[index].max_size < size)
+        {
+            return NO_NODE;
+        }
+
+        const auto& n = this->nodes_[index];
+
+        // Ranges are disjoint, the left subtree can only end after min_address if this one does
+        if (n.range.end > min_address)
+        {
+            const auto left = this->find_first_fit(n.left, min_address, size, fits);
+            if (left != NO_NODE)
+            {
+                return left;
+            }
+
+            if (n.range.end - n.range.start >= size && fits(n.range))
+            {
+                return index;
+            }
+        }
+
+        return this->find_first_fit(n.right, min_address, size, fits);
+    }
+};
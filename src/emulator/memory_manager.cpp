@@ -3,15 +3,61 @@
 #include "memory_region.hpp"
 #include "address_utils.hpp"
 
+#include <set>
+#include <unordered_set>
+#include <ranges>
+#include <array>
 #include <vector>
+#include <cstring>
 #include <optional>
 #include <stdexcept>
 #include <cassert>
+#include <algorithm>
+#include <limits>
+#include <mutex>
+#include <functional>
+
+#include <utils/concurrency.hpp>
 
 namespace
 {
     constexpr auto MIN_ALLOCATION_ADDRESS = 0x0000000000010000ULL;
     constexpr auto MAX_ALLOCATION_ADDRESS = 0x00007ffffffeffffULL;
+    constexpr uint64_t MEMORY_PAGE_SIZE = 0x1000;
+    constexpr auto FREE_RANGE_END = std::numeric_limits<uint64_t>::max();
+    constexpr auto MEMORY_PAGE_SHIFT = 12;
+    constexpr auto PAGES_PER_BITMAP_ENTRY = 64;
+
+    void mark_dirty_pages(std::unordered_map<uint64_t, uint64_t>& bitmap, const uint64_t address, const size_t size)
+    {
+        const auto first_page = address >> MEMORY_PAGE_SHIFT;
+        const auto last_page = (address + size - 1) >> MEMORY_PAGE_SHIFT;
+
+        for (auto page = first_page; page <= last_page; ++page)
+        {
+            bitmap[page / PAGES_PER_BITMAP_ENTRY] |= 1ULL << (page % PAGES_PER_BITMAP_ENTRY);
+        }
+    }
+
+    std::vector<uint64_t> collect_marked_pages(const std::unordered_map<uint64_t, uint64_t>& bitmap)
+    {
+        std::vector<uint64_t> pages{};
+
+        for (const auto& entry : bitmap)
+        {
+            for (int i = 0; i < PAGES_PER_BITMAP_ENTRY; ++i)
+            {
+                if (entry.second & (1ULL << i))
+                {
+                    pages.push_back(((entry.first * PAGES_PER_BITMAP_ENTRY) + static_cast<uint64_t>(i))
+                                    << MEMORY_PAGE_SHIFT);
+                }
+            }
+        }
+
+        std::ranges::sort(pages);
+        return pages;
+    }
 
     void split_regions(memory_manager::committed_region_map& regions, const std::vector<uint64_t>& split_points)
     {
@@ -23,10 +69,13 @@ namespace
                 {
                     const auto first_length = split_point - i->first;
                     const auto second_length = i->second.length - first_length;
+                    const auto permissions = i->second.pemissions;
+                    const auto index = i - regions.begin();
 
                     i->second.length = first_length;
 
-                    regions[split_point] = memory_manager::committed_region{second_length, i->second.pemissions};
+                    regions[split_point] = memory_manager::committed_region{second_length, permissions};
+                    i = regions.begin() + index;
                 }
             }
         }
@@ -61,496 +110,2699 @@ namespace
             regions.erase(next);
         }
     }
-}
 
-namespace utils
-{
-    static void serialize(buffer_serializer& buffer, const memory_manager::committed_region& region)
+    const memory_manager::committed_region* find_committed_region(
+        const memory_manager::reserved_region_map& regions, const uint64_t address)
     {
-        buffer.write<uint64_t>(region.length);
-        buffer.write(region.pemissions);
+        auto upper_bound = regions.upper_bound(address);
+        if (upper_bound == regions.begin())
+        {
+            return nullptr;
+        }
+
+        const auto& committed_regions = (--upper_bound)->second.committed_regions;
+        const auto entry = committed_regions.find(address);
+        if (entry == committed_regions.end())
+        {
+            return nullptr;
+        }
+
+        return &entry->second;
     }
 
-    static void deserialize(buffer_deserializer& buffer, memory_manager::committed_region& region)
+    const memory_manager::committed_region_map::value_type* find_committed_region_containing(
+        const memory_manager::reserved_region_map& regions, const uint64_t address)
     {
-        region.length = static_cast<size_t>(buffer.read<uint64_t>());
-        region.pemissions = buffer.read<memory_permission>();
+        auto upper_bound = regions.upper_bound(address);
+        if (upper_bound == regions.begin())
+        {
+            return nullptr;
+        }
+
+        const auto& committed_regions = (--upper_bound)->second.committed_regions;
+        auto committed_bound = committed_regions.upper_bound(address);
+        if (committed_bound == committed_regions.begin())
+        {
+            return nullptr;
+        }
+
+        const auto& entry = *(--committed_bound);
+        if (!is_within_start_and_length(address, entry.first, entry.second.length))
+        {
+            return nullptr;
+        }
+
+        return &entry;
     }
 
-    static void serialize(buffer_serializer& buffer, const memory_manager::reserved_region& region)
+    enum class memory_data_format : uint8_t
     {
-        buffer.write(region.is_mmio);
-        buffer.write<uint64_t>(region.length);
-        buffer.write_map(region.committed_regions);
-    }
+        raw,
+        deduplicated,
+        // Offsets into a memory image
+        image,
+    };
 
-    static void deserialize(buffer_deserializer& buffer, memory_manager::reserved_region& region)
+    enum class memory_data_layout : uint8_t
     {
-        buffer.read(region.is_mmio);
-        region.length = static_cast<size_t>(buffer.read<uint64_t>());
-        buffer.read_map(region.committed_regions);
-    }
-}
+        sequential,
+        chunked,
+    };
 
-void memory_manager::serialize_memory_state(utils::buffer_serializer& buffer, const bool is_snapshot) const
-{
-    buffer.write_map(this->reserved_regions_);
+    // Regions are grouped into chunks of at least this size, large regions form a chunk on their own
+    constexpr size_t MEMORY_CHUNK_SIZE = 0x1000000;
 
-    if (is_snapshot)
+    struct memory_chunk
     {
-        return;
-    }
+        uint64_t region_count{};
+        uint64_t size{};
+    };
+
+    enum class page_encoding : uint8_t
+    {
+        literal,
+        zero,
+        duplicate,
+        stored,
+    };
 
-    std::vector<uint8_t> data{};
+    using known_page_map = std::map<page_hash, uint64_t>;
+    using page_reader = std::function<void(uint64_t address, std::span<std::byte> data)>;
 
-    for (const auto& reserved_region : this->reserved_regions_)
+    using region_list = std::vector<const memory_manager::committed_region_map::value_type*>;
+
+    region_list collect_memory_regions(const memory_manager::reserved_region_map& regions)
     {
-        if (reserved_region.second.is_mmio)
+        region_list result{};
+
+        for (const auto& reserved_region : regions)
         {
-            continue;
+            if (reserved_region.second.is_mmio)
+            {
+                continue;
+            }
+
+            for (const auto& region : reserved_region.second.committed_regions)
+            {
+                result.push_back(&region);
+            }
         }
 
-        for (const auto& region : reserved_region.second.committed_regions)
-        {
-            data.resize(region.second.length);
+        return result;
+    }
+
+    bool is_same_layout(const memory_manager::reserved_region_map& regions,
+                        const memory_manager::reserved_region_map& other_regions)
+    {
+        const auto is_memory = [](const auto& entry) { return !entry.second.is_mmio; };
 
-            this->read_memory(region.first, data.data(), region.second.length);
+        const auto is_same_region = [](const auto& region, const auto& other_region) {
+            return region.first == other_region.first && region.second.length == other_region.second.length &&
+                   region.second.pemissions == other_region.second.pemissions;
+        };
 
-            buffer.write(data.data(), region.second.length);
-        }
+        const auto is_same_reserved_region = [&](const auto& entry, const auto& other_entry) {
+            return entry.first == other_entry.first && entry.second.length == other_entry.second.length &&
+                   std::ranges::equal(entry.second.committed_regions, other_entry.second.committed_regions,
+                                      is_same_region);
+        };
+
+        return std::ranges::equal(regions | std::views::filter(is_memory),
+                                  other_regions | std::views::filter(is_memory), is_same_reserved_region);
     }
-}
 
-void memory_manager::deserialize_memory_state(utils::buffer_deserializer& buffer, const bool is_snapshot)
-{
-    if (!is_snapshot)
+    std::vector<region_list> split_into_chunks(const region_list& regions)
     {
-        for (const auto& reserved_region : this->reserved_regions_)
+        std::vector<region_list> chunks{};
+        size_t chunk_size = MEMORY_CHUNK_SIZE;
+
+        for (const auto* region : regions)
         {
-            for (const auto& region : reserved_region.second.committed_regions)
+            if (chunk_size >= MEMORY_CHUNK_SIZE)
             {
-                this->unmap_memory(region.first, region.second.length);
+                chunks.emplace_back();
+                chunk_size = 0;
             }
-        }
-    }
 
-    buffer.read_map(this->reserved_regions_);
+            chunks.back().push_back(region);
+            chunk_size += region->second.length;
+        }
 
-    if (is_snapshot)
-    {
-        return;
+        return chunks;
     }
 
-    std::vector<uint8_t> data{};
-
-    for (auto i = this->reserved_regions_.begin(); i != this->reserved_regions_.end();)
+    // Memory of the regions of a single chunk, duplicate pages only reference pages of their own chunk
+    class chunk_memory
     {
-        auto& reserved_region = i->second;
-        if (reserved_region.is_mmio)
+      public:
+        std::span<std::byte> add(const uint64_t address, const size_t length)
         {
-            i = this->reserved_regions_.erase(i);
-            continue;
+            auto& data = this->regions_[address];
+            data.resize(length);
+            return data;
         }
 
-        ++i;
-
-        for (const auto& region : reserved_region.committed_regions)
+        void read(const uint64_t address, const std::span<std::byte> data) const
         {
-            data.resize(region.second.length);
+            auto entry = this->regions_.upper_bound(address);
+            if (entry == this->regions_.begin())
+            {
+                throw std::runtime_error("Bad duplicate memory page");
+            }
 
-            buffer.read(data.data(), region.second.length);
+            --entry;
 
-            this->map_memory(region.first, region.second.length, region.second.pemissions);
-            this->write_memory(region.first, data.data(), region.second.length);
-        }
-    }
-}
+            const auto offset = address - entry->first;
+            if (offset > entry->second.size() || data.size() > entry->second.size() - offset)
+            {
+                throw std::runtime_error("Bad duplicate memory page");
+            }
 
-bool memory_manager::protect_memory(const uint64_t address, const size_t size, const memory_permission permissions,
-                                    memory_permission* old_permissions)
-{
-    const auto entry = this->find_reserved_region(address);
-    if (entry == this->reserved_regions_.end())
-    {
-        return false;
-    }
+            memcpy(data.data(), entry->second.data() + offset, data.size());
+        }
 
-    const auto end = address + size;
-    const auto region_end = entry->first + entry->second.length;
+      private:
+        std::map<uint64_t, std::vector<std::byte>> regions_{};
+    };
 
-    if (region_end < end)
+    bool is_zero_page(const std::span<const std::byte> page)
     {
-        throw std::runtime_error("Cross region protect not supported yet!");
+        return std::ranges::all_of(page, [](const std::byte value) { return value == std::byte{0}; });
     }
 
-    std::optional<memory_permission> old_first_permissions{};
+    bool is_same_page(const page_reader& read_page, const uint64_t address, const std::span<const std::byte> page)
+    {
+        std::array<std::byte, MEMORY_PAGE_SIZE> known_page{};
+        read_page(address, std::span(known_page.data(), page.size()));
 
-    auto& committed_regions = entry->second.committed_regions;
-    split_regions(committed_regions, {address, end});
+        return memcmp(known_page.data(), page.data(), page.size()) == 0;
+    }
 
-    for (auto& sub_region : committed_regions)
+    void serialize_pages(utils::buffer_serializer& buffer, const page_reader& read_page, page_store* store,
+                         known_page_map& known_pages, const uint64_t address, const std::span<const std::byte> data)
     {
-        if (sub_region.first >= end)
+        for (size_t offset = 0; offset < data.size(); offset += MEMORY_PAGE_SIZE)
         {
-            break;
-        }
+            const auto page_size = std::min(data.size() - offset, static_cast<size_t>(MEMORY_PAGE_SIZE));
+            const auto page = data.subspan(offset, page_size);
 
-        const auto sub_region_end = sub_region.first + sub_region.second.length;
-        if (sub_region.first >= address && sub_region_end <= end)
-        {
-            if (!old_first_permissions.has_value())
+            if (is_zero_page(page))
             {
-                old_first_permissions = sub_region.second.pemissions;
+                buffer.write(page_encoding::zero);
+                continue;
             }
 
-            this->apply_memory_protection(sub_region.first, sub_region.second.length, permissions);
-            sub_region.second.pemissions = permissions;
+            const auto hash = hash_page(page);
+            const auto [known_page, inserted] = known_pages.try_emplace(hash, address + offset);
+
+            if (!inserted && is_same_page(read_page, known_page->second, page))
+            {
+                buffer.write(page_encoding::duplicate);
+                buffer.write(known_page->second);
+                continue;
+            }
+
+            // Colliding pages are kept inline, the store could only hold one of them
+            if (store && inserted)
+            {
+                store->store(hash, page);
+
+                buffer.write(page_encoding::stored);
+                buffer.write(hash.low);
+                buffer.write(hash.high);
+                continue;
+            }
+
+            buffer.write(page_encoding::literal);
+            buffer.write(page.data(), page.size());
         }
     }
 
-    if (old_permissions)
+    void deserialize_pages(utils::buffer_deserializer& buffer, const page_reader& read_page, const page_store* store,
+                           const uint64_t address, const std::span<std::byte> data)
     {
-        *old_permissions = old_first_permissions.value_or(memory_permission::none);
-    }
+        for (size_t offset = 0; offset < data.size(); offset += MEMORY_PAGE_SIZE)
+        {
+            const auto page_size = std::min(data.size() - offset, static_cast<size_t>(MEMORY_PAGE_SIZE));
+            const auto page = data.subspan(offset, page_size);
 
-    merge_regions(committed_regions);
-    return true;
-}
+            switch (buffer.read<page_encoding>())
+            {
+            case page_encoding::literal:
+                buffer.read(page.data(), page.size());
+                break;
 
-bool memory_manager::allocate_mmio(const uint64_t address, const size_t size, mmio_read_callback read_cb,
-                                   mmio_write_callback write_cb)
-{
-    if (this->overlaps_reserved_region(address, size))
-    {
-        return false;
-    }
+            case page_encoding::zero:
+                std::ranges::fill(page, std::byte{0});
+                break;
 
-    this->map_mmio(address, size, std::move(read_cb), std::move(write_cb));
+            case page_encoding::duplicate: {
+                const auto source = buffer.read<uint64_t>();
 
-    const auto entry = this->reserved_regions_
-                           .try_emplace(address,
-                                        reserved_region{
-                                            .length = size,
-                                            .is_mmio = true,
-                                        })
-                           .first;
+                // Pages of the current region are not available through the reader yet
+                if (is_within_start_and_length(source, address, offset))
+                {
+                    if (offset - (source - address) < page.size())
+                    {
+                        throw std::runtime_error("Bad duplicate memory page");
+                    }
 
-    entry->second.committed_regions[address] = committed_region{size, memory_permission::read_write};
+                    memcpy(page.data(), data.data() + (source - address), page.size());
+                }
+                else
+                {
+                    read_page(source, page);
+                }
 
-    return true;
+                break;
+            }
+
+            case page_encoding::stored: {
+                page_hash hash{};
+                buffer.read(hash.low);
+                buffer.read(hash.high);
+
+                if (!store || !store->load(hash, page))
+                {
+                    throw std::runtime_error("Memory page not found in page store: " + hash.to_string());
+                }
+
+                break;
+            }
+
+            default:
+                throw std::runtime_error("Bad memory page encoding");
+            }
+        }
+    }
 }
 
-bool memory_manager::allocate_memory(const uint64_t address, const size_t size, const memory_permission permissions,
-                                     const bool reserve_only)
+namespace utils
 {
-    if (this->overlaps_reserved_region(address, size))
+    static void serialize(buffer_serializer& buffer, const memory_manager::committed_region& region)
     {
-        return false;
+        buffer.write<uint64_t>(region.length);
+        buffer.write(region.pemissions);
     }
 
-    const auto entry = this->reserved_regions_
-                           .try_emplace(address,
-                                        reserved_region{
-                                            .length = size,
-                                        })
-                           .first;
+    static void deserialize(buffer_deserializer& buffer, memory_manager::committed_region& region)
+    {
+        region.length = static_cast<size_t>(buffer.read<uint64_t>());
+        region.pemissions = buffer.read<memory_permission>();
+    }
 
-    if (!reserve_only)
+    static void serialize(buffer_serializer& buffer, const memory_manager::reserved_region& region)
     {
-        this->map_memory(address, size, permissions);
-        entry->second.committed_regions[address] = committed_region{size, memory_permission::read_write};
+        buffer.write(region.is_mmio);
+        buffer.write<uint64_t>(region.length);
+        buffer.write_map(region.committed_regions);
     }
 
-    return true;
+    static void deserialize(buffer_deserializer& buffer, memory_manager::reserved_region& region)
+    {
+        buffer.read(region.is_mmio);
+        region.length = static_cast<size_t>(buffer.read<uint64_t>());
+        buffer.read_map(region.committed_regions);
+    }
 }
 
-bool memory_manager::commit_memory(const uint64_t address, const size_t size, const memory_permission permissions)
+void memory_manager::serialize_memory_state(utils::buffer_serializer& buffer, memory_image_writer* image) const
 {
-    const auto entry = this->find_reserved_region(address);
-    if (entry == this->reserved_regions_.end())
+    buffer.write_map(this->reserved_regions_);
+
+    if (image)
     {
-        return false;
-    }
+        buffer.write(memory_data_format::image);
+        buffer.write(memory_data_layout::sequential);
 
-    const auto end = address + size;
-    const auto region_end = entry->first + entry->second.length;
+        std::vector<std::byte> data{};
 
-    if (region_end < end)
-    {
-        throw std::runtime_error("Cross region commit not supported yet!");
+        for (const auto* region : collect_memory_regions(this->reserved_regions_))
+        {
+            data.resize(region->second.length);
+            this->read_memory(region->first, data.data(), data.size());
+            buffer.write(image->write(data));
+        }
+
+        this->serialize_section_views(buffer);
+        return;
     }
 
-    auto& committed_regions = entry->second.committed_regions;
-    split_regions(committed_regions, {address, end});
+    const auto format = this->deduplicate_pages_ ? memory_data_format::deduplicated : memory_data_format::raw;
+    const auto layout =
+        this->serialization_threads_ > 1 ? memory_data_layout::chunked : memory_data_layout::sequential;
 
-    uint64_t last_region_start{};
-    const committed_region* last_region{nullptr};
+    buffer.write(format);
+    buffer.write(layout);
 
-    for (auto& sub_region : committed_regions)
+    const auto regions = collect_memory_regions(this->reserved_regions_);
+
+    if (layout == memory_data_layout::sequential)
     {
-        if (sub_region.first >= end)
-        {
-            break;
-        }
+        const page_reader read_page = [this](const uint64_t address, const std::span<std::byte> data) {
+            this->read_memory(address, data.data(), data.size());
+        };
 
-        const auto sub_region_end = sub_region.first + sub_region.second.length;
-        if (sub_region.first >= address && sub_region_end <= end)
-        {
-            const auto map_start = last_region ? (last_region_start + last_region->length) : address;
-            const auto map_length = sub_region.first - map_start;
+        std::vector<std::byte> data{};
+        known_page_map known_pages{};
 
-            if (map_length > 0)
+        for (const auto* region : regions)
+        {
+            if (format == memory_data_format::raw)
             {
-                this->map_memory(map_start, map_length, permissions);
-                committed_regions[map_start] = committed_region{map_length, permissions};
+                buffer.write_in_place(region->second.length,
+                                      [&](const std::span<std::byte> target) { read_page(region->first, target); });
+                continue;
             }
 
-            last_region_start = sub_region.first;
-            last_region = &sub_region.second;
+            data.resize(region->second.length);
+            read_page(region->first, data);
+
+            serialize_pages(buffer, read_page, this->page_store_.get(), known_pages, region->first, data);
         }
+
+        this->serialize_section_views(buffer);
+        return;
     }
 
-    if (!last_region || (last_region_start + last_region->length) < end)
-    {
-        const auto map_start = last_region ? (last_region_start + last_region->length) : address;
-        const auto map_length = end - map_start;
+    const auto chunks = split_into_chunks(regions);
+    std::vector<utils::buffer_serializer> chunk_buffers(chunks.size());
 
-        this->map_memory(map_start, map_length, permissions);
-        committed_regions[map_start] = committed_region{map_length, permissions};
-    }
+    // Only the encoding runs in parallel, the emulator's memory is not accessed concurrently
+    std::mutex memory_mutex{};
 
-    merge_regions(committed_regions);
-    return true;
+    utils::concurrency::parallel_for(chunks.size(), this->serialization_threads_, [&](const size_t index) {
+        auto& chunk_buffer = chunk_buffers[index];
+
+        if (format == memory_data_format::raw)
+        {
+            std::lock_guard _{memory_mutex};
+
+            for (const auto* region : chunks[index])
+            {
+                chunk_buffer.write_in_place(region->second.length, [&](const std::span<std::byte> target) {
+                    this->read_memory(region->first, target.data(), target.size());
+                });
+            }
+
+            return;
+        }
+
+        chunk_memory memory{};
+        std::vector<std::span<std::byte>> region_data{};
+
+        {
+            std::lock_guard _{memory_mutex};
+
+            for (const auto* region : chunks[index])
+            {
+                const auto data = memory.add(region->first, region->second.length);
+                this->read_memory(region->first, data.data(), data.size());
+                region_data.push_back(data);
+            }
+        }
+
+        const page_reader read_page = [&memory](const uint64_t address, const std::span<std::byte> data) {
+            memory.read(address, data);
+        };
+
+        known_page_map known_pages{};
+
+        for (size_t i = 0; i < region_data.size(); ++i)
+        {
+            serialize_pages(chunk_buffer, read_page, this->page_store_.get(), known_pages, chunks[index][i]->first,
+                            region_data[i]);
+        }
+    });
+
+    std::vector<memory_chunk> chunk_index{};
+    size_t total_size = 0;
+
+    for (size_t i = 0; i < chunks.size(); ++i)
+    {
+        const auto size = chunk_buffers[i].get_buffer().size();
+        chunk_index.push_back({chunks[i].size(), size});
+        total_size += size;
+    }
+
+    buffer.write_vector(chunk_index);
+
+    // A single write, so the chunks can be read back with a single read
+    buffer.write_in_place(total_size, [&](const std::span<std::byte> target) {
+        size_t offset = 0;
+
+        for (const auto& chunk_buffer : chunk_buffers)
+        {
+            const auto& data = chunk_buffer.get_buffer();
+            std::ranges::copy(data, target.begin() + static_cast<ptrdiff_t>(offset));
+            offset += data.size();
+        }
+    });
+
+    this->serialize_section_views(buffer);
+}
+
+void memory_manager::deserialize_memory_state(utils::buffer_deserializer& buffer,
+                                              std::shared_ptr<utils::mapped_file> image)
+{
+    this->unmap_all_regions();
+
+    buffer.read_map(this->reserved_regions_);
+
+    const auto format = buffer.read<memory_data_format>();
+    if (format != memory_data_format::raw && format != memory_data_format::deduplicated &&
+        format != memory_data_format::image)
+    {
+        throw std::runtime_error("Bad memory data format");
+    }
+
+    if (format == memory_data_format::image && !image)
+    {
+        throw std::runtime_error("Memory image required");
+    }
+
+    const auto layout = buffer.read<memory_data_layout>();
+    if (layout != memory_data_layout::sequential && layout != memory_data_layout::chunked)
+    {
+        throw std::runtime_error("Bad memory data layout");
+    }
+
+    for (auto i = this->reserved_regions_.begin(); i != this->reserved_regions_.end();)
+    {
+        if (i->second.is_mmio)
+        {
+            i = this->reserved_regions_.erase(i);
+        }
+        else
+        {
+            ++i;
+        }
+    }
+
+    const auto regions = collect_memory_regions(this->reserved_regions_);
+
+    if (format == memory_data_format::image)
+    {
+        this->memory_image_ = std::move(image);
+
+        for (const auto* region : regions)
+        {
+            this->map_image_data(region->first, region->second, buffer.read<uint64_t>());
+        }
+    }
+    else if (layout == memory_data_layout::sequential)
+    {
+        const page_reader read_page = [this](const uint64_t address, const std::span<std::byte> data) {
+            this->read_memory(address, data.data(), data.size());
+        };
+
+        std::vector<std::byte> data{};
+
+        for (const auto* region : regions)
+        {
+            std::span<const std::byte> region_data{};
+
+            if (format == memory_data_format::raw)
+            {
+                region_data = buffer.read_data(region->second.length);
+            }
+            else
+            {
+                data.resize(region->second.length);
+                deserialize_pages(buffer, read_page, this->page_store_.get(), region->first, data);
+                region_data = data;
+            }
+
+            this->map_region_data(region->first, region->second, region_data);
+        }
+    }
+    else
+    {
+        const auto chunk_index = buffer.read_vector<memory_chunk>();
+
+        std::vector<size_t> chunk_offsets{};
+        size_t region_count = 0;
+        size_t total_size = 0;
+
+        const auto remaining_size = buffer.get_remaining_size();
+
+        for (const auto& chunk : chunk_index)
+        {
+            if (chunk.region_count > regions.size() - region_count || chunk.size > remaining_size - total_size)
+            {
+                throw std::runtime_error("Bad memory chunk index");
+            }
+
+            chunk_offsets.push_back(total_size);
+            region_count += static_cast<size_t>(chunk.region_count);
+            total_size += static_cast<size_t>(chunk.size);
+        }
+
+        if (region_count != regions.size())
+        {
+            throw std::runtime_error("Bad memory chunk index");
+        }
+
+        const auto chunk_data = buffer.read_data(total_size);
+
+        std::vector<size_t> first_regions{};
+        region_count = 0;
+
+        for (const auto& chunk : chunk_index)
+        {
+            first_regions.push_back(region_count);
+            region_count += static_cast<size_t>(chunk.region_count);
+        }
+
+        // Chunks are decoded in parallel, mapping them into the emulator is serialized
+        std::mutex memory_mutex{};
+
+        utils::concurrency::parallel_for(chunk_index.size(), this->serialization_threads_, [&](const size_t index) {
+            const auto& chunk = chunk_index[index];
+            utils::buffer_deserializer chunk_buffer{
+                chunk_data.subspan(chunk_offsets[index], static_cast<size_t>(chunk.size))};
+
+            const std::span chunk_regions(regions.data() + first_regions[index],
+                                          static_cast<size_t>(chunk.region_count));
+
+            chunk_memory memory{};
+            const page_reader read_page = [&memory](const uint64_t address, const std::span<std::byte> data) {
+                memory.read(address, data);
+            };
+
+            std::vector<std::span<const std::byte>> region_data{};
+
+            for (const auto* region : chunk_regions)
+            {
+                if (format == memory_data_format::raw)
+                {
+                    region_data.push_back(chunk_buffer.read_data(region->second.length));
+                    continue;
+                }
+
+                const auto data = memory.add(region->first, region->second.length);
+                deserialize_pages(chunk_buffer, read_page, this->page_store_.get(), region->first, data);
+                region_data.push_back(data);
+            }
+
+            std::lock_guard _{memory_mutex};
+
+            for (size_t i = 0; i < chunk_regions.size(); ++i)
+            {
+                this->map_region_data(chunk_regions[i]->first, chunk_regions[i]->second, region_data[i]);
+            }
+        });
+    }
+
+    this->deserialize_section_views(buffer);
+
+    this->rebuild_free_ranges();
+    this->recount_committed_bytes();
+
+    this->memory_snapshots_.clear();
+    this->base_snapshot_.reset();
+    this->clear_dirty_pages();
+    this->migration_page_bitmap_.clear();
+}
+
+void memory_manager::start_migration_page_tracking()
+{
+    this->tracks_migration_pages_ = true;
+    this->migration_page_bitmap_.clear();
+    this->migrated_section_memory_.clear();
+}
+
+// Pages of the layout that were not touched since the previous round are not written, zeroed pages only by address
+void memory_manager::serialize_memory_delta(utils::buffer_serializer& buffer)
+{
+    buffer.write_map(this->reserved_regions_);
+
+    const auto marked_pages = collect_marked_pages(this->migration_page_bitmap_);
+    const auto regions = collect_memory_regions(this->reserved_regions_);
+
+    std::vector<uint64_t> pages{};
+    std::vector<uint64_t> zero_pages{};
+    std::vector<std::byte> page_data{};
+
+    std::array<std::byte, MEMORY_PAGE_SIZE> data{};
+    auto page = marked_pages.begin();
+
+    for (const auto* region : regions)
+    {
+        page = std::lower_bound(page, marked_pages.end(), region->first);
+
+        for (; page != marked_pages.end() && *page - region->first < region->second.length; ++page)
+        {
+            this->read_memory(*page, data.data(), data.size());
+
+            if (is_zero_page(data))
+            {
+                zero_pages.push_back(*page);
+                continue;
+            }
+
+            pages.push_back(*page);
+            page_data.insert(page_data.end(), data.begin(), data.end());
+        }
+    }
+
+    buffer.write_vector(pages);
+    buffer.write_vector(zero_pages);
+    buffer.write(page_data.data(), page_data.size());
+
+    this->serialize_section_views(buffer, this->migrated_section_memory_);
+
+    this->migrated_section_memory_.clear();
+
+    for (const auto& [id, memory] : this->section_memory_)
+    {
+        if (!this->has_section_views(memory))
+        {
+            this->migrated_section_memory_.insert(id);
+        }
+    }
+
+    this->migration_page_bitmap_.clear();
+}
+
+void memory_manager::deserialize_memory_delta(utils::buffer_deserializer& buffer)
+{
+    reserved_region_map reserved_regions{};
+    buffer.read_map(reserved_regions);
+
+    const auto pages = buffer.read_vector<uint64_t>();
+    const auto zero_pages = buffer.read_vector<uint64_t>();
+
+    const auto page_data_size = pages.size() * MEMORY_PAGE_SIZE;
+    if (page_data_size > buffer.get_remaining_size())
+    {
+        throw std::runtime_error("Bad memory delta");
+    }
+
+    const auto page_data = buffer.read_data(page_data_size);
+    const auto current_section_memory = this->collect_section_memory();
+
+    if (is_same_layout(this->reserved_regions_, reserved_regions))
+    {
+        // Nothing was mapped or unmapped since the previous round, so only the pages are written
+        for (size_t i = 0; i < pages.size(); ++i)
+        {
+            this->write_memory(pages[i], page_data.data() + i * MEMORY_PAGE_SIZE, MEMORY_PAGE_SIZE);
+        }
+
+        constexpr std::array<std::byte, MEMORY_PAGE_SIZE> zero_page{};
+
+        for (const auto page : zero_pages)
+        {
+            this->write_memory(page, zero_page.data(), zero_page.size());
+        }
+
+        this->deserialize_section_views(buffer, current_section_memory);
+        this->finish_memory_delta();
+        return;
+    }
+
+    std::unordered_map<uint64_t, size_t> page_offsets{};
+    for (size_t i = 0; i < pages.size(); ++i)
+    {
+        page_offsets[pages[i]] = i * MEMORY_PAGE_SIZE;
+    }
+
+    const std::unordered_set<uint64_t> zeroed_pages(zero_pages.begin(), zero_pages.end());
+
+    for (auto i = reserved_regions.begin(); i != reserved_regions.end();)
+    {
+        if (i->second.is_mmio)
+        {
+            i = reserved_regions.erase(i);
+        }
+        else
+        {
+            ++i;
+        }
+    }
+
+    // The rest of the pages are taken from the current memory, before it is unmapped
+    std::vector<std::vector<std::byte>> region_data{};
+
+    for (const auto* region : collect_memory_regions(reserved_regions))
+    {
+        auto& data = region_data.emplace_back(region->second.length);
+
+        for (size_t offset = 0; offset < data.size(); offset += MEMORY_PAGE_SIZE)
+        {
+            const auto address = region->first + offset;
+            const auto length = std::min(static_cast<size_t>(MEMORY_PAGE_SIZE), data.size() - offset);
+            auto* target = data.data() + offset;
+
+            const auto entry = page_offsets.find(address);
+            if (entry != page_offsets.end())
+            {
+                std::copy_n(page_data.data() + entry->second, length, target);
+            }
+            else if (!zeroed_pages.contains(address) && !this->try_read_memory(address, target, length))
+            {
+                std::fill_n(target, length, std::byte{});
+            }
+        }
+    }
+
+    this->unmap_all_regions();
+    this->reserved_regions_ = std::move(reserved_regions);
+
+    const auto regions = collect_memory_regions(this->reserved_regions_);
+
+    for (size_t i = 0; i < regions.size(); ++i)
+    {
+        this->map_region_data(regions[i]->first, regions[i]->second, region_data[i]);
+    }
+
+    this->deserialize_section_views(buffer, current_section_memory);
+
+    this->rebuild_free_ranges();
+    this->finish_memory_delta();
+}
+
+void memory_manager::finish_memory_delta()
+{
+    this->recount_committed_bytes();
+
+    this->memory_snapshots_.clear();
+    this->base_snapshot_.reset();
+    this->clear_dirty_pages();
+    this->migration_page_bitmap_.clear();
+    this->migrated_section_memory_.clear();
+}
+
+memory_manager::memory_snapshot memory_manager::read_memory_snapshot()
+{
+    memory_snapshot snapshot{};
+    snapshot.regions = this->reserved_regions_;
+    snapshot.shared_regions = this->shared_regions_;
+
+    for (const auto& reserved_region : this->reserved_regions_)
+    {
+        if (reserved_region.second.is_mmio)
+        {
+            continue;
+        }
+
+        for (const auto& region : reserved_region.second.committed_regions)
+        {
+            if (this->find_shared_memory(this->shared_regions_, region.first))
+            {
+                continue;
+            }
+
+            // One buffer per region, the pages point into it
+            const auto length = region.second.length;
+            const auto data = std::make_shared<std::byte[]>(length);
+            this->read_memory(region.first, data.get(), length);
+
+            auto& pages = snapshot.data[region.first];
+            pages.reserve(static_cast<size_t>(page_align_up(length) / MEMORY_PAGE_SIZE));
+
+            for (size_t offset = 0; offset < length; offset += MEMORY_PAGE_SIZE)
+            {
+                pages.emplace_back(data, data.get() + offset);
+            }
+        }
+    }
+
+    return snapshot;
+}
+
+void memory_manager::update_snapshot_pages(memory_snapshot& snapshot, const std::vector<uint64_t>& pages)
+{
+    for (const auto page : pages)
+    {
+        const auto* region = find_committed_region_containing(snapshot.regions, page);
+        if (!region)
+        {
+            continue;
+        }
+
+        const auto data = snapshot.data.find(region->first);
+        if (data == snapshot.data.end())
+        {
+            continue;
+        }
+
+        const auto offset = page - region->first;
+        const auto length = std::min(MEMORY_PAGE_SIZE, static_cast<uint64_t>(region->second.length) - offset);
+
+        const auto page_data = std::make_shared<std::byte[]>(static_cast<size_t>(length));
+        this->read_memory(page, page_data.get(), static_cast<size_t>(length));
+
+        data->second.at(static_cast<size_t>(offset / MEMORY_PAGE_SIZE)) = {page_data, page_data.get()};
+    }
+}
+
+const memory_manager::memory_snapshot* memory_manager::get_base_snapshot() const
+{
+    if (!this->base_snapshot_)
+    {
+        return nullptr;
+    }
+
+    const auto entry = this->memory_snapshots_.find(*this->base_snapshot_);
+    return entry != this->memory_snapshots_.end() ? &entry->second : nullptr;
+}
+
+void memory_manager::save_memory_snapshot(const uint64_t id)
+{
+    const auto* base = this->get_base_snapshot();
+
+    memory_snapshot snapshot{};
+
+    if (base && !this->layout_changed_)
+    {
+        // Everything but the written pages is still as in the base snapshot
+        snapshot = *base;
+        this->update_snapshot_pages(snapshot, this->collect_dirty_pages());
+    }
+    else
+    {
+        snapshot = this->read_memory_snapshot();
+    }
+
+    // Section memory can change without changing the layout
+    snapshot.section_memory = this->section_memory_;
+    snapshot.section_views = this->section_views_;
+
+    this->memory_snapshots_[id] = std::move(snapshot);
+    this->base_snapshot_ = id;
+
+    this->layout_changed_ = false;
+    this->start_dirty_page_tracking();
+    this->clear_dirty_pages();
+}
+
+void memory_manager::delete_memory_snapshot(const uint64_t id)
+{
+    this->memory_snapshots_.erase(id);
+
+    if (this->base_snapshot_ == id)
+    {
+        this->base_snapshot_.reset();
+    }
+}
+
+void memory_manager::restore_memory_snapshot(const uint64_t id)
+{
+    const auto entry = this->memory_snapshots_.find(id);
+    if (entry == this->memory_snapshots_.end())
+    {
+        return;
+    }
+
+    const auto& snapshot = entry->second;
+    const auto* base = this->get_base_snapshot();
+    const auto dirty_pages = this->collect_dirty_pages();
+
+    const auto current_shared_regions = std::move(this->shared_regions_);
+    this->shared_regions_ = snapshot.shared_regions;
+
+    const auto current_section_views = std::move(this->section_views_);
+    this->section_views_ = snapshot.section_views;
+    this->section_memory_ = snapshot.section_memory;
+    this->migrated_section_memory_.clear();
+
+    const auto is_unchanged = [&](const uint64_t address, const committed_region& current,
+                                  const committed_region& saved) {
+        const auto* current_shared = this->find_shared_memory(current_shared_regions, address);
+        const auto* saved_shared = this->find_shared_memory(snapshot.shared_regions, address);
+
+        const auto* current_view = find_view_memory(current_section_views, address);
+        const auto* saved_view = find_view_memory(snapshot.section_views, address);
+
+        return current.length == saved.length && current_shared == saved_shared && current_view == saved_view;
+    };
+
+    for (const auto& reserved_region : this->reserved_regions_)
+    {
+        if (reserved_region.second.is_mmio)
+        {
+            continue;
+        }
+
+        for (const auto& region : reserved_region.second.committed_regions)
+        {
+            const auto* snapshot_region = find_committed_region(snapshot.regions, region.first);
+            if (!snapshot_region || !is_unchanged(region.first, region.second, *snapshot_region))
+            {
+                this->unmap_memory(region.first, region.second.length);
+                this->forget_watched_pages(region.first, region.second.length);
+                this->deduplicated_pages_.erase(this->deduplicated_pages_.lower_bound(region.first),
+                                                this->deduplicated_pages_.lower_bound(region.first +
+                                                                                      region.second.length));
+            }
+        }
+    }
+
+    for (const auto& reserved_region : snapshot.regions)
+    {
+        if (reserved_region.second.is_mmio)
+        {
+            continue;
+        }
+
+        for (const auto& region : reserved_region.second.committed_regions)
+        {
+            const auto* current_region = find_committed_region(this->reserved_regions_, region.first);
+
+            if (current_region && is_unchanged(region.first, *current_region, region.second))
+            {
+                if (current_region->pemissions != region.second.pemissions)
+                {
+                    if ((region.second.pemissions & memory_permission::write) != memory_permission::none)
+                    {
+                        this->privatize_deduplicated_pages(region.first, region.second.length);
+                    }
+
+                    this->apply_memory_protection(region.first, region.second.length, region.second.pemissions);
+                }
+
+                if (base != &snapshot)
+                {
+                    this->restore_changed_pages(snapshot, base, region.first, region.second);
+                }
+
+                continue;
+            }
+
+            const auto* shared_data = this->find_shared_memory(snapshot.shared_regions, region.first);
+            if (shared_data)
+            {
+                this->map_shared_memory(region.first, region.second.length, region.second.pemissions, shared_data);
+                continue;
+            }
+
+            auto* view_data = find_view_memory(snapshot.section_views, region.first);
+            if (view_data)
+            {
+                this->map_host_memory(region.first, region.second.length, region.second.pemissions, view_data);
+            }
+            else
+            {
+                this->map_memory(region.first, region.second.length, region.second.pemissions);
+            }
+
+            this->restore_changed_pages(snapshot, nullptr, region.first, region.second);
+        }
+    }
+
+    this->reserved_regions_ = snapshot.regions;
+    this->rebuild_free_ranges();
+    this->recount_committed_bytes();
+
+    this->restore_snapshot_pages(snapshot, dirty_pages);
+
+    this->base_snapshot_ = id;
+    this->layout_changed_ = false;
+    this->clear_dirty_pages();
+}
+
+bool memory_manager::revert_dirty_pages()
+{
+    const auto* base = this->get_base_snapshot();
+    if (!base || this->layout_changed_)
+    {
+        return false;
+    }
+
+    this->restore_snapshot_pages(*base, this->collect_dirty_pages());
+    this->clear_dirty_pages();
+
+    return true;
+}
+
+// Writes the pages of the region that differ between the snapshots, all of them without a base
+void memory_manager::restore_changed_pages(const memory_snapshot& snapshot, const memory_snapshot* base,
+                                           const uint64_t address, const committed_region& region)
+{
+    const auto data = snapshot.data.find(address);
+    if (data == snapshot.data.end())
+    {
+        return;
+    }
+
+    const snapshot_pages* base_pages = nullptr;
+
+    if (base)
+    {
+        const auto* base_region = find_committed_region(base->regions, address);
+        const auto base_data = base->data.find(address);
+
+        if (base_region && base_region->length == region.length && base_data != base->data.end())
+        {
+            base_pages = &base_data->second;
+        }
+    }
+
+    const auto& pages = data->second;
+
+    for (size_t i = 0; i < pages.size(); ++i)
+    {
+        if (base_pages && (*base_pages)[i] == pages[i])
+        {
+            continue;
+        }
+
+        const auto offset = i * MEMORY_PAGE_SIZE;
+        const auto length = std::min(static_cast<size_t>(MEMORY_PAGE_SIZE), region.length - offset);
+        this->write_memory(address + offset, pages[i].get(), length);
+    }
+}
+
+void memory_manager::restore_snapshot_pages(const memory_snapshot& snapshot, const std::vector<uint64_t>& pages)
+{
+    for (const auto page : pages)
+    {
+        const auto* region = find_committed_region_containing(snapshot.regions, page);
+        if (!region)
+        {
+            continue;
+        }
+
+        const auto data = snapshot.data.find(region->first);
+        if (data == snapshot.data.end())
+        {
+            continue;
+        }
+
+        const auto offset = page - region->first;
+        const auto length = std::min(MEMORY_PAGE_SIZE, static_cast<uint64_t>(region->second.length) - offset);
+
+        this->write_memory(page, data->second.at(static_cast<size_t>(offset / MEMORY_PAGE_SIZE)).get(),
+                           static_cast<size_t>(length));
+    }
+}
+
+std::vector<uint64_t> memory_manager::collect_dirty_pages() const
+{
+    return collect_marked_pages(this->dirty_page_bitmap_);
+}
+
+void memory_manager::clear_dirty_pages()
+{
+    this->dirty_page_bitmap_.clear();
+}
+
+void memory_manager::count_executable_unmap(const memory_permission permissions)
+{
+    if ((permissions & memory_permission::exec) != memory_permission::none)
+    {
+        ++this->invalidation_statistics_.executable_unmaps;
+    }
+}
+
+void memory_manager::record_memory_write(const uint64_t address, const size_t size, const bool guest_write)
+{
+    if (!this->tracks_dirty_pages_ || !size)
+    {
+        return;
+    }
+
+    mark_dirty_pages(this->dirty_page_bitmap_, address, size);
+    this->mark_tracked_pages(address, size);
+
+    if (guest_write)
+    {
+        this->watch_written_pages(address, size);
+    }
+
+    if (!this->section_views_.empty())
+    {
+        this->record_section_view_write(address, size, guest_write);
+    }
+}
+
+// The other views of the memory were written as well
+void memory_manager::record_section_view_write(const uint64_t address, const size_t size, const bool guest_write)
+{
+    auto entry = this->section_views_.upper_bound(address);
+    if (entry == this->section_views_.begin())
+    {
+        return;
+    }
+
+    --entry;
+
+    const auto view_size = static_cast<uint64_t>(entry->second.memory->size());
+    const auto offset = address - entry->first;
+    if (offset >= view_size)
+    {
+        return;
+    }
+
+    const auto length = static_cast<size_t>(std::min(static_cast<uint64_t>(size), view_size - offset));
+
+    for (const auto& view : this->section_views_)
+    {
+        if (view.first != entry->first && view.second.memory == entry->second.memory)
+        {
+            mark_dirty_pages(this->dirty_page_bitmap_, view.first + offset, length);
+            this->mark_tracked_pages(view.first + offset, length);
+
+            if (guest_write)
+            {
+                this->watch_written_pages(view.first + offset, length);
+            }
+        }
+    }
+}
+
+// Committed memory is zeroed, or holds the contents of a section, without being written
+void memory_manager::record_committed_memory(const uint64_t address, const size_t size)
+{
+    if (size)
+    {
+        this->mark_tracked_pages(address, size);
+    }
+}
+
+// Marks the pages for the consumers beyond the snapshots, which track pages independent of them
+void memory_manager::mark_tracked_pages(const uint64_t address, const size_t size)
+{
+    if (this->tracks_migration_pages_)
+    {
+        mark_dirty_pages(this->migration_page_bitmap_, address, size);
+    }
+
+    for (auto& bitmap : this->page_trackers_ | std::views::values)
+    {
+        mark_dirty_pages(bitmap, address, size);
+    }
+}
+
+std::optional<memory_permission> memory_manager::find_committed_permissions(const uint64_t address)
+{
+    const auto entry = this->find_reserved_region(address);
+    if (entry == this->reserved_regions_.end() || entry->second.is_mmio)
+    {
+        return std::nullopt;
+    }
+
+    const auto& committed_regions = entry->second.committed_regions;
+
+    auto region = committed_regions.upper_bound(address);
+    if (region == committed_regions.begin())
+    {
+        return std::nullopt;
+    }
+
+    --region;
+    if (region->first + region->second.length <= address)
+    {
+        return std::nullopt;
+    }
+
+    return region->second.pemissions;
+}
+
+// Only the first write of a page after it ran changes the backend, later writes are a lookup
+void memory_manager::watch_written_pages(const uint64_t address, const size_t size)
+{
+    if (!this->written_execution_callback_)
+    {
+        return;
+    }
+
+    const auto end = address + size;
+
+    for (auto page = page_align_down(address); page < end; page += MEMORY_PAGE_SIZE)
+    {
+        if (this->watched_pages_.contains(page))
+        {
+            continue;
+        }
+
+        const auto permissions = this->find_committed_permissions(page);
+        if (!permissions)
+        {
+            continue;
+        }
+
+        this->watched_pages_.insert(page);
+
+        if ((*permissions & memory_permission::exec) != memory_permission::none)
+        {
+            this->apply_memory_protection(page, MEMORY_PAGE_SIZE, *permissions & ~memory_permission::exec);
+        }
+    }
+}
+
+// Protecting or remapping memory maps it with the guest permissions again
+void memory_manager::revoke_watched_execution(const uint64_t address, const size_t size,
+                                              const memory_permission permissions)
+{
+    if ((permissions & memory_permission::exec) == memory_permission::none)
+    {
+        return;
+    }
+
+    const auto end = address + size;
+
+    for (auto page = this->watched_pages_.lower_bound(address); page != this->watched_pages_.end() && *page < end;
+         ++page)
+    {
+        this->apply_memory_protection(*page, MEMORY_PAGE_SIZE, permissions & ~memory_permission::exec);
+    }
+}
+
+void memory_manager::forget_watched_pages(const uint64_t address, const size_t size)
+{
+    this->watched_pages_.erase(this->watched_pages_.lower_bound(address),
+                               this->watched_pages_.lower_bound(address + size));
+}
+
+bool memory_manager::handle_watched_execution(const uint64_t address)
+{
+    const auto page = this->watched_pages_.find(page_align_down(address));
+    if (page == this->watched_pages_.end())
+    {
+        return false;
+    }
+
+    const auto permissions = this->find_committed_permissions(*page);
+    if (!permissions || (*permissions & memory_permission::exec) == memory_permission::none)
+    {
+        return false;
+    }
+
+    const auto page_address = *page;
+    this->watched_pages_.erase(page);
+    this->apply_memory_protection(page_address, MEMORY_PAGE_SIZE, *permissions);
+
+    this->written_execution_callback_(page_address);
+    return true;
+}
+
+void memory_manager::stop_execution_watch()
+{
+    for (const auto page : this->watched_pages_)
+    {
+        const auto permissions = this->find_committed_permissions(page);
+        if (permissions && (*permissions & memory_permission::exec) != memory_permission::none)
+        {
+            this->apply_memory_protection(page, MEMORY_PAGE_SIZE, *permissions);
+        }
+    }
+
+    this->watched_pages_.clear();
+    this->written_execution_callback_ = {};
+}
+
+uint64_t memory_manager::add_page_tracker()
+{
+    const auto id = ++this->next_page_tracker_;
+    this->page_trackers_[id] = {};
+    return id;
+}
+
+void memory_manager::stop_page_tracker(const uint64_t tracker)
+{
+    this->page_trackers_.erase(tracker);
+}
+
+std::vector<uint64_t> memory_manager::collect_tracked_pages(const uint64_t tracker) const
+{
+    const auto entry = this->page_trackers_.find(tracker);
+    if (entry == this->page_trackers_.end())
+    {
+        return {};
+    }
+
+    return collect_marked_pages(entry->second);
+}
+
+void memory_manager::privatize_shared_memory(const uint64_t address, const size_t size)
+{
+    this->privatize_deduplicated_pages(address, size);
+
+    if (this->shared_regions_.empty())
+    {
+        return;
+    }
+
+    auto entry = this->shared_regions_.upper_bound(address);
+    if (entry != this->shared_regions_.begin())
+    {
+        --entry;
+    }
+
+    while (entry != this->shared_regions_.end() && entry->first < address + size)
+    {
+        if (!regions_with_length_intersect(address, size, entry->first, entry->second))
+        {
+            ++entry;
+            continue;
+        }
+
+        const auto shared_start = entry->first;
+        const auto shared_length = entry->second;
+        const auto* shared_data = this->shared_memory_pool_->find(shared_start, shared_length);
+
+        entry = this->shared_regions_.erase(entry);
+
+        const auto reserved_region = this->find_reserved_region(shared_start);
+        if (reserved_region == this->reserved_regions_.end() || !shared_data)
+        {
+            continue;
+        }
+
+        for (const auto& region : reserved_region->second.committed_regions)
+        {
+            if (!is_within_start_and_length(region.first, shared_start, shared_length))
+            {
+                continue;
+            }
+
+            this->unmap_memory(region.first, region.second.length);
+            this->map_memory(region.first, region.second.length, region.second.pemissions);
+            this->write_memory(region.first, shared_data + (region.first - shared_start), region.second.length);
+            this->revoke_watched_execution(region.first, region.second.length, region.second.pemissions);
+
+            this->layout_changed_ = true;
+        }
+    }
+}
+
+bool memory_manager::protect_memory(const uint64_t address, const size_t size, const memory_permission permissions,
+                                    memory_permission* old_permissions)
+{
+    const auto entry = this->find_reserved_region(address);
+    if (entry == this->reserved_regions_.end())
+    {
+        return false;
+    }
+
+    const auto end = address + size;
+    const auto region_end = entry->first + entry->second.length;
+
+    if (region_end < end)
+    {
+        throw std::runtime_error("Cross region protect not supported yet!");
+    }
+
+    if ((permissions & memory_permission::write) != memory_permission::none)
+    {
+        this->privatize_shared_memory(address, size);
+    }
+
+    std::optional<memory_permission> old_first_permissions{};
+
+    auto& committed_regions = entry->second.committed_regions;
+    split_regions(committed_regions, {address, end});
+
+    // Regions that already have the permissions are skipped and adjacent changes are applied at once,
+    // every backend call may cost translated code
+    uint64_t pending_start = 0;
+    uint64_t pending_end = 0;
+    auto changed = false;
+
+    const auto becomes_executable = (permissions & memory_permission::exec) != memory_permission::none;
+    std::vector<std::pair<uint64_t, size_t>> executable_ranges{};
+
+    const auto apply_pending = [&] {
+        if (pending_start == pending_end)
+        {
+            return;
+        }
+
+        const auto pending_size = static_cast<size_t>(pending_end - pending_start);
+        this->apply_memory_protection(pending_start, pending_size, permissions);
+        ++this->invalidation_statistics_.protection_changes;
+
+        this->revoke_watched_execution(pending_start, pending_size, permissions);
+
+        if (becomes_executable && this->executable_memory_callback_)
+        {
+            executable_ranges.emplace_back(pending_start, pending_size);
+        }
+
+        pending_start = pending_end = 0;
+    };
+
+    for (auto& sub_region : committed_regions)
+    {
+        if (sub_region.first >= end)
+        {
+            break;
+        }
+
+        const auto sub_region_end = sub_region.first + sub_region.second.length;
+        if (sub_region.first >= address && sub_region_end <= end)
+        {
+            if (!old_first_permissions.has_value())
+            {
+                old_first_permissions = sub_region.second.pemissions;
+            }
+
+            if (sub_region.second.pemissions == permissions)
+            {
+                continue;
+            }
+
+            if (sub_region.first != pending_end)
+            {
+                apply_pending();
+                pending_start = sub_region.first;
+            }
+
+            pending_end = sub_region_end;
+            sub_region.second.pemissions = permissions;
+            changed = true;
+        }
+    }
+
+    apply_pending();
+
+    if (old_permissions)
+    {
+        *old_permissions = old_first_permissions.value_or(memory_permission::none);
+    }
+
+    merge_regions(committed_regions);
+
+    if (!changed)
+    {
+        ++this->invalidation_statistics_.skipped_protection_changes;
+        return true;
+    }
+
+    this->layout_changed_ = true;
+
+    for (const auto& [range_start, range_size] : executable_ranges)
+    {
+        this->executable_memory_callback_(range_start, range_size);
+    }
+
+    return true;
+}
+
+bool memory_manager::allocate_mmio(const uint64_t address, const size_t size, mmio_read_callback read_cb,
+                                   mmio_write_callback write_cb)
+{
+    if (this->overlaps_reserved_region(address, size))
+    {
+        return false;
+    }
+
+    this->map_mmio(address, size, std::move(read_cb), std::move(write_cb));
+    this->reserve_free_range(address, size);
+
+    const auto entry = this->reserved_regions_
+                           .try_emplace(address,
+                                        reserved_region{
+                                            .length = size,
+                                            .is_mmio = true,
+                                        })
+                           .first;
+
+    entry->second.committed_regions[address] = committed_region{size, memory_permission::read_write};
+
+    this->layout_changed_ = true;
+
+    return true;
+}
+
+bool memory_manager::allocate_memory(const uint64_t address, const size_t size, const memory_permission permissions,
+                                     const bool reserve_only)
+{
+    if (this->overlaps_reserved_region(address, size))
+    {
+        return false;
+    }
+
+    if (!reserve_only && !this->has_commit_capacity(size))
+    {
+        return false;
+    }
+
+    const auto entry = this->reserved_regions_
+                           .try_emplace(address,
+                                        reserved_region{
+                                            .length = size,
+                                        })
+                           .first;
+
+    this->reserve_free_range(address, size);
+
+    if (!reserve_only)
+    {
+        this->map_memory(address, size, permissions);
+        entry->second.committed_regions[address] = committed_region{size, memory_permission::read_write};
+        this->committed_bytes_ += size;
+        this->record_committed_memory(address, size);
+    }
+
+    this->layout_changed_ = true;
+
+    return true;
+}
+
+bool memory_manager::commit_memory(const uint64_t address, const size_t size, const memory_permission permissions)
+{
+    const auto entry = this->find_reserved_region(address);
+    if (entry == this->reserved_regions_.end())
+    {
+        return false;
+    }
+
+    const auto end = address + size;
+    const auto region_end = entry->first + entry->second.length;
+
+    if (region_end < end)
+    {
+        throw std::runtime_error("Cross region commit not supported yet!");
+    }
+
+    auto& committed_regions = entry->second.committed_regions;
+    split_regions(committed_regions, {address, end});
+
+    std::vector<std::pair<uint64_t, size_t>> unmapped_ranges{};
+    uint64_t map_start = address;
+
+    for (const auto& sub_region : committed_regions)
+    {
+        if (sub_region.first >= end)
+        {
+            break;
+        }
+
+        const auto sub_region_end = sub_region.first + sub_region.second.length;
+        if (sub_region.first >= address && sub_region_end <= end)
+        {
+            if (sub_region.first > map_start)
+            {
+                unmapped_ranges.emplace_back(map_start, sub_region.first - map_start);
+            }
+
+            map_start = sub_region_end;
+        }
+    }
+
+    if (map_start < end)
+    {
+        unmapped_ranges.emplace_back(map_start, end - map_start);
+    }
+
+    uint64_t commit_size = 0;
+    for (const auto& range : unmapped_ranges)
+    {
+        commit_size += range.second;
+    }
+
+    if (!this->has_commit_capacity(commit_size))
+    {
+        merge_regions(committed_regions);
+        return false;
+    }
+
+    for (const auto& [range_start, range_length] : unmapped_ranges)
+    {
+        this->map_memory(range_start, range_length, permissions);
+        committed_regions[range_start] = committed_region{range_length, permissions};
+        this->record_committed_memory(range_start, range_length);
+    }
+
+    this->committed_bytes_ += commit_size;
+
+    merge_regions(committed_regions);
+    this->layout_changed_ = true;
+
+    return true;
+}
+
+bool memory_manager::decommit_memory(const uint64_t address, const size_t size)
+{
+    const auto entry = this->find_reserved_region(address);
+    if (entry == this->reserved_regions_.end())
+    {
+        return false;
+    }
+
+    if (entry->second.is_mmio)
+    {
+        throw std::runtime_error("Not allowed to decommit MMIO!");
+    }
+
+    const auto end = address + size;
+    const auto region_end = entry->first + entry->second.length;
+
+    if (region_end < end)
+    {
+        throw std::runtime_error("Cross region decommit not supported yet!");
+    }
+
+    this->privatize_shared_memory(address, size);
+
+    const auto view = this->section_views_.find(entry->first);
+    if (view != this->section_views_.end())
+    {
+        this->privatize_section_view(view);
+    }
+
+    auto& committed_regions = entry->second.committed_regions;
+
+    split_regions(committed_regions, {address, end});
+
+    for (auto i = committed_regions.begin(); i != committed_regions.end();)
+    {
+        if (i->first >= end)
+        {
+            break;
+        }
+
+        const auto sub_region_end = i->first + i->second.length;
+        if (i->first >= address && sub_region_end <= end)
+        {
+            this->count_executable_unmap(i->second.pemissions);
+            this->record_memory_write(i->first, i->second.length);
+            this->unmap_memory(i->first, i->second.length);
+            this->forget_watched_pages(i->first, i->second.length);
+            this->committed_bytes_ -= i->second.length;
+            i = committed_regions.erase(i);
+            continue;
+        }
+
+        ++i;
+    }
+
+    this->layout_changed_ = true;
+
+    return true;
+}
+
+bool memory_manager::release_memory(const uint64_t address, size_t size)
+{
+    const auto entry = this->reserved_regions_.find(address);
+    if (entry == this->reserved_regions_.end())
+    {
+        return false;
+    }
+
+    if (!size)
+    {
+        size = entry->second.length;
+    }
+
+    if (size > entry->second.length)
+    {
+        throw std::runtime_error("Cross region release not supported yet!");
+    }
+
+    this->privatize_shared_memory(address, size);
+
+    // Releasing one of several views of the same memory doesn't uncharge it
+    uint64_t kept_charge = 0;
+
+    const auto view = this->section_views_.find(address);
+    if (view != this->section_views_.end())
+    {
+        if (size < entry->second.length)
+        {
+            this->privatize_section_view(view);
+        }
+        else
+        {
+            if (this->has_section_views(view->second.memory, address))
+            {
+                kept_charge = size;
+            }
+
+            this->section_views_.erase(view);
+        }
+    }
+
+    const auto end = address + size;
+    auto& committed_regions = entry->second.committed_regions;
+
+    split_regions(committed_regions, {end});
+
+    for (auto i = committed_regions.begin(); i != committed_regions.end();)
+    {
+        if (i->first >= end)
+        {
+            break;
+        }
+
+        const auto sub_region_end = i->first + i->second.length;
+        if (i->first >= address && sub_region_end <= end)
+        {
+            this->count_executable_unmap(i->second.pemissions);
+            this->record_memory_write(i->first, i->second.length);
+            this->unmap_memory(i->first, i->second.length);
+            this->forget_watched_pages(i->first, i->second.length);
+            this->committed_bytes_ -= i->second.length;
+            i = committed_regions.erase(i);
+        }
+        else
+        {
+            ++i;
+        }
+    }
+
+    this->committed_bytes_ += kept_charge;
+
+    entry->second.length -= size;
+    auto remaining_region = std::move(entry->second);
+
+    this->reserved_regions_.erase(entry);
+    this->release_free_range(address, size);
+
+    if (remaining_region.length > 0)
+    {
+        this->reserved_regions_[address + size] = std::move(remaining_region);
+    }
+
+    this->layout_changed_ = true;
+
+    return true;
+}
+
+uint64_t memory_manager::create_section_memory(const size_t size)
+{
+    if (!size)
+    {
+        return 0;
+    }
+
+    auto memory = std::make_shared<utils::virtual_memory>(static_cast<size_t>(page_align_up(size)));
+    if (!*memory)
+    {
+        return 0;
+    }
+
+    const auto id = this->next_section_memory_id_++;
+    this->section_memory_[id] = std::move(memory);
+
+    return id;
+}
+
+void memory_manager::release_section_memory(const uint64_t id)
+{
+    this->section_memory_.erase(id);
+}
+
+size_t memory_manager::get_section_memory_size(const uint64_t id) const
+{
+    const auto entry = this->section_memory_.find(id);
+    return entry != this->section_memory_.end() ? entry->second->size() : 0;
+}
+
+bool memory_manager::map_section_view(const uint64_t address, const uint64_t id, const memory_permission permissions)
+{
+    const auto memory = this->section_memory_.find(id);
+    if (memory == this->section_memory_.end())
+    {
+        return false;
+    }
+
+    // The memory is only charged once, however many views it has
+    const auto size = memory->second->size();
+    const auto is_charged = this->has_section_views(memory->second);
+    if (this->overlaps_reserved_region(address, size) || (!is_charged && !this->has_commit_capacity(size)))
+    {
+        return false;
+    }
+
+    this->map_host_memory(address, size, permissions, memory->second->data());
+
+    const auto entry = this->reserved_regions_
+                           .try_emplace(address,
+                                        reserved_region{
+                                            .length = size,
+                                        })
+                           .first;
+
+    this->reserve_free_range(address, size);
+
+    entry->second.committed_regions[address] = committed_region{size, permissions};
+    this->record_committed_memory(address, size);
+
+    if (!is_charged)
+    {
+        this->committed_bytes_ += size;
+    }
+
+    this->migrated_section_memory_.erase(id);
+
+    this->section_views_[address] = {
+        .id = id,
+        .memory = memory->second,
+    };
+
+    this->layout_changed_ = true;
+
+    return true;
+}
+
+bool memory_manager::is_section_view(const uint64_t address) const
+{
+    return this->section_views_.contains(address);
+}
+
+bool memory_manager::has_section_views(const section_memory& memory, const uint64_t excluded_view) const
+{
+    return std::ranges::any_of(this->section_views_, [&](const auto& view) {
+        return view.first != excluded_view && view.second.memory == memory; //
+    });
+}
+
+std::byte* memory_manager::find_view_memory(const section_view_map& views, const uint64_t address)
+{
+    auto entry = views.upper_bound(address);
+    if (entry == views.begin())
+    {
+        return nullptr;
+    }
+
+    --entry;
+    if (!is_within_start_and_length(address, entry->first, entry->second.memory->size()))
+    {
+        return nullptr;
+    }
+
+    return entry->second.memory->data() + (address - entry->first);
+}
+
+void memory_manager::privatize_section_view(const section_view_map::iterator view)
+{
+    const auto address = view->first;
+    const auto memory = std::move(view->second.memory);
+
+    this->section_views_.erase(view);
+
+    const auto reserved_region = this->reserved_regions_.find(address);
+    if (reserved_region == this->reserved_regions_.end())
+    {
+        return;
+    }
+
+    // The other views still carry the charge of the section memory, the copy is charged on its own
+    const auto is_charged_elsewhere = this->has_section_views(memory);
+
+    for (const auto& region : reserved_region->second.committed_regions)
+    {
+        if (is_charged_elsewhere)
+        {
+            this->committed_bytes_ += region.second.length;
+        }
+
+        this->unmap_memory(region.first, region.second.length);
+        this->map_memory(region.first, region.second.length, region.second.pemissions);
+        this->write_memory(region.first, memory->data() + (region.first - address), region.second.length);
+        this->revoke_watched_execution(region.first, region.second.length, region.second.pemissions);
+    }
+
+    this->layout_changed_ = true;
+}
+
+memory_manager::section_memory_map memory_manager::collect_section_memory() const
+{
+    section_memory_map memory = this->section_memory_;
+    for (const auto& view : this->section_views_)
+    {
+        memory.try_emplace(view.second.id, view.second.memory);
+    }
+
+    return memory;
+}
+
+// The contents of viewed memory are part of the region data, only the memory without views is written. Memory
+// without views that the receiver already has unchanged is only written by id.
+void memory_manager::serialize_section_views(utils::buffer_serializer& buffer,
+                                             const std::set<uint64_t>& unchanged_memory) const
+{
+    buffer.write(this->next_section_memory_id_);
+    buffer.write<uint64_t>(this->section_views_.size());
+
+    for (const auto& view : this->section_views_)
+    {
+        buffer.write(view.first);
+        buffer.write(view.second.id);
+    }
+
+    const auto memory = this->collect_section_memory();
+    buffer.write<uint64_t>(memory.size());
+
+    for (const auto& [id, data] : memory)
+    {
+        const auto has_view = std::ranges::any_of(this->section_views_,
+                                                  [&](const auto& view) { return view.second.memory == data; });
+
+        buffer.write(id);
+        buffer.write<uint64_t>(data->size());
+        buffer.write(this->section_memory_.contains(id));
+        buffer.write(has_view);
+
+        if (has_view)
+        {
+            continue;
+        }
+
+        const auto is_unchanged = unchanged_memory.contains(id);
+        buffer.write(is_unchanged);
+
+        if (!is_unchanged)
+        {
+            buffer.write(data->data(), data->size());
+        }
+    }
+}
+
+// Views that are still mapped the same way keep their memory, migration rounds wrote their pages in place
+void memory_manager::deserialize_section_views(utils::buffer_deserializer& buffer,
+                                               const section_memory_map& current_memory)
+{
+    buffer.read(this->next_section_memory_id_);
+
+    std::vector<std::pair<uint64_t, uint64_t>> views{};
+    const auto view_count = buffer.read<uint64_t>();
+
+    for (uint64_t i = 0; i < view_count; ++i)
+    {
+        const auto address = buffer.read<uint64_t>();
+        const auto id = buffer.read<uint64_t>();
+        views.emplace_back(address, id);
+    }
+
+    const auto keeps_views =
+        std::ranges::equal(views, this->section_views_, {}, {}, [](const auto& view) {
+            return std::pair{view.first, view.second.id}; //
+        });
+
+    const auto find_current_memory = [&](const uint64_t id) {
+        const auto entry = current_memory.find(id);
+        if (entry == current_memory.end())
+        {
+            throw std::runtime_error("Bad section memory");
+        }
+
+        return entry->second;
+    };
+
+    this->section_memory_.clear();
+
+    section_memory_map memory{};
+    std::set<uint64_t> unfilled_memory{};
+
+    const auto memory_count = buffer.read<uint64_t>();
+
+    for (uint64_t i = 0; i < memory_count; ++i)
+    {
+        const auto id = buffer.read<uint64_t>();
+        const auto size = static_cast<size_t>(buffer.read<uint64_t>());
+        const auto is_alive = buffer.read<bool>();
+        const auto has_view = buffer.read<bool>();
+        const auto is_unchanged = !has_view && buffer.read<bool>();
+
+        section_memory data{};
+
+        if (is_unchanged || (has_view && keeps_views))
+        {
+            data = find_current_memory(id);
+        }
+        else
+        {
+            data = std::make_shared<utils::virtual_memory>(size);
+            if (size && !*data)
+            {
+                throw std::runtime_error("Failed to allocate section memory");
+            }
+
+            if (has_view)
+            {
+                unfilled_memory.insert(id);
+            }
+            else
+            {
+                const auto content = buffer.read_data(size);
+                std::ranges::copy(content, data->data());
+            }
+        }
+
+        if (data->size() != size)
+        {
+            throw std::runtime_error("Bad section memory");
+        }
+
+        if (is_alive)
+        {
+            this->section_memory_[id] = data;
+        }
+
+        memory[id] = std::move(data);
+    }
+
+    if (keeps_views)
+    {
+        return;
+    }
+
+    // Views written in place that are mapped differently now are mapped again from private copies
+    while (!this->section_views_.empty())
+    {
+        this->privatize_section_view(this->section_views_.begin());
+    }
+
+    for (const auto& [address, id] : views)
+    {
+        const auto data = memory.find(id);
+        const auto reserved_region = this->reserved_regions_.find(address);
+
+        if (data == memory.end() || reserved_region == this->reserved_regions_.end() ||
+            reserved_region->second.length != data->second->size())
+        {
+            throw std::runtime_error("Bad section view");
+        }
+
+        // The views were mapped as private copies of the same contents, one of them fills the memory
+        if (unfilled_memory.erase(id))
+        {
+            for (const auto& region : reserved_region->second.committed_regions)
+            {
+                this->read_memory(region.first, data->second->data() + (region.first - address),
+                                  region.second.length);
+            }
+        }
+
+        for (const auto& region : reserved_region->second.committed_regions)
+        {
+            this->unmap_memory(region.first, region.second.length);
+            this->shared_regions_.erase(region.first);
+            this->map_host_memory(region.first, region.second.length, region.second.pemissions,
+                                  data->second->data() + (region.first - address));
+        }
+
+        this->section_views_[address] = {
+            .id = id,
+            .memory = data->second,
+        };
+    }
+}
+
+uint64_t memory_manager::find_free_allocation_base(const size_t size, const uint64_t start) const
+{
+    const uint64_t start_address = std::max(MIN_ALLOCATION_ADDRESS, start ? start : 0x100000000ULL);
+
+    const auto get_candidate = [&](const free_range& range) {
+        return std::max(start_address, page_align_up(range.start)); //
+    };
+
+    // Holes smaller than the size are skipped by the tree, only the clipped ranges at both ends are checked here
+    const auto range = this->free_ranges_.find_first_fit(start_address, size, [&](const free_range& r) {
+        const auto candidate = get_candidate(r);
+        const auto limit = r.end == FREE_RANGE_END ? MAX_ALLOCATION_ADDRESS : r.end;
+        return candidate <= limit && size <= limit - candidate;
+    });
+
+    return range ? get_candidate(*range) : 0;
+}
+
+region_info memory_manager::get_region_info(const uint64_t address)
+{
+    region_info result{};
+    result.start = MIN_ALLOCATION_ADDRESS;
+    result.length = MAX_ALLOCATION_ADDRESS - result.start;
+    result.permissions = memory_permission::none;
+    result.allocation_base = {};
+    result.allocation_length = result.length;
+    result.is_committed = false;
+    result.is_reserved = false;
+
+    if (this->reserved_regions_.empty())
+    {
+        return result;
+    }
+
+    auto upper_bound = this->reserved_regions_.upper_bound(address);
+    if (upper_bound == this->reserved_regions_.begin())
+    {
+        result.length = upper_bound->first - result.start;
+        return result;
+    }
+
+    const auto entry = --upper_bound;
+    const auto lower_end = entry->first + entry->second.length;
+    if (lower_end <= address)
+    {
+        result.start = lower_end;
+        result.length = MAX_ALLOCATION_ADDRESS - result.start;
+        return result;
+    }
+
+    // We have a reserved region
+    const auto& reserved_region = entry->second;
+    const auto& committed_regions = reserved_region.committed_regions;
+
+    result.is_reserved = true;
+    result.allocation_base = entry->first;
+    result.allocation_length = reserved_region.length;
+    result.start = result.allocation_base;
+    result.length = result.allocation_length;
+
+    if (committed_regions.empty())
+    {
+        return result;
+    }
+
+    auto committed_bound = committed_regions.upper_bound(address);
+    if (committed_bound == committed_regions.begin())
+    {
+        result.length = committed_bound->first - result.start;
+        return result;
+    }
+
+    const auto committed_entry = --committed_bound;
+    const auto committed_lower_end = committed_entry->first + committed_entry->second.length;
+    if (committed_lower_end <= address)
+    {
+        result.start = committed_lower_end;
+        result.length = lower_end - result.start;
+        return result;
+    }
+
+    result.is_committed = true;
+    result.start = committed_entry->first;
+    result.length = committed_entry->second.length;
+    result.permissions = committed_entry->second.pemissions;
+
+    return result;
+}
+
+memory_usage memory_manager::get_memory_usage() const
+{
+    memory_usage usage{
+        .committed_bytes = this->committed_bytes_,
+    };
+
+    for (const auto& reserved_region : this->reserved_regions_)
+    {
+        if (reserved_region.second.is_mmio)
+        {
+            ++usage.mmio_regions;
+            continue;
+        }
+
+        ++usage.reserved_regions;
+        usage.reserved_bytes += reserved_region.second.length;
+        usage.mapped_regions += reserved_region.second.committed_regions.size();
+    }
+
+    for (const auto& shared_region : this->shared_regions_)
+    {
+        usage.shared_bytes += shared_region.second;
+    }
+
+    usage.shared_bytes += this->deduplicated_pages_.size() * MEMORY_PAGE_SIZE;
+
+    return usage;
+}
+
+void memory_manager::scan_memory(const utils::pattern_matcher& matcher, const memory_scan_callback& callback,
+                                 const uint64_t address, const uint64_t size)
+{
+    if (matcher.empty() || !size)
+    {
+        return;
+    }
+
+    const auto end = address + std::min(size, std::numeric_limits<uint64_t>::max() - address);
+
+    std::vector<std::pair<uint64_t, uint64_t>> ranges{};
+
+    for (const auto& reserved_region : this->reserved_regions_)
+    {
+        if (reserved_region.second.is_mmio)
+        {
+            continue;
+        }
+
+        for (const auto& region : reserved_region.second.committed_regions)
+        {
+            if ((region.second.pemissions & memory_permission::read) == memory_permission::none)
+            {
+                continue;
+            }
+
+            const auto range_start = std::max(address, region.first);
+            const auto range_end = std::min(end, region.first + region.second.length);
+            if (range_start >= range_end)
+            {
+                continue;
+            }
+
+            if (!ranges.empty() && ranges.back().second == range_start)
+            {
+                ranges.back().second = range_end;
+            }
+            else
+            {
+                ranges.emplace_back(range_start, range_end);
+            }
+        }
+    }
+
+    std::vector<std::byte> buffer{};
+
+    for (const auto& [range_start, range_end] : ranges)
+    {
+        const auto range_size = static_cast<size_t>(range_end - range_start);
+        const auto* data = this->get_host_memory(range_start, range_size);
+
+        if (!data)
+        {
+            buffer.resize(range_size);
+            this->read_memory(range_start, buffer.data(), buffer.size());
+            data = buffer.data();
+        }
+
+        matcher.find(std::span(data, range_size), [&](const size_t offset, const size_t pattern) {
+            callback(range_start + offset, pattern); //
+        });
+    }
 }
 
-bool memory_manager::decommit_memory(const uint64_t address, const size_t size)
+std::span<const std::byte> memory_manager::get_readable_view(const uint64_t address, const size_t size)
+{
+    if (!size || !this->has_permissions(address, size, memory_permission::read, memory_permission::none))
+    {
+        return {};
+    }
+
+    const auto* data = this->get_host_memory(address, size);
+    if (!data)
+    {
+        return {};
+    }
+
+    return {data, size};
+}
+
+std::span<std::byte> memory_manager::get_writable_view(const uint64_t address, const size_t size)
+{
+    if (!size || !this->has_permissions(address, size, memory_permission::write, memory_permission::exec))
+    {
+        return {};
+    }
+
+    this->privatize_shared_memory(address, size);
+
+    auto* data = this->get_host_memory(address, size);
+    if (!data)
+    {
+        return {};
+    }
+
+    this->record_memory_write(address, size);
+    return {data, size};
+}
+
+bool memory_manager::has_permissions(const uint64_t address, const size_t size, const memory_permission required,
+                                     const memory_permission forbidden)
 {
     const auto entry = this->find_reserved_region(address);
-    if (entry == this->reserved_regions_.end())
+    if (entry == this->reserved_regions_.end() || entry->second.is_mmio)
     {
         return false;
     }
 
-    if (entry->second.is_mmio)
+    const auto end = address + size;
+    if (end < address || entry->first + entry->second.length < end)
     {
-        throw std::runtime_error("Not allowed to decommit MMIO!");
+        return false;
     }
 
-    const auto end = address + size;
-    const auto region_end = entry->first + entry->second.length;
+    const auto& committed_regions = entry->second.committed_regions;
 
-    if (region_end < end)
+    auto region = committed_regions.upper_bound(address);
+    if (region == committed_regions.begin())
     {
-        throw std::runtime_error("Cross region decommit not supported yet!");
+        return false;
     }
 
-    auto& committed_regions = entry->second.committed_regions;
-
-    split_regions(committed_regions, {address, end});
+    auto position = address;
 
-    for (auto i = committed_regions.begin(); i != committed_regions.end();)
+    for (--region; region != committed_regions.end(); ++region)
     {
-        if (i->first >= end)
+        const auto permissions = region->second.pemissions;
+        if (region->first > position || region->first + region->second.length <= position ||
+            (permissions & required) != required || (permissions & forbidden) != memory_permission::none)
         {
-            break;
+            return false;
         }
 
-        const auto sub_region_end = i->first + i->second.length;
-        if (i->first >= address && sub_region_end <= end)
+        position = region->first + region->second.length;
+        if (position >= end)
         {
-            this->unmap_memory(i->first, i->second.length);
-            i = committed_regions.erase(i);
-            continue;
+            return true;
         }
-
-        ++i;
     }
 
-    return true;
+    return false;
 }
 
-bool memory_manager::release_memory(const uint64_t address, size_t size)
+memory_manager::reserved_region_map::iterator memory_manager::find_reserved_region(const uint64_t address)
 {
-    const auto entry = this->reserved_regions_.find(address);
-    if (entry == this->reserved_regions_.end())
+    if (this->reserved_regions_.empty())
     {
-        return false;
+        return this->reserved_regions_.end();
     }
 
-    if (!size)
+    auto upper_bound = this->reserved_regions_.upper_bound(address);
+    if (upper_bound == this->reserved_regions_.begin())
     {
-        size = entry->second.length;
+        return this->reserved_regions_.end();
     }
 
-    if (size > entry->second.length)
+    const auto entry = --upper_bound;
+    if (entry->first + entry->second.length <= address)
     {
-        throw std::runtime_error("Cross region release not supported yet!");
+        return this->reserved_regions_.end();
     }
 
-    const auto end = address + size;
-    auto& committed_regions = entry->second.committed_regions;
+    return entry;
+}
 
-    split_regions(committed_regions, {end});
+bool memory_manager::overlaps_reserved_region(const uint64_t address, const size_t size) const
+{
+    auto entry = this->reserved_regions_.upper_bound(address);
+    if (entry != this->reserved_regions_.end() && entry->first < address + size)
+    {
+        return true;
+    }
 
-    for (auto i = committed_regions.begin(); i != committed_regions.end();)
+    if (entry == this->reserved_regions_.begin())
     {
-        if (i->first >= end)
-        {
-            break;
-        }
+        return false;
+    }
 
-        const auto sub_region_end = i->first + i->second.length;
-        if (i->first >= address && sub_region_end <= end)
-        {
-            this->unmap_memory(i->first, i->second.length);
-            i = committed_regions.erase(i);
-        }
-        else
+    --entry;
+    return regions_with_length_intersect(address, size, entry->first, entry->second.length);
+}
+
+void memory_manager::map_region_data(const uint64_t address, const committed_region& region,
+                                     const std::span<const std::byte> data)
+{
+    const auto is_writable = (region.pemissions & memory_permission::write) != memory_permission::none;
+
+    if (this->shared_memory_pool_ && !is_writable)
+    {
+        const auto* shared_data = this->shared_memory_pool_->get_or_insert(address, data);
+        if (shared_data)
         {
-            ++i;
+            this->map_shared_memory(address, region.length, region.pemissions, shared_data);
+            this->shared_regions_[address] = region.length;
+            return;
         }
     }
 
-    entry->second.length -= size;
-    if (entry->second.length > 0)
+    this->map_memory(address, region.length, region.pemissions);
+    this->write_memory(address, data.data(), data.size());
+}
+
+void memory_manager::map_image_data(const uint64_t address, const committed_region& region, const uint64_t offset)
+{
+    const auto image_size = this->memory_image_->size();
+
+    if (offset % MEMORY_IMAGE_ALIGNMENT || offset > image_size || region.length > image_size - offset)
     {
-        this->reserved_regions_[address + size] = std::move(entry->second);
+        throw std::runtime_error("Bad memory image offset");
     }
 
-    this->reserved_regions_.erase(entry);
-    return true;
+    // Copy-on-write, guest writes never reach the image
+    this->map_host_memory(address, region.length, region.pemissions,
+                          this->memory_image_->data() + static_cast<size_t>(offset));
 }
 
-uint64_t memory_manager::find_free_allocation_base(const size_t size, const uint64_t start) const
+size_t memory_manager::deduplicate_pages(const size_t max_pages)
 {
-    uint64_t start_address = std::max(MIN_ALLOCATION_ADDRESS, start ? start : 0x100000000ULL);
+    if (!this->page_deduplicator_)
+    {
+        return 0;
+    }
 
-    for (const auto& region : this->reserved_regions_)
+    size_t checked_pages = 0;
+    size_t merged_pages = 0;
+
+    for (const auto& reserved_region : this->reserved_regions_)
     {
-        const auto region_end = region.first + region.second.length;
-        if (region_end < start_address)
+        if (reserved_region.second.is_mmio || this->section_views_.contains(reserved_region.first))
         {
             continue;
         }
 
-        if (!regions_with_length_intersect(start_address, size, region.first, region.second.length))
+        for (const auto& region : reserved_region.second.committed_regions)
         {
-            return start_address;
+            const auto permissions = region.second.pemissions;
+            const auto region_end = region.first + region.second.length;
+
+            if (region_end <= this->deduplication_cursor_ ||
+                (permissions & memory_permission::read) == memory_permission::none ||
+                (permissions & memory_permission::write) != memory_permission::none ||
+                this->find_shared_memory(this->shared_regions_, region.first))
+            {
+                continue;
+            }
+
+            for (auto page = std::max(region.first, this->deduplication_cursor_); page < region_end;
+                 page += MEMORY_PAGE_SIZE)
+            {
+                if (checked_pages++ == max_pages)
+                {
+                    this->deduplication_cursor_ = page;
+                    return merged_pages;
+                }
+
+                if (this->deduplicate_page(page, permissions))
+                {
+                    ++merged_pages;
+                }
+            }
         }
+    }
+
+    this->deduplication_cursor_ = 0;
+    return merged_pages;
+}
+
+bool memory_manager::deduplicate_page(const uint64_t page, const memory_permission permissions)
+{
+    // Pages under the execution watch are mapped with other permissions than the region's
+    if (this->deduplicated_pages_.contains(page) || this->watched_pages_.contains(page))
+    {
+        return false;
+    }
 
-        start_address = page_align_up(region_end);
+    const auto* data = this->get_host_memory(page, MEMORY_PAGE_SIZE);
+    if (!data)
+    {
+        return false;
     }
 
-    if (start_address + size <= MAX_ALLOCATION_ADDRESS)
+    auto shared_page = this->page_deduplicator_->get_or_insert({data, MEMORY_PAGE_SIZE});
+    if (!shared_page)
     {
-        return start_address;
+        return false;
     }
 
-    return 0;
+    // The first instance maps the shared copy as well, its own page is discarded by the backend
+    this->count_executable_unmap(permissions);
+    this->unmap_memory(page, MEMORY_PAGE_SIZE);
+    this->map_shared_memory(page, MEMORY_PAGE_SIZE, permissions, shared_page.get());
+
+    this->deduplicated_pages_[page] = std::move(shared_page);
+    return true;
 }
 
-region_info memory_manager::get_region_info(const uint64_t address)
+// The contents stay the same, so nothing counts as written. Remapping still drops the translated code of
+// executable pages, that is counted like any other executable unmap.
+void memory_manager::privatize_deduplicated_pages(const uint64_t address, const size_t size)
 {
-    region_info result{};
-    result.start = MIN_ALLOCATION_ADDRESS;
-    result.length = MAX_ALLOCATION_ADDRESS - result.start;
-    result.permissions = memory_permission::none;
-    result.allocation_base = {};
-    result.allocation_length = result.length;
-    result.is_committed = false;
-    result.is_reserved = false;
-
-    if (this->reserved_regions_.empty())
+    if (this->deduplicated_pages_.empty())
     {
-        return result;
+        return;
     }
 
-    auto upper_bound = this->reserved_regions_.upper_bound(address);
-    if (upper_bound == this->reserved_regions_.begin())
+    const auto end = address + size;
+
+    for (auto entry = this->deduplicated_pages_.lower_bound(page_align_down(address));
+         entry != this->deduplicated_pages_.end() && entry->first < end;)
     {
-        result.length = upper_bound->first - result.start;
-        return result;
+        const auto page = entry->first;
+        const auto shared_page = std::move(entry->second);
+        entry = this->deduplicated_pages_.erase(entry);
+
+        const auto permissions = this->find_committed_permissions(page);
+        if (!permissions)
+        {
+            continue;
+        }
+
+        this->count_executable_unmap(*permissions);
+        this->unmap_memory(page, MEMORY_PAGE_SIZE);
+        this->map_memory(page, MEMORY_PAGE_SIZE, *permissions);
+
+        auto* data = this->get_host_memory(page, MEMORY_PAGE_SIZE);
+        if (data)
+        {
+            memcpy(data, shared_page.get(), MEMORY_PAGE_SIZE);
+        }
+        else
+        {
+            this->write_memory(page, shared_page.get(), MEMORY_PAGE_SIZE);
+        }
     }
+}
 
-    const auto entry = --upper_bound;
-    const auto lower_end = entry->first + entry->second.length;
-    if (lower_end <= address)
+const std::byte* memory_manager::find_shared_memory(const shared_region_map& shared_regions,
+                                                    const uint64_t address) const
+{
+    if (!this->shared_memory_pool_)
     {
-        result.start = lower_end;
-        result.length = MAX_ALLOCATION_ADDRESS - result.start;
-        return result;
+        return nullptr;
     }
 
-    // We have a reserved region
-    const auto& reserved_region = entry->second;
-    const auto& committed_regions = reserved_region.committed_regions;
+    auto entry = shared_regions.upper_bound(address);
+    if (entry == shared_regions.begin())
+    {
+        return nullptr;
+    }
 
-    result.is_reserved = true;
-    result.allocation_base = entry->first;
-    result.allocation_length = reserved_region.length;
-    result.start = result.allocation_base;
-    result.length = result.allocation_length;
+    --entry;
+    if (!is_within_start_and_length(address, entry->first, entry->second))
+    {
+        return nullptr;
+    }
 
-    if (committed_regions.empty())
+    const auto* data = this->shared_memory_pool_->find(entry->first, entry->second);
+    if (!data)
     {
-        return result;
+        return nullptr;
     }
 
-    auto committed_bound = committed_regions.upper_bound(address);
-    if (committed_bound == committed_regions.begin())
+    return data + (address - entry->first);
+}
+
+void memory_manager::reserve_free_range(const uint64_t address, const size_t size)
+{
+    const auto entry = this->free_ranges_.find_preceding(address);
+    if (!entry)
     {
-        result.length = committed_bound->first - result.start;
-        return result;
+        return;
     }
 
-    const auto committed_entry = --committed_bound;
-    const auto committed_lower_end = committed_entry->first + committed_entry->second.length;
-    if (committed_lower_end <= address)
+    const auto range_start = entry->start;
+    const auto range_end = entry->end;
+    const auto end = address + size;
+
+    if (range_end < end)
     {
-        result.start = committed_lower_end;
-        result.length = lower_end - result.start;
-        return result;
+        return;
     }
 
-    result.is_committed = true;
-    result.start = committed_entry->first;
-    result.length = committed_entry->second.length;
-    result.permissions = committed_entry->second.pemissions;
+    this->free_ranges_.erase(range_start);
 
-    return result;
+    if (range_start < address)
+    {
+        this->free_ranges_.insert({range_start, address});
+    }
+
+    if (end < range_end)
+    {
+        this->free_ranges_.insert({end, range_end});
+    }
 }
 
-memory_manager::reserved_region_map::iterator memory_manager::find_reserved_region(const uint64_t address)
+void memory_manager::release_free_range(const uint64_t address, const size_t size)
 {
-    if (this->reserved_regions_.empty())
+    auto start = address;
+    auto end = address + size;
+
+    if (const auto next = this->free_ranges_.find(end))
     {
-        return this->reserved_regions_.end();
+        end = next->end;
+        this->free_ranges_.erase(next->start);
     }
 
-    auto upper_bound = this->reserved_regions_.upper_bound(address);
-    if (upper_bound == this->reserved_regions_.begin())
+    // Nothing starts at the address itself, it was reserved until now
+    if (address > 0)
     {
-        return this->reserved_regions_.end();
+        const auto previous = this->free_ranges_.find_preceding(address - 1);
+        if (previous && previous->end == start)
+        {
+            start = previous->start;
+            this->free_ranges_.erase(previous->start);
+        }
     }
 
-    const auto entry = --upper_bound;
-    if (entry->first + entry->second.length <= address)
+    this->free_ranges_.insert({start, end});
+}
+
+void memory_manager::recount_committed_bytes()
+{
+    this->committed_bytes_ = 0;
+
+    std::set<const utils::virtual_memory*> charged_section_memory{};
+
+    for (const auto& reserved_region : this->reserved_regions_)
     {
-        return this->reserved_regions_.end();
+        if (reserved_region.second.is_mmio)
+        {
+            continue;
+        }
+
+        const auto view = this->section_views_.find(reserved_region.first);
+        if (view != this->section_views_.end() && !charged_section_memory.insert(view->second.memory.get()).second)
+        {
+            continue;
+        }
+
+        for (const auto& region : reserved_region.second.committed_regions)
+        {
+            this->committed_bytes_ += region.second.length;
+        }
     }
+}
 
-    return entry;
+void memory_manager::unmap_all_regions()
+{
+    for (const auto& reserved_region : this->reserved_regions_)
+    {
+        for (const auto& region : reserved_region.second.committed_regions)
+        {
+            this->unmap_memory(region.first, region.second.length);
+        }
+    }
+
+    this->shared_regions_.clear();
+    this->section_views_.clear();
+    this->section_memory_.clear();
+    this->migrated_section_memory_.clear();
+    this->watched_pages_.clear();
+    this->deduplicated_pages_.clear();
+    this->memory_image_.reset();
 }
 
-bool memory_manager::overlaps_reserved_region(const uint64_t address, const size_t size) const
+void memory_manager::rebuild_free_ranges()
 {
+    this->free_ranges_.clear();
+
+    uint64_t range_start = 0;
+
     for (const auto& region : this->reserved_regions_)
     {
-        if (regions_with_length_intersect(address, size, region.first, region.second.length))
+        if (region.first > range_start)
         {
-            return true;
+            this->free_ranges_.insert({range_start, region.first});
         }
+
+        range_start = region.first + region.second.length;
     }
 
-    return false;
+    this->free_ranges_.insert({range_start, FREE_RANGE_END});
 }
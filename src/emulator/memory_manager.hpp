@@ -1,9 +1,24 @@
 #pragma once
 #include <map>
+#include <limits>
+#include <algorithm>
+#include <memory>
+#include <optional>
+#include <set>
+#include <unordered_map>
 
 #include "memory_region.hpp"
 #include "address_utils.hpp"
+#include "flat_map.hpp"
+#include "free_range_tree.hpp"
 #include "serialization.hpp"
+#include "shared_memory_pool.hpp"
+#include "page_store.hpp"
+#include "page_deduplicator.hpp"
+
+#include <utils/mapped_file.hpp>
+#include <utils/pattern_matcher.hpp>
+#include <utils/virtual_memory.hpp>
 
 struct region_info : basic_memory_region
 {
@@ -13,6 +28,45 @@ struct region_info : basic_memory_region
     bool is_committed{};
 };
 
+// Operations that make the backend drop translated code. Quickly growing counts point at guests that keep
+// flipping code permissions or at instrumentation that keeps changing hooks.
+struct code_invalidation_statistics
+{
+    uint64_t protection_changes{};
+    uint64_t skipped_protection_changes{};
+    uint64_t executable_unmaps{};
+    uint64_t full_flushes{};
+};
+
+// Guest memory of one instance. Shared bytes are committed as well, but backed by a shared_memory_pool or a
+// page_deduplicator that other instances map too.
+struct memory_usage
+{
+    uint64_t reserved_bytes{};
+    uint64_t committed_bytes{};
+    uint64_t shared_bytes{};
+    size_t reserved_regions{};
+    size_t mapped_regions{};
+    size_t mmio_regions{};
+};
+
+using memory_scan_callback = std::function<void(uint64_t address, size_t pattern)>;
+using executable_memory_callback = std::function<void(uint64_t address, size_t size)>;
+using written_execution_callback = std::function<void(uint64_t page)>;
+
+// Keeps the region contents of a state apart from it, at offsets aligned to MEMORY_IMAGE_ALIGNMENT. A copy-on-write
+// mapping of the image then backs the guest memory directly when the state is loaded.
+constexpr size_t MEMORY_IMAGE_ALIGNMENT = 0x1000;
+
+class memory_image_writer
+{
+  public:
+    virtual ~memory_image_writer() = default;
+
+    // Returns the aligned offset of the data in the image
+    virtual uint64_t write(std::span<const std::byte> data) = 0;
+};
+
 using mmio_read_callback = std::function<uint64_t(uint64_t addr, size_t size)>;
 using mmio_write_callback = std::function<void(uint64_t addr, size_t size, uint64_t data)>;
 
@@ -25,7 +79,7 @@ class memory_manager
         memory_permission pemissions{};
     };
 
-    using committed_region_map = std::map<uint64_t, committed_region>;
+    using committed_region_map = flat_map<uint64_t, committed_region>;
 
     struct reserved_region
     {
@@ -34,6 +88,8 @@ class memory_manager
         bool is_mmio{false};
     };
 
+    using reserved_region_map = flat_map<uint64_t, reserved_region>;
+
     virtual ~memory_manager() = default;
 
     template <typename T>
@@ -97,10 +153,131 @@ class memory_manager
 
     bool release_memory(uint64_t address, size_t size);
 
+    // Host memory behind section views. Every view maps the same memory, so writes through one of them are seen
+    // by all others without copying. Views turn into private copies when they are partially released or
+    // decommitted. Returns 0 if the host memory is exhausted.
+    uint64_t create_section_memory(size_t size);
+    // Memory that is still mapped stays alive until its last view is released
+    void release_section_memory(uint64_t id);
+    size_t get_section_memory_size(uint64_t id) const;
+
+    // Maps the whole section memory as a region of its own
+    bool map_section_view(uint64_t address, uint64_t id, memory_permission permissions);
+    bool is_section_view(uint64_t address) const;
+
     uint64_t find_free_allocation_base(size_t size, uint64_t start = 0) const;
 
     region_info get_region_info(uint64_t address);
 
+    // Host memory backing a committed guest range, so syscall handlers can work on it in place.
+    // Empty if the range lacks the permissions, isn't backed by one contiguous host block, or is MMIO; callers
+    // fall back to read_memory and write_memory then. Views skip memory hooks and stay valid until the memory
+    // layout changes or emulation resumes.
+    std::span<const std::byte> get_readable_view(uint64_t address, size_t size);
+
+    // Writing through a view doesn't invalidate translated code, so executable memory is never returned.
+    // The whole range is recorded as written.
+    std::span<std::byte> get_writable_view(uint64_t address, size_t size);
+
+    memory_usage get_memory_usage() const;
+
+    // Matches the patterns against committed, readable memory of the range without copying it where the backend
+    // owns host memory. Contiguous regions are scanned as one, matches don't span unreadable gaps.
+    void scan_memory(const utils::pattern_matcher& matcher, const memory_scan_callback& callback, uint64_t address = 0,
+                     uint64_t size = std::numeric_limits<uint64_t>::max());
+
+    // Called after protect_memory made a range executable, which covers mapped images and unpacked code.
+    // Lets scanners look at new code only instead of rescanning the process.
+    void set_executable_memory_callback(executable_memory_callback callback)
+    {
+        this->executable_memory_callback_ = std::move(callback);
+    }
+
+    // Commits beyond the limit fail, 0 means no limit
+    void set_commit_limit(const uint64_t limit)
+    {
+        this->commit_limit_ = limit;
+    }
+
+    uint64_t get_commit_limit() const
+    {
+        return this->commit_limit_;
+    }
+
+    uint64_t get_committed_bytes() const
+    {
+        return this->committed_bytes_;
+    }
+
+    bool has_commit_capacity(const uint64_t size) const
+    {
+        return !this->commit_limit_ || (this->committed_bytes_ <= this->commit_limit_ &&
+                                        size <= this->commit_limit_ - this->committed_bytes_);
+    }
+
+    std::vector<uint64_t> collect_dirty_pages() const;
+    void clear_dirty_pages();
+
+    // Pages written or committed since the tracker was added, see emulator::start_page_tracker
+    std::vector<uint64_t> collect_tracked_pages(uint64_t tracker) const;
+    void stop_page_tracker(uint64_t tracker);
+
+    // Called for faults on executing memory, true if the execution watch caused it. The page got its execute
+    // permission back then, so the instruction can run again.
+    bool handle_watched_execution(uint64_t address);
+    void stop_execution_watch();
+
+    const code_invalidation_statistics& get_code_invalidation_statistics() const
+    {
+        return this->invalidation_statistics_;
+    }
+
+    bool is_tracking_dirty_pages() const
+    {
+        return this->tracks_dirty_pages_;
+    }
+
+    void set_shared_memory_pool(std::shared_ptr<shared_memory_pool> pool)
+    {
+        this->shared_memory_pool_ = std::move(pool);
+    }
+
+    // Read-only pages are merged with identical pages of other instances that use the same deduplicator. They
+    // become private again once they are written or made writable.
+    void set_page_deduplicator(std::shared_ptr<page_deduplicator> deduplicator)
+    {
+        this->page_deduplicator_ = std::move(deduplicator);
+    }
+
+    // Checks up to max_pages read-only pages, starting after the page the previous call stopped at, so the work can
+    // be spread over the emulation. Returns the number of pages that were merged.
+    size_t deduplicate_pages(size_t max_pages);
+
+    // Backends may back large regions with host huge pages, which makes TLB misses rarer for big guest heaps
+    void set_huge_pages(const bool enabled)
+    {
+        this->huge_pages_ = enabled;
+    }
+
+    bool uses_huge_pages() const
+    {
+        return this->huge_pages_;
+    }
+
+    // Serializes every distinct page only once and zero pages as a flag. With a store, the page contents
+    // are kept in there and states only reference them by their hash.
+    void set_page_deduplication(const bool enabled, std::shared_ptr<page_store> store = {})
+    {
+        this->deduplicate_pages_ = enabled;
+        this->page_store_ = std::move(store);
+    }
+
+    // More than one thread splits memory into chunks that are serialized and deserialized independently
+    void set_serialization_threads(const size_t count)
+    {
+        this->serialization_threads_ = std::max(count, static_cast<size_t>(1));
+    }
+
     uint64_t allocate_memory(const size_t size, const memory_permission permissions, const bool reserve_only = false)
     {
         const auto allocation_base = this->find_free_allocation_base(size);
@@ -113,19 +290,177 @@ class memory_manager
     }
 
   private:
-    using reserved_region_map = std::map<uint64_t, reserved_region>;
     reserved_region_map reserved_regions_{};
+    free_range_tree free_ranges_{{0, std::numeric_limits<uint64_t>::max()}};
+
+    using shared_region_map = std::map<uint64_t, size_t>;
+
+    std::shared_ptr<shared_memory_pool> shared_memory_pool_{};
+    shared_region_map shared_regions_{};
+
+    std::shared_ptr<page_deduplicator> page_deduplicator_{};
+    std::map<uint64_t, page_deduplicator::shared_page> deduplicated_pages_{};
+    uint64_t deduplication_cursor_{};
+
+    using section_memory = std::shared_ptr<utils::virtual_memory>;
+    using section_memory_map = std::map<uint64_t, section_memory>;
+
+    struct section_view
+    {
+        uint64_t id{};
+        section_memory memory{};
+    };
+
+    // Views by the base of their reserved region, which they span
+    using section_view_map = std::map<uint64_t, section_view>;
+
+    section_memory_map section_memory_{};
+    section_view_map section_views_{};
+    uint64_t next_section_memory_id_{1};
+
+    bool huge_pages_{false};
+    bool deduplicate_pages_{false};
+    std::shared_ptr<page_store> page_store_{};
+    size_t serialization_threads_{1};
+
+    // Page contents by committed region. Snapshots taken or restored from each other share unchanged pages.
+    using snapshot_pages = std::vector<std::shared_ptr<const std::byte>>;
+
+    struct memory_snapshot
+    {
+        reserved_region_map regions{};
+        shared_region_map shared_regions{};
+        section_memory_map section_memory{};
+        section_view_map section_views{};
+        std::map<uint64_t, snapshot_pages> data{};
+    };
+
+    // Backs the regions mapped from a memory image, which stay mapped until the whole layout is replaced
+    std::shared_ptr<utils::mapped_file> memory_image_{};
+
+    std::map<uint64_t, memory_snapshot> memory_snapshots_{};
+    // Snapshot the memory was last saved as or restored to, the dirty pages are relative to it
+    std::optional<uint64_t> base_snapshot_{};
+    bool layout_changed_{false};
+
+    bool tracks_dirty_pages_{false};
+    std::unordered_map<uint64_t, uint64_t> dirty_page_bitmap_{};
+
+    // Pages written or committed since the previous migration round, independent of the snapshots
+    bool tracks_migration_pages_{false};
+    std::unordered_map<uint64_t, uint64_t> migration_page_bitmap_{};
+    // Section memory without views at the previous round, it can't have been written since
+    std::set<uint64_t> migrated_section_memory_{};
+
+    // Bitmaps of the running page trackers, by tracker id
+    uint64_t next_page_tracker_{};
+    std::map<uint64_t, std::unordered_map<uint64_t, uint64_t>> page_trackers_{};
+
+    // Pages the guest wrote while the execution watch runs and didn't execute since. The backend maps them without
+    // execute permission, so only their first execution after a write faults.
+    written_execution_callback written_execution_callback_{};
+    std::set<uint64_t> watched_pages_{};
+
+    code_invalidation_statistics invalidation_statistics_{};
+
+    executable_memory_callback executable_memory_callback_{};
+
+    uint64_t commit_limit_{};
+    uint64_t committed_bytes_{};
+
+    void recount_committed_bytes();
+
+    void count_executable_unmap(memory_permission permissions);
 
     reserved_region_map::iterator find_reserved_region(uint64_t address);
     bool overlaps_reserved_region(uint64_t address, size_t size) const;
 
+    void reserve_free_range(uint64_t address, size_t size);
+    void release_free_range(uint64_t address, size_t size);
+    void rebuild_free_ranges();
+    void unmap_all_regions();
+
+    const std::byte* find_shared_memory(const shared_region_map& shared_regions, uint64_t address) const;
+    bool deduplicate_page(uint64_t page, memory_permission permissions);
+    void privatize_deduplicated_pages(uint64_t address, size_t size);
+    static std::byte* find_view_memory(const section_view_map& views, uint64_t address);
+    bool has_section_views(const section_memory& memory, uint64_t excluded_view = 0) const;
+    void privatize_section_view(section_view_map::iterator view);
+    void record_section_view_write(uint64_t address, size_t size, bool guest_write);
+    section_memory_map collect_section_memory() const;
+    void serialize_section_views(utils::buffer_serializer& buffer,
+                                 const std::set<uint64_t>& unchanged_memory = {}) const;
+    void deserialize_section_views(utils::buffer_deserializer& buffer, const section_memory_map& current_memory = {});
+    void finish_memory_delta();
+    bool has_permissions(uint64_t address, size_t size, memory_permission required, memory_permission forbidden);
+    std::optional<memory_permission> find_committed_permissions(uint64_t address);
+    void watch_written_pages(uint64_t address, size_t size);
+    void revoke_watched_execution(uint64_t address, size_t size, memory_permission permissions);
+    void forget_watched_pages(uint64_t address, size_t size);
+    void map_region_data(uint64_t address, const committed_region& region, std::span<const std::byte> data);
+    void map_image_data(uint64_t address, const committed_region& region, uint64_t offset);
+    memory_snapshot read_memory_snapshot();
+    void update_snapshot_pages(memory_snapshot& snapshot, const std::vector<uint64_t>& pages);
+    void restore_snapshot_pages(const memory_snapshot& snapshot, const std::vector<uint64_t>& pages);
+    void restore_changed_pages(const memory_snapshot& snapshot, const memory_snapshot* base, uint64_t address,
+                               const committed_region& region);
+    const memory_snapshot* get_base_snapshot() const;
+
     virtual void map_mmio(uint64_t address, size_t size, mmio_read_callback read_cb, mmio_write_callback write_cb) = 0;
     virtual void map_memory(uint64_t address, size_t size, memory_permission permissions) = 0;
+    virtual void map_shared_memory(uint64_t address, size_t size, memory_permission permissions,
+                                   const std::byte* data) = 0;
+    // Maps host memory that is owned by the caller and may be written
+    virtual void map_host_memory(uint64_t address, size_t size, memory_permission permissions, std::byte* data) = 0;
     virtual void unmap_memory(uint64_t address, size_t size) = 0;
 
     virtual void apply_memory_protection(uint64_t address, size_t size, memory_permission permissions) = 0;
 
+    // Null if the backend doesn't own host memory for the whole range
+    virtual std::byte* get_host_memory(uint64_t address, size_t size) = 0;
+
   protected:
-    void serialize_memory_state(utils::buffer_serializer& buffer, bool is_snapshot) const;
-    void deserialize_memory_state(utils::buffer_deserializer& buffer, bool is_snapshot);
+    // With an image, the region contents are written to it instead of the buffer. Section views are always part of
+    // the buffer, their memory is shared and may be written through any of their views.
+    void serialize_memory_state(utils::buffer_serializer& buffer, memory_image_writer* image = nullptr) const;
+    // States with region contents in an image require a copy-on-write mapping of it
+    void deserialize_memory_state(utils::buffer_deserializer& buffer, std::shared_ptr<utils::mapped_file> image = {});
+
+    // Live migration rounds after a full serialization carry the layout, but only the pages written or committed
+    // since the previous round. The receiver fills in the rest from its current memory.
+    void start_migration_page_tracking();
+    void serialize_memory_delta(utils::buffer_serializer& buffer);
+    void deserialize_memory_delta(utils::buffer_deserializer& buffer);
+
+    // Starting from the base snapshot, saving only reads the pages written since and restoring only writes the
+    // pages that differ, as long as the memory layout stayed the same
+    void save_memory_snapshot(uint64_t id);
+    void restore_memory_snapshot(uint64_t id);
+    void delete_memory_snapshot(uint64_t id);
+
+    // Reverts only the pages written since the base snapshot, which is enough as long as no memory was mapped,
+    // unmapped or protected since. Returns false without reverting anything otherwise.
+    bool revert_dirty_pages();
+
+    void start_dirty_page_tracking()
+    {
+        this->tracks_dirty_pages_ = true;
+    }
+
+    void start_written_execution_watch(written_execution_callback callback)
+    {
+        this->written_execution_callback_ = std::move(callback);
+    }
+
+    // Host writes, like the ones of the loader, don't feed the execution watch
+    void record_memory_write(uint64_t address, size_t size, bool guest_write = false);
+    void record_committed_memory(uint64_t address, size_t size);
+    void mark_tracked_pages(uint64_t address, size_t size);
+    uint64_t add_page_tracker();
+    void privatize_shared_memory(uint64_t address, size_t size);
+
+    void count_full_flush()
+    {
+        ++this->invalidation_statistics_.full_flushes;
+    }
 };
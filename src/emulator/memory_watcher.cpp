@@ -0,0 +1,224 @@
+#include "memory_watcher.hpp"
+
+#include <ranges>
+#include <limits>
+#include <optional>
+#include <algorithm>
+
+#include <utils/finally.hpp>
+
+namespace
+{
+    bool matches(const memory_operation filter, const memory_operation operation)
+    {
+        return (filter & operation) != memory_operation::none;
+    }
+
+    uint64_t get_end(const uint64_t address, const size_t size)
+    {
+        return size > std::numeric_limits<uint64_t>::max() - address ? std::numeric_limits<uint64_t>::max()
+                                                                       : address + size;
+    }
+}
+
+memory_watcher::memory_watcher(emulator& emu)
+    : emu_(&emu)
+{
+}
+
+memory_watcher::~memory_watcher()
+{
+    this->remove_hooks();
+}
+
+memory_watcher::watch_id memory_watcher::watch(const uint64_t address, const size_t size,
+                                               const memory_operation filter, complex_memory_hook_callback callback)
+{
+    watch_entry entry{};
+    entry.start = address;
+    entry.end = get_end(address, size);
+    entry.filter = filter;
+    entry.callback = std::move(callback);
+
+    const auto id = this->next_id_++;
+    this->watches_.emplace(id, std::move(entry));
+
+    this->update();
+
+    return id;
+}
+
+void memory_watcher::unwatch(const watch_id id)
+{
+    const auto entry = this->watches_.find(id);
+    if (entry == this->watches_.end())
+    {
+        return;
+    }
+
+    // The callback might be running right now, it is removed once dispatching is done
+    if (this->is_dispatching_)
+    {
+        entry->second.filter = memory_operation::none;
+        this->needs_update_ = true;
+        return;
+    }
+
+    this->watches_.erase(entry);
+    this->update();
+}
+
+void memory_watcher::update()
+{
+    if (this->is_dispatching_)
+    {
+        this->needs_update_ = true;
+        return;
+    }
+
+    this->needs_update_ = false;
+
+    std::erase_if(this->watches_, [](const auto& entry) { return entry.second.filter == memory_operation::none; });
+
+    this->rebuild_segments();
+    this->rebuild_hooks();
+}
+
+void memory_watcher::rebuild_segments()
+{
+    std::vector<uint64_t> boundaries{};
+    boundaries.reserve(this->watches_.size() * 2);
+
+    for (const auto& entry : this->watches_ | std::views::values)
+    {
+        if (entry.start < entry.end)
+        {
+            boundaries.push_back(entry.start);
+            boundaries.push_back(entry.end);
+        }
+    }
+
+    std::ranges::sort(boundaries);
+    const auto duplicates = std::ranges::unique(boundaries);
+    boundaries.erase(duplicates.begin(), duplicates.end());
+
+    std::map<uint64_t, segment> segments{};
+
+    for (size_t i = 1; i < boundaries.size(); ++i)
+    {
+        segments[boundaries[i - 1]].end = boundaries[i];
+    }
+
+    for (const auto& [id, entry] : this->watches_)
+    {
+        for (auto i = segments.lower_bound(entry.start); i != segments.end() && i->first < entry.end; ++i)
+        {
+            i->second.filter = i->second.filter | entry.filter;
+            i->second.watches.push_back(id);
+        }
+    }
+
+    std::erase_if(segments, [](const auto& entry) { return entry.second.watches.empty(); });
+
+    this->segments_ = std::move(segments);
+}
+
+void memory_watcher::rebuild_hooks()
+{
+    this->remove_hooks();
+
+    const auto add_hook = [this](const uint64_t start, const uint64_t end, const memory_operation filter) {
+        auto* hook = this->emu_->hook_memory_access(
+            start, static_cast<size_t>(end - start), filter,
+            [this](const uint64_t address, const size_t size, const uint64_t value, const memory_operation operation) {
+                this->dispatch(address, size, value, operation);
+            });
+
+        if (hook)
+        {
+            this->hooks_.push_back(hook);
+        }
+    };
+
+    std::optional<segment> range{};
+    uint64_t range_start{};
+
+    for (const auto& [start, entry] : this->segments_)
+    {
+        if (range && range->end == start)
+        {
+            range->end = entry.end;
+            range->filter = range->filter | entry.filter;
+            continue;
+        }
+
+        if (range)
+        {
+            add_hook(range_start, range->end, range->filter);
+        }
+
+        range_start = start;
+        range = segment{.end = entry.end, .filter = entry.filter};
+    }
+
+    if (range)
+    {
+        add_hook(range_start, range->end, range->filter);
+    }
+}
+
+void memory_watcher::remove_hooks()
+{
+    for (auto* hook : this->hooks_)
+    {
+        this->emu_->delete_hook(hook);
+    }
+
+    this->hooks_.clear();
+}
+
+void memory_watcher::dispatch(const uint64_t address, const size_t size, const uint64_t value,
+                              const memory_operation operation)
+{
+    const auto end = get_end(address, std::max(size, static_cast<size_t>(1)));
+
+    auto entry = this->segments_.upper_bound(address);
+    if (entry != this->segments_.begin() && std::prev(entry)->second.end > address)
+    {
+        --entry;
+    }
+
+    {
+        const auto was_dispatching = this->is_dispatching_;
+        this->is_dispatching_ = true;
+
+        const auto _ = utils::finally([&] { this->is_dispatching_ = was_dispatching; });
+
+        // Segments are only rebuilt after dispatching. Watches spanning several segments are called for the
+        // first one only.
+        for (auto first = entry; entry != this->segments_.end() && entry->first < end; ++entry)
+        {
+            if (!matches(entry->second.filter, operation))
+            {
+                continue;
+            }
+
+            for (const auto id : entry->second.watches)
+            {
+                const auto watch = this->watches_.find(id);
+                if (watch == this->watches_.end() || !matches(watch->second.filter, operation) ||
+                    (entry != first && watch->second.start < entry->first))
+                {
+                    continue;
+                }
+
+                watch->second.callback(address, size, value, operation);
+            }
+        }
+    }
+
+    if (!this->is_dispatching_ && this->needs_update_)
+    {
+        this->update();
+    }
+}
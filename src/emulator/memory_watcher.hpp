@@ -0,0 +1,65 @@
+#pragma once
+
+#include <map>
+#include <vector>
+
+#include "emulator.hpp"
+
+// Dispatches memory accesses to many watchers through few emulator hooks. Overlapping or adjacent
+// watched ranges share one hook and accesses are matched against an interval index, so the cost of
+// an access does not grow with the number of watchers.
+class memory_watcher
+{
+  public:
+    using watch_id = uint64_t;
+
+    explicit memory_watcher(emulator& emu);
+    ~memory_watcher();
+
+    memory_watcher(memory_watcher&&) = delete;
+    memory_watcher(const memory_watcher&) = delete;
+    memory_watcher& operator=(memory_watcher&&) = delete;
+    memory_watcher& operator=(const memory_watcher&) = delete;
+
+    // Watches may be added and removed from within callbacks
+    watch_id watch(uint64_t address, size_t size, memory_operation filter, complex_memory_hook_callback callback);
+    void unwatch(watch_id id);
+
+    size_t get_hook_count() const
+    {
+        return this->hooks_.size();
+    }
+
+  private:
+    struct watch_entry
+    {
+        uint64_t start{};
+        uint64_t end{};
+        memory_operation filter{};
+        complex_memory_hook_callback callback{};
+    };
+
+    // Part of the address space in which the same watchers are active
+    struct segment
+    {
+        uint64_t end{};
+        memory_operation filter{};
+        std::vector<watch_id> watches{};
+    };
+
+    emulator* emu_{};
+    watch_id next_id_{1};
+    std::map<watch_id, watch_entry> watches_{};
+    std::map<uint64_t, segment> segments_{};
+    std::vector<emulator_hook*> hooks_{};
+
+    bool is_dispatching_{false};
+    bool needs_update_{false};
+
+    void update();
+    void rebuild_segments();
+    void rebuild_hooks();
+    void remove_hooks();
+
+    void dispatch(uint64_t address, size_t size, uint64_t value, memory_operation operation);
+};
@@ -0,0 +1,84 @@
+#pragma once
+#include <map>
+#include <new>
+#include <span>
+#include <mutex>
+#include <memory>
+#include <cstdint>
+#include <cstring>
+
+#include "page_store.hpp"
+
+// Read-only page contents by hash, shared between all emulators of the host process that deduplicate against it.
+// Unlike a shared_memory_pool, the emulators don't need to be created from the same state. Pages are released
+// once no emulator maps them anymore.
+class page_deduplicator
+{
+  public:
+    static constexpr size_t SHARED_PAGE_SIZE = 0x1000;
+
+    using shared_page = std::shared_ptr<const std::byte>;
+
+    // Null if a different page with the same hash is shared already
+    shared_page get_or_insert(const std::span<const std::byte> data)
+    {
+        if (data.size() != SHARED_PAGE_SIZE)
+        {
+            return {};
+        }
+
+        const auto hash = hash_page(data);
+
+        std::lock_guard _{this->mutex_};
+
+        auto& entry = this->pages_[hash];
+
+        auto page = entry.lock();
+        if (!page)
+        {
+            page = allocate_page(data);
+            entry = page;
+
+            this->remove_released_pages();
+        }
+
+        if (memcmp(page.get(), data.data(), SHARED_PAGE_SIZE) != 0)
+        {
+            return {};
+        }
+
+        return page;
+    }
+
+    size_t get_page_count() const
+    {
+        std::lock_guard _{this->mutex_};
+        return this->pages_.size();
+    }
+
+  private:
+    static constexpr size_t CLEANUP_INTERVAL = 0x1000;
+
+    mutable std::mutex mutex_{};
+    std::map<page_hash, std::weak_ptr<const std::byte>> pages_{};
+    size_t insertions_{};
+
+    // Aligned like guest pages, so backends can map the memory directly
+    static shared_page allocate_page(const std::span<const std::byte> data)
+    {
+        auto* memory = static_cast<std::byte*>(::operator new(SHARED_PAGE_SIZE, std::align_val_t{SHARED_PAGE_SIZE}));
+        memcpy(memory, data.data(), SHARED_PAGE_SIZE);
+
+        return {memory, [](const std::byte* page) {
+                    ::operator delete(const_cast<std::byte*>(page), std::align_val_t{SHARED_PAGE_SIZE}); //
+                }};
+    }
+
+    void remove_released_pages()
+    {
+        if (++this->insertions_ % CLEANUP_INTERVAL == 0)
+        {
+            std::erase_if(this->pages_, [](const auto& entry) { return entry.second.expired(); });
+        }
+    }
+};
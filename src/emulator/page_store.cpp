@@ -0,0 +1,106 @@
+#include "page_store.hpp"
+
+#include <cstdio>
+#include <thread>
+#include <fstream>
+#include <stdexcept>
+
+namespace
+{
+    uint64_t mix(uint64_t value)
+    {
+        value ^= value >> 33;
+        value *= 0xFF51AFD7ED558CCDULL;
+        value ^= value >> 33;
+        value *= 0xC4CEB9FE1A85EC53ULL;
+        value ^= value >> 33;
+        return value;
+    }
+
+    uint64_t rotate_left(const uint64_t value, const int shift)
+    {
+        return (value << shift) | (value >> (64 - shift));
+    }
+}
+
+std::string page_hash::to_string() const
+{
+    char buffer[33]{};
+    (void)snprintf(buffer, sizeof(buffer), "%016llx%016llx", static_cast<unsigned long long>(this->high),
+                   static_cast<unsigned long long>(this->low));
+    return buffer;
+}
+
+page_hash hash_page(const std::span<const std::byte> data)
+{
+    uint64_t low = 0x9E3779B97F4A7C15ULL;
+    uint64_t high = 0xD6E8FEB86659FD93ULL;
+
+    size_t offset = 0;
+
+    for (; offset + sizeof(uint64_t) <= data.size(); offset += sizeof(uint64_t))
+    {
+        uint64_t word{};
+        memcpy(&word, data.data() + offset, sizeof(word));
+
+        low = rotate_left(low ^ mix(word), 27) * 0x9FB21C651E98DF25ULL;
+        high = rotate_left(high + mix(word ^ 0xA0761D6478BD642FULL), 31) * 0xC2B2AE3D27D4EB4FULL;
+    }
+
+    uint64_t tail{};
+    memcpy(&tail, data.data() + offset, data.size() - offset);
+
+    low = mix(low ^ mix(tail) ^ data.size());
+    high = mix(high + mix(tail ^ low) + data.size());
+
+    return {low, high};
+}
+
+directory_page_store::directory_page_store(std::filesystem::path directory)
+    : directory_(std::move(directory))
+{
+    std::filesystem::create_directories(this->directory_);
+}
+
+void directory_page_store::store(const page_hash& hash, const std::span<const std::byte> data)
+{
+    const auto file = this->directory_ / hash.to_string();
+
+    std::error_code ec{};
+    if (std::filesystem::exists(file, ec))
+    {
+        return;
+    }
+
+    // Concurrent writers of the same page produce identical files, the rename makes each write atomic
+    auto temp_file = file;
+    temp_file += "." + std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id())) + ".tmp";
+
+    {
+        std::ofstream stream(temp_file, std::ios::binary | std::ios::trunc);
+        stream.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+
+        if (!stream)
+        {
+            throw std::runtime_error("Failed to store page: " + file.string());
+        }
+    }
+
+    std::filesystem::rename(temp_file, file, ec);
+    if (ec)
+    {
+        std::filesystem::remove(temp_file, ec);
+    }
+}
+
+bool directory_page_store::load(const page_hash& hash, const std::span<std::byte> data) const
+{
+    std::ifstream stream(this->directory_ / hash.to_string(), std::ios::binary);
+    if (!stream)
+    {
+        return false;
+    }
+
+    stream.read(reinterpret_cast<char*>(data.data()), static_cast<std::streamsize>(data.size()));
+    return stream.gcount() == static_cast<std::streamsize>(data.size()) && stream.peek() == EOF;
+}
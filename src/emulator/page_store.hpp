@@ -0,0 +1,76 @@
+#pragma once
+
+#include <map>
+#include <span>
+#include <mutex>
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include <compare>
+#include <filesystem>
+
+struct page_hash
+{
+    uint64_t low{};
+    uint64_t high{};
+
+    auto operator<=>(const page_hash&) const = default;
+
+    std::string to_string() const;
+};
+
+// 128 bit content hash, not resistant against deliberately crafted collisions
+page_hash hash_page(std::span<const std::byte> data);
+
+// Content addressed storage of memory pages that can be shared by multiple snapshots and emulators
+class page_store
+{
+  public:
+    virtual ~page_store() = default;
+
+    // Both functions may be called from multiple threads at once
+    virtual void store(const page_hash& hash, std::span<const std::byte> data) = 0;
+    virtual bool load(const page_hash& hash, std::span<std::byte> data) const = 0;
+};
+
+class memory_page_store : public page_store
+{
+  public:
+    void store(const page_hash& hash, const std::span<const std::byte> data) override
+    {
+        std::lock_guard _{this->mutex_};
+        this->pages_.try_emplace(hash, data.begin(), data.end());
+    }
+
+    bool load(const page_hash& hash, const std::span<std::byte> data) const override
+    {
+        std::lock_guard _{this->mutex_};
+
+        const auto entry = this->pages_.find(hash);
+        if (entry == this->pages_.end() || entry->second.size() != data.size())
+        {
+            return false;
+        }
+
+        memcpy(data.data(), entry->second.data(), data.size());
+        return true;
+    }
+
+  private:
+    mutable std::mutex mutex_{};
+    std::map<page_hash, std::vector<std::byte>> pages_{};
+};
+
+// Stores every page in a file named after its hash, so directories can be synced between machines
+class directory_page_store : public page_store
+{
+  public:
+    directory_page_store(std::filesystem::path directory);
+
+    void store(const page_hash& hash, std::span<const std::byte> data) override;
+    bool load(const page_hash& hash, std::span<std::byte> data) const override;
+
+  private:
+    std::filesystem::path directory_{};
+};
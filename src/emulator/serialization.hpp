@@ -8,12 +8,41 @@
 #include <optional>
 #include <functional>
 #include <typeindex>
+#include <limits>
+#include <algorithm>
+#include <unordered_map>
 
 namespace utils
 {
     class buffer_serializer;
     class buffer_deserializer;
 
+    // Destination of streamed serialization, e.g. a file, a socket or a compressor
+    class serialization_sink
+    {
+      public:
+        virtual ~serialization_sink() = default;
+        virtual void write(std::span<const std::byte> data) = 0;
+    };
+
+    // Source of streamed deserialization. Returns the number of bytes read, 0 at the end of the stream.
+    class serialization_source
+    {
+      public:
+        virtual ~serialization_source() = default;
+        virtual size_t read(std::span<std::byte> data) = 0;
+    };
+
+    constexpr size_t DEFAULT_STREAM_CHUNK_SIZE = 0x10000;
+
+    // Debug builds follow every write with the offset it started at, to detect reads that don't match the writes.
+    // Release builds leave the guards out, data can therefore not be exchanged between the two.
+#ifdef NDEBUG
+    constexpr bool SERIALIZATION_GUARDS = false;
+#else
+    constexpr bool SERIALIZATION_GUARDS = true;
+#endif
+
     template <typename T>
     concept Serializable = requires(T a, const T ac, buffer_serializer& serializer, buffer_deserializer& deserializer) {
         { ac.serialize(serializer) } -> std::same_as<void>;
@@ -60,6 +89,13 @@ namespace utils
         struct has_deserializer_constructor : std::bool_constant<std::is_constructible_v<T, buffer_deserializer&>>
         {
         };
+
+        // Ranges of these types are copied as a whole instead of element by element
+        template <typename T>
+        constexpr bool is_bulk_serializable_v =
+            std::is_trivially_copyable_v<T> && std::is_default_constructible_v<T> && !std::is_same_v<T, bool> &&
+            !Serializable<T> && !has_serialize_function<T>::value && !has_deserialize_function<T>::value &&
+            !has_deserializer_constructor<T>::value;
     }
 
     class buffer_deserializer
@@ -79,14 +115,22 @@ namespace utils
         {
         }
 
+        // Reads incrementally, only the data of the current read is kept in memory.
+        // Spans returned by read_data stay valid until the next read.
+        buffer_deserializer(serialization_source& source, bool no_debugging = false)
+            : no_debugging_(no_debugging),
+              source_(&source)
+        {
+        }
+
         std::span<const std::byte> read_data(const size_t length)
         {
-#ifndef NDEBUG
-            const uint64_t real_old_size = this->offset_;
-            (void)real_old_size;
-#endif
+            const auto has_guard = SERIALIZATION_GUARDS && !this->no_debugging_;
+            const uint64_t real_old_size = this->get_offset();
+            const auto guard_size = has_guard ? sizeof(uint64_t) : 0;
 
-            if (this->offset_ + length > this->buffer_.size())
+            if (length > std::numeric_limits<size_t>::max() - guard_size ||
+                !this->ensure_available(length + guard_size))
             {
                 throw std::runtime_error("Out of bounds read from byte buffer");
             }
@@ -94,17 +138,9 @@ namespace utils
             const std::span result(this->buffer_.data() + this->offset_, length);
             this->offset_ += length;
 
-            (void)this->no_debugging_;
-
-#ifndef NDEBUG
-            if (!this->no_debugging_)
+            if (has_guard)
             {
                 uint64_t old_size{};
-                if (this->offset_ + sizeof(old_size) > this->buffer_.size())
-                {
-                    throw std::runtime_error("Out of bounds read from byte buffer");
-                }
-
                 memcpy(&old_size, this->buffer_.data() + this->offset_, sizeof(old_size));
                 if (old_size != real_old_size)
                 {
@@ -113,7 +149,6 @@ namespace utils
 
                 this->offset_ += sizeof(old_size);
             }
-#endif
 
             return result;
         }
@@ -197,11 +232,25 @@ namespace utils
         {
             const auto size = this->read<uint64_t>();
             result.clear();
-            result.reserve(size);
 
-            for (uint64_t i = 0; i < size; ++i)
+            if constexpr (detail::is_bulk_serializable_v<T>)
+            {
+                const auto data = this->read_array_data<T>(size);
+                result.resize(static_cast<size_t>(size));
+
+                if (!data.empty())
+                {
+                    memcpy(result.data(), data.data(), data.size());
+                }
+            }
+            else
             {
-                result.emplace_back(this->read<T>());
+                result.reserve(size);
+
+                for (uint64_t i = 0; i < size; ++i)
+                {
+                    result.emplace_back(this->read<T>());
+                }
             }
         }
 
@@ -244,14 +293,10 @@ namespace utils
         void read_string(std::basic_string<T>& result)
         {
             const auto size = this->read<uint64_t>();
+            const auto data = this->read_array_data<T>(size);
 
-            result.clear();
-            result.reserve(size);
-
-            for (uint64_t i = 0; i < size; ++i)
-            {
-                result.push_back(this->read<T>());
-            }
+            result.resize(static_cast<size_t>(size));
+            memcpy(result.data(), data.data(), data.size());
         }
 
         template <typename T = char>
@@ -262,8 +307,13 @@ namespace utils
             return result;
         }
 
-        size_t get_remaining_size() const
+        size_t get_remaining_size()
         {
+            if (this->source_)
+            {
+                this->ensure_available(std::numeric_limits<size_t>::max());
+            }
+
             return this->buffer_.size() - offset_;
         }
 
@@ -274,7 +324,7 @@ namespace utils
 
         size_t get_offset() const
         {
-            return this->offset_;
+            return this->window_offset_ + this->offset_;
         }
 
         template <typename T, typename F>
@@ -290,6 +340,66 @@ namespace utils
         std::span<const std::byte> buffer_{};
         std::unordered_map<std::type_index, std::function<void*()>> factories_{};
 
+        serialization_source* source_{};
+        std::vector<std::byte> window_{};
+        size_t window_offset_{0};
+
+        template <typename T>
+        std::span<const std::byte> read_array_data(const uint64_t count)
+        {
+            if (count > std::numeric_limits<size_t>::max() / sizeof(T))
+            {
+                throw std::runtime_error("Out of bounds read from byte buffer");
+            }
+
+            return this->read_data(static_cast<size_t>(count) * sizeof(T));
+        }
+
+        // Refills the window from the source until length bytes are available or the source is exhausted
+        bool ensure_available(const size_t length)
+        {
+            const auto available = this->buffer_.size() - this->offset_;
+            if (length <= available)
+            {
+                return true;
+            }
+
+            if (!this->source_)
+            {
+                return false;
+            }
+
+            if (available)
+            {
+                std::memmove(this->window_.data(), this->window_.data() + this->offset_, available);
+            }
+
+            this->window_offset_ += this->offset_;
+            this->offset_ = 0;
+
+            auto size = available;
+
+            while (size < length)
+            {
+                const auto target_size = std::max(size + DEFAULT_STREAM_CHUNK_SIZE, std::min(length, size * 2));
+                this->window_.resize(target_size);
+
+                const auto read_size =
+                    this->source_->read(std::span(this->window_.data() + size, this->window_.size() - size));
+                if (read_size == 0)
+                {
+                    break;
+                }
+
+                size += read_size;
+            }
+
+            this->window_.resize(size);
+            this->buffer_ = this->window_;
+
+            return length <= size;
+        }
+
         template <typename T>
         T construct_object()
         {
@@ -324,19 +434,70 @@ namespace utils
       public:
         buffer_serializer() = default;
 
-        void write(const void* buffer, const size_t length)
+        // Passes the data to the sink in chunks of about chunk_size bytes instead of accumulating it.
+        // flush must be called once serialization is done.
+        buffer_serializer(serialization_sink& sink, const size_t chunk_size = DEFAULT_STREAM_CHUNK_SIZE)
+            : sink_(&sink),
+              chunk_size_(chunk_size)
         {
-#ifndef NDEBUG
-            const uint64_t old_size = this->buffer_.size();
-#endif
+        }
 
+        void write(const void* buffer, const size_t length)
+        {
+            const uint64_t old_size = this->get_size();
             const auto* byte_buffer = static_cast<const std::byte*>(buffer);
-            this->buffer_.insert(this->buffer_.end(), byte_buffer, byte_buffer + length);
 
-#ifndef NDEBUG
-            const auto* security_buffer = reinterpret_cast<const std::byte*>(&old_size);
-            this->buffer_.insert(this->buffer_.end(), security_buffer, security_buffer + sizeof(old_size));
-#endif
+            if (this->sink_ && length >= this->chunk_size_)
+            {
+                this->flush();
+                this->sink_->write(std::span(byte_buffer, length));
+                this->flushed_size_ += length;
+            }
+            else
+            {
+                this->buffer_.insert(this->buffer_.end(), byte_buffer, byte_buffer + length);
+            }
+
+            this->finish_write(old_size);
+        }
+
+        // Lets the callback fill the data in place, which saves copying large blocks through a temporary buffer.
+        // With a sink, the pending data is flushed first, so the buffer never holds more than one such block.
+        template <typename F>
+            requires(std::is_invocable_v<F, std::span<std::byte>>)
+        void write_in_place(const size_t length, const F& writer)
+        {
+            const uint64_t old_size = this->get_size();
+
+            if (this->sink_ && this->buffer_.size() + length > this->chunk_size_)
+            {
+                this->flush();
+            }
+
+            const auto position = this->buffer_.size();
+
+            this->buffer_.resize(position + length);
+            writer(std::span(this->buffer_.data() + position, length));
+
+            this->finish_write(old_size);
+        }
+
+        void flush()
+        {
+            if (!this->sink_ || this->buffer_.empty())
+            {
+                return;
+            }
+
+            this->sink_->write(this->buffer_);
+            this->flushed_size_ += this->buffer_.size();
+            this->buffer_.clear();
+        }
+
+        // Total number of bytes written, including the ones passed to the sink
+        size_t get_size() const
+        {
+            return this->flushed_size_ + this->buffer_.size();
         }
 
         void write(const buffer_serializer& object)
@@ -393,14 +554,21 @@ namespace utils
         {
             this->write(static_cast<uint64_t>(vec.size()));
 
-            for (const auto& v : vec)
+            if constexpr (detail::is_bulk_serializable_v<std::remove_cv_t<T>>)
             {
-                this->write(v);
+                this->write(vec.data(), vec.size_bytes());
+            }
+            else
+            {
+                for (const auto& v : vec)
+                {
+                    this->write(v);
+                }
             }
         }
 
         template <typename T>
-        void write_vector(const std::vector<T> vec)
+        void write_vector(const std::vector<T>& vec)
         {
             this->write_span(std::span(vec));
         }
@@ -441,6 +609,28 @@ namespace utils
 
       private:
         std::vector<std::byte> buffer_{};
+
+        serialization_sink* sink_{};
+        size_t chunk_size_{};
+        size_t flushed_size_{0};
+
+        void finish_write(const uint64_t old_size)
+        {
+            if constexpr (SERIALIZATION_GUARDS)
+            {
+                const auto* security_buffer = reinterpret_cast<const std::byte*>(&old_size);
+                this->buffer_.insert(this->buffer_.end(), security_buffer, security_buffer + sizeof(old_size));
+            }
+            else
+            {
+                (void)old_size;
+            }
+
+            if (this->sink_ && this->buffer_.size() >= this->chunk_size_)
+            {
+                this->flush();
+            }
+        }
     };
 
     template <>
@@ -0,0 +1,91 @@
+#pragma once
+
+#include "serialization.hpp"
+
+#include <cstdio>
+#include <functional>
+
+namespace utils
+{
+    class file_sink : public serialization_sink
+    {
+      public:
+        file_sink(FILE* file)
+            : file_(file)
+        {
+        }
+
+        void write(const std::span<const std::byte> data) override
+        {
+            if (fwrite(data.data(), 1, data.size(), this->file_) != data.size())
+            {
+                throw std::runtime_error("Failed to write serialized data to file");
+            }
+        }
+
+      private:
+        FILE* file_{};
+    };
+
+    class file_source : public serialization_source
+    {
+      public:
+        file_source(FILE* file)
+            : file_(file)
+        {
+        }
+
+        size_t read(const std::span<std::byte> data) override
+        {
+            const auto size = fread(data.data(), 1, data.size(), this->file_);
+            if (size == 0 && ferror(this->file_))
+            {
+                throw std::runtime_error("Failed to read serialized data from file");
+            }
+
+            return size;
+        }
+
+      private:
+        FILE* file_{};
+    };
+
+    // Adapts sockets, compressors and other transports without a dedicated sink
+    class function_sink : public serialization_sink
+    {
+      public:
+        using writer = std::function<void(std::span<const std::byte> data)>;
+
+        function_sink(writer data_writer)
+            : writer_(std::move(data_writer))
+        {
+        }
+
+        void write(const std::span<const std::byte> data) override
+        {
+            this->writer_(data);
+        }
+
+      private:
+        writer writer_{};
+    };
+
+    class function_source : public serialization_source
+    {
+      public:
+        using reader = std::function<size_t(std::span<std::byte> data)>;
+
+        function_source(reader data_reader)
+            : reader_(std::move(data_reader))
+        {
+        }
+
+        size_t read(const std::span<std::byte> data) override
+        {
+            return this->reader_(data);
+        }
+
+      private:
+        reader reader_{};
+    };
+}
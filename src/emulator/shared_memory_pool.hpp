@@ -0,0 +1,79 @@
+#pragma once
+#include <map>
+#include <span>
+#include <mutex>
+#include <memory>
+#include <cstdint>
+#include <cstring>
+
+// Read-only page contents shared between multiple emulators that were created from the same state
+class shared_memory_pool
+{
+  public:
+    const std::byte* get_or_insert(const uint64_t address, const std::span<const std::byte> data)
+    {
+        std::lock_guard _{this->mutex_};
+
+        auto entry = this->pages_.find(address);
+        if (entry == this->pages_.end())
+        {
+            entry = this->pages_.emplace(address, shared_pages(data)).first;
+        }
+
+        if (entry->second.size() != data.size())
+        {
+            return nullptr;
+        }
+
+        return entry->second.data();
+    }
+
+    const std::byte* find(const uint64_t address, const size_t size) const
+    {
+        std::lock_guard _{this->mutex_};
+
+        const auto entry = this->pages_.find(address);
+        if (entry == this->pages_.end() || entry->second.size() != size)
+        {
+            return nullptr;
+        }
+
+        return entry->second.data();
+    }
+
+  private:
+    static constexpr size_t PAGE_ALIGNMENT = 0x1000;
+
+    class shared_pages
+    {
+      public:
+        shared_pages(const std::span<const std::byte> data)
+            : size_(data.size()),
+              storage_(std::make_unique<std::byte[]>(data.size() + PAGE_ALIGNMENT))
+        {
+            const auto storage = reinterpret_cast<uintptr_t>(this->storage_.get());
+            const auto aligned = (storage + PAGE_ALIGNMENT - 1) & ~(PAGE_ALIGNMENT - 1);
+
+            this->data_ = reinterpret_cast<std::byte*>(aligned);
+            memcpy(this->data_, data.data(), data.size());
+        }
+
+        const std::byte* data() const
+        {
+            return this->data_;
+        }
+
+        size_t size() const
+        {
+            return this->size_;
+        }
+
+      private:
+        size_t size_{};
+        std::unique_ptr<std::byte[]> storage_{};
+        std::byte* data_{};
+    };
+
+    mutable std::mutex mutex_{};
+    std::map<uint64_t, shared_pages> pages_{};
+};
@@ -2,6 +2,9 @@
 
 #include "emulator.hpp"
 
+#include <array>
+#include <algorithm>
+
 template <typename PointerType, typename Register, Register InstructionPointer, Register StackPointer,
           typename HookableInstructions>
 class typed_emulator : public emulator
@@ -15,6 +18,9 @@ class typed_emulator : public emulator
     static constexpr registers stack_pointer = StackPointer;
     static constexpr registers instruction_pointer = InstructionPointer;
 
+    // Batched transfers make one backend call per this many registers
+    static constexpr size_t register_batch_size = 64;
+
     void start_from_ip(const std::chrono::nanoseconds timeout = {}, const size_t count = 0)
     {
         this->start(this->read_instruction_pointer(), 0, timeout, count);
@@ -30,6 +36,59 @@ class typed_emulator : public emulator
         this->read_raw_register(static_cast<int>(reg), value, size);
     }
 
+    // Every value has to be large enough for its register
+    void read_registers(const std::span<const registers> regs, const std::span<void* const> values)
+    {
+        for_each_register_batch(regs, [&](const std::span<const int> ids, const size_t offset) {
+            this->read_raw_registers(ids, values.subspan(offset, ids.size())); //
+        });
+    }
+
+    void write_registers(const std::span<const registers> regs, const std::span<const void* const> values)
+    {
+        for_each_register_batch(regs, [&](const std::span<const int> ids, const size_t offset) {
+            this->write_raw_registers(ids, values.subspan(offset, ids.size())); //
+        });
+    }
+
+    // Registers of up to 64 bits, smaller ones are zero extended
+    void read_registers(const std::span<const registers> regs, const std::span<uint64_t> values)
+    {
+        for_each_register_batch(regs, [&](const std::span<const int> ids, const size_t offset) {
+            std::array<void*, register_batch_size> pointers{};
+
+            for (size_t i = 0; i < ids.size(); ++i)
+            {
+                values[offset + i] = 0;
+                pointers[i] = &values[offset + i];
+            }
+
+            this->read_raw_registers(ids, std::span(pointers.data(), ids.size()));
+        });
+    }
+
+    void write_registers(const std::span<const registers> regs, const std::span<const uint64_t> values)
+    {
+        for_each_register_batch(regs, [&](const std::span<const int> ids, const size_t offset) {
+            std::array<const void*, register_batch_size> pointers{};
+
+            for (size_t i = 0; i < ids.size(); ++i)
+            {
+                pointers[i] = &values[offset + i];
+            }
+
+            this->write_raw_registers(ids, std::span(pointers.data(), ids.size()));
+        });
+    }
+
+    template <size_t Count>
+    std::array<uint64_t, Count> read_registers(const std::array<registers, Count>& regs)
+    {
+        std::array<uint64_t, Count> values{};
+        this->read_registers(std::span<const registers>(regs), std::span<uint64_t>(values));
+        return values;
+    }
+
     template <typename T = pointer_type>
     T reg(const registers regid)
     {
@@ -92,4 +151,25 @@ class typed_emulator : public emulator
 
     void read_raw_register(int reg, void* value, size_t size) override = 0;
     void write_raw_register(int reg, const void* value, size_t size) override = 0;
+
+    void read_raw_registers(std::span<const int> regs, std::span<void* const> values) override = 0;
+    void write_raw_registers(std::span<const int> regs, std::span<const void* const> values) override = 0;
+
+    template <typename F>
+    static void for_each_register_batch(const std::span<const registers> regs, F&& callback)
+    {
+        std::array<int, register_batch_size> ids{};
+
+        for (size_t offset = 0; offset < regs.size(); offset += register_batch_size)
+        {
+            const auto count = std::min(regs.size() - offset, register_batch_size);
+
+            for (size_t i = 0; i < count; ++i)
+            {
+                ids[i] = static_cast<int>(regs[offset + i]);
+            }
+
+            callback(std::span<const int>(ids.data(), count), offset);
+        }
+    }
 };
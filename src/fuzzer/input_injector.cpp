@@ -0,0 +1,327 @@
+#include "std_include.hpp"
+#include "input_injector.hpp"
+
+#include <socket_provider.hpp>
+#include <utils/string.hpp>
+
+namespace
+{
+    // Inputs are written into a region that is part of the snapshot
+    constexpr size_t INPUT_REGION_SIZE = 0x100000;
+
+    class argument_injector : public input_injector
+    {
+      public:
+        void prepare(windows_emulator& win_emu) override
+        {
+            this->input_region_ = win_emu.emu().allocate_memory(INPUT_REGION_SIZE, memory_permission::read_write);
+        }
+
+        void inject(windows_emulator& win_emu, const std::span<const uint8_t> data) override
+        {
+            const auto memory = this->write_input(win_emu, data);
+
+            win_emu.emu().reg(x64_register::rcx, memory);
+            win_emu.emu().reg<uint64_t>(x64_register::rdx, data.size());
+        }
+
+      private:
+        uint64_t input_region_{};
+
+        // Inputs end close to the end of the region, so reading past them faults
+        uint64_t write_input(windows_emulator& win_emu, const std::span<const uint8_t> data) const
+        {
+            auto& emu = win_emu.emu();
+
+            if (data.size() <= INPUT_REGION_SIZE)
+            {
+                const auto memory = align_down(this->input_region_ + INPUT_REGION_SIZE - data.size(), 0x10);
+                emu.write_memory(memory, data.data(), data.size());
+                return memory;
+            }
+
+            const auto memory = emu.allocate_memory(page_align_up(data.size()), memory_permission::read_write);
+            emu.write_memory(memory, data.data(), data.size());
+            return memory;
+        }
+    };
+
+    class register_injector : public input_injector
+    {
+      public:
+        register_injector(const x64_register reg)
+            : register_(reg)
+        {
+        }
+
+        void prepare(windows_emulator&) override
+        {
+        }
+
+        void inject(windows_emulator& win_emu, const std::span<const uint8_t> data) override
+        {
+            uint64_t value{};
+            memcpy(&value, data.data(), std::min(data.size(), sizeof(value)));
+            win_emu.emu().reg(this->register_, value);
+        }
+
+      private:
+        x64_register register_{};
+    };
+
+    class buffer_injector : public input_injector
+    {
+      public:
+        void prepare(windows_emulator& win_emu) override
+        {
+            this->buffer_ = win_emu.emu().reg(x64_register::rcx);
+            this->capacity_ = win_emu.emu().reg(x64_register::rdx);
+        }
+
+        void inject(windows_emulator& win_emu, const std::span<const uint8_t> data) override
+        {
+            const auto size = std::min(static_cast<uint64_t>(data.size()), this->capacity_);
+
+            win_emu.emu().write_memory(this->buffer_, data.data(), static_cast<size_t>(size));
+            win_emu.emu().reg(x64_register::rdx, size);
+        }
+
+      private:
+        uint64_t buffer_{};
+        uint64_t capacity_{};
+    };
+
+    // Reads are served synchronously, their event and APC are not signaled
+    class file_injector : public input_injector
+    {
+      public:
+        file_injector(const std::string_view name)
+            : name_(utils::string::to_lower(u8_to_u16(name)))
+        {
+        }
+
+        void prepare(windows_emulator& win_emu) override
+        {
+            const auto id = win_emu.dispatcher().find_syscall_id("NtReadFile");
+            if (!id)
+            {
+                throw std::runtime_error("NtReadFile is not available");
+            }
+
+            win_emu.add_syscall_hook([this, &win_emu, id = *id] {
+                if (win_emu.emu().reg(x64_register::rax) != id || !this->read_file(win_emu))
+                {
+                    return instruction_hook_continuation::run_instruction;
+                }
+
+                return instruction_hook_continuation::skip_instruction;
+            });
+        }
+
+        void inject(windows_emulator&, const std::span<const uint8_t> data) override
+        {
+            this->data_ = data;
+            this->offset_ = 0;
+        }
+
+      private:
+        std::u16string name_{};
+        std::span<const uint8_t> data_{};
+        size_t offset_{};
+
+        bool read_file(windows_emulator& win_emu)
+        {
+            auto& emu = win_emu.emu();
+
+            const auto* f = win_emu.process().files.get(emu.reg(x64_register::r10));
+            if (!f || !utils::string::to_lower(f->name).ends_with(this->name_))
+            {
+                return false;
+            }
+
+            // IoStatusBlock, Buffer and Length follow the return address and the home space
+            std::array<uint64_t, 3> arguments{};
+            emu.read_memory(emu.reg(x64_register::rsp) + 0x28, arguments.data(), sizeof(arguments));
+
+            const auto remaining = this->data_.size() - this->offset_;
+            const auto size = std::min(static_cast<size_t>(static_cast<uint32_t>(arguments[2])), remaining);
+            const auto status = size || !arguments[2] ? STATUS_SUCCESS : STATUS_END_OF_FILE;
+
+            emu.write_memory(arguments[1], this->data_.data() + this->offset_, size);
+            this->offset_ += size;
+
+            if (arguments[0])
+            {
+                IO_STATUS_BLOCK<EmulatorTraits<Emu64>> block{};
+                block.Status = status;
+                block.Information = size;
+                emu.write_memory(arguments[0], &block, sizeof(block));
+            }
+
+            emu.reg<uint64_t>(x64_register::rax, static_cast<uint64_t>(status));
+            return true;
+        }
+    };
+
+    struct socket_input
+    {
+        std::span<const uint8_t> data{};
+        size_t offset{};
+        bool active{false};
+    };
+
+    // All sockets read from the same input. Before the first one, receives block.
+    class input_socket : public emulated_socket
+    {
+      public:
+        input_socket(std::shared_ptr<socket_input> input)
+            : input_(std::move(input))
+        {
+        }
+
+        bool bind(const network::address&) override
+        {
+            return true;
+        }
+
+        socket_transfer send_to(const network::address&, const std::span<const std::byte> data) override
+        {
+            return {socket_transfer_status::success, data.size()};
+        }
+
+        socket_transfer receive_from(network::address&, const std::span<std::byte> data) override
+        {
+            auto& input = *this->input_;
+            if (!input.active)
+            {
+                return {socket_transfer_status::would_block, 0};
+            }
+
+            // Receiving nothing closes the connection once the input is consumed
+            const auto size = std::min(data.size(), input.data.size() - input.offset);
+            memcpy(data.data(), input.data.data() + input.offset, size);
+            input.offset += size;
+
+            return {socket_transfer_status::success, size};
+        }
+
+        int16_t poll_events(const int16_t events) const override
+        {
+            auto revents = static_cast<int16_t>(events & (POLLOUT | POLLWRNORM));
+
+            if (this->input_->active)
+            {
+                revents = static_cast<int16_t>(revents | (events & (POLLIN | POLLRDNORM)));
+            }
+
+            return revents;
+        }
+
+        std::optional<SOCKET> get_host_socket() const override
+        {
+            return std::nullopt;
+        }
+
+      private:
+        std::shared_ptr<socket_input> input_{};
+    };
+
+    class input_socket_provider : public socket_provider
+    {
+      public:
+        input_socket_provider(std::shared_ptr<socket_input> input)
+            : input_(std::move(input))
+        {
+        }
+
+        std::unique_ptr<emulated_socket> create_socket(int, int, int) override
+        {
+            return std::make_unique<input_socket>(this->input_);
+        }
+
+      private:
+        std::shared_ptr<socket_input> input_{};
+    };
+
+    class socket_injector : public input_injector
+    {
+      public:
+        std::shared_ptr<socket_provider> get_socket_provider() override
+        {
+            return std::make_shared<input_socket_provider>(this->input_);
+        }
+
+        void prepare(windows_emulator&) override
+        {
+        }
+
+        void inject(windows_emulator&, const std::span<const uint8_t> data) override
+        {
+            this->input_->data = data;
+            this->input_->offset = 0;
+            this->input_->active = true;
+        }
+
+      private:
+        std::shared_ptr<socket_input> input_{std::make_shared<socket_input>()};
+    };
+
+    std::optional<x64_register> parse_register(const std::string_view name)
+    {
+        static const std::unordered_map<std::string_view, x64_register> registers{
+            {"rax", x64_register::rax}, {"rbx", x64_register::rbx}, {"rcx", x64_register::rcx},
+            {"rdx", x64_register::rdx}, {"rsi", x64_register::rsi}, {"rdi", x64_register::rdi},
+            {"r8", x64_register::r8},   {"r9", x64_register::r9},   {"r10", x64_register::r10},
+            {"r11", x64_register::r11}, {"r12", x64_register::r12}, {"r13", x64_register::r13},
+            {"r14", x64_register::r14}, {"r15", x64_register::r15},
+        };
+
+        const auto entry = registers.find(name);
+        if (entry == registers.end())
+        {
+            return std::nullopt;
+        }
+
+        return entry->second;
+    }
+}
+
+std::unique_ptr<input_injector> create_input_injector(const std::string_view mode)
+{
+    const auto separator = mode.find(':');
+    const auto type = mode.substr(0, separator);
+    const auto parameter = separator == std::string_view::npos ? std::string_view{} : mode.substr(separator + 1);
+
+    if (type == "arguments")
+    {
+        return std::make_unique<argument_injector>();
+    }
+
+    if (type == "register")
+    {
+        const auto reg = parse_register(parameter);
+        if (!reg)
+        {
+            throw std::runtime_error("Invalid input register: " + std::string(parameter));
+        }
+
+        return std::make_unique<register_injector>(*reg);
+    }
+
+    if (type == "buffer")
+    {
+        return std::make_unique<buffer_injector>();
+    }
+
+    if (type == "file" && !parameter.empty())
+    {
+        return std::make_unique<file_injector>(parameter);
+    }
+
+    if (type == "socket")
+    {
+        return std::make_unique<socket_injector>();
+    }
+
+    throw std::runtime_error("Invalid input mode: " + std::string(mode));
+}
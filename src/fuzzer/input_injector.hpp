@@ -0,0 +1,32 @@
+#pragma once
+
+#include <windows_emulator.hpp>
+
+// Places the fuzzing input where the target reads it. Every executer has its own injector, prepare is called
+// once the snapshot state is loaded and before the executer takes its own snapshot.
+class input_injector
+{
+  public:
+    virtual ~input_injector() = default;
+
+    // Serves the guest sockets, must be set before the state is loaded
+    virtual std::shared_ptr<socket_provider> get_socket_provider()
+    {
+        return {};
+    }
+
+    virtual void prepare(windows_emulator& win_emu) = 0;
+
+    // The data stays valid until the execution ends
+    virtual void inject(windows_emulator& win_emu, std::span<const uint8_t> data) = 0;
+};
+
+// Modes are:
+//   arguments       pointer to the input in rcx and its size in rdx, the default
+//   register:<name> first bytes of the input as the value of a general purpose register
+//   buffer          input written into the buffer rcx points to at the snapshot, rdx holds its capacity and
+//                   receives the size of the input
+//   file:<name>     NtReadFile calls on files whose name ends with the given one read the input
+//   socket          guest sockets receive the input, then the connection is closed
+// Throws for unknown modes.
+std::unique_ptr<input_injector> create_input_injector(std::string_view mode);
@@ -3,18 +3,49 @@
 #include <windows_emulator.hpp>
 #include <fuzzer.hpp>
 
+#include "input_injector.hpp"
 #include "utils/finally.hpp"
+#include "utils/string.hpp"
 
 bool use_gdb = false;
+bool pin_workers = false;
+size_t worker_count = 0;
+uint16_t sync_port = 0;
+std::vector<std::string> sync_peers{};
+// Emulates the guest heap with redzones of this size, so overflows are caught when chunks are freed
+uint64_t heap_redzone_size = 0;
+// Reports heap overflows and use after free at the faulting access, see heap_sanitizer
+bool sanitize_heap = false;
+// Where the snapshot is taken: an export of the application, "module!function", a hex address or "syscall:<name>"
+std::string snapshot_target = "vulnerable";
+// The snapshot is taken when the target is reached for this time
+size_t snapshot_hits = 1;
+// See create_input_injector
+std::string input_mode = "arguments";
+fuzzer::power_schedule schedule = fuzzer::power_schedule::fast;
+// AFL style dictionary of tokens the mutator inserts into inputs
+std::filesystem::path dictionary_file{};
 
 namespace
 {
-    void run_emulation(windows_emulator& win_emu)
+    // Between full restores, the persistent reset keeps the thread and memory allocator state of the previous
+    // iterations, see windows_emulator::reset_to_snapshot.
+    constexpr size_t FULL_RESTORE_INTERVAL = 1000;
+
+    constexpr uint64_t INSTRUCTION_BUDGET = 50'000'000;
+    constexpr std::chrono::milliseconds TIME_BUDGET{1000};
+
+    constexpr size_t STACK_SCAN_SIZE = 64;
+    constexpr size_t STACK_HASH_FRAMES = 8;
+
+    constexpr size_t MAX_TRACED_COMPARISONS = 1024;
+
+    void run_emulation(windows_emulator& win_emu, const std::chrono::nanoseconds timeout = {}, const size_t count = 0)
     {
         try
         {
             win_emu.log.disable_output(true);
-            win_emu.start();
+            win_emu.start(timeout, count);
 
             if (win_emu.process().exception_rip.has_value())
             {
@@ -32,89 +63,413 @@ namespace
         win_emu.log.disable_output(false);
     }
 
-    void forward_emulator(windows_emulator& win_emu)
+    struct snapshot_trigger
+    {
+        size_t hits{};
+        uint64_t address{};
+    };
+
+    // The trigger address is an exit, so the code around it runs without a hook. Earlier hits step over it
+    // with the exit removed, the exit is gone once the snapshot address is reached.
+    void run_to_trigger(windows_emulator& win_emu, snapshot_trigger& trigger)
     {
-        const auto target = win_emu.process().executable->find_export("vulnerable");
-        win_emu.emu().hook_memory_execution(target, 1, [&](uint64_t, size_t, uint64_t) { win_emu.emu().stop(); });
+        auto& emu = win_emu.emu();
+
+        while (true)
+        {
+            run_emulation(win_emu);
+
+            if (!trigger.address || emu.read_instruction_pointer() != trigger.address ||
+                win_emu.process().exit_status.has_value() || ++trigger.hits == snapshot_hits)
+            {
+                break;
+            }
+
+            emu.remove_exit_address(trigger.address);
+            win_emu.start({}, 1);
+            emu.add_exit_address(trigger.address);
+        }
+
+        if (trigger.address)
+        {
+            emu.remove_exit_address(trigger.address);
+        }
+    }
+
+    // Stops in front of the syscall, so it runs as part of every execution
+    void forward_to_syscall(windows_emulator& win_emu, const std::string_view name)
+    {
+        const auto id = win_emu.dispatcher().find_syscall_id(name);
+        if (!id)
+        {
+            throw std::runtime_error("Unknown syscall: " + std::string(name));
+        }
+
+        auto trigger = std::make_shared<snapshot_trigger>();
+
+        win_emu.add_syscall_hook([&win_emu, trigger, id = *id] {
+            auto& emu = win_emu.emu();
+            if (emu.reg(x64_register::rax) != id || ++trigger->hits != snapshot_hits)
+            {
+                return instruction_hook_continuation::run_instruction;
+            }
+
+            emu.reg(x64_register::rip, emu.read_instruction_pointer() - 2);
+            emu.stop();
+            return instruction_hook_continuation::skip_instruction;
+        });
 
         run_emulation(win_emu);
     }
 
+    // Symbols of modules that aren't loaded yet are resolved once the module runs its first block
+    void forward_to_symbol(windows_emulator& win_emu, const std::string_view module_name,
+                           const std::string_view function)
+    {
+        snapshot_trigger trigger{};
+
+        const auto resolve = [&](const mapped_module& mod) {
+            if (utils::string::to_lower(mod.name) != utils::string::to_lower(std::string(module_name)))
+            {
+                return false;
+            }
+
+            trigger.address = mod.find_export(function);
+            if (!trigger.address)
+            {
+                throw std::runtime_error("Export not found: " + std::string(function));
+            }
+
+            win_emu.emu().add_exit_address(trigger.address);
+            return true;
+        };
+
+        for (const auto& mod : win_emu.process().mod_manager.get_modules() | std::views::values)
+        {
+            if (resolve(mod))
+            {
+                run_to_trigger(win_emu, trigger);
+                return;
+            }
+        }
+
+        auto* block_hook = win_emu.emu().hook_basic_block([&](const basic_block& block) {
+            const auto* mod = win_emu.process().mod_manager.find_by_address(block.address);
+            if (!trigger.address && mod)
+            {
+                resolve(*mod);
+            }
+        });
+
+        const auto _ = utils::finally([&] { win_emu.emu().delete_hook(block_hook); });
+        run_to_trigger(win_emu, trigger);
+    }
+
+    // Returns whether the snapshot is taken at the entry of a function, whose return ends an execution
+    bool forward_emulator(windows_emulator& win_emu)
+    {
+        const std::string_view target = snapshot_target;
+
+        if (target.starts_with("syscall:"))
+        {
+            forward_to_syscall(win_emu, target.substr(8));
+            return false;
+        }
+
+        if (target.starts_with("0x"))
+        {
+            snapshot_trigger trigger{};
+            trigger.address = strtoull(snapshot_target.c_str(), nullptr, 16);
+
+            win_emu.emu().add_exit_address(trigger.address);
+            run_to_trigger(win_emu, trigger);
+            return false;
+        }
+
+        const auto separator = target.find('!');
+        if (separator != std::string_view::npos)
+        {
+            forward_to_symbol(win_emu, target.substr(0, separator), target.substr(separator + 1));
+            return true;
+        }
+
+        snapshot_trigger trigger{};
+        trigger.address = win_emu.process().executable->find_export(target);
+        if (!trigger.address)
+        {
+            throw std::runtime_error("Export not found: " + snapshot_target);
+        }
+
+        win_emu.emu().add_exit_address(trigger.address);
+        run_to_trigger(win_emu, trigger);
+        return true;
+    }
+
+    // Without unwind information, module addresses on the stack are treated as return addresses
+    uint64_t hash_call_stack(windows_emulator& win_emu)
+    {
+        std::array<uint64_t, STACK_SCAN_SIZE> stack{};
+        const auto rsp = win_emu.emu().reg(x64_register::rsp);
+
+        if (!win_emu.emu().try_read_memory(rsp, stack.data(), sizeof(stack)))
+        {
+            return 0;
+        }
+
+        uint64_t hash = 0xCBF29CE484222325;
+        size_t frames = 0;
+
+        for (const auto value : stack)
+        {
+            if (frames >= STACK_HASH_FRAMES)
+            {
+                break;
+            }
+
+            if (!win_emu.process().mod_manager.find_by_address(value))
+            {
+                continue;
+            }
+
+            hash ^= value;
+            hash *= 0x100000001B3;
+            ++frames;
+        }
+
+        return hash;
+    }
+
     struct fuzzer_executer : fuzzer::executer
     {
         windows_emulator emu{};
+        std::unique_ptr<input_injector> injector{create_input_injector(input_mode)};
         std::span<const std::byte> emulator_data{};
-        std::unordered_set<uint64_t> visited_blocks{};
-        const std::function<fuzzer::coverage_functor>* handler{nullptr};
-
-        fuzzer_executer(std::span<const std::byte> data)
-            : emulator_data(data)
+        std::span<const uint64_t> warm_blocks{};
+        bool prewarmed{false};
+        bool stop_on_return{false};
+        size_t iterations_since_restore{};
+        bool needs_full_restore{false};
+        uint64_t return_address{};
+        std::chrono::nanoseconds restore_time{};
+        fuzzer::crash_details crash{};
+        std::vector<fuzzer::comparison_entry> comparisons{};
+
+        fuzzer_executer(std::span<const std::byte> data, std::shared_ptr<shared_memory_pool> memory_pool,
+                        std::span<const uint64_t> blocks, const bool stop_at_return)
+            : emulator_data(data),
+              warm_blocks(blocks),
+              stop_on_return(stop_at_return)
         {
             emu.fuzzing = true;
-            emu.emu().hook_basic_block([&](const basic_block& block) {
-                if (this->handler && visited_blocks.emplace(block.address).second)
-                {
-                    (*this->handler)(block.address);
-                }
-            });
+            emu.count_instructions_per_block = true;
+            emu.emu().set_shared_memory_pool(std::move(memory_pool));
+
+            if (auto sockets = injector->get_socket_provider())
+            {
+                emu.set_socket_provider(std::move(sockets));
+            }
 
             utils::buffer_deserializer deserializer{emulator_data};
             emu.deserialize(deserializer);
+
+            injector->prepare(emu);
             emu.save_snapshot();
 
-            const auto ret = emu.emu().read_stack(0);
+            if (!stop_on_return)
+            {
+                return;
+            }
 
-            emu.emu().hook_memory_execution(ret, 1, [&](uint64_t, size_t, uint64_t) { emu.emu().stop(); });
+            return_address = emu.emu().read_stack(0);
+            emu.emu().add_exit_address(return_address);
         }
 
         void restore_emulator()
         {
+            if (!needs_full_restore && ++iterations_since_restore < FULL_RESTORE_INTERVAL && emu.reset_to_snapshot())
+            {
+                return;
+            }
+
             /*utils::buffer_deserializer deserializer{ emulator_data };
             emu.deserialize(deserializer);*/
             emu.restore_snapshot();
+
+            iterations_since_restore = 0;
+            needs_full_restore = false;
         }
 
-        fuzzer::execution_result execute(std::span<const uint8_t> data,
-                                         const std::function<fuzzer::coverage_functor>& coverage_handler) override
+        fuzzer::execution_result execute(std::span<const uint8_t> data, fuzzer::coverage_map& coverage_map,
+                                         const fuzzer::execution_budget& budget) override
         {
             // printf("Input size: %zd\n", data.size());
-            this->handler = &coverage_handler;
-            this->visited_blocks.clear();
+            emu.emu().enable_block_coverage(coverage_map.get_buffer());
 
-            restore_emulator();
+            // Translating the blocks up front keeps the first runs from spending their time budget on it
+            if (!prewarmed)
+            {
+                emu.emu().prewarm_blocks(warm_blocks);
+                prewarmed = true;
+            }
 
-            const auto memory = emu.emu().allocate_memory(page_align_up(std::max(data.size(), size_t(1))),
-                                                          memory_permission::read_write);
-            emu.emu().write_memory(memory, data.data(), data.size());
+            const auto restore_start = std::chrono::steady_clock::now();
+            restore_emulator();
+            restore_time = std::chrono::steady_clock::now() - restore_start;
 
-            emu.emu().reg(x64_register::rcx, memory);
-            emu.emu().reg<uint64_t>(x64_register::rdx, data.size());
+            injector->inject(emu, data);
 
             try
             {
-                run_emulation(emu);
-                return fuzzer::execution_result::success;
+                run_emulation(emu, budget.time, static_cast<size_t>(budget.instructions));
             }
             catch (...)
             {
+                crash.address = emu.process().exception_rip.value_or(emu.emu().read_instruction_pointer());
+                crash.stack_hash = hash_call_stack(emu);
+
+                needs_full_restore = true;
                 return fuzzer::execution_result::error;
             }
+
+            // Only runs that returned from the target end at a state the persistent reset continues from. Runs that
+            // ended by exit or by the budget are fully restored, targets that don't return always end that way.
+            const auto returned = stop_on_return && emu.emu().read_instruction_pointer() == return_address;
+            const auto exited = emu.process().exit_status.has_value();
+
+            if (!returned || exited)
+            {
+                needs_full_restore = true;
+            }
+
+            if (stop_on_return && !returned && !exited)
+            {
+                return fuzzer::execution_result::timeout;
+            }
+
+            return fuzzer::execution_result::success;
+        }
+
+        std::chrono::nanoseconds get_restore_time() const override
+        {
+            return restore_time;
+        }
+
+        fuzzer::crash_details get_crash_details() const override
+        {
+            return crash;
+        }
+
+        std::vector<fuzzer::comparison_entry> trace_comparisons(std::span<const uint8_t> data,
+                                                                fuzzer::coverage_map& coverage_map,
+                                                                const fuzzer::execution_budget& budget) override
+        {
+            comparisons.clear();
+
+            std::vector<emulator_hook*> hooks{};
+            hooks.push_back(emu.emu().hook_comparison([&](uint64_t, const uint64_t first, const uint64_t second,
+                                                          const size_t size) {
+                add_comparison(&first, &second, std::min(size, sizeof(uint64_t)), true);
+            }));
+
+            // Memory compared through these functions is logged as well
+            const std::pair<std::string_view, bool> compare_functions[] = {
+                {"memcmp", true},
+                {"strncmp", true},
+                {"RtlCompareMemory", true},
+                {"strcmp", false},
+            };
+
+            for (const auto& [name, has_length] : compare_functions)
+            {
+                const auto address = emu.process().ntdll->find_export(name);
+                if (!address)
+                {
+                    continue;
+                }
+
+                hooks.push_back(emu.emu().hook_memory_execution(
+                    address, 1, [&, has_length](uint64_t, size_t, uint64_t) { trace_memory_comparison(has_length); }));
+            }
+
+            const auto _ = utils::finally([&] {
+                for (auto* hook : hooks)
+                {
+                    emu.emu().delete_hook(hook);
+                }
+            });
+
+            execute(data, coverage_map, budget);
+            return std::move(comparisons);
+        }
+
+        void add_comparison(const void* first, const void* second, const size_t size, const bool is_integer)
+        {
+            if (comparisons.size() >= MAX_TRACED_COMPARISONS)
+            {
+                return;
+            }
+
+            fuzzer::comparison_entry entry{};
+            entry.size = static_cast<uint8_t>(std::min(size, fuzzer::MAX_COMPARISON_SIZE));
+            entry.is_integer = is_integer;
+
+            memcpy(entry.first.data(), first, entry.size);
+            memcpy(entry.second.data(), second, entry.size);
+
+            comparisons.push_back(entry);
+        }
+
+        void trace_memory_comparison(const bool has_length)
+        {
+            auto& x64_emu = emu.emu();
+            const auto first_address = x64_emu.reg(x64_register::rcx);
+            const auto second_address = x64_emu.reg(x64_register::rdx);
+
+            uint64_t size = fuzzer::MAX_COMPARISON_SIZE;
+            if (has_length)
+            {
+                size = std::min(size, x64_emu.reg(x64_register::r8));
+            }
+
+            std::array<uint8_t, fuzzer::MAX_COMPARISON_SIZE> first{};
+            std::array<uint8_t, fuzzer::MAX_COMPARISON_SIZE> second{};
+
+            // Strings may end right before unmapped memory, so their bytes are read one by one
+            size_t valid = 0;
+            while (valid < size && x64_emu.try_read_memory(first_address + valid, &first[valid], 1) &&
+                   x64_emu.try_read_memory(second_address + valid, &second[valid], 1))
+            {
+                ++valid;
+
+                if (!has_length && (!first[valid - 1] || !second[valid - 1]))
+                {
+                    break;
+                }
+            }
+
+            add_comparison(first.data(), second.data(), valid, false);
         }
     };
 
     struct my_fuzzing_handler : fuzzer::fuzzing_handler
     {
         std::vector<std::byte> emulator_state{};
+        std::vector<uint64_t> warm_blocks{};
+        std::shared_ptr<shared_memory_pool> memory_pool{std::make_shared<shared_memory_pool>()};
+        bool stop_on_return{false};
         std::atomic_bool stop_fuzzing{false};
 
-        my_fuzzing_handler(std::vector<std::byte> emulator_state)
-            : emulator_state(std::move(emulator_state))
+        my_fuzzing_handler(std::vector<std::byte> emulator_state, std::vector<uint64_t> warm_blocks,
+                           const bool stop_at_return)
+            : emulator_state(std::move(emulator_state)),
+              warm_blocks(std::move(warm_blocks)),
+              stop_on_return(stop_at_return)
         {
         }
 
         std::unique_ptr<fuzzer::executer> make_executer() override
         {
-            return std::make_unique<fuzzer_executer>(emulator_state);
+            return std::make_unique<fuzzer_executer>(emulator_state, memory_pool, warm_blocks, stop_on_return);
         }
 
         bool stop() override
@@ -123,28 +478,90 @@ namespace
         }
     };
 
-    void run_fuzzer(const windows_emulator& base_emulator)
+    // Runs the target once with an empty input and collects the blocks it executes. The emulator is not restored
+    // afterwards, its state must have been serialized before.
+    std::vector<uint64_t> record_executed_blocks(windows_emulator& win_emu, input_injector& injector,
+                                                 const bool stop_on_return)
     {
-        const auto concurrency = std::thread::hardware_concurrency() + 2;
+        std::unordered_set<uint64_t> blocks{};
+        auto* block_hook = win_emu.emu().hook_basic_block([&](const basic_block& block) {
+            blocks.insert(block.address); //
+        });
+
+        const auto ret = stop_on_return ? win_emu.emu().read_stack(0) : 0;
+        if (ret)
+        {
+            win_emu.emu().add_exit_address(ret);
+        }
+
+        injector.prepare(win_emu);
+        injector.inject(win_emu, {});
+
+        try
+        {
+            run_emulation(win_emu, TIME_BUDGET, static_cast<size_t>(INSTRUCTION_BUDGET));
+        }
+        catch (...)
+        {
+        }
+
+        win_emu.emu().delete_hook(block_hook);
+
+        if (ret)
+        {
+            win_emu.emu().remove_exit_address(ret);
+        }
+
+        return {blocks.begin(), blocks.end()};
+    }
+
+    void run_fuzzer(windows_emulator& base_emulator, input_injector& injector, const std::string_view application,
+                    const bool stop_on_return)
+    {
+        fuzzer::fuzzing_settings settings{};
+        settings.concurrency = worker_count ? worker_count : std::thread::hardware_concurrency() + 2;
+        settings.pin_workers = pin_workers;
+        settings.corpus_file = std::filesystem::path(application).filename().concat(".corpus");
+        settings.crash_directory = std::filesystem::path(application).filename().concat(".crashes");
+        settings.stats_file = std::filesystem::path(application).filename().concat(".prom");
+        settings.budget.instructions = INSTRUCTION_BUDGET;
+        settings.budget.time = TIME_BUDGET;
+        settings.trace_comparisons = true;
+        settings.schedule = schedule;
+        settings.sync_port = sync_port;
+        settings.sync_peers = sync_peers;
+        settings.dictionary_file = dictionary_file;
 
         utils::buffer_serializer serializer{};
         base_emulator.serialize(serializer);
 
-        my_fuzzing_handler handler{serializer.move_buffer()};
+        auto emulator_state = serializer.move_buffer();
+        auto warm_blocks = record_executed_blocks(base_emulator, injector, stop_on_return);
+
+        my_fuzzing_handler handler{std::move(emulator_state), std::move(warm_blocks), stop_on_return};
 
-        fuzzer::run(handler, concurrency);
+        fuzzer::run(handler, settings);
     }
 
     void run(const std::string_view application)
     {
+        const auto injector = create_input_injector(input_mode);
+
+        // Files written by one input must not be seen by the next one. They live in the process data, which both
+        // the full and the persistent reset restore once it was modified.
         emulator_settings settings{
             .application = application,
+            .virtualize_file_writes = true,
+            .sockets = injector->get_socket_provider(),
+            .emulate_heap = heap_redzone_size != 0,
+            .heap_redzone_size = heap_redzone_size,
+            .sanitize_heap = sanitize_heap,
         };
 
         windows_emulator win_emu{std::move(settings)};
 
-        forward_emulator(win_emu);
-        run_fuzzer(win_emu);
+        const auto stop_on_return = forward_emulator(win_emu);
+        run_fuzzer(win_emu, *injector, application, stop_on_return);
     }
 }
 
@@ -157,16 +574,73 @@ int main(const int argc, char** argv)
     }
 
     // setvbuf(stdout, nullptr, _IOFBF, 0x10000);
-    if (argc > 2 && argv[1] == "-d"s)
+    int arg_index = 1;
+    for (; arg_index < argc - 1; ++arg_index)
     {
-        use_gdb = true;
+        const std::string_view option = argv[arg_index];
+
+        if (option == "-d")
+        {
+            use_gdb = true;
+        }
+        else if (option == "-a")
+        {
+            pin_workers = true;
+        }
+        else if (option == "-j" && arg_index + 2 < argc)
+        {
+            worker_count = static_cast<size_t>(strtoul(argv[++arg_index], nullptr, 10));
+        }
+        else if (option == "-s" && arg_index + 2 < argc)
+        {
+            sync_port = static_cast<uint16_t>(atoi(argv[++arg_index]));
+        }
+        else if (option == "-p" && arg_index + 2 < argc)
+        {
+            sync_peers.emplace_back(argv[++arg_index]);
+        }
+        else if (option == "-r" && arg_index + 2 < argc)
+        {
+            heap_redzone_size = strtoull(argv[++arg_index], nullptr, 10);
+        }
+        else if (option == "-S")
+        {
+            sanitize_heap = true;
+        }
+        else if (option == "-t" && arg_index + 2 < argc)
+        {
+            snapshot_target = argv[++arg_index];
+        }
+        else if (option == "-n" && arg_index + 2 < argc)
+        {
+            snapshot_hits = std::max(static_cast<size_t>(strtoull(argv[++arg_index], nullptr, 10)), size_t{1});
+        }
+        else if (option == "-i" && arg_index + 2 < argc)
+        {
+            input_mode = argv[++arg_index];
+        }
+        else if (option == "-x" && arg_index + 2 < argc)
+        {
+            dictionary_file = argv[++arg_index];
+        }
+        else if (option == "-ps" && arg_index + 2 < argc)
+        {
+            const std::string_view name = argv[++arg_index];
+            schedule = name == "explore" ? fuzzer::power_schedule::explore
+                       : name == "rare"  ? fuzzer::power_schedule::rare
+                                         : fuzzer::power_schedule::fast;
+        }
+        else
+        {
+            break;
+        }
     }
 
     try
     {
         do
         {
-            run(argv[use_gdb ? 2 : 1]);
+            run(argv[arg_index]);
         } while (use_gdb);
 
         return 0;
@@ -0,0 +1,105 @@
+#include "comparison_log.hpp"
+
+#include <cstring>
+#include <algorithm>
+#include <string_view>
+#include <unordered_set>
+
+namespace fuzzer
+{
+    namespace
+    {
+        class replacement_generator
+        {
+          public:
+            replacement_generator(const std::span<const uint8_t> input, const size_t limit)
+                : input_(input),
+                  limit_(limit)
+            {
+            }
+
+            void add(const std::span<const uint8_t> pattern, const std::span<const uint8_t> replacement)
+            {
+                if (std::ranges::equal(pattern, replacement) || pattern.size() > this->input_.size())
+                {
+                    return;
+                }
+
+                for (size_t i = 0; i + pattern.size() <= this->input_.size() && !this->is_full(); ++i)
+                {
+                    if (memcmp(this->input_.data() + i, pattern.data(), pattern.size()) != 0)
+                    {
+                        continue;
+                    }
+
+                    std::vector candidate(this->input_.begin(), this->input_.end());
+                    memcpy(candidate.data() + i, replacement.data(), replacement.size());
+
+                    const auto hash = std::hash<std::string_view>{}(
+                        std::string_view(reinterpret_cast<const char*>(candidate.data()), candidate.size()));
+
+                    if (this->known_.insert(hash).second)
+                    {
+                        this->candidates_.push_back(std::move(candidate));
+                    }
+                }
+            }
+
+            bool is_full() const
+            {
+                return this->candidates_.size() >= this->limit_;
+            }
+
+            std::vector<std::vector<uint8_t>> move_candidates()
+            {
+                return std::move(this->candidates_);
+            }
+
+          private:
+            std::span<const uint8_t> input_{};
+            size_t limit_{};
+            std::unordered_set<size_t> known_{};
+            std::vector<std::vector<uint8_t>> candidates_{};
+        };
+    }
+
+    std::vector<std::vector<uint8_t>> generate_replacements(const std::span<const uint8_t> input,
+                                                            const std::span<const comparison_entry> comparisons,
+                                                            const size_t limit)
+    {
+        replacement_generator generator{input, limit};
+
+        for (const auto& entry : comparisons)
+        {
+            const auto size = std::min(static_cast<size_t>(entry.size), MAX_COMPARISON_SIZE);
+
+            // Single byte integers match almost everywhere
+            if (generator.is_full() || size == 0 || (entry.is_integer && size < 2))
+            {
+                continue;
+            }
+
+            const auto first = std::span(entry.first).first(size);
+            const auto second = std::span(entry.second).first(size);
+
+            generator.add(first, second);
+            generator.add(second, first);
+
+            if (!entry.is_integer)
+            {
+                continue;
+            }
+
+            std::array<uint8_t, MAX_COMPARISON_SIZE> first_swapped{};
+            std::array<uint8_t, MAX_COMPARISON_SIZE> second_swapped{};
+
+            std::reverse_copy(first.begin(), first.end(), first_swapped.begin());
+            std::reverse_copy(second.begin(), second.end(), second_swapped.begin());
+
+            generator.add(std::span(first_swapped).first(size), std::span(second_swapped).first(size));
+            generator.add(std::span(second_swapped).first(size), std::span(first_swapped).first(size));
+        }
+
+        return generator.move_candidates();
+    }
+}
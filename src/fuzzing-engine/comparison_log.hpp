@@ -0,0 +1,25 @@
+#pragma once
+#include <span>
+#include <array>
+#include <vector>
+#include <cstdint>
+
+namespace fuzzer
+{
+    constexpr size_t MAX_COMPARISON_SIZE = 32;
+
+    // Operands of one comparison, integers are stored in little endian
+    struct comparison_entry
+    {
+        std::array<uint8_t, MAX_COMPARISON_SIZE> first{};
+        std::array<uint8_t, MAX_COMPARISON_SIZE> second{};
+        uint8_t size{};
+        bool is_integer{};
+    };
+
+    // Input-to-state replacement: every occurrence of one operand in the input is replaced by the other one,
+    // each replacement producing a separate input. Integers are searched in both byte orders.
+    std::vector<std::vector<uint8_t>> generate_replacements(std::span<const uint8_t> input,
+                                                            std::span<const comparison_entry> comparisons,
+                                                            size_t limit);
+}
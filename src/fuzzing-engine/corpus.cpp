@@ -0,0 +1,228 @@
+#include "corpus.hpp"
+
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+
+namespace fuzzer
+{
+    namespace
+    {
+        constexpr uint64_t CORPUS_MAGIC = 0x5355505230434D4D; // MMC0RPUS
+        constexpr uint32_t CORPUS_VERSION = 1;
+        constexpr uint64_t INITIAL_CORPUS_SIZE = 0x100000;
+        constexpr uint64_t RECORD_ALIGNMENT = 8;
+
+        struct corpus_header
+        {
+            uint64_t magic;
+            uint32_t version;
+            uint32_t reserved;
+            uint64_t entry_count;
+            uint64_t data_end;
+        };
+
+        struct record_header
+        {
+            uint32_t size;
+            uint32_t reserved;
+            uint64_t score;
+            uint64_t signature;
+        };
+
+        uint64_t align_record(const uint64_t value)
+        {
+            return (value + RECORD_ALIGNMENT - 1) & ~(RECORD_ALIGNMENT - 1);
+        }
+
+        uint64_t get_record_size(const uint64_t data_size)
+        {
+            return align_record(sizeof(record_header) + data_size);
+        }
+
+        template <typename T>
+        T read_object(const utils::mapped_file& mapping, const uint64_t offset)
+        {
+            T object{};
+            memcpy(&object, mapping.data() + offset, sizeof(object));
+            return object;
+        }
+
+        template <typename T>
+        void write_object(utils::mapped_file& mapping, const uint64_t offset, const T& object)
+        {
+            memcpy(mapping.data() + offset, &object, sizeof(object));
+        }
+    }
+
+    corpus::corpus(const std::filesystem::path& file)
+        : file_(file)
+    {
+        this->mapping_ = utils::mapped_file(this->file_, utils::mapped_file::access::read_write, INITIAL_CORPUS_SIZE);
+        this->load();
+    }
+
+    corpus::~corpus()
+    {
+        this->flush();
+    }
+
+    void corpus::load()
+    {
+        auto header = read_object<corpus_header>(this->mapping_, 0);
+
+        if (header.magic == 0 && header.entry_count == 0 && header.data_end == 0)
+        {
+            header.magic = CORPUS_MAGIC;
+            header.version = CORPUS_VERSION;
+            header.data_end = align_record(sizeof(corpus_header));
+
+            write_object(this->mapping_, 0, header);
+            return;
+        }
+
+        if (header.magic != CORPUS_MAGIC || header.version != CORPUS_VERSION)
+        {
+            throw std::runtime_error("Invalid corpus file: " + this->file_.string());
+        }
+
+        if (header.data_end > this->mapping_.size())
+        {
+            throw std::runtime_error("Truncated corpus file: " + this->file_.string());
+        }
+
+        this->offsets_.reserve(static_cast<size_t>(header.entry_count));
+
+        auto offset = align_record(sizeof(corpus_header));
+
+        while (offset + sizeof(record_header) <= header.data_end && this->offsets_.size() < header.entry_count)
+        {
+            const auto record = read_object<record_header>(this->mapping_, offset);
+            const auto next_offset = offset + get_record_size(record.size);
+
+            if (next_offset > header.data_end)
+            {
+                break;
+            }
+
+            this->offsets_.push_back(offset);
+            this->signatures_.insert(record.signature);
+
+            offset = next_offset;
+        }
+
+        if (this->offsets_.size() != header.entry_count || offset != header.data_end)
+        {
+            header.entry_count = this->offsets_.size();
+            header.data_end = offset;
+            write_object(this->mapping_, 0, header);
+        }
+    }
+
+    void corpus::grow(const uint64_t required_size)
+    {
+        auto new_size = static_cast<uint64_t>(this->mapping_.size());
+
+        while (new_size < required_size)
+        {
+            new_size *= 2;
+        }
+
+        this->mapping_.flush();
+        this->mapping_.release();
+        this->mapping_ = utils::mapped_file(this->file_, utils::mapped_file::access::read_write,
+                                            static_cast<size_t>(new_size));
+    }
+
+    bool corpus::add(const std::span<const uint8_t> data, const uint64_t score, const uint64_t signature)
+    {
+        std::unique_lock _{this->mutex_};
+
+        if (!this->signatures_.insert(signature).second)
+        {
+            return false;
+        }
+
+        auto header = read_object<corpus_header>(this->mapping_, 0);
+        const auto offset = header.data_end;
+        const auto end = offset + get_record_size(data.size());
+
+        if (end > this->mapping_.size())
+        {
+            this->grow(end);
+        }
+
+        record_header record{};
+        record.size = static_cast<uint32_t>(data.size());
+        record.score = score;
+        record.signature = signature;
+
+        write_object(this->mapping_, offset, record);
+        memcpy(this->mapping_.data() + offset + sizeof(record), data.data(), data.size());
+
+        header.entry_count += 1;
+        header.data_end = end;
+        write_object(this->mapping_, 0, header);
+
+        this->offsets_.push_back(offset);
+        return true;
+    }
+
+    corpus_entry corpus::read_entry(const uint64_t offset) const
+    {
+        const auto record = read_object<record_header>(this->mapping_, offset);
+        const auto* data = reinterpret_cast<const uint8_t*>(this->mapping_.data() + offset + sizeof(record));
+
+        corpus_entry entry{};
+        entry.data.assign(data, data + record.size);
+        entry.score = record.score;
+        entry.signature = record.signature;
+
+        return entry;
+    }
+
+    corpus_entry corpus::get(const size_t index) const
+    {
+        std::shared_lock _{this->mutex_};
+        return this->read_entry(this->offsets_.at(index));
+    }
+
+    std::vector<corpus_entry> corpus::get_top_entries(const size_t count) const
+    {
+        std::shared_lock _{this->mutex_};
+
+        std::vector<std::pair<uint64_t, uint64_t>> scores{};
+        scores.reserve(this->offsets_.size());
+
+        for (const auto offset : this->offsets_)
+        {
+            scores.emplace_back(read_object<record_header>(this->mapping_, offset).score, offset);
+        }
+
+        const auto top_count = std::min(count, scores.size());
+        std::partial_sort(scores.begin(), scores.begin() + static_cast<ptrdiff_t>(top_count), scores.end(),
+                          [](const auto& a, const auto& b) { return a.first > b.first; });
+
+        std::vector<corpus_entry> entries{};
+        entries.reserve(top_count);
+
+        for (size_t i = 0; i < top_count; ++i)
+        {
+            entries.push_back(this->read_entry(scores[i].second));
+        }
+
+        return entries;
+    }
+
+    size_t corpus::size() const
+    {
+        std::shared_lock _{this->mutex_};
+        return this->offsets_.size();
+    }
+
+    void corpus::flush() const
+    {
+        std::shared_lock _{this->mutex_};
+        this->mapping_.flush();
+    }
+}
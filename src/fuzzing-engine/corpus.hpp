@@ -0,0 +1,56 @@
+#pragma once
+#include <span>
+#include <mutex>
+#include <shared_mutex>
+#include <vector>
+#include <cstdint>
+#include <filesystem>
+#include <unordered_set>
+
+#include <utils/mapped_file.hpp>
+
+namespace fuzzer
+{
+    struct corpus_entry
+    {
+        std::vector<uint8_t> data{};
+        uint64_t score{};
+        uint64_t signature{};
+    };
+
+    // Append-only input store backed by a memory-mapped file.
+    // Only record offsets are kept in memory, entry data stays in the mapping.
+    class corpus
+    {
+      public:
+        corpus(const std::filesystem::path& file);
+        ~corpus();
+
+        corpus(const corpus&) = delete;
+        corpus& operator=(const corpus&) = delete;
+
+        corpus(corpus&&) = delete;
+        corpus& operator=(corpus&&) = delete;
+
+        bool add(std::span<const uint8_t> data, uint64_t score, uint64_t signature);
+
+        corpus_entry get(size_t index) const;
+        std::vector<corpus_entry> get_top_entries(size_t count) const;
+
+        size_t size() const;
+        void flush() const;
+
+      private:
+        std::filesystem::path file_{};
+        utils::mapped_file mapping_{};
+
+        mutable std::shared_mutex mutex_{};
+        std::vector<uint64_t> offsets_{};
+        std::unordered_set<uint64_t> signatures_{};
+
+        void load();
+        void grow(uint64_t required_size);
+
+        corpus_entry read_entry(uint64_t offset) const;
+    };
+}
@@ -0,0 +1,199 @@
+#include "corpus_sync.hpp"
+
+#include <random>
+#include <cstring>
+#include <optional>
+#include <stdexcept>
+
+namespace fuzzer
+{
+    namespace
+    {
+        constexpr uint32_t MAGIC = 0x434E5953; // SYNC
+        constexpr uint16_t VERSION = 1;
+
+        // Size of the receive buffer of network::socket
+        constexpr size_t MAX_PACKET_SIZE = 0x2000;
+        constexpr std::chrono::milliseconds RECEIVE_TIMEOUT{100};
+
+        // All nodes are expected to share the byte order
+        struct packet_header
+        {
+            uint32_t magic{};
+            uint16_t version{};
+            uint16_t delta_count{};
+            uint64_t node_id{};
+            uint64_t score{};
+            uint64_t signature{};
+            uint32_t input_size{};
+            uint32_t reserved{};
+        };
+
+        static_assert(sizeof(packet_header) == 40);
+
+        constexpr size_t DELTA_ENTRY_SIZE = sizeof(coverage_delta::index) + sizeof(coverage_delta::bits);
+
+        template <typename T>
+        void append_object(std::string& packet, const T& value)
+        {
+            packet.append(reinterpret_cast<const char*>(&value), sizeof(value));
+        }
+
+        template <typename T>
+        T read_object(const std::string& packet, const size_t offset)
+        {
+            T value{};
+            memcpy(&value, packet.data() + offset, sizeof(value));
+            return value;
+        }
+
+        std::optional<synced_input> parse_packet(const std::string& packet, const uint64_t own_node_id)
+        {
+            if (packet.size() < sizeof(packet_header))
+            {
+                return std::nullopt;
+            }
+
+            const auto header = read_object<packet_header>(packet, 0);
+            if (header.magic != MAGIC || header.version != VERSION || header.node_id == own_node_id)
+            {
+                return std::nullopt;
+            }
+
+            const auto delta_size = header.delta_count * DELTA_ENTRY_SIZE;
+            if (packet.size() != sizeof(header) + delta_size + header.input_size)
+            {
+                return std::nullopt;
+            }
+
+            synced_input input{};
+            input.score = header.score;
+            input.signature = header.signature;
+            input.coverage.reserve(header.delta_count);
+
+            auto offset = sizeof(header);
+
+            for (size_t i = 0; i < header.delta_count; ++i, offset += DELTA_ENTRY_SIZE)
+            {
+                coverage_delta delta{};
+                delta.index = read_object<uint32_t>(packet, offset);
+                delta.bits = read_object<uint64_t>(packet, offset + sizeof(delta.index));
+
+                input.coverage.push_back(delta);
+            }
+
+            const auto* data = reinterpret_cast<const uint8_t*>(packet.data() + offset);
+            input.data.assign(data, data + header.input_size);
+
+            return input;
+        }
+
+        uint64_t generate_node_id()
+        {
+            std::random_device rd{};
+            return (static_cast<uint64_t>(rd()) << 32) | rd();
+        }
+    }
+
+    corpus_sync::corpus_sync(const uint16_t port, const std::vector<std::string>& peers, input_callback callback)
+        : node_id_(generate_node_id()),
+          socket_(AF_INET),
+          callback_(std::move(callback))
+    {
+        network::address local_address{"0.0.0.0", AF_INET};
+        local_address.set_port(port);
+
+        if (!this->socket_.bind_port(local_address))
+        {
+            throw std::runtime_error("Failed to bind sync port " + std::to_string(port));
+        }
+
+        this->socket_.set_blocking(false);
+
+        for (const auto& peer : peers)
+        {
+            this->peers_.emplace_back(peer, AF_INET);
+        }
+
+        this->receiver_ = std::thread([this] {
+            this->receive_packets(); //
+        });
+    }
+
+    corpus_sync::~corpus_sync()
+    {
+        this->stop_ = true;
+
+        if (this->receiver_.joinable())
+        {
+            this->receiver_.join();
+        }
+    }
+
+    bool corpus_sync::broadcast(const std::span<const uint8_t> input, const uint64_t score, const uint64_t signature,
+                                const std::span<const coverage_delta> coverage) const
+    {
+        const auto packet_size = sizeof(packet_header) + coverage.size() * DELTA_ENTRY_SIZE + input.size();
+        if (packet_size > MAX_PACKET_SIZE || this->peers_.empty())
+        {
+            return false;
+        }
+
+        packet_header header{};
+        header.magic = MAGIC;
+        header.version = VERSION;
+        header.delta_count = static_cast<uint16_t>(coverage.size());
+        header.node_id = this->node_id_;
+        header.score = score;
+        header.signature = signature;
+        header.input_size = static_cast<uint32_t>(input.size());
+
+        std::string packet{};
+        packet.reserve(packet_size);
+
+        append_object(packet, header);
+
+        for (const auto& delta : coverage)
+        {
+            append_object(packet, delta.index);
+            append_object(packet, delta.bits);
+        }
+
+        packet.append(reinterpret_cast<const char*>(input.data()), input.size());
+
+        auto sent = true;
+
+        for (const auto& peer : this->peers_)
+        {
+            sent &= this->socket_.send(peer, packet);
+        }
+
+        return sent;
+    }
+
+    void corpus_sync::receive_packets()
+    {
+        network::address source{};
+        std::string packet{};
+
+        while (!this->stop_)
+        {
+            if (this->socket_.sleep(RECEIVE_TIMEOUT) != network::socket::socket_is_ready)
+            {
+                continue;
+            }
+
+            while (this->socket_.receive(source, packet))
+            {
+                auto input = parse_packet(packet, this->node_id_);
+                if (!input)
+                {
+                    continue;
+                }
+
+                ++this->received_;
+                this->callback_(*input);
+            }
+        }
+    }
+}
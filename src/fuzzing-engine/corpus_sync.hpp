@@ -0,0 +1,61 @@
+#pragma once
+#include <span>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <functional>
+
+#include <network/socket.hpp>
+
+#include "coverage_map.hpp"
+
+namespace fuzzer
+{
+    struct synced_input
+    {
+        std::vector<uint8_t> data{};
+        uint64_t score{};
+        uint64_t signature{};
+        std::vector<coverage_delta> coverage{};
+    };
+
+    // Exchanges inputs that found new coverage between fuzzing nodes over UDP. Every input is sent together
+    // with the coverage bits it discovered, so receivers can merge them without executing the input.
+    // Delivery is best effort: lost datagrams are not resent and inputs that don't fit into one are not sent.
+    class corpus_sync
+    {
+      public:
+        using input_callback = std::function<void(synced_input&)>;
+
+        corpus_sync(uint16_t port, const std::vector<std::string>& peers, input_callback callback);
+        ~corpus_sync();
+
+        corpus_sync(const corpus_sync&) = delete;
+        corpus_sync& operator=(const corpus_sync&) = delete;
+
+        corpus_sync(corpus_sync&&) = delete;
+        corpus_sync& operator=(corpus_sync&&) = delete;
+
+        bool broadcast(std::span<const uint8_t> input, uint64_t score, uint64_t signature,
+                       std::span<const coverage_delta> coverage) const;
+
+        uint64_t get_received() const
+        {
+            return this->received_;
+        }
+
+      private:
+        uint64_t node_id_{};
+        network::socket socket_{};
+        std::vector<network::address> peers_{};
+        input_callback callback_{};
+
+        std::atomic_uint64_t received_{0};
+        std::atomic_bool stop_{false};
+        std::thread receiver_{};
+
+        void receive_packets();
+    };
+}
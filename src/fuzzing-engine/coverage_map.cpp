@@ -0,0 +1,209 @@
+#include "coverage_map.hpp"
+
+#include <bit>
+#include <cstring>
+
+namespace fuzzer
+{
+    namespace
+    {
+        constexpr std::array<uint8_t, 256> create_count_classes()
+        {
+            std::array<uint8_t, 256> classes{};
+
+            for (size_t i = 0; i < classes.size(); ++i)
+            {
+                if (i <= 3)
+                {
+                    classes[i] = static_cast<uint8_t>(i == 3 ? 4 : i);
+                }
+                else if (i <= 7)
+                {
+                    classes[i] = 8;
+                }
+                else if (i <= 15)
+                {
+                    classes[i] = 16;
+                }
+                else if (i <= 31)
+                {
+                    classes[i] = 32;
+                }
+                else if (i <= 127)
+                {
+                    classes[i] = 64;
+                }
+                else
+                {
+                    classes[i] = 128;
+                }
+            }
+
+            return classes;
+        }
+
+        constexpr auto COUNT_CLASSES = create_count_classes();
+
+        uint64_t classify_word(const uint64_t word)
+        {
+            uint8_t bytes[sizeof(word)]{};
+            memcpy(bytes, &word, sizeof(word));
+
+            for (auto& b : bytes)
+            {
+                b = COUNT_CLASSES[b];
+            }
+
+            uint64_t result{};
+            memcpy(&result, bytes, sizeof(result));
+            return result;
+        }
+    }
+
+    void coverage_map::classify_counts()
+    {
+        for (auto& word : this->words_)
+        {
+            if (word)
+            {
+                word = classify_word(word);
+            }
+        }
+    }
+
+    size_t coverage_map::count_edges() const
+    {
+        size_t edges = 0;
+
+        for (const auto word : this->words_)
+        {
+            if (!word)
+            {
+                continue;
+            }
+
+            for (size_t i = 0; i < sizeof(word); ++i)
+            {
+                edges += ((word >> (i * 8)) & 0xFF) ? 1 : 0;
+            }
+        }
+
+        return edges;
+    }
+
+    uint64_t coverage_map::get_signature() const
+    {
+        uint64_t signature = 0xCBF29CE484222325;
+
+        for (size_t i = 0; i < this->words_.size(); ++i)
+        {
+            if (this->words_[i])
+            {
+                signature ^= this->words_[i] + i;
+                signature *= 0x100000001B3;
+                signature = std::rotl(signature, 17);
+            }
+        }
+
+        return signature;
+    }
+
+    bool virgin_map::has_new_bits(const coverage_map& coverage) const
+    {
+        const auto trace = coverage.get_words();
+
+        uint64_t new_bits = 0;
+
+        for (size_t i = 0; i < this->words_.size(); ++i)
+        {
+            new_bits |= trace[i] & this->words_[i];
+        }
+
+        return new_bits != 0;
+    }
+
+    size_t virgin_map::count_covered_edges() const
+    {
+        size_t edges = 0;
+
+        for (const auto word : this->words_)
+        {
+            if (word == ~0ULL)
+            {
+                continue;
+            }
+
+            for (size_t i = 0; i < sizeof(word); ++i)
+            {
+                edges += ((word >> (i * 8)) & 0xFF) != 0xFF ? 1 : 0;
+            }
+        }
+
+        return edges;
+    }
+
+    coverage_novelty virgin_map::merge(const coverage_map& coverage, std::vector<coverage_delta>* delta)
+    {
+        const auto trace = coverage.get_words();
+
+        coverage_novelty novelty{};
+
+        for (size_t i = 0; i < this->words_.size(); ++i)
+        {
+            const auto new_bits = this->merge_word(i, trace[i], novelty);
+            if (new_bits && delta)
+            {
+                delta->push_back({static_cast<uint32_t>(i), new_bits});
+            }
+        }
+
+        return novelty;
+    }
+
+    coverage_novelty virgin_map::merge(const std::span<const coverage_delta> delta)
+    {
+        coverage_novelty novelty{};
+
+        for (const auto& entry : delta)
+        {
+            if (entry.index < this->words_.size())
+            {
+                this->merge_word(entry.index, entry.bits, novelty);
+            }
+        }
+
+        return novelty;
+    }
+
+    uint64_t virgin_map::merge_word(const size_t index, const uint64_t bits, coverage_novelty& novelty)
+    {
+        auto& word = this->words_[index];
+
+        const auto new_bits = bits & word;
+        if (!new_bits)
+        {
+            return 0;
+        }
+
+        for (size_t j = 0; j < sizeof(uint64_t); ++j)
+        {
+            const auto shift = j * 8;
+            if (!((new_bits >> shift) & 0xFF))
+            {
+                continue;
+            }
+
+            if (((word >> shift) & 0xFF) == 0xFF)
+            {
+                ++novelty.new_edges;
+            }
+            else
+            {
+                ++novelty.new_counts;
+            }
+        }
+
+        word &= ~bits;
+        return new_bits;
+    }
+}
@@ -0,0 +1,106 @@
+#pragma once
+#include <span>
+#include <array>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace fuzzer
+{
+    constexpr size_t COVERAGE_MAP_SIZE = 1 << 16;
+
+    // AFL-style edge map: every byte counts how often a block transition was taken.
+    // Uses the same edge hashing as emulator::enable_block_coverage, so both can fill the same map.
+    class coverage_map
+    {
+      public:
+        void record_block(const uint64_t address)
+        {
+            const auto location = hash_location(address);
+            auto& counter = this->bytes()[(location ^ this->previous_location_) & (COVERAGE_MAP_SIZE - 1)];
+            counter = static_cast<uint8_t>(counter + 1);
+            this->previous_location_ = location >> 1;
+        }
+
+        void reset()
+        {
+            this->words_.fill(0);
+            this->previous_location_ = 0;
+        }
+
+        void classify_counts();
+        size_t count_edges() const;
+        uint64_t get_signature() const;
+
+        std::span<uint8_t> get_buffer()
+        {
+            return {this->bytes(), COVERAGE_MAP_SIZE};
+        }
+
+        std::span<const uint64_t> get_words() const
+        {
+            return this->words_;
+        }
+
+      private:
+        static constexpr size_t WORD_COUNT = COVERAGE_MAP_SIZE / sizeof(uint64_t);
+
+        alignas(64) std::array<uint64_t, WORD_COUNT> words_{};
+        uint64_t previous_location_{0};
+
+        uint8_t* bytes()
+        {
+            return reinterpret_cast<uint8_t*>(this->words_.data());
+        }
+
+        static uint64_t hash_location(uint64_t address)
+        {
+            address ^= address >> 33;
+            address *= 0xFF51AFD7ED558CCD;
+            address ^= address >> 33;
+            return address;
+        }
+    };
+
+    struct coverage_novelty
+    {
+        size_t new_edges{};
+        size_t new_counts{};
+
+        bool is_new() const
+        {
+            return this->new_edges != 0 || this->new_counts != 0;
+        }
+    };
+
+    // Bits of one map word that were observed for the first time
+    struct coverage_delta
+    {
+        uint32_t index{};
+        uint64_t bits{};
+    };
+
+    // Bits that were never observed in any classified coverage map
+    class virgin_map
+    {
+      public:
+        virgin_map()
+        {
+            this->words_.fill(~0ULL);
+        }
+
+        bool has_new_bits(const coverage_map& coverage) const;
+        size_t count_covered_edges() const;
+
+        // The new bits are appended to the delta, if one is given
+        coverage_novelty merge(const coverage_map& coverage, std::vector<coverage_delta>* delta = nullptr);
+        coverage_novelty merge(std::span<const coverage_delta> delta);
+
+      private:
+        static constexpr size_t WORD_COUNT = COVERAGE_MAP_SIZE / sizeof(uint64_t);
+
+        alignas(64) std::array<uint64_t, WORD_COUNT> words_{};
+
+        uint64_t merge_word(size_t index, uint64_t bits, coverage_novelty& novelty);
+    };
+}
@@ -0,0 +1,89 @@
+#include "crash_store.hpp"
+
+#include <cstdio>
+#include <cinttypes>
+
+#include <utils/io.hpp>
+
+namespace fuzzer
+{
+    crash_store::crash_store(std::filesystem::path directory)
+        : directory_(std::move(directory))
+    {
+        if (!this->directory_.empty())
+        {
+            std::filesystem::create_directories(this->directory_);
+        }
+    }
+
+    bool crash_store::add(const crash_details& details, const std::span<const uint8_t> input)
+    {
+        std::lock_guard _{this->mutex_};
+
+        const auto entry = this->buckets_.find(details);
+        if (entry != this->buckets_.end())
+        {
+            ++entry->second.hits;
+
+            if (input.size() < entry->second.input.size())
+            {
+                entry->second.input.assign(input.begin(), input.end());
+                this->save(details, entry->second.input);
+            }
+
+            return false;
+        }
+
+        auto& new_bucket = this->buckets_[details];
+        new_bucket.input.assign(input.begin(), input.end());
+        new_bucket.hits = 1;
+
+        this->save(details, new_bucket.input);
+        this->minimization_queue_.push_back(details);
+
+        printf("New crash at 0x%" PRIx64 " (stack 0x%016" PRIx64 ") - %zu bytes\n", details.address,
+               details.stack_hash, input.size());
+
+        return true;
+    }
+
+    std::optional<crash_entry> crash_store::take_minimization_job()
+    {
+        std::lock_guard _{this->mutex_};
+
+        if (this->minimization_queue_.empty())
+        {
+            return std::nullopt;
+        }
+
+        crash_entry job{};
+        job.details = this->minimization_queue_.front();
+        job.input = this->buckets_.at(job.details).input;
+
+        this->minimization_queue_.pop_front();
+        return job;
+    }
+
+    size_t crash_store::size() const
+    {
+        std::lock_guard _{this->mutex_};
+        return this->buckets_.size();
+    }
+
+    void crash_store::save(const crash_details& details, const std::vector<uint8_t>& input) const
+    {
+        if (this->directory_.empty())
+        {
+            return;
+        }
+
+        char name[64]{};
+        (void)snprintf(name, sizeof(name), "crash_%" PRIx64 "_%016" PRIx64 ".bin", details.address,
+                       details.stack_hash);
+
+        if (!utils::io::write_file(this->directory_ / name, input))
+        {
+            printf("Failed to save crash input: %s\n", name);
+        }
+    }
+}
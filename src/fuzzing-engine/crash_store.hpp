@@ -0,0 +1,59 @@
+#pragma once
+#include <map>
+#include <span>
+#include <deque>
+#include <mutex>
+#include <vector>
+#include <compare>
+#include <cstdint>
+#include <optional>
+#include <filesystem>
+
+namespace fuzzer
+{
+    // Crashes with equal details are considered duplicates
+    struct crash_details
+    {
+        uint64_t address{};
+        uint64_t stack_hash{};
+
+        auto operator<=>(const crash_details&) const = default;
+    };
+
+    struct crash_entry
+    {
+        crash_details details{};
+        std::vector<uint8_t> input{};
+    };
+
+    // Buckets crashes by their details and keeps the smallest input of every bucket.
+    // Inputs are written to the directory, if one is given, and replaced when a smaller one is found.
+    class crash_store
+    {
+      public:
+        crash_store(std::filesystem::path directory = {});
+
+        // Returns true if the crash wasn't seen before
+        bool add(const crash_details& details, std::span<const uint8_t> input);
+
+        // Hands out every new bucket once, to minimize its input
+        std::optional<crash_entry> take_minimization_job();
+
+        size_t size() const;
+
+      private:
+        struct bucket
+        {
+            std::vector<uint8_t> input{};
+            uint64_t hits{};
+        };
+
+        std::filesystem::path directory_{};
+
+        mutable std::mutex mutex_{};
+        std::map<crash_details, bucket> buckets_{};
+        std::deque<crash_details> minimization_queue_{};
+
+        void save(const crash_details& details, const std::vector<uint8_t>& input) const;
+    };
+}
@@ -1,19 +1,139 @@
 #include "fuzzer.hpp"
 #include <cinttypes>
+#include <mutex>
+#include <numeric>
+#include <algorithm>
 
+#include <utils/io.hpp>
+#include <utils/cpu_topology.hpp>
+
+#include "corpus_sync.hpp"
+#include "fuzzing_stats.hpp"
 #include "input_generator.hpp"
 
 namespace fuzzer
 {
     namespace
     {
+        constexpr uint64_t NEW_EDGE_SCORE = 1000;
+        constexpr uint64_t NEW_COUNT_SCORE = 10;
+        constexpr size_t MAX_MINIMIZATION_EXECUTIONS = 10000;
+        constexpr size_t MAX_REPLACEMENT_INPUTS = 256;
+
+        std::unique_ptr<corpus> create_corpus(const fuzzing_settings& settings)
+        {
+            if (settings.corpus_file.empty())
+            {
+                return {};
+            }
+
+            return std::make_unique<corpus>(settings.corpus_file);
+        }
+
+        // Seeds are executed like any other input first, so the corpus keeps the ones reaching new coverage under
+        // their coverage signature
+        void queue_seed_inputs(input_generator& generator, const fuzzing_settings& settings)
+        {
+            if (settings.seed_directory.empty())
+            {
+                return;
+            }
+
+            const auto workers = std::max(settings.concurrency, static_cast<size_t>(1));
+            std::vector<std::vector<std::vector<uint8_t>>> worker_inputs(workers);
+
+            size_t seeds = 0;
+
+            for (const auto& file : utils::io::list_files(settings.seed_directory, true))
+            {
+                if (std::filesystem::is_regular_file(file))
+                {
+                    worker_inputs[seeds++ % workers].push_back(utils::io::read_file(file));
+                }
+            }
+
+            for (size_t i = 0; i < workers; ++i)
+            {
+                generator.queue_inputs(i, std::move(worker_inputs[i]));
+            }
+        }
+
         class fuzzing_context
         {
           public:
-            fuzzing_context(input_generator& generator, fuzzing_handler& handler)
+            fuzzing_context(input_generator& generator, fuzzing_handler& handler, crash_store& crashes,
+                            const size_t workers, const fuzzing_settings& settings)
                 : generator(generator),
-                  handler(handler)
+                  handler(handler),
+                  crashes(crashes),
+                  budget(settings.budget),
+                  trace_comparisons(settings.trace_comparisons),
+                  processors(settings.pin_workers ? utils::cpu::get_processors()
+                                                  : std::vector<utils::cpu::logical_processor>{}),
+                  executions_(std::make_unique<execution_counter[]>(std::max(workers, static_cast<size_t>(1)))),
+                  workers_(std::max(workers, static_cast<size_t>(1)))
+            {
+            }
+
+            void count_execution(const size_t worker_index)
+            {
+                this->executions_[worker_index % this->workers_].value.fetch_add(1, std::memory_order_relaxed);
+            }
+
+            // Executions of every worker since the last call
+            std::vector<uint64_t> collect_executions()
+            {
+                std::vector<uint64_t> executions{};
+                executions.reserve(this->workers_);
+
+                for (size_t i = 0; i < this->workers_; ++i)
+                {
+                    executions.push_back(this->executions_[i].value.exchange(0, std::memory_order_relaxed));
+                }
+
+                return executions;
+            }
+
+            void count_timeout(const size_t worker_index)
             {
+                this->executions_[worker_index % this->workers_].timeouts.fetch_add(1, std::memory_order_relaxed);
+            }
+
+            // Timeouts of every worker since the start
+            std::vector<uint64_t> get_timeouts() const
+            {
+                std::vector<uint64_t> timeouts{};
+                timeouts.reserve(this->workers_);
+
+                for (size_t i = 0; i < this->workers_; ++i)
+                {
+                    timeouts.push_back(this->executions_[i].timeouts.load(std::memory_order_relaxed));
+                }
+
+                return timeouts;
+            }
+
+            void record_restore_time(const size_t worker_index, const std::chrono::nanoseconds time)
+            {
+                this->executions_[worker_index % this->workers_].restore_latency.record(time);
+            }
+
+            latency_snapshot get_restore_latency() const
+            {
+                latency_snapshot snapshot{};
+
+                for (size_t i = 0; i < this->workers_; ++i)
+                {
+                    this->executions_[i].restore_latency.add_to(snapshot);
+                }
+
+                return snapshot;
+            }
+
+            size_t count_covered_edges()
+            {
+                std::lock_guard _{this->virgin_mutex_};
+                return this->virgin_map_.count_covered_edges();
             }
 
             void stop()
@@ -37,38 +157,202 @@ namespace fuzzer
                 return true;
             }
 
+            coverage_novelty update_virgin_map(virgin_map& local_map, const coverage_map& coverage,
+                                               std::vector<coverage_delta>* delta = nullptr)
+            {
+                if (!local_map.has_new_bits(coverage))
+                {
+                    return {};
+                }
+
+                std::lock_guard _{this->virgin_mutex_};
+
+                const auto novelty = this->virgin_map_.merge(coverage, delta);
+                local_map = this->virgin_map_;
+
+                return novelty;
+            }
+
+            // Worker maps pick the imported bits up with their next global merge
+            void import_input(synced_input& input)
+            {
+                {
+                    std::lock_guard _{this->virgin_mutex_};
+                    this->virgin_map_.merge(input.coverage);
+                }
+
+                input_entry entry{};
+                entry.data = std::move(input.data);
+                entry.score = input.score;
+                entry.signature = input.signature;
+
+                this->generator.import_input(std::move(entry));
+            }
+
             input_generator& generator;
             fuzzing_handler& handler;
-            std::atomic_uint64_t executions{0};
+            crash_store& crashes;
+            const corpus_sync* sync{};
+            execution_budget budget{};
+            bool trace_comparisons{};
+            std::vector<utils::cpu::logical_processor> processors{};
 
           private:
+            struct alignas(64) execution_counter
+            {
+                std::atomic_uint64_t value{0};
+                std::atomic_uint64_t timeouts{0};
+                latency_histogram restore_latency{};
+            };
+
+            std::unique_ptr<execution_counter[]> executions_{};
+            size_t workers_{};
             std::atomic_bool stop_{false};
+
+            std::mutex virgin_mutex_{};
+            virgin_map virgin_map_{};
         };
 
-        void perform_fuzzing_iteration(fuzzing_context& context, executer& executer)
+        struct worker_state
+        {
+            size_t index{};
+            coverage_map coverage{};
+            coverage_map comparison_coverage{};
+            virgin_map local_virgin_map{};
+            std::vector<coverage_delta> discovered_bits{};
+        };
+
+        // Inputs reaching new coverage are traced once, replacing compared values in them queues new inputs
+        void queue_replacement_inputs(fuzzing_context& context, executer& executer, worker_state& state,
+                                      const std::span<const uint8_t> input)
+        {
+            state.comparison_coverage.reset();
+            const auto comparisons = executer.trace_comparisons(input, state.comparison_coverage, context.budget);
+            context.count_execution(state.index);
+
+            auto replacements = generate_replacements(input, comparisons, MAX_REPLACEMENT_INPUTS);
+            context.generator.queue_inputs(state.index, std::move(replacements));
+        }
+
+        void perform_fuzzing_iteration(fuzzing_context& context, executer& executer, worker_state& state)
         {
-            ++context.executions;
-            context.generator.access_input([&](const std::span<const uint8_t> input) {
-                uint64_t score{0};
-                const auto result = executer.execute(input, [&](uint64_t) { ++score; });
+            context.count_execution(state.index);
+            context.generator.access_input(state.index, [&](const std::span<const uint8_t> input) {
+                state.coverage.reset();
+
+                const auto start = std::chrono::steady_clock::now();
+                const auto result = executer.execute(input, state.coverage, context.budget);
+                const auto execution_time = std::chrono::steady_clock::now() - start;
+
+                if (const auto restore_time = executer.get_restore_time(); restore_time.count() > 0)
+                {
+                    context.record_restore_time(state.index, restore_time);
+                }
+
+                // Coverage of hanging inputs is incomplete, they are not worth keeping
+                if (result == execution_result::timeout)
+                {
+                    context.count_timeout(state.index);
+                    return input_feedback{};
+                }
+
+                state.coverage.classify_counts();
+                state.discovered_bits.clear();
+
+                auto* delta = context.sync ? &state.discovered_bits : nullptr;
+                const auto novelty = context.update_virgin_map(state.local_virgin_map, state.coverage, delta);
+
+                input_feedback feedback{};
+                feedback.score = novelty.new_edges * NEW_EDGE_SCORE + novelty.new_counts * NEW_COUNT_SCORE +
+                                 state.coverage.count_edges();
+                feedback.signature = state.coverage.get_signature();
+                feedback.new_coverage = novelty.is_new();
+                feedback.execution_time = execution_time;
 
                 if (result == execution_result::error)
                 {
-                    printf("Found error!\n");
-                    context.stop();
+                    context.crashes.add(executer.get_crash_details(), input);
+                }
+                else if (feedback.new_coverage)
+                {
+                    if (context.sync)
+                    {
+                        context.sync->broadcast(input, feedback.score, feedback.signature, state.discovered_bits);
+                    }
+
+                    if (context.trace_comparisons)
+                    {
+                        queue_replacement_inputs(context, executer, state, input);
+                    }
                 }
 
-                return score;
+                return feedback;
             });
         }
 
-        void worker(fuzzing_context& context)
+        // Removes chunks of the input as long as it still crashes the same way, halving the chunk size
+        // down to single bytes
+        std::vector<uint8_t> minimize_input(fuzzing_context& context, executer& executer, worker_state& state,
+                                            const crash_entry& crash)
+        {
+            auto input = crash.input;
+            size_t executions = 0;
+
+            for (auto chunk_size = std::max(input.size() / 2, static_cast<size_t>(1)); chunk_size > 0;
+                 chunk_size /= 2)
+            {
+                size_t offset = 0;
+
+                while (offset < input.size() && executions < MAX_MINIMIZATION_EXECUTIONS && !context.should_stop())
+                {
+                    auto candidate = input;
+                    const auto end = std::min(offset + chunk_size, candidate.size());
+                    candidate.erase(candidate.begin() + static_cast<ptrdiff_t>(offset),
+                                    candidate.begin() + static_cast<ptrdiff_t>(end));
+
+                    ++executions;
+                    context.count_execution(state.index);
+                    state.coverage.reset();
+
+                    const auto result = executer.execute(candidate, state.coverage, context.budget);
+                    if (result == execution_result::error && executer.get_crash_details() == crash.details)
+                    {
+                        input = std::move(candidate);
+                    }
+                    else
+                    {
+                        offset += chunk_size;
+                    }
+                }
+            }
+
+            return input;
+        }
+
+        void worker(fuzzing_context& context, const size_t worker_index)
         {
+            // The executer is created afterwards, its emulator state is then allocated on the local NUMA node
+            if (!context.processors.empty())
+            {
+                utils::cpu::pin_current_thread(context.processors[worker_index % context.processors.size()]);
+            }
+
             const auto executer = context.handler.make_executer();
 
+            const auto state = std::make_unique<worker_state>();
+            state->index = worker_index;
+
             while (!context.should_stop())
             {
-                perform_fuzzing_iteration(context, *executer);
+                // Minimizing new crashes takes priority, the workers share that work with each other
+                if (const auto crash = context.crashes.take_minimization_job())
+                {
+                    const auto input = minimize_input(context, *executer, *state, *crash);
+                    context.crashes.add(crash->details, input);
+                    continue;
+                }
+
+                perform_fuzzing_iteration(context, *executer, *state);
             }
         }
 
@@ -84,7 +368,7 @@ namespace fuzzer
 
                 for (size_t i = 0; i < concurrency; ++i)
                 {
-                    this->workers_.emplace_back([&context] { worker(context); });
+                    this->workers_.emplace_back([&context, i] { worker(context, i); });
                 }
             }
 
@@ -107,19 +391,93 @@ namespace fuzzer
 
     void run(fuzzing_handler& handler, const size_t concurrency)
     {
-        input_generator generator{};
-        fuzzing_context context{generator, handler};
-        worker_pool pool{context, concurrency};
+        fuzzing_settings settings{};
+        settings.concurrency = concurrency;
+
+        run(handler, settings);
+    }
+
+    void run(fuzzing_handler& handler, const fuzzing_settings& settings)
+    {
+        auto tokens = settings.dictionary_file.empty() ? dictionary{} : load_dictionary(settings.dictionary_file);
+        if (!tokens.empty())
+        {
+            printf("Loaded %zu dictionary tokens\n", tokens.size());
+        }
+
+        input_generator generator{settings.concurrency, create_corpus(settings), std::move(tokens), settings.schedule};
+        queue_seed_inputs(generator, settings);
+        crash_store crashes{settings.crash_directory};
+        fuzzing_context context{generator, handler, crashes, settings.concurrency, settings};
+
+        std::unique_ptr<corpus_sync> sync{};
+        if (settings.sync_port || !settings.sync_peers.empty())
+        {
+            sync = std::make_unique<corpus_sync>(settings.sync_port, settings.sync_peers, [&](synced_input& input) {
+                context.import_input(input); //
+            });
+
+            context.sync = sync.get();
+            printf("Syncing on port %u with %zu peers\n", static_cast<unsigned>(settings.sync_port),
+                   settings.sync_peers.size());
+        }
+
+        worker_pool pool{context, settings.concurrency};
+
+        const auto start_time = std::chrono::steady_clock::now();
+        uint64_t total_executions = 0;
 
         while (!context.should_stop())
         {
             std::this_thread::sleep_for(std::chrono::seconds{1});
 
-            const auto executions = context.executions.exchange(0);
+            const auto worker_executions = context.collect_executions();
+            const auto executions = std::accumulate(worker_executions.begin(), worker_executions.end(), uint64_t{0});
+            total_executions += executions;
+
             const auto highest_scorer = context.generator.get_highest_scorer();
             const auto avg_score = context.generator.get_average_score();
-            printf("Executions/s: %" PRIu64 " - Score: %" PRIx64 " - Avg: %.3f\n", executions, highest_scorer.score,
-                   avg_score);
+
+            const auto timeouts = context.get_timeouts();
+            const auto total_timeouts = std::accumulate(timeouts.begin(), timeouts.end(), uint64_t{0});
+            const auto hanging_workers = std::ranges::count_if(timeouts, [](const uint64_t t) { return t > 0; });
+
+            const auto synced = sync ? sync->get_received() : 0;
+
+            printf("Executions/s: %" PRIu64 " - Score: %" PRIx64 " - Avg: %.3f - Timeouts: %" PRIu64
+                   " (%zu workers) - Crashes: %zu - Synced: %" PRIu64 "\n",
+                   executions, highest_scorer.score, avg_score, total_timeouts, static_cast<size_t>(hanging_workers),
+                   crashes.size(), synced);
+
+            if (settings.stats_file.empty())
+            {
+                continue;
+            }
+
+            const auto uptime = std::chrono::steady_clock::now() - start_time;
+
+            fuzzing_stats stats{};
+            stats.uptime = std::chrono::duration_cast<std::chrono::seconds>(uptime);
+            stats.worker_executions = worker_executions;
+            stats.worker_timeouts = timeouts;
+            stats.total_executions = total_executions;
+            stats.corpus_size = generator.get_corpus_size();
+            stats.covered_edges = context.count_covered_edges();
+            stats.crashes = crashes.size();
+            stats.synced_inputs = synced;
+            stats.restore_latency = context.get_restore_latency();
+            stats.resident_memory = get_resident_memory();
+
+            write_stats_file(settings.stats_file, stats);
+        }
+
+        const auto timeouts = context.get_timeouts();
+        for (size_t i = 0; i < timeouts.size(); ++i)
+        {
+            if (timeouts[i])
+            {
+                printf("Worker %zu: %" PRIu64 " timeouts\n", i, timeouts[i]);
+            }
         }
     }
 }
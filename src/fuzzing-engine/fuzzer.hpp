@@ -2,25 +2,60 @@
 #include <span>
 #include <memory>
 #include <thread>
+#include <chrono>
+#include <string>
+#include <vector>
 #include <cstdint>
 #include <functional>
+#include <filesystem>
+
+#include "coverage_map.hpp"
+#include "crash_store.hpp"
+#include "comparison_log.hpp"
+#include "input_generator.hpp"
 
 namespace fuzzer
 {
-    using coverage_functor = void(uint64_t address);
-
     enum class execution_result
     {
         success,
         error,
+        timeout,
+    };
+
+    // Zero means unlimited. Executions exceeding either limit are stopped and reported as timeout.
+    struct execution_budget
+    {
+        uint64_t instructions{};
+        std::chrono::milliseconds time{};
     };
 
     struct executer
     {
         virtual ~executer() = default;
 
-        virtual execution_result execute(std::span<const uint8_t> data,
-                                         const std::function<coverage_functor>& coverage_handler) = 0;
+        virtual execution_result execute(std::span<const uint8_t> data, coverage_map& coverage,
+                                         const execution_budget& budget) = 0;
+
+        // Time the last execution spent restoring the initial state, zero if unknown
+        virtual std::chrono::nanoseconds get_restore_time() const
+        {
+            return {};
+        }
+
+        // Details of the last execution that returned error
+        virtual crash_details get_crash_details() const
+        {
+            return {};
+        }
+
+        // Executes the input once more and records the operands of its comparisons
+        virtual std::vector<comparison_entry> trace_comparisons(std::span<const uint8_t> /*data*/,
+                                                                coverage_map& /*coverage*/,
+                                                                const execution_budget& /*budget*/)
+        {
+            return {};
+        }
     };
 
     struct fuzzing_handler
@@ -35,5 +70,26 @@ namespace fuzzer
         }
     };
 
+    struct fuzzing_settings
+    {
+        size_t concurrency{std::thread::hardware_concurrency()};
+        std::filesystem::path corpus_file{};
+        std::filesystem::path seed_directory{};
+        std::filesystem::path crash_directory{};
+        std::filesystem::path dictionary_file{};
+        std::filesystem::path stats_file{};
+        bool trace_comparisons{false};
+        power_schedule schedule{power_schedule::fast};
+
+        // Every worker runs on its own processor, spread over the NUMA nodes
+        bool pin_workers{false};
+        execution_budget budget{};
+
+        // Inputs with new coverage are exchanged with the peers ("host:port") if a port or peers are given
+        uint16_t sync_port{};
+        std::vector<std::string> sync_peers{};
+    };
+
+    void run(fuzzing_handler& handler, const fuzzing_settings& settings);
     void run(fuzzing_handler& handler, size_t concurrency = std::thread::hardware_concurrency());
 }
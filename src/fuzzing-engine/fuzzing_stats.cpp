@@ -0,0 +1,194 @@
+#include "fuzzing_stats.hpp"
+
+#include <bit>
+#include <algorithm>
+#include <string>
+#include <cstdio>
+#include <fstream>
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#include <Psapi.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace fuzzer
+{
+    namespace
+    {
+        constexpr uint64_t FIRST_BUCKET_NS = 1000;
+
+        size_t get_bucket_index(const uint64_t nanoseconds)
+        {
+            if (nanoseconds <= FIRST_BUCKET_NS)
+            {
+                return 0;
+            }
+
+            const auto index = static_cast<size_t>(std::bit_width((nanoseconds - 1) / FIRST_BUCKET_NS));
+            return std::min(index, LATENCY_BUCKETS - 1);
+        }
+
+        void append_metric(std::string& buffer, const char* name, const char* type)
+        {
+            buffer.append("# TYPE ");
+            buffer.append(name);
+            buffer.push_back(' ');
+            buffer.append(type);
+            buffer.push_back('\n');
+        }
+
+        void append_value(std::string& buffer, const char* name, const uint64_t value, const std::string& labels = {})
+        {
+            buffer.append(name);
+
+            if (!labels.empty())
+            {
+                buffer.push_back('{');
+                buffer.append(labels);
+                buffer.push_back('}');
+            }
+
+            buffer.push_back(' ');
+            buffer.append(std::to_string(value));
+            buffer.push_back('\n');
+        }
+
+        void append_gauge(std::string& buffer, const char* name, const uint64_t value)
+        {
+            append_metric(buffer, name, "gauge");
+            append_value(buffer, name, value);
+        }
+
+        void append_worker_values(std::string& buffer, const char* name, const char* type,
+                                  const std::vector<uint64_t>& values)
+        {
+            append_metric(buffer, name, type);
+
+            for (size_t i = 0; i < values.size(); ++i)
+            {
+                append_value(buffer, name, values[i], "worker=\"" + std::to_string(i) + "\"");
+            }
+        }
+
+        void append_histogram(std::string& buffer, const std::string& name, const latency_snapshot& snapshot)
+        {
+            append_metric(buffer, name.c_str(), "histogram");
+
+            const auto bucket_name = name + "_bucket";
+            uint64_t count = 0;
+
+            for (size_t i = 0; i < snapshot.buckets.size(); ++i)
+            {
+                count += snapshot.buckets[i];
+
+                std::string bound = "+Inf";
+                if (i + 1 < snapshot.buckets.size())
+                {
+                    char value[32]{};
+                    (void)snprintf(value, sizeof(value), "%g", static_cast<double>(FIRST_BUCKET_NS << i) / 1e9);
+                    bound = value;
+                }
+
+                append_value(buffer, bucket_name.c_str(), count, "le=\"" + bound + "\"");
+            }
+
+            char sum[32]{};
+            (void)snprintf(sum, sizeof(sum), "%.9f", static_cast<double>(snapshot.sum.count()) / 1e9);
+
+            buffer.append(name + "_sum " + sum + "\n");
+            append_value(buffer, (name + "_count").c_str(), count);
+        }
+    }
+
+    void latency_histogram::record(const std::chrono::nanoseconds latency)
+    {
+        const auto nanoseconds = static_cast<uint64_t>(std::max(latency.count(), std::chrono::nanoseconds::rep{0}));
+
+        this->buckets_[get_bucket_index(nanoseconds)].fetch_add(1, std::memory_order_relaxed);
+        this->sum_.fetch_add(nanoseconds, std::memory_order_relaxed);
+    }
+
+    void latency_histogram::add_to(latency_snapshot& snapshot) const
+    {
+        for (size_t i = 0; i < this->buckets_.size(); ++i)
+        {
+            snapshot.buckets[i] += this->buckets_[i].load(std::memory_order_relaxed);
+        }
+
+        snapshot.sum += std::chrono::nanoseconds{this->sum_.load(std::memory_order_relaxed)};
+    }
+
+    uint64_t get_resident_memory()
+    {
+#ifdef _WIN32
+        PROCESS_MEMORY_COUNTERS counters{};
+        if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        {
+            return 0;
+        }
+
+        return counters.WorkingSetSize;
+#else
+        FILE* statm = fopen("/proc/self/statm", "r");
+        if (!statm)
+        {
+            return 0;
+        }
+
+        unsigned long long size{};
+        unsigned long long resident{};
+        const auto fields = fscanf(statm, "%llu %llu", &size, &resident);
+        (void)fclose(statm);
+
+        if (fields != 2)
+        {
+            return 0;
+        }
+
+        return resident * static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+#endif
+    }
+
+    void write_stats_file(const std::filesystem::path& file, const fuzzing_stats& stats)
+    {
+        std::string buffer{};
+
+        append_gauge(buffer, "fuzzer_uptime_seconds", static_cast<uint64_t>(stats.uptime.count()));
+
+        append_metric(buffer, "fuzzer_executions_total", "counter");
+        append_value(buffer, "fuzzer_executions_total", stats.total_executions);
+
+        append_worker_values(buffer, "fuzzer_worker_executions_per_second", "gauge", stats.worker_executions);
+        append_worker_values(buffer, "fuzzer_worker_timeouts_total", "counter", stats.worker_timeouts);
+
+        append_gauge(buffer, "fuzzer_corpus_inputs", stats.corpus_size);
+        append_gauge(buffer, "fuzzer_covered_edges", stats.covered_edges);
+        append_gauge(buffer, "fuzzer_unique_crashes", stats.crashes);
+
+        append_metric(buffer, "fuzzer_synced_inputs_total", "counter");
+        append_value(buffer, "fuzzer_synced_inputs_total", stats.synced_inputs);
+
+        append_histogram(buffer, "fuzzer_restore_latency_seconds", stats.restore_latency);
+        append_gauge(buffer, "fuzzer_resident_memory_bytes", stats.resident_memory);
+
+        auto temporary_file = file;
+        temporary_file += ".tmp";
+
+        {
+            std::ofstream stream(temporary_file, std::ios::binary | std::ios::trunc);
+            if (!stream)
+            {
+                return;
+            }
+
+            stream.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        }
+
+        std::error_code ec{};
+        std::filesystem::rename(temporary_file, file, ec);
+    }
+}
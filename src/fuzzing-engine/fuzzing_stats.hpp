@@ -0,0 +1,50 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <vector>
+#include <cstdint>
+#include <filesystem>
+
+namespace fuzzer
+{
+    // Power of two buckets starting at 1 µs, the last one takes everything above
+    constexpr size_t LATENCY_BUCKETS = 20;
+
+    struct latency_snapshot
+    {
+        std::array<uint64_t, LATENCY_BUCKETS> buckets{};
+        std::chrono::nanoseconds sum{};
+    };
+
+    class latency_histogram
+    {
+      public:
+        void record(std::chrono::nanoseconds latency);
+        void add_to(latency_snapshot& snapshot) const;
+
+      private:
+        std::array<std::atomic_uint64_t, LATENCY_BUCKETS> buckets_{};
+        std::atomic_uint64_t sum_{0};
+    };
+
+    struct fuzzing_stats
+    {
+        std::chrono::seconds uptime{};
+        std::vector<uint64_t> worker_executions{};
+        std::vector<uint64_t> worker_timeouts{};
+        uint64_t total_executions{};
+        size_t corpus_size{};
+        size_t covered_edges{};
+        size_t crashes{};
+        uint64_t synced_inputs{};
+        latency_snapshot restore_latency{};
+        uint64_t resident_memory{};
+    };
+
+    uint64_t get_resident_memory();
+
+    // Writes the stats in the Prometheus text format. The file is replaced at once, readers never see partial
+    // content. Worker executions are the ones of the last second.
+    void write_stats_file(const std::filesystem::path& file, const fuzzing_stats& stats);
+}
@@ -1,121 +1,443 @@
 #include "input_generator.hpp"
 
+#include <cmath>
 #include <cassert>
+#include <numeric>
+#include <algorithm>
 
 namespace fuzzer
 {
     namespace
     {
         constexpr size_t MAX_TOP_SCORER = 20;
+        constexpr size_t CORPUS_PICK_RATE = 4;
+        constexpr size_t MERGE_INTERVAL = 1000;
+        constexpr size_t MAX_SHARED_INPUTS = 64;
+        constexpr size_t MAX_QUEUED_INPUTS = 4096;
+        constexpr size_t MAX_TRACKED_PATHS = 1 << 20;
 
-        void mutate_input(random_generator& rng, std::vector<uint8_t>& input)
+        constexpr double MIN_SCHEDULE_FACTOR = 1.0 / 32;
+        constexpr double MAX_SCHEDULE_FACTOR = 32.0;
+
+        // Relative to the average like the perf score of AFL
+        double get_time_factor(const double time)
         {
-            if (input.empty() || rng.get(3) == 0)
+            if (time > 10.0)
             {
-                const auto new_bytes = rng.get_geometric<size_t>() + 1;
-                input.resize(input.size() + new_bytes);
+                return 0.1;
             }
-            else if (rng.get(10) == 0)
+
+            if (time > 4.0)
             {
-                const auto remove_bytes = rng.get_geometric<size_t>() % input.size();
-                input.resize(input.size() - remove_bytes);
+                return 0.25;
             }
 
-            const auto mutations = (rng.get_geometric<size_t>() + 1) % input.size();
+            if (time > 2.0)
+            {
+                return 0.5;
+            }
 
-            for (size_t i = 0; i < mutations; ++i)
+            if (time > 1.33)
             {
-                const auto index = rng.get<size_t>(input.size());
-                input[index] = rng.get<uint8_t>();
+                return 0.75;
             }
+
+            if (time < 0.25)
+            {
+                return 3.0;
+            }
+
+            if (time < 0.33)
+            {
+                return 2.0;
+            }
+
+            return time < 0.5 ? 1.5 : 1.0;
+        }
+
+        double get_score_factor(const double score)
+        {
+            if (score > 3.3)
+            {
+                return 3.0;
+            }
+
+            if (score > 2.0)
+            {
+                return 2.0;
+            }
+
+            if (score > 1.33)
+            {
+                return 1.5;
+            }
+
+            if (score < 0.33)
+            {
+                return 0.25;
+            }
+
+            if (score < 0.5)
+            {
+                return 0.5;
+            }
+
+            return score < 0.75 ? 0.75 : 1.0;
+        }
+
+        size_t pick_weighted(random_generator& rng, const std::span<const double> weights)
+        {
+            const auto total = std::accumulate(weights.begin(), weights.end(), 0.0);
+            auto value = static_cast<double>(rng.next() >> 11) * 0x1.0p-53 * total;
+
+            for (size_t i = 0; i < weights.size(); ++i)
+            {
+                if (value < weights[i])
+                {
+                    return i;
+                }
+
+                value -= weights[i];
+            }
+
+            return weights.size() - 1;
         }
     }
 
-    input_generator::input_generator() = default;
+    input_generator::input_generator(const size_t workers, std::unique_ptr<corpus> store, dictionary tokens,
+                                     const power_schedule schedule)
+        : corpus_(std::move(store)),
+          mutator_(std::move(tokens)),
+          schedule_(schedule)
+    {
+        this->shards_.reserve(std::max(workers, static_cast<size_t>(1)));
+
+        for (size_t i = 0; i < this->shards_.capacity(); ++i)
+        {
+            this->shards_.emplace_back(std::make_unique<worker_shard>());
+        }
+
+        if (!this->corpus_)
+        {
+            return;
+        }
+
+        for (auto& e : this->corpus_->get_top_entries(MAX_TOP_SCORER))
+        {
+            input_entry entry{};
+            entry.data = std::move(e.data);
+            entry.score = e.score;
+            entry.signature = e.signature;
 
-    std::vector<uint8_t> input_generator::generate_next_input()
+            for (const auto& shard : this->shards_)
+            {
+                this->store_input_entry(*shard, entry);
+            }
+
+            this->shared_inputs_.emplace_back(std::move(entry));
+        }
+    }
+
+    std::vector<uint8_t> input_generator::generate_next_input(worker_shard& shard)
     {
         std::vector<uint8_t> input{};
-        std::unique_lock lock{this->mutex_};
+        std::unique_lock lock{shard.mutex_};
+
+        if (!shard.queued_inputs_.empty())
+        {
+            input = std::move(shard.queued_inputs_.front());
+            shard.queued_inputs_.pop_front();
+            return input;
+        }
+
+        const auto corpus_size = this->corpus_ ? this->corpus_->size() : 0;
 
-        if (!this->top_scorer_.empty())
+        if (corpus_size > 0 && (shard.top_scorer_.empty() || shard.rng.get(CORPUS_PICK_RATE) == 0))
         {
-            const auto index = this->rng.get<size_t>() % this->top_scorer_.size();
-            input = this->top_scorer_[index].data;
+            input = this->corpus_->get(shard.rng.get<size_t>() % corpus_size).data;
         }
+        else if (!shard.top_scorer_.empty())
+        {
+            const auto energies = this->get_energies(shard);
+            auto& entry = shard.top_scorer_[pick_weighted(shard.rng, energies)];
 
-        mutate_input(this->rng, input);
+            ++entry.fuzz_count;
+            input = entry.data;
+        }
+
+        std::span<const uint8_t> splice_source{};
+        if (!shard.top_scorer_.empty())
+        {
+            splice_source = shard.top_scorer_[shard.rng.get<size_t>() % shard.top_scorer_.size()].data;
+        }
+
+        this->mutator_.mutate(shard.rng, input, splice_source);
 
         return input;
     }
 
-    void input_generator::access_input(const std::function<input_handler>& handler)
+    void input_generator::access_input(const size_t worker, const std::function<input_handler>& handler)
     {
-        auto next_input = this->generate_next_input();
-        const auto score = handler(next_input);
+        auto& shard = *this->shards_[worker % this->shards_.size()];
+
+        auto next_input = this->generate_next_input(shard);
+        const auto feedback = handler(next_input);
+
+        {
+            std::unique_lock lock{shard.mutex_};
+            this->record_path(shard, feedback.signature);
+        }
 
         input_entry e{};
         e.data = std::move(next_input);
-        e.score = score;
+        e.score = feedback.score;
+        e.signature = feedback.signature;
+        e.execution_time = feedback.execution_time;
+
+        this->store_input_entry(shard, std::move(e), feedback.new_coverage);
 
-        this->store_input_entry(std::move(e));
+        if (++shard.iterations_since_merge >= MERGE_INTERVAL)
+        {
+            shard.iterations_since_merge = 0;
+            this->merge_shared_inputs(shard);
+        }
+    }
+
+    void input_generator::queue_inputs(const size_t worker, std::vector<std::vector<uint8_t>> inputs)
+    {
+        auto& shard = *this->shards_[worker % this->shards_.size()];
+        std::unique_lock lock{shard.mutex_};
+
+        for (auto& input : inputs)
+        {
+            if (shard.queued_inputs_.size() >= MAX_QUEUED_INPUTS)
+            {
+                break;
+            }
+
+            shard.queued_inputs_.push_back(std::move(input));
+        }
+    }
+
+    void input_generator::import_input(input_entry entry)
+    {
+        if (this->corpus_)
+        {
+            this->corpus_->add(entry.data, entry.score, entry.signature);
+        }
+
+        std::unique_lock lock{this->shared_mutex_};
+        this->add_shared_input(std::move(entry));
     }
 
     input_entry input_generator::get_highest_scorer()
     {
-        std::unique_lock lock{this->mutex_};
-        return this->highest_scorer_;
+        input_entry highest_scorer{};
+
+        for (const auto& shard : this->shards_)
+        {
+            std::unique_lock lock{shard->mutex_};
+
+            if (shard->highest_scorer_.score > highest_scorer.score)
+            {
+                highest_scorer = shard->highest_scorer_;
+            }
+        }
+
+        return highest_scorer;
     }
 
     double input_generator::get_average_score()
     {
-        std::unique_lock lock{this->mutex_};
-
         double score{0.0};
-        for (const auto& e : this->top_scorer_)
+        size_t entries{0};
+
+        for (const auto& shard : this->shards_)
         {
-            score += static_cast<double>(e.score);
+            std::unique_lock lock{shard->mutex_};
+
+            for (const auto& e : shard->top_scorer_)
+            {
+                score += static_cast<double>(e.score);
+            }
+
+            entries += shard->top_scorer_.size();
         }
 
-        return score / static_cast<double>(this->top_scorer_.size());
+        return score / static_cast<double>(entries);
+    }
+
+    size_t input_generator::get_corpus_size() const
+    {
+        return this->corpus_ ? this->corpus_->size() : 0;
     }
 
-    void input_generator::store_input_entry(input_entry entry)
+    void input_generator::merge_shared_inputs(worker_shard& shard)
     {
-        std::unique_lock lock{this->mutex_};
+        input_entry best_entry{};
+        input_entry shared_entry{};
 
-        if (entry.score < this->lowest_score && this->rng.get(40) != 0)
         {
+            std::unique_lock lock{shard.mutex_};
+            best_entry = shard.highest_scorer_;
+        }
+
+        {
+            std::unique_lock lock{this->shared_mutex_};
+            this->add_shared_input(std::move(best_entry));
+            shared_entry = this->shared_inputs_[shard.rng.get<size_t>() % this->shared_inputs_.size()];
+        }
+
+        this->store_input_entry(shard, std::move(shared_entry));
+    }
+
+    void input_generator::add_shared_input(input_entry entry)
+    {
+        if (this->shared_inputs_.size() < MAX_SHARED_INPUTS)
+        {
+            this->shared_inputs_.push_back(std::move(entry));
             return;
         }
 
-        if (entry.score > this->highest_scorer_.score)
+        auto lowest = std::ranges::min_element(this->shared_inputs_, {}, &input_entry::score);
+        if (lowest->score < entry.score)
+        {
+            *lowest = std::move(entry);
+        }
+    }
+
+    void input_generator::store_input_entry(worker_shard& shard, input_entry entry, const bool persist)
+    {
+        std::unique_lock lock{shard.mutex_};
+
+        if (persist && this->corpus_ && shard.known_signatures_.insert(entry.signature).second)
+        {
+            this->corpus_->add(entry.data, entry.score, entry.signature);
+        }
+
+        if (entry.score > shard.highest_scorer_.score)
         {
-            this->highest_scorer_ = entry;
+            shard.highest_scorer_ = entry;
         }
 
-        if (this->top_scorer_.size() < MAX_TOP_SCORER)
+        if (shard.top_scorer_.size() < MAX_TOP_SCORER)
         {
-            this->top_scorer_.emplace_back(std::move(entry));
+            shard.top_scorer_.emplace_back(std::move(entry));
             return;
         }
 
-        const auto insert_at_random = this->rng.get(10) == 0;
-        const auto index =
-            insert_at_random ? (this->rng.get<size_t>() % this->top_scorer_.size()) : this->lowest_scorer;
+        // The input with the least energy makes room, unless the new one has even less
+        const auto energies = this->get_energies(shard);
+        const auto lowest = static_cast<size_t>(std::ranges::min_element(energies) - energies.begin());
 
-        this->top_scorer_[index] = std::move(entry);
+        const auto average_score = static_cast<double>(this->get_average_score(shard));
+        const auto energy = this->get_energy(shard, entry, average_score, this->get_average_time(shard));
 
-        this->lowest_score = this->top_scorer_[0].score;
-        this->lowest_scorer = 0;
+        if (energy > energies[lowest] || shard.rng.get(40) == 0)
+        {
+            shard.top_scorer_[lowest] = std::move(entry);
+        }
+    }
+
+    std::vector<double> input_generator::get_energies(const worker_shard& shard) const
+    {
+        const auto average_score = static_cast<double>(this->get_average_score(shard));
+        const auto average_time = this->get_average_time(shard);
 
-        for (size_t i = 1; i < this->top_scorer_.size(); ++i)
+        std::vector<double> energies{};
+        energies.reserve(shard.top_scorer_.size());
+
+        for (const auto& entry : shard.top_scorer_)
         {
-            if (this->top_scorer_[i].score < this->lowest_score)
+            energies.push_back(this->get_energy(shard, entry, average_score, average_time));
+        }
+
+        return energies;
+    }
+
+    double input_generator::get_energy(const worker_shard& shard, const input_entry& entry,
+                                       const double average_score, const double average_time) const
+    {
+        auto energy = 1.0;
+
+        if (average_time > 0.0 && entry.execution_time.count() > 0)
+        {
+            energy *= get_time_factor(static_cast<double>(entry.execution_time.count()) / average_time);
+        }
+
+        if (average_score > 0.0)
+        {
+            energy *= get_score_factor(static_cast<double>(entry.score) / average_score);
+        }
+
+        if (this->schedule_ == power_schedule::explore || shard.path_hits_.empty())
+        {
+            return energy;
+        }
+
+        const auto path = shard.path_hits_.find(entry.signature);
+        const auto hits = static_cast<double>(path == shard.path_hits_.end() ? 1 : path->second);
+        const auto average_hits =
+            static_cast<double>(shard.total_path_hits_) / static_cast<double>(shard.path_hits_.size());
+
+        auto factor = average_hits / hits;
+
+        if (this->schedule_ == power_schedule::fast)
+        {
+            factor /= std::log2(2.0 + entry.fuzz_count);
+        }
+
+        return energy * std::clamp(factor, MIN_SCHEDULE_FACTOR, MAX_SCHEDULE_FACTOR);
+    }
+
+    double input_generator::get_average_score(const worker_shard& shard)
+    {
+        if (shard.top_scorer_.empty())
+        {
+            return 0.0;
+        }
+
+        double score{0.0};
+        for (const auto& entry : shard.top_scorer_)
+        {
+            score += static_cast<double>(entry.score);
+        }
+
+        return score / static_cast<double>(shard.top_scorer_.size());
+    }
+
+    double input_generator::get_average_time(const worker_shard& shard)
+    {
+        double time{0.0};
+        size_t entries{0};
+
+        for (const auto& entry : shard.top_scorer_)
+        {
+            if (entry.execution_time.count() > 0)
             {
-                this->lowest_score = this->top_scorer_[i].score;
-                this->lowest_scorer = i;
+                time += static_cast<double>(entry.execution_time.count());
+                ++entries;
             }
         }
+
+        return entries ? time / static_cast<double>(entries) : 0.0;
+    }
+
+    void input_generator::record_path(worker_shard& shard, const uint64_t signature)
+    {
+        // Timeouts have no signature
+        if (!signature)
+        {
+            return;
+        }
+
+        if (shard.path_hits_.size() >= MAX_TRACKED_PATHS)
+        {
+            shard.path_hits_.clear();
+            shard.total_path_hits_ = 0;
+        }
+
+        ++shard.path_hits_[signature];
+        ++shard.total_path_hits_;
     }
 }
@@ -1,44 +1,112 @@
 #pragma once
 #include <mutex>
+#include <deque>
 #include <vector>
+#include <chrono>
+#include <memory>
 #include <optional>
+#include <unordered_map>
+#include <unordered_set>
 #include <functional>
 
+#include "corpus.hpp"
+#include "mutator.hpp"
 #include "random_generator.hpp"
 
 namespace fuzzer
 {
     using input_score = uint64_t;
-    using input_handler = input_score(std::span<const uint8_t>);
+
+    // How the energy of the stored inputs is assigned, which decides how often they are mutated.
+    // All schedules favor fast inputs with high scores. On top of that, fast favors inputs that were picked rarely
+    // and whose path is rarely executed, rare only looks at the path frequency and explore adds nothing.
+    enum class power_schedule
+    {
+        explore,
+        fast,
+        rare,
+    };
+
+    struct input_feedback
+    {
+        input_score score{};
+        uint64_t signature{};
+        bool new_coverage{};
+        std::chrono::nanoseconds execution_time{};
+    };
+
+    using input_handler = input_feedback(std::span<const uint8_t>);
 
     struct input_entry
     {
         std::vector<uint8_t> data{};
         input_score score{};
+        uint64_t signature{};
+        // Zero if unknown, e.g. for inputs from the corpus or other nodes
+        std::chrono::nanoseconds execution_time{};
+        // Times the input was picked for mutation
+        uint32_t fuzz_count{};
     };
 
     class input_generator
     {
       public:
-        input_generator();
+        input_generator(size_t workers = 1, std::unique_ptr<corpus> store = {}, dictionary tokens = {},
+                        power_schedule schedule = power_schedule::fast);
+
+        void access_input(size_t worker, const std::function<input_handler>& handler);
 
-        void access_input(const std::function<input_handler>& handler);
+        // Queued inputs are handed to the worker unmutated, before any generated ones
+        void queue_inputs(size_t worker, std::vector<std::vector<uint8_t>> inputs);
+
+        // Adds an input found by another node to the corpus and the inputs shared between workers
+        void import_input(input_entry entry);
 
         input_entry get_highest_scorer();
         double get_average_score();
+        size_t get_corpus_size() const;
 
       private:
-        std::mutex mutex_{};
-        random_generator rng{};
+        // Each worker owns one shard, so the shard lock is only contended by the statistics queries
+        struct alignas(64) worker_shard
+        {
+            std::mutex mutex_{};
+            random_generator rng{};
+
+            std::vector<input_entry> top_scorer_{};
+
+            // Executions per coverage signature
+            std::unordered_map<uint64_t, uint64_t> path_hits_{};
+            uint64_t total_path_hits_{0};
+
+            input_entry highest_scorer_{};
+
+            size_t iterations_since_merge{0};
+            std::unordered_set<uint64_t> known_signatures_{};
+
+            std::deque<std::vector<uint8_t>> queued_inputs_{};
+        };
+
+        std::vector<std::unique_ptr<worker_shard>> shards_{};
+
+        std::mutex shared_mutex_{};
+        std::vector<input_entry> shared_inputs_{};
 
-        std::vector<input_entry> top_scorer_{};
-        input_score lowest_score{0};
-        size_t lowest_scorer{0};
+        std::unique_ptr<corpus> corpus_{};
+        mutator mutator_{};
+        power_schedule schedule_{power_schedule::fast};
 
-        input_entry highest_scorer_{};
+        std::vector<uint8_t> generate_next_input(worker_shard& shard);
 
-        std::vector<uint8_t> generate_next_input();
+        std::vector<double> get_energies(const worker_shard& shard) const;
+        double get_energy(const worker_shard& shard, const input_entry& entry, double average_score,
+                          double average_time) const;
+        static double get_average_score(const worker_shard& shard);
+        static double get_average_time(const worker_shard& shard);
+        void record_path(worker_shard& shard, uint64_t signature);
 
-        void store_input_entry(input_entry entry);
+        void store_input_entry(worker_shard& shard, input_entry entry, bool persist = false);
+        void merge_shared_inputs(worker_shard& shard);
+        void add_shared_input(input_entry entry);
     };
 }
@@ -0,0 +1,364 @@
+#include "mutator.hpp"
+
+#include <array>
+#include <string>
+#include <fstream>
+#include <stdexcept>
+#include <algorithm>
+
+namespace fuzzer
+{
+    namespace
+    {
+        constexpr size_t MAX_INPUT_SIZE = 0x100000;
+        constexpr size_t MAX_STACKING_SHIFT = 7;
+        constexpr int64_t MAX_ARITHMETIC = 35;
+
+        constexpr std::array<int8_t, 9> INTERESTING_8 = {-128, -1, 0, 1, 16, 32, 64, 100, 127};
+
+        constexpr std::array<int16_t, 10> INTERESTING_16 = {
+            -32768, -129, 128, 255, 256, 512, 1000, 1024, 4096, 32767,
+        };
+
+        constexpr std::array<int32_t, 8> INTERESTING_32 = {
+            INT32_MIN, -100663046, -32769, 32768, 65535, 65536, 100663045, INT32_MAX,
+        };
+
+        enum class mutation : uint8_t
+        {
+            flip_bit,
+            random_byte,
+            interesting_8,
+            interesting_16,
+            interesting_32,
+            arithmetic_8,
+            arithmetic_16,
+            arithmetic_32,
+            delete_block,
+            clone_block,
+            insert_random_block,
+            overwrite_block,
+            insert_token,
+            overwrite_token,
+            splice,
+            count,
+        };
+
+        template <typename T>
+        T byte_swap(const T value)
+        {
+            T result{};
+
+            for (size_t i = 0; i < sizeof(T); ++i)
+            {
+                result = static_cast<T>((result << 8) | ((value >> (i * 8)) & 0xFF));
+            }
+
+            return result;
+        }
+
+        // Writes the value at a random position, in random endianness
+        template <typename T>
+        void write_value(random_generator& rng, std::vector<uint8_t>& input, T value)
+        {
+            if (input.size() < sizeof(T))
+            {
+                return;
+            }
+
+            if (rng.get<bool>())
+            {
+                value = byte_swap(value);
+            }
+
+            const auto offset = rng.get<size_t>(input.size() - sizeof(T) + 1);
+            memcpy(input.data() + offset, &value, sizeof(value));
+        }
+
+        template <typename T>
+        void add_value(random_generator& rng, std::vector<uint8_t>& input)
+        {
+            if (input.size() < sizeof(T))
+            {
+                return;
+            }
+
+            const auto offset = rng.get<size_t>(input.size() - sizeof(T) + 1);
+            const auto big_endian = rng.get<bool>();
+
+            T value{};
+            memcpy(&value, input.data() + offset, sizeof(value));
+
+            if (big_endian)
+            {
+                value = byte_swap(value);
+            }
+
+            const auto delta = static_cast<T>(rng.get<uint64_t>(MAX_ARITHMETIC) + 1);
+            value = rng.get<bool>() ? static_cast<T>(value + delta) : static_cast<T>(value - delta);
+
+            if (big_endian)
+            {
+                value = byte_swap(value);
+            }
+
+            memcpy(input.data() + offset, &value, sizeof(value));
+        }
+
+        template <typename T, size_t N>
+        void write_interesting(random_generator& rng, std::vector<uint8_t>& input, const std::array<T, N>& values)
+        {
+            using unsigned_type = std::make_unsigned_t<T>;
+            write_value(rng, input, static_cast<unsigned_type>(values[rng.get<size_t>(N)]));
+        }
+
+        // Block lengths favour small blocks, like AFL's havoc stage
+        size_t choose_block_length(random_generator& rng, const size_t limit)
+        {
+            if (limit == 0)
+            {
+                return 0;
+            }
+
+            const size_t max_lengths[] = {32, 128, 1500};
+            const auto max_length = std::min(limit, max_lengths[rng.get<size_t>(std::size(max_lengths))]);
+
+            return rng.get<size_t>(max_length) + 1;
+        }
+
+        void insert_bytes(std::vector<uint8_t>& input, const size_t offset, const std::span<const uint8_t> data)
+        {
+            if (input.size() + data.size() > MAX_INPUT_SIZE)
+            {
+                return;
+            }
+
+            input.insert(input.begin() + static_cast<ptrdiff_t>(offset), data.begin(), data.end());
+        }
+
+        uint8_t parse_hex_digit(const char c)
+        {
+            if (c >= '0' && c <= '9')
+            {
+                return static_cast<uint8_t>(c - '0');
+            }
+
+            if (c >= 'a' && c <= 'f')
+            {
+                return static_cast<uint8_t>(c - 'a' + 10);
+            }
+
+            if (c >= 'A' && c <= 'F')
+            {
+                return static_cast<uint8_t>(c - 'A' + 10);
+            }
+
+            throw std::runtime_error("Invalid hex digit in dictionary");
+        }
+
+        std::vector<uint8_t> parse_token(const std::string_view text)
+        {
+            std::vector<uint8_t> token{};
+
+            for (size_t i = 0; i < text.size(); ++i)
+            {
+                if (text[i] != '\\' || i + 1 >= text.size())
+                {
+                    token.push_back(static_cast<uint8_t>(text[i]));
+                    continue;
+                }
+
+                const auto escaped = text[++i];
+                if (escaped != 'x')
+                {
+                    token.push_back(static_cast<uint8_t>(escaped));
+                    continue;
+                }
+
+                if (i + 2 >= text.size())
+                {
+                    throw std::runtime_error("Truncated hex escape in dictionary");
+                }
+
+                const auto high = parse_hex_digit(text[i + 1]);
+                const auto low = parse_hex_digit(text[i + 2]);
+                token.push_back(static_cast<uint8_t>((high << 4) | low));
+                i += 2;
+            }
+
+            return token;
+        }
+    }
+
+    dictionary load_dictionary(const std::filesystem::path& file)
+    {
+        std::ifstream stream(file);
+        if (!stream)
+        {
+            throw std::runtime_error("Failed to open dictionary: " + file.string());
+        }
+
+        dictionary tokens{};
+        std::string line{};
+
+        while (std::getline(stream, line))
+        {
+            const auto start = line.find('"');
+            const auto end = line.rfind('"');
+
+            if (line.empty() || line.front() == '#' || start == std::string::npos || end <= start)
+            {
+                continue;
+            }
+
+            auto token = parse_token(std::string_view(line).substr(start + 1, end - start - 1));
+            if (!token.empty())
+            {
+                tokens.push_back(std::move(token));
+            }
+        }
+
+        return tokens;
+    }
+
+    mutator::mutator(dictionary tokens)
+        : tokens_(std::move(tokens))
+    {
+    }
+
+    void mutator::mutate(random_generator& rng, std::vector<uint8_t>& input,
+                         const std::span<const uint8_t> splice_source) const
+    {
+        if (input.empty())
+        {
+            input.resize(rng.get_geometric<size_t>() + 1);
+            rng.fill(input);
+        }
+
+        const auto stacking = static_cast<size_t>(1) << (rng.get<size_t>(MAX_STACKING_SHIFT) + 1);
+
+        for (size_t i = 0; i < stacking; ++i)
+        {
+            this->mutate_once(rng, input, splice_source);
+        }
+
+        if (input.empty())
+        {
+            input.push_back(rng.get<uint8_t>());
+        }
+    }
+
+    void mutator::mutate_once(random_generator& rng, std::vector<uint8_t>& input,
+                              const std::span<const uint8_t> splice_source) const
+    {
+        const auto type = static_cast<mutation>(rng.get<size_t>(static_cast<size_t>(mutation::count)));
+
+        switch (type)
+        {
+        case mutation::flip_bit:
+            if (!input.empty())
+            {
+                const auto bit = rng.get<size_t>(input.size() * 8);
+                input[bit / 8] ^= static_cast<uint8_t>(1 << (bit % 8));
+            }
+            break;
+        case mutation::random_byte:
+            if (!input.empty())
+            {
+                input[rng.get<size_t>(input.size())] ^= static_cast<uint8_t>(rng.get<uint8_t>(255) + 1);
+            }
+            break;
+        case mutation::interesting_8:
+            write_interesting(rng, input, INTERESTING_8);
+            break;
+        case mutation::interesting_16:
+            write_interesting(rng, input, INTERESTING_16);
+            break;
+        case mutation::interesting_32:
+            write_interesting(rng, input, INTERESTING_32);
+            break;
+        case mutation::arithmetic_8:
+            add_value<uint8_t>(rng, input);
+            break;
+        case mutation::arithmetic_16:
+            add_value<uint16_t>(rng, input);
+            break;
+        case mutation::arithmetic_32:
+            add_value<uint32_t>(rng, input);
+            break;
+        case mutation::delete_block:
+            if (input.size() > 1)
+            {
+                const auto length = choose_block_length(rng, input.size() - 1);
+                const auto offset = rng.get<size_t>(input.size() - length + 1);
+                input.erase(input.begin() + static_cast<ptrdiff_t>(offset),
+                            input.begin() + static_cast<ptrdiff_t>(offset + length));
+            }
+            break;
+        case mutation::clone_block:
+            if (!input.empty())
+            {
+                const auto length = choose_block_length(rng, input.size());
+                const auto source = rng.get<size_t>(input.size() - length + 1);
+                const std::vector block(input.begin() + static_cast<ptrdiff_t>(source),
+                                        input.begin() + static_cast<ptrdiff_t>(source + length));
+                insert_bytes(input, rng.get<size_t>(input.size() + 1), block);
+            }
+            break;
+        case mutation::insert_random_block: {
+            std::vector<uint8_t> block(choose_block_length(rng, 128));
+            if (rng.get<bool>())
+            {
+                rng.fill(block);
+            }
+            else
+            {
+                std::ranges::fill(block, rng.get<uint8_t>());
+            }
+
+            insert_bytes(input, rng.get<size_t>(input.size() + 1), block);
+            break;
+        }
+        case mutation::overwrite_block:
+            if (input.size() > 1)
+            {
+                const auto length = choose_block_length(rng, input.size() - 1);
+                const auto source = rng.get<size_t>(input.size() - length + 1);
+                const auto target = rng.get<size_t>(input.size() - length + 1);
+                memmove(input.data() + target, input.data() + source, length);
+            }
+            break;
+        case mutation::insert_token:
+        case mutation::overwrite_token: {
+            if (this->tokens_.empty())
+            {
+                break;
+            }
+
+            const auto& token = this->tokens_[rng.get<size_t>(this->tokens_.size())];
+
+            if (type == mutation::insert_token)
+            {
+                insert_bytes(input, rng.get<size_t>(input.size() + 1), token);
+            }
+            else if (input.size() >= token.size())
+            {
+                const auto offset = rng.get<size_t>(input.size() - token.size() + 1);
+                std::ranges::copy(token, input.begin() + static_cast<ptrdiff_t>(offset));
+            }
+            break;
+        }
+        case mutation::splice:
+            // Keeps a prefix of the input and continues with the tail of the other one
+            if (input.size() > 1 && splice_source.size() > 1)
+            {
+                const auto split = rng.get<size_t>(std::min(input.size(), splice_source.size()) - 1) + 1;
+                input.resize(split);
+                input.insert(input.end(), splice_source.begin() + static_cast<ptrdiff_t>(split), splice_source.end());
+            }
+            break;
+        case mutation::count:
+            break;
+        }
+    }
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include <span>
+#include <vector>
+#include <cstdint>
+#include <filesystem>
+
+#include "random_generator.hpp"
+
+namespace fuzzer
+{
+    using dictionary = std::vector<std::vector<uint8_t>>;
+
+    // Parses AFL style dictionaries, one quoted token per line with \xNN escapes
+    dictionary load_dictionary(const std::filesystem::path& file);
+
+    // Havoc style mutator, stacks a random number of bit flips, arithmetic changes, interesting values,
+    // block operations, dictionary tokens and splices on top of each other
+    class mutator
+    {
+      public:
+        mutator(dictionary tokens = {});
+
+        // The splice source is another interesting input, it may be empty
+        void mutate(random_generator& rng, std::vector<uint8_t>& input, std::span<const uint8_t> splice_source) const;
+
+      private:
+        dictionary tokens_{};
+
+        void mutate_once(random_generator& rng, std::vector<uint8_t>& input,
+                         std::span<const uint8_t> splice_source) const;
+    };
+}
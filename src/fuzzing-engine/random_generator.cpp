@@ -1,16 +1,34 @@
 #include "random_generator.hpp"
+#include <random>
 #include <cstring>
 
 namespace fuzzer
 {
+    namespace
+    {
+        uint64_t split_mix(uint64_t& state)
+        {
+            state += 0x9E3779B97F4A7C15;
+
+            auto value = state;
+            value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9;
+            value = (value ^ (value >> 27)) * 0x94D049BB133111EB;
+
+            return value ^ (value >> 31);
+        }
+    }
+
     random_generator::random_generator()
-        : rng_(std::random_device()())
+        : random_generator((static_cast<uint64_t>(std::random_device()()) << 32) | std::random_device()())
     {
     }
 
-    std::mt19937::result_type random_generator::generate_number()
+    random_generator::random_generator(uint64_t seed)
     {
-        return this->distribution_(this->rng_);
+        for (auto& value : this->state_)
+        {
+            value = split_mix(seed);
+        }
     }
 
     void random_generator::fill(void* data, const size_t size)
@@ -23,7 +41,7 @@ namespace fuzzer
         size_t i = 0;
         while (i < data.size())
         {
-            const auto number = this->generate_number();
+            const auto number = this->next();
 
             const auto remaining_data = data.size() - i;
             const auto data_to_fill = std::min(remaining_data, sizeof(number));
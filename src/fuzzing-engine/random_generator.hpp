@@ -1,15 +1,34 @@
 #pragma once
 #include <span>
-#include <random>
+#include <array>
+#include <bit>
 #include <cstdint>
 #include <cstring>
 
 namespace fuzzer
 {
+    // xoshiro256**, every call produces 64 random bits. Not suitable for anything security related.
     class random_generator
     {
       public:
         random_generator();
+        random_generator(uint64_t seed);
+
+        uint64_t next()
+        {
+            auto& s = this->state_;
+            const auto result = std::rotl(s[1] * 5, 7) * 9;
+            const auto t = s[1] << 17;
+
+            s[2] ^= s[0];
+            s[3] ^= s[1];
+            s[1] ^= s[2];
+            s[0] ^= s[3];
+            s[2] ^= t;
+            s[3] = std::rotl(s[3], 45);
+
+            return result;
+        }
 
         void fill(std::span<uint8_t> data);
         void fill(void* data, size_t size);
@@ -42,29 +61,31 @@ namespace fuzzer
             return (this->get<T>() % diff) + min;
         }
 
+        // Number of successful fair coin flips before the first failure
         template <typename T>
         T get_geometric()
         {
             T value{0};
 
-            while (this->get<bool>())
+            while (true)
             {
-                ++value;
-            }
+                const auto ones = std::countr_one(this->next());
+                value += static_cast<T>(ones);
 
-            return value;
+                if (ones < 64)
+                {
+                    return value;
+                }
+            }
         }
 
       private:
-        std::mt19937 rng_;
-        std::uniform_int_distribution<std::mt19937::result_type> distribution_{};
-
-        std::mt19937::result_type generate_number();
+        std::array<uint64_t, 4> state_{};
     };
 
     template <>
     inline bool random_generator::get<bool>()
     {
-        return (this->generate_number() & 1) != 0;
+        return (this->next() >> 63) != 0;
     }
 }
@@ -0,0 +1,304 @@
+#include <span>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <fstream>
+#include <iostream>
+#include <cinttypes>
+#include <stdexcept>
+#include <string_view>
+
+#include <memory_permission.hpp>
+#include <event_trace_format.hpp>
+#include <execution_trace_format.hpp>
+#include <utils/json.hpp>
+#include <utils/mapped_file.hpp>
+
+using namespace event_trace_format;
+
+namespace
+{
+    void append_string_field(std::string& buffer, const std::string_view name, const std::string_view value)
+    {
+        buffer.append(",\"");
+        buffer.append(name);
+        buffer.append("\":");
+        utils::json::append_string(buffer, value);
+    }
+
+    void append_number_field(std::string& buffer, const std::string_view name, const uint64_t value)
+    {
+        buffer.append(",\"");
+        buffer.append(name);
+        buffer.append("\":");
+        buffer.append(std::to_string(value));
+    }
+
+    void append_address_field(std::string& buffer, const std::string_view name, const uint64_t value)
+    {
+        char address[32]{};
+        (void)snprintf(address, sizeof(address), "0x%" PRIx64, value);
+        append_string_field(buffer, name, address);
+    }
+
+    std::string get_operation_string(const uint8_t operation)
+    {
+        const auto permission = static_cast<memory_permission>(operation);
+
+        std::string result{};
+        result.push_back((permission & memory_permission::read) != memory_permission::none ? 'r' : '-');
+        result.push_back((permission & memory_permission::write) != memory_permission::none ? 'w' : '-');
+        result.push_back((permission & memory_permission::exec) != memory_permission::none ? 'x' : '-');
+
+        return result;
+    }
+
+    void append_event_fields(std::string& buffer, const event& e)
+    {
+        switch (e.header.type)
+        {
+        case event_type::module_load: {
+            const auto data = e.get_data<module_load_event>();
+            append_string_field(buffer, "name", e.get_text<module_load_event>());
+            append_address_field(buffer, "image_base", data.image_base);
+            append_number_field(buffer, "size_of_image", data.size_of_image);
+            break;
+        }
+        case event_type::function_entry: {
+            const auto data = e.get_data<function_entry_event>();
+            append_string_field(buffer, "module", e.get_text<function_entry_event>());
+            append_string_field(buffer, "function", e.get_text<function_entry_event>(1));
+            append_address_field(buffer, "address", data.address);
+            break;
+        }
+        case event_type::syscall: {
+            const auto data = e.get_data<syscall_event>();
+            append_string_field(buffer, "name", e.get_text<syscall_event>());
+            append_number_field(buffer, "id", data.id);
+            append_address_field(buffer, "address", data.address);
+            break;
+        }
+        case event_type::object_access: {
+            const auto data = e.get_data<object_access_event>();
+            append_string_field(buffer, "object", e.get_text<object_access_event>());
+            append_string_field(buffer, "member", e.get_text<object_access_event>(1));
+            append_address_field(buffer, "address", data.address);
+            append_number_field(buffer, "offset", data.offset);
+            append_number_field(buffer, "size", data.size);
+            append_string_field(buffer, "operation", get_operation_string(data.operation));
+            append_address_field(buffer, "rip", data.rip);
+            break;
+        }
+        case event_type::exception: {
+            const auto data = e.get_data<exception_event>();
+            char code[16]{};
+            (void)snprintf(code, sizeof(code), "0x%08X", data.code);
+            append_string_field(buffer, "code", code);
+            append_address_field(buffer, "rip", data.rip);
+            append_address_field(buffer, "address", data.address);
+            append_string_field(buffer, "operation", get_operation_string(data.operation));
+            break;
+        }
+        case event_type::api_call: {
+            const auto data = e.get_data<api_call_event>();
+            append_string_field(buffer, "module", e.get_text<api_call_event>());
+            append_string_field(buffer, "function", e.get_text<api_call_event>(1));
+            append_address_field(buffer, "address", data.address);
+            append_address_field(buffer, "return_address", data.return_address);
+
+            // Arguments with a string are written as that string
+            buffer.append(",\"arguments\":[");
+
+            size_t string_index = 2;
+            const auto count = std::min(static_cast<size_t>(data.argument_count), MAX_API_ARGUMENTS);
+
+            for (size_t i = 0; i < count; ++i)
+            {
+                if (i)
+                {
+                    buffer.push_back(',');
+                }
+
+                if (data.string_mask & (1 << i))
+                {
+                    utils::json::append_string(buffer, e.get_text<api_call_event>(string_index++));
+                    continue;
+                }
+
+                char value[32]{};
+                (void)snprintf(value, sizeof(value), "\"0x%" PRIx64 "\"", data.arguments[i]);
+                buffer.append(value);
+            }
+
+            buffer.push_back(']');
+            break;
+        }
+        default:
+            break;
+        }
+    }
+
+    void write_line(std::ostream& output, const std::string& line)
+    {
+        output.write(line.data(), static_cast<std::streamsize>(line.size()));
+    }
+
+    // Writes one JSON object per block, with the registers that changed since the previous one
+    void convert_execution_trace(const std::span<const std::byte> data, std::ostream& output)
+    {
+        execution_trace_format::file_header header{};
+        memcpy(&header, data.data(), sizeof(header));
+
+        if (header.version != execution_trace_format::VERSION)
+        {
+            throw std::runtime_error("Unsupported execution trace version");
+        }
+
+        const auto has_registers = (header.flags & execution_trace_format::FLAG_REGISTERS) != 0;
+
+        std::string line{};
+        size_t position = sizeof(header);
+
+        while (data.size() - position >= sizeof(uint32_t))
+        {
+            uint32_t chunk_size{};
+            memcpy(&chunk_size, data.data() + position, sizeof(chunk_size));
+            position += sizeof(chunk_size);
+
+            if (data.size() - position < chunk_size)
+            {
+                break;
+            }
+
+            execution_trace_format::chunk_reader chunk(data.subspan(position, chunk_size), has_registers);
+            position += chunk_size;
+
+            while (const auto r = chunk.next())
+            {
+                if (r->type != execution_trace_format::record_type::block)
+                {
+                    continue;
+                }
+
+                line.clear();
+                line.append("{\"type\":\"block\"");
+                append_number_field(line, "thread", r->thread_id);
+                append_address_field(line, "address", r->address);
+                append_number_field(line, "instructions", r->instruction_count);
+
+                if (has_registers)
+                {
+                    line.append(",\"registers\":{");
+
+                    auto first = true;
+                    for (size_t i = 0; i < execution_trace_format::TRACED_REGISTERS.size(); ++i)
+                    {
+                        if (!(r->changed_registers & (1U << i)))
+                        {
+                            continue;
+                        }
+
+                        char value[32]{};
+                        (void)snprintf(value, sizeof(value), "0x%" PRIx64, r->registers[i]);
+
+                        line.append(first ? "\"" : ",\"");
+                        line.append(execution_trace_format::TRACED_REGISTER_NAMES[i]);
+                        line.append("\":");
+                        utils::json::append_string(line, value);
+
+                        first = false;
+                    }
+
+                    line.push_back('}');
+                }
+
+                line.append("}\n");
+                write_line(output, line);
+            }
+        }
+    }
+
+    // Writes one JSON object per event
+    void convert_event_trace(const std::span<const std::byte> data, std::ostream& output)
+    {
+        reader trace_reader(data);
+
+        if (!trace_reader.is_valid())
+        {
+            throw std::runtime_error("Invalid event trace");
+        }
+
+        std::string line{};
+
+        while (const auto e = trace_reader.next())
+        {
+            line.clear();
+            line.append("{\"type\":");
+            utils::json::append_string(line, get_event_type_name(e->header.type));
+            append_number_field(line, "thread", e->header.thread_id);
+            append_number_field(line, "instructions", e->header.instructions);
+            append_event_fields(line, *e);
+            line.append("}\n");
+
+            write_line(output, line);
+        }
+    }
+
+    void convert(const std::filesystem::path& trace_file, std::ostream& output)
+    {
+        const utils::mapped_file file(trace_file);
+        const auto data = file.get_buffer();
+
+        uint32_t magic{};
+        if (data.size() >= sizeof(execution_trace_format::file_header))
+        {
+            memcpy(&magic, data.data(), sizeof(magic));
+        }
+
+        if (magic == execution_trace_format::MAGIC)
+        {
+            convert_execution_trace(data, output);
+        }
+        else if (magic == MAGIC)
+        {
+            convert_event_trace(data, output);
+        }
+        else
+        {
+            throw std::runtime_error("Unknown trace file: " + trace_file.string());
+        }
+    }
+}
+
+int main(const int argc, char** argv)
+{
+    try
+    {
+        if (argc < 2)
+        {
+            printf("Usage: %s <trace file> [json file]\n", argv[0]);
+            return 1;
+        }
+
+        if (argc < 3)
+        {
+            convert(argv[1], std::cout);
+            return 0;
+        }
+
+        std::ofstream output(argv[2], std::ios::binary | std::ios::trunc);
+        if (!output)
+        {
+            throw std::runtime_error("Failed to open output file: " + std::string(argv[2]));
+        }
+
+        convert(argv[1], output);
+        return 0;
+    }
+    catch (std::exception& e)
+    {
+        puts(e.what());
+    }
+
+    return 1;
+}
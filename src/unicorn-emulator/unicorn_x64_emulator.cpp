@@ -5,7 +5,11 @@
 #include "unicorn_hook.hpp"
 
 #include "function_wrapper.hpp"
+#include <set>
+#include <unordered_set>
 #include <ranges>
+#include <utils/finally.hpp>
+#include <utils/virtual_memory.hpp>
 
 namespace unicorn
 {
@@ -18,6 +22,9 @@ namespace unicorn
 
         static_assert(static_cast<uint32_t>(x64_register::end) == UC_X86_REG_ENDING);
 
+        // Smaller regions wouldn't fill a single huge page
+        constexpr size_t HUGE_PAGE_REGION_SIZE = 2 * 1024 * 1024;
+
         uc_x86_insn map_hookable_instruction(const x64_hookable_instructions instruction)
         {
             switch (instruction)
@@ -118,21 +125,16 @@ namespace unicorn
         class uc_context_serializer
         {
           public:
-            uc_context_serializer(uc_engine* uc, const bool in_place)
+            uc_context_serializer(uc_engine* uc)
                 : uc_(uc)
             {
-                if (in_place)
-                {
-                    // Unicorn stores pointers in the struct. The serialization here is broken
-                    throw std::runtime_error("Memory saving not supported atm");
-                }
-
+                // Memory is snapshotted by the memory_manager, Unicorn's memory context stores pointers
 #ifndef OS_WINDOWS
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wconversion"
 #endif
 
-                uc_ctl_context_mode(uc, UC_CTL_CONTEXT_CPU | (in_place ? UC_CTL_CONTEXT_MEMORY : 0));
+                uc_ctl_context_mode(uc, UC_CTL_CONTEXT_CPU);
 
 #ifndef OS_WINDOWS
 #pragma GCC diagnostic pop
@@ -162,6 +164,24 @@ namespace unicorn
                 uce(uc_context_restore(this->uc_, this->context_));
             }
 
+            void save(std::vector<std::byte>& data) const
+            {
+                uce(uc_context_save(this->uc_, this->context_));
+                data.resize(this->size_);
+                memcpy(data.data(), this->context_, this->size_);
+            }
+
+            void restore(const std::vector<std::byte>& data) const
+            {
+                if (data.size() != this->size_)
+                {
+                    throw std::runtime_error("Invalid register context size");
+                }
+
+                memcpy(this->context_, data.data(), this->size_);
+                uce(uc_context_restore(this->uc_, this->context_));
+            }
+
             uc_context_serializer(uc_context_serializer&&) = delete;
             uc_context_serializer(const uc_context_serializer&) = delete;
             uc_context_serializer& operator=(uc_context_serializer&&) = delete;
@@ -173,61 +193,57 @@ namespace unicorn
             size_t size_{};
         };
 
-        void add_read_hook(uc_engine* uc, const uint64_t address, const size_t size, hook_container& container,
-                           const std::shared_ptr<complex_memory_hook_callback>& callback)
+        class memory_access_hook : public hook_object
         {
-            function_wrapper<void, uc_engine*, uc_mem_type, uint64_t, int, int64_t> wrapper(
-                [callback](uc_engine*, const uc_mem_type type, const uint64_t address, const int size, const int64_t) {
-                    const auto operation = map_memory_operation(type);
-                    if (operation != memory_permission::none)
-                    {
-                        (*callback)(address, static_cast<uint64_t>(size), 0, operation);
-                    }
-                });
+          public:
+            memory_access_hook(const raw_memory_hook_callback callback, std::unique_ptr<hook_context> context)
+                : callback_(callback),
+                  context_(std::move(context))
+            {
+            }
 
-            unicorn_hook hook{uc};
+            void add(unicorn_hook hook)
+            {
+                this->hooks_.emplace_back(std::move(hook));
+            }
 
-            uce(uc_hook_add(uc, hook.make_reference(), UC_HOOK_MEM_READ, wrapper.get_function(),
-                            wrapper.get_user_data(), address, address + size));
+            void dispatch(const uint64_t address, const size_t size, const uint64_t value,
+                          const memory_operation operation) const
+            {
+                this->callback_(*this->context_, address, size, value, operation);
+            }
 
-            container.add(std::move(wrapper), std::move(hook));
-        }
+          private:
+            raw_memory_hook_callback callback_{};
+            std::unique_ptr<hook_context> context_{};
+            std::vector<unicorn_hook> hooks_{};
+        };
 
-        void add_write_hook(uc_engine* uc, const uint64_t address, const size_t size, hook_container& container,
-                            const std::shared_ptr<complex_memory_hook_callback>& callback)
+        void dispatch_memory_read(uc_engine*, const uc_mem_type type, const uint64_t address, const int size,
+                                  const int64_t, void* user_data)
         {
-            function_wrapper<void, uc_engine*, uc_mem_type, uint64_t, int, int64_t> wrapper(
-                [callback](uc_engine*, const uc_mem_type type, const uint64_t address, const int size,
-                           const uint64_t value) {
-                    const auto operation = map_memory_operation(type);
-                    if (operation != memory_permission::none)
-                    {
-                        (*callback)(address, static_cast<uint64_t>(size), value, operation);
-                    }
-                });
-
-            unicorn_hook hook{uc};
-
-            uce(uc_hook_add(uc, hook.make_reference(), UC_HOOK_MEM_WRITE, wrapper.get_function(),
-                            wrapper.get_user_data(), address, address + size));
-
-            container.add(std::move(wrapper), std::move(hook));
+            const auto operation = map_memory_operation(type);
+            if (operation != memory_permission::none)
+            {
+                static_cast<const memory_access_hook*>(user_data)->dispatch(address, static_cast<size_t>(size), 0,
+                                                                            operation);
+            }
         }
 
-        void add_exec_hook(uc_engine* uc, const uint64_t address, const size_t size, hook_container& container,
-                           const std::shared_ptr<complex_memory_hook_callback>& callback)
+        void dispatch_memory_write(uc_engine*, const uc_mem_type type, const uint64_t address, const int size,
+                                   const int64_t value, void* user_data)
         {
-            function_wrapper<void, uc_engine*, uint64_t, uint32_t> wrapper(
-                [callback](uc_engine*, const uint64_t address, const uint32_t size) {
-                    (*callback)(address, size, 0, memory_permission::exec);
-                });
-
-            unicorn_hook hook{uc};
-
-            uce(uc_hook_add(uc, hook.make_reference(), UC_HOOK_CODE, wrapper.get_function(), wrapper.get_user_data(),
-                            address, address + size));
+            const auto operation = map_memory_operation(type);
+            if (operation != memory_permission::none)
+            {
+                static_cast<const memory_access_hook*>(user_data)->dispatch(address, static_cast<size_t>(size),
+                                                                            static_cast<uint64_t>(value), operation);
+            }
+        }
 
-            container.add(std::move(wrapper), std::move(hook));
+        void dispatch_memory_execution(uc_engine*, const uint64_t address, const uint32_t size, void* user_data)
+        {
+            static_cast<const memory_access_hook*>(user_data)->dispatch(address, size, 0, memory_permission::exec);
         }
 
         basic_block map_block(const uc_tb& translation_block)
@@ -241,6 +257,32 @@ namespace unicorn
             return block;
         }
 
+        struct block_coverage
+        {
+            uint8_t* bitmap{};
+            uint64_t mask{};
+            uint64_t previous_location{};
+        };
+
+        void record_block_coverage(uc_engine*, const uint64_t address, uint32_t, void* user_data)
+        {
+            auto& coverage = *static_cast<block_coverage*>(user_data);
+
+            auto location = address;
+            location ^= location >> 33;
+            location *= 0xFF51AFD7ED558CCD;
+            location ^= location >> 33;
+
+            auto& counter = coverage.bitmap[(location ^ coverage.previous_location) & coverage.mask];
+            counter = static_cast<uint8_t>(counter + 1);
+            coverage.previous_location = location >> 1;
+        }
+
+        void record_block_trace(uc_engine*, const uint64_t address, const uint32_t size, void* user_data)
+        {
+            static_cast<std::unordered_map<uint64_t, uint32_t>*>(user_data)->try_emplace(address, size);
+        }
+
         class unicorn_x64_emulator : public x64_emulator
         {
           public:
@@ -258,11 +300,16 @@ namespace unicorn
 #ifndef OS_WINDOWS
 #pragma GCC diagnostic pop
 #endif
+
+                this->register_context_ = std::make_unique<uc_context_serializer>(this->uc_);
             }
 
             ~unicorn_x64_emulator() override
             {
                 this->hooks_.clear();
+                this->coverage_hook_.release();
+                this->block_trace_hook_.release();
+                this->register_context_ = {};
                 uc_close(this->uc_);
             }
 
@@ -274,6 +321,21 @@ namespace unicorn
                     timeout = {};
                 }
 
+                // Unicorn ignores the end address while exits are in use, so it becomes one of them
+                const auto temporary_exit =
+                    end && !this->exit_addresses_.empty() && !this->exit_addresses_.contains(end);
+                if (temporary_exit)
+                {
+                    this->add_exit_address(end);
+                }
+
+                const auto _ = utils::finally([&] {
+                    if (temporary_exit)
+                    {
+                        this->remove_exit_address(end);
+                    }
+                });
+
                 this->has_violation_ = false;
                 const auto timeoutYs = std::chrono::duration_cast<std::chrono::microseconds>(timeout);
                 const auto res = uc_emu_start(*this, start, end, static_cast<uint64_t>(timeoutYs.count()), count);
@@ -301,6 +363,22 @@ namespace unicorn
                 uce(uc_emu_stop(*this));
             }
 
+            void add_exit_address(const uint64_t address) override
+            {
+                if (this->exit_addresses_.insert(address).second)
+                {
+                    this->update_exits(address);
+                }
+            }
+
+            void remove_exit_address(const uint64_t address) override
+            {
+                if (this->exit_addresses_.erase(address))
+                {
+                    this->update_exits(address);
+                }
+            }
+
             void write_raw_register(const int reg, const void* value, const size_t size) override
             {
                 size_t result_size = size;
@@ -326,6 +404,29 @@ namespace unicorn
                 }
             }
 
+            void read_raw_registers(const std::span<const int> regs, const std::span<void* const> values) override
+            {
+                if (values.size() < regs.size())
+                {
+                    throw std::runtime_error("Register batch size mismatch");
+                }
+
+                uce(uc_reg_read_batch(*this, const_cast<int*>(regs.data()), const_cast<void**>(values.data()),
+                                      static_cast<int>(regs.size())));
+            }
+
+            void write_raw_registers(const std::span<const int> regs,
+                                     const std::span<const void* const> values) override
+            {
+                if (values.size() < regs.size())
+                {
+                    throw std::runtime_error("Register batch size mismatch");
+                }
+
+                uce(uc_reg_write_batch(*this, const_cast<int*>(regs.data()), const_cast<void* const*>(values.data()),
+                                       static_cast<int>(regs.size())));
+            }
+
             void map_mmio(const uint64_t address, const size_t size, mmio_read_callback read_cb,
                           mmio_write_callback write_cb) override
             {
@@ -343,15 +444,44 @@ namespace unicorn
                 this->mmio_[address] = std::move(cb);
             }
 
+            // The backing memory is owned here instead of by Unicorn, so guest memory can be accessed in place
             void map_memory(const uint64_t address, const size_t size, memory_permission permissions) override
             {
-                uce(uc_mem_map(*this, address, size, static_cast<uint32_t>(permissions)));
+                const auto huge_pages = this->uses_huge_pages() && size >= HUGE_PAGE_REGION_SIZE;
+                auto memory = std::make_shared<utils::virtual_memory>(size, huge_pages);
+                uce(uc_mem_map_ptr(*this, address, size, static_cast<uint32_t>(permissions), memory->data()));
+
+                auto* data = memory->data();
+                this->host_mappings_[address] = {std::move(memory), data, size};
+            }
+
+            void map_shared_memory(const uint64_t address, const size_t size, memory_permission permissions,
+                                   const std::byte* data) override
+            {
+                // Unicorn never writes to the backing memory of non-writable regions
+                auto* host_data = const_cast<std::byte*>(data);
+                uce(uc_mem_map_ptr(*this, address, size, static_cast<uint32_t>(permissions), host_data));
+
+                this->host_mappings_[address] = {{}, host_data, size};
+            }
+
+            void map_host_memory(const uint64_t address, const size_t size, memory_permission permissions,
+                                 std::byte* data) override
+            {
+                uce(uc_mem_map_ptr(*this, address, size, static_cast<uint32_t>(permissions), data));
+
+                // Not owned, so unmapping doesn't discard memory that other views still map
+                this->host_mappings_[address] = {{}, data, size};
             }
 
             void unmap_memory(const uint64_t address, const size_t size) override
             {
                 uce(uc_mem_unmap(*this, address, size));
 
+                this->unmap_host_memory(address, size);
+
+                this->invalidate_block_instruction_counts(address, size);
+
                 const auto mmio_entry = this->mmio_.find(address);
                 if (mmio_entry != this->mmio_.end())
                 {
@@ -371,13 +501,38 @@ namespace unicorn
 
             void write_memory(const uint64_t address, const void* data, const size_t size) override
             {
+                this->privatize_shared_memory(address, size);
                 uce(uc_mem_write(*this, address, data, size));
+                this->record_memory_write(address, size);
+                this->invalidate_written_block_counts(address, size);
             }
 
             void apply_memory_protection(const uint64_t address, const size_t size,
                                          memory_permission permissions) override
             {
                 uce(uc_mem_protect(*this, address, size, static_cast<uint32_t>(permissions)));
+
+                // Host views only write memory that isn't executable, it may be again after this
+                this->invalidate_written_block_counts(address, size);
+            }
+
+            std::byte* get_host_memory(const uint64_t address, const size_t size) override
+            {
+                auto entry = this->host_mappings_.upper_bound(address);
+                if (entry == this->host_mappings_.begin())
+                {
+                    return nullptr;
+                }
+
+                --entry;
+
+                const auto offset = address - entry->first;
+                if (offset >= entry->second.size || entry->second.size - offset < size)
+                {
+                    return nullptr;
+                }
+
+                return entry->second.data + offset;
             }
 
             emulator_hook* hook_instruction(int instruction_type, instruction_hook_callback callback) override
@@ -416,10 +571,11 @@ namespace unicorn
             emulator_hook* hook_basic_block(basic_block_hook_callback callback) override
             {
                 function_wrapper<void, uc_engine*, uint64_t, size_t> wrapper(
-                    [c = std::move(callback)](uc_engine*, const uint64_t address, const size_t size) {
+                    [this, c = std::move(callback)](uc_engine*, const uint64_t address, const size_t size) {
                         basic_block block{};
                         block.address = address;
                         block.size = size;
+                        block.instruction_count = this->get_block_instruction_count(address, size);
 
                         c(block);
                     });
@@ -460,6 +616,32 @@ namespace unicorn
                 return result;
             }
 
+            emulator_hook* hook_comparison(comparison_hook_callback callback) override
+            {
+                function_wrapper<void, uc_engine*, uint64_t, uint64_t, uint64_t, uint32_t> wrapper(
+                    [c = std::move(callback)](uc_engine*, const uint64_t address, const uint64_t first,
+                                              const uint64_t second, const uint32_t size) {
+                        c(address, first, second, size / 8); //
+                    });
+
+                unicorn_hook hook{*this};
+                auto container = std::make_unique<hook_container>();
+
+                // Compares are translated to subtractions flagged as such, begin > end covers all addresses
+                uce(uc_hook_add(*this, hook.make_reference(), UC_HOOK_TCG_OPCODE, wrapper.get_function(),
+                                wrapper.get_user_data(), 1, 0, UC_TCG_OP_SUB, UC_TCG_OP_FLAG_CMP));
+
+                // The hook is compiled into translated code, existing translations don't know about it
+                uce(uc_ctl_flush_tb(*this));
+                this->count_full_flush();
+
+                container->add(std::move(wrapper), std::move(hook));
+
+                auto* result = container->as_opaque_hook();
+                this->hooks_.push_back(std::move(container));
+                return result;
+            }
+
             emulator_hook* hook_interrupt(interrupt_hook_callback callback) override
             {
                 function_wrapper<void, uc_engine*, int> wrapper(
@@ -523,31 +705,40 @@ namespace unicorn
                 return result;
             }
 
-            emulator_hook* hook_memory_access(const uint64_t address, const size_t size, const memory_operation filter,
-                                              complex_memory_hook_callback callback) override
+            emulator_hook* hook_raw_memory_access(const uint64_t address, const size_t size,
+                                                  const memory_operation filter,
+                                                  const raw_memory_hook_callback callback,
+                                                  std::unique_ptr<hook_context> context) override
             {
                 if (filter == memory_permission::none)
                 {
                     return nullptr;
                 }
 
-                const auto shared_callback = std::make_shared<complex_memory_hook_callback>(std::move(callback));
+                auto container = std::make_unique<memory_access_hook>(callback, std::move(context));
 
-                auto container = std::make_unique<hook_container>();
+                const auto add_hook = [&](const int type, void* function) {
+                    unicorn_hook hook{*this};
+
+                    uce(uc_hook_add(*this, hook.make_reference(), type, function, container.get(), address,
+                                    address + size));
+
+                    container->add(std::move(hook));
+                };
 
                 if ((filter & memory_operation::read) != memory_operation::none)
                 {
-                    add_read_hook(*this, address, size, *container, shared_callback);
+                    add_hook(UC_HOOK_MEM_READ, reinterpret_cast<void*>(&dispatch_memory_read));
                 }
 
                 if ((filter & memory_operation::write) != memory_operation::none)
                 {
-                    add_write_hook(*this, address, size, *container, shared_callback);
+                    add_hook(UC_HOOK_MEM_WRITE, reinterpret_cast<void*>(&dispatch_memory_write));
                 }
 
                 if ((filter & memory_operation::exec) != memory_operation::none)
                 {
-                    add_exec_hook(*this, address, size, *container, shared_callback);
+                    add_hook(UC_HOOK_CODE, reinterpret_cast<void*>(&dispatch_memory_execution));
                 }
 
                 auto* result = container->as_opaque_hook();
@@ -557,6 +748,66 @@ namespace unicorn
                 return result;
             }
 
+            void enable_block_coverage(const std::span<uint8_t> bitmap) override
+            {
+                if (bitmap.empty() || (bitmap.size() & (bitmap.size() - 1)) != 0)
+                {
+                    throw std::runtime_error("Coverage bitmap size must be a power of two");
+                }
+
+                const auto installed = this->coverage_.bitmap != nullptr;
+
+                this->coverage_.bitmap = bitmap.data();
+                this->coverage_.mask = bitmap.size() - 1;
+                this->coverage_.previous_location = 0;
+
+                if (!installed)
+                {
+                    this->coverage_hook_ = unicorn_hook{*this};
+                    uce(uc_hook_add(*this, this->coverage_hook_.make_reference(), UC_HOOK_BLOCK,
+                                    reinterpret_cast<void*>(&record_block_coverage), &this->coverage_, 0,
+                                    std::numeric_limits<pointer_type>::max()));
+                }
+            }
+
+            void disable_block_coverage() override
+            {
+                this->coverage_hook_.release();
+                this->coverage_ = {};
+            }
+
+            void enable_block_trace(std::unordered_map<uint64_t, uint32_t>& blocks) override
+            {
+                this->block_trace_hook_ = unicorn_hook{*this};
+                uce(uc_hook_add(*this, this->block_trace_hook_.make_reference(), UC_HOOK_BLOCK,
+                                reinterpret_cast<void*>(&record_block_trace), &blocks, 0,
+                                std::numeric_limits<pointer_type>::max()));
+            }
+
+            void disable_block_trace() override
+            {
+                this->block_trace_hook_.release();
+            }
+
+            size_t prewarm_blocks(const std::span<const uint64_t> addresses) override
+            {
+                size_t translated = 0;
+
+                for (const auto address : addresses)
+                {
+                    uc_tb translation_block{};
+                    if (uc_ctl_request_cache(*this, address, &translation_block) != UC_ERR_OK)
+                    {
+                        continue;
+                    }
+
+                    this->store_block_instruction_count(address, translation_block.size, translation_block.icount);
+                    ++translated;
+                }
+
+                return translated;
+            }
+
             void delete_hook(emulator_hook* hook) override
             {
                 const auto entry =
@@ -575,45 +826,31 @@ namespace unicorn
                 return this->uc_;
             }
 
-            void serialize_state(utils::buffer_serializer& buffer, const bool is_snapshot) const override
+            void serialize_state(utils::buffer_serializer& buffer, bool /*is_snapshot*/) const override
             {
-                if (this->has_snapshots_ && !is_snapshot)
-                {
-                    // TODO: Investigate if this is really necessary
-                    throw std::runtime_error("Unable to serialize after snapshot was taken!");
-                }
-
-                this->has_snapshots_ |= is_snapshot;
-
-                const uc_context_serializer serializer(this->uc_, is_snapshot);
-                serializer.serialize(buffer);
+                this->register_context_->serialize(buffer);
             }
 
-            void deserialize_state(utils::buffer_deserializer& buffer, const bool is_snapshot) override
+            void deserialize_state(utils::buffer_deserializer& buffer, bool /*is_snapshot*/) override
             {
-                if (this->has_snapshots_ && !is_snapshot)
-                {
-                    // TODO: Investigate if this is really necessary
-                    throw std::runtime_error("Unable to deserialize after snapshot was taken!");
-                }
-
-                const uc_context_serializer serializer(this->uc_, is_snapshot);
-                serializer.deserialize(buffer);
+                this->register_context_->deserialize(buffer);
             }
 
             std::vector<std::byte> save_registers() override
             {
-                utils::buffer_serializer buffer{};
-                const uc_context_serializer serializer(this->uc_, false);
-                serializer.serialize(buffer);
-                return buffer.move_buffer();
+                std::vector<std::byte> register_data{};
+                this->save_registers(register_data);
+                return register_data;
+            }
+
+            void save_registers(std::vector<std::byte>& register_data) override
+            {
+                this->register_context_->save(register_data);
             }
 
             void restore_registers(const std::vector<std::byte>& register_data) override
             {
-                utils::buffer_deserializer buffer{register_data};
-                const uc_context_serializer serializer(this->uc_, false);
-                serializer.deserialize(buffer);
+                this->register_context_->restore(register_data);
             }
 
             bool has_violation() const override
@@ -622,11 +859,172 @@ namespace unicorn
             }
 
           private:
-            mutable bool has_snapshots_{false};
             uc_engine* uc_{};
             bool has_violation_{false};
+            std::unique_ptr<uc_context_serializer> register_context_{};
             std::vector<std::unique_ptr<hook_object>> hooks_{};
             std::unordered_map<uint64_t, mmio_callbacks> mmio_{};
+
+            struct host_mapping
+            {
+                std::shared_ptr<utils::virtual_memory> memory{};
+                std::byte* data{};
+                size_t size{};
+            };
+
+            // Partially unmapped blocks are split and share their memory, it is released once nothing maps it
+            std::map<uint64_t, host_mapping> host_mappings_{};
+
+            block_coverage coverage_{};
+            unicorn_hook coverage_hook_{};
+            unicorn_hook block_trace_hook_{};
+
+            struct block_instruction_count
+            {
+                size_t size{};
+                size_t instructions{};
+            };
+
+            // Guest writes to code are only seen by translating it again, which mostly changes the block size. Host
+            // writes and protection changes drop the counts of the blocks on the affected pages.
+            std::unordered_map<uint64_t, block_instruction_count> block_instruction_counts_{};
+            std::unordered_set<uint64_t> counted_pages_{};
+
+            std::set<uint64_t> exit_addresses_{};
+            bool uses_exits_{false};
+
+            // Exits are checked while translating, so the code at the changed address is translated again
+            void update_exits(const uint64_t changed_address)
+            {
+#ifndef OS_WINDOWS
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wconversion"
+#endif
+
+                if (!this->uses_exits_)
+                {
+                    uce(uc_ctl_exits_enable(*this));
+                    this->uses_exits_ = true;
+                }
+
+                std::vector<uint64_t> exits(this->exit_addresses_.begin(), this->exit_addresses_.end());
+                uce(uc_ctl_set_exits(*this, exits.data(), exits.size()));
+
+                if (exits.empty())
+                {
+                    uce(uc_ctl_exits_disable(*this));
+                    this->uses_exits_ = false;
+                }
+
+                uce(uc_ctl_remove_cache(*this, changed_address, changed_address + 1));
+                this->invalidate_block_instruction_counts(changed_address, 1);
+
+#ifndef OS_WINDOWS
+#pragma GCC diagnostic pop
+#endif
+            }
+
+            size_t get_block_instruction_count(const uint64_t address, const size_t size)
+            {
+                const auto entry = this->block_instruction_counts_.find(address);
+                if (entry != this->block_instruction_counts_.end() && entry->second.size == size)
+                {
+                    return entry->second.instructions;
+                }
+
+                uc_tb translation_block{};
+                uce(uc_ctl_request_cache(*this, address, &translation_block));
+
+                this->store_block_instruction_count(address, size, translation_block.icount);
+                return translation_block.icount;
+            }
+
+            void store_block_instruction_count(const uint64_t address, const size_t size, const size_t instructions)
+            {
+                this->block_instruction_counts_[address] = {
+                    .size = size,
+                    .instructions = instructions,
+                };
+
+                for (auto page = page_align_down(address); page < address + std::max(size, size_t{1});
+                     page += 0x1000)
+                {
+                    this->counted_pages_.insert(page);
+                }
+            }
+
+            // Blocks overlapping the range, not only the ones starting in it
+            void invalidate_block_instruction_counts(const uint64_t address, const size_t size)
+            {
+                std::erase_if(this->block_instruction_counts_, [&](const auto& entry) {
+                    return entry.first < address + size && entry.first + entry.second.size > address;
+                });
+            }
+
+            void invalidate_written_block_counts(const uint64_t address, const size_t size)
+            {
+                if (this->counted_pages_.empty() || !size)
+                {
+                    return;
+                }
+
+                for (auto page = page_align_down(address); page < address + size; page += 0x1000)
+                {
+                    if (this->counted_pages_.erase(page))
+                    {
+                        this->invalidate_block_instruction_counts(page, 0x1000);
+                    }
+                }
+            }
+
+            void unmap_host_memory(const uint64_t address, const size_t size)
+            {
+                const auto end = address + size;
+
+                auto entry = this->host_mappings_.upper_bound(address);
+                if (entry != this->host_mappings_.begin())
+                {
+                    --entry;
+                }
+
+                while (entry != this->host_mappings_.end() && entry->first < end)
+                {
+                    const auto mapping_start = entry->first;
+                    const auto mapping_end = mapping_start + entry->second.size;
+
+                    if (mapping_end <= address)
+                    {
+                        ++entry;
+                        continue;
+                    }
+
+                    const auto mapping = std::move(entry->second);
+                    entry = this->host_mappings_.erase(entry);
+
+                    const auto unmap_start = std::max(address, mapping_start);
+                    const auto unmap_end = std::min(end, mapping_end);
+
+                    if (mapping.memory)
+                    {
+                        const auto offset = static_cast<size_t>(mapping.data - mapping.memory->data());
+                        mapping.memory->discard(offset + static_cast<size_t>(unmap_start - mapping_start),
+                                                static_cast<size_t>(unmap_end - unmap_start));
+                    }
+
+                    if (mapping_start < unmap_start)
+                    {
+                        this->host_mappings_[mapping_start] = {mapping.memory, mapping.data,
+                                                               static_cast<size_t>(unmap_start - mapping_start)};
+                    }
+
+                    if (unmap_end < mapping_end)
+                    {
+                        this->host_mappings_[unmap_end] = {mapping.memory,
+                                                           mapping.data + (unmap_end - mapping_start),
+                                                           static_cast<size_t>(mapping_end - unmap_end)};
+                    }
+                }
+            }
         };
     }
 
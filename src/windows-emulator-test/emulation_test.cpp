@@ -1,5 +1,10 @@
 #include "emulation_test_utils.hpp"
 
+#include <state_diff.hpp>
+#include <thread_memory_pool.hpp>
+#include <path_explorer.hpp>
+#include <unpack_detector.hpp>
+
 namespace test
 {
     TEST(EmulationTest, BasicEmulationWorks)
@@ -10,6 +15,296 @@ namespace test
         ASSERT_TERMINATED_SUCCESSFULLY(emu);
     }
 
+    TEST(EmulationTest, LibraryFunctionEmulationWorks)
+    {
+        auto emu = create_sample_emulator({
+            .disable_logging = true,
+            .use_relative_time = true,
+            .emulate_library_functions = true,
+        });
+
+        emu.start();
+
+        ASSERT_TERMINATED_SUCCESSFULLY(emu);
+    }
+
+    TEST(EmulationTest, HeapEmulationWorks)
+    {
+        auto emu = create_sample_emulator({
+            .disable_logging = true,
+            .use_relative_time = true,
+            .emulate_heap = true,
+            .heap_redzone_size = 16,
+        });
+
+        emu.start();
+
+        ASSERT_TERMINATED_SUCCESSFULLY(emu);
+    }
+
+    TEST(EmulationTest, EventsReachSubscribers)
+    {
+        auto emu = create_sample_emulator();
+
+        size_t module_loads = 0;
+        size_t syscall_entries = 0;
+        size_t syscall_exits = 0;
+
+        emu.events().subscribe<module_load_event>([&](const module_load_event&) { ++module_loads; });
+        emu.events().subscribe<syscall_enter_event>([&](const syscall_enter_event&) { ++syscall_entries; });
+        emu.events().subscribe<syscall_exit_event>([&](const syscall_exit_event&) { ++syscall_exits; });
+
+        emu.start();
+
+        ASSERT_TERMINATED_SUCCESSFULLY(emu);
+        ASSERT_GT(module_loads, 0);
+        ASSERT_GT(syscall_entries, 0);
+        ASSERT_EQ(syscall_entries, syscall_exits);
+    }
+
+    TEST(EmulationTest, StateDiffReportsChanges)
+    {
+        auto emu = create_sample_emulator();
+        emu.start({}, 1000);
+
+        const state_diff diff{emu};
+        ASSERT_TRUE(diff.get_changed_pages().empty());
+
+        emu.start();
+
+        ASSERT_TERMINATED_SUCCESSFULLY(emu);
+        ASSERT_FALSE(diff.get_changed_pages().empty());
+        ASSERT_FALSE(diff.get_new_modules().empty());
+
+        // The sample closes the keys it opens again
+        ASSERT_FALSE(diff.get_opened_registry_keys().empty());
+    }
+
+    TEST(EmulationTest, ThreadMemoryPoolZeroesOnlyUsedPages)
+    {
+        auto emu = create_sample_emulator();
+        auto& memory = emu.emu();
+
+        constexpr uint64_t size = 0x40000;
+
+        thread_memory_pool pool{};
+        const auto address = pool.allocate(memory, size);
+        ASSERT_NE(address, 0u);
+
+        // Like a stack that was only used at the top
+        constexpr uint32_t value = 0x11223344;
+        memory.write_memory(address + size - sizeof(value), &value, sizeof(value));
+
+        pool.release(memory, address, size, size);
+        ASSERT_EQ(pool.get_region_count(), 1u);
+
+        const state_diff diff{emu};
+        ASSERT_EQ(pool.allocate(memory, size), address);
+
+        uint32_t recycled_value{};
+        memory.read_memory(address + size - sizeof(recycled_value), &recycled_value, sizeof(recycled_value));
+
+        ASSERT_EQ(recycled_value, 0u);
+        ASSERT_EQ(diff.get_changed_pages().size(), 1u);
+    }
+
+    TEST(EmulationTest, SectionViewsShareMemory)
+    {
+        auto emu = create_sample_emulator();
+        auto& memory = emu.emu();
+
+        constexpr size_t size = 0x2000;
+
+        const auto id = memory.create_section_memory(size);
+        ASSERT_NE(id, 0u);
+
+        const auto committed_bytes = memory.get_committed_bytes();
+
+        const auto first_view = memory.find_free_allocation_base(size);
+        ASSERT_TRUE(memory.map_section_view(first_view, id, memory_permission::read_write));
+
+        const auto second_view = memory.find_free_allocation_base(size);
+        ASSERT_TRUE(memory.map_section_view(second_view, id, memory_permission::read_write));
+        ASSERT_NE(first_view, second_view);
+
+        // The section memory is charged once, however many views it has
+        ASSERT_EQ(memory.get_committed_bytes(), committed_bytes + size);
+
+        constexpr uint64_t value = 0x1122334455667788;
+        memory.write_memory(first_view + 0x1008, &value, sizeof(value));
+
+        uint64_t aliased_value{};
+        memory.read_memory(second_view + 0x1008, &aliased_value, sizeof(aliased_value));
+        ASSERT_EQ(aliased_value, value);
+
+        ASSERT_TRUE(memory.release_memory(second_view, 0));
+        ASSERT_EQ(memory.get_committed_bytes(), committed_bytes + size);
+
+        ASSERT_TRUE(memory.release_memory(first_view, 0));
+        ASSERT_EQ(memory.get_committed_bytes(), committed_bytes);
+
+        memory.release_section_memory(id);
+    }
+
+    TEST(EmulationTest, FreeAllocationBaseSkipsSmallHoles)
+    {
+        auto emu = create_sample_emulator();
+        auto& memory = emu.emu();
+
+        constexpr size_t count = 64;
+        constexpr size_t size = 0x10000;
+
+        const auto base = memory.find_free_allocation_base(count * size);
+        ASSERT_NE(base, 0u);
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            ASSERT_TRUE(memory.allocate_memory(base + i * size, size, memory_permission::read_write, true));
+        }
+
+        for (size_t i = 0; i < count; i += 2)
+        {
+            ASSERT_TRUE(memory.release_memory(base + i * size, 0));
+        }
+
+        ASSERT_EQ(memory.find_free_allocation_base(size, base), base);
+        ASSERT_GE(memory.find_free_allocation_base(2 * size, base), base + count * size);
+
+        // Merges the holes on both sides, the first hole large enough is used
+        ASSERT_TRUE(memory.release_memory(base + 41 * size, 0));
+        ASSERT_EQ(memory.find_free_allocation_base(2 * size, base), base + 40 * size);
+        ASSERT_EQ(memory.find_free_allocation_base(2 * size, base + 41 * size), base + 41 * size);
+    }
+
+    TEST(EmulationTest, UnpackDetectionKeepsBehavior)
+    {
+        auto reference = create_sample_emulator();
+        reference.start();
+
+        ASSERT_TERMINATED_SUCCESSFULLY(reference);
+
+        auto emu = create_sample_emulator();
+        const unpack_detector detector{emu};
+
+        emu.start();
+
+        ASSERT_TERMINATED_SUCCESSFULLY(emu);
+        ASSERT_EQ(emu.process().executed_instructions, reference.process().executed_instructions);
+    }
+
+    TEST(EmulationTest, UnpackDetectionFindsOnlyWrittenCode)
+    {
+        auto emu = create_sample_emulator();
+        const unpack_detector detector{emu};
+
+        emu.start();
+
+        ASSERT_TERMINATED_SUCCESSFULLY(emu);
+
+        // The sample runs a ud2 it copied to an allocation, the modules the loader wrote aren't reported
+        const auto& unpacked = detector.get_unpacked_memory();
+        ASSERT_EQ(unpacked.size(), 1);
+        ASSERT_EQ(emu.process().mod_manager.find_by_address(unpacked[0].allocation_base), nullptr);
+        ASSERT_GE(unpacked[0].data.size(), 2);
+        ASSERT_EQ(unpacked[0].data[0], std::byte{0x0F});
+        ASSERT_EQ(unpacked[0].data[1], std::byte{0x0B});
+    }
+
+    TEST(EmulationTest, PathExplorationContinuesWithChosenAnswer)
+    {
+        auto emu = create_sample_emulator();
+
+        // The alternative is the status the first NtClose really returns, so both paths reach the same edges
+        path_explorer explorer{emu, {
+                                        .queries = {parse_environment_query("NtClose:0")},
+                                        .max_forks = 1,
+                                        .path_instructions = 100000,
+                                    }};
+
+        explorer.start();
+
+        const auto& forks = explorer.get_forks();
+        ASSERT_EQ(forks.size(), 1);
+        ASSERT_EQ(forks[0].query, 0);
+        ASSERT_EQ(forks[0].new_edges.size(), 2);
+        ASSERT_EQ(forks[0].new_edges[0], forks[0].new_edges[1]);
+        ASSERT_GT(forks[0].new_edges[0], 0);
+        ASSERT_EQ(emu.process().mod_manager.find_by_address(forks[0].address), emu.process().ntdll);
+
+        // Ties keep the real answer, the emulation continues from the fork to the end
+        ASSERT_EQ(forks[0].chosen_answer, 0);
+        ASSERT_TERMINATED_SUCCESSFULLY(emu);
+    }
+
+    TEST(EmulationTest, SharedPagesKeepBehavior)
+    {
+        auto reference = create_sample_emulator();
+        reference.start();
+
+        ASSERT_TERMINATED_SUCCESSFULLY(reference);
+
+        const auto deduplicator = std::make_shared<page_deduplicator>();
+
+        const auto create_emulator = [&] {
+            return create_sample_emulator({
+                .disable_logging = true,
+                .use_relative_time = true,
+                .shared_page_deduplicator = deduplicator,
+            });
+        };
+
+        auto emu1 = create_emulator();
+        auto emu2 = create_emulator();
+
+        emu1.start();
+        emu2.start();
+
+        ASSERT_TERMINATED_SUCCESSFULLY(emu1);
+        ASSERT_TERMINATED_SUCCESSFULLY(emu2);
+        ASSERT_EQ(emu1.process().executed_instructions, reference.process().executed_instructions);
+        ASSERT_EQ(emu2.process().executed_instructions, reference.process().executed_instructions);
+        ASSERT_GT(emu2.emu().get_memory_usage().shared_bytes, 0u);
+    }
+
+    TEST(EmulationTest, SpinLoopFastForwardWorks)
+    {
+        auto emu = create_sample_emulator({
+            .disable_logging = true,
+            .use_relative_time = true,
+            .fast_forward_spin_loops = true,
+        });
+
+        emu.count_instructions_per_block = true;
+        emu.start();
+
+        ASSERT_TERMINATED_SUCCESSFULLY(emu);
+    }
+
+    TEST(EmulationTest, SpinLoopFastForwardYieldsSpinningThread)
+    {
+        auto emu = create_sample_emulator({
+            .disable_logging = true,
+            .use_relative_time = true,
+            .fast_forward_spin_loops = true,
+        });
+
+        emu.count_instructions_per_block = true;
+        emu.start({}, 100000);
+
+        // jmp $
+        constexpr uint8_t spin_code[] = {0xEB, 0xFE};
+        const auto code = emu.emu().allocate_memory(0x1000, memory_permission::read | memory_permission::exec);
+        ASSERT_NE(code, 0);
+        emu.emu().write_memory(code, spin_code, sizeof(spin_code));
+        emu.emu().reg(x64_register::rip, code);
+
+        const auto yields = emu.get_spin_loop_yields();
+        emu.start({}, 300);
+
+        ASSERT_NOT_TERMINATED(emu);
+        ASSERT_GT(emu.get_spin_loop_yields(), yields);
+    }
+
     TEST(EmulationTest, CountedEmulationWorks)
     {
         constexpr auto count = 200000;
@@ -0,0 +1,57 @@
+#include "emulation_test_utils.hpp"
+
+#include <registry/hive_parser.hpp>
+#include <registry/registry_snapshot.hpp>
+
+namespace test
+{
+    namespace
+    {
+        std::shared_ptr<const registry_snapshot> create_software_snapshot(const std::filesystem::path& file)
+        {
+            registry_snapshot::create(file, {{"SOFTWARE", "./registry/SOFTWARE"}});
+            return std::make_shared<const registry_snapshot>(file);
+        }
+    }
+
+    TEST(RegistryTest, SnapshotMatchesHive)
+    {
+        const auto snapshot_file = std::filesystem::temp_directory_path() / "emulator-registry-test.bin";
+
+        {
+            hive_parser hive{"./registry/SOFTWARE"};
+            const auto snapshot = registry_snapshot::open_hive(create_software_snapshot(snapshot_file), "SOFTWARE");
+
+            const std::filesystem::path key = R"(microsoft\windows\currentversion)";
+
+            ASSERT_TRUE(hive.has_key(key));
+            ASSERT_TRUE(snapshot->has_key(key));
+            ASSERT_FALSE(snapshot->has_key(R"(microsoft\missing key)"));
+
+            const auto expected = hive.get_value(key, "programfilesdir");
+            const auto value = snapshot->get_value(key, "programfilesdir");
+
+            ASSERT_TRUE(expected.has_value());
+            ASSERT_TRUE(value.has_value());
+            ASSERT_EQ(value->type, expected->type);
+            ASSERT_TRUE(std::ranges::equal(value->data, expected->data));
+        }
+
+        std::filesystem::remove(snapshot_file);
+    }
+
+    TEST(RegistryTest, SnapshotHiveNamesIgnoreCase)
+    {
+        const auto snapshot_file = std::filesystem::temp_directory_path() / "emulator-registry-case-test.bin";
+
+        {
+            const auto snapshot = create_software_snapshot(snapshot_file);
+            const auto hive = registry_snapshot::open_hive(snapshot, "software");
+
+            ASSERT_TRUE(hive->has_key(R"(Microsoft\Windows\CurrentVersion)"));
+            ASSERT_THROW((void)registry_snapshot::open_hive(snapshot, "SYSTEM"), std::runtime_error);
+        }
+
+        std::filesystem::remove(snapshot_file);
+    }
+}
@@ -1,5 +1,7 @@
 #include "emulation_test_utils.hpp"
 
+#include <serialization_stream.hpp>
+
 namespace test
 {
     TEST(SerializationTest, SerializedDataIsReproducible)
@@ -75,4 +77,331 @@ namespace test
 
         ASSERT_EQ(serializer1.get_buffer(), serializer2.get_buffer());
     }
+
+    TEST(SerializationTest, RestoredSnapshotMatchesSavedState)
+    {
+        auto emu = create_sample_emulator();
+        emu.start({}, 100);
+
+        utils::buffer_serializer serializer1{};
+        emu.serialize(serializer1);
+
+        emu.save_snapshot();
+
+        emu.start();
+        ASSERT_TERMINATED_SUCCESSFULLY(emu);
+
+        emu.restore_snapshot();
+
+        utils::buffer_serializer serializer2{};
+        emu.serialize(serializer2);
+
+        ASSERT_EQ(serializer1.get_buffer(), serializer2.get_buffer());
+    }
+
+    TEST(SerializationTest, NamedSnapshotsRestoreTheirStates)
+    {
+        auto emu = create_sample_emulator();
+        emu.start({}, 100);
+
+        utils::buffer_serializer serializer1{};
+        emu.serialize(serializer1);
+        const auto first = emu.create_snapshot();
+
+        emu.start({}, 10000);
+
+        utils::buffer_serializer serializer2{};
+        emu.serialize(serializer2);
+        const auto second = emu.create_snapshot();
+
+        emu.start();
+        ASSERT_TERMINATED_SUCCESSFULLY(emu);
+
+        ASSERT_TRUE(emu.restore_snapshot(first));
+
+        utils::buffer_serializer serializer3{};
+        emu.serialize(serializer3);
+        ASSERT_EQ(serializer1.get_buffer(), serializer3.get_buffer());
+
+        ASSERT_TRUE(emu.restore_snapshot(second));
+
+        utils::buffer_serializer serializer4{};
+        emu.serialize(serializer4);
+        ASSERT_EQ(serializer2.get_buffer(), serializer4.get_buffer());
+
+        emu.delete_snapshot(first);
+        ASSERT_FALSE(emu.restore_snapshot(first));
+    }
+
+    TEST(SerializationTest, StreamedSerializationMatchesBufferedSerialization)
+    {
+        auto emu = create_sample_emulator();
+        emu.start({}, 100);
+
+        utils::buffer_serializer serializer1{};
+        emu.serialize(serializer1);
+
+        std::vector<std::byte> streamed_data{};
+        utils::function_sink sink{[&](const std::span<const std::byte> data) {
+            streamed_data.insert(streamed_data.end(), data.begin(), data.end());
+        }};
+
+        utils::buffer_serializer streaming_serializer{sink, 0x1000};
+        emu.serialize(streaming_serializer);
+        streaming_serializer.flush();
+
+        ASSERT_EQ(serializer1.get_buffer(), streamed_data);
+
+        size_t offset = 0;
+        utils::function_source source{[&](const std::span<std::byte> data) {
+            const auto size = std::min(data.size(), streamed_data.size() - offset);
+            std::copy_n(streamed_data.begin() + static_cast<ptrdiff_t>(offset), size, data.begin());
+            offset += size;
+            return size;
+        }};
+
+        utils::buffer_deserializer deserializer{source};
+
+        windows_emulator new_emu{};
+        new_emu.log.disable_output(true);
+        new_emu.deserialize(deserializer);
+
+        utils::buffer_serializer serializer2{};
+        new_emu.serialize(serializer2);
+
+        ASSERT_EQ(serializer1.get_buffer(), serializer2.get_buffer());
+    }
+
+    TEST(SerializationTest, DeduplicatedMemoryMatchesRawMemory)
+    {
+        auto emu = create_sample_emulator();
+        emu.start({}, 100);
+
+        utils::buffer_serializer serializer1{};
+        emu.serialize(serializer1);
+
+        const auto store = std::make_shared<memory_page_store>();
+        emu.emu().set_page_deduplication(true, store);
+
+        utils::buffer_serializer deduplicated_serializer{};
+        emu.serialize(deduplicated_serializer);
+
+        ASSERT_LT(deduplicated_serializer.get_buffer().size(), serializer1.get_buffer().size());
+
+        utils::buffer_deserializer deserializer{deduplicated_serializer.get_buffer()};
+
+        windows_emulator new_emu{};
+        new_emu.log.disable_output(true);
+        new_emu.emu().set_page_deduplication(false, store);
+        new_emu.deserialize(deserializer);
+
+        utils::buffer_serializer serializer2{};
+        new_emu.serialize(serializer2);
+
+        ASSERT_EQ(serializer1.get_buffer(), serializer2.get_buffer());
+    }
+
+    TEST(SerializationTest, ParallelSerializationRestoresSameState)
+    {
+        auto emu = create_sample_emulator();
+        emu.start({}, 100);
+
+        utils::buffer_serializer serializer1{};
+        emu.serialize(serializer1);
+
+        emu.emu().set_serialization_threads(4);
+
+        utils::buffer_serializer parallel_serializer{};
+        emu.serialize(parallel_serializer);
+
+        utils::buffer_deserializer deserializer{parallel_serializer.get_buffer()};
+
+        windows_emulator new_emu{};
+        new_emu.log.disable_output(true);
+        new_emu.emu().set_serialization_threads(4);
+        new_emu.deserialize(deserializer);
+        new_emu.emu().set_serialization_threads(1);
+
+        utils::buffer_serializer serializer2{};
+        new_emu.serialize(serializer2);
+
+        ASSERT_EQ(serializer1.get_buffer(), serializer2.get_buffer());
+    }
+
+    TEST(SerializationTest, MigrationDeltasRestoreSameState)
+    {
+        auto emu = create_sample_emulator();
+        emu.start({}, 100);
+
+        utils::buffer_serializer base_serializer{};
+        emu.serialize_migration_base(base_serializer);
+
+        emu.start({}, 100);
+
+        utils::buffer_serializer delta_serializer{};
+        emu.serialize_migration_delta(delta_serializer);
+
+        windows_emulator new_emu{};
+        new_emu.log.disable_output(true);
+
+        utils::buffer_deserializer base_deserializer{base_serializer.get_buffer()};
+        new_emu.deserialize(base_deserializer);
+
+        utils::buffer_deserializer delta_deserializer{delta_serializer.get_buffer()};
+        new_emu.deserialize_migration_delta(delta_deserializer);
+
+        utils::buffer_serializer serializer1{};
+        utils::buffer_serializer serializer2{};
+
+        emu.serialize(serializer1);
+        new_emu.serialize(serializer2);
+
+        ASSERT_EQ(serializer1.get_buffer(), serializer2.get_buffer());
+    }
+
+    TEST(SerializationTest, RepeatedMigrationDeltasRestoreSameState)
+    {
+        auto emu = create_sample_emulator();
+        emu.start({}, 100);
+
+        utils::buffer_serializer base_serializer{};
+        emu.serialize_migration_base(base_serializer);
+
+        windows_emulator new_emu{};
+        new_emu.log.disable_output(true);
+
+        utils::buffer_deserializer base_deserializer{base_serializer.get_buffer()};
+        new_emu.deserialize(base_deserializer);
+
+        // Later rounds mostly keep the layout, their pages are written in place
+        for (size_t i = 0; i < 5; ++i)
+        {
+            emu.start({}, 100);
+
+            utils::buffer_serializer delta_serializer{};
+            emu.serialize_migration_delta(delta_serializer);
+
+            utils::buffer_deserializer delta_deserializer{delta_serializer.get_buffer()};
+            new_emu.deserialize_migration_delta(delta_deserializer);
+        }
+
+        utils::buffer_serializer serializer1{};
+        utils::buffer_serializer serializer2{};
+
+        emu.serialize(serializer1);
+        new_emu.serialize(serializer2);
+
+        ASSERT_EQ(serializer1.get_buffer(), serializer2.get_buffer());
+    }
+
+    TEST(SerializationTest, MappedStateFileRestoresSameState)
+    {
+        const auto state_file = std::filesystem::temp_directory_path() / "emulator-state-test.bin";
+
+        auto emu = create_sample_emulator();
+        emu.start({}, 100);
+        emu.save_state_file(state_file);
+
+        utils::buffer_serializer serializer1{};
+        utils::buffer_serializer serializer2{};
+
+        {
+            windows_emulator new_emu{};
+            new_emu.log.disable_output(true);
+            new_emu.load_state_file(state_file);
+
+            new_emu.start();
+            ASSERT_TERMINATED_SUCCESSFULLY(new_emu);
+
+            new_emu.serialize(serializer2);
+        }
+
+        std::error_code ec{};
+        std::filesystem::remove(state_file, ec);
+
+        emu.start();
+        ASSERT_TERMINATED_SUCCESSFULLY(emu);
+
+        emu.serialize(serializer1);
+
+        ASSERT_EQ(serializer1.get_buffer(), serializer2.get_buffer());
+    }
+
+    TEST(SerializationTest, PersistentResetRestoresHeap)
+    {
+        constexpr uint64_t redzone_size = 16;
+
+        auto emu = create_sample_emulator({
+            .disable_logging = true,
+            .use_relative_time = true,
+            .emulate_heap = true,
+            .heap_redzone_size = redzone_size,
+        });
+
+        emu.start({}, 100000);
+
+        auto& heap = emu.process().heap;
+
+        // Creates the arena before the snapshot, so the memory layout stays the same
+        const auto existing = heap.allocate(emu.emu(), 0x20, false);
+        ASSERT_NE(existing, 0);
+
+        emu.save_snapshot();
+
+        const auto discarded = heap.allocate(emu.emu(), 0x20, false);
+        ASSERT_NE(discarded, 0);
+
+        ASSERT_TRUE(emu.reset_to_snapshot());
+        ASSERT_FALSE(heap.get_size(discarded).has_value());
+
+        // The arena position was restored, so the discarded chunk is reused instead of leaked
+        const auto allocated = heap.allocate(emu.emu(), 0x40, false);
+        ASSERT_EQ(allocated, discarded);
+        ASSERT_GE(allocated - redzone_size, existing + 0x20 + redzone_size);
+
+        ASSERT_EQ(heap.release(emu.emu(), existing), heap_status::success);
+        ASSERT_EQ(heap.release(emu.emu(), allocated), heap_status::success);
+    }
+
+    TEST(SerializationTest, PersistentResetRestoresHeapSanitizer)
+    {
+        auto emu = create_sample_emulator({
+            .disable_logging = true,
+            .use_relative_time = true,
+            .sanitize_heap = true,
+        });
+
+        emu.start({}, 100000);
+
+        auto& heap = emu.process().heap;
+        const auto chunk = heap.allocate(emu.emu(), 0x20, false);
+        ASSERT_NE(chunk, 0);
+
+        // mov al, [rax]; jmp $
+        constexpr uint8_t read_code[] = {0x8A, 0x00, 0xEB, 0xFE};
+        const auto code = emu.emu().allocate_memory(0x1000, memory_permission::read | memory_permission::exec);
+        ASSERT_NE(code, 0);
+        emu.emu().write_memory(code, read_code, sizeof(read_code));
+
+        const auto read_chunk = [&] {
+            emu.emu().reg(x64_register::rax, chunk);
+            emu.emu().reg(x64_register::rip, code);
+            emu.start({}, 1);
+        };
+
+        emu.save_snapshot();
+
+        ASSERT_EQ(heap.release(emu.emu(), chunk), heap_status::success);
+        ASSERT_TRUE(emu.reset_to_snapshot());
+
+        // Allocated again after the reset, the quarantine of the discarded input must not report it
+        read_chunk();
+        ASSERT_NOT_TERMINATED(emu);
+
+        ASSERT_EQ(heap.release(emu.emu(), chunk), heap_status::success);
+
+        read_chunk();
+        ASSERT_TERMINATED_WITH_STATUS(emu, STATUS_HEAP_CORRUPTION);
+        ASSERT_EQ(emu.process().exception_rip, code);
+    }
 }
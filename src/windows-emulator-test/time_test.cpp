@@ -39,4 +39,37 @@ namespace test
 
         ASSERT_LE(diff, std::chrono::hours(1));
     }
+
+    TEST(TimeTest, ReplayedTimeMatchesRecording)
+    {
+        const auto recording = std::filesystem::temp_directory_path() / "emulator-time-inputs.bin";
+
+        const auto run_sample = [&](const bool replay) {
+            std::string output_buffer{};
+
+            emulator_settings settings{
+                .arguments = {u"-time"},
+                .stdout_callback = [&output_buffer](const std::string_view data) { output_buffer.append(data); },
+                .disable_logging = true,
+                .use_relative_time = false,
+            };
+
+            (replay ? settings.input_replay_file : settings.input_recording_file) = recording;
+
+            auto emu = create_sample_emulator(std::move(settings));
+            emu.start();
+
+            EXPECT_TRUE(emu.process().exit_status.has_value());
+            return std::make_pair(output_buffer, emu.process().executed_instructions);
+        };
+
+        const auto recorded = run_sample(false);
+        const auto replayed = run_sample(true);
+
+        std::error_code ec{};
+        std::filesystem::remove(recording, ec);
+
+        ASSERT_EQ(recorded.first, replayed.first);
+        ASSERT_EQ(recorded.second, replayed.second);
+    }
 }
@@ -0,0 +1,286 @@
+#include "api_tracer.hpp"
+#include "event_trace.hpp"
+
+#include "module/mapped_module.hpp"
+
+#include <utils/string.hpp>
+
+namespace
+{
+    constexpr size_t REGISTER_ARGUMENTS = 4;
+    constexpr size_t MAX_STRING_LENGTH = 260;
+
+    enum class argument_type : uint8_t
+    {
+        value,
+        ansi_string,
+        wide_string,
+        unicode_string,
+        object_attributes,
+    };
+
+    struct prototype
+    {
+        std::vector<argument_type> arguments{};
+    };
+
+    const std::unordered_map<std::string_view, prototype>& get_prototypes()
+    {
+        using enum argument_type;
+
+        static const std::unordered_map<std::string_view, prototype> prototypes{
+            {"LoadLibraryA", {{ansi_string}}},
+            {"LoadLibraryW", {{wide_string}}},
+            {"LoadLibraryExA", {{ansi_string, value, value}}},
+            {"LoadLibraryExW", {{wide_string, value, value}}},
+            {"GetModuleHandleA", {{ansi_string}}},
+            {"GetModuleHandleW", {{wide_string}}},
+            {"GetProcAddress", {{value, ansi_string}}},
+            {"LdrLoadDll", {{wide_string, value, unicode_string, value}}},
+            {"LdrGetDllHandle", {{wide_string, value, unicode_string, value}}},
+            {"CreateFileA", {{ansi_string, value, value, value, value, value, value}}},
+            {"CreateFileW", {{wide_string, value, value, value, value, value, value}}},
+            {"DeleteFileA", {{ansi_string}}},
+            {"DeleteFileW", {{wide_string}}},
+            {"ReadFile", {{value, value, value, value, value}}},
+            {"WriteFile", {{value, value, value, value, value}}},
+            {"CloseHandle", {{value}}},
+            {"CreateProcessA",
+             {{ansi_string, ansi_string, value, value, value, value, value, ansi_string, value, value}}},
+            {"CreateProcessW",
+             {{wide_string, wide_string, value, value, value, value, value, wide_string, value, value}}},
+            {"OpenProcess", {{value, value, value}}},
+            {"CreateThread", {{value, value, value, value, value, value}}},
+            {"VirtualAlloc", {{value, value, value, value}}},
+            {"VirtualFree", {{value, value, value}}},
+            {"VirtualProtect", {{value, value, value, value}}},
+            {"CreateMutexA", {{value, value, ansi_string}}},
+            {"CreateMutexW", {{value, value, wide_string}}},
+            {"OpenMutexA", {{value, value, ansi_string}}},
+            {"OpenMutexW", {{value, value, wide_string}}},
+            {"CreateEventA", {{value, value, value, ansi_string}}},
+            {"CreateEventW", {{value, value, value, wide_string}}},
+            {"RegOpenKeyExA", {{value, ansi_string, value, value, value}}},
+            {"RegOpenKeyExW", {{value, wide_string, value, value, value}}},
+            {"RegQueryValueExA", {{value, ansi_string, value, value, value, value}}},
+            {"RegQueryValueExW", {{value, wide_string, value, value, value, value}}},
+            {"OutputDebugStringA", {{ansi_string}}},
+            {"OutputDebugStringW", {{wide_string}}},
+            {"Sleep", {{value}}},
+            {"ExitProcess", {{value}}},
+            {"NtCreateFile",
+             {{value, value, object_attributes, value, value, value, value, value, value, value, value}}},
+            {"NtOpenFile", {{value, value, object_attributes, value, value, value}}},
+            {"NtOpenKey", {{value, value, object_attributes}}},
+            {"NtCreateKey", {{value, value, object_attributes, value, value, value, value}}},
+            {"RtlInitUnicodeString", {{value, wide_string}}},
+        };
+
+        return prototypes;
+    }
+
+    bool matches_pattern(const std::string_view pattern, const std::string_view value)
+    {
+        if (!pattern.empty() && pattern.back() == '*')
+        {
+            return value.starts_with(pattern.substr(0, pattern.size() - 1));
+        }
+
+        return pattern == value;
+    }
+
+    template <typename T>
+    std::string read_string(const x64_emulator& emu, const uint64_t address, const size_t max_length)
+    {
+        std::basic_string<T> result{};
+
+        for (size_t i = 0; address && i < max_length; ++i)
+        {
+            T character{};
+            if (!emu.try_read_memory(address + (i * sizeof(T)), &character, sizeof(character)) || !character)
+            {
+                break;
+            }
+
+            result.push_back(character);
+        }
+
+        if constexpr (std::is_same_v<T, char16_t>)
+        {
+            return u16_to_u8(result);
+        }
+        else
+        {
+            return result;
+        }
+    }
+
+    std::string read_unicode_string(const x64_emulator& emu, const uint64_t address)
+    {
+        UNICODE_STRING<EmulatorTraits<Emu64>> ucs{};
+        if (!address || !emu.try_read_memory(address, &ucs, sizeof(ucs)))
+        {
+            return {};
+        }
+
+        return read_string<char16_t>(emu, ucs.Buffer, std::min<size_t>(ucs.Length / 2, MAX_STRING_LENGTH));
+    }
+
+    std::string read_argument_string(const x64_emulator& emu, const argument_type type, const uint64_t value)
+    {
+        switch (type)
+        {
+        case argument_type::ansi_string:
+            return read_string<char>(emu, value, MAX_STRING_LENGTH);
+        case argument_type::wide_string:
+            return read_string<char16_t>(emu, value, MAX_STRING_LENGTH);
+        case argument_type::unicode_string:
+            return read_unicode_string(emu, value);
+        case argument_type::object_attributes: {
+            OBJECT_ATTRIBUTES<EmulatorTraits<Emu64>> attributes{};
+            if (!value || !emu.try_read_memory(value, &attributes, sizeof(attributes)))
+            {
+                return {};
+            }
+
+            return read_unicode_string(emu, attributes.ObjectName);
+        }
+        default:
+            return {};
+        }
+    }
+
+    // Reads the arguments at the entry of the function, before the prolog touched the stack
+    void log_call(x64_emulator& emu, event_trace& trace, const uint64_t address, const std::string_view module_name,
+                  const std::string_view function_name, const prototype* proto)
+    {
+        const auto registers = emu.read_registers(std::array{
+            x64_register::rcx,
+            x64_register::rdx,
+            x64_register::r8,
+            x64_register::r9,
+            x64_register::rsp,
+        });
+
+        const auto rsp = registers[4];
+
+        uint64_t return_address{};
+        (void)emu.try_read_memory(rsp, &return_address, sizeof(return_address));
+
+        const auto count = std::min(proto ? proto->arguments.size() : REGISTER_ARGUMENTS,
+                                    event_trace_format::MAX_API_ARGUMENTS);
+
+        std::array<uint64_t, event_trace_format::MAX_API_ARGUMENTS> arguments{};
+        std::vector<std::string> strings{};
+        uint16_t string_mask{};
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (i < REGISTER_ARGUMENTS)
+            {
+                arguments[i] = registers[i];
+            }
+            else
+            {
+                // Behind the return address and the home space of the register arguments
+                (void)emu.try_read_memory(rsp + ((i + 1) * sizeof(uint64_t)), &arguments[i], sizeof(uint64_t));
+            }
+
+            const auto type = proto ? proto->arguments[i] : argument_type::value;
+            if (type != argument_type::value)
+            {
+                strings.push_back(read_argument_string(emu, type, arguments[i]));
+                string_mask |= static_cast<uint16_t>(1 << i);
+            }
+        }
+
+        trace.log_api_call(address, return_address, module_name, function_name, std::span(arguments).first(count),
+                           string_mask, strings);
+    }
+}
+
+api_tracer::api_tracer(x64_emulator& emu, event_trace& trace, const std::vector<std::string>& filters)
+    : emu_(&emu),
+      trace_(&trace)
+{
+    for (const auto& entry : filters)
+    {
+        const auto separator = entry.find('!');
+
+        filter f{};
+        f.module = separator == std::string::npos ? "*" : utils::string::to_lower(entry.substr(0, separator));
+        f.function = separator == std::string::npos ? entry : entry.substr(separator + 1);
+
+        if (!f.module.empty() && !f.function.empty())
+        {
+            this->filters_.push_back(std::move(f));
+        }
+    }
+}
+
+api_tracer::~api_tracer()
+{
+    for (auto* hook : this->hooks_ | std::views::values)
+    {
+        this->emu_->delete_hook(hook);
+    }
+}
+
+void api_tracer::hook_module(const mapped_module& mod)
+{
+    const auto module_name = utils::string::to_lower(mod.name);
+
+    for (const auto& symbol : mod.exports)
+    {
+        // Forwarded exports don't point into the module
+        if (!mod.is_within(symbol.address) || this->hooks_.contains(symbol.address) ||
+            !this->is_traced(module_name, symbol.name))
+        {
+            continue;
+        }
+
+        const auto entry = get_prototypes().find(symbol.name);
+        const auto* proto = entry == get_prototypes().end() ? nullptr : &entry->second;
+
+        auto* hook = this->emu_->hook_memory_execution(
+            symbol.address, 1,
+            [this, proto, module = mod.name, function = symbol.name](const uint64_t address, size_t, uint64_t) {
+                log_call(*this->emu_, *this->trace_, address, module, function, proto);
+            });
+
+        this->hooks_[symbol.address] = hook;
+    }
+}
+
+void api_tracer::unhook_module(const mapped_module& mod)
+{
+    this->unhook_range(mod.image_base, mod.size_of_image);
+}
+
+void api_tracer::synchronize(const std::map<uint64_t, mapped_module>& modules)
+{
+    this->unhook_range(0, std::numeric_limits<uint64_t>::max());
+
+    for (const auto& mod : modules | std::views::values)
+    {
+        this->hook_module(mod);
+    }
+}
+
+bool api_tracer::is_traced(const std::string_view module_name, const std::string_view function_name) const
+{
+    return std::ranges::any_of(this->filters_, [&](const filter& f) {
+        return matches_pattern(f.module, module_name) && matches_pattern(f.function, function_name);
+    });
+}
+
+void api_tracer::unhook_range(const uint64_t address, const uint64_t size)
+{
+    auto i = this->hooks_.lower_bound(address);
+
+    while (i != this->hooks_.end() && i->first - address < size)
+    {
+        this->emu_->delete_hook(i->second);
+        i = this->hooks_.erase(i);
+    }
+}
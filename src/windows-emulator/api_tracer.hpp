@@ -0,0 +1,46 @@
+#pragma once
+
+#include "std_include.hpp"
+
+#include <x64_emulator.hpp>
+
+struct mapped_module;
+class event_trace;
+
+// Logs calls of the exports matched by the filters into the event trace. Only the entry points of these exports are
+// hooked, so the cost depends on the calls made instead of the instructions executed. Arguments are decoded with
+// the prototypes of well-known functions, other functions get their four register arguments.
+// Filters are "module!function", either part may be a prefix ending in '*'. Filters without a module match
+// functions of every module. Module names are compared case-insensitively.
+class api_tracer
+{
+  public:
+    api_tracer(x64_emulator& emu, event_trace& trace, const std::vector<std::string>& filters);
+    ~api_tracer();
+
+    api_tracer(const api_tracer&) = delete;
+    api_tracer& operator=(const api_tracer&) = delete;
+    api_tracer(api_tracer&&) = delete;
+    api_tracer& operator=(api_tracer&&) = delete;
+
+    void hook_module(const mapped_module& mod);
+    void unhook_module(const mapped_module& mod);
+
+    // Rehooks all given modules, e.g. after deserialization
+    void synchronize(const std::map<uint64_t, mapped_module>& modules);
+
+  private:
+    struct filter
+    {
+        std::string module{};
+        std::string function{};
+    };
+
+    x64_emulator* emu_{};
+    event_trace* trace_{};
+    std::vector<filter> filters_{};
+    std::map<uint64_t, emulator_hook*> hooks_{};
+
+    bool is_traced(std::string_view module_name, std::string_view function_name) const;
+    void unhook_range(uint64_t address, uint64_t size);
+};
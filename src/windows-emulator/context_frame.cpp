@@ -3,149 +3,253 @@
 
 namespace context_frame
 {
+    namespace
+    {
+        // Collects the registers of a context frame, so they are transferred with a single backend call.
+        // Fields of up to 64 bits go through zero extended scalars, wider ones are transferred in place.
+        class register_batch
+        {
+          public:
+            template <typename T>
+            void add(const x64_register reg, T& value)
+            {
+                static_assert(std::is_trivially_copyable_v<std::remove_const_t<T>>);
+
+                auto& entry = this->entries_.at(this->count_);
+                this->registers_.at(this->count_) = reg;
+                ++this->count_;
+
+                entry.target = const_cast<void*>(static_cast<const void*>(&value));
+                entry.size = sizeof(T);
+                entry.scalar = 0;
+
+                if constexpr (sizeof(T) <= sizeof(uint64_t))
+                {
+                    memcpy(&entry.scalar, &value, sizeof(T));
+                }
+            }
+
+            void read(x64_emulator& emu)
+            {
+                std::array<void*, MAX_REGISTERS> values{};
+
+                for (size_t i = 0; i < this->count_; ++i)
+                {
+                    auto& entry = this->entries_[i];
+                    if (entry.is_scalar())
+                    {
+                        values[i] = &entry.scalar;
+                    }
+                    else
+                    {
+                        memset(entry.target, 0, entry.size);
+                        values[i] = entry.target;
+                    }
+                }
+
+                emu.read_registers(this->get_registers(), std::span<void* const>(values.data(), this->count_));
+
+                for (size_t i = 0; i < this->count_; ++i)
+                {
+                    const auto& entry = this->entries_[i];
+                    if (entry.is_scalar())
+                    {
+                        memcpy(entry.target, &entry.scalar, entry.size);
+                    }
+                }
+            }
+
+            void write(x64_emulator& emu) const
+            {
+                std::array<const void*, MAX_REGISTERS> values{};
+
+                for (size_t i = 0; i < this->count_; ++i)
+                {
+                    const auto& entry = this->entries_[i];
+                    values[i] = entry.is_scalar() ? &entry.scalar : entry.target;
+                }
+
+                emu.write_registers(this->get_registers(),
+                                    std::span<const void* const>(values.data(), this->count_));
+            }
+
+          private:
+            static constexpr size_t MAX_REGISTERS = x64_emulator::register_batch_size;
+
+            struct entry
+            {
+                void* target{};
+                size_t size{};
+                uint64_t scalar{};
+
+                bool is_scalar() const
+                {
+                    return this->size <= sizeof(uint64_t);
+                }
+            };
+
+            size_t count_{};
+            std::array<x64_register, MAX_REGISTERS> registers_{};
+            std::array<entry, MAX_REGISTERS> entries_{};
+
+            std::span<const x64_register> get_registers() const
+            {
+                return {this->registers_.data(), this->count_};
+            }
+        };
+    }
+
     void restore(x64_emulator& emu, const CONTEXT64& context)
     {
+        register_batch batch{};
+
         if (context.ContextFlags & CONTEXT_DEBUG_REGISTERS_64)
         {
-            emu.reg(x64_register::dr0, context.Dr0);
-            emu.reg(x64_register::dr1, context.Dr1);
-            emu.reg(x64_register::dr2, context.Dr2);
-            emu.reg(x64_register::dr3, context.Dr3);
-            emu.reg(x64_register::dr6, context.Dr6);
-            emu.reg(x64_register::dr7, context.Dr7);
+            batch.add(x64_register::dr0, context.Dr0);
+            batch.add(x64_register::dr1, context.Dr1);
+            batch.add(x64_register::dr2, context.Dr2);
+            batch.add(x64_register::dr3, context.Dr3);
+            batch.add(x64_register::dr6, context.Dr6);
+            batch.add(x64_register::dr7, context.Dr7);
         }
 
         if (context.ContextFlags & CONTEXT_CONTROL_64)
         {
-            emu.reg<uint16_t>(x64_register::ss, context.SegSs);
-            emu.reg<uint16_t>(x64_register::cs, context.SegCs);
+            batch.add(x64_register::ss, context.SegSs);
+            batch.add(x64_register::cs, context.SegCs);
 
-            emu.reg(x64_register::rip, context.Rip);
-            emu.reg(x64_register::rsp, context.Rsp);
+            batch.add(x64_register::rip, context.Rip);
+            batch.add(x64_register::rsp, context.Rsp);
 
-            emu.reg<uint32_t>(x64_register::eflags, context.EFlags);
+            batch.add(x64_register::eflags, context.EFlags);
         }
 
         if (context.ContextFlags & CONTEXT_INTEGER_64)
         {
-            emu.reg(x64_register::rax, context.Rax);
-            emu.reg(x64_register::rbx, context.Rbx);
-            emu.reg(x64_register::rcx, context.Rcx);
-            emu.reg(x64_register::rdx, context.Rdx);
-            emu.reg(x64_register::rbp, context.Rbp);
-            emu.reg(x64_register::rsi, context.Rsi);
-            emu.reg(x64_register::rdi, context.Rdi);
-            emu.reg(x64_register::r8, context.R8);
-            emu.reg(x64_register::r9, context.R9);
-            emu.reg(x64_register::r10, context.R10);
-            emu.reg(x64_register::r11, context.R11);
-            emu.reg(x64_register::r12, context.R12);
-            emu.reg(x64_register::r13, context.R13);
-            emu.reg(x64_register::r14, context.R14);
-            emu.reg(x64_register::r15, context.R15);
+            batch.add(x64_register::rax, context.Rax);
+            batch.add(x64_register::rbx, context.Rbx);
+            batch.add(x64_register::rcx, context.Rcx);
+            batch.add(x64_register::rdx, context.Rdx);
+            batch.add(x64_register::rbp, context.Rbp);
+            batch.add(x64_register::rsi, context.Rsi);
+            batch.add(x64_register::rdi, context.Rdi);
+            batch.add(x64_register::r8, context.R8);
+            batch.add(x64_register::r9, context.R9);
+            batch.add(x64_register::r10, context.R10);
+            batch.add(x64_register::r11, context.R11);
+            batch.add(x64_register::r12, context.R12);
+            batch.add(x64_register::r13, context.R13);
+            batch.add(x64_register::r14, context.R14);
+            batch.add(x64_register::r15, context.R15);
         }
 
         /*if (context.ContextFlags & CONTEXT_SEGMENTS)
         {
-            emu.reg<uint16_t>(x64_register::ds, context.SegDs);
-            emu.reg<uint16_t>(x64_register::es, context.SegEs);
-            emu.reg<uint16_t>(x64_register::fs, context.SegFs);
-            emu.reg<uint16_t>(x64_register::gs, context.SegGs);
+            batch.add(x64_register::ds, context.SegDs);
+            batch.add(x64_register::es, context.SegEs);
+            batch.add(x64_register::fs, context.SegFs);
+            batch.add(x64_register::gs, context.SegGs);
         }*/
 
         if (context.ContextFlags & CONTEXT_FLOATING_POINT_64)
         {
-            emu.reg<uint16_t>(x64_register::fpcw, context.FltSave.ControlWord);
-            emu.reg<uint16_t>(x64_register::fpsw, context.FltSave.StatusWord);
-            emu.reg<uint16_t>(x64_register::fptag, context.FltSave.TagWord);
+            batch.add(x64_register::fpcw, context.FltSave.ControlWord);
+            batch.add(x64_register::fpsw, context.FltSave.StatusWord);
+            batch.add(x64_register::fptag, context.FltSave.TagWord);
 
             for (int i = 0; i < 8; i++)
             {
                 const auto reg = static_cast<x64_register>(static_cast<int>(x64_register::st0) + i);
-                emu.reg<M128A>(reg, context.FltSave.FloatRegisters[i]);
+                batch.add(reg, context.FltSave.FloatRegisters[i]);
             }
         }
 
         if (context.ContextFlags & CONTEXT_XSTATE_64)
         {
-            emu.reg<uint32_t>(x64_register::mxcsr, context.MxCsr);
+            batch.add(x64_register::mxcsr, context.MxCsr);
 
             for (int i = 0; i < 16; i++)
             {
                 const auto reg = static_cast<x64_register>(static_cast<int>(x64_register::xmm0) + i);
-                emu.reg<M128A>(reg, (&context.Xmm0)[i]);
+                batch.add(reg, (&context.Xmm0)[i]);
             }
         }
+
+        batch.write(emu);
     }
 
     void save(x64_emulator& emu, CONTEXT64& context)
     {
+        register_batch batch{};
+
         if (context.ContextFlags & CONTEXT_DEBUG_REGISTERS_64)
         {
-            context.Dr0 = emu.reg(x64_register::dr0);
-            context.Dr1 = emu.reg(x64_register::dr1);
-            context.Dr2 = emu.reg(x64_register::dr2);
-            context.Dr3 = emu.reg(x64_register::dr3);
-            context.Dr6 = emu.reg(x64_register::dr6);
-            context.Dr7 = emu.reg(x64_register::dr7);
+            batch.add(x64_register::dr0, context.Dr0);
+            batch.add(x64_register::dr1, context.Dr1);
+            batch.add(x64_register::dr2, context.Dr2);
+            batch.add(x64_register::dr3, context.Dr3);
+            batch.add(x64_register::dr6, context.Dr6);
+            batch.add(x64_register::dr7, context.Dr7);
         }
 
         if (context.ContextFlags & CONTEXT_CONTROL_64)
         {
-            context.SegSs = emu.reg<uint16_t>(x64_register::ss);
-            context.SegCs = emu.reg<uint16_t>(x64_register::cs);
-            context.Rip = emu.reg(x64_register::rip);
-            context.Rsp = emu.reg(x64_register::rsp);
-            context.EFlags = emu.reg<uint32_t>(x64_register::eflags);
+            batch.add(x64_register::ss, context.SegSs);
+            batch.add(x64_register::cs, context.SegCs);
+            batch.add(x64_register::rip, context.Rip);
+            batch.add(x64_register::rsp, context.Rsp);
+            batch.add(x64_register::eflags, context.EFlags);
         }
 
         if (context.ContextFlags & CONTEXT_INTEGER_64)
         {
-            context.Rax = emu.reg(x64_register::rax);
-            context.Rbx = emu.reg(x64_register::rbx);
-            context.Rcx = emu.reg(x64_register::rcx);
-            context.Rdx = emu.reg(x64_register::rdx);
-            context.Rbp = emu.reg(x64_register::rbp);
-            context.Rsi = emu.reg(x64_register::rsi);
-            context.Rdi = emu.reg(x64_register::rdi);
-            context.R8 = emu.reg(x64_register::r8);
-            context.R9 = emu.reg(x64_register::r9);
-            context.R10 = emu.reg(x64_register::r10);
-            context.R11 = emu.reg(x64_register::r11);
-            context.R12 = emu.reg(x64_register::r12);
-            context.R13 = emu.reg(x64_register::r13);
-            context.R14 = emu.reg(x64_register::r14);
-            context.R15 = emu.reg(x64_register::r15);
+            batch.add(x64_register::rax, context.Rax);
+            batch.add(x64_register::rbx, context.Rbx);
+            batch.add(x64_register::rcx, context.Rcx);
+            batch.add(x64_register::rdx, context.Rdx);
+            batch.add(x64_register::rbp, context.Rbp);
+            batch.add(x64_register::rsi, context.Rsi);
+            batch.add(x64_register::rdi, context.Rdi);
+            batch.add(x64_register::r8, context.R8);
+            batch.add(x64_register::r9, context.R9);
+            batch.add(x64_register::r10, context.R10);
+            batch.add(x64_register::r11, context.R11);
+            batch.add(x64_register::r12, context.R12);
+            batch.add(x64_register::r13, context.R13);
+            batch.add(x64_register::r14, context.R14);
+            batch.add(x64_register::r15, context.R15);
         }
 
         if (context.ContextFlags & CONTEXT_SEGMENTS_64)
         {
-            context.SegDs = emu.reg<uint16_t>(x64_register::ds);
-            context.SegEs = emu.reg<uint16_t>(x64_register::es);
-            context.SegFs = emu.reg<uint16_t>(x64_register::fs);
-            context.SegGs = emu.reg<uint16_t>(x64_register::gs);
+            batch.add(x64_register::ds, context.SegDs);
+            batch.add(x64_register::es, context.SegEs);
+            batch.add(x64_register::fs, context.SegFs);
+            batch.add(x64_register::gs, context.SegGs);
         }
 
         if (context.ContextFlags & CONTEXT_FLOATING_POINT_64)
         {
-            context.FltSave.ControlWord = emu.reg<uint16_t>(x64_register::fpcw);
-            context.FltSave.StatusWord = emu.reg<uint16_t>(x64_register::fpsw);
-            context.FltSave.TagWord = static_cast<BYTE>(emu.reg<uint16_t>(x64_register::fptag));
+            batch.add(x64_register::fpcw, context.FltSave.ControlWord);
+            batch.add(x64_register::fpsw, context.FltSave.StatusWord);
+            batch.add(x64_register::fptag, context.FltSave.TagWord);
             for (int i = 0; i < 8; i++)
             {
                 const auto reg = static_cast<x64_register>(static_cast<int>(x64_register::st0) + i);
-                context.FltSave.FloatRegisters[i] = emu.reg<M128A>(reg);
+                batch.add(reg, context.FltSave.FloatRegisters[i]);
             }
         }
 
         if (context.ContextFlags & CONTEXT_XSTATE_64)
         {
-            context.MxCsr = emu.reg<uint32_t>(x64_register::mxcsr);
+            batch.add(x64_register::mxcsr, context.MxCsr);
             for (int i = 0; i < 16; i++)
             {
                 const auto reg = static_cast<x64_register>(static_cast<int>(x64_register::xmm0) + i);
-                (&context.Xmm0)[i] = emu.reg<M128A>(reg);
+                batch.add(reg, (&context.Xmm0)[i]);
             }
         }
+
+        batch.read(emu);
     }
 }
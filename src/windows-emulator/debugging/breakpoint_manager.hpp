@@ -0,0 +1,184 @@
+#pragma once
+#include <x64_emulator.hpp>
+#include <memory_watcher.hpp>
+#include "gdb_stub.hpp"
+#include "scoped_hook.hpp"
+
+inline bool is_execution_breakpoint(const breakpoint_type type)
+{
+    return type == breakpoint_type::software || type == breakpoint_type::hardware_exec;
+}
+
+inline memory_operation map_watchpoint_type(const breakpoint_type type)
+{
+    switch (type)
+    {
+    case breakpoint_type::hardware_read:
+        return memory_permission::read;
+    case breakpoint_type::hardware_write:
+        return memory_permission::write;
+    case breakpoint_type::hardware_read_write:
+        return memory_permission::read_write;
+    default:
+        throw std::runtime_error("Bad watchpoint type");
+    }
+}
+
+struct breakpoint_key
+{
+    size_t addr{};
+    size_t size{};
+    breakpoint_type type{};
+
+    bool operator==(const breakpoint_key& other) const
+    {
+        return this->addr == other.addr && this->size == other.size && this->type == other.type;
+    }
+};
+
+template <>
+struct std::hash<breakpoint_key>
+{
+    std::size_t operator()(const breakpoint_key& k) const noexcept
+    {
+        return ((std::hash<size_t>()(k.addr) ^ (std::hash<size_t>()(k.size) << 1)) >> 1) ^
+               (std::hash<size_t>()(static_cast<size_t>(k.type)) << 1);
+    }
+};
+
+// Checks all execution breakpoints from a single block hook and multiplexes watchpoints through a
+// memory_watcher, so the hook count doesn't grow with the number of breakpoints.
+// A block with a breakpoint at its start stops before it executes. A block with a breakpoint
+// inside stops as well and is reported as pending, it then has to be stepped through.
+// Breakpoints must only be changed while the emulator is stopped.
+class breakpoint_manager
+{
+  public:
+    struct address_range
+    {
+        uint64_t start{};
+        uint64_t end{};
+    };
+
+    breakpoint_manager(x64_emulator& emu)
+        : emu_(&emu),
+          watcher_(emu)
+    {
+    }
+
+    bool add(const breakpoint_type type, const size_t addr, const size_t size)
+    {
+        if (!is_execution_breakpoint(type))
+        {
+            const breakpoint_key key{addr, size, type};
+            if (this->watchpoints_.contains(key))
+            {
+                return true;
+            }
+
+            this->watchpoints_[key] = this->watcher_.watch(addr, size, map_watchpoint_type(type),
+                                                           [this](uint64_t, size_t, uint64_t, memory_operation) {
+                                                               this->emu_->stop(); //
+                                                           });
+            return true;
+        }
+
+        const auto is_first = this->execution_breakpoints_.empty();
+        ++this->execution_breakpoints_[addr];
+
+        if (is_first)
+        {
+            auto* hook = this->emu_->hook_basic_block([this](const basic_block& block) {
+                this->on_block(block); //
+            });
+
+            this->block_hook_ = scoped_hook(*this->emu_, hook);
+        }
+
+        return true;
+    }
+
+    bool remove(const breakpoint_type type, const size_t addr, const size_t size)
+    {
+        if (!is_execution_breakpoint(type))
+        {
+            const auto entry = this->watchpoints_.find({addr, size, type});
+            if (entry == this->watchpoints_.end())
+            {
+                return false;
+            }
+
+            this->watcher_.unwatch(entry->second);
+            this->watchpoints_.erase(entry);
+            return true;
+        }
+
+        const auto entry = this->execution_breakpoints_.find(addr);
+        if (entry == this->execution_breakpoints_.end())
+        {
+            return false;
+        }
+
+        if (--entry->second == 0)
+        {
+            this->execution_breakpoints_.erase(entry);
+        }
+
+        if (this->execution_breakpoints_.empty())
+        {
+            this->block_hook_.remove();
+        }
+
+        return true;
+    }
+
+    bool is_breakpoint(const uint64_t address) const
+    {
+        return this->execution_breakpoints_.contains(address);
+    }
+
+    // Disables the block checks, e.g. while stepping through a pending block
+    void suspend(const bool value)
+    {
+        this->suspended_ = value;
+    }
+
+    std::optional<address_range> take_pending_block()
+    {
+        return std::exchange(this->pending_block_, std::nullopt);
+    }
+
+  private:
+    x64_emulator* emu_{};
+
+    std::map<uint64_t, size_t> execution_breakpoints_{};
+    scoped_hook block_hook_{};
+    bool suspended_{false};
+    std::optional<address_range> pending_block_{};
+
+    memory_watcher watcher_;
+    std::unordered_map<breakpoint_key, memory_watcher::watch_id> watchpoints_{};
+
+    void on_block(const basic_block& block)
+    {
+        if (this->suspended_)
+        {
+            return;
+        }
+
+        const auto end = block.address + std::max(block.size, static_cast<size_t>(1));
+
+        const auto breakpoint = this->execution_breakpoints_.lower_bound(block.address);
+        if (breakpoint == this->execution_breakpoints_.end() || breakpoint->first >= end)
+        {
+            return;
+        }
+
+        if (breakpoint->first != block.address)
+        {
+            this->pending_block_ = address_range{block.address, end};
+        }
+
+        this->emu_->stop();
+    }
+};
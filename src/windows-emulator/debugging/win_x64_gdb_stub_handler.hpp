@@ -12,32 +12,10 @@ class win_x64_gdb_stub_handler : public x64_gdb_stub_handler
     {
     }
 
-    gdb_action cont() override
+  protected:
+    void start(const size_t count) override
     {
-        try
-        {
-            this->win_emu_->start();
-        }
-        catch (const std::exception& e)
-        {
-            puts(e.what());
-        }
-
-        return gdb_action::resume;
-    }
-
-    gdb_action stepi() override
-    {
-        try
-        {
-            this->win_emu_->start({}, 1);
-        }
-        catch (const std::exception& e)
-        {
-            puts(e.what());
-        }
-
-        return gdb_action::resume;
+        this->win_emu_->start({}, count);
     }
 
   private:
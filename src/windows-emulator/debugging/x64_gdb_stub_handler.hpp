@@ -1,8 +1,9 @@
 #pragma once
 #include <x64_emulator.hpp>
 #include "gdb_stub.hpp"
-#include "scoped_hook.hpp"
-#include <utils/concurrency.hpp>
+#include "breakpoint_manager.hpp"
+#include <address_utils.hpp>
+#include <utils/finally.hpp>
 
 inline std::vector gdb_registers{
     x64_register::rax, x64_register::rbx, x64_register::rcx, x64_register::rdx, x64_register::rsi, x64_register::rdi,
@@ -16,51 +17,12 @@ inline std::vector gdb_registers{
     x64_register::gs,*/
 };
 
-inline memory_operation map_breakpoint_type(const breakpoint_type type)
-{
-    switch (type)
-    {
-    case breakpoint_type::software:
-    case breakpoint_type::hardware_exec:
-        return memory_operation::exec;
-    case breakpoint_type::hardware_read:
-        return memory_permission::read;
-    case breakpoint_type::hardware_write:
-        return memory_permission::write;
-    case breakpoint_type::hardware_read_write:
-        return memory_permission::read_write;
-    default:
-        throw std::runtime_error("Bad bp type");
-    }
-}
-
-struct breakpoint_key
-{
-    size_t addr{};
-    size_t size{};
-    breakpoint_type type{};
-
-    bool operator==(const breakpoint_key& other) const
-    {
-        return this->addr == other.addr && this->size == other.size && this->type == other.type;
-    }
-};
-
-template <>
-struct std::hash<breakpoint_key>
-{
-    std::size_t operator()(const breakpoint_key& k) const noexcept
-    {
-        return ((std::hash<size_t>()(k.addr) ^ (std::hash<size_t>()(k.size) << 1)) >> 1) ^
-               (std::hash<size_t>()(static_cast<size_t>(k.type)) << 1);
-    }
-};
-
 class x64_gdb_stub_handler : public gdb_stub_handler
 {
   public:
     x64_gdb_stub_handler(x64_emulator& emu)
-        : emu_(&emu)
+        : emu_(&emu),
+          breakpoints_(emu)
     {
     }
 
@@ -68,9 +30,11 @@ class x64_gdb_stub_handler : public gdb_stub_handler
 
     gdb_action cont() override
     {
+        this->invalidate_caches();
+
         try
         {
-            this->emu_->start_from_ip();
+            this->run_to_breakpoint();
         }
         catch (const std::exception& e)
         {
@@ -82,9 +46,14 @@ class x64_gdb_stub_handler : public gdb_stub_handler
 
     gdb_action stepi() override
     {
+        this->invalidate_caches();
+
+        this->breakpoints_.suspend(true);
+        const auto _ = utils::finally([this] { this->breakpoints_.suspend(false); });
+
         try
         {
-            this->emu_->start_from_ip({}, 1);
+            this->start(1);
         }
         catch (const std::exception& e)
         {
@@ -105,7 +74,7 @@ class x64_gdb_stub_handler : public gdb_stub_handler
                 return true;
             }
 
-            this->emu_->read_register(gdb_registers[regno], value, sizeof(*value));
+            *value = this->get_registers()[regno];
             return true;
         }
         catch (...)
@@ -124,6 +93,12 @@ class x64_gdb_stub_handler : public gdb_stub_handler
             }
 
             this->emu_->write_register(gdb_registers[regno], &value, sizeof(value));
+
+            if (!this->register_cache_.empty())
+            {
+                this->register_cache_[regno] = value;
+            }
+
             return true;
         }
         catch (...)
@@ -134,11 +109,36 @@ class x64_gdb_stub_handler : public gdb_stub_handler
 
     bool read_mem(const size_t addr, const size_t len, void* val) override
     {
-        return this->emu_->try_read_memory(addr, val, len);
+        if (len > MEMORY_CACHE_SIZE)
+        {
+            return this->emu_->try_read_memory(addr, val, len);
+        }
+
+        auto* buffer = static_cast<std::byte*>(val);
+
+        for (size_t offset = 0; offset < len;)
+        {
+            const auto address = addr + offset;
+            const auto* page = this->get_cached_page(address);
+            if (!page)
+            {
+                return this->emu_->try_read_memory(address, buffer + offset, len - offset);
+            }
+
+            const auto page_offset = static_cast<size_t>(address - this->cached_page_address_);
+            const auto size = std::min(len - offset, MEMORY_CACHE_SIZE - page_offset);
+
+            memcpy(buffer + offset, page + page_offset, size);
+            offset += size;
+        }
+
+        return true;
     }
 
     bool write_mem(const size_t addr, const size_t len, void* val) override
     {
+        this->memory_cache_valid_ = false;
+
         try
         {
             this->emu_->write_memory(addr, val, len);
@@ -154,15 +154,7 @@ class x64_gdb_stub_handler : public gdb_stub_handler
     {
         try
         {
-            return this->hooks_.access<bool>([&](hook_map& hooks) {
-                hooks[{addr, size, type}] = scoped_hook(
-                    *this->emu_, this->emu_->hook_memory_access(addr, size, map_breakpoint_type(type),
-                                                                [this](uint64_t, size_t, uint64_t, memory_operation) {
-                                                                    this->on_interrupt(); //
-                                                                }));
-
-                return true;
-            });
+            return this->breakpoints_.add(type, addr, size);
         }
         catch (...)
         {
@@ -174,17 +166,7 @@ class x64_gdb_stub_handler : public gdb_stub_handler
     {
         try
         {
-            return this->hooks_.access<bool>([&](hook_map& hooks) {
-                const auto entry = hooks.find({addr, size, type});
-                if (entry == hooks.end())
-                {
-                    return false;
-                }
-
-                hooks.erase(entry);
-
-                return true;
-            });
+            return this->breakpoints_.remove(type, addr, size);
         }
         catch (...)
         {
@@ -197,9 +179,100 @@ class x64_gdb_stub_handler : public gdb_stub_handler
         this->emu_->stop();
     }
 
+  protected:
+    // Runs the target for the given number of instructions, without limit if zero
+    virtual void start(const size_t count)
+    {
+        this->emu_->start_from_ip({}, count);
+    }
+
+    // Everything gdb reads while the target is stopped is cached, resuming it drops the caches
+    void invalidate_caches()
+    {
+        this->register_cache_.clear();
+        this->memory_cache_valid_ = false;
+    }
+
   private:
+    static constexpr size_t MEMORY_CACHE_SIZE = 0x1000;
+
     x64_emulator* emu_{};
+    breakpoint_manager breakpoints_;
+
+    // gdb requests registers one by one, they are read all at once on the first request
+    std::vector<uint64_t> register_cache_{};
+
+    uint64_t cached_page_address_{};
+    bool memory_cache_valid_{false};
+    std::array<std::byte, MEMORY_CACHE_SIZE> memory_cache_{};
+
+    const std::vector<uint64_t>& get_registers()
+    {
+        if (this->register_cache_.empty())
+        {
+            this->register_cache_.resize(gdb_registers.size());
+
+            for (size_t i = 0; i < gdb_registers.size(); ++i)
+            {
+                this->emu_->read_register(gdb_registers[i], &this->register_cache_[i], sizeof(uint64_t));
+            }
+        }
+
+        return this->register_cache_;
+    }
+
+    void run_to_breakpoint()
+    {
+        while (true)
+        {
+            this->start(0);
+
+            const auto block = this->breakpoints_.take_pending_block();
+            if (!block)
+            {
+                return;
+            }
+
+            // The breakpoint is inside the block, step to it without the block checks stopping every step
+            this->breakpoints_.suspend(true);
+            const auto _ = utils::finally([this] { this->breakpoints_.suspend(false); });
+
+            while (true)
+            {
+                const auto address = this->emu_->read_instruction_pointer();
+                if (this->breakpoints_.is_breakpoint(address))
+                {
+                    return;
+                }
+
+                if (address < block->start || address >= block->end)
+                {
+                    break;
+                }
+
+                this->start(1);
+
+                if (this->emu_->read_instruction_pointer() == address)
+                {
+                    return;
+                }
+            }
+        }
+    }
+
+    // Returns null if the page is not entirely readable
+    const std::byte* get_cached_page(const uint64_t address)
+    {
+        const auto page_address = page_align_down(address, MEMORY_CACHE_SIZE);
+
+        if (!this->memory_cache_valid_ || this->cached_page_address_ != page_address)
+        {
+            this->memory_cache_valid_ =
+                this->emu_->try_read_memory(page_address, this->memory_cache_.data(), this->memory_cache_.size());
+            this->cached_page_address_ = page_address;
+        }
+
+        return this->memory_cache_valid_ ? this->memory_cache_.data() : nullptr;
+    }
 
-    using hook_map = std::unordered_map<breakpoint_key, scoped_hook>;
-    utils::concurrency::container<hook_map> hooks_{};
 };
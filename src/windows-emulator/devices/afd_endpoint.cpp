@@ -3,14 +3,19 @@
 
 #include "../windows_emulator.hpp"
 #include "../syscall_utils.hpp"
+#include "../socket_provider.hpp"
 
 #include <network/address.hpp>
 #include <network/socket.hpp>
+#include <network/poller.hpp>
 
 #include <utils/finally.hpp>
 
 namespace
 {
+    constexpr ULONG MAX_BUFFER_COUNT = 1024;
+    constexpr uint64_t MAX_DATAGRAM_SIZE = 0x10000;
+
     struct afd_creation_data
     {
         uint64_t unk1;
@@ -32,6 +37,64 @@ namespace
         return win_emu.emu().read_memory<afd_creation_data>(data.buffer);
     }
 
+    std::optional<std::vector<EMU_WSABUF<EmulatorTraits<Emu64>>>> read_buffer_array(const x64_emulator& emu,
+                                                                                   const uint64_t address,
+                                                                                   const ULONG count)
+    {
+        if (!address || !count || count > MAX_BUFFER_COUNT)
+        {
+            return std::nullopt;
+        }
+
+        std::vector<EMU_WSABUF<EmulatorTraits<Emu64>>> buffers(count);
+        emu.read_memory(address, buffers.data(), buffers.size() * sizeof(buffers.front()));
+
+        uint64_t total_size = 0;
+        for (const auto& buffer : buffers)
+        {
+            if (buffer.len && !buffer.buf)
+            {
+                return std::nullopt;
+            }
+
+            total_size += buffer.len;
+        }
+
+        if (!total_size || total_size > MAX_DATAGRAM_SIZE)
+        {
+            return std::nullopt;
+        }
+
+        return buffers;
+    }
+
+    // Transfers go straight through views of guest memory, buffers without host views are staged in the fallback
+    template <typename View, typename GetView>
+    std::vector<View> get_buffer_views(const std::vector<EMU_WSABUF<EmulatorTraits<Emu64>>>& buffers,
+                                       const GetView& get_view)
+    {
+        std::vector<View> views{};
+        views.reserve(buffers.size());
+
+        for (const auto& buffer : buffers)
+        {
+            if (!buffer.len)
+            {
+                continue;
+            }
+
+            const auto view = get_view(buffer.buf, static_cast<size_t>(buffer.len));
+            if (view.size() != buffer.len)
+            {
+                return {};
+            }
+
+            views.push_back(view);
+        }
+
+        return views;
+    }
+
     std::pair<AFD_POLL_INFO64, std::vector<AFD_POLL_HANDLE_INFO64>> get_poll_info(windows_emulator& win_emu,
                                                                                   const io_device_context& c)
     {
@@ -125,23 +188,51 @@ namespace
     }
 
     NTSTATUS perform_poll(windows_emulator& win_emu, const io_device_context& c,
-                          const std::span<const SOCKET> endpoints,
+                          const std::span<const emulated_socket* const> endpoints,
                           const std::span<const AFD_POLL_HANDLE_INFO64> handles)
     {
         std::vector<pollfd> poll_data{};
         poll_data.resize(endpoints.size());
 
+        std::vector<pollfd> host_poll_data{};
+        std::vector<size_t> host_indices{};
+
+        int count = 0;
+
         for (size_t i = 0; i < endpoints.size() && i < handles.size(); ++i)
         {
             auto& pfd = poll_data.at(i);
             auto& handle = handles[i];
 
-            pfd.fd = endpoints[i];
             pfd.events = map_afd_request_events_to_socket(handle.PollEvents);
-            pfd.revents = pfd.events;
+            pfd.revents = 0;
+
+            // Host sockets are polled in one batch, in-process sockets answer directly
+            if (const auto host_socket = endpoints[i]->get_host_socket())
+            {
+                pollfd host_pfd = pfd;
+                host_pfd.fd = *host_socket;
+
+                host_poll_data.push_back(host_pfd);
+                host_indices.push_back(i);
+            }
+            else
+            {
+                pfd.revents = endpoints[i]->poll_events(pfd.events);
+                count += pfd.revents ? 1 : 0;
+            }
+        }
+
+        if (!host_poll_data.empty() &&
+            poll(host_poll_data.data(), static_cast<uint32_t>(host_poll_data.size()), 0) > 0)
+        {
+            for (size_t i = 0; i < host_poll_data.size(); ++i)
+            {
+                poll_data.at(host_indices[i]).revents = host_poll_data[i].revents;
+                count += host_poll_data[i].revents ? 1 : 0;
+            }
         }
 
-        const auto count = poll(poll_data.data(), static_cast<uint32_t>(poll_data.size()), 0);
         if (count <= 0)
         {
             return STATUS_PENDING;
@@ -168,8 +259,6 @@ namespace
             break;
         }
 
-        assert(current_index == static_cast<size_t>(count));
-
         emulator_object<AFD_POLL_INFO64>{win_emu.emu(), c.input_buffer}.access(
             [&](AFD_POLL_INFO64& info) { info.NumberOfHandles = static_cast<ULONG>(current_index); });
 
@@ -180,34 +269,46 @@ namespace
     {
         bool executing_delayed_ioctl_{};
         std::optional<afd_creation_data> creation_data{};
-        std::optional<SOCKET> s_{};
+        std::unique_ptr<emulated_socket> s_{};
         std::optional<bool> require_poll_{};
         std::optional<io_device_context> delayed_ioctl_{};
         std::optional<std::chrono::steady_clock::time_point> timeout_{};
+        network::poller* poller_{};
 
-        afd_endpoint()
-        {
-            network::initialize_wsa();
-        }
+        afd_endpoint() = default;
 
         afd_endpoint(afd_endpoint&&) = delete;
         afd_endpoint& operator=(afd_endpoint&&) = delete;
 
         ~afd_endpoint() override
         {
-            if (this->s_)
+            this->release_socket();
+        }
+
+        void release_socket()
+        {
+            if (!this->s_)
+            {
+                return;
+            }
+
+            const auto host_socket = this->s_->get_host_socket();
+            if (this->poller_ && host_socket)
             {
-                closesocket(*this->s_);
+                this->poller_->unwatch(*host_socket);
             }
+
+            this->poller_ = {};
+            this->s_ = {};
         }
 
         void create(windows_emulator& win_emu, const io_device_creation_data& data) override
         {
             this->creation_data = get_creation_data(win_emu, data);
-            this->setup();
+            this->setup(win_emu);
         }
 
-        void setup()
+        void setup(windows_emulator& win_emu)
         {
             if (!this->creation_data)
             {
@@ -215,17 +316,7 @@ namespace
             }
 
             const auto& data = *this->creation_data;
-
-            // TODO: values map to windows values; might not be the case for other platforms
-            const auto sock = socket(data.address_family, data.type, data.protocol);
-            if (sock == INVALID_SOCKET)
-            {
-                throw std::runtime_error("Failed to create socket!");
-            }
-
-            network::socket::set_blocking(sock, false);
-
-            this->s_ = sock;
+            this->s_ = win_emu.get_socket_provider().create_socket(data.address_family, data.type, data.protocol);
         }
 
         void delay_ioctrl(const io_device_context& c,
@@ -244,11 +335,44 @@ namespace
 
         void clear_pending_state()
         {
+            const auto host_socket = this->s_ ? this->s_->get_host_socket() : std::nullopt;
+            if (this->poller_ && host_socket)
+            {
+                this->poller_->unwatch(*host_socket);
+            }
+
+            this->poller_ = {};
             this->timeout_ = {};
             this->require_poll_ = {};
             this->delayed_ioctl_ = {};
         }
 
+        bool is_socket_ready(windows_emulator& win_emu)
+        {
+            const auto in_poll = *this->require_poll_;
+            const auto host_socket = this->s_->get_host_socket();
+
+            if (!host_socket)
+            {
+                return this->s_->poll_events(in_poll ? POLLIN : POLLOUT) != 0;
+            }
+
+            auto& poller = win_emu.socket_poller();
+
+            if (poller.is_watching(*host_socket, in_poll))
+            {
+                return poller.is_ready(*host_socket);
+            }
+
+            // Newly watched sockets are only reported by the next wait, check them directly once
+            if (poller.watch(*host_socket, in_poll))
+            {
+                this->poller_ = &poller;
+            }
+
+            return network::socket::is_socket_ready(*host_socket, in_poll);
+        }
+
         void work(windows_emulator& win_emu) override
         {
             if (!this->delayed_ioctl_ || !this->s_)
@@ -261,8 +385,7 @@ namespace
 
             if (this->require_poll_.has_value())
             {
-                const auto is_ready = network::socket::is_socket_ready(*this->s_, *this->require_poll_);
-                if (!is_ready)
+                if (!this->is_socket_ready(win_emu))
                 {
                     return;
                 }
@@ -271,7 +394,7 @@ namespace
             const auto status = this->execute_ioctl(win_emu, *this->delayed_ioctl_);
             if (status == STATUS_PENDING)
             {
-                if (!this->timeout_ || this->timeout_ > std::chrono::steady_clock::now())
+                if (!this->timeout_ || this->timeout_ > win_emu.process().clock.steady_now())
                 {
                     return;
                 }
@@ -283,15 +406,50 @@ namespace
             if (e)
             {
                 e->signaled = true;
+                win_emu.process().signal_waiters();
             }
 
+            const auto& status_block = this->delayed_ioctl_->io_status_block;
+            const auto block = status_block ? status_block.read() : IO_STATUS_BLOCK<EmulatorTraits<Emu64>>{};
+            win_emu.process().queue_io_completion(this->delayed_ioctl_->file_handle, this->delayed_ioctl_->apc_context,
+                                                  block.Status, block.Information);
+
             this->clear_pending_state();
         }
 
+        void collect_wakeup(io_device_wakeup& wakeup) const override
+        {
+            if (!this->delayed_ioctl_ || !this->s_)
+            {
+                return;
+            }
+
+            if (this->timeout_ && (!wakeup.deadline || *this->timeout_ < *wakeup.deadline))
+            {
+                wakeup.deadline = *this->timeout_;
+            }
+
+            if (this->require_poll_.has_value())
+            {
+                // In-process sockets only become ready through guest activity
+                if (const auto host_socket = this->s_->get_host_socket())
+                {
+                    wakeup.sockets.emplace_back(static_cast<uint64_t>(*host_socket), *this->require_poll_);
+                }
+            }
+            else
+            {
+                wakeup.needs_polling = true;
+            }
+        }
+
         void deserialize(utils::buffer_deserializer& buffer) override
         {
+            auto& win_emu = buffer.read<windows_emulator_wrapper>().get();
+
             buffer.read(this->creation_data);
-            this->setup();
+            this->release_socket();
+            this->setup(win_emu);
 
             buffer.read(this->require_poll_);
             buffer.read(this->delayed_ioctl_);
@@ -353,7 +511,7 @@ namespace
 
             const network::address addr(address, address_size);
 
-            if (bind(*this->s_, &addr.get_addr(), addr.get_size()) == SOCKET_ERROR)
+            if (!this->s_->bind(addr))
             {
                 return STATUS_ADDRESS_ALREADY_ASSOCIATED;
             }
@@ -361,12 +519,12 @@ namespace
             return STATUS_SUCCESS;
         }
 
-        static std::vector<SOCKET> resolve_endpoints(windows_emulator& win_emu,
-                                                     const std::span<const AFD_POLL_HANDLE_INFO64> handles)
+        static std::vector<const emulated_socket*> resolve_endpoints(
+            windows_emulator& win_emu, const std::span<const AFD_POLL_HANDLE_INFO64> handles)
         {
             auto& proc = win_emu.process();
 
-            std::vector<SOCKET> endpoints{};
+            std::vector<const emulated_socket*> endpoints{};
             endpoints.reserve(handles.size());
 
             for (const auto& handle : handles)
@@ -383,7 +541,7 @@ namespace
                     throw std::runtime_error("Device is not an AFD endpoint!");
                 }
 
-                endpoints.push_back(*endpoint->s_);
+                endpoints.push_back(endpoint->s_.get());
             }
 
             return endpoints;
@@ -410,7 +568,7 @@ namespace
                 std::optional<std::chrono::steady_clock::time_point> timeout{};
                 if (info.Timeout.QuadPart != std::numeric_limits<int64_t>::max())
                 {
-                    timeout = convert_delay_interval_to_time_point(info.Timeout);
+                    timeout = convert_delay_interval_to_time_point(win_emu.process().clock, info.Timeout);
                 }
 
                 this->delay_ioctrl(c, timeout);
@@ -429,9 +587,7 @@ namespace
             }
 
             const auto receive_info = emu.read_memory<AFD_RECV_DATAGRAM_INFO<EmulatorTraits<Emu64>>>(c.input_buffer);
-            const auto buffer = emu.read_memory<EMU_WSABUF<EmulatorTraits<Emu64>>>(receive_info.BufferArray);
-
-            std::vector<std::byte> address{};
+            const auto buffers = read_buffer_array(emu, receive_info.BufferArray, receive_info.BufferCount);
 
             unsigned long address_length = 0x1000;
             if (receive_info.AddressLength)
@@ -439,46 +595,65 @@ namespace
                 address_length = emu.read_memory<ULONG>(receive_info.AddressLength);
             }
 
-            address.resize(std::clamp(address_length, 1UL, 0x1000UL));
+            address_length = std::clamp(address_length, 1UL, 0x1000UL);
 
-            if (!buffer.len || buffer.len > 0x10000 || !buffer.buf)
+            if (!buffers)
             {
                 return STATUS_INVALID_PARAMETER;
             }
 
-            auto fromlength = static_cast<socklen_t>(address.size());
-
-            std::vector<char> data{};
-            data.resize(buffer.len);
+            auto views =
+                get_buffer_views<std::span<std::byte>>(*buffers, [&](const uint64_t address, const size_t size) {
+                    return emu.get_writable_view(address, size); //
+                });
 
-            const auto recevied_data = recvfrom(*this->s_, data.data(), static_cast<send_size>(data.size()), 0,
-                                                reinterpret_cast<sockaddr*>(address.data()), &fromlength);
-
-            if (recevied_data < 0)
+            std::vector<std::byte> staging{};
+            if (views.empty())
             {
-                const auto error = GET_SOCKET_ERROR();
-                if (error == SOCK_WOULDBLOCK)
+                for (const auto& buffer : *buffers)
                 {
-                    this->delay_ioctrl(c, {}, true);
-                    return STATUS_PENDING;
+                    staging.resize(staging.size() + buffer.len);
                 }
 
+                views.emplace_back(staging);
+            }
+
+            network::address source{};
+            const auto result = this->s_->receive_from_buffers(source, views);
+
+            if (result.status == socket_transfer_status::would_block)
+            {
+                this->delay_ioctrl(c, {}, true);
+                return STATUS_PENDING;
+            }
+
+            if (result.status != socket_transfer_status::success)
+            {
                 return STATUS_UNSUCCESSFUL;
             }
 
-            const auto data_size = std::min(data.size(), static_cast<size_t>(recevied_data));
-            emu.write_memory(buffer.buf, data.data(), data_size);
+            if (!staging.empty())
+            {
+                auto remaining = std::span(staging).first(std::min(staging.size(), result.size));
+                for (const auto& buffer : *buffers)
+                {
+                    const auto size = std::min(static_cast<size_t>(buffer.len), remaining.size());
+                    emu.write_memory(buffer.buf, remaining.data(), size);
+                    remaining = remaining.subspan(size);
+                }
+            }
 
             if (receive_info.Address && address_length)
             {
-                const auto address_size = std::min(address.size(), static_cast<size_t>(address_length));
-                emu.write_memory(receive_info.Address, address.data(), address_size);
+                const auto address_size = std::min(static_cast<size_t>(source.get_size()),
+                                                   static_cast<size_t>(address_length));
+                emu.write_memory(receive_info.Address, &source.get_addr(), address_size);
             }
 
             if (c.io_status_block)
             {
                 IO_STATUS_BLOCK<EmulatorTraits<Emu64>> block{};
-                block.Information = static_cast<uint32_t>(recevied_data);
+                block.Information = static_cast<uint32_t>(result.size);
                 c.io_status_block.write(block);
             }
 
@@ -487,7 +662,7 @@ namespace
 
         NTSTATUS ioctl_send_datagram(windows_emulator& win_emu, const io_device_context& c)
         {
-            const auto& emu = win_emu.emu();
+            auto& emu = win_emu.emu();
 
             if (c.input_buffer_length < sizeof(AFD_SEND_DATAGRAM_INFO<EmulatorTraits<Emu64>>))
             {
@@ -495,7 +670,11 @@ namespace
             }
 
             const auto send_info = emu.read_memory<AFD_SEND_DATAGRAM_INFO<EmulatorTraits<Emu64>>>(c.input_buffer);
-            const auto buffer = emu.read_memory<EMU_WSABUF<EmulatorTraits<Emu64>>>(send_info.BufferArray);
+            const auto buffers = read_buffer_array(emu, send_info.BufferArray, send_info.BufferCount);
+            if (!buffers)
+            {
+                return STATUS_INVALID_PARAMETER;
+            }
 
             const auto address = emu.read_memory(send_info.TdiConnInfo.RemoteAddress,
                                                  static_cast<size_t>(send_info.TdiConnInfo.RemoteAddressLength));
@@ -503,28 +682,40 @@ namespace
             const network::address target(reinterpret_cast<const sockaddr*>(address.data()),
                                           static_cast<socklen_t>(address.size()));
 
-            const auto data = emu.read_memory(buffer.buf, buffer.len);
-
-            const auto sent_data =
-                sendto(*this->s_, reinterpret_cast<const char*>(data.data()), static_cast<send_size>(data.size()),
-                       0 /* ? */, &target.get_addr(), target.get_size());
+            auto views =
+                get_buffer_views<std::span<const std::byte>>(*buffers, [&](const uint64_t address, const size_t size) {
+                    return emu.get_readable_view(address, size); //
+                });
 
-            if (sent_data < 0)
+            std::vector<std::byte> staging{};
+            if (views.empty())
             {
-                const auto error = GET_SOCKET_ERROR();
-                if (error == SOCK_WOULDBLOCK)
+                for (const auto& buffer : *buffers)
                 {
-                    this->delay_ioctrl(c, {}, false);
-                    return STATUS_PENDING;
+                    const auto data = emu.read_memory(buffer.buf, buffer.len);
+                    staging.insert(staging.end(), data.begin(), data.end());
                 }
 
+                views.emplace_back(staging);
+            }
+
+            const auto result = this->s_->send_to_buffers(target, views);
+
+            if (result.status == socket_transfer_status::would_block)
+            {
+                this->delay_ioctrl(c, {}, false);
+                return STATUS_PENDING;
+            }
+
+            if (result.status != socket_transfer_status::success)
+            {
                 return STATUS_UNSUCCESSFUL;
             }
 
             if (c.io_status_block)
             {
                 IO_STATUS_BLOCK<EmulatorTraits<Emu64>> block{};
-                block.Information = static_cast<uint32_t>(sent_data);
+                block.Information = static_cast<uint32_t>(result.size);
                 c.io_status_block.write(block);
             }
 
@@ -0,0 +1,482 @@
+#include "emulated_heap.hpp"
+
+#include <address_utils.hpp>
+
+namespace
+{
+    constexpr uint64_t ARENA_SIZE = 16ULL * 1024 * 1024;
+    constexpr uint64_t DEDICATED_THRESHOLD = ARENA_SIZE / 4;
+    constexpr uint64_t CHUNK_ALIGNMENT = 0x10;
+    constexpr auto REDZONE_FILL = static_cast<std::byte>(0xFD);
+
+    // Freed chunks are recycled once the quarantine exceeds this, use after free goes unnoticed past it
+    constexpr uint64_t QUARANTINE_LIMIT = 64ULL * 1024 * 1024;
+    constexpr uint64_t GRANULE_SHIFT = 4;
+    constexpr uint64_t SHADOW_PAGE_SHIFT = 8;
+    constexpr uint64_t SHADOW_PAGE_MASK = (1ULL << SHADOW_PAGE_SHIFT) - 1;
+
+    std::vector<std::byte> get_redzone_pattern(const uint64_t size)
+    {
+        return std::vector<std::byte>(static_cast<size_t>(size), REDZONE_FILL);
+    }
+}
+
+void emulated_heap::enable(const uint64_t redzone_size, const bool sanitize)
+{
+    ++this->modifications_;
+    this->enabled_ = true;
+    this->sanitize_ = sanitize;
+
+    // Overflows are only caught up to the next chunk, without redzones that is right away
+    this->redzone_size_ = align_up(sanitize ? std::max(redzone_size, CHUNK_ALIGNMENT) : redzone_size,
+                                   CHUNK_ALIGNMENT);
+}
+
+std::optional<heap_shadow_state> emulated_heap::check_access(const uint64_t address, const uint64_t size) const
+{
+    if (!size)
+    {
+        return std::nullopt;
+    }
+
+    const auto end = address + size;
+    const auto last_granule = (end - 1) >> GRANULE_SHIFT;
+
+    for (auto granule = address >> GRANULE_SHIFT; granule <= last_granule; ++granule)
+    {
+        const auto state = this->get_shadow(granule);
+        if (state == heap_shadow_state::addressable)
+        {
+            continue;
+        }
+
+        const auto value = static_cast<uint8_t>(state);
+        if (value < CHUNK_ALIGNMENT)
+        {
+            const auto granule_start = granule << GRANULE_SHIFT;
+            if (std::min(end, granule_start + CHUNK_ALIGNMENT) - granule_start <= value)
+            {
+                continue;
+            }
+
+            return heap_shadow_state::redzone;
+        }
+
+        return state;
+    }
+
+    return std::nullopt;
+}
+
+bool emulated_heap::is_accessible(const uint64_t address, const uint64_t size) const
+{
+    if (!this->sanitize_ || !size)
+    {
+        return true;
+    }
+
+    const auto is_in_region = [this](const uint64_t value) {
+        auto entry = this->regions_.upper_bound(value);
+        if (entry == this->regions_.begin())
+        {
+            return false;
+        }
+
+        --entry;
+        return value - entry->first < entry->second;
+    };
+
+    if (!is_in_region(address) && !is_in_region(address + size - 1))
+    {
+        return true;
+    }
+
+    return !this->check_access(address, size);
+}
+
+uint64_t emulated_heap::get_capacity(const uint64_t size) const
+{
+    return align_up(std::max(size, static_cast<uint64_t>(1)), CHUNK_ALIGNMENT) + (2 * this->redzone_size_);
+}
+
+uint64_t emulated_heap::allocate_chunk(memory_manager& memory, const uint64_t capacity, chunk& c)
+{
+    c.capacity = capacity;
+
+    if (capacity >= DEDICATED_THRESHOLD)
+    {
+        c.region_size = page_align_up(capacity);
+
+        const auto region = memory.allocate_memory(static_cast<size_t>(c.region_size), memory_permission::read_write);
+        if (region)
+        {
+            this->add_region(region, c.region_size);
+        }
+
+        return region;
+    }
+
+    const auto bin = this->free_chunks_.find(capacity);
+    if (bin != this->free_chunks_.end())
+    {
+        const auto base = bin->second.chunks.back();
+        bin->second.chunks.pop_back();
+
+        if (bin->second.chunks.empty())
+        {
+            this->free_chunks_.erase(bin);
+        }
+
+        return base;
+    }
+
+    if (this->arena_end_ - this->arena_position_ < capacity)
+    {
+        const auto arena = memory.allocate_memory(static_cast<size_t>(ARENA_SIZE), memory_permission::read_write);
+        if (!arena)
+        {
+            return 0;
+        }
+
+        this->arena_position_ = arena;
+        this->arena_end_ = arena + ARENA_SIZE;
+        this->add_region(arena, ARENA_SIZE);
+    }
+
+    const auto base = this->arena_position_;
+    this->arena_position_ += capacity;
+
+    return base;
+}
+
+uint64_t emulated_heap::allocate(memory_manager& memory, const uint64_t size, const bool zero)
+{
+    ++this->modifications_;
+    chunk c{.size = size};
+
+    const auto base = this->allocate_chunk(memory, this->get_capacity(size), c);
+    if (!base)
+    {
+        return 0;
+    }
+
+    const auto address = base + this->redzone_size_;
+
+    // Recycled chunks hold old data, fresh memory is zero already
+    if (zero && !c.region_size && size)
+    {
+        const std::vector<std::byte> zeros(static_cast<size_t>(size));
+        memory.write_memory(address, zeros.data(), zeros.size());
+    }
+
+    this->fill_redzones(memory, address, c);
+    this->update_chunk_shadow(address, c);
+    this->chunks_[address] = c;
+
+    return address;
+}
+
+heap_status emulated_heap::release(memory_manager& memory, const uint64_t address)
+{
+    const auto entry = this->chunks_.find(address);
+    if (entry == this->chunks_.end())
+    {
+        // Double frees of quarantined chunks
+        return this->sanitize_ && this->get_shadow(address >> GRANULE_SHIFT) == heap_shadow_state::freed
+                   ? heap_status::corrupted
+                   : heap_status::not_owned;
+    }
+
+    const auto c = entry->second;
+    if (!this->check_redzones(memory, address, c))
+    {
+        return heap_status::corrupted;
+    }
+
+    ++this->modifications_;
+    this->chunks_.erase(entry);
+
+    const auto base = address - this->redzone_size_;
+
+    if (c.region_size)
+    {
+        memory.release_memory(base, 0);
+        this->set_shadow(base, c.region_size, heap_shadow_state::redzone);
+        this->remove_region(base);
+    }
+    else if (this->sanitize_)
+    {
+        this->quarantine_chunk(base, c.capacity);
+    }
+    else
+    {
+        this->free_chunks_[c.capacity].chunks.push_back(base);
+    }
+
+    return heap_status::success;
+}
+
+std::optional<uint64_t> emulated_heap::get_size(const uint64_t address) const
+{
+    const auto entry = this->chunks_.find(address);
+    if (entry == this->chunks_.end())
+    {
+        return std::nullopt;
+    }
+
+    return entry->second.size;
+}
+
+std::pair<heap_status, uint64_t> emulated_heap::reallocate(memory_manager& memory, const uint64_t address,
+                                                           const uint64_t size, const bool zero,
+                                                           const bool in_place_only)
+{
+    const auto entry = this->chunks_.find(address);
+    if (entry == this->chunks_.end())
+    {
+        return {heap_status::not_owned, 0};
+    }
+
+    auto& c = entry->second;
+    if (!this->check_redzones(memory, address, c))
+    {
+        return {heap_status::corrupted, 0};
+    }
+
+    if (this->get_capacity(size) <= c.capacity)
+    {
+        ++this->modifications_;
+
+        if (zero && size > c.size)
+        {
+            const std::vector<std::byte> zeros(static_cast<size_t>(size - c.size));
+            memory.write_memory(address + c.size, zeros.data(), zeros.size());
+        }
+
+        c.size = size;
+        this->fill_redzones(memory, address, c);
+        this->update_chunk_shadow(address, c);
+
+        return {heap_status::success, address};
+    }
+
+    if (in_place_only)
+    {
+        return {heap_status::success, 0};
+    }
+
+    const auto old_size = c.size;
+
+    const auto new_address = this->allocate(memory, size, zero);
+    if (!new_address)
+    {
+        return {heap_status::success, 0};
+    }
+
+    const auto data = memory.read_memory(address, static_cast<size_t>(old_size));
+    memory.write_memory(new_address, data.data(), data.size());
+
+    (void)this->release(memory, address);
+
+    return {heap_status::success, new_address};
+}
+
+void emulated_heap::fill_redzones(memory_manager& memory, const uint64_t address, const chunk& c) const
+{
+    if (!this->redzone_size_)
+    {
+        return;
+    }
+
+    const auto base = address - this->redzone_size_;
+    const auto trailing_size = c.capacity - this->redzone_size_ - c.size;
+
+    const auto leading = get_redzone_pattern(this->redzone_size_);
+    const auto trailing = get_redzone_pattern(trailing_size);
+
+    memory.write_memory(base, leading.data(), leading.size());
+    memory.write_memory(address + c.size, trailing.data(), trailing.size());
+}
+
+bool emulated_heap::check_redzones(memory_manager& memory, const uint64_t address, const chunk& c) const
+{
+    if (!this->redzone_size_)
+    {
+        return true;
+    }
+
+    const auto base = address - this->redzone_size_;
+    const auto trailing_size = c.capacity - this->redzone_size_ - c.size;
+
+    const auto is_intact = [&](const uint64_t start, const uint64_t size) {
+        const auto data = memory.read_memory(start, static_cast<size_t>(size));
+        return std::ranges::all_of(data, [](const std::byte value) { return value == REDZONE_FILL; });
+    };
+
+    return is_intact(base, this->redzone_size_) && is_intact(address + c.size, trailing_size);
+}
+
+void emulated_heap::add_region(const uint64_t address, const uint64_t size)
+{
+    this->regions_[address] = size;
+
+    if (this->region_callback_)
+    {
+        this->region_callback_();
+    }
+}
+
+void emulated_heap::remove_region(const uint64_t address)
+{
+    this->regions_.erase(address);
+
+    if (this->region_callback_)
+    {
+        this->region_callback_();
+    }
+}
+
+void emulated_heap::quarantine_chunk(const uint64_t base, const uint64_t capacity)
+{
+    this->set_shadow(base, capacity, heap_shadow_state::freed);
+    this->quarantine_.push_back({.base = base, .capacity = capacity});
+    this->quarantine_size_ += capacity;
+
+    while (this->quarantine_size_ > QUARANTINE_LIMIT)
+    {
+        const auto oldest = this->quarantine_.front();
+        this->quarantine_.pop_front();
+        this->quarantine_size_ -= oldest.capacity;
+
+        this->set_shadow(oldest.base, oldest.capacity, heap_shadow_state::redzone);
+        this->free_chunks_[oldest.capacity].chunks.push_back(oldest.base);
+    }
+}
+
+heap_shadow_state emulated_heap::get_shadow(const uint64_t granule) const
+{
+    const auto page = this->shadow_.find(granule >> SHADOW_PAGE_SHIFT);
+    if (page == this->shadow_.end())
+    {
+        return heap_shadow_state::redzone;
+    }
+
+    return page->second[granule & SHADOW_PAGE_MASK];
+}
+
+void emulated_heap::set_shadow(const uint64_t address, const uint64_t size, const heap_shadow_state state)
+{
+    if (!this->sanitize_)
+    {
+        return;
+    }
+
+    const auto end = (address + size + CHUNK_ALIGNMENT - 1) >> GRANULE_SHIFT;
+
+    for (auto granule = address >> GRANULE_SHIFT; granule < end;)
+    {
+        const auto page_index = granule >> SHADOW_PAGE_SHIFT;
+        const auto page_end = std::min(end, (page_index + 1) << SHADOW_PAGE_SHIFT);
+
+        // Missing pages are redzone already
+        auto page = this->shadow_.find(page_index);
+        if (page == this->shadow_.end() && state != heap_shadow_state::redzone)
+        {
+            shadow_page new_page{};
+            new_page.fill(heap_shadow_state::redzone);
+            page = this->shadow_.emplace(page_index, new_page).first;
+        }
+
+        if (page != this->shadow_.end())
+        {
+            std::fill(page->second.begin() + static_cast<ptrdiff_t>(granule & SHADOW_PAGE_MASK),
+                      page->second.begin() + static_cast<ptrdiff_t>(((page_end - 1) & SHADOW_PAGE_MASK) + 1), state);
+        }
+
+        granule = page_end;
+    }
+}
+
+void emulated_heap::update_chunk_shadow(const uint64_t address, const chunk& c)
+{
+    if (!this->sanitize_)
+    {
+        return;
+    }
+
+    const auto full_size = align_down(c.size, CHUNK_ALIGNMENT);
+    const auto partial_size = c.size - full_size;
+
+    this->set_shadow(address - this->redzone_size_, c.capacity, heap_shadow_state::redzone);
+    this->set_shadow(address, full_size, heap_shadow_state::addressable);
+
+    if (partial_size)
+    {
+        this->set_shadow(address + full_size, 1, static_cast<heap_shadow_state>(partial_size));
+    }
+}
+
+void emulated_heap::rebuild_shadow()
+{
+    this->shadow_.clear();
+
+    for (const auto& [address, c] : this->chunks_)
+    {
+        this->update_chunk_shadow(address, c);
+    }
+
+    for (const auto& entry : this->quarantine_)
+    {
+        this->set_shadow(entry.base, entry.capacity, heap_shadow_state::freed);
+    }
+}
+
+void emulated_heap::serialize(utils::buffer_serializer& buffer) const
+{
+    buffer.write(this->enabled_);
+    buffer.write(this->sanitize_);
+    buffer.write(this->redzone_size_);
+    buffer.write(this->arena_position_);
+    buffer.write(this->arena_end_);
+    buffer.write_map(this->chunks_);
+    buffer.write_map(this->free_chunks_);
+    buffer.write_map(this->regions_);
+
+    buffer.write(static_cast<uint64_t>(this->quarantine_.size()));
+    for (const auto& entry : this->quarantine_)
+    {
+        buffer.write(entry);
+    }
+}
+
+void emulated_heap::deserialize(utils::buffer_deserializer& buffer)
+{
+    ++this->modifications_;
+
+    buffer.read(this->enabled_);
+    buffer.read(this->sanitize_);
+    buffer.read(this->redzone_size_);
+    buffer.read(this->arena_position_);
+    buffer.read(this->arena_end_);
+    buffer.read_map(this->chunks_);
+    buffer.read_map(this->free_chunks_);
+    buffer.read_map(this->regions_);
+
+    this->quarantine_.clear();
+    this->quarantine_size_ = 0;
+
+    const auto quarantine_count = buffer.read<uint64_t>();
+    for (uint64_t i = 0; i < quarantine_count; ++i)
+    {
+        const auto entry = buffer.read<quarantined_chunk>();
+        this->quarantine_.push_back(entry);
+        this->quarantine_size_ += entry.capacity;
+    }
+
+    this->rebuild_shadow();
+
+    if (this->region_callback_)
+    {
+        this->region_callback_();
+    }
+}
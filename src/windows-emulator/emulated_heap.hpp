@@ -0,0 +1,148 @@
+#pragma once
+
+#include "std_include.hpp"
+
+#include <memory_manager.hpp>
+#include <serialization.hpp>
+
+enum class heap_status
+{
+    success,
+    not_owned,
+    corrupted,
+};
+
+enum class heap_shadow_state : uint8_t
+{
+    addressable = 0,
+    // 1 to 15 are granules of which only that many leading bytes are addressable
+    redzone = 0xFA,
+    freed = 0xFD,
+};
+
+// Host side allocator behind RtlAllocateHeap and friends, all guest heaps share its arenas. Addresses it didn't
+// hand out are not owned, their calls are left to the guest heap. With redzones, every chunk is surrounded by
+// filler bytes that are verified when the chunk is freed or resized.
+// The sanitizer additionally keeps a shadow state for every 16 byte granule of the heap memory and quarantines
+// freed chunks before they are reused, so accesses can be checked against it, see heap_sanitizer.
+class emulated_heap
+{
+  public:
+    struct chunk
+    {
+        uint64_t size{};
+        // Includes the redzones
+        uint64_t capacity{};
+        // Set for chunks that got their own region instead of living in an arena
+        uint64_t region_size{};
+    };
+
+    struct free_bin
+    {
+        std::vector<uint64_t> chunks{};
+
+        void serialize(utils::buffer_serializer& buffer) const
+        {
+            buffer.write_vector(this->chunks);
+        }
+
+        void deserialize(utils::buffer_deserializer& buffer)
+        {
+            buffer.read_vector(this->chunks);
+        }
+    };
+
+    void enable(uint64_t redzone_size, bool sanitize = false);
+
+    bool is_enabled() const
+    {
+        return this->enabled_;
+    }
+
+    bool is_sanitizing() const
+    {
+        return this->sanitize_;
+    }
+
+    // State of the first granule the access must not touch, nothing if it's fine.
+    // Only meaningful for accesses within the regions.
+    std::optional<heap_shadow_state> check_access(uint64_t address, uint64_t size) const;
+
+    // Whether the host may access the memory on behalf of the guest without bypassing the sanitizer
+    bool is_accessible(uint64_t address, uint64_t size) const;
+
+    // Arenas and dedicated chunk regions by their address
+    const std::map<uint64_t, uint64_t>& get_regions() const
+    {
+        return this->regions_;
+    }
+
+    // Called whenever the regions changed, including after deserialization
+    void set_region_callback(std::function<void()> callback)
+    {
+        this->region_callback_ = std::move(callback);
+    }
+
+    // 0 if the memory is exhausted
+    uint64_t allocate(memory_manager& memory, uint64_t size, bool zero);
+    heap_status release(memory_manager& memory, uint64_t address);
+    std::optional<uint64_t> get_size(uint64_t address) const;
+
+    // The new address is 0 if the chunk can't grow in place or the memory is exhausted
+    std::pair<heap_status, uint64_t> reallocate(memory_manager& memory, uint64_t address, uint64_t size, bool zero,
+                                                bool in_place_only);
+
+    // Bumped by every call that changes chunks, arenas or the quarantine
+    uint64_t get_modifications() const
+    {
+        return this->modifications_;
+    }
+
+    void serialize(utils::buffer_serializer& buffer) const;
+    void deserialize(utils::buffer_deserializer& buffer);
+
+  private:
+    using shadow_page = std::array<heap_shadow_state, 0x100>;
+
+    bool enabled_{false};
+    bool sanitize_{false};
+    uint64_t redzone_size_{};
+    uint64_t modifications_{};
+
+    struct quarantined_chunk
+    {
+        uint64_t base{};
+        uint64_t capacity{};
+    };
+
+    std::map<uint64_t, uint64_t> regions_{};
+    // Freed arena chunks, oldest first
+    std::deque<quarantined_chunk> quarantine_{};
+    uint64_t quarantine_size_{};
+
+    // Pages without shadow are entirely redzone. Not serialized, it's rebuilt from the chunks.
+    std::unordered_map<uint64_t, shadow_page> shadow_{};
+    std::function<void()> region_callback_{};
+
+    uint64_t arena_position_{};
+    uint64_t arena_end_{};
+
+    // Keyed by the user addresses
+    std::map<uint64_t, chunk> chunks_{};
+    // Chunk bases by capacity
+    std::map<uint64_t, free_bin> free_chunks_{};
+
+    uint64_t get_capacity(uint64_t size) const;
+    uint64_t allocate_chunk(memory_manager& memory, uint64_t capacity, chunk& c);
+    void fill_redzones(memory_manager& memory, uint64_t address, const chunk& c) const;
+    bool check_redzones(memory_manager& memory, uint64_t address, const chunk& c) const;
+
+    void add_region(uint64_t address, uint64_t size);
+    void remove_region(uint64_t address);
+    void quarantine_chunk(uint64_t base, uint64_t capacity);
+
+    heap_shadow_state get_shadow(uint64_t granule) const;
+    void set_shadow(uint64_t address, uint64_t size, heap_shadow_state state);
+    void update_chunk_shadow(uint64_t address, const chunk& c);
+    void rebuild_shadow();
+};
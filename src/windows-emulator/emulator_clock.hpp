@@ -0,0 +1,135 @@
+#pragma once
+
+#include "std_include.hpp"
+#include <serialization.hpp>
+
+#include "input_recorder.hpp"
+
+// Host clocks shifted by the time that was skipped while all guest threads were idle.
+// With virtual time, every reading is derived from the executed instructions instead of the host clocks.
+class emulator_clock
+{
+  public:
+    emulator_clock(const uint64_t* executed_instructions = nullptr)
+        : executed_instructions_(executed_instructions)
+    {
+    }
+
+    // Every executed instruction advances the clocks by one tick of the given frequency
+    void use_virtual_time(const uint64_t frequency, const std::chrono::system_clock::time_point system_start)
+    {
+        this->virtual_frequency_ = frequency;
+        this->virtual_system_start_ = system_start;
+    }
+
+    bool is_virtual() const
+    {
+        return this->virtual_frequency_ != 0 && this->executed_instructions_;
+    }
+
+    std::chrono::steady_clock::time_point steady_now() const
+    {
+        if (this->is_virtual())
+        {
+            return std::chrono::steady_clock::time_point(this->get_virtual_time()) + this->skipped_time_;
+        }
+
+        return read_clock<std::chrono::steady_clock>(recorded_input::steady_time) + this->skipped_time_;
+    }
+
+    std::chrono::system_clock::time_point system_now() const
+    {
+        using duration = std::chrono::system_clock::duration;
+
+        if (this->is_virtual())
+        {
+            return this->virtual_system_start_ +
+                   std::chrono::duration_cast<duration>(this->get_virtual_time() + this->skipped_time_);
+        }
+
+        return read_clock<std::chrono::system_clock>(recorded_input::system_time) +
+               std::chrono::duration_cast<duration>(this->skipped_time_);
+    }
+
+    // Ticks of KUSER_SHARED_DATA::QpcFrequency
+    uint64_t performance_counter() const
+    {
+        if (!this->is_virtual())
+        {
+            return static_cast<uint64_t>(this->steady_now().time_since_epoch().count());
+        }
+
+        const std::chrono::duration<double> skipped_time = this->skipped_time_;
+        const auto skipped_ticks = static_cast<uint64_t>(skipped_time.count() * this->virtual_frequency_);
+
+        return *this->executed_instructions_ + skipped_ticks;
+    }
+
+    // Host clock readings go through the recorder, the recorder is not serialized
+    void set_recorder(input_recorder* recorder)
+    {
+        this->recorder_ = recorder;
+    }
+
+    std::chrono::steady_clock::duration get_skipped_time() const
+    {
+        return this->skipped_time_;
+    }
+
+    void skip(const std::chrono::steady_clock::duration duration)
+    {
+        if (duration.count() > 0)
+        {
+            this->skipped_time_ += duration;
+        }
+    }
+
+    void serialize(utils::buffer_serializer& buffer) const
+    {
+        buffer.write(this->skipped_time_);
+        buffer.write(this->virtual_frequency_);
+        buffer.write(this->virtual_system_start_);
+    }
+
+    void deserialize(utils::buffer_deserializer& buffer)
+    {
+        buffer.read(this->skipped_time_);
+        buffer.read(this->virtual_frequency_);
+        buffer.read(this->virtual_system_start_);
+    }
+
+  private:
+    std::chrono::steady_clock::duration skipped_time_{};
+    input_recorder* recorder_{};
+
+    const uint64_t* executed_instructions_{};
+    uint64_t virtual_frequency_{};
+    std::chrono::system_clock::time_point virtual_system_start_{};
+
+    std::chrono::steady_clock::duration get_virtual_time() const
+    {
+        using duration = std::chrono::steady_clock::duration;
+
+        const auto instructions = *this->executed_instructions_;
+        const auto seconds = std::chrono::seconds(instructions / this->virtual_frequency_);
+        const auto fraction = (instructions % this->virtual_frequency_) * duration::period::den /
+                              (this->virtual_frequency_ * duration::period::num);
+
+        return std::chrono::duration_cast<duration>(seconds) + duration(static_cast<duration::rep>(fraction));
+    }
+
+    template <typename Clock>
+    typename Clock::time_point read_clock(const recorded_input type) const
+    {
+        if (!this->recorder_)
+        {
+            return Clock::now();
+        }
+
+        const auto ticks = this->recorder_->capture(type, [] {
+            return static_cast<uint64_t>(Clock::now().time_since_epoch().count()); //
+        });
+
+        return typename Clock::time_point(typename Clock::duration(static_cast<typename Clock::rep>(ticks)));
+    }
+};
@@ -112,8 +112,18 @@ class emulator_object
     template <typename F>
     void access(const F& accessor, const size_t index = 0) const
     {
+        const auto address = this->address_ + index * this->size();
+
+        // The object is modified in place if its memory allows it, the accessor must not unmap it
+        const auto view = this->emu_->get_writable_view(address, sizeof(T));
+        if (!view.empty() && reinterpret_cast<uintptr_t>(view.data()) % alignof(T) == 0)
+        {
+            accessor(*reinterpret_cast<T*>(view.data()));
+            return;
+        }
+
         T obj{};
-        this->emu_->read_memory(this->address_ + index * this->size(), &obj, sizeof(obj));
+        this->emu_->read_memory(address, &obj, sizeof(obj));
 
         accessor(obj);
 
@@ -281,6 +291,20 @@ inline std::u16string read_unicode_string(const emulator& emu, const UNICODE_STR
     return result;
 }
 
+// Passes the string without copying it if its buffer is backed by host memory
+template <typename F>
+auto access_unicode_string(emulator& emu, const UNICODE_STRING<EmulatorTraits<Emu64>> ucs, const F& accessor)
+{
+    const auto view = emu.get_readable_view(ucs.Buffer, ucs.Length);
+    if (!view.empty() && reinterpret_cast<uintptr_t>(view.data()) % alignof(char16_t) == 0)
+    {
+        return accessor(std::u16string_view(reinterpret_cast<const char16_t*>(view.data()), ucs.Length / 2));
+    }
+
+    const auto string = read_unicode_string(emu, ucs);
+    return accessor(std::u16string_view(string));
+}
+
 inline std::u16string read_unicode_string(const emulator& emu,
                                           const emulator_object<UNICODE_STRING<EmulatorTraits<Emu64>>> uc_string)
 {
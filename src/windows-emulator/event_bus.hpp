@@ -0,0 +1,200 @@
+#pragma once
+
+#include "std_include.hpp"
+
+#include <memory_permission.hpp>
+
+struct mapped_module;
+class emulator_thread;
+
+struct module_load_event
+{
+    const mapped_module& mod;
+};
+
+// Published before the module is unmapped
+struct module_unload_event
+{
+    const mapped_module& mod;
+};
+
+struct syscall_enter_event
+{
+    uint64_t address{};
+    uint32_t id{};
+    std::string_view name{};
+};
+
+struct syscall_exit_event
+{
+    uint64_t address{};
+    uint32_t id{};
+    std::string_view name{};
+    NTSTATUS status{};
+};
+
+struct thread_switch_event
+{
+    // Null for the first thread that runs
+    const emulator_thread* previous{};
+    const emulator_thread& next;
+};
+
+// Exceptions raised by the emulated CPU, before they are dispatched to the guest
+struct exception_event
+{
+    uint64_t rip{};
+    NTSTATUS status{};
+    // Accessed address of access violations
+    uint64_t address{};
+};
+
+struct memory_protect_event
+{
+    uint64_t address{};
+    size_t size{};
+    memory_permission permissions{};
+    memory_permission previous_permissions{};
+};
+
+// Guest writes into files, after they were performed
+struct file_write_event
+{
+    std::u16string_view name{};
+    size_t size{};
+};
+
+// Registry keys the guest opened, the hive and path as registry_key holds them
+struct registry_key_open_event
+{
+    const std::filesystem::path& hive;
+    const std::filesystem::path& path;
+};
+
+using event_subscription = uint64_t;
+
+// Subscribers of one event type, called in the order they subscribed. They may subscribe and unsubscribe while
+// being called, subscribers added during a publication are called by it as well.
+template <typename Event>
+class event_channel
+{
+  public:
+    using subscriber = std::function<void(const Event&)>;
+
+    event_subscription subscribe(subscriber callback)
+    {
+        const auto id = ++this->next_id_;
+        this->subscribers_.push_back({id, std::move(callback)});
+        return id;
+    }
+
+    void unsubscribe(const event_subscription id)
+    {
+        const auto entry = std::ranges::find(this->subscribers_, id, &entry_type::id);
+        if (entry == this->subscribers_.end())
+        {
+            return;
+        }
+
+        if (this->publishing_)
+        {
+            entry->callback = {};
+            this->has_removed_ = true;
+        }
+        else
+        {
+            this->subscribers_.erase(entry);
+        }
+    }
+
+    bool has_subscribers() const
+    {
+        return !this->subscribers_.empty();
+    }
+
+    // The event is only constructed if there are subscribers, publishing into an empty channel is a single check
+    template <typename F>
+        requires(std::is_invocable_r_v<Event, F&>)
+    void publish(F&& make_event)
+    {
+        if (this->subscribers_.empty())
+        {
+            return;
+        }
+
+        this->dispatch(make_event());
+    }
+
+  private:
+    struct entry_type
+    {
+        event_subscription id{};
+        subscriber callback{};
+    };
+
+    std::vector<entry_type> subscribers_{};
+    event_subscription next_id_{};
+    bool publishing_{false};
+    bool has_removed_{false};
+
+    void dispatch(const Event& event)
+    {
+        const auto was_publishing = this->publishing_;
+        this->publishing_ = true;
+
+        // Indices stay valid, removals only clear the callback while publishing
+        for (size_t i = 0; i < this->subscribers_.size(); ++i)
+        {
+            if (this->subscribers_[i].callback)
+            {
+                this->subscribers_[i].callback(event);
+            }
+        }
+
+        this->publishing_ = was_publishing;
+
+        if (!this->publishing_ && this->has_removed_)
+        {
+            this->has_removed_ = false;
+            std::erase_if(this->subscribers_, [](const entry_type& e) { return !e.callback; });
+        }
+    }
+};
+
+// Typed channels for analyses that observe the emulation. The channels are fixed at compile time, so publishing
+// resolves its channel statically and costs nothing beyond an empty check while nobody subscribed.
+class event_bus
+{
+  public:
+    template <typename Event>
+    event_channel<Event>& channel()
+    {
+        return std::get<event_channel<Event>>(this->channels_);
+    }
+
+    template <typename Event>
+    event_subscription subscribe(typename event_channel<Event>::subscriber callback)
+    {
+        return this->channel<Event>().subscribe(std::move(callback));
+    }
+
+    template <typename Event>
+    void unsubscribe(const event_subscription id)
+    {
+        this->channel<Event>().unsubscribe(id);
+    }
+
+    template <typename Event, typename F>
+    void publish(F&& make_event)
+    {
+        this->channel<Event>().publish(std::forward<F>(make_event));
+    }
+
+  private:
+    std::tuple<event_channel<module_load_event>, event_channel<module_unload_event>,
+               event_channel<syscall_enter_event>, event_channel<syscall_exit_event>,
+               event_channel<thread_switch_event>, event_channel<exception_event>,
+               event_channel<memory_protect_event>, event_channel<file_write_event>,
+               event_channel<registry_key_open_event>>
+        channels_{};
+};
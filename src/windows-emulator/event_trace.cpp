@@ -0,0 +1,206 @@
+#include "event_trace.hpp"
+#include "process_context.hpp"
+
+using namespace event_trace_format;
+
+namespace
+{
+    constexpr size_t MIN_CAPACITY = 0x1000;
+}
+
+event_trace::event_trace(const process_context& process, const std::filesystem::path& file, const size_t capacity)
+    : process_(&process)
+{
+    const auto ring_size = std::max(capacity, MIN_CAPACITY);
+
+    std::error_code ec{};
+    std::filesystem::remove(file, ec);
+
+    this->file_ = utils::mapped_file(file, utils::mapped_file::access::read_write, sizeof(file_header) + ring_size);
+
+    this->header_ = reinterpret_cast<file_header*>(this->file_.data());
+    this->ring_ = this->file_.get_buffer().subspan(sizeof(file_header), ring_size);
+
+    *this->header_ = {};
+    this->header_->magic = MAGIC;
+    this->header_->version = VERSION;
+    this->header_->capacity = ring_size;
+}
+
+event_trace::~event_trace()
+{
+    this->flush();
+}
+
+void event_trace::flush() const
+{
+    this->file_.flush();
+}
+
+void event_trace::log_module_load(const uint64_t image_base, const uint64_t size_of_image, const std::string_view name)
+{
+    module_load_event data{};
+    data.image_base = image_base;
+    data.size_of_image = size_of_image;
+
+    this->log(event_type::module_load, data, name);
+}
+
+void event_trace::log_function_entry(const uint64_t address, const std::string_view module_name,
+                                     const std::string_view function_name)
+{
+    function_entry_event data{};
+    data.address = address;
+
+    this->log(event_type::function_entry, data, module_name, function_name);
+}
+
+void event_trace::log_syscall(const uint64_t address, const uint32_t id, const std::string_view name)
+{
+    syscall_event data{};
+    data.address = address;
+    data.id = id;
+
+    this->log(event_type::syscall, data, name);
+}
+
+void event_trace::log_object_access(const uint64_t address, const uint64_t rip, const uint32_t offset,
+                                    const size_t size, const memory_operation operation,
+                                    const std::string_view type_name, const std::string_view member_name)
+{
+    object_access_event data{};
+    data.address = address;
+    data.rip = rip;
+    data.offset = offset;
+    data.size = static_cast<uint32_t>(size);
+    data.operation = static_cast<uint8_t>(operation);
+
+    this->log(event_type::object_access, data, type_name, member_name);
+}
+
+void event_trace::log_exception(const uint64_t rip, const uint32_t code, const uint64_t address,
+                                const memory_operation operation)
+{
+    exception_event data{};
+    data.rip = rip;
+    data.address = address;
+    data.code = code;
+    data.operation = static_cast<uint8_t>(operation);
+
+    this->log(event_type::exception, data);
+}
+
+void event_trace::log_api_call(const uint64_t address, const uint64_t return_address,
+                               const std::string_view module_name, const std::string_view function_name,
+                               const std::span<const uint64_t> arguments, const uint16_t string_mask,
+                               const std::span<const std::string> strings)
+{
+    api_call_event data{};
+    data.address = address;
+    data.return_address = return_address;
+    data.string_mask = string_mask;
+    data.argument_count = static_cast<uint8_t>(std::min(arguments.size(), MAX_API_ARGUMENTS));
+    std::copy_n(arguments.begin(), data.argument_count, data.arguments);
+
+    std::vector<std::string_view> texts{module_name, function_name};
+    texts.insert(texts.end(), strings.begin(), strings.end());
+
+    this->log(event_type::api_call, data, texts);
+}
+
+template <typename T>
+void event_trace::log(const event_type type, const T& data, const std::string_view text,
+                      const std::string_view second_text)
+{
+    const std::array texts{text, second_text};
+    this->log(type, data, std::span(texts).first(second_text.empty() ? 1 : 2));
+}
+
+template <typename T>
+void event_trace::log(const event_type type, const T& data, const std::span<const std::string_view> texts)
+{
+    static_assert(std::is_trivially_copyable_v<T>);
+
+    constexpr auto max_text_size = std::numeric_limits<uint16_t>::max() - sizeof(T);
+
+    // Every text after the first one is preceded by a separator
+    const auto max_size = texts.empty() ? 0 : (max_text_size - (texts.size() - 1)) / texts.size();
+
+    auto payload_size = sizeof(T);
+    for (size_t i = 0; i < texts.size(); ++i)
+    {
+        payload_size += std::min(texts[i].size(), max_size) + (i ? 1 : 0);
+    }
+
+    const auto size = sizeof(event_header) + payload_size;
+
+    if (size > this->ring_.size())
+    {
+        return;
+    }
+
+    event_header header{};
+    header.type = type;
+    header.size = static_cast<uint16_t>(payload_size);
+    header.thread_id = this->process_->active_thread ? this->process_->active_thread->id : 0;
+    header.instructions = this->process_->executed_instructions;
+
+    this->make_space(size);
+
+    auto position = this->header_->head;
+
+    const auto append = [&](const void* buffer, const size_t length) {
+        this->write(position, buffer, length);
+        position += length;
+    };
+
+    append(&header, sizeof(header));
+    append(&data, sizeof(data));
+
+    for (size_t i = 0; i < texts.size(); ++i)
+    {
+        if (i)
+        {
+            constexpr char separator = '\0';
+            append(&separator, 1);
+        }
+
+        append(texts[i].data(), std::min(texts[i].size(), max_size));
+    }
+
+    this->header_->head = position;
+}
+
+void event_trace::make_space(const size_t size)
+{
+    auto tail = this->header_->tail;
+    const auto head = this->header_->head;
+
+    while (this->ring_.size() - (head - tail) < size)
+    {
+        event_header header{};
+        const auto offset = static_cast<size_t>(tail % this->ring_.size());
+        const auto first = std::min(sizeof(header), this->ring_.size() - offset);
+
+        memcpy(&header, this->ring_.data() + offset, first);
+        memcpy(reinterpret_cast<std::byte*>(&header) + first, this->ring_.data(), sizeof(header) - first);
+
+        tail += sizeof(header) + header.size;
+    }
+
+    this->header_->tail = tail;
+}
+
+void event_trace::write(const uint64_t position, const void* data, const size_t size)
+{
+    if (!size)
+    {
+        return;
+    }
+
+    const auto offset = static_cast<size_t>(position % this->ring_.size());
+    const auto first = std::min(size, this->ring_.size() - offset);
+
+    memcpy(this->ring_.data() + offset, data, first);
+    memcpy(this->ring_.data(), static_cast<const std::byte*>(data) + first, size - first);
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "std_include.hpp"
+
+#include <emulator.hpp>
+#include <utils/mapped_file.hpp>
+
+#include "event_trace_format.hpp"
+
+struct process_context;
+
+// Records analysis events as binary records into a memory-mapped ring. Once the ring is full, the oldest
+// records are overwritten. The file stays readable if the process dies, use trace-converter to convert it.
+class event_trace
+{
+  public:
+    event_trace(const process_context& process, const std::filesystem::path& file, size_t capacity);
+    ~event_trace();
+
+    event_trace(event_trace&&) = delete;
+    event_trace(const event_trace&) = delete;
+    event_trace& operator=(event_trace&&) = delete;
+    event_trace& operator=(const event_trace&) = delete;
+
+    void log_module_load(uint64_t image_base, uint64_t size_of_image, std::string_view name);
+    void log_function_entry(uint64_t address, std::string_view module_name, std::string_view function_name);
+    void log_syscall(uint64_t address, uint32_t id, std::string_view name);
+    void log_object_access(uint64_t address, uint64_t rip, uint32_t offset, size_t size, memory_operation operation,
+                           std::string_view type_name, std::string_view member_name);
+    void log_exception(uint64_t rip, uint32_t code, uint64_t address = 0,
+                       memory_operation operation = memory_operation::none);
+    // Strings are the values of the arguments in the string mask, in argument order
+    void log_api_call(uint64_t address, uint64_t return_address, std::string_view module_name,
+                      std::string_view function_name, std::span<const uint64_t> arguments, uint16_t string_mask,
+                      std::span<const std::string> strings);
+
+    void flush() const;
+
+  private:
+    const process_context* process_{};
+    utils::mapped_file file_{};
+    event_trace_format::file_header* header_{};
+    std::span<std::byte> ring_{};
+
+    template <typename T>
+    void log(event_trace_format::event_type type, const T& data, std::string_view text = {},
+             std::string_view second_text = {});
+    template <typename T>
+    void log(event_trace_format::event_type type, const T& data, std::span<const std::string_view> texts);
+
+    void write(uint64_t position, const void* data, size_t size);
+    void make_space(size_t size);
+};
@@ -0,0 +1,253 @@
+#pragma once
+
+#include <span>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+#include <optional>
+#include <algorithm>
+#include <string_view>
+
+// Layout of event trace files. The file starts with a header that is followed by a ring of records.
+// Every record is an event header, a fixed size payload depending on the type and optional text.
+// Positions are absolute byte counts, the ring offset is the position modulo the capacity.
+namespace event_trace_format
+{
+    constexpr uint32_t MAGIC = 0x43525445; // ETRC
+    constexpr uint32_t VERSION = 1;
+
+    struct file_header
+    {
+        uint32_t magic{};
+        uint32_t version{};
+        uint64_t capacity{};
+        // Position of the oldest record that wasn't overwritten yet
+        uint64_t tail{};
+        // Position behind the newest record
+        uint64_t head{};
+    };
+
+    static_assert(sizeof(file_header) == 32);
+
+    enum class event_type : uint8_t
+    {
+        module_load,
+        function_entry,
+        syscall,
+        object_access,
+        exception,
+        api_call,
+    };
+
+    struct event_header
+    {
+        event_type type{};
+        uint8_t reserved{};
+        // Size of the payload and text following the header
+        uint16_t size{};
+        uint32_t thread_id{};
+        uint64_t instructions{};
+    };
+
+    static_assert(sizeof(event_header) == 16);
+
+    // Followed by the module name
+    struct module_load_event
+    {
+        uint64_t image_base{};
+        uint64_t size_of_image{};
+    };
+
+    // Followed by the module name, a null character and the function name
+    struct function_entry_event
+    {
+        uint64_t address{};
+    };
+
+    // Followed by the syscall name
+    struct syscall_event
+    {
+        uint64_t address{};
+        uint32_t id{};
+        uint32_t reserved{};
+    };
+
+    // Followed by the type name, a null character and the member name
+    struct object_access_event
+    {
+        uint64_t address{};
+        uint64_t rip{};
+        uint32_t offset{};
+        uint32_t size{};
+        uint8_t operation{};
+        uint8_t reserved[7]{};
+    };
+
+    struct exception_event
+    {
+        uint64_t rip{};
+        uint64_t address{};
+        uint32_t code{};
+        uint8_t operation{};
+        uint8_t reserved[3]{};
+    };
+
+    constexpr size_t MAX_API_ARGUMENTS = 12;
+
+    // Followed by the module name, a null character and the function name. Each argument that has its bit set in
+    // the string mask is followed by another null character and the string it points to.
+    struct api_call_event
+    {
+        uint64_t address{};
+        uint64_t return_address{};
+        uint64_t arguments[MAX_API_ARGUMENTS]{};
+        uint16_t string_mask{};
+        uint8_t argument_count{};
+        uint8_t reserved[5]{};
+    };
+
+    struct event
+    {
+        event_header header{};
+        std::span<const std::byte> payload{};
+
+        template <typename T>
+        T get_data() const
+        {
+            T data{};
+            if (this->payload.empty())
+            {
+                return data;
+            }
+
+            memcpy(&data, this->payload.data(), std::min(sizeof(T), this->payload.size()));
+            return data;
+        }
+
+        template <typename T>
+        std::string_view get_text(const size_t index = 0) const
+        {
+            const auto offset = std::min(sizeof(T), this->payload.size());
+            std::string_view text(reinterpret_cast<const char*>(this->payload.data() + offset),
+                                  this->payload.size() - offset);
+
+            for (size_t i = 0; i < index; ++i)
+            {
+                const auto separator = text.find('\0');
+                if (separator == std::string_view::npos)
+                {
+                    return {};
+                }
+
+                text.remove_prefix(separator + 1);
+            }
+
+            return text.substr(0, text.find('\0'));
+        }
+    };
+
+    // Reads the records of a trace file from the oldest to the newest one
+    class reader
+    {
+      public:
+        reader(const std::span<const std::byte> file)
+        {
+            if (file.size() < sizeof(file_header))
+            {
+                return;
+            }
+
+            memcpy(&this->header_, file.data(), sizeof(this->header_));
+
+            if (this->header_.magic != MAGIC || this->header_.version != VERSION || !this->header_.capacity ||
+                this->header_.capacity > file.size() - sizeof(file_header) ||
+                this->header_.head - this->header_.tail > this->header_.capacity)
+            {
+                this->header_ = {};
+                return;
+            }
+
+            this->ring_ = file.subspan(sizeof(file_header), static_cast<size_t>(this->header_.capacity));
+            this->position_ = this->header_.tail;
+            this->valid_ = true;
+        }
+
+        bool is_valid() const
+        {
+            return this->valid_;
+        }
+
+        const file_header& get_header() const
+        {
+            return this->header_;
+        }
+
+        std::optional<event> next()
+        {
+            if (this->header_.head - this->position_ < sizeof(event_header))
+            {
+                return std::nullopt;
+            }
+
+            event e{};
+            this->read(this->position_, &e.header, sizeof(e.header));
+
+            const auto size = sizeof(event_header) + e.header.size;
+            if (this->header_.head - this->position_ < size)
+            {
+                return std::nullopt;
+            }
+
+            this->payload_.resize(e.header.size);
+            this->read(this->position_ + sizeof(event_header), this->payload_.data(), this->payload_.size());
+
+            this->position_ += size;
+            e.payload = this->payload_;
+
+            return e;
+        }
+
+      private:
+        bool valid_{false};
+        file_header header_{};
+        std::span<const std::byte> ring_{};
+        uint64_t position_{};
+        std::vector<std::byte> payload_{};
+
+        void read(const uint64_t position, void* data, const size_t size) const
+        {
+            if (!size)
+            {
+                return;
+            }
+
+            const auto offset = static_cast<size_t>(position % this->ring_.size());
+            const auto first = std::min(size, this->ring_.size() - offset);
+
+            memcpy(data, this->ring_.data() + offset, first);
+            memcpy(static_cast<std::byte*>(data) + first, this->ring_.data(), size - first);
+        }
+    };
+
+    inline const char* get_event_type_name(const event_type type)
+    {
+        switch (type)
+        {
+        case event_type::module_load:
+            return "module_load";
+        case event_type::function_entry:
+            return "function_entry";
+        case event_type::syscall:
+            return "syscall";
+        case event_type::object_access:
+            return "object_access";
+        case event_type::exception:
+            return "exception";
+        case event_type::api_call:
+            return "api_call";
+        default:
+            return "unknown";
+        }
+    }
+}
@@ -0,0 +1,192 @@
+#include "execution_trace.hpp"
+
+using namespace execution_trace_format;
+
+namespace
+{
+    constexpr size_t CHUNK_SIZE = 0x100000;
+    // Blocks the emulation once the writer falls this far behind
+    constexpr size_t MAX_PENDING_CHUNKS = 16;
+}
+
+execution_trace::execution_trace(const std::filesystem::path& file, const bool capture_registers)
+    : capture_registers_(capture_registers),
+      file_(file, std::ios::binary | std::ios::trunc)
+{
+    if (!this->file_)
+    {
+        throw std::runtime_error("Failed to open execution trace: " + file.string());
+    }
+
+    file_header header{};
+    header.magic = MAGIC;
+    header.version = VERSION;
+    header.flags = capture_registers ? FLAG_REGISTERS : 0;
+
+    this->file_.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    this->start_chunk();
+    this->writer_ = std::thread([this] { this->run_writer(); });
+}
+
+execution_trace::~execution_trace()
+{
+    this->flush();
+
+    {
+        std::scoped_lock lock{this->mutex_};
+        this->stop_ = true;
+    }
+
+    this->condition_variable_.notify_all();
+    this->writer_.join();
+}
+
+void execution_trace::record_block(x64_emulator& emu, const uint32_t thread_id, const basic_block& block)
+{
+    if (this->chunk_.size() >= CHUNK_SIZE)
+    {
+        this->submit_chunk();
+    }
+
+    if (thread_id != this->thread_id_)
+    {
+        this->thread_id_ = thread_id;
+        this->chunk_.push_back(static_cast<std::byte>(record_type::thread_switch));
+        write_varint(this->chunk_, thread_id);
+    }
+
+    this->chunk_.push_back(static_cast<std::byte>(record_type::block));
+    write_delta(this->chunk_, block.address, this->address_);
+    write_varint(this->chunk_, block.instruction_count);
+
+    this->address_ = block.address;
+
+    if (!this->capture_registers_)
+    {
+        return;
+    }
+
+    register_values values{};
+    uint32_t changed_registers{};
+
+    for (size_t i = 0; i < TRACED_REGISTERS.size(); ++i)
+    {
+        values[i] = emu.reg(TRACED_REGISTERS[i]);
+
+        if (values[i] != this->registers_[i])
+        {
+            changed_registers |= 1U << i;
+        }
+    }
+
+    write_varint(this->chunk_, changed_registers);
+
+    for (size_t i = 0; i < TRACED_REGISTERS.size(); ++i)
+    {
+        if (changed_registers & (1U << i))
+        {
+            write_delta(this->chunk_, values[i], this->registers_[i]);
+        }
+    }
+
+    this->registers_ = values;
+}
+
+void execution_trace::flush()
+{
+    this->submit_chunk();
+
+    std::unique_lock lock{this->mutex_};
+    this->condition_variable_.wait(lock, [this] { return this->pending_chunks_.empty() && !this->writing_; });
+
+    this->file_.flush();
+}
+
+void execution_trace::start_chunk()
+{
+    // Deltas restart with every chunk, so chunks decode independently
+    this->address_ = 0;
+    this->registers_ = {};
+
+    if (this->thread_id_)
+    {
+        this->chunk_.push_back(static_cast<std::byte>(record_type::thread_switch));
+        write_varint(this->chunk_, this->thread_id_);
+    }
+}
+
+void execution_trace::submit_chunk()
+{
+    if (this->chunk_.empty())
+    {
+        return;
+    }
+
+    std::vector<std::byte> next_chunk{};
+
+    {
+        std::unique_lock lock{this->mutex_};
+        this->condition_variable_.wait(lock,
+                                       [this] { return this->pending_chunks_.size() < MAX_PENDING_CHUNKS; });
+
+        this->pending_chunks_.push_back(std::move(this->chunk_));
+
+        if (!this->free_chunks_.empty())
+        {
+            next_chunk = std::move(this->free_chunks_.back());
+            this->free_chunks_.pop_back();
+        }
+    }
+
+    this->condition_variable_.notify_all();
+
+    next_chunk.clear();
+    next_chunk.reserve(CHUNK_SIZE + 0x100);
+
+    this->chunk_ = std::move(next_chunk);
+    this->start_chunk();
+}
+
+void execution_trace::run_writer()
+{
+    std::vector<std::vector<std::byte>> chunks{};
+
+    while (true)
+    {
+        {
+            std::unique_lock lock{this->mutex_};
+            this->condition_variable_.wait(lock, [this] { return this->stop_ || !this->pending_chunks_.empty(); });
+
+            if (this->pending_chunks_.empty())
+            {
+                return;
+            }
+
+            std::swap(chunks, this->pending_chunks_);
+            this->writing_ = true;
+        }
+
+        this->condition_variable_.notify_all();
+
+        for (const auto& chunk : chunks)
+        {
+            const auto size = static_cast<uint32_t>(chunk.size());
+            this->file_.write(reinterpret_cast<const char*>(&size), sizeof(size));
+            this->file_.write(reinterpret_cast<const char*>(chunk.data()), static_cast<std::streamsize>(chunk.size()));
+        }
+
+        {
+            std::scoped_lock lock{this->mutex_};
+            this->writing_ = false;
+
+            for (auto& chunk : chunks)
+            {
+                this->free_chunks_.push_back(std::move(chunk));
+            }
+        }
+
+        chunks.clear();
+        this->condition_variable_.notify_all();
+    }
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "std_include.hpp"
+
+#include <x64_emulator.hpp>
+
+#include "execution_trace_format.hpp"
+
+// Records executed blocks and optionally the registers at their start. Records are batched into chunks
+// that a background thread writes to the file, so the emulation thread only encodes them.
+class execution_trace
+{
+  public:
+    execution_trace(const std::filesystem::path& file, bool capture_registers);
+    ~execution_trace();
+
+    execution_trace(execution_trace&&) = delete;
+    execution_trace(const execution_trace&) = delete;
+    execution_trace& operator=(execution_trace&&) = delete;
+    execution_trace& operator=(const execution_trace&) = delete;
+
+    void record_block(x64_emulator& emu, uint32_t thread_id, const basic_block& block);
+
+    // Hands the current chunk to the writer and blocks until everything is written
+    void flush();
+
+  private:
+    bool capture_registers_{false};
+
+    std::vector<std::byte> chunk_{};
+    uint32_t thread_id_{};
+    uint64_t address_{};
+    execution_trace_format::register_values registers_{};
+
+    std::ofstream file_{};
+    std::thread writer_{};
+    std::mutex mutex_{};
+    std::condition_variable condition_variable_{};
+    std::vector<std::vector<std::byte>> pending_chunks_{};
+    std::vector<std::vector<std::byte>> free_chunks_{};
+    bool writing_{false};
+    bool stop_{false};
+
+    void start_chunk();
+    void submit_chunk();
+    void run_writer();
+};
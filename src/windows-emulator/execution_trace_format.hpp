@@ -0,0 +1,179 @@
+#pragma once
+
+#include <span>
+#include <array>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+#include <optional>
+#include <stdexcept>
+
+#include <x64_register.hpp>
+
+// Layout of execution trace files. A file header is followed by chunks, each a 32-bit size and a run of records.
+// Records store varints and zigzag encoded deltas to the previous record of the same chunk, so every chunk can
+// be decoded on its own.
+namespace execution_trace_format
+{
+    constexpr uint32_t MAGIC = 0x52545845; // EXTR
+    constexpr uint32_t VERSION = 1;
+
+    constexpr uint32_t FLAG_REGISTERS = 1 << 0;
+
+    struct file_header
+    {
+        uint32_t magic{};
+        uint32_t version{};
+        uint32_t flags{};
+        uint32_t reserved{};
+    };
+
+    static_assert(sizeof(file_header) == 16);
+
+    enum class record_type : uint8_t
+    {
+        // Address delta and instruction count, followed by a register mask and deltas if registers are traced
+        block,
+        thread_switch,
+    };
+
+    // Registers captured at the start of every block, their index is the bit in the register mask
+    constexpr std::array TRACED_REGISTERS{
+        x64_register::rax, x64_register::rbx, x64_register::rcx, x64_register::rdx, x64_register::rsi,
+        x64_register::rdi, x64_register::rbp, x64_register::rsp, x64_register::r8,  x64_register::r9,
+        x64_register::r10, x64_register::r11, x64_register::r12, x64_register::r13, x64_register::r14,
+        x64_register::r15, x64_register::rflags,
+    };
+
+    using register_values = std::array<uint64_t, TRACED_REGISTERS.size()>;
+
+    constexpr std::array<const char*, TRACED_REGISTERS.size()> TRACED_REGISTER_NAMES{
+        "rax", "rbx", "rcx", "rdx", "rsi", "rdi", "rbp", "rsp", "r8",
+        "r9",  "r10", "r11", "r12", "r13", "r14", "r15", "rflags",
+    };
+
+    inline void write_varint(std::vector<std::byte>& buffer, uint64_t value)
+    {
+        while (value >= 0x80)
+        {
+            buffer.push_back(static_cast<std::byte>((value & 0x7F) | 0x80));
+            value >>= 7;
+        }
+
+        buffer.push_back(static_cast<std::byte>(value));
+    }
+
+    inline void write_delta(std::vector<std::byte>& buffer, const uint64_t value, const uint64_t previous)
+    {
+        const auto delta = static_cast<int64_t>(value - previous);
+        write_varint(buffer, (static_cast<uint64_t>(delta) << 1) ^ static_cast<uint64_t>(delta >> 63));
+    }
+
+    struct record
+    {
+        record_type type{};
+        uint32_t thread_id{};
+        uint64_t address{};
+        uint64_t instruction_count{};
+        // Bit i is set if TRACED_REGISTERS[i] changed since the previous block of the chunk
+        uint32_t changed_registers{};
+        register_values registers{};
+    };
+
+    // Decodes the records of a chunk
+    class chunk_reader
+    {
+      public:
+        chunk_reader(const std::span<const std::byte> data, const bool has_registers)
+            : has_registers_(has_registers),
+              data_(data)
+        {
+        }
+
+        std::optional<record> next()
+        {
+            if (this->position_ >= this->data_.size())
+            {
+                return std::nullopt;
+            }
+
+            record r{};
+            r.type = static_cast<record_type>(this->data_[this->position_++]);
+
+            if (r.type == record_type::thread_switch)
+            {
+                this->thread_id_ = static_cast<uint32_t>(this->read_varint());
+                r.thread_id = this->thread_id_;
+                return r;
+            }
+
+            if (r.type != record_type::block)
+            {
+                throw std::runtime_error("Invalid execution trace record");
+            }
+
+            this->address_ = this->read_delta(this->address_);
+
+            r.thread_id = this->thread_id_;
+            r.address = this->address_;
+            r.instruction_count = this->read_varint();
+
+            if (this->has_registers_)
+            {
+                r.changed_registers = static_cast<uint32_t>(this->read_varint());
+
+                for (size_t i = 0; i < this->registers_.size(); ++i)
+                {
+                    if (r.changed_registers & (1U << i))
+                    {
+                        this->registers_[i] = this->read_delta(this->registers_[i]);
+                    }
+                }
+
+                r.registers = this->registers_;
+            }
+
+            return r;
+        }
+
+      private:
+        bool has_registers_{};
+        std::span<const std::byte> data_{};
+        size_t position_{};
+
+        uint32_t thread_id_{};
+        uint64_t address_{};
+        register_values registers_{};
+
+        uint64_t read_varint()
+        {
+            uint64_t value{};
+
+            for (uint32_t shift = 0; shift < 64; shift += 7)
+            {
+                if (this->position_ >= this->data_.size())
+                {
+                    throw std::runtime_error("Truncated execution trace record");
+                }
+
+                const auto byte = static_cast<uint8_t>(this->data_[this->position_++]);
+                value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+
+                if (!(byte & 0x80))
+                {
+                    break;
+                }
+            }
+
+            return value;
+        }
+
+        uint64_t read_delta(const uint64_t previous)
+        {
+            const auto value = this->read_varint();
+            const auto delta = static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+            return previous + static_cast<uint64_t>(delta);
+        }
+    };
+}
@@ -0,0 +1,443 @@
+#include "function_hle.hpp"
+#include "process_context.hpp"
+
+#include <cstring>
+#include <algorithm>
+#include <utils/string.hpp>
+
+namespace
+{
+    constexpr uint64_t PAGE_SIZE = 0x1000;
+
+    constexpr uint32_t HEAP_ZERO_MEMORY = 0x00000008;
+    constexpr uint32_t HEAP_REALLOC_IN_PLACE_ONLY = 0x00000010;
+
+    struct function_call
+    {
+        x64_emulator& emu;
+        process_context& process;
+        // rcx, rdx, r8 and r9
+        std::array<uint64_t, 4> args{};
+        uint64_t return_address{};
+        uint64_t result{};
+    };
+
+    // Returns false to leave the call to the guest
+    using function_handler = bool (*)(function_call& call);
+
+    // Host accesses would bypass the heap sanitizer, bad ones are left to the guest so its hooks report them
+    bool is_heap_accessible(const function_call& call, const uint64_t address, const uint64_t size)
+    {
+        return call.process.heap.is_accessible(address, size);
+    }
+
+    bool move_memory(x64_emulator& emu, const uint64_t destination, const uint64_t source, const uint64_t size)
+    {
+        if (!size)
+        {
+            return true;
+        }
+
+        const auto source_view = emu.get_readable_view(source, static_cast<size_t>(size));
+        if (source_view.empty())
+        {
+            return false;
+        }
+
+        const auto destination_view = emu.get_writable_view(destination, static_cast<size_t>(size));
+        if (destination_view.empty())
+        {
+            return false;
+        }
+
+        memmove(destination_view.data(), source_view.data(), source_view.size());
+        return true;
+    }
+
+    bool fill_memory(x64_emulator& emu, const uint64_t destination, const uint64_t size, const uint8_t value)
+    {
+        if (!size)
+        {
+            return true;
+        }
+
+        const auto view = emu.get_writable_view(destination, static_cast<size_t>(size));
+        if (view.empty())
+        {
+            return false;
+        }
+
+        memset(view.data(), value, view.size());
+        return true;
+    }
+
+    std::optional<std::pair<std::span<const std::byte>, std::span<const std::byte>>> get_compare_views(
+        x64_emulator& emu, const uint64_t first, const uint64_t second, const uint64_t size)
+    {
+        auto first_view = emu.get_readable_view(first, static_cast<size_t>(size));
+        auto second_view = emu.get_readable_view(second, static_cast<size_t>(size));
+
+        if (first_view.empty() || second_view.empty())
+        {
+            return std::nullopt;
+        }
+
+        return std::make_pair(first_view, second_view);
+    }
+
+    // Scans page by page, the guest would fault at the first page that isn't readable
+    template <typename Char>
+    std::optional<uint64_t> get_string_length(x64_emulator& emu, const uint64_t address)
+    {
+        if (address % sizeof(Char))
+        {
+            return std::nullopt;
+        }
+
+        uint64_t length = 0;
+
+        while (true)
+        {
+            const auto current = address + (length * sizeof(Char));
+            const auto chunk_size = PAGE_SIZE - (current % PAGE_SIZE);
+
+            const auto view = emu.get_readable_view(current, static_cast<size_t>(chunk_size));
+            if (view.empty())
+            {
+                return std::nullopt;
+            }
+
+            const auto* data = reinterpret_cast<const Char*>(view.data());
+            const auto count = view.size() / sizeof(Char);
+            const auto* end = std::char_traits<Char>::find(data, count, Char{});
+
+            if (end)
+            {
+                return length + static_cast<uint64_t>(end - data);
+            }
+
+            length += count;
+        }
+    }
+
+    bool handle_memmove(function_call& call)
+    {
+        call.result = call.args[0];
+        return is_heap_accessible(call, call.args[0], call.args[2]) &&
+               is_heap_accessible(call, call.args[1], call.args[2]) &&
+               move_memory(call.emu, call.args[0], call.args[1], call.args[2]);
+    }
+
+    bool handle_memset(function_call& call)
+    {
+        call.result = call.args[0];
+        return is_heap_accessible(call, call.args[0], call.args[2]) &&
+               fill_memory(call.emu, call.args[0], call.args[2], static_cast<uint8_t>(call.args[1]));
+    }
+
+    bool handle_fill_memory(function_call& call)
+    {
+        return is_heap_accessible(call, call.args[0], call.args[1]) &&
+               fill_memory(call.emu, call.args[0], call.args[1], static_cast<uint8_t>(call.args[2]));
+    }
+
+    bool handle_zero_memory(function_call& call)
+    {
+        return is_heap_accessible(call, call.args[0], call.args[1]) &&
+               fill_memory(call.emu, call.args[0], call.args[1], 0);
+    }
+
+    bool handle_memcmp(function_call& call)
+    {
+        if (!call.args[2])
+        {
+            call.result = 0;
+            return true;
+        }
+
+        const auto views = get_compare_views(call.emu, call.args[0], call.args[1], call.args[2]);
+        if (!views || !is_heap_accessible(call, call.args[0], call.args[2]) ||
+            !is_heap_accessible(call, call.args[1], call.args[2]))
+        {
+            return false;
+        }
+
+        const auto comparison = memcmp(views->first.data(), views->second.data(), views->first.size());
+        call.result = static_cast<uint64_t>(static_cast<int64_t>(comparison < 0 ? -1 : (comparison > 0 ? 1 : 0)));
+        return true;
+    }
+
+    bool handle_compare_memory(function_call& call)
+    {
+        if (!call.args[2])
+        {
+            call.result = 0;
+            return true;
+        }
+
+        const auto views = get_compare_views(call.emu, call.args[0], call.args[1], call.args[2]);
+        if (!views || !is_heap_accessible(call, call.args[0], call.args[2]) ||
+            !is_heap_accessible(call, call.args[1], call.args[2]))
+        {
+            return false;
+        }
+
+        const auto mismatch = std::ranges::mismatch(views->first, views->second);
+        call.result = static_cast<uint64_t>(mismatch.in1 - views->first.begin());
+        return true;
+    }
+
+    bool handle_strlen(function_call& call)
+    {
+        const auto length = get_string_length<char>(call.emu, call.args[0]);
+        call.result = length.value_or(0);
+        return length && is_heap_accessible(call, call.args[0], *length + 1);
+    }
+
+    bool handle_wcslen(function_call& call)
+    {
+        const auto length = get_string_length<char16_t>(call.emu, call.args[0]);
+        call.result = length.value_or(0);
+        return length && is_heap_accessible(call, call.args[0], (*length + 1) * sizeof(char16_t));
+    }
+
+    // Windows fails fast on heap corruption, which terminates the process
+    bool report_heap_corruption(function_call& call)
+    {
+        call.process.exit_status = STATUS_HEAP_CORRUPTION;
+        call.process.exception_rip = call.return_address;
+        call.emu.stop();
+        return true;
+    }
+
+    bool handle_allocate_heap(function_call& call)
+    {
+        const auto flags = static_cast<uint32_t>(call.args[1]);
+        call.result = call.process.heap.allocate(call.emu, call.args[2], flags & HEAP_ZERO_MEMORY);
+        return true;
+    }
+
+    bool handle_free_heap(function_call& call)
+    {
+        if (!call.args[2])
+        {
+            call.result = TRUE;
+            return true;
+        }
+
+        const auto status = call.process.heap.release(call.emu, call.args[2]);
+        if (status == heap_status::corrupted)
+        {
+            return report_heap_corruption(call);
+        }
+
+        call.result = TRUE;
+        return status == heap_status::success;
+    }
+
+    bool handle_size_heap(function_call& call)
+    {
+        const auto size = call.process.heap.get_size(call.args[2]);
+        call.result = size.value_or(0);
+        return size.has_value();
+    }
+
+    bool handle_reallocate_heap(function_call& call)
+    {
+        const auto flags = static_cast<uint32_t>(call.args[1]);
+        const auto [status, address] =
+            call.process.heap.reallocate(call.emu, call.args[2], call.args[3], flags & HEAP_ZERO_MEMORY,
+                                         flags & HEAP_REALLOC_IN_PLACE_ONLY);
+
+        if (status == heap_status::corrupted)
+        {
+            return report_heap_corruption(call);
+        }
+
+        call.result = address;
+        return status == heap_status::success;
+    }
+
+    struct function_entry
+    {
+        function_handler handler{};
+        bool is_heap_function{};
+    };
+
+    const std::unordered_map<std::string_view, function_entry>& get_functions()
+    {
+        static const std::unordered_map<std::string_view, function_entry> functions{
+            {"memcpy", {handle_memmove}},
+            {"memmove", {handle_memmove}},
+            {"memset", {handle_memset}},
+            {"memcmp", {handle_memcmp}},
+            {"strlen", {handle_strlen}},
+            {"wcslen", {handle_wcslen}},
+            {"RtlCopyMemory", {handle_memmove}},
+            {"RtlMoveMemory", {handle_memmove}},
+            {"RtlFillMemory", {handle_fill_memory}},
+            {"RtlZeroMemory", {handle_zero_memory}},
+            {"RtlCompareMemory", {handle_compare_memory}},
+            {"RtlAllocateHeap", {handle_allocate_heap, true}},
+            {"RtlFreeHeap", {handle_free_heap, true}},
+            {"RtlSizeHeap", {handle_size_heap, true}},
+            {"RtlReAllocateHeap", {handle_reallocate_heap, true}},
+        };
+
+        return functions;
+    }
+
+    bool is_ntdll(const std::string& name)
+    {
+        return name == "ntdll.dll";
+    }
+
+    bool is_crt(const std::string& name)
+    {
+        return name == "ucrtbase.dll" || name == "msvcrt.dll" || name == "vcruntime140.dll";
+    }
+
+    // The heap is only emulated through ntdll, CRT allocators end up there anyway
+    const function_entry* find_function(const process_context& process, const mapped_module& mod,
+                                        const std::string& name)
+    {
+        const auto entry = get_functions().find(name);
+        if (entry == get_functions().end())
+        {
+            return nullptr;
+        }
+
+        const auto module_name = utils::string::to_lower(mod.name);
+
+        if (entry->second.is_heap_function)
+        {
+            return process.heap.is_enabled() && is_ntdll(module_name) ? &entry->second : nullptr;
+        }
+
+        const auto is_supported = is_ntdll(module_name) || is_crt(module_name);
+        return process.emulate_library_functions && is_supported ? &entry->second : nullptr;
+    }
+
+    const function_entry* find_function(const process_context& process,
+                                        const std::map<uint64_t, mapped_module>& modules, const uint64_t address)
+    {
+        auto entry = modules.upper_bound(address);
+        if (entry == modules.begin())
+        {
+            return nullptr;
+        }
+
+        const auto& mod = std::prev(entry)->second;
+        if (!mod.is_within(address))
+        {
+            return nullptr;
+        }
+
+        const auto* name = mod.find_export_name(address);
+        return name ? find_function(process, mod, *name) : nullptr;
+    }
+
+    // Runs the function and returns to the caller as its ret would
+    void run_function(x64_emulator& emu, process_context& process, const function_handler handler)
+    {
+        const auto registers = emu.read_registers(std::array{
+            x64_register::rcx,
+            x64_register::rdx,
+            x64_register::r8,
+            x64_register::r9,
+            x64_register::rsp,
+        });
+
+        const auto stack_pointer = registers[4];
+
+        uint64_t return_address{};
+        if (!emu.try_read_memory(stack_pointer, &return_address, sizeof(return_address)))
+        {
+            return;
+        }
+
+        function_call call{
+            .emu = emu,
+            .process = process,
+            .args = {registers[0], registers[1], registers[2], registers[3]},
+            .return_address = return_address,
+        };
+
+        if (!handler(call))
+        {
+            return;
+        }
+
+        emu.write_registers(std::array{x64_register::rax, x64_register::rsp, x64_register::rip},
+                            std::array{call.result, stack_pointer + sizeof(uint64_t), return_address});
+    }
+}
+
+function_hle::function_hle(x64_emulator& emu, process_context& process)
+    : emu_(&emu),
+      process_(&process)
+{
+}
+
+function_hle::~function_hle()
+{
+    for (auto* hook : this->hooks_ | std::views::values)
+    {
+        this->emu_->delete_hook(hook);
+    }
+}
+
+void function_hle::hook_module(const mapped_module& mod)
+{
+    for (const auto& symbol : mod.exports)
+    {
+        const auto* function = find_function(*this->process_, mod, symbol.name);
+        if (!function || !mod.is_within(symbol.address) || this->hooks_.contains(symbol.address))
+        {
+            continue;
+        }
+
+        auto* hook = this->emu_->hook_memory_execution(
+            symbol.address, 1, [this, handler = function->handler](uint64_t, size_t, uint64_t) {
+                run_function(*this->emu_, *this->process_, handler); //
+            });
+
+        this->hooks_[symbol.address] = hook;
+    }
+}
+
+void function_hle::unhook_module(const mapped_module& mod)
+{
+    this->unhook_range(mod.image_base, mod.size_of_image);
+}
+
+void function_hle::synchronize(const std::map<uint64_t, mapped_module>& modules)
+{
+    for (auto i = this->hooks_.begin(); i != this->hooks_.end();)
+    {
+        if (find_function(*this->process_, modules, i->first))
+        {
+            ++i;
+            continue;
+        }
+
+        this->emu_->delete_hook(i->second);
+        i = this->hooks_.erase(i);
+    }
+
+    for (const auto& mod : modules | std::views::values)
+    {
+        this->hook_module(mod);
+    }
+}
+
+void function_hle::unhook_range(const uint64_t address, const uint64_t size)
+{
+    auto i = this->hooks_.lower_bound(address);
+
+    while (i != this->hooks_.end() && i->first < address + size)
+    {
+        this->emu_->delete_hook(i->second);
+        i = this->hooks_.erase(i);
+    }
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "std_include.hpp"
+
+#include <x64_emulator.hpp>
+
+struct mapped_module;
+struct process_context;
+
+// Runs hot memory and string routines of ntdll and the CRTs on the host instead of emulating them, as well as
+// the heap functions with emulated_heap. Which ones is taken from the process.
+// Calls whose memory isn't accessible as host views are left to the guest implementation, so faults keep
+// their exact semantics. Memory accessed on the host skips memory hooks.
+class function_hle
+{
+  public:
+    function_hle(x64_emulator& emu, process_context& process);
+    ~function_hle();
+
+    function_hle(const function_hle&) = delete;
+    function_hle& operator=(const function_hle&) = delete;
+    function_hle(function_hle&&) = delete;
+    function_hle& operator=(function_hle&&) = delete;
+
+    void hook_module(const mapped_module& mod);
+    void unhook_module(const mapped_module& mod);
+
+    // Hooks all given modules and drops the hooks of modules that are gone, e.g. after deserialization
+    void synchronize(const std::map<uint64_t, mapped_module>& modules);
+
+  private:
+    x64_emulator* emu_{};
+    process_context* process_{};
+    std::map<uint64_t, emulator_hook*> hooks_{};
+
+    void unhook_range(uint64_t address, uint64_t size);
+};
@@ -17,6 +17,7 @@ struct handle_types
         registry,
         mutant,
         token,
+        io_completion,
     };
 };
 
@@ -117,29 +118,121 @@ struct generic_handle_store
     virtual bool erase(const handle h) = 0;
 };
 
+// Handles index a dense slot table. Freed slots are reused and bump the generation stored in the handle's padding
+// bits, so stale handles of reused slots are rejected.
 template <handle_types::type Type, typename T, uint32_t IndexShift = 0>
     requires(utils::Serializable<T>)
 class handle_store : public generic_handle_store
 {
   public:
     using index_type = uint32_t;
-    using value_map = std::map<index_type, T>;
+    using generation_type = uint16_t;
+    using value_type = std::pair<const index_type, T>;
+
+  private:
+    static constexpr generation_type GENERATION_MASK = (1 << 14) - 1;
+    static constexpr index_type MAX_INDEX = std::numeric_limits<index_type>::max() >> IndexShift;
+
+    struct slot
+    {
+        generation_type generation{};
+        // Unique for every stored value, unlike the generation it doesn't wrap
+        uint64_t serial{};
+        std::optional<value_type> entry{};
+    };
+
+    // Deque to keep stored values at a stable address
+    using slot_container = std::deque<slot>;
+
+    template <bool IsConst>
+    class basic_iterator
+    {
+      public:
+        using iterator_category = std::forward_iterator_tag;
+        using difference_type = std::ptrdiff_t;
+        using value_type = handle_store::value_type;
+        using pointer = std::conditional_t<IsConst, const value_type*, value_type*>;
+        using reference = std::conditional_t<IsConst, const value_type&, value_type&>;
+        using slot_iterator =
+            std::conditional_t<IsConst, typename slot_container::const_iterator, typename slot_container::iterator>;
+
+        basic_iterator() = default;
+
+        basic_iterator(const slot_iterator current, const slot_iterator end)
+            : current_(current),
+              end_(end)
+        {
+            this->skip_free_slots();
+        }
+
+        operator basic_iterator<true>() const
+            requires(!IsConst)
+        {
+            return {this->current_, this->end_};
+        }
+
+        reference operator*() const
+        {
+            return *this->current_->entry;
+        }
+
+        pointer operator->() const
+        {
+            return &*this->current_->entry;
+        }
+
+        basic_iterator& operator++()
+        {
+            ++this->current_;
+            this->skip_free_slots();
+            return *this;
+        }
+
+        basic_iterator operator++(int)
+        {
+            auto old = *this;
+            ++*this;
+            return old;
+        }
+
+        bool operator==(const basic_iterator& other) const
+        {
+            return this->current_ == other.current_;
+        }
+
+      private:
+        slot_iterator current_{};
+        slot_iterator end_{};
+
+        void skip_free_slots()
+        {
+            while (this->current_ != this->end_ && !this->current_->entry)
+            {
+                ++this->current_;
+            }
+        }
+    };
+
+  public:
+    using iterator = basic_iterator<false>;
+    using const_iterator = basic_iterator<true>;
 
     bool block_mutation(bool blocked)
     {
+        ++this->modifications_;
         std::swap(this->block_mutation_, blocked);
         return blocked;
     }
 
     handle store(T value)
     {
-        if (this->block_mutation_)
-        {
-            throw std::runtime_error("Mutation of handle store is blocked!");
-        }
+        this->ensure_mutable();
+        ++this->modifications_;
 
-        auto index = this->find_free_index();
-        this->store_.emplace(index, std::move(value));
+        const auto index = this->allocate_index();
+        auto& s = this->slots_[index - 1];
+        s.entry.emplace(index, std::move(value));
+        s.serial = ++this->stored_values_;
 
         return make_handle(index);
     }
@@ -152,23 +245,34 @@ class handle_store : public generic_handle_store
         h.value.type = Type;
         h.value.id = index << IndexShift;
 
+        if (index > 0 && index <= this->slots_.size())
+        {
+            h.value.padding = this->slots_[index - 1].generation;
+        }
+
         return h;
     }
 
     T* get_by_index(const uint32_t index)
     {
-        return this->get(this->make_handle(index));
+        auto* s = this->find_slot(index);
+        if (!s || !s->entry)
+        {
+            return nullptr;
+        }
+
+        return &s->entry->second;
     }
 
     T* get(const handle_value h)
     {
-        const auto entry = this->get_iterator(h);
-        if (entry == this->store_.end())
+        auto* s = this->find_slot(h);
+        if (!s)
         {
             return nullptr;
         }
 
-        return &entry->second;
+        return &s->entry->second;
     }
 
     T* get(const handle h)
@@ -186,37 +290,49 @@ class handle_store : public generic_handle_store
 
     size_t size() const
     {
-        return this->store_.size();
+        return this->slots_.size() - this->free_indices_.size();
     }
 
-    bool erase(const typename value_map::iterator& entry)
+    // Tells values apart that were stored under the same handle, 0 if the index is free
+    uint64_t get_serial(const index_type index) const
     {
-        if (this->block_mutation_)
+        if (index == 0 || index > this->slots_.size() || !this->slots_[index - 1].entry)
         {
-            throw std::runtime_error("Mutation of handle store is blocked!");
+            return 0;
         }
 
-        if (entry == this->store_.end())
-        {
-            return false;
-        }
+        return this->slots_[index - 1].serial;
+    }
 
-        if constexpr (handle_detail::has_deleter_function<T>())
+    // Bumped by every access that hands out mutable entries, so unchanged counts mean unchanged contents
+    uint64_t get_modifications() const
+    {
+        return this->modifications_;
+    }
+
+    bool erase(const iterator& entry)
+    {
+        this->ensure_mutable();
+
+        if (entry == this->end())
         {
-            if (!T::deleter(entry->second))
-            {
-                return false;
-            }
+            return false;
         }
 
-        this->store_.erase(entry);
-        return true;
+        return this->erase_slot(this->slots_[entry->first - 1]);
     }
 
     bool erase(const handle_value h)
     {
-        const auto entry = this->get_iterator(h);
-        return this->erase(entry);
+        this->ensure_mutable();
+
+        auto* s = this->find_slot(h);
+        if (!s)
+        {
+            return false;
+        }
+
+        return this->erase_slot(*s);
     }
 
     bool erase(const handle h) override
@@ -241,19 +357,56 @@ class handle_store : public generic_handle_store
     void serialize(utils::buffer_serializer& buffer) const
     {
         buffer.write(this->block_mutation_);
-        buffer.write_map(this->store_);
+        buffer.write_vector(this->free_indices_);
+        buffer.write(this->stored_values_);
+        buffer.write<uint64_t>(this->slots_.size());
+
+        for (const auto& s : this->slots_)
+        {
+            buffer.write(s.generation);
+            buffer.write(s.serial);
+            buffer.write(s.entry.has_value());
+
+            if (s.entry)
+            {
+                buffer.write(s.entry->second);
+            }
+        }
     }
 
     void deserialize(utils::buffer_deserializer& buffer)
     {
+        ++this->modifications_;
+
         buffer.read(this->block_mutation_);
-        buffer.read_map(this->store_);
+        buffer.read_vector(this->free_indices_);
+        buffer.read(this->stored_values_);
+
+        const auto slot_count = buffer.read<uint64_t>();
+        if (slot_count > MAX_INDEX)
+        {
+            throw std::runtime_error("Invalid handle store size");
+        }
+
+        this->slots_.clear();
+
+        for (uint64_t i = 0; i < slot_count; ++i)
+        {
+            auto& s = this->slots_.emplace_back();
+            buffer.read(s.generation);
+            buffer.read(s.serial);
+
+            if (buffer.read<bool>())
+            {
+                s.entry.emplace(static_cast<index_type>(i + 1), buffer.read<T>());
+            }
+        }
     }
 
-    typename value_map::iterator find(const T& value)
+    iterator find(const T& value)
     {
-        auto i = this->store_.begin();
-        for (; i != this->store_.end(); ++i)
+        auto i = this->begin();
+        for (; i != this->end(); ++i)
         {
             if (&i->second == &value)
             {
@@ -264,10 +417,10 @@ class handle_store : public generic_handle_store
         return i;
     }
 
-    typename value_map::const_iterator find(const T& value) const
+    const_iterator find(const T& value) const
     {
-        auto i = this->store_.begin();
-        for (; i != this->store_.end(); ++i)
+        auto i = this->begin();
+        for (; i != this->end(); ++i)
         {
             if (&i->second == &value)
             {
@@ -299,53 +452,104 @@ class handle_store : public generic_handle_store
         return this->find_handle(*value);
     }
 
-    typename value_map::iterator begin()
+    iterator begin()
     {
-        return this->store_.begin();
+        ++this->modifications_;
+        return {this->slots_.begin(), this->slots_.end()};
     }
 
-    typename value_map::const_iterator begin() const
+    const_iterator begin() const
     {
-        return this->store_.begin();
+        return {this->slots_.begin(), this->slots_.end()};
     }
 
-    typename value_map::iterator end()
+    iterator end()
     {
-        return this->store_.end();
+        return {this->slots_.end(), this->slots_.end()};
     }
 
-    typename value_map::const_iterator end() const
+    const_iterator end() const
     {
-        return this->store_.end();
+        return {this->slots_.end(), this->slots_.end()};
     }
 
   private:
-    typename value_map::iterator get_iterator(const handle_value h)
+    void ensure_mutable() const
+    {
+        if (this->block_mutation_)
+        {
+            throw std::runtime_error("Mutation of handle store is blocked!");
+        }
+    }
+
+    slot* find_slot(const index_type index)
+    {
+        ++this->modifications_;
+
+        if (index == 0 || index > this->slots_.size())
+        {
+            return nullptr;
+        }
+
+        return &this->slots_[index - 1];
+    }
+
+    slot* find_slot(const handle_value h)
     {
         if (h.type != Type || h.is_pseudo)
         {
-            return this->store_.end();
+            return nullptr;
+        }
+
+        auto* s = this->find_slot(static_cast<index_type>(h.id) >> IndexShift);
+        if (!s || !s->entry || s->generation != h.padding)
+        {
+            return nullptr;
         }
 
-        return this->store_.find(static_cast<uint32_t>(h.id) >> IndexShift);
+        return s;
     }
 
-    uint32_t find_free_index()
+    index_type allocate_index()
     {
-        uint32_t index = 1;
-        for (; index > 0; ++index)
+        if (!this->free_indices_.empty())
+        {
+            const auto index = this->free_indices_.back();
+            this->free_indices_.pop_back();
+            return index;
+        }
+
+        if (this->slots_.size() >= MAX_INDEX)
         {
-            if (!this->store_.contains(index))
+            throw std::runtime_error("Handle store is full");
+        }
+
+        this->slots_.emplace_back();
+        return static_cast<index_type>(this->slots_.size());
+    }
+
+    bool erase_slot(slot& s)
+    {
+        if constexpr (handle_detail::has_deleter_function<T>())
+        {
+            if (!T::deleter(s.entry->second))
             {
-                break;
+                return false;
             }
         }
 
-        return index;
+        this->free_indices_.push_back(s.entry->first);
+        s.entry.reset();
+        s.generation = static_cast<generation_type>((s.generation + 1) & GENERATION_MASK);
+
+        return true;
     }
 
     bool block_mutation_{false};
-    value_map store_{};
+    slot_container slots_{};
+    std::vector<index_type> free_indices_{};
+    uint64_t stored_values_{};
+    uint64_t modifications_{};
 };
 
 constexpr auto KNOWN_DLLS_DIRECTORY = make_pseudo_handle(0x1, handle_types::directory);
@@ -0,0 +1,74 @@
+#include "heap_sanitizer.hpp"
+#include "process_context.hpp"
+#include "logger.hpp"
+
+heap_sanitizer::heap_sanitizer(x64_emulator& emu, process_context& process, logger& log)
+    : emu_(&emu),
+      process_(&process),
+      log_(&log)
+{
+    this->process_->heap.set_region_callback([this] { this->synchronize(); });
+    this->synchronize();
+}
+
+heap_sanitizer::~heap_sanitizer()
+{
+    this->process_->heap.set_region_callback({});
+
+    for (auto* hook : this->hooks_ | std::views::values)
+    {
+        this->emu_->delete_hook(hook);
+    }
+}
+
+void heap_sanitizer::synchronize()
+{
+    const auto& regions = this->process_->heap.get_regions();
+
+    for (auto i = this->hooks_.begin(); i != this->hooks_.end();)
+    {
+        if (regions.contains(i->first))
+        {
+            ++i;
+            continue;
+        }
+
+        this->emu_->delete_hook(i->second);
+        i = this->hooks_.erase(i);
+    }
+
+    for (const auto& [address, size] : regions)
+    {
+        if (this->hooks_.contains(address))
+        {
+            continue;
+        }
+
+        this->hooks_[address] = this->emu_->hook_memory_access(
+            address, static_cast<size_t>(size), memory_operation::read | memory_operation::write,
+            [this](const uint64_t a, const size_t s, uint64_t, const memory_operation operation) {
+                this->check_access(a, s, operation);
+            });
+    }
+}
+
+void heap_sanitizer::check_access(const uint64_t address, const size_t size, const memory_operation operation) const
+{
+    const auto state = this->process_->heap.check_access(address, size);
+    if (!state || this->process_->exception_rip)
+    {
+        return;
+    }
+
+    const auto rip = this->emu_->read_instruction_pointer();
+    const auto* name = this->process_->mod_manager.find_name(rip);
+    const auto* kind = *state == heap_shadow_state::freed ? "Heap use after free" : "Heap buffer overflow";
+    const auto* access = operation == memory_operation::write ? "write" : "read";
+
+    this->log_->error("%s: %s of 0x%" PRIx64 " (%zX) at 0x%" PRIx64 " (%s)\n", kind, access, address, size, rip,
+                      name);
+
+    this->process_->exit_status = STATUS_HEAP_CORRUPTION;
+    this->process_->exception_rip = rip;
+    this->emu_->stop();
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "std_include.hpp"
+
+#include <x64_emulator.hpp>
+
+class logger;
+struct process_context;
+
+// Checks guest reads and writes within the emulated heap against its shadow state. Accesses of redzones,
+// unallocated or quarantined memory terminate the process like a fail fast, which the fuzzer reports as a crash.
+// Only the heap regions are hooked, so the cost is limited to code that touches the heap.
+class heap_sanitizer
+{
+  public:
+    heap_sanitizer(x64_emulator& emu, process_context& process, logger& log);
+    ~heap_sanitizer();
+
+    heap_sanitizer(const heap_sanitizer&) = delete;
+    heap_sanitizer& operator=(const heap_sanitizer&) = delete;
+    heap_sanitizer(heap_sanitizer&&) = delete;
+    heap_sanitizer& operator=(heap_sanitizer&&) = delete;
+
+    // Hooks the current heap regions, the heap triggers it whenever they change
+    void synchronize();
+
+  private:
+    x64_emulator* emu_{};
+    process_context* process_{};
+    logger* log_{};
+    std::map<uint64_t, emulator_hook*> hooks_{};
+
+    void check_access(uint64_t address, size_t size, memory_operation operation) const;
+};
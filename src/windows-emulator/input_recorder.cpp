@@ -0,0 +1,184 @@
+#include "input_recorder.hpp"
+#include "process_context.hpp"
+
+#include <cstring>
+#include <utils/io.hpp>
+
+namespace
+{
+    constexpr uint32_t MAGIC = 0x43524E49; // INRC
+    constexpr uint32_t VERSION = 1;
+
+    struct file_header
+    {
+        uint32_t magic{};
+        uint32_t version{};
+    };
+
+    struct entry_header
+    {
+        uint64_t instructions{};
+        uint32_t size{};
+        recorded_input type{};
+        uint8_t reserved[3]{};
+    };
+
+    static_assert(sizeof(entry_header) == 16);
+
+    std::string get_input_name(const recorded_input type)
+    {
+        switch (type)
+        {
+        case recorded_input::steady_time:
+            return "steady time";
+        case recorded_input::system_time:
+            return "system time";
+        case recorded_input::file_read:
+            return "file read";
+        case recorded_input::socket_bind:
+            return "socket bind";
+        case recorded_input::socket_send:
+            return "socket send";
+        case recorded_input::socket_receive:
+            return "socket receive";
+        case recorded_input::socket_poll:
+            return "socket poll";
+        case recorded_input::stop_position:
+            return "stop position";
+        }
+
+        return "input " + std::to_string(static_cast<uint32_t>(type));
+    }
+}
+
+input_recorder::input_recorder(const process_context& process, const std::filesystem::path& file,
+                               const mode recorder_mode)
+    : process_(&process),
+      mode_(recorder_mode)
+{
+    if (this->is_replaying())
+    {
+        this->load(file);
+        return;
+    }
+
+    this->file_ = std::ofstream(file, std::ios::binary | std::ios::trunc);
+    if (!this->file_)
+    {
+        throw std::runtime_error("Failed to open input recording: " + file.string());
+    }
+
+    const file_header header{MAGIC, VERSION};
+    this->file_.write(reinterpret_cast<const char*>(&header), sizeof(header));
+}
+
+input_recorder::~input_recorder()
+{
+    this->flush();
+}
+
+void input_recorder::flush()
+{
+    if (this->file_.is_open())
+    {
+        this->file_.flush();
+    }
+}
+
+void input_recorder::record(const recorded_input type, const std::span<const std::byte> data)
+{
+    entry_header header{};
+    header.instructions = this->process_->executed_instructions;
+    header.size = static_cast<uint32_t>(data.size());
+    header.type = type;
+
+    this->file_.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    this->file_.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+}
+
+std::vector<std::byte> input_recorder::replay(const recorded_input type)
+{
+    auto& entries = this->entries_[type];
+    if (entries.empty())
+    {
+        throw std::runtime_error("Input recording has no more " + get_input_name(type) + " entries");
+    }
+
+    auto entry = std::move(entries.front());
+    entries.pop_front();
+
+    // Stop positions are requested when the run they end starts
+    if (type != recorded_input::stop_position && entry.instructions != this->process_->executed_instructions)
+    {
+        throw std::runtime_error("Replay diverged: " + get_input_name(type) + " recorded at " +
+                                 std::to_string(entry.instructions) + " instructions, requested at " +
+                                 std::to_string(this->process_->executed_instructions));
+    }
+
+    return std::move(entry.data);
+}
+
+void input_recorder::record_value(const recorded_input type, const uint64_t value)
+{
+    this->record(type, std::as_bytes(std::span(&value, 1)));
+}
+
+uint64_t input_recorder::replay_value(const recorded_input type)
+{
+    const auto data = this->replay(type);
+    if (data.size() != sizeof(uint64_t))
+    {
+        throw std::runtime_error("Invalid " + get_input_name(type) + " entry");
+    }
+
+    uint64_t value{};
+    memcpy(&value, data.data(), sizeof(value));
+    return value;
+}
+
+void input_recorder::load(const std::filesystem::path& file)
+{
+    std::vector<uint8_t> data{};
+    if (!utils::io::read_file(file, &data))
+    {
+        throw std::runtime_error("Failed to read input recording: " + file.string());
+    }
+
+    file_header header{};
+    if (data.size() < sizeof(header))
+    {
+        throw std::runtime_error("Invalid input recording: " + file.string());
+    }
+
+    memcpy(&header, data.data(), sizeof(header));
+    if (header.magic != MAGIC || header.version != VERSION)
+    {
+        throw std::runtime_error("Unsupported input recording: " + file.string());
+    }
+
+    // A truncated last entry is dropped, the recording process may have died while writing it
+    size_t position = sizeof(header);
+    while (data.size() - position >= sizeof(entry_header))
+    {
+        entry_header entry_info{};
+        memcpy(&entry_info, data.data() + position, sizeof(entry_info));
+        position += sizeof(entry_info);
+
+        if (data.size() - position < entry_info.size)
+        {
+            break;
+        }
+
+        entry e{};
+        e.instructions = entry_info.instructions;
+        e.data.resize(entry_info.size);
+
+        if (entry_info.size)
+        {
+            memcpy(e.data.data(), data.data() + position, entry_info.size);
+        }
+
+        position += entry_info.size;
+        this->entries_[entry_info.type].push_back(std::move(e));
+    }
+}
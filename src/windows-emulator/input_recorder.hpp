@@ -0,0 +1,93 @@
+#pragma once
+
+#include "std_include.hpp"
+
+struct process_context;
+
+enum class recorded_input : uint8_t
+{
+    steady_time,
+    system_time,
+    file_read,
+    socket_bind,
+    socket_send,
+    socket_receive,
+    socket_poll,
+    stop_position,
+};
+
+// Records every nondeterministic input the guest observes, together with the instruction count it was observed
+// at, or feeds recorded inputs back instead of querying the host. Every input type is replayed in its own
+// order. An input requested at a different instruction count than recorded means the replay diverged.
+class input_recorder
+{
+  public:
+    enum class mode : uint8_t
+    {
+        record,
+        replay,
+    };
+
+    input_recorder(const process_context& process, const std::filesystem::path& file, mode recorder_mode);
+    ~input_recorder();
+
+    input_recorder(input_recorder&&) = delete;
+    input_recorder(const input_recorder&) = delete;
+    input_recorder& operator=(input_recorder&&) = delete;
+    input_recorder& operator=(const input_recorder&) = delete;
+
+    bool is_replaying() const
+    {
+        return this->mode_ == mode::replay;
+    }
+
+    // Returns the live value while recording and the recorded one while replaying, live is not called then
+    template <typename F>
+    uint64_t capture(const recorded_input type, F&& live)
+    {
+        if (this->is_replaying())
+        {
+            return this->replay_value(type);
+        }
+
+        const uint64_t value = live();
+        this->record_value(type, value);
+        return value;
+    }
+
+    template <typename F>
+    std::vector<std::byte> capture_data(const recorded_input type, F&& live)
+    {
+        if (this->is_replaying())
+        {
+            return this->replay(type);
+        }
+
+        std::vector<std::byte> data = live();
+        this->record(type, data);
+        return data;
+    }
+
+    void record(recorded_input type, std::span<const std::byte> data);
+    std::vector<std::byte> replay(recorded_input type);
+
+    void record_value(recorded_input type, uint64_t value);
+    uint64_t replay_value(recorded_input type);
+
+    void flush();
+
+  private:
+    struct entry
+    {
+        uint64_t instructions{};
+        std::vector<std::byte> data{};
+    };
+
+    const process_context* process_{};
+    mode mode_{};
+
+    std::ofstream file_{};
+    std::map<recorded_input, std::deque<entry>> entries_{};
+
+    void load(const std::filesystem::path& file);
+};
@@ -12,6 +12,7 @@ struct process_context;
 
 struct io_device_context
 {
+    handle file_handle{};
     handle event{};
     emulator_pointer /*PIO_APC_ROUTINE*/ apc_routine{};
     emulator_pointer apc_context{};
@@ -34,6 +35,7 @@ struct io_device_context
 
     void serialize(utils::buffer_serializer& buffer) const
     {
+        buffer.write(file_handle);
         buffer.write(event);
         buffer.write(apc_routine);
         buffer.write(apc_context);
@@ -47,6 +49,7 @@ struct io_device_context
 
     void deserialize(utils::buffer_deserializer& buffer)
     {
+        buffer.read(file_handle);
         buffer.read(event);
         buffer.read(apc_routine);
         buffer.read(apc_context);
@@ -75,6 +78,13 @@ inline void write_io_status(const emulator_object<IO_STATUS_BLOCK<EmulatorTraits
     }
 }
 
+struct io_device_wakeup
+{
+    std::optional<std::chrono::steady_clock::time_point> deadline{};
+    std::vector<std::pair<uint64_t, bool>> sockets{}; // Native socket and whether readability is awaited
+    bool needs_polling{false};
+};
+
 struct io_device
 {
     io_device() = default;
@@ -99,6 +109,12 @@ struct io_device
         (void)win_emu;
     }
 
+    // Describes what pending work is waiting for, so the scheduler can sleep until it can make progress
+    virtual void collect_wakeup(io_device_wakeup& wakeup) const
+    {
+        (void)wakeup;
+    }
+
     virtual void serialize(utils::buffer_serializer& buffer) const = 0;
     virtual void deserialize(utils::buffer_deserializer& buffer) = 0;
 
@@ -156,6 +172,12 @@ class io_device_container : public io_device
         return this->device_->work(win_emu);
     }
 
+    void collect_wakeup(io_device_wakeup& wakeup) const override
+    {
+        this->assert_validity();
+        this->device_->collect_wakeup(wakeup);
+    }
+
     void serialize(utils::buffer_serializer& buffer) const override
     {
         this->assert_validity();
@@ -10,7 +10,7 @@ constexpr auto KUSD_BUFFER_SIZE = page_align_up(KUSD_SIZE);
 
 namespace
 {
-    void setup_kusd(KUSER_SHARED_DATA64& kusd, const bool use_relative_time)
+    void setup_kusd(KUSER_SHARED_DATA64& kusd, const bool use_relative_time, const uint64_t instructions_per_second)
     {
         memset(reinterpret_cast<void*>(&kusd), 0, sizeof(kusd));
 
@@ -73,7 +73,7 @@ namespace
 
         if (use_relative_time)
         {
-            kusd.QpcFrequency = 1000;
+            kusd.QpcFrequency = static_cast<LONGLONG>(instructions_per_second);
         }
         else
         {
@@ -118,19 +118,26 @@ kusd_mmio::kusd_mmio(utils::buffer_deserializer& buffer)
 {
 }
 
-void kusd_mmio::setup(const bool use_relative_time)
+void kusd_mmio::setup(const bool use_relative_time, const bool as_memory, const uint64_t instructions_per_second)
 {
     this->use_relative_time_ = use_relative_time;
+    this->as_memory_ = as_memory;
 
-    setup_kusd(this->kusd_, use_relative_time);
+    setup_kusd(this->kusd_, use_relative_time, std::max(instructions_per_second, static_cast<uint64_t>(1)));
     this->start_time_ = convert_from_ksystem_time(this->kusd_.SystemTime);
 
+    if (use_relative_time)
+    {
+        this->process_->clock.use_virtual_time(static_cast<uint64_t>(this->kusd_.QpcFrequency), this->start_time_);
+    }
+
     this->register_mmio();
 }
 
 void kusd_mmio::serialize(utils::buffer_serializer& buffer) const
 {
     buffer.write(this->use_relative_time_);
+    buffer.write(this->as_memory_);
     buffer.write(this->kusd_);
     buffer.write(this->start_time_);
 }
@@ -138,13 +145,39 @@ void kusd_mmio::serialize(utils::buffer_serializer& buffer) const
 void kusd_mmio::deserialize(utils::buffer_deserializer& buffer)
 {
     buffer.read(this->use_relative_time_);
+    buffer.read(this->as_memory_);
     buffer.read(this->kusd_);
     buffer.read(this->start_time_);
 
+    // The page is part of the memory state, it has already been restored
+    if (this->as_memory_)
+    {
+        this->registered_ = true;
+        return;
+    }
+
     this->deregister_mmio();
     this->register_mmio();
 }
 
+void kusd_mmio::refresh()
+{
+    if (!this->as_memory_ || !this->registered_)
+    {
+        return;
+    }
+
+    this->update();
+
+    // The field is volatile, it has to be copied out before it can be written
+    KSYSTEM_TIME system_time{};
+    system_time.LowPart = this->kusd_.SystemTime.LowPart;
+    system_time.High1Time = this->kusd_.SystemTime.High1Time;
+    system_time.High2Time = this->kusd_.SystemTime.High2Time;
+
+    this->emu_->write_memory(KUSD_ADDRESS + offsetof(KUSER_SHARED_DATA64, SystemTime), system_time);
+}
+
 uint64_t kusd_mmio::read(const uint64_t addr, const size_t size)
 {
     uint64_t result{};
@@ -178,22 +211,7 @@ uint64_t kusd_mmio::address()
 
 void kusd_mmio::update()
 {
-    auto time = this->start_time_;
-
-    if (this->use_relative_time_)
-    {
-        const auto passed_time = this->process_->executed_instructions;
-        const auto clock_frequency = static_cast<uint64_t>(this->kusd_.QpcFrequency);
-
-        using duration = std::chrono::system_clock::duration;
-        time += duration(passed_time * duration::period::den / clock_frequency);
-    }
-    else
-    {
-        time = std::chrono::system_clock::now();
-    }
-
-    convert_to_ksystem_time(&this->kusd_.SystemTime, time);
+    convert_to_ksystem_time(&this->kusd_.SystemTime, this->process_->clock.system_now());
 }
 
 void kusd_mmio::register_mmio()
@@ -205,6 +223,15 @@ void kusd_mmio::register_mmio()
 
     this->registered_ = true;
 
+    if (this->as_memory_)
+    {
+        this->update();
+
+        this->emu_->allocate_memory(KUSD_ADDRESS, KUSD_BUFFER_SIZE, memory_permission::read);
+        this->emu_->write_memory(KUSD_ADDRESS, &this->kusd_, KUSD_SIZE);
+        return;
+    }
+
     this->emu_->allocate_mmio(
         KUSD_ADDRESS, KUSD_BUFFER_SIZE,
         [this](const uint64_t addr, const size_t size) { return this->read(addr, size); },
@@ -36,7 +36,18 @@ class kusd_mmio
 
     static uint64_t address();
 
-    void setup(bool use_relative_time);
+    bool is_memory_backed() const
+    {
+        return this->as_memory_;
+    }
+
+    // With as_memory, KUSD is a read-only page instead of MMIO, so reading it doesn't leave the emulator.
+    // The system time in it is then only as recent as the last refresh.
+    // Relative time switches the process clock to virtual time advanced by instructions_per_second.
+    void setup(bool use_relative_time, bool as_memory = false, uint64_t instructions_per_second = 1000);
+
+    // Writes the current time into the page, called at time slice boundaries and syscalls
+    void refresh();
 
   private:
     x64_emulator* emu_{};
@@ -44,6 +55,7 @@ class kusd_mmio
 
     bool registered_{};
     bool use_relative_time_{};
+    bool as_memory_{};
 
     KUSER_SHARED_DATA64 kusd_{};
     std::chrono::system_clock::time_point start_time_{};
@@ -1,7 +1,11 @@
 #include "std_include.hpp"
 #include "logger.hpp"
 
+#include <utils/json.hpp>
 #include <utils/finally.hpp>
+#include <utils/file_handle.hpp>
+
+#include <cstring>
 
 namespace
 {
@@ -98,50 +102,400 @@ namespace
         set_color(base_color);
         (void)fwrite(line.data(), 1, line.size(), stdout);
     }
+
+    std::string_view get_category_name(const log_category category)
+    {
+        switch (category)
+        {
+        case log_category::syscall:
+            return "syscall";
+        case log_category::thread:
+            return "thread";
+        case log_category::memory:
+            return "memory";
+        case log_category::calls:
+            return "calls";
+        case log_category::general:
+        default:
+            return "general";
+        }
+    }
+
+    std::string_view get_level_name(const log_level level)
+    {
+        switch (level)
+        {
+        case log_level::trace:
+            return "trace";
+        case log_level::debug:
+            return "debug";
+        case log_level::warning:
+            return "warning";
+        case log_level::error:
+            return "error";
+        case log_level::info:
+        default:
+            return "info";
+        }
+    }
+
+    struct log_record
+    {
+        uint32_t size{};
+        bool stop{false};
+        log_category category{};
+        log_level level{};
+        color c{};
+    };
+
+    // Single producer, single consumer byte ring holding records followed by their message
+    class log_ring
+    {
+      public:
+        log_ring(const size_t capacity)
+            : buffer_(capacity)
+        {
+        }
+
+        size_t get_capacity() const
+        {
+            return this->buffer_.size();
+        }
+
+        void push(const log_record& record, const std::string_view message)
+        {
+            const auto size = sizeof(record) + message.size();
+            const auto head = this->head_.load(std::memory_order_relaxed);
+
+            while (true)
+            {
+                const auto tail = this->tail_.load(std::memory_order_acquire);
+                if (this->buffer_.size() - (head - tail) >= size)
+                {
+                    break;
+                }
+
+                this->tail_.wait(tail, std::memory_order_acquire);
+            }
+
+            this->write(head, &record, sizeof(record));
+            this->write(head + sizeof(record), message.data(), message.size());
+
+            this->head_.store(head + size, std::memory_order_release);
+            this->head_.notify_one();
+        }
+
+        // Returns false once a stop record was read
+        template <typename Handler>
+        bool consume(const Handler& handler)
+        {
+            auto tail = this->tail_.load(std::memory_order_relaxed);
+            this->head_.wait(tail, std::memory_order_acquire);
+
+            const auto head = this->head_.load(std::memory_order_acquire);
+            auto running = true;
+
+            while (tail != head)
+            {
+                log_record record{};
+                this->read(tail, &record, sizeof(record));
+
+                this->message_.resize(record.size);
+                this->read(tail + sizeof(record), this->message_.data(), record.size);
+
+                tail += sizeof(record) + record.size;
+
+                if (record.stop)
+                {
+                    running = false;
+                    continue;
+                }
+
+                handler(record, std::string_view{this->message_});
+            }
+
+            this->tail_.store(tail, std::memory_order_release);
+            this->tail_.notify_all();
+
+            return running;
+        }
+
+        void wait_until_empty() const
+        {
+            const auto head = this->head_.load(std::memory_order_acquire);
+
+            while (true)
+            {
+                const auto tail = this->tail_.load(std::memory_order_acquire);
+                if (tail == head)
+                {
+                    break;
+                }
+
+                this->tail_.wait(tail, std::memory_order_acquire);
+            }
+        }
+
+      private:
+        std::vector<char> buffer_{};
+        std::string message_{};
+
+        alignas(64) std::atomic<size_t> head_{0};
+        alignas(64) std::atomic<size_t> tail_{0};
+
+        void write(const size_t position, const void* data, const size_t size)
+        {
+            const auto offset = position % this->buffer_.size();
+            const auto first = std::min(size, this->buffer_.size() - offset);
+
+            memcpy(this->buffer_.data() + offset, data, first);
+            memcpy(this->buffer_.data(), static_cast<const char*>(data) + first, size - first);
+        }
+
+        void read(const size_t position, void* data, const size_t size) const
+        {
+            const auto offset = position % this->buffer_.size();
+            const auto first = std::min(size, this->buffer_.size() - offset);
+
+            memcpy(data, this->buffer_.data() + offset, first);
+            memcpy(static_cast<char*>(data) + first, this->buffer_.data(), size - first);
+        }
+    };
+
+    constexpr size_t ASYNC_BUFFER_SIZE = 0x100000;
 }
 
+class log_writer
+{
+  public:
+    log_writer() = default;
+
+    ~log_writer()
+    {
+        this->set_async(false);
+    }
+
+    log_writer(const log_writer&) = delete;
+    log_writer& operator=(const log_writer&) = delete;
+
+    log_writer(log_writer&&) = delete;
+    log_writer& operator=(log_writer&&) = delete;
+
+    void set_output_file(const std::filesystem::path& file)
+    {
+        this->flush();
+
+#ifdef _WIN32
+        FILE* handle{};
+        (void)_wfopen_s(&handle, file.wstring().c_str(), L"wb");
+#else
+        FILE* handle = fopen(file.string().c_str(), "wb");
+#endif
+
+        if (!handle)
+        {
+            throw std::runtime_error("Failed to open log file: " + file.string());
+        }
+
+        this->file_ = handle;
+    }
+
+    void set_async(const bool value)
+    {
+        if (value == (this->ring_ != nullptr))
+        {
+            return;
+        }
+
+        if (value)
+        {
+            this->ring_ = std::make_unique<log_ring>(ASYNC_BUFFER_SIZE);
+            this->thread_ = std::thread([this] {
+                while (this->ring_->consume(
+                    [this](const log_record& record, const std::string_view message) { this->emit(record, message); }))
+                {
+                }
+            });
+
+            return;
+        }
+
+        log_record stop{};
+        stop.stop = true;
+
+        this->ring_->push(stop, {});
+        this->thread_.join();
+        this->ring_ = {};
+    }
+
+    void write(const log_record& record, std::string_view message)
+    {
+        if (!this->ring_)
+        {
+            this->emit(record, message);
+            return;
+        }
+
+        const auto max_size = this->ring_->get_capacity() - sizeof(record);
+        message = message.substr(0, max_size);
+
+        auto ring_record = record;
+        ring_record.size = static_cast<uint32_t>(message.size());
+
+        this->ring_->push(ring_record, message);
+    }
+
+    void flush() const
+    {
+        if (this->ring_)
+        {
+            this->ring_->wait_until_empty();
+        }
+
+        if (this->file_)
+        {
+            (void)fflush(this->file_);
+        }
+    }
+
+  private:
+    utils::file_handle file_{};
+    std::string line_{};
+
+    std::unique_ptr<log_ring> ring_{};
+    std::thread thread_{};
+
+    void emit(const log_record& record, const std::string_view message)
+    {
+        if (!this->file_)
+        {
+            print_colored(message, get_color_type(record.c));
+            return;
+        }
+
+        auto text = message;
+        while (!text.empty() && (text.back() == '\n' || text.back() == '\r'))
+        {
+            text.remove_suffix(1);
+        }
+
+        this->line_ = "{\"category\":";
+        utils::json::append_string(this->line_, get_category_name(record.category));
+        this->line_.append(",\"level\":");
+        utils::json::append_string(this->line_, get_level_name(record.level));
+        this->line_.append(",\"message\":");
+        utils::json::append_string(this->line_, text);
+        this->line_.append("}\n");
+
+        (void)fwrite(this->line_.data(), 1, this->line_.size(), this->file_);
+    }
+};
+
+logger::logger()
+    : writer_(std::make_unique<log_writer>())
+{
+}
+
+logger::~logger()
+{
+    this->flush();
+}
+
+logger::logger(logger&&) noexcept = default;
+logger& logger::operator=(logger&&) noexcept = default;
+
 void logger::print(const color c, const std::string_view message) const
 {
-    if (this->disable_output_)
+    this->print(log_category::general, log_level::info, c, message);
+}
+
+void logger::print(const log_category category, const log_level level, const color c,
+                   const std::string_view message) const
+{
+    if (!this->is_enabled(category, level))
     {
         return;
     }
 
-    print_colored(message, get_color_type(c));
+    log_record record{};
+    record.size = static_cast<uint32_t>(message.size());
+    record.category = category;
+    record.level = level;
+    record.c = c;
+
+    this->writer_->write(record, message);
 }
 
+#define print_formatted(category, level, c, msg)   \
+    do                                             \
+    {                                              \
+        if (this->is_enabled(category, level))     \
+        {                                          \
+            format_to_string(msg, data);           \
+            this->print(category, level, c, data); \
+        }                                          \
+    } while (0)
+
 void logger::print(const color c, const char* message, ...) const
 {
-    format_to_string(message, data);
-    this->print(c, data);
+    print_formatted(log_category::general, log_level::info, c, message);
+}
+
+void logger::print(const log_category category, const log_level level, const color c, const char* message,
+                   ...) const
+{
+    print_formatted(category, level, c, message);
 }
 
 void logger::info(const char* message, ...) const
 {
-    format_to_string(message, data);
-    this->print(color::cyan, data);
+    print_formatted(log_category::general, log_level::info, color::cyan, message);
 }
 
 void logger::warn(const char* message, ...) const
 {
-    format_to_string(message, data);
-    this->print(color::yellow, data);
+    print_formatted(log_category::general, log_level::warning, color::yellow, message);
 }
 
 void logger::error(const char* message, ...) const
 {
-    format_to_string(message, data);
-    this->print(color::red, data);
+    print_formatted(log_category::general, log_level::error, color::red, message);
 }
 
 void logger::success(const char* message, ...) const
 {
-    format_to_string(message, data);
-    this->print(color::green, data);
+    print_formatted(log_category::general, log_level::info, color::green, message);
 }
 
 void logger::log(const char* message, ...) const
 {
-    format_to_string(message, data);
-    this->print(color::gray, data);
+    print_formatted(log_category::general, log_level::debug, color::gray, message);
+}
+
+void logger::set_level(const log_category category, const log_level level)
+{
+    this->levels_[static_cast<size_t>(category)] = level;
+}
+
+void logger::set_level(const log_level level)
+{
+    this->levels_.fill(level);
+}
+
+void logger::set_output_file(const std::filesystem::path& file)
+{
+    this->writer_->set_output_file(file);
+}
+
+void logger::set_async(const bool value)
+{
+    this->writer_->set_async(value);
+}
+
+void logger::flush() const
+{
+    if (this->writer_)
+    {
+        this->writer_->flush();
+    }
 }
@@ -6,6 +6,10 @@
 #define FORMAT_ATTRIBUTE(fmt_pos, var_pos) __attribute__((format(printf, fmt_pos, var_pos)))
 #endif
 
+#ifndef MOMO_MIN_LOG_LEVEL
+#define MOMO_MIN_LOG_LEVEL 0
+#endif
+
 enum class color
 {
     black,
@@ -20,11 +24,44 @@ enum class color
     dark_gray,
 };
 
+enum class log_level : uint8_t
+{
+    trace,
+    debug,
+    info,
+    warning,
+    error,
+};
+
+enum class log_category : uint8_t
+{
+    general,
+    syscall,
+    thread,
+    memory,
+    calls,
+    count,
+};
+
+class log_writer;
+
 class logger
 {
   public:
+    logger();
+    ~logger();
+
+    logger(logger&&) noexcept;
+    logger& operator=(logger&&) noexcept;
+
+    logger(const logger&) = delete;
+    logger& operator=(const logger&) = delete;
+
     void print(color c, std::string_view message) const;
     void print(color c, const char* message, ...) const FORMAT_ATTRIBUTE(3, 4);
+    void print(log_category category, log_level level, color c, std::string_view message) const;
+    void print(log_category category, log_level level, color c, const char* message, ...) const
+        FORMAT_ATTRIBUTE(5, 6);
     void info(const char* message, ...) const FORMAT_ATTRIBUTE(2, 3);
     void warn(const char* message, ...) const FORMAT_ATTRIBUTE(2, 3);
     void error(const char* message, ...) const FORMAT_ATTRIBUTE(2, 3);
@@ -41,6 +78,47 @@ class logger
         return this->disable_output_;
     }
 
+    static constexpr bool is_compiled_in(const log_level level)
+    {
+        return level >= static_cast<log_level>(MOMO_MIN_LOG_LEVEL);
+    }
+
+    bool is_enabled(const log_category category, const log_level level) const
+    {
+        return is_compiled_in(level) && !this->disable_output_ &&
+               level >= this->levels_[static_cast<size_t>(category)];
+    }
+
+    // Messages below the level are dropped before they are formatted
+    void set_level(log_category category, log_level level);
+    void set_level(log_level level);
+
+    // Writes JSON lines to the file instead of colored text to stdout
+    void set_output_file(const std::filesystem::path& file);
+
+    // Moves writing the messages to a background thread, the logging thread only copies them
+    // into a ring buffer. Messages must not be logged from multiple threads at once.
+    void set_async(bool value);
+
+    // Blocks until all buffered messages are written
+    void flush() const;
+
   private:
     bool disable_output_{false};
+    std::array<log_level, static_cast<size_t>(log_category::count)> levels_{};
+    std::unique_ptr<log_writer> writer_{};
 };
+
+// Arguments are only evaluated if the message is going to be emitted.
+// Levels below MOMO_MIN_LOG_LEVEL are removed at compile time.
+#define EMU_LOG_ENABLED(log_obj, category, level) ((log_obj).is_enabled(log_category::category, log_level::level))
+
+#define EMU_LOG(log_obj, category, level, c, ...)                                                \
+    do                                                                                           \
+    {                                                                                            \
+        const auto& emu_log_obj_ = (log_obj);                                                    \
+        if (emu_log_obj_.is_enabled(log_category::category, log_level::level))                   \
+        {                                                                                        \
+            emu_log_obj_.print(log_category::category, log_level::level, color::c, __VA_ARGS__); \
+        }                                                                                        \
+    } while (false)
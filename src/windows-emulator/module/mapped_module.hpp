@@ -1,4 +1,5 @@
 #pragma once
+#include <algorithm>
 #include <memory_region.hpp>
 
 struct exported_symbol
@@ -10,7 +11,104 @@ struct exported_symbol
 };
 
 using exported_symbols = std::vector<exported_symbol>;
-using address_name_mapping = std::map<uint64_t, std::string>;
+
+// Name and address lookup tables over exported_symbols, built on first use.
+// Copies start out empty, as the tables point into the exports of their owner.
+class export_index
+{
+  public:
+    export_index() = default;
+    ~export_index() = default;
+
+    export_index(const export_index&)
+    {
+    }
+
+    export_index& operator=(const export_index&)
+    {
+        this->reset();
+        return *this;
+    }
+
+    export_index(export_index&&) noexcept
+    {
+    }
+
+    export_index& operator=(export_index&&) noexcept
+    {
+        this->reset();
+        return *this;
+    }
+
+    void reset()
+    {
+        this->built_ = false;
+        this->names_.clear();
+        this->addresses_.clear();
+    }
+
+    const exported_symbol* find_by_name(const exported_symbols& exports, const std::string_view name) const
+    {
+        this->build(exports);
+
+        const auto entry = this->names_.find(name);
+        if (entry == this->names_.end())
+        {
+            return nullptr;
+        }
+
+        return &exports[entry->second];
+    }
+
+    const exported_symbol* find_by_address(const exported_symbols& exports, const uint64_t address) const
+    {
+        this->build(exports);
+
+        const auto entry = std::ranges::lower_bound(this->addresses_, std::pair{address, size_t{0}});
+        if (entry == this->addresses_.end() || entry->first != address)
+        {
+            return nullptr;
+        }
+
+        return &exports[entry->second];
+    }
+
+  private:
+    mutable bool built_{false};
+    mutable std::unordered_map<std::string_view, size_t> names_{};
+    mutable std::vector<std::pair<uint64_t, size_t>> addresses_{};
+
+    void build(const exported_symbols& exports) const
+    {
+        if (this->built_)
+        {
+            return;
+        }
+
+        this->built_ = true;
+        this->names_.reserve(exports.size());
+        this->addresses_.reserve(exports.size());
+
+        for (size_t i = 0; i < exports.size(); ++i)
+        {
+            this->names_.try_emplace(exports[i].name, i);
+            this->addresses_.emplace_back(exports[i].address, i);
+        }
+
+        std::ranges::sort(this->addresses_);
+    }
+};
+
+// Entry of the exception directory, all fields are relative to the image base
+struct runtime_function
+{
+    uint32_t begin_address{};
+    uint32_t end_address{};
+    uint32_t unwind_info{};
+};
+
+// Sorted by begin address, immutable once parsed
+using unwind_table = std::vector<runtime_function>;
 
 struct mapped_section
 {
@@ -28,10 +126,13 @@ struct mapped_module
     uint64_t entry_point{};
 
     exported_symbols exports{};
-    address_name_mapping address_names{};
+    export_index export_lookup{};
 
     std::vector<mapped_section> sections{};
 
+    // Shared by all mappings of the same image
+    std::shared_ptr<const unwind_table> runtime_functions{};
+
     bool is_within(const uint64_t address) const
     {
         return address >= this->image_base && address < (this->image_base + this->size_of_image);
@@ -39,14 +140,33 @@ struct mapped_module
 
     uint64_t find_export(const std::string_view export_name) const
     {
-        for (auto& symbol : this->exports)
+        const auto* symbol = this->export_lookup.find_by_name(this->exports, export_name);
+        return symbol ? symbol->address : 0;
+    }
+
+    const std::string* find_export_name(const uint64_t address) const
+    {
+        const auto* symbol = this->export_lookup.find_by_address(this->exports, address);
+        return symbol ? &symbol->name : nullptr;
+    }
+
+    const runtime_function* find_runtime_function(const uint64_t address) const
+    {
+        if (!this->runtime_functions || !this->is_within(address))
+        {
+            return nullptr;
+        }
+
+        const auto rva = static_cast<uint32_t>(address - this->image_base);
+        const auto& functions = *this->runtime_functions;
+
+        const auto entry = std::ranges::upper_bound(functions, rva, {}, &runtime_function::begin_address);
+        if (entry == functions.begin())
         {
-            if (symbol.name == export_name)
-            {
-                return symbol.address;
-            }
+            return nullptr;
         }
 
-        return 0;
+        const auto& function = *std::prev(entry);
+        return rva < function.end_address ? &function : nullptr;
     }
 };
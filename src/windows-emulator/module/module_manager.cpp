@@ -2,6 +2,10 @@
 #include "module_manager.hpp"
 #include "module_mapping.hpp"
 #include "windows-emulator/logger.hpp"
+#include "../event_trace.hpp"
+#include "../function_hle.hpp"
+#include "../api_tracer.hpp"
+#include "../event_bus.hpp"
 
 namespace
 {
@@ -47,7 +51,6 @@ namespace utils
         buffer.write(mod.entry_point);
 
         buffer.write_vector(mod.exports);
-        buffer.write_map(mod.address_names);
     }
 
     static void deserialize(buffer_deserializer& buffer, mapped_module& mod)
@@ -60,12 +63,17 @@ namespace utils
         buffer.read(mod.entry_point);
 
         buffer.read_vector(mod.exports);
-        buffer.read_map(mod.address_names);
+        mod.export_lookup.reset();
     }
 }
 
-module_manager::module_manager(emulator& emu)
-    : emu_(&emu)
+module_manager::module_manager(emulator& emu, event_trace* trace, function_hle* hle, api_tracer* tracer,
+                               event_bus* events)
+    : emu_(&emu),
+      trace_(trace),
+      hle_(hle),
+      tracer_(tracer),
+      events_(events)
 {
 }
 
@@ -87,8 +95,30 @@ mapped_module* module_manager::map_module(const std::filesystem::path& file, log
 
         logger.log("Mapped %s at 0x%" PRIx64 "\n", mod.path.generic_string().c_str(), mod.image_base);
 
+        if (this->trace_)
+        {
+            this->trace_->log_module_load(mod.image_base, mod.size_of_image, mod.name);
+        }
+
         const auto image_base = mod.image_base;
         const auto entry = this->modules_.try_emplace(image_base, std::move(mod));
+        this->update_module_ranges();
+
+        if (this->hle_)
+        {
+            this->hle_->hook_module(entry.first->second);
+        }
+
+        if (this->tracer_)
+        {
+            this->tracer_->hook_module(entry.first->second);
+        }
+
+        if (this->events_)
+        {
+            this->events_->publish<module_load_event>([&] { return module_load_event{entry.first->second}; });
+        }
+
         return &entry.first->second;
     }
     catch (const std::exception& e)
@@ -111,6 +141,32 @@ void module_manager::serialize(utils::buffer_serializer& buffer) const
 void module_manager::deserialize(utils::buffer_deserializer& buffer)
 {
     buffer.read_map(this->modules_);
+    this->update_module_ranges();
+
+    for (auto& mod : this->modules_ | std::views::values)
+    {
+        rebuild_runtime_functions(*this->emu_, mod);
+    }
+
+    if (this->hle_)
+    {
+        this->hle_->synchronize(this->modules_);
+    }
+
+    if (this->tracer_)
+    {
+        this->tracer_->synchronize(this->modules_);
+    }
+}
+
+void module_manager::set_function_hle(function_hle* hle)
+{
+    this->hle_ = hle;
+
+    if (this->hle_)
+    {
+        this->hle_->synchronize(this->modules_);
+    }
 }
 
 bool module_manager::unmap(const uint64_t address)
@@ -121,8 +177,41 @@ bool module_manager::unmap(const uint64_t address)
         return false;
     }
 
+    if (this->events_)
+    {
+        this->events_->publish<module_unload_event>([&] { return module_unload_event{mod->second}; });
+    }
+
+    if (this->hle_)
+    {
+        this->hle_->unhook_module(mod->second);
+    }
+
+    if (this->tracer_)
+    {
+        this->tracer_->unhook_module(mod->second);
+    }
+
     unmap_module(*this->emu_, mod->second);
     this->modules_.erase(mod);
+    this->update_module_ranges();
 
     return true;
 }
+
+void module_manager::update_module_ranges()
+{
+    ++this->modifications_;
+    this->last_hit_ = nullptr;
+    this->module_ranges_.clear();
+    this->module_ranges_.reserve(this->modules_.size());
+
+    for (auto& [image_base, mod] : this->modules_)
+    {
+        this->module_ranges_.push_back({
+            .start = image_base,
+            .end = image_base + mod.size_of_image,
+            .mod = &mod,
+        });
+    }
+}
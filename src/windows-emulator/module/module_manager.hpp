@@ -3,23 +3,43 @@
 #include <emulator.hpp>
 
 class logger;
+class event_trace;
+class function_hle;
+class api_tracer;
+class event_bus;
 
 class module_manager
 {
   public:
-    module_manager(emulator& emu);
+    using module_map = std::map<uint64_t, mapped_module>;
+
+    module_manager(emulator& emu, event_trace* trace = nullptr, function_hle* hle = nullptr,
+                   api_tracer* tracer = nullptr, event_bus* events = nullptr);
 
     mapped_module* map_module(const std::filesystem::path& file, logger& logger);
 
+    // Hot path of per-instruction and per-access attribution, consecutive lookups mostly hit the same module
     mapped_module* find_by_address(const uint64_t address)
     {
-        const auto entry = this->get_module(address);
-        if (entry != this->modules_.end())
+        if (this->last_hit_ && this->last_hit_->contains(address))
+        {
+            return this->last_hit_->mod;
+        }
+
+        const auto entry = std::ranges::upper_bound(this->module_ranges_, address, {}, &module_range::start);
+        if (entry == this->module_ranges_.begin())
         {
-            return &entry->second;
+            return nullptr;
         }
 
-        return nullptr;
+        const auto& range = *std::prev(entry);
+        if (!range.contains(address))
+        {
+            return nullptr;
+        }
+
+        this->last_hit_ = &range;
+        return range.mod;
     }
 
     const char* find_name(const uint64_t address)
@@ -33,31 +53,50 @@ class module_manager
         return mod->name.c_str();
     }
 
+    const module_map& get_modules() const
+    {
+        return this->modules_;
+    }
+
+    // Bumped whenever modules are mapped, unmapped or deserialized
+    uint64_t get_modifications() const
+    {
+        return this->modifications_;
+    }
+
     void serialize(utils::buffer_serializer& buffer) const;
     void deserialize(utils::buffer_deserializer& buffer);
 
     bool unmap(const uint64_t address);
 
+    // Hooks the loaded modules right away
+    void set_function_hle(function_hle* hle);
+
   private:
     emulator* emu_{};
+    event_trace* trace_{};
+    function_hle* hle_{};
+    api_tracer* tracer_{};
+    event_bus* events_{};
 
-    using module_map = std::map<uint64_t, mapped_module>;
     module_map modules_{};
 
-    module_map::iterator get_module(const uint64_t address)
+    struct module_range
     {
-        if (this->modules_.empty())
-        {
-            return this->modules_.end();
-        }
+        uint64_t start{};
+        uint64_t end{};
+        mapped_module* mod{};
 
-        auto upper_bound = this->modules_.upper_bound(address);
-        if (upper_bound == this->modules_.begin())
+        bool contains(const uint64_t address) const
         {
-            return this->modules_.end();
+            return address >= this->start && address < this->end;
         }
+    };
 
-        std::advance(upper_bound, -1);
-        return upper_bound;
-    }
+    // Flat copy of the module bounds, sorted by start, rebuilt whenever the modules change
+    std::vector<module_range> module_ranges_{};
+    const module_range* last_hit_{};
+    uint64_t modifications_{};
+
+    void update_module_ranges();
 };
@@ -2,7 +2,9 @@
 #include "module_mapping.hpp"
 #include <address_utils.hpp>
 
-#include <utils/io.hpp>
+#include <algorithm>
+
+#include <utils/mapped_file.hpp>
 #include <utils/buffer_accessor.hpp>
 
 namespace
@@ -20,15 +22,6 @@ namespace
         return nt_headers_offset + (first_section_absolute - absolute_base);
     }
 
-    std::vector<uint8_t> read_mapped_memory(const emulator& emu, const mapped_module& binary)
-    {
-        std::vector<uint8_t> memory{};
-        memory.resize(binary.size_of_image);
-        emu.read_memory(binary.image_base, memory.data(), memory.size());
-
-        return memory;
-    }
-
     void collect_exports(mapped_module& binary, const utils::safe_buffer_accessor<const uint8_t> buffer,
                          const PEOptionalHeader_t<std::uint64_t>& optional_header)
     {
@@ -61,11 +54,42 @@ namespace
 
             binary.exports.push_back(std::move(symbol));
         }
+    }
+
+    std::shared_ptr<const unwind_table> create_unwind_table(const mapped_module& binary,
+                                                            const utils::safe_buffer_accessor<const uint8_t> buffer,
+                                                            const uint64_t offset, const size_t count)
+    {
+        const auto entries = buffer.as<runtime_function>(offset);
+
+        auto functions = std::make_shared<unwind_table>();
+        functions->reserve(count);
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            const auto entry = entries.get(i);
+            if (entry.begin_address < entry.end_address && entry.end_address <= binary.size_of_image)
+            {
+                functions->push_back(entry);
+            }
+        }
+
+        // Linkers emit a sorted table, but lookups must not depend on it
+        std::ranges::sort(*functions, {}, &runtime_function::begin_address);
+        return functions;
+    }
 
-        for (const auto& symbol : binary.exports)
+    void collect_runtime_functions(mapped_module& binary, const utils::safe_buffer_accessor<const uint8_t> buffer,
+                                   const PEOptionalHeader_t<std::uint64_t>& optional_header)
+    {
+        const auto& directory = optional_header.DataDirectory[IMAGE_DIRECTORY_ENTRY_EXCEPTION];
+        if (directory.VirtualAddress == 0 || directory.Size == 0)
         {
-            binary.address_names.try_emplace(symbol.address, symbol.name);
+            return;
         }
+
+        const auto count = directory.Size / sizeof(runtime_function);
+        binary.runtime_functions = create_unwind_table(binary, buffer, directory.VirtualAddress, count);
     }
 
     template <typename T>
@@ -141,7 +165,8 @@ namespace
         }
     }
 
-    void map_sections(emulator& emu, mapped_module& binary, const utils::safe_buffer_accessor<const uint8_t> buffer,
+    void map_sections(mapped_module& binary, const utils::safe_buffer_accessor<const uint8_t> buffer,
+                      const utils::safe_buffer_accessor<uint8_t> mapped_buffer,
                       const PENTHeaders_t<std::uint64_t>& nt_headers, const uint64_t nt_headers_offset)
     {
         const auto first_section_offset = get_first_section_offset(nt_headers, nt_headers_offset);
@@ -156,7 +181,8 @@ namespace
             {
                 const auto size_of_data = std::min(section.SizeOfRawData, section.Misc.VirtualSize);
                 const auto* source_ptr = buffer.get_pointer_for_range(section.PointerToRawData, size_of_data);
-                emu.write_memory(target_ptr, source_ptr, size_of_data);
+                auto* target = mapped_buffer.get_pointer_for_range(section.VirtualAddress, size_of_data);
+                memcpy(target, source_ptr, size_of_data);
             }
 
             auto permissions = memory_permission::none;
@@ -178,8 +204,6 @@ namespace
 
             const auto size_of_section = page_align_up(std::max(section.SizeOfRawData, section.Misc.VirtualSize));
 
-            emu.protect_memory(target_ptr, size_of_section, permissions, nullptr);
-
             mapped_section section_info{};
             section_info.region.start = target_ptr;
             section_info.region.length = size_of_section;
@@ -193,70 +217,245 @@ namespace
             binary.sections.push_back(std::move(section_info));
         }
     }
-}
 
-mapped_module map_module_from_data(emulator& emu, const std::span<const uint8_t> data, std::filesystem::path file)
-{
-    mapped_module binary{};
-    binary.path = std::move(file);
-    binary.name = binary.path.filename().string();
+    struct module_cache_key
+    {
+        std::u16string path{};
+        std::filesystem::file_time_type write_time{};
+        uint64_t file_size{};
+        uint64_t image_base{};
+
+        bool operator<(const module_cache_key& other) const
+        {
+            return std::tie(this->path, this->write_time, this->file_size, this->image_base) <
+                   std::tie(other.path, other.write_time, other.file_size, other.image_base);
+        }
+    };
+
+    // Module loaded at a specific base, with relocations applied and exports resolved
+    struct cached_module_image
+    {
+        mapped_module binary{};
+        std::vector<uint8_t> memory{};
+    };
+
+    // Least recently used images are dropped beyond this much memory, instances mapping them keep them alive
+    constexpr size_t MAX_MODULE_CACHE_SIZE = 1ULL << 30;
+
+    struct module_cache_entry
+    {
+        std::shared_ptr<const cached_module_image> image{};
+        uint64_t last_use{};
+    };
+
+    // Shared by all emulator instances, images are immutable once stored
+    std::mutex module_cache_mutex{};
+    std::map<module_cache_key, module_cache_entry> module_cache{};
+    size_t module_cache_size{};
+    uint64_t module_cache_uses{};
+
+    void remove_least_recently_used_images()
+    {
+        while (module_cache_size > MAX_MODULE_CACHE_SIZE && !module_cache.empty())
+        {
+            const auto entry = std::ranges::min_element(
+                module_cache, [](const auto& a, const auto& b) { return a.second.last_use < b.second.last_use; });
+
+            module_cache_size -= entry->second.image->memory.size();
+            module_cache.erase(entry);
+        }
+    }
+
+    std::shared_ptr<const cached_module_image> find_cached_image(const module_cache_key& key)
+    {
+        std::lock_guard _{module_cache_mutex};
+
+        const auto entry = module_cache.find(key);
+        if (entry == module_cache.end())
+        {
+            return {};
+        }
+
+        entry->second.last_use = ++module_cache_uses;
+        return entry->second.image;
+    }
+
+    void store_cached_image(module_cache_key key, std::shared_ptr<const cached_module_image> image)
+    {
+        std::lock_guard _{module_cache_mutex};
+
+        auto& entry = module_cache[std::move(key)];
+        if (entry.image)
+        {
+            module_cache_size -= entry.image->memory.size();
+        }
 
-    utils::safe_buffer_accessor buffer{data};
+        module_cache_size += image->memory.size();
+        entry.image = std::move(image);
+        entry.last_use = ++module_cache_uses;
 
-    const auto dos_header = buffer.as<PEDosHeader_t>(0).get();
-    const auto nt_headers_offset = dos_header.e_lfanew;
+        remove_least_recently_used_images();
+    }
 
-    const auto nt_headers = buffer.as<PENTHeaders_t<std::uint64_t>>(nt_headers_offset).get();
-    auto& optional_header = nt_headers.OptionalHeader;
+    void write_image(emulator& emu, const mapped_module& binary, const std::span<const uint8_t> memory)
+    {
+        emu.write_memory(binary.image_base, memory.data(), memory.size());
 
-    if (nt_headers.FileHeader.Machine != PEMachineType::AMD64)
+        for (const auto& section : binary.sections)
+        {
+            emu.protect_memory(section.region.start, section.region.length, section.region.permissions, nullptr);
+        }
+    }
+
+    mapped_module map_cached_image(emulator& emu, const cached_module_image& image)
     {
-        throw std::runtime_error("Unsupported architecture!");
+        write_image(emu, image.binary, image.memory);
+        return image.binary;
     }
 
-    binary.image_base = optional_header.ImageBase;
-    binary.size_of_image = page_align_up(optional_header.SizeOfImage); // TODO: Sanitize
+    uint64_t get_nt_headers_offset(const utils::safe_buffer_accessor<const uint8_t> buffer)
+    {
+        return buffer.as<PEDosHeader_t>(0).get().e_lfanew;
+    }
 
-    if (!emu.allocate_memory(binary.image_base, binary.size_of_image, memory_permission::read))
+    uint64_t allocate_image(emulator& emu, const std::span<const uint8_t> data)
     {
-        binary.image_base = emu.find_free_allocation_base(binary.size_of_image);
-        const auto is_dll = nt_headers.FileHeader.Characteristics & IMAGE_FILE_DLL;
-        const auto has_dynamic_base = optional_header.DllCharacteristics & IMAGE_DLLCHARACTERISTICS_DYNAMIC_BASE;
-        const auto is_relocatable = is_dll || has_dynamic_base;
+        utils::safe_buffer_accessor buffer{data};
+
+        const auto nt_headers = buffer.as<PENTHeaders_t<std::uint64_t>>(get_nt_headers_offset(buffer)).get();
+        auto& optional_header = nt_headers.OptionalHeader;
+
+        if (nt_headers.FileHeader.Machine != PEMachineType::AMD64)
+        {
+            throw std::runtime_error("Unsupported architecture!");
+        }
+
+        auto image_base = optional_header.ImageBase;
+        const auto size_of_image = page_align_up(optional_header.SizeOfImage); // TODO: Sanitize
 
-        if (!is_relocatable || !emu.allocate_memory(binary.image_base, binary.size_of_image, memory_permission::read))
+        if (!emu.allocate_memory(image_base, size_of_image, memory_permission::read))
         {
-            throw std::runtime_error("Memory range not allocatable");
+            image_base = emu.find_free_allocation_base(size_of_image);
+            const auto is_dll = nt_headers.FileHeader.Characteristics & IMAGE_FILE_DLL;
+            const auto has_dynamic_base = optional_header.DllCharacteristics & IMAGE_DLLCHARACTERISTICS_DYNAMIC_BASE;
+            const auto is_relocatable = is_dll || has_dynamic_base;
+
+            if (!is_relocatable || !emu.allocate_memory(image_base, size_of_image, memory_permission::read))
+            {
+                throw std::runtime_error("Memory range not allocatable");
+            }
         }
+
+        return image_base;
     }
 
-    binary.entry_point = binary.image_base + optional_header.AddressOfEntryPoint;
+    mapped_module load_image(emulator& emu, const std::span<const uint8_t> data, std::filesystem::path file,
+                             const uint64_t image_base, std::vector<uint8_t>& mapped_memory)
+    {
+        mapped_module binary{};
+        binary.path = std::move(file);
+        binary.name = binary.path.filename().string();
 
-    const auto* header_buffer = buffer.get_pointer_for_range(0, optional_header.SizeOfHeaders);
-    emu.write_memory(binary.image_base, header_buffer, optional_header.SizeOfHeaders);
+        utils::safe_buffer_accessor buffer{data};
 
-    map_sections(emu, binary, buffer, nt_headers, nt_headers_offset);
+        const auto nt_headers_offset = get_nt_headers_offset(buffer);
+        const auto nt_headers = buffer.as<PENTHeaders_t<std::uint64_t>>(nt_headers_offset).get();
+        auto& optional_header = nt_headers.OptionalHeader;
 
-    auto mapped_memory = read_mapped_memory(emu, binary);
-    utils::safe_buffer_accessor<uint8_t> mapped_buffer{mapped_memory};
+        binary.image_base = image_base;
+        binary.size_of_image = page_align_up(optional_header.SizeOfImage);
+        binary.entry_point = binary.image_base + optional_header.AddressOfEntryPoint;
 
-    apply_relocations(binary, mapped_buffer, optional_header);
-    collect_exports(binary, mapped_buffer, optional_header);
+        // The image is assembled and relocated on the host, the emulator only receives the final pages
+        mapped_memory.assign(binary.size_of_image, 0);
+        utils::safe_buffer_accessor<uint8_t> mapped_buffer{mapped_memory};
 
-    emu.write_memory(binary.image_base, mapped_memory.data(), mapped_memory.size());
+        const auto* header_buffer = buffer.get_pointer_for_range(0, optional_header.SizeOfHeaders);
+        memcpy(mapped_buffer.get_pointer_for_range(0, optional_header.SizeOfHeaders), header_buffer,
+               optional_header.SizeOfHeaders);
 
-    return binary;
+        map_sections(binary, buffer, mapped_buffer, nt_headers, nt_headers_offset);
+
+        apply_relocations(binary, mapped_buffer, optional_header);
+        collect_exports(binary, mapped_buffer, optional_header);
+        collect_runtime_functions(binary, mapped_buffer, optional_header);
+
+        write_image(emu, binary, mapped_memory);
+
+        return binary;
+    }
+}
+
+mapped_module map_module_from_data(emulator& emu, const std::span<const uint8_t> data, std::filesystem::path file)
+{
+    const auto image_base = allocate_image(emu, data);
+
+    std::vector<uint8_t> mapped_memory{};
+    return load_image(emu, data, std::move(file), image_base, mapped_memory);
 }
 
 mapped_module map_module_from_file(emulator& emu, std::filesystem::path file)
 {
-    const auto data = utils::io::read_file(file);
-    if (data.empty())
+    const utils::mapped_file mapping{file};
+    if (!mapping)
     {
         throw std::runtime_error("Bad file data");
     }
 
-    return map_module_from_data(emu, data, std::move(file));
+    const std::span data{reinterpret_cast<const uint8_t*>(mapping.data()), mapping.size()};
+
+    std::error_code ec{};
+    const auto write_time = std::filesystem::last_write_time(file, ec);
+    if (ec)
+    {
+        return map_module_from_data(emu, data, std::move(file));
+    }
+
+    module_cache_key key{};
+    key.path = file.generic_u16string();
+    key.write_time = write_time;
+    key.file_size = data.size();
+    key.image_base = allocate_image(emu, data);
+
+    if (const auto cached_image = find_cached_image(key))
+    {
+        return map_cached_image(emu, *cached_image);
+    }
+
+    auto image = std::make_shared<cached_module_image>();
+    image->binary = load_image(emu, data, std::move(file), key.image_base, image->memory);
+    store_cached_image(std::move(key), image);
+
+    return image->binary;
+}
+
+void rebuild_runtime_functions(const emulator& emu, mapped_module& mod)
+{
+    mod.runtime_functions.reset();
+
+    PEDosHeader_t dos_header{};
+    PENTHeaders_t<std::uint64_t> nt_headers{};
+    if (!emu.try_read_memory(mod.image_base, &dos_header, sizeof(dos_header)) ||
+        !emu.try_read_memory(mod.image_base + dos_header.e_lfanew, &nt_headers, sizeof(nt_headers)))
+    {
+        return;
+    }
+
+    const auto& directory = nt_headers.OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_EXCEPTION];
+    if (directory.VirtualAddress == 0 || directory.Size == 0 ||
+        static_cast<uint64_t>(directory.VirtualAddress) + directory.Size > mod.size_of_image)
+    {
+        return;
+    }
+
+    std::vector<uint8_t> data(directory.Size);
+    if (!emu.try_read_memory(mod.image_base + directory.VirtualAddress, data.data(), data.size()))
+    {
+        return;
+    }
+
+    const utils::safe_buffer_accessor<const uint8_t> buffer{data};
+    mod.runtime_functions = create_unwind_table(mod, buffer, 0, data.size() / sizeof(runtime_function));
 }
 
 bool unmap_module(emulator& emu, const mapped_module& mod)
@@ -6,4 +6,7 @@
 mapped_module map_module_from_data(emulator& emu, std::span<const uint8_t> data, std::filesystem::path file);
 mapped_module map_module_from_file(emulator& emu, std::filesystem::path file);
 
+// Snapshots don't carry the unwind tables, they are read back from the restored image
+void rebuild_runtime_functions(const emulator& emu, mapped_module& mod);
+
 bool unmap_module(emulator& emu, const mapped_module& mod);
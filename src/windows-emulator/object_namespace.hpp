@@ -0,0 +1,85 @@
+#pragma once
+
+#include "handles.hpp"
+
+#include <unordered_map>
+#include <utils/string.hpp>
+
+// Case-insensitive name index of the named kernel objects. Each object type has its own names, like the lookups
+// it replaces. The index is not serialized, process_context rebuilds it from the handle stores.
+class object_namespace
+{
+  public:
+    void add(const handle h, const std::u16string_view name)
+    {
+        if (name.empty())
+        {
+            return;
+        }
+
+        auto key = make_key(static_cast<handle_types::type>(h.value.type), name);
+
+        // Keep the first object of a name, which is the one a scan over the handle store returns
+        if (this->handles_.try_emplace(key, h.bits).second)
+        {
+            this->names_[h.bits] = std::move(key);
+        }
+    }
+
+    void remove(const handle h)
+    {
+        const auto entry = this->names_.find(h.bits);
+        if (entry == this->names_.end())
+        {
+            return;
+        }
+
+        this->handles_.erase(entry->second);
+        this->names_.erase(entry);
+    }
+
+    std::optional<handle> find(const handle_types::type type, const std::u16string_view name) const
+    {
+        const auto entry = this->handles_.find(make_key(type, name));
+        if (entry == this->handles_.end())
+        {
+            return std::nullopt;
+        }
+
+        return make_handle(entry->second);
+    }
+
+    template <handle_types::type Type, typename T, uint32_t IndexShift>
+    void add_all(const handle_store<Type, T, IndexShift>& store)
+    {
+        for (const auto& entry : store)
+        {
+            this->add(store.make_handle(entry.first), entry.second.name);
+        }
+    }
+
+    void clear()
+    {
+        this->handles_.clear();
+        this->names_.clear();
+    }
+
+  private:
+    // Handles by type and lowercase name, and the other way around to drop closed objects
+    std::unordered_map<std::u16string, uint64_t> handles_{};
+    std::unordered_map<uint64_t, std::u16string> names_{};
+
+    static std::u16string make_key(const handle_types::type type, const std::u16string_view name)
+    {
+        std::u16string key{};
+        key.reserve(name.size() + 1);
+        key.push_back(static_cast<char16_t>(type));
+
+        for (const auto c : name)
+        {
+            key.push_back(utils::string::char_to_lower(c));
+        }
+
+        return key;
+    }
+};
@@ -0,0 +1,281 @@
+#include "std_include.hpp"
+#include "path_explorer.hpp"
+#include "windows_emulator.hpp"
+
+#include <algorithm>
+
+#include <utils/concurrency.hpp>
+
+namespace
+{
+    constexpr size_t COVERAGE_MAP_SIZE = 1 << 16;
+
+    uint64_t parse_number(const std::string_view value)
+    {
+        size_t length = 0;
+        const std::string number(value);
+        const auto result = std::stoull(number, &length, 0);
+
+        if (length != number.size())
+        {
+            throw std::runtime_error("Invalid number: " + number);
+        }
+
+        return result;
+    }
+
+    void apply_answer(windows_emulator& win_emu, const environment_query& query, const uint64_t answer)
+    {
+        auto& emu = win_emu.emu();
+
+        if (query.type == environment_query_type::syscall)
+        {
+            emu.reg<uint64_t>(x64_register::rax, answer);
+            return;
+        }
+
+        const auto low = emu.reg(x64_register::rax) & 0xFFFFFFFF;
+        const auto high = emu.reg(x64_register::rdx) & 0xFFFFFFFF;
+        const auto ticks = ((high << 32) | low) + answer;
+
+        emu.reg(x64_register::rax, ticks & 0xFFFFFFFF);
+        emu.reg(x64_register::rdx, (ticks >> 32) & 0xFFFFFFFF);
+    }
+
+    size_t count_new_edges(const std::span<const uint8_t> coverage, const std::span<const uint8_t> known)
+    {
+        size_t count = 0;
+
+        for (size_t i = 0; i < coverage.size(); ++i)
+        {
+            if (coverage[i] && !known[i])
+            {
+                ++count;
+            }
+        }
+
+        return count;
+    }
+}
+
+environment_query parse_environment_query(const std::string_view query)
+{
+    const auto separator = query.find(':');
+    if (separator == std::string_view::npos || separator == 0)
+    {
+        throw std::runtime_error("Invalid environment query: " + std::string(query));
+    }
+
+    environment_query result{};
+
+    const auto name = query.substr(0, separator);
+    if (name == "rdtsc")
+    {
+        result.type = environment_query_type::rdtsc;
+    }
+    else
+    {
+        result.type = environment_query_type::syscall;
+        result.syscall_name = name;
+    }
+
+    auto answers = query.substr(separator + 1);
+
+    while (!answers.empty())
+    {
+        const auto end = answers.find(',');
+        result.answers.push_back(parse_number(answers.substr(0, end)));
+        answers = end == std::string_view::npos ? std::string_view{} : answers.substr(end + 1);
+    }
+
+    if (result.answers.empty())
+    {
+        throw std::runtime_error("Environment query without answers: " + std::string(query));
+    }
+
+    return result;
+}
+
+path_explorer::path_explorer(windows_emulator& win_emu, path_exploration_settings settings)
+    : win_emu_(&win_emu),
+      settings_(std::move(settings)),
+      coverage_(COVERAGE_MAP_SIZE)
+{
+    this->settings_.concurrency = std::max(this->settings_.concurrency, static_cast<size_t>(1));
+
+    for (size_t i = 0; i < this->settings_.queries.size(); ++i)
+    {
+        const auto& query = this->settings_.queries[i];
+
+        if (query.type == environment_query_type::rdtsc)
+        {
+            win_emu.add_rdtsc_hook([this, i, active = this->active_] {
+                if (*active)
+                {
+                    this->on_query(i);
+                }
+            });
+
+            continue;
+        }
+
+        const auto id = win_emu.dispatcher().find_syscall_id(query.syscall_name);
+        if (!id)
+        {
+            throw std::runtime_error(query.syscall_name + " is not available");
+        }
+
+        // The syscall is dispatched here, so the fork sees its real answer
+        win_emu.add_syscall_hook([this, i, id = *id, active = this->active_] {
+            auto& emu = this->win_emu_->emu();
+            if (!*active || emu.reg(x64_register::rax) != id)
+            {
+                return instruction_hook_continuation::run_instruction;
+            }
+
+            this->win_emu_->dispatcher().dispatch(*this->win_emu_);
+            this->on_query(i);
+
+            return instruction_hook_continuation::skip_instruction;
+        });
+    }
+
+    win_emu.emu().enable_block_coverage(this->coverage_);
+}
+
+path_explorer::~path_explorer()
+{
+    *this->active_ = false;
+    this->win_emu_->emu().disable_block_coverage();
+}
+
+void path_explorer::start(const std::chrono::nanoseconds timeout, const size_t count)
+{
+    auto& process = this->win_emu_->process();
+
+    const auto target_instructions = process.executed_instructions + count;
+    auto remaining_time = timeout;
+
+    while (true)
+    {
+        const auto start_time = std::chrono::high_resolution_clock::now();
+        const auto start_instructions = process.executed_instructions;
+
+        // Counts of zero mean unlimited, so a count that is used up stops here
+        this->win_emu_->start(remaining_time, count ? static_cast<size_t>(target_instructions - start_instructions)
+                                                    : 0);
+
+        const auto query = this->pending_query_;
+        this->pending_query_.reset();
+
+        if (!query || process.exit_status.has_value())
+        {
+            return;
+        }
+
+        if (timeout != std::chrono::nanoseconds{})
+        {
+            const auto elapsed = std::chrono::high_resolution_clock::now() - start_time;
+            if (elapsed >= remaining_time)
+            {
+                return;
+            }
+
+            remaining_time -= std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed);
+        }
+
+        this->explore(*query);
+
+        if (count && process.executed_instructions >= target_instructions)
+        {
+            return;
+        }
+    }
+}
+
+// Forks after the query is answered, the emulator stops right behind the querying instruction
+void path_explorer::on_query(const size_t query)
+{
+    if (this->forks_.size() >= this->settings_.max_forks || this->pending_query_ || this->win_emu_->switch_thread ||
+        this->win_emu_->process().exit_status.has_value())
+    {
+        return;
+    }
+
+    this->pending_query_ = query;
+    this->win_emu_->emu().stop();
+}
+
+void path_explorer::explore(const size_t query_index)
+{
+    const auto& query = this->settings_.queries[query_index];
+
+    utils::buffer_serializer serializer{};
+    this->win_emu_->serialize(serializer);
+    const auto& state = serializer.get_buffer();
+
+    explored_fork fork{};
+    fork.address = this->win_emu_->emu().read_instruction_pointer();
+    fork.query = query_index;
+    fork.new_edges.resize(query.answers.size() + 1);
+
+    // Written by the workers, logged once they are done
+    std::vector<std::string> failures(fork.new_edges.size());
+
+    utils::concurrency::parallel_for(fork.new_edges.size(), this->settings_.concurrency, [&](const size_t index) {
+        windows_emulator worker{};
+        worker.log.disable_output(true);
+        worker.count_instructions_per_block = this->win_emu_->count_instructions_per_block;
+        worker.emu().set_shared_memory_pool(this->memory_pool_);
+
+        utils::buffer_deserializer deserializer{state};
+        worker.deserialize(deserializer);
+
+        if (index)
+        {
+            apply_answer(worker, query, query.answers[index - 1]);
+        }
+
+        std::vector<uint8_t> coverage(COVERAGE_MAP_SIZE);
+        worker.emu().enable_block_coverage(coverage);
+
+        // Paths that crash the emulator still count with the coverage they reached
+        try
+        {
+            worker.start({}, static_cast<size_t>(this->settings_.path_instructions));
+        }
+        catch (const std::exception& e)
+        {
+            failures[index] = e.what();
+        }
+        catch (...)
+        {
+            failures[index] = "Unknown error";
+        }
+
+        worker.emu().disable_block_coverage();
+        fork.new_edges[index] = count_new_edges(coverage, this->coverage_);
+    });
+
+    for (size_t i = 0; i < failures.size(); ++i)
+    {
+        if (!failures[i].empty())
+        {
+            this->win_emu_->log.warn("Answer %zu at 0x%" PRIx64 " crashed the emulation: %s\n", i, fork.address,
+                                     failures[i].c_str());
+        }
+    }
+
+    const auto best = std::ranges::max_element(fork.new_edges);
+    fork.chosen_answer = static_cast<size_t>(std::distance(fork.new_edges.begin(), best));
+
+    if (fork.chosen_answer)
+    {
+        apply_answer(*this->win_emu_, query, query.answers[fork.chosen_answer - 1]);
+    }
+
+    this->win_emu_->log.print(color::cyan, "Explored %zu answers at 0x%" PRIx64 ", answer %zu reached %zu new edges\n",
+                              fork.new_edges.size(), fork.address, fork.chosen_answer, *best);
+
+    this->forks_.push_back(std::move(fork));
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "std_include.hpp"
+
+#include <x64_emulator.hpp>
+
+class windows_emulator;
+
+enum class environment_query_type : uint8_t
+{
+    // Answers replace the status the syscall returned. Output buffers the syscall wrote keep the real contents.
+    syscall,
+    // Answers are added to the counter the guest read
+    rdtsc,
+};
+
+struct environment_query
+{
+    environment_query_type type{};
+    std::string syscall_name{};
+    // Tried next to the real answer
+    std::vector<uint64_t> answers{};
+};
+
+// "rdtsc:<offsets>" or "<syscall>:<statuses>", with comma separated numbers, e.g. "NtOpenKey:0xC0000034"
+environment_query parse_environment_query(std::string_view query);
+
+struct path_exploration_settings
+{
+    std::vector<environment_query> queries{};
+    // Forks beyond this many let the guest see the real answers
+    size_t max_forks{16};
+    // Instructions every alternative runs before its coverage is compared
+    uint64_t path_instructions{1000000};
+    size_t concurrency{std::thread::hardware_concurrency()};
+};
+
+struct explored_fork
+{
+    uint64_t address{};
+    size_t query{};
+    // 0 is the real answer, otherwise the query's answer before this index
+    size_t chosen_answer{};
+    // Edges every alternative reached that the emulation didn't reach before the fork
+    std::vector<size_t> new_edges{};
+};
+
+// Runs the emulator and forks it when the guest hits one of the queries. Every answer runs in a worker emulator
+// deserialized from the state at the query, the workers share the pages that are never written. The answer whose
+// path reaches the most new edges is the one the emulator continues with, ties keep the earlier answer.
+class path_explorer
+{
+  public:
+    path_explorer(windows_emulator& win_emu, path_exploration_settings settings);
+    ~path_explorer();
+
+    path_explorer(const path_explorer&) = delete;
+    path_explorer& operator=(const path_explorer&) = delete;
+    path_explorer(path_explorer&&) = delete;
+    path_explorer& operator=(path_explorer&&) = delete;
+
+    // Like windows_emulator::start, the time spent on exploring doesn't count into the timeout
+    void start(std::chrono::nanoseconds timeout = {}, size_t count = 0);
+
+    const std::vector<explored_fork>& get_forks() const
+    {
+        return this->forks_;
+    }
+
+  private:
+    windows_emulator* win_emu_{};
+    path_exploration_settings settings_{};
+
+    std::shared_ptr<bool> active_{std::make_shared<bool>(true)};
+    std::shared_ptr<shared_memory_pool> memory_pool_{std::make_shared<shared_memory_pool>()};
+
+    // Coverage of the chosen paths, in the map format of emulator::enable_block_coverage
+    std::vector<uint8_t> coverage_{};
+
+    std::optional<size_t> pending_query_{};
+    std::vector<explored_fork> forks_{};
+
+    void on_query(size_t query);
+    void explore(size_t query);
+};
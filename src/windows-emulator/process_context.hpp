@@ -2,17 +2,22 @@
 
 #include "emulator_utils.hpp"
 #include "handles.hpp"
+#include "object_namespace.hpp"
 #include "registry/registry_manager.hpp"
 
 #include "module/module_manager.hpp"
 #include <utils/nt_handle.hpp>
 #include <utils/file_handle.hpp>
+#include <utils/mapped_file.hpp>
 
 #include <x64_emulator.hpp>
 #include <serialization_helper.hpp>
 
 #include "io_device.hpp"
 #include "kusd_mmio.hpp"
+#include "emulated_heap.hpp"
+#include "thread_memory_pool.hpp"
+#include "emulator_clock.hpp"
 
 #define PEB_SEGMENT_SIZE (20 << 20) // 20 MB
 #define GS_SEGMENT_SIZE  (1 << 20)  // 1 MB
@@ -142,34 +147,56 @@ struct mutant : ref_counted_object
 
 struct file_entry
 {
-    std::filesystem::path file_path{};
+    std::u16string name{};
 
     void serialize(utils::buffer_serializer& buffer) const
     {
-        buffer.write(this->file_path);
+        buffer.write_string(this->name);
     }
 
     void deserialize(utils::buffer_deserializer& buffer)
     {
-        buffer.read(this->file_path);
+        buffer.read_string(this->name);
     }
 };
 
+// Immutable, shared between all handles enumerating the same directory
+using directory_listing = std::vector<file_entry>;
+
 struct file_enumeration_state
 {
     size_t current_index{0};
-    std::vector<file_entry> files{};
+    std::shared_ptr<const directory_listing> files{};
 
     void serialize(utils::buffer_serializer& buffer) const
     {
         buffer.write(this->current_index);
-        buffer.write_vector(this->files);
+        buffer.write_vector(this->files ? *this->files : directory_listing{});
     }
 
     void deserialize(utils::buffer_deserializer& buffer)
     {
         buffer.read(this->current_index);
-        buffer.read_vector(this->files);
+
+        auto files = std::make_shared<directory_listing>();
+        buffer.read_vector(*files);
+        this->files = std::move(files);
+    }
+};
+
+// Contents of a file the guest wrote while file writes are virtualized
+struct virtual_file
+{
+    std::vector<std::byte> data{};
+
+    void serialize(utils::buffer_serializer& buffer) const
+    {
+        buffer.write_vector(this->data);
+    }
+
+    void deserialize(utils::buffer_deserializer& buffer)
+    {
+        buffer.read_vector(this->data);
     }
 };
 
@@ -179,9 +206,16 @@ struct file
     std::u16string name{};
     std::optional<file_enumeration_state> enumeration_state{};
 
+    // Read-only view of the host file that serves NtReadFile, dropped whenever the file is written
+    std::optional<utils::mapped_file> read_mapping{};
+
+    // Backed by process_context::virtual_files instead of a host file
+    bool is_virtual{false};
+    uint64_t virtual_position{};
+
     bool is_file() const
     {
-        return this->handle;
+        return this->handle || this->is_virtual;
     }
 
     bool is_directory() const
@@ -194,13 +228,18 @@ struct file
         // TODO: Serialize handle
         buffer.write(this->name);
         buffer.write_optional(this->enumeration_state);
+        buffer.write(this->is_virtual);
+        buffer.write(this->virtual_position);
     }
 
     void deserialize(utils::buffer_deserializer& buffer)
     {
         buffer.read(this->name);
         buffer.read_optional(this->enumeration_state);
+        buffer.read(this->is_virtual);
+        buffer.read(this->virtual_position);
         this->handle = {};
+        this->read_mapping = {};
     }
 };
 
@@ -211,6 +250,8 @@ struct section
     uint64_t maximum_size{};
     uint32_t section_page_protection{};
     uint32_t allocation_attributes{};
+    // Section memory of the memory manager that all views map, created by the first view
+    uint64_t memory_id{};
 
     bool is_image() const
     {
@@ -224,6 +265,7 @@ struct section
         buffer.write(this->maximum_size);
         buffer.write(this->section_page_protection);
         buffer.write(this->allocation_attributes);
+        buffer.write(this->memory_id);
     }
 
     void deserialize(utils::buffer_deserializer& buffer)
@@ -233,6 +275,7 @@ struct section
         buffer.read(this->maximum_size);
         buffer.read(this->section_page_protection);
         buffer.read(this->allocation_attributes);
+        buffer.read(this->memory_id);
     }
 };
 
@@ -261,6 +304,152 @@ struct semaphore : ref_counted_object
     }
 };
 
+struct io_completion_packet
+{
+    uint64_t key_context{};
+    uint64_t apc_context{};
+    NTSTATUS status{};
+    uint64_t information{};
+
+    void serialize(utils::buffer_serializer& buffer) const
+    {
+        buffer.write(this->key_context);
+        buffer.write(this->apc_context);
+        buffer.write(this->status);
+        buffer.write(this->information);
+    }
+
+    void deserialize(utils::buffer_deserializer& buffer)
+    {
+        buffer.read(this->key_context);
+        buffer.read(this->apc_context);
+        buffer.read(this->status);
+        buffer.read(this->information);
+    }
+};
+
+// Outputs of a thread blocked in NtRemoveIoCompletion(Ex), they are filled once a packet is queued.
+// The extended variant removes up to max_entries packets into an array at entries.
+struct io_completion_wait
+{
+    handle port{};
+    bool extended{false};
+    uint64_t entries{};
+    uint32_t max_entries{1};
+    uint64_t removed_count{};
+    uint64_t key_context{};
+    uint64_t apc_context{};
+    uint64_t io_status_block{};
+
+    void serialize(utils::buffer_serializer& buffer) const
+    {
+        buffer.write(this->port);
+        buffer.write(this->extended);
+        buffer.write(this->entries);
+        buffer.write(this->max_entries);
+        buffer.write(this->removed_count);
+        buffer.write(this->key_context);
+        buffer.write(this->apc_context);
+        buffer.write(this->io_status_block);
+    }
+
+    void deserialize(utils::buffer_deserializer& buffer)
+    {
+        buffer.read(this->port);
+        buffer.read(this->extended);
+        buffer.read(this->entries);
+        buffer.read(this->max_entries);
+        buffer.read(this->removed_count);
+        buffer.read(this->key_context);
+        buffer.read(this->apc_context);
+        buffer.read(this->io_status_block);
+    }
+};
+
+struct io_completion_port : ref_counted_object
+{
+    std::u16string name{};
+    std::vector<io_completion_packet> packets{};
+
+    // Returns the number of packets written to the outputs of the wait
+    uint32_t remove_packets(x64_emulator& emu, const io_completion_wait& wait)
+    {
+        const auto count = static_cast<uint32_t>(std::min(this->packets.size(), static_cast<size_t>(wait.max_entries)));
+        if (!count)
+        {
+            return 0;
+        }
+
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            const auto& packet = this->packets[i];
+
+            IO_STATUS_BLOCK<EmulatorTraits<Emu64>> status_block{};
+            status_block.Status = packet.status;
+            status_block.Information = packet.information;
+
+            if (wait.extended)
+            {
+                FILE_IO_COMPLETION_INFORMATION<EmulatorTraits<Emu64>> info{};
+                info.KeyContext = packet.key_context;
+                info.ApcContext = packet.apc_context;
+                info.IoStatusBlock = status_block;
+
+                emu.write_memory(wait.entries + i * sizeof(info), &info, sizeof(info));
+                continue;
+            }
+
+            emulator_object<uint64_t>{emu, wait.key_context}.write_if_valid(packet.key_context);
+            emulator_object<uint64_t>{emu, wait.apc_context}.write_if_valid(packet.apc_context);
+            emulator_object<IO_STATUS_BLOCK<EmulatorTraits<Emu64>>>{emu, wait.io_status_block}.write_if_valid(
+                status_block);
+        }
+
+        if (wait.extended)
+        {
+            emulator_object<ULONG>{emu, wait.removed_count}.write_if_valid(count);
+        }
+
+        this->packets.erase(this->packets.begin(), this->packets.begin() + count);
+        return count;
+    }
+
+    void serialize(utils::buffer_serializer& buffer) const
+    {
+        buffer.write(this->name);
+        buffer.write_vector(this->packets);
+
+        ref_counted_object::serialize(buffer);
+    }
+
+    void deserialize(utils::buffer_deserializer& buffer)
+    {
+        buffer.read(this->name);
+        buffer.read_vector(this->packets);
+
+        ref_counted_object::deserialize(buffer);
+    }
+};
+
+// Set through FileCompletionInformation, completed I/O of the handle queues packets with this key
+struct io_completion_association
+{
+    handle port{};
+    uint64_t key{};
+
+    void serialize(utils::buffer_serializer& buffer) const
+    {
+        buffer.write(this->port);
+        buffer.write(this->key);
+    }
+
+    void deserialize(utils::buffer_deserializer& buffer)
+    {
+        buffer.read(this->port);
+        buffer.read(this->key);
+    }
+};
+
 struct port
 {
     std::u16string name{};
@@ -330,8 +519,8 @@ class emulator_thread : ref_counted_object
     {
     }
 
-    emulator_thread(x64_emulator& emu, const process_context& context, uint64_t start_address, uint64_t argument,
-                    uint64_t stack_size, uint32_t id);
+    emulator_thread(x64_emulator& emu, const process_context& context, thread_memory_pool& memory_pool,
+                    uint64_t start_address, uint64_t argument, uint64_t stack_size, uint32_t id);
 
     emulator_thread(const emulator_thread&) = delete;
     emulator_thread& operator=(const emulator_thread&) = delete;
@@ -347,6 +536,8 @@ class emulator_thread : ref_counted_object
     moved_marker marker{};
 
     x64_emulator* emu_ptr{};
+    // Takes the stack and GS segment back, they are released otherwise
+    thread_memory_pool* memory_pool{};
 
     uint64_t stack_base{};
     uint64_t stack_size{};
@@ -364,6 +555,14 @@ class emulator_thread : ref_counted_object
     bool waiting_for_alert{false};
     bool alerted{false};
     std::optional<std::chrono::steady_clock::time_point> await_time{};
+    std::optional<io_completion_wait> completion_wait{};
+
+    // process_context::wait_generation at the last time await_objects were checked
+    std::optional<uint64_t> checked_wait_generation{};
+
+    // Scheduling state of process_context, rebuilt when the threads are deserialized
+    uint64_t self_handle{};
+    bool queued{false};
 
     std::optional<NTSTATUS> pending_status{};
 
@@ -374,16 +573,16 @@ class emulator_thread : ref_counted_object
 
     void mark_as_ready(NTSTATUS status);
 
-    bool is_await_time_over() const
+    bool is_await_time_over(const std::chrono::steady_clock::time_point now) const
     {
-        return this->await_time.has_value() && this->await_time.value() < std::chrono::steady_clock::now();
+        return this->await_time.has_value() && this->await_time.value() < now;
     }
 
     bool is_thread_ready(windows_emulator& win_emu);
 
     void save(x64_emulator& emu)
     {
-        this->last_registers = emu.save_registers();
+        emu.save_registers(this->last_registers);
     }
 
     void restore(x64_emulator& emu) const
@@ -431,6 +630,7 @@ class emulator_thread : ref_counted_object
         buffer.write(this->alerted);
 
         buffer.write_optional(this->await_time);
+        buffer.write_optional(this->completion_wait);
         buffer.write_optional(this->pending_status);
         buffer.write_optional(this->gs_segment);
         buffer.write_optional(this->teb);
@@ -464,7 +664,9 @@ class emulator_thread : ref_counted_object
         buffer.read(this->alerted);
 
         buffer.read_optional(this->await_time);
+        buffer.read_optional(this->completion_wait);
         buffer.read_optional(this->pending_status);
+        this->checked_wait_generation = {};
         buffer.read_optional(this->gs_segment, [this] { return emulator_allocator(*this->emu_ptr); });
         buffer.read_optional(this->teb, [this] { return emulator_object<TEB64>(*this->emu_ptr); });
 
@@ -488,13 +690,31 @@ class emulator_thread : ref_counted_object
                 throw std::runtime_error("Emulator was never assigned!");
             }
 
-            this->emu_ptr->release_memory(this->stack_base, this->stack_size);
+            if (this->memory_pool)
+            {
+                this->memory_pool->release(*this->emu_ptr, this->stack_base, this->stack_size, this->stack_size);
+            }
+            else
+            {
+                this->emu_ptr->release_memory(this->stack_base, this->stack_size);
+            }
+
             this->stack_base = 0;
         }
 
         if (this->gs_segment)
         {
-            this->gs_segment->release();
+            if (this->memory_pool && this->gs_segment->get_base())
+            {
+                const auto base = this->gs_segment->get_base();
+                this->memory_pool->release(*this->emu_ptr, base, this->gs_segment->get_size(),
+                                           this->gs_segment->get_next_address() - base);
+            }
+            else
+            {
+                this->gs_segment->release();
+            }
+
             this->gs_segment = {};
         }
     }
@@ -517,6 +737,8 @@ struct process_context
     uint64_t current_ip{0};
     uint64_t previous_ip{0};
 
+    emulator_clock clock{&this->executed_instructions};
+
     std::optional<uint64_t> exception_rip{};
     std::optional<NTSTATUS> exit_status{};
 
@@ -544,101 +766,444 @@ struct process_context
     handle_store<handle_types::port, port> ports{};
     handle_store<handle_types::mutant, mutant> mutants{};
     handle_store<handle_types::registry, registry_key, 2> registry_keys{};
+    handle_store<handle_types::io_completion, io_completion_port> io_completions{};
+    // Names of the events, sections, semaphores and mutants
+    object_namespace object_names{};
+    std::map<uint64_t, io_completion_association> io_completion_associations{};
     std::map<uint16_t, std::wstring> atoms{};
 
+    // Guest writes land here, keyed by the lowercase path. Files never written are read from the host.
+    bool virtualize_file_writes{false};
+    std::map<std::u16string, virtual_file> virtual_files{};
+
+    // Hooked by function_hle
+    bool emulate_library_functions{false};
+    emulated_heap heap{};
+
     std::vector<std::byte> default_register_set{};
 
     uint32_t current_thread_id{0};
+    // Bumped by all changes of the process data besides the heap, which counts its own
+    uint64_t process_data_modifications{0};
+    // Bumped when threads are created, exit or get switched to
+    uint64_t thread_changes{0};
+    // Outlives the threads, which return their memory to it
+    thread_memory_pool thread_memory{};
     handle_store<handle_types::thread, emulator_thread> threads{};
-    emulator_thread* active_thread{nullptr};
 
-    void serialize(utils::buffer_serializer& buffer) const
+    // Bumped whenever a waitable object may have become signaled.
+    // Blocked threads only re-check their wait objects after it changed.
+    uint64_t wait_generation{0};
+
+    // Threads that may be able to run, in round-robin order. Blocked threads stay out of it until they are
+    // signaled, alerted or time out, so picking the next thread doesn't depend on the number of threads.
+    std::deque<uint64_t> ready_threads{};
+    std::set<uint64_t> blocked_threads{};
+    // May contain timeouts of threads that were woken up differently, waking them again only re-checks them
+    std::set<std::pair<std::chrono::steady_clock::time_point, uint64_t>> thread_timeouts{};
+
+    void queue_thread(emulator_thread& thread)
     {
-        buffer.write(this->registry);
-        buffer.write(this->executed_instructions);
-        buffer.write(this->current_ip);
-        buffer.write(this->previous_ip);
-        buffer.write_optional(this->exception_rip);
-        buffer.write_optional(this->exit_status);
-        buffer.write(this->base_allocator);
-        buffer.write(this->peb);
-        buffer.write(this->process_params);
-        buffer.write(this->kusd);
-        buffer.write(this->mod_manager);
+        if (!thread.queued)
+        {
+            thread.queued = true;
+            this->ready_threads.push_back(thread.self_handle);
+        }
+    }
 
-        buffer.write(this->executable->image_base);
-        buffer.write(this->ntdll->image_base);
-        buffer.write(this->win32u->image_base);
+    void block_thread(const emulator_thread& thread)
+    {
+        this->blocked_threads.insert(thread.self_handle);
 
-        buffer.write(this->ldr_initialize_thunk);
-        buffer.write(this->rtl_user_thread_start);
-        buffer.write(this->ki_user_exception_dispatcher);
+        if (thread.await_time)
+        {
+            this->thread_timeouts.emplace(*thread.await_time, thread.self_handle);
+        }
+    }
 
-        buffer.write(this->events);
-        buffer.write(this->files);
-        buffer.write(this->sections);
-        buffer.write(this->devices);
-        buffer.write(this->semaphores);
-        buffer.write(this->ports);
-        buffer.write(this->mutants);
-        buffer.write(this->registry_keys);
-        buffer.write_map(this->atoms);
+    void wake_thread(const uint64_t thread_handle)
+    {
+        if (!this->blocked_threads.erase(thread_handle))
+        {
+            return;
+        }
 
-        buffer.write_vector(this->default_register_set);
-        buffer.write(this->current_thread_id);
-        buffer.write(this->threads);
+        if (auto* thread = this->threads.get(thread_handle))
+        {
+            this->queue_thread(*thread);
+        }
+    }
 
-        buffer.write(this->threads.find_handle(this->active_thread).bits);
+    void wake_timed_out_threads(const std::chrono::steady_clock::time_point now)
+    {
+        while (!this->thread_timeouts.empty() && this->thread_timeouts.begin()->first < now)
+        {
+            const auto thread_handle = this->thread_timeouts.begin()->second;
+            this->thread_timeouts.erase(this->thread_timeouts.begin());
+            this->wake_thread(thread_handle);
+        }
     }
 
-    void deserialize(utils::buffer_deserializer& buffer)
+    void signal_waiters()
     {
-        buffer.read(this->registry);
-        buffer.read(this->executed_instructions);
-        buffer.read(this->current_ip);
-        buffer.read(this->previous_ip);
-        buffer.read_optional(this->exception_rip);
-        buffer.read_optional(this->exit_status);
-        buffer.read(this->base_allocator);
-        buffer.read(this->peb);
-        buffer.read(this->process_params);
-        buffer.read(this->kusd);
-        buffer.read(this->mod_manager);
+        ++this->wait_generation;
+
+        // Threads that only wait for an alert or a timeout can't be woken by objects
+        std::erase_if(this->blocked_threads, [this](const uint64_t thread_handle) {
+            auto* thread = this->threads.get(thread_handle);
+            if (!thread)
+            {
+                return true;
+            }
+
+            if (thread->await_objects.empty() && !thread->completion_wait)
+            {
+                return false;
+            }
+
+            this->queue_thread(*thread);
+            return true;
+        });
+    }
+    emulator_thread* active_thread{nullptr};
+
+    void rebuild_object_names()
+    {
+        this->object_names.clear();
+        this->object_names.add_all(this->events);
+        this->object_names.add_all(this->sections);
+        this->object_names.add_all(this->semaphores);
+        this->object_names.add_all(this->mutants);
+    }
+
+    // Completed I/O of handles associated with a completion port queues a packet there
+    void queue_io_completion(const handle file_handle, const uint64_t apc_context, const NTSTATUS status,
+                             const uint64_t information)
+    {
+        const auto entry = this->io_completion_associations.find(file_handle.bits);
+        if (entry == this->io_completion_associations.end())
+        {
+            return;
+        }
+
+        auto* port = this->io_completions.get(entry->second.port);
+        if (!port)
+        {
+            return;
+        }
 
-        const auto executable_base = buffer.read<uint64_t>();
-        const auto ntdll_base = buffer.read<uint64_t>();
-        const auto win32u_base = buffer.read<uint64_t>();
+        port->packets.push_back({
+            .key_context = entry->second.key,
+            .apc_context = apc_context,
+            .status = status,
+            .information = information,
+        });
 
-        this->executable = this->mod_manager.find_by_address(executable_base);
-        this->ntdll = this->mod_manager.find_by_address(ntdll_base);
-        this->win32u = this->mod_manager.find_by_address(win32u_base);
+        this->signal_waiters();
+    }
 
-        buffer.read(this->ldr_initialize_thunk);
-        buffer.read(this->rtl_user_thread_start);
-        buffer.read(this->ki_user_exception_dispatcher);
+    // The state is serialized in independent components, in this order. In-memory snapshots keep them apart,
+    // so restoring one only has to rebuild the components that changed since.
+    enum class component : uint8_t
+    {
+        registry,
+        execution,
+        modules,
+        events,
+        files,
+        sections,
+        devices,
+        semaphores,
+        ports,
+        mutants,
+        registry_keys,
+        io_completions,
+        process_data,
+        threads,
+        count,
+    };
+
+    static constexpr auto component_count = static_cast<size_t>(component::count);
+
+    // Changes with every modification of the component, nothing if that isn't tracked
+    std::optional<uint64_t> get_component_modifications(const component c) const
+    {
+        switch (c)
+        {
+        case component::registry:
+            // Only holds the hive path
+            return 0;
+        case component::modules:
+            return this->mod_manager.get_modifications();
+        case component::events:
+            return this->events.get_modifications();
+        case component::files:
+            return this->files.get_modifications();
+        case component::sections:
+            return this->sections.get_modifications();
+        case component::devices:
+            return this->devices.get_modifications();
+        case component::semaphores:
+            return this->semaphores.get_modifications();
+        case component::ports:
+            return this->ports.get_modifications();
+        case component::mutants:
+            return this->mutants.get_modifications();
+        case component::registry_keys:
+            return this->registry_keys.get_modifications();
+        case component::io_completions:
+            return this->io_completions.get_modifications();
+        case component::process_data:
+            return this->process_data_modifications + this->heap.get_modifications();
+        case component::execution:
+        case component::threads:
+        case component::count:
+            break;
+        }
 
-        buffer.read(this->events);
-        buffer.read(this->files);
-        buffer.read(this->sections);
-        buffer.read(this->devices);
-        buffer.read(this->semaphores);
-        buffer.read(this->ports);
-        buffer.read(this->mutants);
-        buffer.read(this->registry_keys);
-        buffer.read_map(this->atoms);
+        return std::nullopt;
+    }
 
-        buffer.read_vector(this->default_register_set);
-        buffer.read(this->current_thread_id);
+    void serialize(utils::buffer_serializer& buffer) const
+    {
+        for (size_t i = 0; i < component_count; ++i)
+        {
+            this->serialize_component(buffer, static_cast<component>(i));
+        }
+    }
 
-        buffer.read(this->threads);
+    void deserialize(utils::buffer_deserializer& buffer)
+    {
+        for (size_t i = 0; i < component_count; ++i)
+        {
+            this->deserialize_component(buffer, static_cast<component>(i));
+        }
+    }
 
-        this->active_thread = this->threads.get(buffer.read<uint64_t>());
+    void serialize_component(utils::buffer_serializer& buffer, const component c) const
+    {
+        switch (c)
+        {
+        case component::registry:
+            buffer.write(this->registry);
+            break;
+        case component::execution:
+            buffer.write(this->executed_instructions);
+            buffer.write(this->current_ip);
+            buffer.write(this->previous_ip);
+            buffer.write(this->clock);
+            buffer.write_optional(this->exception_rip);
+            buffer.write_optional(this->exit_status);
+            buffer.write(this->base_allocator);
+            buffer.write(this->peb);
+            buffer.write(this->process_params);
+            buffer.write(this->kusd);
+            break;
+        case component::modules:
+            buffer.write(this->mod_manager);
+
+            buffer.write(this->executable->image_base);
+            buffer.write(this->ntdll->image_base);
+            buffer.write(this->win32u->image_base);
+
+            buffer.write(this->ldr_initialize_thunk);
+            buffer.write(this->rtl_user_thread_start);
+            buffer.write(this->ki_user_exception_dispatcher);
+            break;
+        case component::events:
+            buffer.write(this->events);
+            break;
+        case component::files:
+            buffer.write(this->files);
+            break;
+        case component::sections:
+            buffer.write(this->sections);
+            break;
+        case component::devices:
+            buffer.write(this->devices);
+            break;
+        case component::semaphores:
+            buffer.write(this->semaphores);
+            break;
+        case component::ports:
+            buffer.write(this->ports);
+            break;
+        case component::mutants:
+            buffer.write(this->mutants);
+            break;
+        case component::registry_keys:
+            buffer.write(this->registry_keys);
+            break;
+        case component::io_completions:
+            buffer.write(this->io_completions);
+            break;
+        case component::process_data:
+            buffer.write_map(this->io_completion_associations);
+            buffer.write_map(this->atoms);
+            buffer.write(this->virtualize_file_writes);
+            buffer.write_map(this->virtual_files);
+            buffer.write(this->emulate_library_functions);
+            buffer.write(this->heap);
+
+            buffer.write_vector(this->default_register_set);
+            buffer.write(this->current_thread_id);
+            break;
+        case component::threads:
+            buffer.write(this->threads);
+            buffer.write(this->threads.find_handle(this->active_thread).bits);
+            buffer.write(this->thread_memory);
+
+            buffer.write_vector(std::vector(this->ready_threads.begin(), this->ready_threads.end()));
+            buffer.write_vector(std::vector(this->blocked_threads.begin(), this->blocked_threads.end()));
+            break;
+        case component::count:
+            break;
+        }
+    }
+
+    void deserialize_component(utils::buffer_deserializer& buffer, const component c)
+    {
+        switch (c)
+        {
+        case component::registry:
+            buffer.read(this->registry);
+            break;
+        case component::execution:
+            buffer.read(this->executed_instructions);
+            buffer.read(this->current_ip);
+            buffer.read(this->previous_ip);
+            buffer.read(this->clock);
+            buffer.read_optional(this->exception_rip);
+            buffer.read_optional(this->exit_status);
+            buffer.read(this->base_allocator);
+            buffer.read(this->peb);
+            buffer.read(this->process_params);
+            buffer.read(this->kusd);
+            break;
+        case component::modules: {
+            buffer.read(this->mod_manager);
+
+            const auto executable_base = buffer.read<uint64_t>();
+            const auto ntdll_base = buffer.read<uint64_t>();
+            const auto win32u_base = buffer.read<uint64_t>();
+
+            this->executable = this->mod_manager.find_by_address(executable_base);
+            this->ntdll = this->mod_manager.find_by_address(ntdll_base);
+            this->win32u = this->mod_manager.find_by_address(win32u_base);
+
+            buffer.read(this->ldr_initialize_thunk);
+            buffer.read(this->rtl_user_thread_start);
+            buffer.read(this->ki_user_exception_dispatcher);
+            break;
+        }
+        case component::events:
+            buffer.read(this->events);
+            this->rebuild_object_names();
+            break;
+        case component::files:
+            buffer.read(this->files);
+            break;
+        case component::sections:
+            buffer.read(this->sections);
+            this->rebuild_object_names();
+            break;
+        case component::devices:
+            buffer.read(this->devices);
+            break;
+        case component::semaphores:
+            buffer.read(this->semaphores);
+            this->rebuild_object_names();
+            break;
+        case component::ports:
+            buffer.read(this->ports);
+            break;
+        case component::mutants:
+            buffer.read(this->mutants);
+            this->rebuild_object_names();
+            break;
+        case component::registry_keys:
+            buffer.read(this->registry_keys);
+            break;
+        case component::io_completions:
+            buffer.read(this->io_completions);
+            break;
+        case component::process_data:
+            ++this->process_data_modifications;
+            buffer.read_map(this->io_completion_associations);
+            buffer.read_map(this->atoms);
+            buffer.read(this->virtualize_file_writes);
+            buffer.read_map(this->virtual_files);
+            buffer.read(this->emulate_library_functions);
+            buffer.read(this->heap);
+
+            buffer.read_vector(this->default_register_set);
+            buffer.read(this->current_thread_id);
+            break;
+        case component::threads:
+            // Destroying the old threads fills the pool, so it's read afterwards
+            ++this->thread_changes;
+            buffer.read(this->threads);
+            this->active_thread = this->threads.get(buffer.read<uint64_t>());
+            buffer.read(this->thread_memory);
+
+            for (auto& t : this->threads)
+            {
+                t.second.memory_pool = &this->thread_memory;
+                t.second.self_handle = this->threads.make_handle(t.first).bits;
+                t.second.queued = false;
+            }
+
+            this->deserialize_scheduling(buffer);
+            break;
+        case component::count:
+            break;
+        }
     }
 
     handle create_thread(x64_emulator& emu, const uint64_t start_address, const uint64_t argument,
                          const uint64_t stack_size)
     {
-        emulator_thread t{emu, *this, start_address, argument, stack_size, ++this->current_thread_id};
-        return this->threads.store(std::move(t));
+        ++this->process_data_modifications;
+        ++this->thread_changes;
+
+        emulator_thread t{
+            emu, *this, this->thread_memory, start_address, argument, stack_size, ++this->current_thread_id,
+        };
+
+        const auto h = this->threads.store(std::move(t));
+
+        auto& thread = *this->threads.get(h);
+        thread.self_handle = h.bits;
+        this->queue_thread(thread);
+
+        return h;
+    }
+
+    void deserialize_scheduling(utils::buffer_deserializer& buffer)
+    {
+        std::vector<uint64_t> ready_threads{};
+        std::vector<uint64_t> blocked_threads{};
+        buffer.read_vector(ready_threads);
+        buffer.read_vector(blocked_threads);
+
+        this->ready_threads.clear();
+        this->blocked_threads.clear();
+        this->thread_timeouts.clear();
+
+        for (const auto thread_handle : ready_threads)
+        {
+            if (auto* thread = this->threads.get(thread_handle))
+            {
+                this->queue_thread(*thread);
+            }
+        }
+
+        for (const auto thread_handle : blocked_threads)
+        {
+            if (const auto* thread = this->threads.get(thread_handle))
+            {
+                this->block_thread(*thread);
+            }
+        }
     }
 };
@@ -1,6 +1,9 @@
 #include "hive_parser.hpp"
 #include <utils/string.hpp>
 
+#include <cstring>
+#include <stdexcept>
+
 // Based on this implementation: https://github.com/reahly/windows-hive-parser
 
 namespace
@@ -52,68 +55,47 @@ namespace
         char name[255];
     };
 
-    bool read_file_data_safe(std::ifstream& file, const uint64_t offset, void* buffer, const size_t size)
-    {
-        if (file.bad())
-        {
-            return false;
-        }
-
-        file.clear();
-
-        if (!file.good())
-        {
-            return false;
-        }
-
-        file.seekg(static_cast<std::streamoff>(offset));
-
-        if (!file.good())
-        {
-            return false;
-        }
-
-        file.read(static_cast<char*>(buffer), static_cast<std::streamsize>(size));
-
-        return file.good();
-    }
-
-    void read_file_data(std::ifstream& file, const uint64_t offset, void* buffer, const size_t size)
+    std::span<const std::byte> get_file_data(const utils::mapped_file& file, const uint64_t offset,
+                                             const size_t size)
     {
-        if (!read_file_data_safe(file, offset, buffer, size))
+        if (offset > file.size() || size > file.size() - offset)
         {
             throw std::runtime_error("Failed to read file data");
         }
-    }
-
-    std::vector<std::byte> read_file_data(std::ifstream& file, const uint64_t offset, const size_t size)
-    {
-        std::vector<std::byte> result{};
-        result.resize(size);
 
-        read_file_data(file, offset, result.data(), size);
-        return result;
+        return {file.data() + offset, size};
     }
 
-    std::string read_file_data_string(std::ifstream& file, const uint64_t offset, const size_t size)
+    std::string read_file_data_string(const utils::mapped_file& file, const uint64_t offset, const size_t size)
     {
-        std::string result{};
-        result.resize(size);
-
-        read_file_data(file, offset, result.data(), size);
-        return result;
+        const auto data = get_file_data(file, offset, size);
+        return {reinterpret_cast<const char*>(data.data()), data.size()};
     }
 
     template <typename T>
         requires(std::is_trivially_copyable_v<T>)
-    T read_file_object(std::ifstream& file, const uint64_t offset, const size_t array_index = 0)
+    T read_file_object(const utils::mapped_file& file, const uint64_t offset, const size_t array_index = 0)
     {
+        const auto data = get_file_data(file, offset + (array_index * sizeof(T)), sizeof(T));
+
         T obj{};
-        read_file_data(file, offset + (array_index * sizeof(T)), &obj, sizeof(T));
+        memcpy(&obj, data.data(), sizeof(T));
         return obj;
     }
 
-    hive_key parse_root_block(std::ifstream& file, const std::filesystem::path& file_path)
+    utils::mapped_file map_hive_file(const std::filesystem::path& file_path)
+    {
+        try
+        {
+            return utils::mapped_file{file_path};
+        }
+        catch (const std::exception& e)
+        {
+            throw std::runtime_error("Bad hive file '" + file_path.string() + "': " + e.what());
+        }
+    }
+
+    hive_key parse_root_block(const utils::mapped_file& file, const std::filesystem::path& file_path)
     {
         try
         {
@@ -133,7 +115,7 @@ namespace
     }
 }
 
-const hive_value* hive_key::get_value(std::ifstream& file, const std::string_view name)
+const hive_value* hive_key::get_value(const utils::mapped_file& file, const std::string_view name)
 {
     this->parse(file);
 
@@ -147,14 +129,35 @@ const hive_value* hive_key::get_value(std::ifstream& file, const std::string_vie
 
     if (!value.parsed)
     {
-        value.data = read_file_data(file, MAIN_ROOT_OFFSET + value.data_offset, value.data_length);
+        value.data = get_file_data(file, MAIN_ROOT_OFFSET + value.data_offset, value.data_length);
         value.parsed = true;
     }
 
     return &value;
 }
 
-void hive_key::parse(std::ifstream& file)
+std::vector<const hive_value*> hive_key::get_values(const utils::mapped_file& file)
+{
+    this->parse(file);
+
+    std::vector<const hive_value*> values{};
+    values.reserve(this->values_.size());
+
+    for (const auto& name : this->values_ | std::views::keys)
+    {
+        try
+        {
+            values.push_back(this->get_value(file, name));
+        }
+        catch (const std::exception&)
+        {
+        }
+    }
+
+    return values;
+}
+
+void hive_key::parse(const utils::mapped_file& file)
 {
     if (this->parsed_)
     {
@@ -214,7 +217,34 @@ void hive_key::parse(std::ifstream& file)
 }
 
 hive_parser::hive_parser(const std::filesystem::path& file_path)
-    : file_(file_path, std::ios::binary),
+    : file_(map_hive_file(file_path)),
       root_key_(parse_root_block(file_, file_path))
 {
 }
+
+hive_key* hive_parser::find_sub_key(const std::filesystem::path& key)
+{
+    auto index_key = key.generic_string();
+    utils::string::to_lower_inplace(index_key);
+
+    const auto entry = this->key_index_.find(index_key);
+    if (entry != this->key_index_.end())
+    {
+        return entry->second;
+    }
+
+    hive_key* current_key = &this->root_key_;
+
+    for (const auto& key_part : std::filesystem::path{index_key})
+    {
+        if (!current_key)
+        {
+            break;
+        }
+
+        current_key = current_key->get_sub_key(this->file_, key_part.string());
+    }
+
+    this->key_index_.emplace(std::move(index_key), current_key);
+    return current_key;
+}
@@ -1,16 +1,21 @@
 #pragma once
 
+#include <span>
+#include <mutex>
 #include <ranges>
-#include <fstream>
 #include <algorithm>
+#include <filesystem>
 
 #include <utils/container.hpp>
+#include <utils/mapped_file.hpp>
+
+#include "registry_hive.hpp"
 
 struct hive_value
 {
     uint32_t type{};
     std::string name{};
-    std::vector<std::byte> data{};
+    std::span<const std::byte> data{};
 };
 
 class hive_key
@@ -23,13 +28,13 @@ class hive_key
     {
     }
 
-    utils::unordered_string_map<hive_key>& get_sub_keys(std::ifstream& file)
+    utils::unordered_string_map<hive_key>& get_sub_keys(const utils::mapped_file& file)
     {
         this->parse(file);
         return this->sub_keys_;
     }
 
-    hive_key* get_sub_key(std::ifstream& file, const std::string_view name)
+    hive_key* get_sub_key(const utils::mapped_file& file, const std::string_view name)
     {
         auto& sub_keys = this->get_sub_keys(file);
         const auto entry = sub_keys.find(name);
@@ -42,7 +47,10 @@ class hive_key
         return &entry->second;
     }
 
-    const hive_value* get_value(std::ifstream& file, const std::string_view name);
+    const hive_value* get_value(const utils::mapped_file& file, const std::string_view name);
+
+    // Unreadable values are skipped
+    std::vector<const hive_value*> get_values(const utils::mapped_file& file);
 
   private:
     struct raw_hive_value : hive_value
@@ -60,43 +68,62 @@ class hive_key
     const int value_count_{};
     const int value_offsets_{};
 
-    void parse(std::ifstream& file);
+    void parse(const utils::mapped_file& file);
 };
 
-class hive_parser
+// Hive mapped into memory and parsed on demand. Keys are additionally indexed by their
+// full lowercase path, so repeated lookups don't walk the tree. Returned keys and values
+// point into the parser and stay valid for its lifetime, which allows sharing one parser
+// between all emulator instances.
+class hive_parser : public registry_hive
 {
   public:
     explicit hive_parser(const std::filesystem::path& file_path);
 
-    [[nodiscard]] hive_key* get_sub_key(const std::filesystem::path& key)
-    {
-        hive_key* current_key = &this->root_key_;
-
-        for (const auto& key_part : key)
-        {
-            if (!current_key)
-            {
-                return nullptr;
-            }
+    hive_parser(const hive_parser&) = delete;
+    hive_parser& operator=(const hive_parser&) = delete;
 
-            current_key = current_key->get_sub_key(this->file_, key_part.string());
-        }
+    hive_parser(hive_parser&&) = delete;
+    hive_parser& operator=(hive_parser&&) = delete;
 
-        return current_key;
+    bool has_key(const std::filesystem::path& key) override
+    {
+        std::lock_guard _{this->mutex_};
+        return this->find_sub_key(key) != nullptr;
     }
 
-    [[nodiscard]] const hive_value* get_value(const std::filesystem::path& key, const std::string_view name)
+    std::optional<registry_value> get_value(const std::filesystem::path& key, const std::string_view name) override
     {
-        auto* sub_key = this->get_sub_key(key);
+        std::lock_guard _{this->mutex_};
+
+        auto* sub_key = this->find_sub_key(key);
         if (!sub_key)
         {
-            return nullptr;
+            return std::nullopt;
+        }
+
+        const auto* value = sub_key->get_value(this->file_, name);
+        if (!value)
+        {
+            return std::nullopt;
         }
 
-        return sub_key->get_value(this->file_, name);
+        return registry_value{value->type, value->name, value->data};
+    }
+
+    // Grants exclusive access to the raw key tree, e.g. to convert the whole hive
+    template <typename F>
+    void access(F&& accessor)
+    {
+        std::lock_guard _{this->mutex_};
+        accessor(this->root_key_, static_cast<const utils::mapped_file&>(this->file_));
     }
 
   private:
-    std::ifstream file_{};
+    std::mutex mutex_{};
+    utils::mapped_file file_{};
     hive_key root_key_;
+    utils::unordered_string_map<hive_key*> key_index_{};
+
+    hive_key* find_sub_key(const std::filesystem::path& key);
 };
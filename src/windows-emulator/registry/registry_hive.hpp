@@ -0,0 +1,26 @@
+#pragma once
+
+#include <span>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <filesystem>
+#include <string_view>
+
+struct registry_value
+{
+    uint32_t type;
+    std::string_view name;
+    std::span<const std::byte> data;
+};
+
+// Read-only view of a hive. Keys and value names are looked up in lowercase,
+// returned values stay valid for the lifetime of the hive.
+class registry_hive
+{
+  public:
+    virtual ~registry_hive() = default;
+
+    virtual bool has_key(const std::filesystem::path& key) = 0;
+    virtual std::optional<registry_value> get_value(const std::filesystem::path& key, std::string_view name) = 0;
+};
@@ -3,6 +3,7 @@
 #include <serialization_helper.hpp>
 
 #include "hive_parser.hpp"
+#include "registry_snapshot.hpp"
 #include <utils/string.hpp>
 
 namespace
@@ -29,10 +30,66 @@ namespace
         return true;
     }
 
-    void register_hive(registry_manager::hive_map& hives, const std::filesystem::path& key,
-                       const std::filesystem::path& file)
+    constexpr auto SNAPSHOT_FILE = "registry.snapshot";
+
+    struct hive_file
+    {
+        std::string_view key;
+        std::string_view file;
+    };
+
+    // Keys are relative to \registry
+    constexpr std::array<hive_file, 6> HIVE_FILES{{
+        {"machine/system", "SYSTEM"},
+        {"machine/security", "SECURITY"},
+        {"machine/sam", "SAM"},
+        {"machine/software", "SOFTWARE"},
+        {"machine/hardware", "HARDWARE"},
+        {"user", "NTUSER.dat"},
+    }};
+
+    struct file_cache_key
+    {
+        std::u16string path{};
+        std::filesystem::file_time_type write_time{};
+        uint64_t file_size{};
+
+        bool operator<(const file_cache_key& other) const
+        {
+            return std::tie(this->path, this->write_time, this->file_size) <
+                   std::tie(other.path, other.write_time, other.file_size);
+        }
+    };
+
+    // Shared by all emulator instances, hives and snapshots are never modified
+    template <typename T>
+    std::shared_ptr<T> load_shared(const std::filesystem::path& file)
     {
-        hives[canonicalize_path(key)] = std::make_unique<hive_parser>(file);
+        static std::mutex cache_mutex{};
+        static std::map<file_cache_key, std::shared_ptr<T>> cache{};
+
+        std::error_code ec{};
+        const auto write_time = std::filesystem::last_write_time(file, ec);
+        const auto file_size = ec ? 0 : std::filesystem::file_size(file, ec);
+        if (ec)
+        {
+            return std::make_shared<T>(file);
+        }
+
+        file_cache_key key{};
+        key.path = file.generic_u16string();
+        key.write_time = write_time;
+        key.file_size = file_size;
+
+        std::lock_guard _{cache_mutex};
+
+        auto& entry = cache[std::move(key)];
+        if (!entry)
+        {
+            entry = std::make_shared<T>(file);
+        }
+
+        return entry;
     }
 }
 
@@ -51,22 +108,49 @@ void registry_manager::setup()
 {
     this->path_mapping_.clear();
     this->hives_.clear();
+    this->key_cache_.clear();
 
     const std::filesystem::path root = R"(\registry)";
     const std::filesystem::path machine = root / "machine";
 
-    register_hive(this->hives_, machine / "system", this->hive_path_ / "SYSTEM");
-    register_hive(this->hives_, machine / "security", this->hive_path_ / "SECURITY");
-    register_hive(this->hives_, machine / "sam", this->hive_path_ / "SAM");
-    register_hive(this->hives_, machine / "software", this->hive_path_ / "SOFTWARE");
-    register_hive(this->hives_, machine / "system", this->hive_path_ / "SYSTEM");
-    register_hive(this->hives_, machine / "hardware", this->hive_path_ / "HARDWARE");
+    // A snapshot next to the hives takes precedence over them
+    std::shared_ptr<const registry_snapshot> snapshot{};
 
-    register_hive(this->hives_, root / "user", this->hive_path_ / "NTUSER.dat");
+    const auto snapshot_file = this->hive_path_ / SNAPSHOT_FILE;
+    if (std::filesystem::exists(snapshot_file))
+    {
+        snapshot = load_shared<registry_snapshot>(snapshot_file);
+    }
+
+    for (const auto& hive : HIVE_FILES)
+    {
+        auto& entry = this->hives_[canonicalize_path(root / hive.key)];
+
+        if (snapshot)
+        {
+            entry = registry_snapshot::open_hive(snapshot, hive.file);
+        }
+        else
+        {
+            entry = load_shared<hive_parser>(this->hive_path_ / hive.file);
+        }
+    }
 
     this->add_path_mapping(machine / "system" / "CurrentControlSet", machine / "system" / "ControlSet001");
 }
 
+void registry_manager::create_snapshot(const std::filesystem::path& hive_path)
+{
+    std::vector<std::pair<std::string, std::filesystem::path>> hives{};
+
+    for (const auto& hive : HIVE_FILES)
+    {
+        hives.emplace_back(hive.file, hive_path / hive.file);
+    }
+
+    registry_snapshot::create(hive_path / SNAPSHOT_FILE, hives);
+}
+
 void registry_manager::serialize(utils::buffer_serializer& buffer) const
 {
     buffer.write(this->hive_path_);
@@ -98,7 +182,24 @@ void registry_manager::add_path_mapping(const std::filesystem::path& key, const
     this->path_mapping_[canonicalize_path(key)] = canonicalize_path(value);
 }
 
-std::optional<registry_key> registry_manager::get_key(const std::filesystem::path& key)
+std::optional<registry_key> registry_manager::get_key(const std::u16string_view key)
+{
+    std::u16string cache_key{key};
+    utils::string::to_lower_inplace(cache_key);
+
+    const auto entry = this->key_cache_.find(cache_key);
+    if (entry != this->key_cache_.end())
+    {
+        return entry->second;
+    }
+
+    auto result = this->find_key(std::filesystem::path(key));
+    this->key_cache_.emplace(std::move(cache_key), result);
+
+    return result;
+}
+
+std::optional<registry_key> registry_manager::find_key(const std::filesystem::path& key)
 {
     const auto normal_key = this->normalize_path(key);
 
@@ -124,8 +225,7 @@ std::optional<registry_key> registry_manager::get_key(const std::filesystem::pat
         return {std::move(reg_key)};
     }
 
-    const auto entry = iterator->second->get_sub_key(reg_key.path);
-    if (!entry)
+    if (!iterator->second->has_key(reg_key.path))
     {
         return std::nullopt;
     }
@@ -137,24 +237,21 @@ std::optional<registry_value> registry_manager::get_value(const registry_key& ke
 {
     utils::string::to_lower_inplace(name);
 
-    const auto iterator = this->hives_.find(key.hive);
-    if (iterator == this->hives_.end())
+    if (const auto entry = key.value_cache.find(name); entry != key.value_cache.end())
     {
-        return std::nullopt;
+        return entry->second;
     }
 
-    auto* entry = iterator->second->get_value(key.path, name);
-    if (!entry)
+    const auto iterator = this->hives_.find(key.hive);
+    if (iterator == this->hives_.end())
     {
         return std::nullopt;
     }
 
-    registry_value v{};
-    v.type = entry->type;
-    v.name = entry->name;
-    v.data = entry->data;
+    auto value = iterator->second->get_value(key.path, name);
+    key.value_cache.emplace(std::move(name), value);
 
-    return v;
+    return value;
 }
 
 registry_manager::hive_map::iterator registry_manager::find_hive(const std::filesystem::path& key)
@@ -2,13 +2,17 @@
 
 #include "../std_include.hpp"
 #include <serialization_helper.hpp>
-#include "hive_parser.hpp"
+#include "registry_hive.hpp"
 
 struct registry_key
 {
     std::filesystem::path hive{};
     std::filesystem::path path{};
 
+    // Results of registry_manager::get_value by lowercase name, including missing values.
+    // The hives are read-only, so entries never go stale.
+    mutable std::unordered_map<std::string, std::optional<registry_value>> value_cache{};
+
     void serialize(utils::buffer_serializer& buffer) const
     {
         buffer.write(this->hive);
@@ -19,20 +23,14 @@ struct registry_key
     {
         buffer.read(this->hive);
         buffer.read(this->path);
+        this->value_cache = {};
     }
 };
 
-struct registry_value
-{
-    uint32_t type;
-    std::string_view name;
-    std::span<const std::byte> data;
-};
-
 class registry_manager
 {
   public:
-    using hive_ptr = std::unique_ptr<hive_parser>;
+    using hive_ptr = std::shared_ptr<registry_hive>;
     using hive_map = std::unordered_map<std::filesystem::path, hive_ptr>;
 
     registry_manager();
@@ -45,10 +43,13 @@ class registry_manager
     registry_manager(const registry_manager&) = delete;
     registry_manager& operator=(const registry_manager&) = delete;
 
+    // Precompiles the hives in the directory into a snapshot that is loaded instead of them
+    static void create_snapshot(const std::filesystem::path& hive_path);
+
     void serialize(utils::buffer_serializer& buffer) const;
     void deserialize(utils::buffer_deserializer& buffer);
 
-    std::optional<registry_key> get_key(const std::filesystem::path& key);
+    std::optional<registry_key> get_key(std::u16string_view key);
     std::optional<registry_value> get_value(const registry_key& key, std::string name);
 
   private:
@@ -56,6 +57,12 @@ class registry_manager
     hive_map hives_{};
     std::unordered_map<std::filesystem::path, std::filesystem::path> path_mapping_{};
 
+    // Results of get_key by lowercase key, including missing keys. Guests open the same keys over and over
+    // and normalizing their paths is far more expensive than hashing them.
+    std::unordered_map<std::u16string, std::optional<registry_key>> key_cache_{};
+
+    std::optional<registry_key> find_key(const std::filesystem::path& key);
+
     std::filesystem::path normalize_path(const std::filesystem::path& path) const;
     void add_path_mapping(const std::filesystem::path& key, const std::filesystem::path& value);
 
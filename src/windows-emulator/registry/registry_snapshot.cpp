@@ -0,0 +1,358 @@
+#include "registry_snapshot.hpp"
+#include "hive_parser.hpp"
+
+#include <deque>
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include <utils/io.hpp>
+#include <utils/string.hpp>
+
+using namespace registry_snapshot_format;
+
+namespace
+{
+    template <typename T>
+    std::span<const T> get_table(const utils::mapped_file& file, const uint64_t offset, const uint64_t count)
+    {
+        if (offset % alignof(T) != 0 || offset > file.size() || (file.size() - offset) / sizeof(T) < count)
+        {
+            throw std::runtime_error("Bad registry snapshot table");
+        }
+
+        return {reinterpret_cast<const T*>(file.data() + offset), static_cast<size_t>(count)};
+    }
+
+    template <typename T>
+    std::span<const T> get_range(const std::span<const T> table, const uint32_t first, const uint32_t count)
+    {
+        if (first > table.size() || count > table.size() - first)
+        {
+            throw std::runtime_error("Bad registry snapshot entry");
+        }
+
+        return table.subspan(first, count);
+    }
+
+    std::span<const std::byte> as_bytes(const std::string_view str)
+    {
+        return {reinterpret_cast<const std::byte*>(str.data()), str.size()};
+    }
+
+    uint32_t to_index(const size_t value)
+    {
+        if (value > std::numeric_limits<uint32_t>::max())
+        {
+            throw std::runtime_error("Registry too large for snapshot");
+        }
+
+        return static_cast<uint32_t>(value);
+    }
+
+    // Keys that fail to parse keep the sub keys read before the failure, the key counts as parsed afterwards
+    utils::unordered_string_map<hive_key>& get_parsed_sub_keys(hive_key& key, const utils::mapped_file& file)
+    {
+        try
+        {
+            return key.get_sub_keys(file);
+        }
+        catch (const std::exception&)
+        {
+            return key.get_sub_keys(file);
+        }
+    }
+
+    class snapshot_builder
+    {
+      public:
+        void add_hive(const std::string_view name, hive_parser& hive)
+        {
+            hive.access([&](hive_key& root, const utils::mapped_file& file) {
+                hive_entry entry{};
+                entry.name = this->intern(as_bytes(utils::string::to_lower(std::string(name))));
+                entry.root_key = to_index(this->keys_.size());
+                this->hives_.push_back(entry);
+
+                this->keys_.emplace_back();
+
+                std::deque<std::pair<hive_key*, uint32_t>> pending{};
+                pending.emplace_back(&root, entry.root_key);
+
+                while (!pending.empty())
+                {
+                    const auto [key, index] = pending.front();
+                    pending.pop_front();
+
+                    auto& sub_keys = get_parsed_sub_keys(*key, file);
+                    this->add_values(index, key->get_values(file));
+
+                    std::vector<std::pair<std::string_view, hive_key*>> children{};
+                    for (auto& [child_name, child] : sub_keys)
+                    {
+                        children.emplace_back(child_name, &child);
+                    }
+
+                    std::ranges::sort(children, {}, [](const auto& child) { return child.first; });
+
+                    this->keys_[index].first_child = to_index(this->keys_.size());
+                    this->keys_[index].child_count = to_index(children.size());
+
+                    for (const auto& [child_name, child] : children)
+                    {
+                        key_entry child_entry{};
+                        child_entry.name = this->intern(as_bytes(child_name));
+
+                        pending.emplace_back(child, to_index(this->keys_.size()));
+                        this->keys_.push_back(child_entry);
+                    }
+                }
+            });
+        }
+
+        std::vector<uint8_t> build() const
+        {
+            header h{};
+            memcpy(h.magic, MAGIC, sizeof(h.magic));
+            h.version = VERSION;
+            h.hive_count = to_index(this->hives_.size());
+            h.key_count = to_index(this->keys_.size());
+            h.value_count = to_index(this->values_.size());
+            h.hives_offset = sizeof(header);
+            h.keys_offset = h.hives_offset + this->hives_.size() * sizeof(hive_entry);
+            h.values_offset = h.keys_offset + this->keys_.size() * sizeof(key_entry);
+            h.blob_offset = h.values_offset + this->values_.size() * sizeof(value_entry);
+            h.blob_size = this->blob_.size();
+
+            std::vector<uint8_t> data{};
+            data.reserve(h.blob_offset + h.blob_size);
+
+            append(data, &h, sizeof(h));
+            append(data, this->hives_.data(), this->hives_.size() * sizeof(hive_entry));
+            append(data, this->keys_.data(), this->keys_.size() * sizeof(key_entry));
+            append(data, this->values_.data(), this->values_.size() * sizeof(value_entry));
+            append(data, this->blob_.data(), this->blob_.size());
+
+            return data;
+        }
+
+      private:
+        std::vector<hive_entry> hives_{};
+        std::vector<key_entry> keys_{};
+        std::vector<value_entry> values_{};
+        std::vector<std::byte> blob_{};
+        utils::unordered_string_map<blob_ref> interned_{};
+
+        static void append(std::vector<uint8_t>& data, const void* source, const size_t size)
+        {
+            const auto* bytes = static_cast<const uint8_t*>(source);
+            data.insert(data.end(), bytes, bytes + size);
+        }
+
+        blob_ref intern(const std::span<const std::byte> data)
+        {
+            const std::string_view key{reinterpret_cast<const char*>(data.data()), data.size()};
+
+            const auto entry = this->interned_.find(key);
+            if (entry != this->interned_.end())
+            {
+                return entry->second;
+            }
+
+            const blob_ref ref{this->blob_.size(), data.size()};
+            this->blob_.insert(this->blob_.end(), data.begin(), data.end());
+            this->interned_.emplace(key, ref);
+
+            return ref;
+        }
+
+        void add_values(const uint32_t key, std::vector<const hive_value*> values)
+        {
+            std::vector<std::pair<std::string, const hive_value*>> sorted_values{};
+            sorted_values.reserve(values.size());
+
+            for (const auto* value : values)
+            {
+                sorted_values.emplace_back(utils::string::to_lower(value->name), value);
+            }
+
+            std::ranges::sort(sorted_values, {}, [](const auto& value) { return value.first; });
+
+            this->keys_[key].first_value = to_index(this->values_.size());
+            this->keys_[key].value_count = to_index(sorted_values.size());
+
+            for (const auto& [lookup_name, value] : sorted_values)
+            {
+                value_entry entry{};
+                entry.lookup_name = this->intern(as_bytes(lookup_name));
+                entry.name = this->intern(as_bytes(value->name));
+                entry.data = this->intern(value->data);
+                entry.type = value->type;
+
+                this->values_.push_back(entry);
+            }
+        }
+    };
+
+    class snapshot_hive : public registry_hive
+    {
+      public:
+        snapshot_hive(std::shared_ptr<const registry_snapshot> snapshot, const uint32_t root_key)
+            : snapshot_(std::move(snapshot)),
+              root_key_(root_key)
+        {
+        }
+
+        bool has_key(const std::filesystem::path& key) override
+        {
+            return this->snapshot_->find_key(this->root_key_, key).has_value();
+        }
+
+        std::optional<registry_value> get_value(const std::filesystem::path& key, const std::string_view name) override
+        {
+            const auto key_index = this->snapshot_->find_key(this->root_key_, key);
+            if (!key_index)
+            {
+                return std::nullopt;
+            }
+
+            return this->snapshot_->get_value(*key_index, name);
+        }
+
+      private:
+        std::shared_ptr<const registry_snapshot> snapshot_{};
+        uint32_t root_key_{};
+    };
+}
+
+registry_snapshot::registry_snapshot(const std::filesystem::path& file)
+    : file_(file)
+{
+    if (this->file_.size() < sizeof(header))
+    {
+        throw std::runtime_error("Bad registry snapshot: " + file.string());
+    }
+
+    this->header_ = reinterpret_cast<const header*>(this->file_.data());
+
+    if (memcmp(this->header_->magic, MAGIC, sizeof(MAGIC)) != 0 || this->header_->version != VERSION)
+    {
+        throw std::runtime_error("Unsupported registry snapshot: " + file.string());
+    }
+
+    this->hives_ = get_table<hive_entry>(this->file_, this->header_->hives_offset, this->header_->hive_count);
+    this->keys_ = get_table<key_entry>(this->file_, this->header_->keys_offset, this->header_->key_count);
+    this->values_ = get_table<value_entry>(this->file_, this->header_->values_offset, this->header_->value_count);
+    this->blob_ = get_table<std::byte>(this->file_, this->header_->blob_offset, this->header_->blob_size);
+}
+
+std::unique_ptr<registry_hive> registry_snapshot::open_hive(std::shared_ptr<const registry_snapshot> snapshot,
+                                                            const std::string_view name)
+{
+    const auto hive = snapshot->find_hive(name);
+    if (!hive)
+    {
+        throw std::runtime_error("Hive not found in registry snapshot: " + std::string(name));
+    }
+
+    return std::make_unique<snapshot_hive>(std::move(snapshot), *hive);
+}
+
+void registry_snapshot::create(const std::filesystem::path& file,
+                               const std::vector<std::pair<std::string, std::filesystem::path>>& hives)
+{
+    snapshot_builder builder{};
+
+    for (const auto& [name, hive_file] : hives)
+    {
+        hive_parser hive{hive_file};
+        builder.add_hive(name, hive);
+    }
+
+    if (!utils::io::write_file(file, builder.build()))
+    {
+        throw std::runtime_error("Failed to write registry snapshot: " + file.string());
+    }
+}
+
+std::optional<uint32_t> registry_snapshot::find_hive(const std::string_view name) const
+{
+    const auto lower_name = utils::string::to_lower(std::string(name));
+
+    for (const auto& hive : this->hives_)
+    {
+        if (this->get_string(hive.name) == lower_name)
+        {
+            return hive.root_key;
+        }
+    }
+
+    return std::nullopt;
+}
+
+std::optional<uint32_t> registry_snapshot::find_key(const uint32_t root_key, const std::filesystem::path& key) const
+{
+    auto path = key.generic_string();
+    utils::string::to_lower_inplace(path);
+
+    std::optional current_key = root_key;
+
+    for (const auto& key_part : std::filesystem::path{path})
+    {
+        current_key = this->find_child(*current_key, key_part.string());
+        if (!current_key)
+        {
+            break;
+        }
+    }
+
+    return current_key;
+}
+
+std::optional<registry_value> registry_snapshot::get_value(const uint32_t key, const std::string_view name) const
+{
+    const auto& entry = get_range(this->keys_, key, 1).front();
+    const auto values = get_range(this->values_, entry.first_value, entry.value_count);
+
+    const auto value = std::ranges::lower_bound(
+        values, name, {}, [this](const value_entry& v) { return this->get_string(v.lookup_name); });
+
+    if (value == values.end() || this->get_string(value->lookup_name) != name)
+    {
+        return std::nullopt;
+    }
+
+    return registry_value{value->type, this->get_string(value->name), this->get_blob(value->data)};
+}
+
+std::optional<uint32_t> registry_snapshot::find_child(const uint32_t key, const std::string_view name) const
+{
+    const auto& entry = get_range(this->keys_, key, 1).front();
+    const auto children = get_range(this->keys_, entry.first_child, entry.child_count);
+
+    const auto child = std::ranges::lower_bound(children, name, {},
+                                                [this](const key_entry& k) { return this->get_string(k.name); });
+
+    if (child == children.end() || this->get_string(child->name) != name)
+    {
+        return std::nullopt;
+    }
+
+    return static_cast<uint32_t>(&*child - this->keys_.data());
+}
+
+std::span<const std::byte> registry_snapshot::get_blob(const blob_ref& ref) const
+{
+    if (ref.offset > this->blob_.size() || ref.size > this->blob_.size() - ref.offset)
+    {
+        throw std::runtime_error("Bad registry snapshot blob");
+    }
+
+    return this->blob_.subspan(static_cast<size_t>(ref.offset), static_cast<size_t>(ref.size));
+}
+
+std::string_view registry_snapshot::get_string(const blob_ref& ref) const
+{
+    const auto data = this->get_blob(ref);
+    return {reinterpret_cast<const char*>(data.data()), data.size()};
+}
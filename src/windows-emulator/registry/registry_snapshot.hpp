@@ -0,0 +1,100 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <string>
+#include <utility>
+
+#include <utils/mapped_file.hpp>
+
+#include "registry_hive.hpp"
+
+// Precompiled, read-only image of several hives that is used directly from a file mapping.
+//
+// Layout: header, hive table, key table, value table, blob. Keys are stored breadth first,
+// so the children of every key are contiguous and sorted by their lowercase name, values
+// are sorted the same way. Names and value data are interned in the blob.
+namespace registry_snapshot_format
+{
+    constexpr char MAGIC[4] = {'E', 'M', 'R', 'S'};
+    constexpr uint32_t VERSION = 1;
+
+    struct blob_ref
+    {
+        uint64_t offset;
+        uint64_t size;
+    };
+
+    struct header
+    {
+        char magic[4];
+        uint32_t version;
+        uint32_t hive_count;
+        uint32_t key_count;
+        uint32_t value_count;
+        uint32_t reserved;
+        uint64_t hives_offset;
+        uint64_t keys_offset;
+        uint64_t values_offset;
+        uint64_t blob_offset;
+        uint64_t blob_size;
+    };
+
+    struct hive_entry
+    {
+        blob_ref name;
+        uint32_t root_key;
+        uint32_t reserved;
+    };
+
+    struct key_entry
+    {
+        blob_ref name;
+        uint32_t first_child;
+        uint32_t child_count;
+        uint32_t first_value;
+        uint32_t value_count;
+    };
+
+    struct value_entry
+    {
+        blob_ref lookup_name;
+        blob_ref name;
+        blob_ref data;
+        uint32_t type;
+        uint32_t reserved;
+    };
+}
+
+class registry_snapshot
+{
+  public:
+    explicit registry_snapshot(const std::filesystem::path& file);
+
+    // Hive names are matched case-insensitively
+    static std::unique_ptr<registry_hive> open_hive(std::shared_ptr<const registry_snapshot> snapshot,
+                                                    std::string_view name);
+
+    // Converts hive files into a snapshot, each hive is stored under the given name
+    static void create(const std::filesystem::path& file,
+                       const std::vector<std::pair<std::string, std::filesystem::path>>& hives);
+
+    // Keys are referenced by their index, hives by the index of their root key
+    std::optional<uint32_t> find_hive(std::string_view name) const;
+    std::optional<uint32_t> find_key(uint32_t root_key, const std::filesystem::path& key) const;
+    std::optional<registry_value> get_value(uint32_t key, std::string_view name) const;
+
+  private:
+    utils::mapped_file file_{};
+
+    const registry_snapshot_format::header* header_{};
+    std::span<const registry_snapshot_format::hive_entry> hives_{};
+    std::span<const registry_snapshot_format::key_entry> keys_{};
+    std::span<const registry_snapshot_format::value_entry> values_{};
+    std::span<const std::byte> blob_{};
+
+    std::span<const std::byte> get_blob(const registry_snapshot_format::blob_ref& ref) const;
+    std::string_view get_string(const registry_snapshot_format::blob_ref& ref) const;
+
+    std::optional<uint32_t> find_child(uint32_t key, std::string_view name) const;
+};
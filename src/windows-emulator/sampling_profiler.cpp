@@ -0,0 +1,94 @@
+#include "std_include.hpp"
+#include "sampling_profiler.hpp"
+#include "stack_walk.hpp"
+#include "windows_emulator.hpp"
+
+sampling_profiler::sampling_profiler(windows_emulator& win_emu, const uint64_t interval, const size_t max_depth)
+    : win_emu_(&win_emu),
+      interval_(std::max(interval, static_cast<uint64_t>(1))),
+      countdown_(interval_),
+      max_depth_(max_depth)
+{
+    this->hook_ = win_emu.emu().hook_basic_block([this](const basic_block&) {
+        if (--this->countdown_ == 0)
+        {
+            this->countdown_ = this->interval_;
+            this->sample();
+        }
+    });
+}
+
+sampling_profiler::~sampling_profiler()
+{
+    this->win_emu_->emu().delete_hook(this->hook_);
+}
+
+void sampling_profiler::sample()
+{
+    auto& mod_manager = this->win_emu_->process().mod_manager;
+    const auto frames = walk_stack(this->win_emu_->emu(), mod_manager, this->max_depth_);
+
+    std::vector<uint64_t> stack{};
+    stack.reserve(frames.size());
+
+    for (const auto& frame : frames)
+    {
+        // Leaf functions have no unwind info, their samples are attributed to the exact address
+        const auto id = frame.function ? frame.function : frame.address;
+        this->name_frame(id, frame.address);
+        stack.push_back(id);
+    }
+
+    ++this->stacks_[std::move(stack)];
+    ++this->sample_count_;
+}
+
+void sampling_profiler::name_frame(const uint64_t frame, const uint64_t address)
+{
+    if (this->frame_names_.contains(frame))
+    {
+        return;
+    }
+
+    const auto* mod = this->win_emu_->process().mod_manager.find_by_address(address);
+    if (!mod)
+    {
+        char name[32]{};
+        snprintf(name, sizeof(name), "0x%" PRIx64, frame);
+        this->frame_names_[frame] = name;
+        return;
+    }
+
+    const auto* export_name = mod->find_export_name(frame);
+    if (export_name)
+    {
+        this->frame_names_[frame] = mod->name + "!" + *export_name;
+        return;
+    }
+
+    char offset[32]{};
+    snprintf(offset, sizeof(offset), "+0x%" PRIx64, frame - mod->image_base);
+    this->frame_names_[frame] = mod->name + offset;
+}
+
+std::string sampling_profiler::get_folded_stacks() const
+{
+    std::string folded{};
+
+    for (const auto& [stack, count] : this->stacks_)
+    {
+        for (auto i = stack.rbegin(); i != stack.rend(); ++i)
+        {
+            if (i != stack.rbegin())
+            {
+                folded.push_back(';');
+            }
+
+            folded += this->frame_names_.at(*i);
+        }
+
+        folded += " " + std::to_string(count) + "\n";
+    }
+
+    return folded;
+}
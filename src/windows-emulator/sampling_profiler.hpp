@@ -0,0 +1,46 @@
+#pragma once
+
+#include "std_include.hpp"
+
+#include <x64_emulator.hpp>
+
+class windows_emulator;
+
+// Samples the guest call stack every few executed blocks and aggregates the samples as folded stacks, the input
+// format of flame graph tools. Frames are named by module and export or function offset, as seen at sampling time.
+class sampling_profiler
+{
+  public:
+    sampling_profiler(windows_emulator& win_emu, uint64_t interval, size_t max_depth = 16);
+    ~sampling_profiler();
+
+    sampling_profiler(const sampling_profiler&) = delete;
+    sampling_profiler& operator=(const sampling_profiler&) = delete;
+    sampling_profiler(sampling_profiler&&) = delete;
+    sampling_profiler& operator=(sampling_profiler&&) = delete;
+
+    uint64_t get_sample_count() const
+    {
+        return this->sample_count_;
+    }
+
+    // One line per distinct stack, outermost frame first, followed by its sample count
+    std::string get_folded_stacks() const;
+
+  private:
+    windows_emulator* win_emu_{};
+    emulator_hook* hook_{};
+
+    uint64_t interval_{};
+    uint64_t countdown_{};
+    size_t max_depth_{};
+
+    uint64_t sample_count_{};
+
+    // Innermost frame first
+    std::map<std::vector<uint64_t>, uint64_t> stacks_{};
+    std::unordered_map<uint64_t, std::string> frame_names_{};
+
+    void sample();
+    void name_frame(uint64_t frame, uint64_t address);
+};
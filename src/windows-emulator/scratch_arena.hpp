@@ -0,0 +1,83 @@
+#pragma once
+
+#include "std_include.hpp"
+
+// Bump allocator for temporaries that live until the end of a syscall. Resetting keeps the blocks, so the
+// syscall path stops allocating once they have grown to the working set.
+class scratch_arena
+{
+  public:
+    std::span<std::byte> allocate(const size_t size, const size_t alignment = alignof(std::max_align_t))
+    {
+        while (this->current_ < this->blocks_.size())
+        {
+            auto& b = this->blocks_[this->current_];
+            const auto offset = (this->offset_ + alignment - 1) & ~(alignment - 1);
+
+            if (offset + size <= b.size)
+            {
+                this->offset_ = offset + size;
+                return {b.data.get() + offset, size};
+            }
+
+            ++this->current_;
+            this->offset_ = 0;
+        }
+
+        const auto block_size = std::max(BLOCK_SIZE, size + alignment);
+        this->blocks_.push_back({std::make_unique_for_overwrite<std::byte[]>(block_size), block_size});
+
+        return this->allocate(size, alignment);
+    }
+
+    template <typename T>
+        requires(std::is_trivially_copyable_v<T>)
+    std::span<T> allocate_array(const size_t count)
+    {
+        const auto memory = this->allocate(count * sizeof(T), alignof(T));
+        return {reinterpret_cast<T*>(memory.data()), count};
+    }
+
+    // Blocks beyond the retained size are released, one oversized request shouldn't be held forever. That
+    // includes the first block, so the ones that fit are kept in their order.
+    void reset()
+    {
+        size_t retained_size = 0;
+        size_t retained_blocks = 0;
+
+        for (size_t i = 0; i < this->blocks_.size(); ++i)
+        {
+            if (retained_size + this->blocks_[i].size > MAX_RETAINED_SIZE)
+            {
+                continue;
+            }
+
+            retained_size += this->blocks_[i].size;
+
+            if (i != retained_blocks)
+            {
+                this->blocks_[retained_blocks] = std::move(this->blocks_[i]);
+            }
+
+            ++retained_blocks;
+        }
+
+        this->blocks_.resize(retained_blocks);
+        this->current_ = 0;
+        this->offset_ = 0;
+    }
+
+  private:
+    static constexpr size_t BLOCK_SIZE = 0x10000;
+    static constexpr size_t MAX_RETAINED_SIZE = 0x400000;
+
+    struct block
+    {
+        std::unique_ptr<std::byte[]> data{};
+        size_t size{};
+    };
+
+    std::vector<block> blocks_{};
+    size_t current_{};
+    size_t offset_{};
+};
@@ -0,0 +1,502 @@
+#include "std_include.hpp"
+#include "socket_provider.hpp"
+#include "input_recorder.hpp"
+
+#include <serialization.hpp>
+
+#ifndef _WIN32
+#include <sys/uio.h>
+#endif
+
+namespace
+{
+    class host_socket : public emulated_socket
+    {
+      public:
+        host_socket(const SOCKET s)
+            : s_(s)
+        {
+        }
+
+        ~host_socket() override
+        {
+            closesocket(this->s_);
+        }
+
+        host_socket(const host_socket&) = delete;
+        host_socket& operator=(const host_socket&) = delete;
+
+        host_socket(host_socket&&) = delete;
+        host_socket& operator=(host_socket&&) = delete;
+
+        bool bind(const network::address& address) override
+        {
+            return ::bind(this->s_, &address.get_addr(), address.get_size()) != SOCKET_ERROR;
+        }
+
+        socket_transfer send_to(const network::address& target, const std::span<const std::byte> data) override
+        {
+            const auto sent_data = sendto(this->s_, reinterpret_cast<const char*>(data.data()),
+                                          static_cast<send_size>(data.size()), 0 /* ? */, &target.get_addr(),
+                                          target.get_size());
+
+            return get_transfer_result(sent_data);
+        }
+
+        socket_transfer receive_from(network::address& source, const std::span<std::byte> data) override
+        {
+            sockaddr_storage address{};
+            auto address_length = static_cast<socklen_t>(sizeof(address));
+
+            const auto received_data =
+                recvfrom(this->s_, reinterpret_cast<char*>(data.data()), static_cast<send_size>(data.size()), 0,
+                         reinterpret_cast<sockaddr*>(&address), &address_length);
+
+            const auto result = get_transfer_result(received_data);
+            if (result.status == socket_transfer_status::success)
+            {
+                source.set_address(reinterpret_cast<const sockaddr*>(&address), address_length);
+            }
+
+            return result;
+        }
+
+        socket_transfer send_to_buffers(const network::address& target,
+                                        const std::span<const std::span<const std::byte>> buffers) override
+        {
+#ifdef _WIN32
+            std::vector<WSABUF> vectors{};
+            vectors.reserve(buffers.size());
+
+            for (const auto& buffer : buffers)
+            {
+                vectors.push_back({static_cast<ULONG>(buffer.size()),
+                                   const_cast<char*>(reinterpret_cast<const char*>(buffer.data()))});
+            }
+
+            DWORD sent_data{};
+            const auto result = WSASendTo(this->s_, vectors.data(), static_cast<DWORD>(vectors.size()), &sent_data, 0,
+                                          &target.get_addr(), target.get_size(), nullptr, nullptr);
+
+            return get_transfer_result(result == SOCKET_ERROR ? -1 : static_cast<int64_t>(sent_data));
+#else
+            std::vector<iovec> vectors{};
+            vectors.reserve(buffers.size());
+
+            for (const auto& buffer : buffers)
+            {
+                vectors.push_back({const_cast<std::byte*>(buffer.data()), buffer.size()});
+            }
+
+            msghdr message{};
+            message.msg_name = const_cast<sockaddr*>(&target.get_addr());
+            message.msg_namelen = target.get_size();
+            message.msg_iov = vectors.data();
+            message.msg_iovlen = vectors.size();
+
+            return get_transfer_result(sendmsg(this->s_, &message, 0));
+#endif
+        }
+
+        socket_transfer receive_from_buffers(network::address& source,
+                                             const std::span<const std::span<std::byte>> buffers) override
+        {
+            sockaddr_storage address{};
+            auto address_length = static_cast<socklen_t>(sizeof(address));
+
+#ifdef _WIN32
+            std::vector<WSABUF> vectors{};
+            vectors.reserve(buffers.size());
+
+            for (const auto& buffer : buffers)
+            {
+                vectors.push_back({static_cast<ULONG>(buffer.size()), reinterpret_cast<char*>(buffer.data())});
+            }
+
+            DWORD received_data{};
+            DWORD flags{};
+            const auto received = WSARecvFrom(this->s_, vectors.data(), static_cast<DWORD>(vectors.size()),
+                                              &received_data, &flags, reinterpret_cast<sockaddr*>(&address),
+                                              &address_length, nullptr, nullptr);
+
+            const auto result =
+                get_transfer_result(received == SOCKET_ERROR ? -1 : static_cast<int64_t>(received_data));
+#else
+            std::vector<iovec> vectors{};
+            vectors.reserve(buffers.size());
+
+            for (const auto& buffer : buffers)
+            {
+                vectors.push_back({buffer.data(), buffer.size()});
+            }
+
+            msghdr message{};
+            message.msg_name = &address;
+            message.msg_namelen = address_length;
+            message.msg_iov = vectors.data();
+            message.msg_iovlen = vectors.size();
+
+            const auto result = get_transfer_result(recvmsg(this->s_, &message, 0));
+            address_length = message.msg_namelen;
+#endif
+
+            if (result.status == socket_transfer_status::success)
+            {
+                source.set_address(reinterpret_cast<const sockaddr*>(&address), address_length);
+            }
+
+            return result;
+        }
+
+        int16_t poll_events(const int16_t events) const override
+        {
+            pollfd pfd{};
+            pfd.fd = this->s_;
+            pfd.events = events;
+            pfd.revents = 0;
+
+            if (::poll(&pfd, 1, 0) <= 0)
+            {
+                return 0;
+            }
+
+            return pfd.revents;
+        }
+
+        std::optional<SOCKET> get_host_socket() const override
+        {
+            return this->s_;
+        }
+
+      private:
+        SOCKET s_{};
+
+        static socket_transfer get_transfer_result(const int64_t result)
+        {
+            if (result >= 0)
+            {
+                return {socket_transfer_status::success, static_cast<size_t>(result)};
+            }
+
+            if (GET_SOCKET_ERROR() == SOCK_WOULDBLOCK)
+            {
+                return {socket_transfer_status::would_block, 0};
+            }
+
+            return {socket_transfer_status::error, 0};
+        }
+    };
+
+    class host_socket_provider : public socket_provider
+    {
+      public:
+        host_socket_provider()
+        {
+            network::initialize_wsa();
+        }
+
+        std::unique_ptr<emulated_socket> create_socket(const int address_family, const int type,
+                                                       const int protocol) override
+        {
+            // TODO: values map to windows values; might not be the case for other platforms
+            const auto sock = ::socket(address_family, type, protocol);
+            if (sock == INVALID_SOCKET)
+            {
+                throw std::runtime_error("Failed to create socket!");
+            }
+
+            network::socket::set_blocking(sock, false);
+
+            return std::make_unique<host_socket>(sock);
+        }
+    };
+
+    class memory_socket : public emulated_socket
+    {
+      public:
+        memory_socket(std::shared_ptr<memory_socket_provider::handler> handler)
+            : handler_(std::move(handler))
+        {
+        }
+
+        bool bind(const network::address& /*address*/) override
+        {
+            return true;
+        }
+
+        socket_transfer send_to(const network::address& target, const std::span<const std::byte> data) override
+        {
+            datagram request{};
+            request.address = target;
+            request.data.assign(data.begin(), data.end());
+
+            for (auto& response : (*this->handler_)(request))
+            {
+                this->responses_.push_back(std::move(response));
+            }
+
+            return {socket_transfer_status::success, data.size()};
+        }
+
+        socket_transfer receive_from(network::address& source, const std::span<std::byte> data) override
+        {
+            if (this->responses_.empty())
+            {
+                return {socket_transfer_status::would_block, 0};
+            }
+
+            const auto response = std::move(this->responses_.front());
+            this->responses_.pop_front();
+
+            // Like recvfrom on datagram sockets, excess data is discarded
+            const auto size = std::min(data.size(), response.data.size());
+            std::copy_n(response.data.begin(), size, data.begin());
+
+            source = response.address;
+            return {socket_transfer_status::success, size};
+        }
+
+        int16_t poll_events(const int16_t events) const override
+        {
+            auto revents = static_cast<int16_t>(events & (POLLOUT | POLLWRNORM));
+
+            if (!this->responses_.empty())
+            {
+                revents = static_cast<int16_t>(revents | (events & (POLLIN | POLLRDNORM)));
+            }
+
+            return revents;
+        }
+
+        std::optional<SOCKET> get_host_socket() const override
+        {
+            return std::nullopt;
+        }
+
+      private:
+        std::shared_ptr<memory_socket_provider::handler> handler_{};
+        std::deque<datagram> responses_{};
+    };
+
+    // The live socket is only created while recording
+    class recording_socket : public emulated_socket
+    {
+      public:
+        recording_socket(std::unique_ptr<emulated_socket> live_socket, input_recorder& recorder)
+            : live_socket_(std::move(live_socket)),
+              recorder_(&recorder)
+        {
+        }
+
+        bool bind(const network::address& address) override
+        {
+            return this->recorder_->capture(recorded_input::socket_bind, [&] {
+                return this->live_socket_->bind(address) ? 1 : 0; //
+            }) != 0;
+        }
+
+        socket_transfer send_to(const network::address& target, const std::span<const std::byte> data) override
+        {
+            const auto result = this->recorder_->capture_data(recorded_input::socket_send, [&] {
+                return serialize_transfer(this->live_socket_->send_to(target, data)); //
+            });
+
+            utils::buffer_deserializer buffer(result);
+            return deserialize_transfer(buffer);
+        }
+
+        socket_transfer receive_from(network::address& source, const std::span<std::byte> data) override
+        {
+            const auto result = this->recorder_->capture_data(recorded_input::socket_receive, [&] {
+                network::address live_source{};
+                const auto transfer = this->live_socket_->receive_from(live_source, data);
+
+                utils::buffer_serializer buffer{};
+                buffer.write(transfer.status);
+                buffer.write(static_cast<uint64_t>(transfer.size));
+
+                if (transfer.status == socket_transfer_status::success)
+                {
+                    buffer.write(static_cast<uint32_t>(live_source.get_size()));
+                    buffer.write(&live_source.get_addr(), static_cast<size_t>(live_source.get_size()));
+                    buffer.write(data.data(), std::min(transfer.size, data.size()));
+                }
+
+                return buffer.move_buffer();
+            });
+
+            utils::buffer_deserializer buffer(result);
+            const auto transfer = deserialize_transfer(buffer);
+
+            if (transfer.status == socket_transfer_status::success)
+            {
+                const auto address_size = buffer.read<uint32_t>();
+                const auto address = buffer.read_data(address_size);
+                source.set_address(reinterpret_cast<const sockaddr*>(address.data()),
+                                   static_cast<socklen_t>(address_size));
+
+                const auto received = buffer.get_remaining_data();
+                std::copy_n(received.begin(), std::min(received.size(), data.size()), data.begin());
+            }
+
+            return transfer;
+        }
+
+        int16_t poll_events(const int16_t events) const override
+        {
+            return static_cast<int16_t>(this->recorder_->capture(recorded_input::socket_poll, [&] {
+                return static_cast<uint16_t>(this->live_socket_->poll_events(events)); //
+            }));
+        }
+
+        std::optional<SOCKET> get_host_socket() const override
+        {
+            return std::nullopt;
+        }
+
+      private:
+        std::unique_ptr<emulated_socket> live_socket_{};
+        input_recorder* recorder_{};
+
+        static std::vector<std::byte> serialize_transfer(const socket_transfer& transfer)
+        {
+            utils::buffer_serializer buffer{};
+            buffer.write(transfer.status);
+            buffer.write(static_cast<uint64_t>(transfer.size));
+            return buffer.move_buffer();
+        }
+
+        static socket_transfer deserialize_transfer(utils::buffer_deserializer& buffer)
+        {
+            socket_transfer transfer{};
+            buffer.read(transfer.status);
+            transfer.size = static_cast<size_t>(buffer.read<uint64_t>());
+            return transfer;
+        }
+    };
+
+    class recording_socket_provider : public socket_provider
+    {
+      public:
+        recording_socket_provider(std::shared_ptr<socket_provider> live_provider, input_recorder& recorder)
+            : live_provider_(std::move(live_provider)),
+              recorder_(&recorder)
+        {
+        }
+
+        std::unique_ptr<emulated_socket> create_socket(const int address_family, const int type,
+                                                       const int protocol) override
+        {
+            auto live_socket = this->recorder_->is_replaying()
+                                   ? nullptr
+                                   : this->live_provider_->create_socket(address_family, type, protocol);
+
+            return std::make_unique<recording_socket>(std::move(live_socket), *this->recorder_);
+        }
+
+      private:
+        std::shared_ptr<socket_provider> live_provider_{};
+        input_recorder* recorder_{};
+    };
+}
+
+socket_transfer emulated_socket::send_to_buffers(const network::address& target,
+                                                 const std::span<const std::span<const std::byte>> buffers)
+{
+    if (buffers.size() == 1)
+    {
+        return this->send_to(target, buffers.front());
+    }
+
+    std::vector<std::byte> data{};
+    for (const auto& buffer : buffers)
+    {
+        data.insert(data.end(), buffer.begin(), buffer.end());
+    }
+
+    return this->send_to(target, data);
+}
+
+socket_transfer emulated_socket::receive_from_buffers(network::address& source,
+                                                      const std::span<const std::span<std::byte>> buffers)
+{
+    if (buffers.size() == 1)
+    {
+        return this->receive_from(source, buffers.front());
+    }
+
+    size_t total_size = 0;
+    for (const auto& buffer : buffers)
+    {
+        total_size += buffer.size();
+    }
+
+    std::vector<std::byte> data(total_size);
+    const auto result = this->receive_from(source, data);
+
+    auto remaining = std::span(data).first(std::min(result.size, data.size()));
+    for (const auto& buffer : buffers)
+    {
+        const auto size = std::min(buffer.size(), remaining.size());
+        std::copy_n(remaining.begin(), size, buffer.begin());
+        remaining = remaining.subspan(size);
+    }
+
+    return result;
+}
+
+std::unique_ptr<socket_provider> create_host_socket_provider()
+{
+    return std::make_unique<host_socket_provider>();
+}
+
+memory_socket_provider::memory_socket_provider(handler request_handler)
+    : handler_(std::make_shared<handler>(std::move(request_handler)))
+{
+}
+
+std::unique_ptr<emulated_socket> memory_socket_provider::create_socket(const int /*address_family*/,
+                                                                       const int /*type*/, const int /*protocol*/)
+{
+    return std::make_unique<memory_socket>(this->handler_);
+}
+
+std::unique_ptr<memory_socket_provider> memory_socket_provider::create_replay(
+    std::vector<std::pair<datagram, datagram>> recording)
+{
+    return std::make_unique<memory_socket_provider>(
+        [recording = std::move(recording)](const datagram& request) -> std::vector<datagram> {
+            const datagram* fallback{};
+
+            for (const auto& [recorded_request, recorded_response] : recording)
+            {
+                if (recorded_request.address != request.address)
+                {
+                    continue;
+                }
+
+                if (recorded_request.data == request.data)
+                {
+                    return {recorded_response};
+                }
+
+                if (!fallback)
+                {
+                    fallback = &recorded_response;
+                }
+            }
+
+            if (fallback)
+            {
+                return {*fallback};
+            }
+
+            return {};
+        });
+}
+
+std::unique_ptr<socket_provider> create_recording_socket_provider(std::shared_ptr<socket_provider> live_provider,
+                                                                  input_recorder& recorder)
+{
+    return std::make_unique<recording_socket_provider>(std::move(live_provider), recorder);
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <network/socket.hpp>
+
+#include <span>
+#include <deque>
+#include <memory>
+#include <vector>
+#include <cstddef>
+#include <optional>
+#include <functional>
+
+enum class socket_transfer_status
+{
+    success,
+    would_block,
+    error,
+};
+
+struct socket_transfer
+{
+    socket_transfer_status status{socket_transfer_status::error};
+    size_t size{};
+};
+
+// Transport behind a guest AFD endpoint
+class emulated_socket
+{
+  public:
+    virtual ~emulated_socket() = default;
+
+    virtual bool bind(const network::address& address) = 0;
+
+    virtual socket_transfer send_to(const network::address& target, std::span<const std::byte> data) = 0;
+    virtual socket_transfer receive_from(network::address& source, std::span<std::byte> data) = 0;
+
+    // Scatter/gather variants for multiple buffers, e.g. views of guest memory.
+    // By default, they go through a single buffer and copy.
+    virtual socket_transfer send_to_buffers(const network::address& target,
+                                            std::span<const std::span<const std::byte>> buffers);
+    virtual socket_transfer receive_from_buffers(network::address& source,
+                                                 std::span<const std::span<std::byte>> buffers);
+
+    // Non-blocking poll for POLL* events
+    virtual int16_t poll_events(int16_t events) const = 0;
+
+    // Host socket to wait on, if data can arrive asynchronously
+    virtual std::optional<SOCKET> get_host_socket() const = 0;
+};
+
+class socket_provider
+{
+  public:
+    virtual ~socket_provider() = default;
+    virtual std::unique_ptr<emulated_socket> create_socket(int address_family, int type, int protocol) = 0;
+};
+
+std::unique_ptr<socket_provider> create_host_socket_provider();
+
+class input_recorder;
+
+// Records the result of every socket operation, or replays them without creating any socket.
+// Sockets never expose their host socket, so all readiness checks go through the recorded poll_events.
+std::unique_ptr<socket_provider> create_recording_socket_provider(std::shared_ptr<socket_provider> live_provider,
+                                                                  input_recorder& recorder);
+
+struct datagram
+{
+    network::address address{};
+    std::vector<std::byte> data{};
+};
+
+// Serves guest sockets entirely in-process without touching the host network.
+// Every sent datagram is passed to the handler, the returned datagrams are queued
+// as responses on the sending socket. Providers shared between emulators call the
+// handler concurrently.
+class memory_socket_provider : public socket_provider
+{
+  public:
+    using handler = std::function<std::vector<datagram>(const datagram& request)>;
+
+    memory_socket_provider(handler request_handler);
+
+    std::unique_ptr<emulated_socket> create_socket(int address_family, int type, int protocol) override;
+
+    // Answers each request with the recorded response of the same target and payload,
+    // falling back to the first response recorded for the target. Unknown targets are sinkholed.
+    static std::unique_ptr<memory_socket_provider> create_replay(std::vector<std::pair<datagram, datagram>> recording);
+
+  private:
+    std::shared_ptr<handler> handler_{};
+};
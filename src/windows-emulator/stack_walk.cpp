@@ -0,0 +1,287 @@
+#include "std_include.hpp"
+#include "stack_walk.hpp"
+
+#include "module/module_manager.hpp"
+
+namespace
+{
+    constexpr uint8_t UNW_FLAG_CHAININFO = 0x4;
+    constexpr size_t REGISTER_RSP = 4;
+    constexpr size_t MAX_CHAIN_DEPTH = 32;
+
+    enum unwind_operation : uint8_t
+    {
+        UWOP_PUSH_NONVOL = 0,
+        UWOP_ALLOC_LARGE = 1,
+        UWOP_ALLOC_SMALL = 2,
+        UWOP_SET_FPREG = 3,
+        UWOP_SAVE_NONVOL = 4,
+        UWOP_SAVE_NONVOL_FAR = 5,
+        UWOP_EPILOG = 6,
+        UWOP_SPARE_CODE = 7,
+        UWOP_SAVE_XMM128 = 8,
+        UWOP_SAVE_XMM128_FAR = 9,
+        UWOP_PUSH_MACHFRAME = 10,
+    };
+
+    struct unwind_context
+    {
+        uint64_t rip{};
+        // In the register order of the unwind codes, rax, rcx, rdx, rbx, rsp, rbp, rsi, rdi, r8 - r15
+        std::array<uint64_t, 16> registers{};
+
+        uint64_t& rsp()
+        {
+            return this->registers[REGISTER_RSP];
+        }
+    };
+
+    template <typename T>
+    std::optional<T> read(const x64_emulator& emu, const uint64_t address)
+    {
+        T value{};
+        if (!emu.try_read_memory(address, &value, sizeof(value)))
+        {
+            return std::nullopt;
+        }
+
+        return value;
+    }
+
+    size_t get_slot_count(const uint8_t operation, const uint8_t info)
+    {
+        switch (operation)
+        {
+        case UWOP_ALLOC_LARGE:
+            return info ? 3 : 2;
+        case UWOP_SAVE_NONVOL:
+        case UWOP_SAVE_XMM128:
+        case UWOP_EPILOG:
+            return 2;
+        case UWOP_SAVE_NONVOL_FAR:
+        case UWOP_SAVE_XMM128_FAR:
+        case UWOP_SPARE_CODE:
+            return 3;
+        default:
+            return 1;
+        }
+    }
+
+    // Reverts the prolog effects that happened up to the offset into the function.
+    // Returns the function the unwind info belongs to, the primary one for chained infos.
+    std::optional<uint64_t> apply_unwind_info(const x64_emulator& emu, unwind_context& context,
+                                              const uint64_t image_base, runtime_function function,
+                                              const uint64_t prolog_offset, bool& machine_frame)
+    {
+        auto offset = prolog_offset;
+
+        for (size_t chain_depth = 0; chain_depth < MAX_CHAIN_DEPTH; ++chain_depth)
+        {
+            const auto unwind_info = image_base + function.unwind_info;
+            const auto header = read<std::array<uint8_t, 4>>(emu, unwind_info);
+            if (!header)
+            {
+                return std::nullopt;
+            }
+
+            const auto flags = static_cast<uint8_t>((*header)[0] >> 3);
+            const auto code_count = (*header)[2];
+            const auto frame_register = static_cast<uint8_t>((*header)[3] & 0xF);
+            const auto frame_offset = static_cast<uint64_t>((*header)[3] >> 4) * 16;
+
+            std::vector<uint16_t> codes(code_count);
+            if (!emu.try_read_memory(unwind_info + 4, codes.data(), codes.size() * sizeof(uint16_t)))
+            {
+                return std::nullopt;
+            }
+
+            const auto get_slot = [&](const size_t index) -> uint64_t {
+                return index < codes.size() ? codes[index] : 0; //
+            };
+
+            for (size_t i = 0; i < codes.size();)
+            {
+                const auto code_offset = static_cast<uint8_t>(codes[i] & 0xFF);
+                const auto operation = static_cast<uint8_t>((codes[i] >> 8) & 0xF);
+                const auto info = static_cast<uint8_t>(codes[i] >> 12);
+
+                const auto slots = get_slot_count(operation, info);
+                const auto current = i;
+                i += slots;
+
+                if (code_offset > offset || operation == UWOP_EPILOG)
+                {
+                    continue;
+                }
+
+                auto& rsp = context.rsp();
+
+                switch (operation)
+                {
+                case UWOP_PUSH_NONVOL: {
+                    const auto value = read<uint64_t>(emu, rsp);
+                    if (!value)
+                    {
+                        return std::nullopt;
+                    }
+
+                    context.registers[info] = *value;
+                    rsp += sizeof(uint64_t);
+                    break;
+                }
+
+                case UWOP_ALLOC_LARGE:
+                    rsp += info ? (get_slot(current + 1) | (get_slot(current + 2) << 16))
+                                : get_slot(current + 1) * sizeof(uint64_t);
+                    break;
+
+                case UWOP_ALLOC_SMALL:
+                    rsp += (static_cast<uint64_t>(info) * sizeof(uint64_t)) + sizeof(uint64_t);
+                    break;
+
+                case UWOP_SET_FPREG:
+                    rsp = context.registers[frame_register] - frame_offset;
+                    break;
+
+                case UWOP_SAVE_NONVOL:
+                case UWOP_SAVE_NONVOL_FAR: {
+                    const auto save_offset = operation == UWOP_SAVE_NONVOL
+                                                 ? get_slot(current + 1) * sizeof(uint64_t)
+                                                 : get_slot(current + 1) | (get_slot(current + 2) << 16);
+
+                    const auto value = read<uint64_t>(emu, rsp + save_offset);
+                    if (!value)
+                    {
+                        return std::nullopt;
+                    }
+
+                    context.registers[info] = *value;
+                    break;
+                }
+
+                case UWOP_PUSH_MACHFRAME: {
+                    const auto frame = rsp + (info ? sizeof(uint64_t) : 0);
+                    const auto rip = read<uint64_t>(emu, frame);
+                    const auto previous_rsp = read<uint64_t>(emu, frame + 24);
+                    if (!rip || !previous_rsp)
+                    {
+                        return std::nullopt;
+                    }
+
+                    context.rip = *rip;
+                    rsp = *previous_rsp;
+                    machine_frame = true;
+                    break;
+                }
+
+                default:
+                    break;
+                }
+            }
+
+            if (!(flags & UNW_FLAG_CHAININFO))
+            {
+                return image_base + function.begin_address;
+            }
+
+            // The chained entry follows the codes, which are padded to an even count
+            const auto chained = read<runtime_function>(emu, unwind_info + 4 + (((code_count + 1) & ~1) * 2));
+            if (!chained)
+            {
+                return std::nullopt;
+            }
+
+            function = *chained;
+            offset = std::numeric_limits<uint64_t>::max();
+        }
+
+        return std::nullopt;
+    }
+
+    // Moves the context into the caller, returns the function of the current frame
+    std::optional<uint64_t> unwind_frame(const x64_emulator& emu, module_manager& modules, unwind_context& context,
+                                         const bool is_return_address)
+    {
+        std::optional<uint64_t> function_start{};
+        bool machine_frame = false;
+
+        // Return addresses may point past the end of a function that doesn't return
+        const auto lookup_address = is_return_address ? context.rip - 1 : context.rip;
+        const auto* mod = modules.find_by_address(lookup_address);
+
+        const auto* function = mod ? mod->find_runtime_function(lookup_address) : nullptr;
+
+        if (function)
+        {
+            const auto prolog_offset = lookup_address - mod->image_base - function->begin_address;
+            function_start =
+                apply_unwind_info(emu, context, mod->image_base, *function, prolog_offset, machine_frame);
+
+            if (!function_start)
+            {
+                return std::nullopt;
+            }
+        }
+
+        if (!machine_frame)
+        {
+            const auto return_address = read<uint64_t>(emu, context.rsp());
+            if (!return_address)
+            {
+                return std::nullopt;
+            }
+
+            context.rip = *return_address;
+            context.rsp() += sizeof(uint64_t);
+        }
+
+        return function_start.value_or(0);
+    }
+}
+
+std::vector<stack_frame> walk_stack(x64_emulator& emu, module_manager& modules, const size_t max_depth)
+{
+    unwind_context context{};
+    context.rip = emu.read_instruction_pointer();
+    context.registers = emu.read_registers(std::array{
+        x64_register::rax,
+        x64_register::rcx,
+        x64_register::rdx,
+        x64_register::rbx,
+        x64_register::rsp,
+        x64_register::rbp,
+        x64_register::rsi,
+        x64_register::rdi,
+        x64_register::r8,
+        x64_register::r9,
+        x64_register::r10,
+        x64_register::r11,
+        x64_register::r12,
+        x64_register::r13,
+        x64_register::r14,
+        x64_register::r15,
+    });
+
+    std::vector<stack_frame> frames{};
+
+    while (frames.size() < max_depth && context.rip)
+    {
+        const auto address = context.rip;
+        const auto stack_pointer = context.rsp();
+
+        const auto function = unwind_frame(emu, modules, context, !frames.empty());
+
+        frames.push_back({
+            .address = address,
+            .function = function.value_or(0),
+        });
+
+        // The stack only grows into the callers, anything else is a broken walk
+        if (!function || context.rsp() <= stack_pointer)
+        {
+            break;
+        }
+    }
+
+    return frames;
+}
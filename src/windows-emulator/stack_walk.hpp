@@ -0,0 +1,18 @@
+#pragma once
+
+#include "std_include.hpp"
+
+#include <x64_emulator.hpp>
+
+class module_manager;
+
+struct stack_frame
+{
+    uint64_t address{};
+    // Start of the function as described by the unwind info, 0 for leaf functions and code outside of modules
+    uint64_t function{};
+};
+
+// Walks the guest stack of the current thread through the .pdata unwind info of the loaded modules, innermost
+// frame first. Epilogs are unwound as if they were function bodies, so frames sampled there may be off.
+std::vector<stack_frame> walk_stack(x64_emulator& emu, module_manager& modules, size_t max_depth);
@@ -0,0 +1,172 @@
+#include "std_include.hpp"
+#include "state_diff.hpp"
+#include "windows_emulator.hpp"
+
+namespace
+{
+    template <typename F>
+    void for_each_handle(const process_context& process, const F& callback)
+    {
+        const auto visit = [&](const auto& store) {
+            for (const auto& entry : store)
+            {
+                callback(store.make_handle(entry.first), store.get_serial(entry.first));
+            }
+        };
+
+        visit(process.events);
+        visit(process.files);
+        visit(process.sections);
+        visit(process.devices);
+        visit(process.semaphores);
+        visit(process.ports);
+        visit(process.mutants);
+        visit(process.registry_keys);
+        visit(process.io_completions);
+        visit(process.threads);
+    }
+
+    std::map<uint64_t, uint64_t> collect_handles(const process_context& process)
+    {
+        std::map<uint64_t, uint64_t> handles{};
+        for_each_handle(process, [&](const handle h, const uint64_t serial) { handles[h.bits] = serial; });
+        return handles;
+    }
+
+    bool has_handle(const std::map<uint64_t, uint64_t>& handles, const uint64_t bits, const uint64_t serial)
+    {
+        const auto entry = handles.find(bits);
+        return entry != handles.end() && entry->second == serial;
+    }
+
+    bool is_same_module(const std::map<uint64_t, std::string>& modules, const uint64_t image_base,
+                        const std::string_view name)
+    {
+        const auto entry = modules.find(image_base);
+        return entry != modules.end() && entry->second == name;
+    }
+}
+
+state_diff::state_diff(windows_emulator& win_emu)
+    : win_emu_(&win_emu)
+{
+    this->file_subscription_ = win_emu.events().subscribe<file_write_event>([this](const file_write_event& e) {
+        this->written_files_.emplace(e.name); //
+    });
+
+    this->registry_subscription_ =
+        win_emu.events().subscribe<registry_key_open_event>([this](const registry_key_open_event& e) {
+            this->opened_registry_keys_.emplace(e.hive / e.path); //
+        });
+
+    this->reset();
+}
+
+state_diff::~state_diff()
+{
+    this->win_emu_->events().unsubscribe<file_write_event>(this->file_subscription_);
+    this->win_emu_->events().unsubscribe<registry_key_open_event>(this->registry_subscription_);
+    this->win_emu_->emu().stop_page_tracker(this->page_tracker_);
+}
+
+void state_diff::reset()
+{
+    auto& emu = this->win_emu_->emu();
+    const auto& process = this->win_emu_->process();
+
+    if (this->page_tracker_)
+    {
+        emu.stop_page_tracker(this->page_tracker_);
+    }
+
+    this->page_tracker_ = emu.start_page_tracker();
+    this->handles_ = collect_handles(process);
+    this->written_files_.clear();
+    this->opened_registry_keys_.clear();
+
+    this->modules_.clear();
+
+    for (const auto& [image_base, mod] : process.mod_manager.get_modules())
+    {
+        this->modules_[image_base] = mod.name;
+    }
+}
+
+std::vector<uint64_t> state_diff::get_changed_pages() const
+{
+    return this->win_emu_->emu().collect_tracked_pages(this->page_tracker_);
+}
+
+std::vector<handle> state_diff::get_new_handles() const
+{
+    std::vector<handle> handles{};
+
+    for_each_handle(this->win_emu_->process(), [&](const handle h, const uint64_t serial) {
+        if (!has_handle(this->handles_, h.bits, serial))
+        {
+            handles.push_back(h);
+        }
+    });
+
+    return handles;
+}
+
+std::vector<handle> state_diff::get_closed_handles() const
+{
+    const auto current_handles = collect_handles(this->win_emu_->process());
+
+    std::vector<handle> handles{};
+
+    for (const auto& [bits, serial] : this->handles_)
+    {
+        if (!has_handle(current_handles, bits, serial))
+        {
+            handles.push_back(make_handle(bits));
+        }
+    }
+
+    return handles;
+}
+
+std::vector<const mapped_module*> state_diff::get_new_modules() const
+{
+    std::vector<const mapped_module*> modules{};
+
+    for (const auto& [image_base, mod] : this->win_emu_->process().mod_manager.get_modules())
+    {
+        if (!is_same_module(this->modules_, image_base, mod.name))
+        {
+            modules.push_back(&mod);
+        }
+    }
+
+    return modules;
+}
+
+std::vector<std::string> state_diff::get_unloaded_modules() const
+{
+    const auto& current_modules = this->win_emu_->process().mod_manager.get_modules();
+
+    std::vector<std::string> modules{};
+
+    for (const auto& [image_base, name] : this->modules_)
+    {
+        const auto entry = current_modules.find(image_base);
+        if (entry == current_modules.end() || entry->second.name != name)
+        {
+            modules.push_back(name);
+        }
+    }
+
+    return modules;
+}
+
+std::vector<std::u16string> state_diff::get_written_files() const
+{
+    return {this->written_files_.begin(), this->written_files_.end()};
+}
+
+std::vector<std::filesystem::path> state_diff::get_opened_registry_keys() const
+{
+    return {this->opened_registry_keys_.begin(), this->opened_registry_keys_.end()};
+}
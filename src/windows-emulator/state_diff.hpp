@@ -0,0 +1,56 @@
+#pragma once
+
+#include "std_include.hpp"
+
+#include <serialization.hpp>
+
+#include "handles.hpp"
+#include "event_bus.hpp"
+
+class windows_emulator;
+struct mapped_module;
+
+// Differences between the state at construction, or the last reset, and the current state. Every category is
+// collected on its own without serializing anything. Pages count as changed once written or committed, even if
+// their contents are the same again. The emulated registry is read-only, its changes are the keys opened since.
+class state_diff
+{
+  public:
+    state_diff(windows_emulator& win_emu);
+    ~state_diff();
+
+    state_diff(const state_diff&) = delete;
+    state_diff& operator=(const state_diff&) = delete;
+    state_diff(state_diff&&) = delete;
+    state_diff& operator=(state_diff&&) = delete;
+
+    // Compares against the current state from now on
+    void reset();
+
+    std::vector<uint64_t> get_changed_pages() const;
+
+    // Handles that were closed and reused for new objects count as both
+    std::vector<handle> get_new_handles() const;
+    std::vector<handle> get_closed_handles() const;
+
+    std::vector<const mapped_module*> get_new_modules() const;
+    std::vector<std::string> get_unloaded_modules() const;
+
+    // Names as the guest opened them
+    std::vector<std::u16string> get_written_files() const;
+    // Including the keys that were closed again
+    std::vector<std::filesystem::path> get_opened_registry_keys() const;
+
+  private:
+    windows_emulator* win_emu_{};
+
+    uint64_t page_tracker_{};
+    event_subscription file_subscription_{};
+    event_subscription registry_subscription_{};
+
+    // Serials of the stored objects by handle
+    std::map<uint64_t, uint64_t> handles_{};
+    std::map<uint64_t, std::string> modules_{};
+    std::set<std::u16string> written_files_{};
+    std::set<std::filesystem::path> opened_registry_keys_{};
+};
@@ -1,5 +1,61 @@
 #include "syscall_dispatcher.hpp"
 #include "syscall_utils.hpp"
+#include "event_trace.hpp"
+
+#include <algorithm>
+
+#include <utils/finally.hpp>
+#include <utils/io.hpp>
+#include <page_store.hpp>
+
+namespace
+{
+    constexpr uint32_t SYSCALL_TABLE_VERSION = 1;
+    constexpr size_t IMAGE_HEADER_SIZE = 0x1000;
+
+    using syscall_table = std::map<uint64_t, std::string>;
+
+    // Tables by a hash of the image headers, whose timestamp, checksum and sections identify the build
+    struct syscall_table_cache
+    {
+        std::mutex mutex{};
+        std::map<page_hash, std::shared_ptr<const syscall_table>> tables{};
+        std::set<std::filesystem::path> loaded_files{};
+        bool has_new_tables{false};
+    };
+
+    syscall_table_cache& get_table_cache()
+    {
+        static syscall_table_cache cache{};
+        return cache;
+    }
+
+    std::shared_ptr<const syscall_table> get_syscall_table(const exported_symbols& exports,
+                                                           const std::span<const std::byte> data)
+    {
+        auto& cache = get_table_cache();
+        const auto key = hash_page(data.first(std::min(data.size(), IMAGE_HEADER_SIZE)));
+
+        {
+            std::lock_guard _{cache.mutex};
+
+            const auto entry = cache.tables.find(key);
+            if (entry != cache.tables.end())
+            {
+                return entry->second;
+            }
+        }
+
+        auto table = std::make_shared<const syscall_table>(find_syscalls(exports, data));
+
+        std::lock_guard _{cache.mutex};
+
+        const auto [entry, inserted] = cache.tables.try_emplace(key, std::move(table));
+        cache.has_new_tables |= inserted;
+
+        return entry->second;
+    }
+}
 
 static void serialize(utils::buffer_serializer& buffer, const syscall_handler_entry& obj)
 {
@@ -14,48 +70,158 @@ static void deserialize(utils::buffer_deserializer& buffer, syscall_handler_entr
 
 void syscall_dispatcher::serialize(utils::buffer_serializer& buffer) const
 {
-    buffer.write_map(this->handlers_);
+    buffer.write_vector(this->nt_handlers_);
+    buffer.write_vector(this->win32k_handlers_);
 }
 
 void syscall_dispatcher::deserialize(utils::buffer_deserializer& buffer)
 {
-    buffer.read_map(this->handlers_);
+    buffer.read_vector(this->nt_handlers_);
+    buffer.read_vector(this->win32k_handlers_);
     this->add_handlers();
 }
 
 void syscall_dispatcher::setup(const exported_symbols& ntdll_exports, std::span<const std::byte> ntdll_data,
                                const exported_symbols& win32u_exports, std::span<const std::byte> win32u_data)
 {
-    this->handlers_ = {};
+    this->nt_handlers_ = {};
+    this->win32k_handlers_ = {};
 
-    const auto ntdll_syscalls = find_syscalls(ntdll_exports, ntdll_data);
-    const auto win32u_syscalls = find_syscalls(win32u_exports, win32u_data);
+    const auto ntdll_syscalls = get_syscall_table(ntdll_exports, ntdll_data);
+    const auto win32u_syscalls = get_syscall_table(win32u_exports, win32u_data);
 
-    map_syscalls(this->handlers_, ntdll_syscalls);
-    map_syscalls(this->handlers_, win32u_syscalls);
+    this->add_syscalls(*ntdll_syscalls);
+    this->add_syscalls(*win32u_syscalls);
 
     this->add_handlers();
 }
 
-void syscall_dispatcher::add_handlers()
+void syscall_dispatcher::add_syscalls(const std::map<uint64_t, std::string>& syscalls)
+{
+    for (const auto& [id, name] : syscalls)
+    {
+        auto& table = id < WIN32K_SYSCALL_BASE ? this->nt_handlers_ : this->win32k_handlers_;
+        const auto index = static_cast<size_t>(id < WIN32K_SYSCALL_BASE ? id : id - WIN32K_SYSCALL_BASE);
+
+        if (index >= table.size())
+        {
+            table.resize(index + 1);
+        }
+
+        auto& entry = table[index];
+
+        if (!entry.name.empty())
+        {
+            throw std::runtime_error("Syscall with id " + std::to_string(id) + ", which is mapping to " + name +
+                                     ", was previously mapped to " + entry.name);
+        }
+
+        entry.name = name;
+        entry.handler = nullptr;
+    }
+}
+
+void syscall_dispatcher::load_syscall_tables(const std::filesystem::path& file)
 {
-    std::map<std::string, syscall_handler> handler_mapping{};
+    auto& cache = get_table_cache();
+    std::lock_guard _{cache.mutex};
 
-    syscall_dispatcher::add_handlers(handler_mapping);
+    if (!cache.loaded_files.insert(file).second)
+    {
+        return;
+    }
+
+    std::vector<uint8_t> data{};
+    if (!utils::io::read_file(file, &data))
+    {
+        return;
+    }
 
-    for (auto& entry : this->handlers_)
+    // Damaged or outdated files only cost the scans they would have saved
+    try
     {
-        const auto handler = handler_mapping.find(entry.second.name);
-        if (handler == handler_mapping.end())
+        utils::buffer_deserializer buffer{data};
+        if (buffer.read<uint32_t>() != SYSCALL_TABLE_VERSION)
         {
-            continue;
+            return;
         }
 
-        entry.second.handler = handler->second;
+        const auto count = buffer.read<uint64_t>();
+
+        for (uint64_t i = 0; i < count; ++i)
+        {
+            page_hash key{};
+            key.low = buffer.read<uint64_t>();
+            key.high = buffer.read<uint64_t>();
+
+            cache.tables.try_emplace(key, std::make_shared<const syscall_table>(buffer.read_map<syscall_table>()));
+        }
+    }
+    catch (const std::exception&)
+    {
+    }
+}
+
+bool syscall_dispatcher::save_syscall_tables(const std::filesystem::path& file)
+{
+    auto& cache = get_table_cache();
+    std::lock_guard _{cache.mutex};
+
+    if (!cache.has_new_tables && std::filesystem::exists(file))
+    {
+        return true;
+    }
+
+    utils::buffer_serializer buffer{};
+    buffer.write(SYSCALL_TABLE_VERSION);
+    buffer.write(static_cast<uint64_t>(cache.tables.size()));
+
+    for (const auto& [key, table] : cache.tables)
+    {
+        buffer.write(key.low);
+        buffer.write(key.high);
+        buffer.write_map(*table);
+    }
+
+    const auto& bytes = buffer.get_buffer();
+    const auto* begin = reinterpret_cast<const uint8_t*>(bytes.data());
+
+    if (!utils::io::write_file(file, std::vector<uint8_t>(begin, begin + bytes.size())))
+    {
+        return false;
+    }
+
+    cache.has_new_tables = false;
+    return true;
+}
+
+const std::map<std::string, syscall_handler>& syscall_dispatcher::get_handler_mapping()
+{
+    static const auto handler_mapping = [] {
+        std::map<std::string, syscall_handler> mapping{};
+        syscall_dispatcher::add_handlers(mapping);
+        return mapping;
+    }();
+
+    return handler_mapping;
+}
+
+void syscall_dispatcher::add_handlers()
+{
+    const auto& handler_mapping = get_handler_mapping();
+
+    for (auto* table : {&this->nt_handlers_, &this->win32k_handlers_})
+    {
+        for (auto& entry : *table)
+        {
+            if (entry.name.empty())
+            {
+                continue;
+            }
 
-#ifndef NDEBUG
-        handler_mapping.erase(handler);
-#endif
+            const auto handler = handler_mapping.find(entry.name);
+            entry.handler = handler == handler_mapping.end() ? nullptr : handler->second;
+        }
     }
 }
 
@@ -64,15 +230,45 @@ void syscall_dispatcher::dispatch(windows_emulator& win_emu)
     auto& emu = win_emu.emu();
     auto& context = win_emu.process();
 
-    const auto address = emu.read_instruction_pointer();
-    const auto syscall_id = emu.reg<uint32_t>(x64_register::eax);
+    const auto registers = syscall_registers::read(emu);
+    const auto address = registers.rip;
+    const auto syscall_id = static_cast<uint32_t>(registers.rax);
+
+    const syscall_context c{win_emu, emu, context, true, false, registers, this->scratch_};
+    const auto _ = utils::finally([this] { this->scratch_.reset(); });
 
-    const syscall_context c{win_emu, emu, context, true};
+    // Every published enter gets its exit, also when the handler throws
+    std::optional<std::string_view> entered_syscall{};
+
+    const auto publish_exit = [&] {
+        if (!entered_syscall)
+        {
+            return;
+        }
+
+        const auto name = *entered_syscall;
+        entered_syscall.reset();
+
+        win_emu.events().publish<syscall_exit_event>([&] {
+            return syscall_exit_event{
+                .address = address,
+                .id = syscall_id,
+                .name = name,
+                .status = static_cast<NTSTATUS>(emu.reg<uint64_t>(x64_register::rax)),
+            };
+        });
+    };
 
     try
     {
-        const auto entry = this->handlers_.find(syscall_id);
-        if (entry == this->handlers_.end())
+        auto* entry = this->find_entry(syscall_id);
+
+        if (auto* trace = win_emu.trace())
+        {
+            trace->log_syscall(address, syscall_id, entry ? std::string_view{entry->name} : std::string_view{});
+        }
+
+        if (!entry)
         {
             printf("Unknown syscall: 0x%X\n", syscall_id);
             c.emu.reg<uint64_t>(x64_register::rax, STATUS_NOT_SUPPORTED);
@@ -80,59 +276,166 @@ void syscall_dispatcher::dispatch(windows_emulator& win_emu)
             return;
         }
 
-        if (!entry->second.handler)
+        if (!entry->handler)
         {
-            printf("Unimplemented syscall: %s - 0x%X\n", entry->second.name.c_str(), syscall_id);
+            printf("Unimplemented syscall: %s - 0x%X\n", entry->name.c_str(), syscall_id);
             c.emu.reg<uint64_t>(x64_register::rax, STATUS_NOT_SUPPORTED);
             c.emu.stop();
             return;
         }
 
-        const auto* mod = context.mod_manager.find_by_address(address);
-        if (mod != context.ntdll && mod != context.win32u)
+        // Debug messages can only be enabled if info messages are
+        if (EMU_LOG_ENABLED(win_emu.log, syscall, info))
         {
-            win_emu.log.print(color::blue, "Executing inline syscall: %s (0x%X) at 0x%" PRIx64 " (%s)\n",
-                              entry->second.name.c_str(), syscall_id, address, mod ? mod->name.c_str() : "<N/A>");
-        }
-        else
-        {
-            if (mod->is_within(context.previous_ip))
+            const auto* mod = context.mod_manager.find_by_address(address);
+            if (mod != context.ntdll && mod != context.win32u)
             {
-                const auto rsp = c.emu.read_stack_pointer();
-                const auto return_address = c.emu.read_memory<uint64_t>(rsp);
-                const auto* mod_name = context.mod_manager.find_name(return_address);
-
-                win_emu.log.print(color::dark_gray,
-                                  "Executing syscall: %s (0x%X) at 0x%" PRIx64 " via 0x%" PRIx64 " (%s)\n",
-                                  entry->second.name.c_str(), syscall_id, address, return_address, mod_name);
+                win_emu.log.print(log_category::syscall, log_level::info, color::blue,
+                                  "Executing inline syscall: %s (0x%X) at 0x%" PRIx64 " (%s)\n", entry->name.c_str(),
+                                  syscall_id, address, mod ? mod->name.c_str() : "<N/A>");
             }
-            else
+            else if (!mod->is_within(context.previous_ip))
             {
                 const auto* previous_mod = context.mod_manager.find_by_address(context.previous_ip);
-                win_emu.log.print(color::blue,
+                win_emu.log.print(log_category::syscall, log_level::info, color::blue,
                                   "Crafted out-of-line syscall: %s (0x%X) at 0x%" PRIx64 " (%s) via 0x%" PRIx64
                                   " (%s)\n",
-                                  entry->second.name.c_str(), syscall_id, address, mod ? mod->name.c_str() : "<N/A>",
+                                  entry->name.c_str(), syscall_id, address, mod ? mod->name.c_str() : "<N/A>",
                                   context.previous_ip, previous_mod ? previous_mod->name.c_str() : "<N/A>");
             }
+            else if (EMU_LOG_ENABLED(win_emu.log, syscall, debug))
+            {
+                const auto return_address = c.emu.read_memory<uint64_t>(registers.rsp);
+                const auto* mod_name = context.mod_manager.find_name(return_address);
+
+                win_emu.log.print(log_category::syscall, log_level::debug, color::dark_gray,
+                                  "Executing syscall: %s (0x%X) at 0x%" PRIx64 " via 0x%" PRIx64 " (%s)\n",
+                                  entry->name.c_str(), syscall_id, address, return_address, mod_name);
+            }
+        }
+
+        if (context.kusd.is_memory_backed())
+        {
+            context.kusd.refresh();
+        }
+
+        win_emu.events().publish<syscall_enter_event>([&] {
+            return syscall_enter_event{.address = address, .id = syscall_id, .name = entry->name}; //
+        });
+
+        entered_syscall = entry->name;
+
+        if (!this->profiling_)
+        {
+            entry->handler(c);
+            publish_exit();
+            return;
         }
 
-        entry->second.handler(c);
+        auto& statistics = entry->statistics;
+        const auto instructions = context.executed_instructions;
+
+        ++statistics.calls;
+        statistics.instructions_since_previous_syscall += instructions - this->last_syscall_instructions_;
+        this->last_syscall_instructions_ = instructions;
+
+        const auto start = std::chrono::steady_clock::now();
+        entry->handler(c);
+        const auto duration =
+            std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+
+        statistics.total_time += duration;
+        statistics.max_time = std::max(statistics.max_time, duration);
+
+        publish_exit();
     }
     catch (std::exception& e)
     {
         printf("Syscall threw an exception: %X (0x%" PRIx64 ") - %s\n", syscall_id, address, e.what());
         emu.reg<uint64_t>(x64_register::rax, STATUS_UNSUCCESSFUL);
         emu.stop();
+        publish_exit();
     }
     catch (...)
     {
         printf("Syscall threw an unknown exception: %X (0x%" PRIx64 ")\n", syscall_id, address);
         emu.reg<uint64_t>(x64_register::rax, STATUS_UNSUCCESSFUL);
         emu.stop();
+        publish_exit();
     }
 }
 
+std::vector<std::pair<uint64_t, const syscall_handler_entry*>> syscall_dispatcher::get_profiled_entries() const
+{
+    std::vector<std::pair<uint64_t, const syscall_handler_entry*>> entries{};
+
+    for (size_t i = 0; i < this->nt_handlers_.size(); ++i)
+    {
+        if (this->nt_handlers_[i].statistics.calls)
+        {
+            entries.emplace_back(i, &this->nt_handlers_[i]);
+        }
+    }
+
+    for (size_t i = 0; i < this->win32k_handlers_.size(); ++i)
+    {
+        if (this->win32k_handlers_[i].statistics.calls)
+        {
+            entries.emplace_back(WIN32K_SYSCALL_BASE + i, &this->win32k_handlers_[i]);
+        }
+    }
+
+    std::ranges::sort(entries, [](const auto& a, const auto& b) {
+        return a.second->statistics.total_time > b.second->statistics.total_time;
+    });
+
+    return entries;
+}
+
+std::string syscall_dispatcher::get_profile_json() const
+{
+    std::string json = "[\n";
+
+    const auto entries = this->get_profiled_entries();
+    for (size_t i = 0; i < entries.size(); ++i)
+    {
+        const auto& [id, entry] = entries[i];
+        const auto& statistics = entry->statistics;
+
+        char line[512]{};
+        snprintf(line, sizeof(line),
+                 "  {\"id\": %" PRIu64 ", \"name\": \"%s\", \"calls\": %" PRIu64 ", \"total_ns\": %lld, "
+                 "\"max_ns\": %lld, \"instructions_between_calls\": %" PRIu64 "}%s\n",
+                 id, entry->name.c_str(), statistics.calls, static_cast<long long>(statistics.total_time.count()),
+                 static_cast<long long>(statistics.max_time.count()), statistics.instructions_since_previous_syscall,
+                 i + 1 < entries.size() ? "," : "");
+
+        json += line;
+    }
+
+    json += "]\n";
+    return json;
+}
+
+std::string syscall_dispatcher::get_profile_csv() const
+{
+    std::string csv = "id,name,calls,total_ns,max_ns,instructions_between_calls\n";
+
+    for (const auto& [id, entry] : this->get_profiled_entries())
+    {
+        const auto& statistics = entry->statistics;
+
+        char line[512]{};
+        snprintf(line, sizeof(line), "%" PRIu64 ",%s,%" PRIu64 ",%lld,%lld,%" PRIu64 "\n", id, entry->name.c_str(),
+                 statistics.calls, static_cast<long long>(statistics.total_time.count()),
+                 static_cast<long long>(statistics.max_time.count()), statistics.instructions_since_previous_syscall);
+
+        csv += line;
+    }
+
+    return csv;
+}
+
 syscall_dispatcher::syscall_dispatcher(const exported_symbols& ntdll_exports, std::span<const std::byte> ntdll_data,
                                        const exported_symbols& win32u_exports, std::span<const std::byte> win32u_data)
 {
@@ -1,14 +1,24 @@
 #pragma once
 
 #include "process_context.hpp"
+#include "scratch_arena.hpp"
 
 struct syscall_context;
 using syscall_handler = void (*)(const syscall_context& c);
 
+struct syscall_statistics
+{
+    uint64_t calls{};
+    std::chrono::nanoseconds total_time{};
+    std::chrono::nanoseconds max_time{};
+    uint64_t instructions_since_previous_syscall{};
+};
+
 struct syscall_handler_entry
 {
     syscall_handler handler{};
     std::string name{};
+    syscall_statistics statistics{};
 };
 
 class windows_emulator;
@@ -25,17 +35,96 @@ class syscall_dispatcher
     void serialize(utils::buffer_serializer& buffer) const;
     void deserialize(utils::buffer_deserializer& buffer);
 
+    // The ids found in the stubs are cached per ntdll and win32u build and shared by all instances of the process
     void setup(const exported_symbols& ntdll_exports, std::span<const std::byte> ntdll_data,
                const exported_symbols& win32u_exports, std::span<const std::byte> win32u_data);
 
-    std::string get_syscall_name(const uint64_t id)
+    // Files hold the cached tables of every build seen so far. Each file is loaded once per process, saving only
+    // writes it if it's missing or tables were added since.
+    static void load_syscall_tables(const std::filesystem::path& file);
+    static bool save_syscall_tables(const std::filesystem::path& file);
+
+    void enable_profiling(const bool enabled = true)
+    {
+        this->profiling_ = enabled;
+    }
+
+    bool is_profiling() const
+    {
+        return this->profiling_;
+    }
+
+    std::string get_profile_json() const;
+    std::string get_profile_csv() const;
+
+    std::string get_syscall_name(const uint64_t id) const
+    {
+        const auto* entry = this->find_entry(id);
+        if (!entry)
+        {
+            throw std::out_of_range("Unknown syscall: " + std::to_string(id));
+        }
+
+        return entry->name;
+    }
+
+    std::optional<uint64_t> find_syscall_id(const std::string_view name) const
     {
-        return this->handlers_.at(id).name;
+        for (size_t i = 0; i < this->nt_handlers_.size(); ++i)
+        {
+            if (this->nt_handlers_[i].name == name)
+            {
+                return i;
+            }
+        }
+
+        for (size_t i = 0; i < this->win32k_handlers_.size(); ++i)
+        {
+            if (this->win32k_handlers_[i].name == name)
+            {
+                return WIN32K_SYSCALL_BASE + i;
+            }
+        }
+
+        return std::nullopt;
     }
 
   private:
-    std::map<uint64_t, syscall_handler_entry> handlers_{};
+    static constexpr uint64_t WIN32K_SYSCALL_BASE = 0x1000;
+
+    // Directly indexed by syscall id, NT syscalls start at 0 and win32k syscalls at WIN32K_SYSCALL_BASE
+    std::vector<syscall_handler_entry> nt_handlers_{};
+    std::vector<syscall_handler_entry> win32k_handlers_{};
+
+    bool profiling_{false};
+    uint64_t last_syscall_instructions_{0};
+
+    // Temporaries of the handlers, reset after every syscall
+    scratch_arena scratch_{};
+
+    const syscall_handler_entry* find_entry(const uint64_t id) const
+    {
+        const auto& table = id < WIN32K_SYSCALL_BASE ? this->nt_handlers_ : this->win32k_handlers_;
+        const auto index = id < WIN32K_SYSCALL_BASE ? id : id - WIN32K_SYSCALL_BASE;
+
+        if (index >= table.size() || table[index].name.empty())
+        {
+            return nullptr;
+        }
+
+        return &table[index];
+    }
+
+    syscall_handler_entry* find_entry(const uint64_t id)
+    {
+        return const_cast<syscall_handler_entry*>(std::as_const(*this).find_entry(id));
+    }
+
+    std::vector<std::pair<uint64_t, const syscall_handler_entry*>> get_profiled_entries() const;
 
     static void add_handlers(std::map<std::string, syscall_handler>& handler_mapping);
+    static const std::map<std::string, syscall_handler>& get_handler_mapping();
+
+    void add_syscalls(const std::map<uint64_t, std::string>& syscalls);
     void add_handlers();
 };
@@ -1,8 +1,34 @@
 #pragma once
 
 #include "windows_emulator.hpp"
+#include "scratch_arena.hpp"
 #include <ctime>
 
+// Registers every syscall needs on entry, read with a single backend call
+struct syscall_registers
+{
+    uint64_t rip{};
+    uint64_t rax{};
+    uint64_t rsp{};
+    // r10, rdx, r8 and r9
+    std::array<uint64_t, 4> arguments{};
+
+    static syscall_registers read(x64_emulator& emu)
+    {
+        const auto values = emu.read_registers(std::array{
+            x64_register::rip, x64_register::rax, x64_register::rsp, x64_register::r10, //
+            x64_register::rdx, x64_register::r8, x64_register::r9,                     //
+        });
+
+        return {
+            .rip = values[0],
+            .rax = values[1],
+            .rsp = values[2],
+            .arguments = {values[3], values[4], values[5], values[6]},
+        };
+    }
+};
+
 struct syscall_context
 {
     windows_emulator& win_emu;
@@ -10,23 +36,80 @@ struct syscall_context
     process_context& proc;
     mutable bool write_status{true};
     mutable bool retrigger_syscall{false};
+    syscall_registers registers{};
+    // Reset once the handler returns
+    scratch_arena& scratch;
 };
 
-inline uint64_t get_syscall_argument(x64_emulator& emu, const size_t index)
+// Raw values of the first Count arguments, all stack arguments are fetched with a single memory read
+template <size_t Count>
+std::array<uint64_t, Count> get_syscall_arguments(const syscall_context& c)
 {
-    switch (index)
+    constexpr auto register_count = std::tuple_size_v<decltype(c.registers.arguments)>;
+
+    std::array<uint64_t, Count> arguments{};
+    std::copy_n(c.registers.arguments.begin(), std::min(Count, register_count), arguments.begin());
+
+    if constexpr (Count > register_count)
     {
-    case 0:
-        return emu.reg(x64_register::r10);
-    case 1:
-        return emu.reg(x64_register::rdx);
-    case 2:
-        return emu.reg(x64_register::r8);
-    case 3:
-        return emu.reg(x64_register::r9);
-    default:
-        return emu.read_stack(index + 1);
+        // Stack arguments follow the return address and the home space of the register arguments
+        constexpr auto stack_offset = (register_count + 1) * sizeof(uint64_t);
+        c.emu.read_memory(c.registers.rsp + stack_offset, arguments.data() + register_count,
+                          (Count - register_count) * sizeof(uint64_t));
     }
+
+    return arguments;
+}
+
+// Guest memory straight from a host view if the range is backed by one, otherwise copied into the scratch arena.
+// Either way, it's only valid until the syscall returns.
+inline std::span<const std::byte> read_scratch_memory(const syscall_context& c, const uint64_t address,
+                                                      const size_t size)
+{
+    const auto view = c.emu.get_readable_view(address, size);
+    if (view.size() == size)
+    {
+        return view;
+    }
+
+    const auto buffer = c.scratch.allocate(size);
+    c.emu.read_memory(address, buffer.data(), buffer.size());
+    return buffer;
+}
+
+inline std::span<std::byte> allocate_scratch_memory(const syscall_context& c, const size_t size)
+{
+    const auto buffer = c.scratch.allocate(size);
+    std::ranges::fill(buffer, std::byte{});
+    return buffer;
+}
+
+inline std::u16string_view read_scratch_unicode_string(const syscall_context& c,
+                                                       const UNICODE_STRING<EmulatorTraits<Emu64>> ucs)
+{
+    const auto length = static_cast<size_t>(ucs.Length / 2);
+    const auto data = read_scratch_memory(c, ucs.Buffer, length * sizeof(char16_t));
+
+    if (reinterpret_cast<uintptr_t>(data.data()) % alignof(char16_t) == 0)
+    {
+        return {reinterpret_cast<const char16_t*>(data.data()), length};
+    }
+
+    const auto string = c.scratch.allocate_array<char16_t>(length);
+    memcpy(string.data(), data.data(), data.size());
+    return {string.data(), string.size()};
+}
+
+inline std::u16string_view read_scratch_object_name(const syscall_context& c,
+                                                    const OBJECT_ATTRIBUTES<EmulatorTraits<Emu64>>& attributes)
+{
+    if (!attributes.ObjectName)
+    {
+        return {};
+    }
+
+    const auto ucs = c.emu.read_memory<UNICODE_STRING<EmulatorTraits<Emu64>>>(attributes.ObjectName);
+    return read_scratch_unicode_string(c, ucs);
 }
 
 inline bool is_uppercase(const char character)
@@ -89,52 +172,27 @@ inline std::map<uint64_t, std::string> find_syscalls(const exported_symbols& exp
     return syscalls;
 }
 
-inline void map_syscalls(std::map<uint64_t, syscall_handler_entry>& handlers, std::map<uint64_t, std::string> syscalls)
-{
-    for (auto& [id, name] : syscalls)
-    {
-        auto& entry = handlers[id];
-
-        if (!entry.name.empty())
-        {
-            throw std::runtime_error("Syscall with id " + std::to_string(id) + ", which is mapping to " + name +
-                                     ", was previously mapped to " + entry.name);
-        }
-
-        entry.name = std::move(name);
-        entry.handler = nullptr;
-    }
-}
-
 template <typename T>
     requires(std::is_integral_v<T> || std::is_enum_v<T>)
-T resolve_argument(x64_emulator& emu, const size_t index)
+T resolve_argument(const syscall_context&, const uint64_t arg)
 {
-    const auto arg = get_syscall_argument(emu, index);
     return static_cast<T>(arg);
 }
 
 template <typename T>
     requires(std::is_same_v<std::remove_cvref_t<T>, handle>)
-handle resolve_argument(x64_emulator& emu, const size_t index)
+handle resolve_argument(const syscall_context&, const uint64_t arg)
 {
     handle h{};
-    h.bits = resolve_argument<uint64_t>(emu, index);
+    h.bits = arg;
     return h;
 }
 
 template <typename T>
     requires(std::is_same_v<T, emulator_object<typename T::value_type>>)
-T resolve_argument(x64_emulator& emu, const size_t index)
+T resolve_argument(const syscall_context& c, const uint64_t arg)
 {
-    const auto arg = get_syscall_argument(emu, index);
-    return T(emu, arg);
-}
-
-template <typename T>
-T resolve_indexed_argument(x64_emulator& emu, size_t& index)
-{
-    return resolve_argument<T>(emu, index++);
+    return T(c.emu, arg);
 }
 
 inline void write_status(const syscall_context& c, const NTSTATUS status, const uint64_t initial_ip)
@@ -153,7 +211,7 @@ inline void write_status(const syscall_context& c, const NTSTATUS status, const
 
 inline void forward_syscall(const syscall_context& c, NTSTATUS (*handler)())
 {
-    const auto ip = c.emu.read_instruction_pointer();
+    const auto ip = c.registers.rip;
 
     const auto ret = handler();
     write_status(c, ret, ip);
@@ -162,15 +220,13 @@ inline void forward_syscall(const syscall_context& c, NTSTATUS (*handler)())
 template <typename... Args>
 void forward_syscall(const syscall_context& c, NTSTATUS (*handler)(const syscall_context&, Args...))
 {
-    const auto ip = c.emu.read_instruction_pointer();
-
-    size_t index = 0;
-    std::tuple<const syscall_context&, Args...> func_args{
-        c, resolve_indexed_argument<std::remove_cv_t<std::remove_reference_t<Args>>>(c.emu, index)...};
+    const auto ip = c.registers.rip;
+    const auto arguments = get_syscall_arguments<sizeof...(Args)>(c);
 
-    (void)index;
+    const auto ret = [&]<size_t... Indices>(std::index_sequence<Indices...>) {
+        return handler(c, resolve_argument<std::remove_cv_t<std::remove_reference_t<Args>>>(c, arguments[Indices])...);
+    }(std::index_sequence_for<Args...>{});
 
-    const auto ret = std::apply(handler, std::move(func_args));
     write_status(c, ret, ip);
 }
 
@@ -198,7 +254,8 @@ constexpr auto HUNDRED_NANOSECONDS_IN_ONE_SECOND = 10000000LL;
 constexpr auto EPOCH_DIFFERENCE_1601_TO_1970_SECONDS = 11644473600LL;
 constexpr auto WINDOWS_EPOCH_DIFFERENCE = EPOCH_DIFFERENCE_1601_TO_1970_SECONDS * HUNDRED_NANOSECONDS_IN_ONE_SECOND;
 
-inline std::chrono::steady_clock::time_point convert_delay_interval_to_time_point(const LARGE_INTEGER delay_interval)
+inline std::chrono::steady_clock::time_point convert_delay_interval_to_time_point(const emulator_clock& clock,
+                                                                                 const LARGE_INTEGER delay_interval)
 {
     if (delay_interval.QuadPart <= 0)
     {
@@ -208,7 +265,7 @@ inline std::chrono::steady_clock::time_point convert_delay_interval_to_time_poin
         const auto relative_duration =
             std::chrono::microseconds(relative_ticks_in_ms) + std::chrono::nanoseconds(relative_fraction_ns);
 
-        return std::chrono::steady_clock::now() + relative_duration;
+        return clock.steady_now() + relative_duration;
     }
 
     const auto delay_seconds_since_1601 = delay_interval.QuadPart / HUNDRED_NANOSECONDS_IN_ONE_SECOND;
@@ -219,11 +276,11 @@ inline std::chrono::steady_clock::time_point convert_delay_interval_to_time_poin
     const auto target_time =
         std::chrono::system_clock::from_time_t(delay_seconds_since_1970) + std::chrono::nanoseconds(delay_fraction_ns);
 
-    const auto now_system = std::chrono::system_clock::now();
+    const auto now_system = clock.system_now();
 
     const auto duration_until_target = std::chrono::duration_cast<std::chrono::microseconds>(target_time - now_system);
 
-    return std::chrono::steady_clock::now() + duration_until_target;
+    return clock.steady_now() + duration_until_target;
 }
 
 inline KSYSTEM_TIME convert_to_ksystem_time(const std::chrono::system_clock::time_point& tp)
@@ -25,14 +25,7 @@ namespace
             if (performance_counter)
             {
                 performance_counter.access([&](LARGE_INTEGER& value) {
-                    if (c.win_emu.time_is_relative())
-                    {
-                        value.QuadPart = static_cast<LONGLONG>(c.proc.executed_instructions);
-                    }
-                    else
-                    {
-                        value.QuadPart = std::chrono::steady_clock::now().time_since_epoch().count();
-                    }
+                    value.QuadPart = static_cast<LONGLONG>(c.proc.clock.performance_counter()); //
                 });
             }
 
@@ -80,7 +73,7 @@ namespace
             key = full_path.u16string();
         }
 
-        c.win_emu.log.print(color::dark_gray, "--> Registry key: %s\n", u16_to_u8(key).c_str());
+        EMU_LOG(c.win_emu.log, syscall, debug, dark_gray, "--> Registry key: %s\n", u16_to_u8(key).c_str());
 
         auto entry = c.proc.registry.get_key(key);
         if (!entry.has_value())
@@ -88,6 +81,10 @@ namespace
             return STATUS_OBJECT_NAME_NOT_FOUND;
         }
 
+        c.win_emu.events().publish<registry_key_open_event>([&] {
+            return registry_key_open_event{.hive = entry->hive, .path = entry->path}; //
+        });
+
         const auto handle = c.proc.registry_keys.store(std::move(entry.value()));
         key_handle.write(handle);
 
@@ -114,13 +111,14 @@ namespace
 
         if (key_information_class == KeyNameInformation)
         {
-            auto key_name = (key->hive / key->path).wstring();
-            while (key_name.ends_with('/') || key_name.ends_with('\\'))
+            // UTF-16 like the guest expects, wchar_t is wider on some hosts
+            auto key_name = (key->hive / key->path).u16string();
+            while (key_name.ends_with(u'/') || key_name.ends_with(u'\\'))
             {
                 key_name.pop_back();
             }
 
-            std::ranges::transform(key_name, key_name.begin(), std::towupper);
+            std::ranges::transform(key_name, key_name.begin(), utils::string::char_to_upper);
 
             const auto required_size = sizeof(KEY_NAME_INFORMATION) + (key_name.size() * 2) - 1;
             result_length.write(static_cast<ULONG>(required_size));
@@ -183,15 +181,20 @@ namespace
             return STATUS_INVALID_HANDLE;
         }
 
-        const auto query_name = read_unicode_string(c.emu, value_name);
+        const auto query_name = access_unicode_string(c.emu, value_name.read(), [](const std::u16string_view name) {
+            return u16_to_u8(name); //
+        });
 
-        const auto value = c.proc.registry.get_value(*key, u16_to_u8(query_name));
+        const auto value = c.proc.registry.get_value(*key, query_name);
         if (!value)
         {
             return STATUS_OBJECT_NAME_NOT_FOUND;
         }
 
-        const std::wstring original_name(value->name.begin(), value->name.end());
+        // Hives store value names as Latin-1
+        const auto original_name = c.scratch.allocate_array<char16_t>(value->name.size());
+        std::ranges::transform(value->name, original_name.begin(),
+                               [](const char ch) { return static_cast<char16_t>(static_cast<unsigned char>(ch)); });
 
         if (key_value_information_class == KeyValueBasicInformation)
         {
@@ -325,8 +328,8 @@ namespace
             const auto i = info.read();
             thread->name = read_unicode_string(c.emu, i.ThreadName);
 
-            c.win_emu.log.print(color::blue, "Setting thread (%d) name: %s\n", thread->id,
-                                u16_to_u8(thread->name).c_str());
+            EMU_LOG(c.win_emu.log, thread, info, blue, "Setting thread (%d) name: %s\n", thread->id,
+                    u16_to_u8(thread->name).c_str());
 
             return STATUS_SUCCESS;
         }
@@ -380,6 +383,7 @@ namespace
         }
 
         entry->signaled = true;
+        c.proc.signal_waiters();
         return STATUS_SUCCESS;
     }
 
@@ -405,6 +409,8 @@ namespace
             return &proc.ports;
         case handle_types::section:
             return &proc.sections;
+        case handle_types::io_completion:
+            return &proc.io_completions;
         default:
             return nullptr;
         }
@@ -418,9 +424,22 @@ namespace
             return STATUS_SUCCESS;
         }
 
+        // Views keep the memory of closed sections alive
+        const auto* s = c.proc.sections.get(h);
+        const auto section_memory = s ? s->memory_id : 0;
+
         auto* handle_store = get_handle_store(c.proc, h);
         if (handle_store && handle_store->erase(h))
         {
+            c.proc.object_names.remove(h);
+            c.proc.io_completion_associations.erase(h.bits);
+            ++c.proc.process_data_modifications;
+
+            if (section_memory)
+            {
+                c.emu.release_section_memory(section_memory);
+            }
+
             return STATUS_SUCCESS;
         }
 
@@ -449,6 +468,7 @@ namespace
         }
 
         const auto old_count = mutant->release();
+        c.proc.signal_waiters();
 
         if (previous_count)
         {
@@ -474,15 +494,9 @@ namespace
             }
         }
 
-        if (!name.empty())
+        if (!name.empty() && c.proc.object_names.find(handle_types::mutant, name))
         {
-            for (const auto& mutant : c.proc.mutants)
-            {
-                if (mutant.second.name == name)
-                {
-                    return STATUS_OBJECT_NAME_EXISTS;
-                }
-            }
+            return STATUS_OBJECT_NAME_EXISTS;
         }
 
         mutant e{};
@@ -494,11 +508,33 @@ namespace
         }
 
         const auto handle = c.proc.mutants.store(std::move(e));
+        c.proc.object_names.add(handle, c.proc.mutants.get(handle)->name);
         mutant_handle.write(handle);
 
         return STATUS_SUCCESS;
     }
 
+    NTSTATUS handle_NtOpenMutant(const syscall_context& c, const emulator_object<handle> mutant_handle,
+                                 const ACCESS_MASK /*desired_access*/,
+                                 const emulator_object<OBJECT_ATTRIBUTES<EmulatorTraits<Emu64>>> object_attributes)
+    {
+        const auto attributes = object_attributes.read();
+        const emulator_object<UNICODE_STRING<EmulatorTraits<Emu64>>> object_name{c.emu, attributes.ObjectName};
+
+        return access_unicode_string(c.emu, object_name.read(), [&](const std::u16string_view name) {
+            const auto h = c.proc.object_names.find(handle_types::mutant, name);
+            auto* m = h ? c.proc.mutants.get(*h) : nullptr;
+            if (!m)
+            {
+                return STATUS_OBJECT_NAME_NOT_FOUND;
+            }
+
+            ++m->ref_count;
+            mutant_handle.write(*h);
+            return STATUS_SUCCESS;
+        });
+    }
+
     NTSTATUS handle_NtCreateEvent(const syscall_context& c, const emulator_object<handle> event_handle,
                                   const ACCESS_MASK /*desired_access*/,
                                   const emulator_object<OBJECT_ATTRIBUTES<EmulatorTraits<Emu64>>> object_attributes,
@@ -515,15 +551,9 @@ namespace
             }
         }
 
-        if (!name.empty())
+        if (!name.empty() && c.proc.object_names.find(handle_types::event, name))
         {
-            for (const auto& event : c.proc.events)
-            {
-                if (event.second.name == name)
-                {
-                    return STATUS_OBJECT_NAME_EXISTS;
-                }
-            }
+            return STATUS_OBJECT_NAME_EXISTS;
         }
 
         event e{};
@@ -532,6 +562,7 @@ namespace
         e.name = std::move(name);
 
         const auto handle = c.proc.events.store(std::move(e));
+        c.proc.object_names.add(handle, c.proc.events.get(handle)->name);
         event_handle.write(handle);
 
         static_assert(sizeof(EVENT_TYPE) == sizeof(uint32_t));
@@ -545,20 +576,20 @@ namespace
                                 const emulator_object<OBJECT_ATTRIBUTES<EmulatorTraits<Emu64>>> object_attributes)
     {
         const auto attributes = object_attributes.read();
-        const auto name =
-            read_unicode_string(c.emu, reinterpret_cast<UNICODE_STRING<EmulatorTraits<Emu64>>*>(attributes.ObjectName));
+        const emulator_object<UNICODE_STRING<EmulatorTraits<Emu64>>> object_name{c.emu, attributes.ObjectName};
 
-        for (auto& entry : c.proc.events)
-        {
-            if (entry.second.name == name)
+        return access_unicode_string(c.emu, object_name.read(), [&](const std::u16string_view name) {
+            const auto h = c.proc.object_names.find(handle_types::event, name);
+            auto* e = h ? c.proc.events.get(*h) : nullptr;
+            if (!e)
             {
-                ++entry.second.ref_count;
-                event_handle.write(c.proc.events.make_handle(entry.first).bits);
-                return STATUS_SUCCESS;
+                return STATUS_NOT_FOUND;
             }
-        }
 
-        return STATUS_NOT_FOUND;
+            ++e->ref_count;
+            event_handle.write(h->bits);
+            return STATUS_SUCCESS;
+        });
     }
 
     NTSTATUS handle_NtQueryVolumeInformationFile(const syscall_context& c, const handle file_handle,
@@ -596,9 +627,8 @@ namespace
     {
         const auto attributes = object_attributes.read();
 
-        auto filename =
-            read_unicode_string(c.emu, reinterpret_cast<UNICODE_STRING<EmulatorTraits<Emu64>>*>(attributes.ObjectName));
-        c.win_emu.log.print(color::dark_gray, "--> Opening section: %s\n", u16_to_u8(filename).c_str());
+        const auto filename = read_scratch_object_name(c, attributes);
+        EMU_LOG(c.win_emu.log, syscall, debug, dark_gray, "--> Opening section: %s\n", u16_to_u8(filename).c_str());
 
         if (filename == u"\\Windows\\SharedSection")
         {
@@ -613,18 +643,15 @@ namespace
             return STATUS_NOT_SUPPORTED;
         }
 
-        utils::string::to_lower_inplace(filename);
-
-        for (auto& section_entry : c.proc.sections)
+        const auto h = c.proc.object_names.find(handle_types::section, filename);
+        const auto* s = h ? c.proc.sections.get(*h) : nullptr;
+        if (!s || !s->is_image())
         {
-            if (section_entry.second.is_image() && section_entry.second.name == filename)
-            {
-                section_handle.write(c.proc.sections.make_handle(section_entry.first));
-                return STATUS_SUCCESS;
-            }
+            return STATUS_OBJECT_NAME_NOT_FOUND;
         }
 
-        return STATUS_OBJECT_NAME_NOT_FOUND;
+        section_handle.write(*h);
+        return STATUS_SUCCESS;
     }
 
     NTSTATUS handle_NtMapViewOfSection(
@@ -705,7 +732,7 @@ namespace
                 return STATUS_FILE_INVALID;
             }
 
-            std::u16string wide_name(binary->name.begin(), binary->name.end());
+            auto wide_name = u8_to_u16(binary->name);
             section_entry->name = utils::string::to_lower_consume(wide_name);
 
             if (view_size.value())
@@ -718,23 +745,44 @@ namespace
             return STATUS_SUCCESS;
         }
 
-        uint64_t size = section_entry->maximum_size;
-        std::vector<uint8_t> file_data{};
+        // All views map the same memory, the file is only read for the first one
+        utils::mapped_file file_data{};
 
-        if (!section_entry->file_name.empty())
+        if (!section_entry->memory_id)
         {
-            if (!utils::io::read_file(section_entry->file_name, &file_data))
+            uint64_t size = section_entry->maximum_size;
+
+            if (!section_entry->file_name.empty())
             {
-                return STATUS_INVALID_PARAMETER;
+                try
+                {
+                    file_data = utils::mapped_file(section_entry->file_name, utils::mapped_file::access::read);
+                }
+                catch (...)
+                {
+                    return STATUS_INVALID_PARAMETER;
+                }
+
+                size = page_align_up(file_data.size());
             }
 
-            size = page_align_up(file_data.size());
+            section_entry->memory_id = c.emu.create_section_memory(static_cast<size_t>(size));
+            if (!section_entry->memory_id)
+            {
+                return STATUS_NO_MEMORY;
+            }
         }
 
+        const auto size = c.emu.get_section_memory_size(section_entry->memory_id);
         const auto protection = map_nt_to_emulator_protection(section_entry->section_page_protection);
-        const auto address = c.emu.allocate_memory(size, protection);
 
-        if (!file_data.empty())
+        const auto address = c.emu.find_free_allocation_base(size);
+        if (!address || !c.emu.map_section_view(address, section_entry->memory_id, protection))
+        {
+            return STATUS_NO_MEMORY;
+        }
+
+        if (file_data)
         {
             c.emu.write_memory(address, file_data.data(), file_data.size());
         }
@@ -749,11 +797,125 @@ namespace
     }
 
     NTSTATUS handle_NtCreateIoCompletion(
-        const syscall_context& c, const emulator_object<handle> event_handle, const ACCESS_MASK desired_access,
+        const syscall_context& c, const emulator_object<handle> io_completion_handle,
+        const ACCESS_MASK /*desired_access*/,
         const emulator_object<OBJECT_ATTRIBUTES<EmulatorTraits<Emu64>>> object_attributes,
         const uint32_t /*number_of_concurrent_threads*/)
     {
-        return handle_NtCreateEvent(c, event_handle, desired_access, object_attributes, NotificationEvent, FALSE);
+        io_completion_port port{};
+
+        if (object_attributes)
+        {
+            const auto attributes = object_attributes.read();
+            if (attributes.ObjectName)
+            {
+                port.name = read_unicode_string(
+                    c.emu, reinterpret_cast<UNICODE_STRING<EmulatorTraits<Emu64>>*>(attributes.ObjectName));
+            }
+        }
+
+        const auto handle = c.proc.io_completions.store(std::move(port));
+        io_completion_handle.write(handle);
+
+        return STATUS_SUCCESS;
+    }
+
+    NTSTATUS handle_NtSetIoCompletion(const syscall_context& c, const handle io_completion_handle,
+                                      const uint64_t key_context, const uint64_t apc_context, const NTSTATUS io_status,
+                                      const uint64_t io_status_information)
+    {
+        auto* port = c.proc.io_completions.get(io_completion_handle);
+        if (!port)
+        {
+            return STATUS_INVALID_HANDLE;
+        }
+
+        port->packets.push_back({
+            .key_context = key_context,
+            .apc_context = apc_context,
+            .status = io_status,
+            .information = io_status_information,
+        });
+
+        c.proc.signal_waiters();
+
+        return STATUS_SUCCESS;
+    }
+
+    NTSTATUS handle_NtSetIoCompletionEx(const syscall_context& c, const handle io_completion_handle,
+                                        const handle /*io_completion_packet_handle*/, const uint64_t key_context,
+                                        const uint64_t apc_context, const NTSTATUS io_status,
+                                        const uint64_t io_status_information)
+    {
+        return handle_NtSetIoCompletion(c, io_completion_handle, key_context, apc_context, io_status,
+                                        io_status_information);
+    }
+
+    // Blocks the thread until a packet is queued, it is removed when the thread becomes ready
+    NTSTATUS remove_io_completion(const syscall_context& c, const io_completion_wait& wait,
+                                  const emulator_object<LARGE_INTEGER> timeout)
+    {
+        auto* port = c.proc.io_completions.get(wait.port);
+        if (!port)
+        {
+            return STATUS_INVALID_HANDLE;
+        }
+
+        if (port->remove_packets(c.emu, wait))
+        {
+            return STATUS_SUCCESS;
+        }
+
+        if (timeout && timeout.read().QuadPart == 0)
+        {
+            return STATUS_TIMEOUT;
+        }
+
+        auto& t = c.win_emu.current_thread();
+        t.completion_wait = wait;
+
+        if (timeout)
+        {
+            t.await_time = convert_delay_interval_to_time_point(c.proc.clock, timeout.read());
+        }
+
+        c.win_emu.yield_thread();
+        return STATUS_SUCCESS;
+    }
+
+    NTSTATUS handle_NtRemoveIoCompletion(const syscall_context& c, const handle io_completion_handle,
+                                         const uint64_t key_context, const uint64_t apc_context,
+                                         const uint64_t io_status_block, const emulator_object<LARGE_INTEGER> timeout)
+    {
+        io_completion_wait wait{};
+        wait.port = io_completion_handle;
+        wait.key_context = key_context;
+        wait.apc_context = apc_context;
+        wait.io_status_block = io_status_block;
+
+        return remove_io_completion(c, wait, timeout);
+    }
+
+    NTSTATUS handle_NtRemoveIoCompletionEx(const syscall_context& c, const handle io_completion_handle,
+                                           const uint64_t io_completion_information, const ULONG count,
+                                           const emulator_object<ULONG> num_entries_removed,
+                                           const emulator_object<LARGE_INTEGER> timeout, const BOOLEAN /*alertable*/)
+    {
+        if (!count)
+        {
+            return STATUS_INVALID_PARAMETER;
+        }
+
+        num_entries_removed.write_if_valid(0);
+
+        io_completion_wait wait{};
+        wait.port = io_completion_handle;
+        wait.extended = true;
+        wait.entries = io_completion_information;
+        wait.max_entries = count;
+        wait.removed_count = num_entries_removed.value();
+
+        return remove_io_completion(c, wait, timeout);
     }
 
     NTSTATUS handle_NtCreateWaitCompletionPacket(
@@ -879,162 +1041,99 @@ namespace
         return STATUS_NOT_SUPPORTED;
     }
 
-    NTSTATUS handle_NtQuerySystemInformation(const syscall_context& c, const uint32_t info_class,
-                                             const uint64_t system_information,
-                                             const uint32_t system_information_length,
-                                             const emulator_object<uint32_t> return_length)
+    template <typename T>
+    std::vector<std::byte> to_system_information(const T& info)
     {
-        if (info_class == SystemFlushInformation || info_class == SystemHypervisorSharedPageInformation ||
-            info_class == 250 // Build 27744
-        )
-        {
-            return STATUS_NOT_SUPPORTED;
-        }
-
-        if (info_class == SystemTimeOfDayInformation)
-        {
-            if (return_length)
-            {
-                return_length.write(sizeof(SYSTEM_TIMEOFDAY_INFORMATION64));
-            }
+        std::vector<std::byte> data(sizeof(T));
+        memcpy(data.data(), &info, sizeof(T));
+        return data;
+    }
 
-            if (system_information_length != sizeof(SYSTEM_TIMEOFDAY_INFORMATION64))
-            {
-                return STATUS_BUFFER_TOO_SMALL;
-            }
+    // Responses of the info classes that never change, they are built once and written with a single copy
+    const std::vector<std::byte>* get_static_system_information(const uint32_t info_class)
+    {
+        static const auto responses = [] {
+            std::map<uint32_t, std::vector<std::byte>> result{};
 
-            const emulator_object<SYSTEM_TIMEOFDAY_INFORMATION64> info_obj{c.emu, system_information};
+            // TODO: Fill
+            result[SystemTimeOfDayInformation] = to_system_information(SYSTEM_TIMEOFDAY_INFORMATION64{});
 
-            info_obj.access([&](SYSTEM_TIMEOFDAY_INFORMATION64& info) {
-                info.BootTime.QuadPart = 0;
-                // TODO: Fill
-            });
+            SYSTEM_RANGE_START_INFORMATION64 range_start{};
+            range_start.SystemRangeStart = 0xFFFF800000000000;
+            result[SystemRangeStartInformation] = to_system_information(range_start);
 
-            return STATUS_SUCCESS;
-        }
+            SYSTEM_PROCESSOR_INFORMATION64 processor{};
+            processor.MaximumProcessors = 2;
+            processor.ProcessorArchitecture = PROCESSOR_ARCHITECTURE_AMD64;
+            result[SystemProcessorInformation] = to_system_information(processor);
 
-        if (info_class == SystemRangeStartInformation)
-        {
-            if (return_length)
-            {
-                return_length.write(sizeof(SYSTEM_RANGE_START_INFORMATION64));
-            }
+            SYSTEM_NUMA_INFORMATION64 numa{};
+            numa.ActiveProcessorsGroupAffinity->Mask = 0xFFF;
+            numa.AvailableMemory[0] = 0xFFF;
+            numa.Pad[0] = 0xFFF;
+            result[SystemNumaProcessorMap] = to_system_information(numa);
 
-            if (system_information_length != sizeof(SYSTEM_RANGE_START_INFORMATION64))
-            {
-                return STATUS_BUFFER_TOO_SMALL;
-            }
+            result[SystemErrorPortTimeouts] = to_system_information(SYSTEM_ERROR_PORT_TIMEOUTS{});
 
-            const emulator_object<SYSTEM_RANGE_START_INFORMATION64> info_obj{c.emu, system_information};
+            SYSTEM_BASIC_INFORMATION64 basic_info{};
+            basic_info.TimerResolution = 0x0002625a;
+            basic_info.PageSize = 0x1000;
+            basic_info.LowestPhysicalPageNumber = 0x00000001;
+            basic_info.HighestPhysicalPageNumber = 0x00c9c7ff;
+            basic_info.AllocationGranularity = 0x10000;
+            basic_info.MinimumUserModeAddress = 0x0000000000010000;
+            basic_info.MaximumUserModeAddress = 0x00007ffffffeffff;
+            basic_info.ActiveProcessorsAffinityMask = 0x0000000000000fff;
+            basic_info.NumberOfProcessors = 1;
+            result[SystemBasicInformation] = to_system_information(basic_info);
+            result[SystemEmulationBasicInformation] = result[SystemBasicInformation];
 
-            info_obj.access(
-                [&](SYSTEM_RANGE_START_INFORMATION64& info) { info.SystemRangeStart = 0xFFFF800000000000; });
+            return result;
+        }();
 
-            return STATUS_SUCCESS;
-        }
+        const auto entry = responses.find(info_class);
+        return entry != responses.end() ? &entry->second : nullptr;
+    }
 
-        if (info_class == SystemProcessorInformation)
+    NTSTATUS write_system_information(const syscall_context& c, const std::vector<std::byte>& response,
+                                      const uint64_t system_information, const uint32_t system_information_length,
+                                      const emulator_object<uint32_t> return_length)
+    {
+        if (return_length)
         {
-            if (return_length)
-            {
-                return_length.write(sizeof(SYSTEM_PROCESSOR_INFORMATION64));
-            }
-
-            if (system_information_length != sizeof(SYSTEM_PROCESSOR_INFORMATION64))
-            {
-                return STATUS_BUFFER_TOO_SMALL;
-            }
-
-            const emulator_object<SYSTEM_PROCESSOR_INFORMATION64> info_obj{c.emu, system_information};
-
-            info_obj.access([&](SYSTEM_PROCESSOR_INFORMATION64& info) {
-                memset(&info, 0, sizeof(info));
-                info.MaximumProcessors = 2;
-                info.ProcessorArchitecture = PROCESSOR_ARCHITECTURE_AMD64;
-            });
-
-            return STATUS_SUCCESS;
+            return_length.write(static_cast<uint32_t>(response.size()));
         }
 
-        if (info_class == SystemNumaProcessorMap)
+        if (system_information_length != response.size())
         {
-            if (return_length)
-            {
-                return_length.write(sizeof(SYSTEM_NUMA_INFORMATION64));
-            }
-
-            if (system_information_length != sizeof(SYSTEM_NUMA_INFORMATION64))
-            {
-                return STATUS_BUFFER_TOO_SMALL;
-            }
-
-            const emulator_object<SYSTEM_NUMA_INFORMATION64> info_obj{c.emu, system_information};
-
-            info_obj.access([&](SYSTEM_NUMA_INFORMATION64& info) {
-                memset(&info, 0, sizeof(info));
-                info.ActiveProcessorsGroupAffinity->Mask = 0xFFF;
-                info.AvailableMemory[0] = 0xFFF;
-                info.Pad[0] = 0xFFF;
-            });
-
-            return STATUS_SUCCESS;
+            return STATUS_BUFFER_TOO_SMALL;
         }
 
-        if (info_class == SystemErrorPortTimeouts)
-        {
-            if (return_length)
-            {
-                return_length.write(sizeof(SYSTEM_ERROR_PORT_TIMEOUTS));
-            }
-
-            if (system_information_length != sizeof(SYSTEM_ERROR_PORT_TIMEOUTS))
-            {
-                return STATUS_BUFFER_TOO_SMALL;
-            }
-
-            const emulator_object<SYSTEM_ERROR_PORT_TIMEOUTS> info_obj{c.emu, system_information};
-
-            info_obj.access([&](SYSTEM_ERROR_PORT_TIMEOUTS& info) {
-                info.StartTimeout = 0;
-                info.CommTimeout = 0;
-            });
-
-            return STATUS_SUCCESS;
-        }
+        c.emu.write_memory(system_information, response.data(), response.size());
+        return STATUS_SUCCESS;
+    }
 
-        if (info_class != SystemBasicInformation && info_class != SystemEmulationBasicInformation)
+    NTSTATUS handle_NtQuerySystemInformation(const syscall_context& c, const uint32_t info_class,
+                                             const uint64_t system_information,
+                                             const uint32_t system_information_length,
+                                             const emulator_object<uint32_t> return_length)
+    {
+        if (info_class == SystemFlushInformation || info_class == SystemHypervisorSharedPageInformation ||
+            info_class == 250 // Build 27744
+        )
         {
-            printf("Unsupported system info class: %X\n", info_class);
-            c.emu.stop();
             return STATUS_NOT_SUPPORTED;
         }
 
-        if (return_length)
+        if (const auto* response = get_static_system_information(info_class))
         {
-            return_length.write(sizeof(SYSTEM_BASIC_INFORMATION64));
+            return write_system_information(c, *response, system_information, system_information_length,
+                                            return_length);
         }
 
-        if (system_information_length != sizeof(SYSTEM_BASIC_INFORMATION64))
-        {
-            return STATUS_BUFFER_TOO_SMALL;
-        }
-
-        const emulator_object<SYSTEM_BASIC_INFORMATION64> info{c.emu, system_information};
-
-        info.access([&](SYSTEM_BASIC_INFORMATION64& basic_info) {
-            basic_info.Reserved = 0;
-            basic_info.TimerResolution = 0x0002625a;
-            basic_info.PageSize = 0x1000;
-            basic_info.LowestPhysicalPageNumber = 0x00000001;
-            basic_info.HighestPhysicalPageNumber = 0x00c9c7ff;
-            basic_info.AllocationGranularity = 0x10000;
-            basic_info.MinimumUserModeAddress = 0x0000000000010000;
-            basic_info.MaximumUserModeAddress = 0x00007ffffffeffff;
-            basic_info.ActiveProcessorsAffinityMask = 0x0000000000000fff;
-            basic_info.NumberOfProcessors = 1;
-        });
-
-        return STATUS_SUCCESS;
+        printf("Unsupported system info class: %X\n", info_class);
+        c.emu.stop();
+        return STATUS_NOT_SUPPORTED;
     }
 
     NTSTATUS handle_NtDuplicateObject(const syscall_context& /*c*/, const handle source_process_handle,
@@ -1073,8 +1172,8 @@ namespace
 
         if (info_class == SystemLogicalProcessorAndGroupInformation)
         {
-            void* buffer = calloc(1, input_buffer_length);
-            void* res_buff = calloc(1, system_information_length);
+            auto* buffer = allocate_scratch_memory(c, input_buffer_length).data();
+            auto* res_buff = allocate_scratch_memory(c, system_information_length).data();
             c.emu.read_memory(input_buffer, buffer, input_buffer_length);
 
             NTSTATUS code = STATUS_SUCCESS;
@@ -1096,45 +1195,18 @@ namespace
                 c.emu.write_memory(system_information, res_buff, return_length.read());
             }
 
-            free(buffer);
-            free(res_buff);
-
             return code;
         }
 
-        if (info_class != SystemBasicInformation && info_class != SystemEmulationBasicInformation)
+        if (info_class == SystemBasicInformation || info_class == SystemEmulationBasicInformation)
         {
-            printf("Unsupported system info ex class: %X\n", info_class);
-            c.emu.stop();
-            return STATUS_NOT_SUPPORTED;
+            return write_system_information(c, *get_static_system_information(info_class), system_information,
+                                            system_information_length, return_length);
         }
 
-        if (return_length)
-        {
-            return_length.write(sizeof(SYSTEM_BASIC_INFORMATION64));
-        }
-
-        if (system_information_length != sizeof(SYSTEM_BASIC_INFORMATION64))
-        {
-            return STATUS_BUFFER_TOO_SMALL;
-        }
-
-        const emulator_object<SYSTEM_BASIC_INFORMATION64> info{c.emu, system_information};
-
-        info.access([&](SYSTEM_BASIC_INFORMATION64& basic_info) {
-            basic_info.Reserved = 0;
-            basic_info.TimerResolution = 0x0002625a;
-            basic_info.PageSize = 0x1000;
-            basic_info.LowestPhysicalPageNumber = 0x00000001;
-            basic_info.HighestPhysicalPageNumber = 0x00c9c7ff;
-            basic_info.AllocationGranularity = 0x10000;
-            basic_info.MinimumUserModeAddress = 0x0000000000010000;
-            basic_info.MaximumUserModeAddress = 0x00007ffffffeffff;
-            basic_info.ActiveProcessorsAffinityMask = 0x0000000000000fff;
-            basic_info.NumberOfProcessors = 1;
-        });
-
-        return STATUS_SUCCESS;
+        printf("Unsupported system info ex class: %X\n", info_class);
+        c.emu.stop();
+        return STATUS_NOT_SUPPORTED;
     }
 
     NTSTATUS handle_NtQueryInformationProcess(const syscall_context& c, const handle process_handle,
@@ -1404,12 +1476,85 @@ namespace
         return STATUS_NOT_SUPPORTED;
     }
 
+    std::u16string get_virtual_file_key(const std::u16string& name)
+    {
+        return utils::string::to_lower(name);
+    }
+
+    virtual_file* find_virtual_file(const syscall_context& c, const file& f)
+    {
+        if (!f.is_virtual)
+        {
+            return nullptr;
+        }
+
+        const auto entry = c.proc.virtual_files.find(get_virtual_file_key(f.name));
+        if (entry == c.proc.virtual_files.end())
+        {
+            return nullptr;
+        }
+
+        ++c.proc.process_data_modifications;
+        return &entry->second;
+    }
+
+    bool set_file_position(file& f, const int64_t position)
+    {
+        if (position < 0)
+        {
+            return false;
+        }
+
+        if (f.is_virtual)
+        {
+            f.virtual_position = static_cast<uint64_t>(position);
+            return true;
+        }
+
+        return f.handle.seek_to(position);
+    }
+
     NTSTATUS handle_NtSetInformationFile(const syscall_context& c, const handle file_handle,
                                          const emulator_object<IO_STATUS_BLOCK<EmulatorTraits<Emu64>>> io_status_block,
                                          const uint64_t file_information, const ULONG length,
                                          const FILE_INFORMATION_CLASS info_class)
     {
-        const auto* f = c.proc.files.get(file_handle);
+        if (info_class == FileCompletionInformation || info_class == FileReplaceCompletionInformation)
+        {
+            if (!c.proc.files.get(file_handle) && !c.proc.devices.get(file_handle))
+            {
+                return STATUS_INVALID_HANDLE;
+            }
+
+            if (length != sizeof(FILE_COMPLETION_INFORMATION<EmulatorTraits<Emu64>>))
+            {
+                return STATUS_INFO_LENGTH_MISMATCH;
+            }
+
+            const auto i =
+                emulator_object<FILE_COMPLETION_INFORMATION<EmulatorTraits<Emu64>>>{c.emu, file_information}.read();
+
+            ++c.proc.process_data_modifications;
+
+            if (!i.Port)
+            {
+                c.proc.io_completion_associations.erase(file_handle.bits);
+                return STATUS_SUCCESS;
+            }
+
+            if (!c.proc.io_completions.get(i.Port))
+            {
+                return STATUS_INVALID_HANDLE;
+            }
+
+            auto& association = c.proc.io_completion_associations[file_handle.bits];
+            association.port.bits = i.Port;
+            association.key = i.Key;
+
+            return STATUS_SUCCESS;
+        }
+
+        auto* f = c.proc.files.get(file_handle);
         if (!f)
         {
             return STATUS_INVALID_HANDLE;
@@ -1417,7 +1562,7 @@ namespace
 
         if (info_class == FilePositionInformation)
         {
-            if (!f->handle)
+            if (!f->is_file())
             {
                 return STATUS_NOT_SUPPORTED;
             }
@@ -1437,32 +1582,80 @@ namespace
             const emulator_object<FILE_POSITION_INFORMATION> info{c.emu, file_information};
             const auto i = info.read();
 
-            if (!f->handle.seek_to(i.CurrentByteOffset.QuadPart))
+            if (!set_file_position(*f, i.CurrentByteOffset.QuadPart))
+            {
+                return STATUS_INVALID_PARAMETER;
+            }
+
+            return STATUS_SUCCESS;
+        }
+
+        printf("Unsupported set file info class: %X\n", info_class);
+        c.emu.stop();
+
+        return STATUS_NOT_SUPPORTED;
+    }
+
+    directory_listing scan_directory(const std::filesystem::path& dir)
+    {
+        directory_listing files{
+            {u"."},
+            {u".."},
+        };
+
+        for (const auto& file : std::filesystem::directory_iterator(dir))
+        {
+            files.emplace_back(file_entry{
+                .name = file.path().filename().u16string(),
+            });
+        }
+
+        return files;
+    }
+
+    // Listings are shared by all emulators in the process and dropped once the modification time of their directory
+    // changes. Directories that changed very recently are rescanned, their timestamps may not reflect further changes.
+    std::shared_ptr<const directory_listing> get_directory_listing(const std::filesystem::path& dir)
+    {
+        constexpr size_t MAX_CACHED_LISTINGS = 0x1000;
+        constexpr auto MIN_LISTING_AGE = std::chrono::seconds(2);
+
+        struct cached_listing
+        {
+            std::filesystem::file_time_type write_time{};
+            std::shared_ptr<const directory_listing> files{};
+        };
+
+        static std::mutex cache_mutex{};
+        static std::map<std::filesystem::path, cached_listing> cache{};
+
+        std::error_code ec{};
+        const auto write_time = std::filesystem::last_write_time(dir, ec);
+        const auto is_cacheable = !ec && write_time + MIN_LISTING_AGE < std::filesystem::file_time_type::clock::now();
+
+        if (is_cacheable)
+        {
+            std::lock_guard _{cache_mutex};
+
+            const auto entry = cache.find(dir);
+            if (entry != cache.end() && entry->second.write_time == write_time)
             {
-                return STATUS_INVALID_PARAMETER;
+                return entry->second.files;
             }
-
-            return STATUS_SUCCESS;
         }
 
-        printf("Unsupported set file info class: %X\n", info_class);
-        c.emu.stop();
+        auto files = std::make_shared<const directory_listing>(scan_directory(dir));
 
-        return STATUS_NOT_SUPPORTED;
-    }
+        if (is_cacheable)
+        {
+            std::lock_guard _{cache_mutex};
 
-    std::vector<file_entry> scan_directory(const std::filesystem::path& dir)
-    {
-        std::vector<file_entry> files{
-            {"."},
-            {".."},
-        };
+            if (cache.size() >= MAX_CACHED_LISTINGS)
+            {
+                cache.clear();
+            }
 
-        for (const auto& file : std::filesystem::directory_iterator(dir))
-        {
-            files.emplace_back(file_entry{
-                .file_path = file.path().filename(),
-            });
+            cache[dir] = {write_time, files};
         }
 
         return files;
@@ -1477,26 +1670,28 @@ namespace
         if (!f->enumeration_state || query_flags & SL_RESTART_SCAN)
         {
             f->enumeration_state.emplace(file_enumeration_state{});
-            f->enumeration_state->files = scan_directory(f->name);
+            f->enumeration_state->files = get_directory_listing(f->name);
         }
 
         auto& enum_state = *f->enumeration_state;
+        const auto& files = *enum_state.files;
 
-        size_t current_offset{0};
-        emulator_object<T> object{c.emu};
+        // Entries are assembled on the host and written to the guest at once
+        std::vector<std::byte> entries{};
+        std::optional<size_t> previous_offset{};
 
+        size_t current_offset{0};
         size_t current_index = enum_state.current_index;
 
         do
         {
-            if (current_index >= enum_state.files.size())
+            if (current_index >= files.size())
             {
                 break;
             }
 
             const auto new_offset = align_up(current_offset, 8);
-            const auto& current_file = enum_state.files[current_index];
-            const auto file_name = current_file.file_path.u16string();
+            const auto& file_name = files[current_index].name;
             const auto required_size = sizeof(T) + (file_name.size() * 2) - 2;
             const auto end_offset = new_offset + required_size;
 
@@ -1514,12 +1709,11 @@ namespace
                 break;
             }
 
-            if (object)
+            if (previous_offset)
             {
-                const auto object_offset = object.value() - file_information;
-
-                object.access(
-                    [&](T& dir_info) { dir_info.NextEntryOffset = static_cast<ULONG>(new_offset - object_offset); });
+                const auto next_entry_offset = static_cast<ULONG>(new_offset - *previous_offset);
+                memcpy(entries.data() + *previous_offset + offsetof(T, NextEntryOffset), &next_entry_offset,
+                       sizeof(next_entry_offset));
             }
 
             T info{};
@@ -1528,15 +1722,20 @@ namespace
             info.FileAttributes = FILE_ATTRIBUTE_NORMAL;
             info.FileNameLength = static_cast<ULONG>(file_name.size() * 2);
 
-            object.set_address(file_information + new_offset);
-            object.write(info);
-
-            c.emu.write_memory(object.value() + offsetof(T, FileName), file_name.data(), info.FileNameLength);
+            entries.resize(std::max(end_offset, new_offset + sizeof(T)));
+            memcpy(entries.data() + new_offset, &info, sizeof(info));
+            memcpy(entries.data() + new_offset + offsetof(T, FileName), file_name.data(), info.FileNameLength);
 
+            previous_offset = new_offset;
             ++current_index;
             current_offset = end_offset;
         } while ((query_flags & SL_RETURN_SINGLE_ENTRY) == 0);
 
+        if (current_offset)
+        {
+            c.emu.write_memory(file_information, entries.data(), current_offset);
+        }
+
         if ((query_flags & SL_NO_CURSOR_UPDATE) == 0)
         {
             enum_state.current_index = current_index;
@@ -1546,7 +1745,7 @@ namespace
         block.Information = current_offset;
         io_status_block.write(block);
 
-        return current_index < enum_state.files.size() ? STATUS_SUCCESS : STATUS_NO_MORE_FILES;
+        return current_index < files.size() ? STATUS_SUCCESS : STATUS_NO_MORE_FILES;
     }
 
     NTSTATUS handle_NtQueryDirectoryFileEx(
@@ -1642,7 +1841,11 @@ namespace
             FILE_STANDARD_INFORMATION i{};
             i.Directory = f->is_directory() ? TRUE : FALSE;
 
-            if (f->handle)
+            if (const auto* vf = find_virtual_file(c, *f))
+            {
+                i.EndOfFile.QuadPart = static_cast<int64_t>(vf->data.size());
+            }
+            else if (f->handle)
             {
                 i.EndOfFile.QuadPart = f->handle.size();
             }
@@ -1654,7 +1857,7 @@ namespace
 
         if (info_class == FilePositionInformation)
         {
-            if (!f->handle)
+            if (!f->is_file())
             {
                 return STATUS_NOT_SUPPORTED;
             }
@@ -1674,7 +1877,8 @@ namespace
             const emulator_object<FILE_POSITION_INFORMATION> info{c.emu, file_information};
             FILE_POSITION_INFORMATION i{};
 
-            i.CurrentByteOffset.QuadPart = f->handle.tell();
+            i.CurrentByteOffset.QuadPart =
+                f->is_virtual ? static_cast<int64_t>(f->virtual_position) : f->handle.tell();
 
             info.write(i);
 
@@ -1803,9 +2007,9 @@ namespace
 
         const auto requested_protection = map_nt_to_emulator_protection(protection);
 
-        c.win_emu.log.print(color::dark_gray, "--> Changing protection at 0x%" PRIx64 "-0x%" PRIx64 " to %s\n",
-                            aligned_start, aligned_start + aligned_length,
-                            get_permission_string(requested_protection).c_str());
+        EMU_LOG(c.win_emu.log, syscall, debug, dark_gray,
+                "--> Changing protection at 0x%" PRIx64 "-0x%" PRIx64 " to %s\n", aligned_start,
+                aligned_start + aligned_length, get_permission_string(requested_protection).c_str());
 
         memory_permission old_protection_value{};
 
@@ -1818,6 +2022,15 @@ namespace
             return STATUS_INVALID_ADDRESS;
         }
 
+        c.win_emu.events().publish<memory_protect_event>([&] {
+            return memory_protect_event{
+                .address = aligned_start,
+                .size = static_cast<size_t>(aligned_length),
+                .permissions = requested_protection,
+                .previous_permissions = old_protection_value,
+            };
+        });
+
         const auto current_protection = map_emulator_to_nt_protection(old_protection_value);
         old_protection.write(current_protection);
 
@@ -1829,8 +2042,7 @@ namespace
         const emulator_object<OBJECT_ATTRIBUTES<EmulatorTraits<Emu64>>> object_attributes)
     {
         const auto attributes = object_attributes.read();
-        const auto object_name =
-            read_unicode_string(c.emu, reinterpret_cast<UNICODE_STRING<EmulatorTraits<Emu64>>*>(attributes.ObjectName));
+        const auto object_name = read_scratch_object_name(c, attributes);
 
         if (object_name == u"\\KnownDlls")
         {
@@ -1852,8 +2064,7 @@ namespace
         const emulator_object<OBJECT_ATTRIBUTES<EmulatorTraits<Emu64>>> object_attributes)
     {
         const auto attributes = object_attributes.read();
-        const auto object_name =
-            read_unicode_string(c.emu, reinterpret_cast<UNICODE_STRING<EmulatorTraits<Emu64>>*>(attributes.ObjectName));
+        const auto object_name = read_scratch_object_name(c, attributes);
 
         if (object_name == u"KnownDllPath")
         {
@@ -1936,9 +2147,13 @@ namespace
             return STATUS_SUCCESS;
         }
 
-        return c.emu.allocate_memory(potential_base, allocation_bytes, protection, !commit)
-                   ? STATUS_SUCCESS
-                   : STATUS_MEMORY_NOT_ALLOCATED;
+        if (c.emu.allocate_memory(potential_base, allocation_bytes, protection, !commit))
+        {
+            return STATUS_SUCCESS;
+        }
+
+        return commit && !c.emu.has_commit_capacity(allocation_bytes) ? STATUS_NO_MEMORY
+                                                                       : STATUS_MEMORY_NOT_ALLOCATED;
     }
 
     NTSTATUS handle_NtAllocateVirtualMemory(const syscall_context& c, const handle process_handle,
@@ -1991,7 +2206,8 @@ namespace
         const auto* file = c.proc.files.get(file_handle);
         if (file)
         {
-            c.win_emu.log.print(color::dark_gray, "--> Section for file %s\n", u16_to_u8(file->name).c_str());
+            EMU_LOG(c.win_emu.log, syscall, debug, dark_gray, "--> Section for file %s\n",
+                    u16_to_u8(file->name).c_str());
             s.file_name = file->name;
         }
 
@@ -2002,7 +2218,8 @@ namespace
             {
                 const auto name = read_unicode_string(
                     c.emu, reinterpret_cast<UNICODE_STRING<EmulatorTraits<Emu64>>*>(attributes.ObjectName));
-                c.win_emu.log.print(color::dark_gray, "--> Section with name %s\n", u16_to_u8(name).c_str());
+                EMU_LOG(c.win_emu.log, syscall, debug, dark_gray, "--> Section with name %s\n",
+                        u16_to_u8(name).c_str());
                 s.name = std::move(name);
             }
         }
@@ -2020,6 +2237,7 @@ namespace
         }
 
         const auto h = c.proc.sections.store(std::move(s));
+        c.proc.object_names.add(h, c.proc.sections.get(h)->name);
         section_handle.write(h);
 
         return STATUS_SUCCESS;
@@ -2035,15 +2253,14 @@ namespace
                                   const emulator_object<ULONG> connection_info_length)
     {
         auto port_name = read_unicode_string(c.emu, server_port_name);
-        c.win_emu.log.print(color::dark_gray, "NtConnectPort: %s\n", u16_to_u8(port_name).c_str());
+        EMU_LOG(c.win_emu.log, syscall, debug, dark_gray, "NtConnectPort: %s\n", u16_to_u8(port_name).c_str());
 
         port p{};
         p.name = std::move(port_name);
 
         if (connection_info)
         {
-            std::vector<uint8_t> zero_mem{};
-            zero_mem.resize(connection_info_length.read(), 0);
+            const auto zero_mem = allocate_scratch_memory(c, connection_info_length.read());
             c.emu.write_memory(connection_info, zero_mem.data(), zero_mem.size());
         }
 
@@ -2071,8 +2288,7 @@ namespace
             return STATUS_NOT_SUPPORTED;
         }
 
-        std::vector<uint8_t> memory{};
-        memory.resize(number_of_bytes_read);
+        const auto memory = c.scratch.allocate(number_of_bytes_to_read);
 
         if (!c.emu.try_read_memory(base_address, memory.data(), memory.size()))
         {
@@ -2084,6 +2300,20 @@ namespace
         return STATUS_SUCCESS;
     }
 
+    // Synchronously completed requests still signal their event and queue their completion packet,
+    // overlapped callers wait for one of them
+    void complete_io(const syscall_context& c, const handle file_handle, const handle event,
+                     const uint64_t apc_context, const NTSTATUS status, const uint64_t information)
+    {
+        if (auto* e = c.proc.events.get(event))
+        {
+            e->signaled = true;
+            c.proc.signal_waiters();
+        }
+
+        c.proc.queue_io_completion(file_handle, apc_context, status, information);
+    }
+
     NTSTATUS handle_NtDeviceIoControlFile(const syscall_context& c, const handle file_handle, const handle event,
                                           const emulator_pointer /*PIO_APC_ROUTINE*/ apc_routine,
                                           const emulator_pointer apc_context,
@@ -2099,6 +2329,7 @@ namespace
         }
 
         io_device_context context{c.emu};
+        context.file_handle = file_handle;
         context.event = event;
         context.apc_routine = apc_routine;
         context.apc_context = apc_context;
@@ -2109,7 +2340,14 @@ namespace
         context.output_buffer = output_buffer;
         context.output_buffer_length = output_buffer_length;
 
-        return device->execute_ioctl(c.win_emu, context);
+        const auto status = device->execute_ioctl(c.win_emu, context);
+        if (status == STATUS_SUCCESS)
+        {
+            const auto information = io_status_block ? io_status_block.read().Information : 0;
+            complete_io(c, file_handle, event, apc_context, status, information);
+        }
+
+        return status;
     }
 
     NTSTATUS handle_NtQueryWnfStateData()
@@ -2571,6 +2809,9 @@ namespace
                 }
             }
 
+            ++c.proc.thread_changes;
+            c.proc.signal_waiters();
+
             return STATUS_SUCCESS;
         }
 
@@ -2584,23 +2825,130 @@ namespace
         return STATUS_NOT_SUPPORTED;
     }
 
-    NTSTATUS handle_NtReadFile(const syscall_context& c, const handle file_handle, const uint64_t /*event*/,
-                               const uint64_t /*apc_routine*/, const uint64_t /*apc_context*/,
+    const utils::mapped_file* get_read_mapping(file& f, const uint64_t end)
+    {
+        if (f.read_mapping && f.read_mapping->size() >= end)
+        {
+            return &*f.read_mapping;
+        }
+
+        if (f.read_mapping && f.read_mapping->size() >= static_cast<uint64_t>(f.handle.size()))
+        {
+            return *f.read_mapping ? &*f.read_mapping : nullptr;
+        }
+
+        (void)fflush(f.handle);
+
+        try
+        {
+            f.read_mapping = utils::mapped_file(f.name, utils::mapped_file::access::read);
+        }
+        catch (...)
+        {
+            f.read_mapping = utils::mapped_file{};
+        }
+
+        return *f.read_mapping ? &*f.read_mapping : nullptr;
+    }
+
+    size_t read_file_to_memory(const syscall_context& c, file& f, const uint64_t buffer, const ULONG length)
+    {
+        if (f.is_virtual)
+        {
+            const auto* vf = find_virtual_file(c, f);
+            if (!vf || f.virtual_position >= vf->data.size())
+            {
+                return 0;
+            }
+
+            const auto offset = static_cast<size_t>(f.virtual_position);
+            const auto bytes_read = std::min(static_cast<size_t>(length), vf->data.size() - offset);
+
+            c.emu.write_memory(buffer, vf->data.data() + offset, bytes_read);
+            f.virtual_position += bytes_read;
+
+            return bytes_read;
+        }
+
+        size_t bytes_read = 0;
+        const auto position = f.handle.tell();
+        const auto* mapping = position >= 0 ? get_read_mapping(f, static_cast<uint64_t>(position) + length) : nullptr;
+
+        if (mapping)
+        {
+            const auto offset = static_cast<size_t>(position);
+            if (offset < mapping->size())
+            {
+                bytes_read = std::min(static_cast<size_t>(length), mapping->size() - offset);
+
+                c.emu.write_memory(buffer, mapping->data() + offset, bytes_read);
+                f.handle.seek_to(position + static_cast<int64_t>(bytes_read));
+            }
+        }
+        else if (const auto view = c.emu.get_writable_view(buffer, length); !view.empty())
+        {
+            bytes_read = fread(view.data(), 1, view.size(), f.handle);
+        }
+        else
+        {
+            const auto temp_buffer = c.scratch.allocate(length);
+
+            bytes_read = fread(temp_buffer.data(), 1, temp_buffer.size(), f.handle);
+            c.emu.write_memory(buffer, temp_buffer.data(), bytes_read);
+        }
+
+        return bytes_read;
+    }
+
+    NTSTATUS handle_NtReadFile(const syscall_context& c, const handle file_handle, const handle event,
+                               const uint64_t /*apc_routine*/, const uint64_t apc_context,
                                const emulator_object<IO_STATUS_BLOCK<EmulatorTraits<Emu64>>> io_status_block,
-                               uint64_t buffer, const ULONG length,
-                               const emulator_object<LARGE_INTEGER> /*byte_offset*/,
+                               uint64_t buffer, const ULONG length, const emulator_object<LARGE_INTEGER> byte_offset,
                                const emulator_object<ULONG> /*key*/)
     {
-        const auto* f = c.proc.files.get(file_handle);
+        auto* f = c.proc.files.get(file_handle);
         if (!f)
         {
             return STATUS_INVALID_HANDLE;
         }
 
-        std::string temp_buffer{};
-        temp_buffer.resize(length);
+        // Negative offsets select the current file position
+        if (byte_offset)
+        {
+            const auto offset = byte_offset.read().QuadPart;
+            if (offset >= 0 && !set_file_position(*f, offset))
+            {
+                return STATUS_INVALID_PARAMETER;
+            }
+        }
+
+        size_t bytes_read = 0;
+        auto* recorder = c.win_emu.recorder();
+
+        if (recorder && recorder->is_replaying())
+        {
+            const auto data = recorder->replay(recorded_input::file_read);
+            c.emu.write_memory(buffer, data.data(), data.size());
+            bytes_read = data.size();
+
+            if (f->is_virtual)
+            {
+                f->virtual_position += bytes_read;
+            }
+            else if (f->handle)
+            {
+                f->handle.seek_to(f->handle.tell() + static_cast<int64_t>(bytes_read));
+            }
+        }
+        else
+        {
+            bytes_read = read_file_to_memory(c, *f, buffer, length);
 
-        const auto bytes_read = fread(temp_buffer.data(), 1, temp_buffer.size(), f->handle);
+            if (recorder)
+            {
+                recorder->record(recorded_input::file_read, read_scratch_memory(c, buffer, bytes_read));
+            }
+        }
 
         if (io_status_block)
         {
@@ -2609,20 +2957,19 @@ namespace
             io_status_block.write(block);
         }
 
-        c.emu.write_memory(buffer, temp_buffer.data(), temp_buffer.size());
+        complete_io(c, file_handle, event, apc_context, STATUS_SUCCESS, bytes_read);
+
         return STATUS_SUCCESS;
     }
 
-    NTSTATUS handle_NtWriteFile(const syscall_context& c, const handle file_handle, const uint64_t /*event*/,
-                                const uint64_t /*apc_routine*/, const uint64_t /*apc_context*/,
+    NTSTATUS handle_NtWriteFile(const syscall_context& c, const handle file_handle, const handle event,
+                                const uint64_t /*apc_routine*/, const uint64_t apc_context,
                                 const emulator_object<IO_STATUS_BLOCK<EmulatorTraits<Emu64>>> io_status_block,
-                                uint64_t buffer, const ULONG length,
-                                const emulator_object<LARGE_INTEGER> /*byte_offset*/,
+                                uint64_t buffer, const ULONG length, const emulator_object<LARGE_INTEGER> byte_offset,
                                 const emulator_object<ULONG> /*key*/)
     {
-        std::string temp_buffer{};
-        temp_buffer.resize(length);
-        c.emu.read_memory(buffer, temp_buffer.data(), temp_buffer.size());
+        // The data is written straight from guest memory if possible
+        const auto data = read_scratch_memory(c, buffer, length);
 
         if (file_handle == STDOUT_HANDLE)
         {
@@ -2633,24 +2980,68 @@ namespace
                 io_status_block.write(block);
             }
 
-            if (!temp_buffer.ends_with("\n"))
+            std::string text(reinterpret_cast<const char*>(data.data()), data.size());
+            if (!text.ends_with("\n"))
             {
-                temp_buffer.push_back('\n');
+                text.push_back('\n');
             }
 
-            c.win_emu.on_stdout(temp_buffer);
-            c.win_emu.log.info("%.*s", static_cast<int>(temp_buffer.size()), temp_buffer.data());
+            c.win_emu.on_stdout(text);
+            c.win_emu.log.info("%.*s", static_cast<int>(text.size()), text.data());
 
             return STATUS_SUCCESS;
         }
 
-        const auto* f = c.proc.files.get(file_handle);
+        auto* f = c.proc.files.get(file_handle);
         if (!f)
         {
             return STATUS_INVALID_HANDLE;
         }
 
-        const auto bytes_written = fwrite(temp_buffer.data(), 1, temp_buffer.size(), f->handle);
+        auto* vf = find_virtual_file(c, *f);
+        if (f->is_virtual && !vf)
+        {
+            return STATUS_INVALID_HANDLE;
+        }
+
+        // -1 appends, other negative offsets select the current file position
+        if (byte_offset)
+        {
+            auto offset = byte_offset.read().QuadPart;
+            if (offset == -1)
+            {
+                offset = vf ? static_cast<int64_t>(vf->data.size()) : f->handle.size();
+            }
+
+            if (offset >= 0 && !set_file_position(*f, offset))
+            {
+                return STATUS_INVALID_PARAMETER;
+            }
+        }
+
+        size_t bytes_written = 0;
+
+        if (vf)
+        {
+            const auto end = static_cast<size_t>(f->virtual_position) + data.size();
+            if (vf->data.size() < end)
+            {
+                vf->data.resize(end);
+            }
+
+            std::ranges::copy(data, vf->data.begin() + static_cast<ptrdiff_t>(f->virtual_position));
+            f->virtual_position = end;
+            bytes_written = data.size();
+        }
+        else
+        {
+            f->read_mapping = {};
+            bytes_written = fwrite(data.data(), 1, data.size(), f->handle);
+        }
+
+        c.win_emu.events().publish<file_write_event>([&] {
+            return file_write_event{.name = f->name, .size = bytes_written}; //
+        });
 
         if (io_status_block)
         {
@@ -2659,6 +3050,8 @@ namespace
             io_status_block.write(block);
         }
 
+        complete_io(c, file_handle, event, apc_context, STATUS_SUCCESS, bytes_written);
+
         return STATUS_SUCCESS;
     }
 
@@ -2709,6 +3102,76 @@ namespace
         return mode;
     }
 
+    // Writing opens copy the host file on first use, files that were never written are read from the host.
+    // Every open counts as a modification of the process data, so resets restore the virtual files.
+    std::optional<NTSTATUS> open_virtual_file(const syscall_context& c, file& f, const std::u16string_view mode)
+    {
+        const auto key = get_virtual_file_key(f.name);
+        auto entry = c.proc.virtual_files.find(key);
+        ++c.proc.process_data_modifications;
+
+        if (entry == c.proc.virtual_files.end())
+        {
+            if (mode == u"rb")
+            {
+                return std::nullopt;
+            }
+
+            virtual_file vf{};
+
+            if (mode == u"r+b" || mode == u"a+b")
+            {
+                std::vector<uint8_t> host_data{};
+                if (utils::io::read_file(f.name, &host_data))
+                {
+                    const auto* bytes = reinterpret_cast<const std::byte*>(host_data.data());
+                    vf.data.assign(bytes, bytes + host_data.size());
+                }
+                else if (mode == u"r+b")
+                {
+                    return STATUS_OBJECT_NAME_NOT_FOUND;
+                }
+            }
+
+            entry = c.proc.virtual_files.emplace(key, std::move(vf)).first;
+        }
+        else if (mode == u"wb" || mode == u"w+b")
+        {
+            entry->second.data.clear();
+        }
+
+        f.is_virtual = true;
+        f.virtual_position = mode == u"a+b" ? entry->second.data.size() : 0;
+
+        return STATUS_SUCCESS;
+    }
+
+    NTSTATUS open_host_file(file& f, const std::u16string& mode)
+    {
+        FILE* file{};
+
+        const auto error = open_unicode(&file, f.name, mode);
+
+        if (!file)
+        {
+            switch (error)
+            {
+            case ENOENT:
+                return STATUS_OBJECT_NAME_NOT_FOUND;
+            case EACCES:
+                return STATUS_ACCESS_DENIED;
+            case EISDIR:
+                return STATUS_FILE_IS_A_DIRECTORY;
+            default:
+                return STATUS_NOT_SUPPORTED;
+            }
+        }
+
+        f.handle = file;
+
+        return STATUS_SUCCESS;
+    }
+
     NTSTATUS handle_NtCreateFile(const syscall_context& c, const emulator_object<handle> file_handle,
                                  ACCESS_MASK desired_access,
                                  const emulator_object<OBJECT_ATTRIBUTES<EmulatorTraits<Emu64>>> object_attributes,
@@ -2721,8 +3184,9 @@ namespace
         auto filename =
             read_unicode_string(c.emu, reinterpret_cast<UNICODE_STRING<EmulatorTraits<Emu64>>*>(attributes.ObjectName));
 
-        auto printer = utils::finally(
-            [&] { c.win_emu.log.print(color::dark_gray, "--> Opening file: %s\n", u16_to_u8(filename).c_str()); });
+        auto printer = utils::finally([&] {
+            EMU_LOG(c.win_emu.log, syscall, debug, dark_gray, "--> Opening file: %s\n", u16_to_u8(filename).c_str());
+        });
 
         constexpr std::u16string_view device_prefix = u"\\Device\\";
         if (filename.starts_with(device_prefix))
@@ -2767,7 +3231,7 @@ namespace
 
         if (f.name.ends_with(u"\\") || create_options & FILE_DIRECTORY_FILE)
         {
-            c.win_emu.log.print(color::dark_gray, "--> Opening folder: %s\n", u16_to_u8(f.name).c_str());
+            EMU_LOG(c.win_emu.log, syscall, debug, dark_gray, "--> Opening folder: %s\n", u16_to_u8(f.name).c_str());
 
             if (create_disposition & FILE_CREATE)
             {
@@ -2790,7 +3254,7 @@ namespace
             return STATUS_SUCCESS;
         }
 
-        c.win_emu.log.print(color::dark_gray, "--> Opening file: %s\n", u16_to_u8(f.name).c_str());
+        EMU_LOG(c.win_emu.log, syscall, debug, dark_gray, "--> Opening file: %s\n", u16_to_u8(f.name).c_str());
 
         std::u16string mode = map_mode(desired_access, create_disposition);
 
@@ -2799,26 +3263,16 @@ namespace
             return STATUS_NOT_SUPPORTED;
         }
 
-        FILE* file{};
-
-        const auto error = open_unicode(&file, f.name, mode);
-
-        if (!file)
+        auto status = c.proc.virtualize_file_writes ? open_virtual_file(c, f, mode) : std::nullopt;
+        if (!status)
         {
-            switch (error)
-            {
-            case ENOENT:
-                return STATUS_OBJECT_NAME_NOT_FOUND;
-            case EACCES:
-                return STATUS_ACCESS_DENIED;
-            case EISDIR:
-                return STATUS_FILE_IS_A_DIRECTORY;
-            default:
-                return STATUS_NOT_SUPPORTED;
-            }
+            status = open_host_file(f, mode);
         }
 
-        f.handle = file;
+        if (*status != STATUS_SUCCESS)
+        {
+            return *status;
+        }
 
         const auto handle = c.proc.files.store(std::move(f));
         file_handle.write(handle);
@@ -2954,23 +3408,23 @@ namespace
             return STATUS_INVALID_PARAMETER;
         }
 
-        const auto name = read_unicode_string(
-            c.emu, emulator_object<UNICODE_STRING<EmulatorTraits<Emu64>>>{c.emu, attributes.ObjectName});
-        if (name.empty())
-        {
-            return STATUS_INVALID_PARAMETER;
-        }
+        const emulator_object<UNICODE_STRING<EmulatorTraits<Emu64>>> object_name{c.emu, attributes.ObjectName};
 
-        for (const auto& semaphore : c.proc.semaphores)
-        {
-            if (semaphore.second.name == name)
+        return access_unicode_string(c.emu, object_name.read(), [&](const std::u16string_view name) {
+            if (name.empty())
             {
-                semaphore_handle.write(c.proc.semaphores.make_handle(semaphore.first));
-                return STATUS_SUCCESS;
+                return STATUS_INVALID_PARAMETER;
+            }
+
+            const auto h = c.proc.object_names.find(handle_types::semaphore, name);
+            if (!h || !c.proc.semaphores.get(*h))
+            {
+                return STATUS_OBJECT_NAME_NOT_FOUND;
             }
-        }
 
-        return STATUS_OBJECT_NAME_NOT_FOUND;
+            semaphore_handle.write(*h);
+            return STATUS_SUCCESS;
+        });
     }
 
     NTSTATUS handle_NtCreateSemaphore(const syscall_context& c, const emulator_object<handle> semaphore_handle,
@@ -2992,18 +3446,13 @@ namespace
             }
         }
 
-        if (!s.name.empty())
+        if (!s.name.empty() && c.proc.object_names.find(handle_types::semaphore, s.name))
         {
-            for (const auto& semaphore : c.proc.semaphores)
-            {
-                if (semaphore.second.name == s.name)
-                {
-                    return STATUS_OBJECT_NAME_EXISTS;
-                }
-            }
+            return STATUS_OBJECT_NAME_EXISTS;
         }
 
         const auto handle = c.proc.semaphores.store(std::move(s));
+        c.proc.object_names.add(handle, c.proc.semaphores.get(handle)->name);
         semaphore_handle.write(handle);
 
         return STATUS_SUCCESS;
@@ -3057,6 +3506,7 @@ namespace
         }
 
         c.proc.atoms[index] = std::move(name);
+        ++c.proc.process_data_modifications;
         atom.write(index);
         return STATUS_SUCCESS;
     }
@@ -3069,6 +3519,12 @@ namespace
             return STATUS_NOT_SUPPORTED;
         }
 
+        if (c.emu.is_section_view(base_address))
+        {
+            c.emu.release_memory(base_address, 0);
+            return STATUS_SUCCESS;
+        }
+
         const auto* mod = c.proc.mod_manager.find_by_address(base_address);
         if (!mod)
         {
@@ -3151,6 +3607,63 @@ namespace
         return STATUS_SUCCESS;
     }
 
+    // The parameters either hold absolute pointers or, if they aren't normalized yet, offsets to their own base
+    std::u16string read_process_parameter(const syscall_context& c, const uint64_t parameters_address,
+                                          const RTL_USER_PROCESS_PARAMETERS64& parameters,
+                                          UNICODE_STRING<EmulatorTraits<Emu64>> string)
+    {
+        constexpr ULONG RTL_USER_PROC_PARAMS_NORMALIZED = 1;
+
+        if (string.Buffer && !(parameters.Flags & RTL_USER_PROC_PARAMS_NORMALIZED))
+        {
+            string.Buffer += parameters_address;
+        }
+
+        return read_unicode_string(c.emu, string);
+    }
+
+    NTSTATUS handle_NtCreateUserProcess(const syscall_context& c, const emulator_object<handle> /*process_handle*/,
+                                        const emulator_object<handle> /*thread_handle*/,
+                                        const ACCESS_MASK /*process_desired_access*/,
+                                        const ACCESS_MASK /*thread_desired_access*/,
+                                        const uint64_t /*process_object_attributes*/,
+                                        const uint64_t /*thread_object_attributes*/, const ULONG /*process_flags*/,
+                                        const ULONG /*thread_flags*/,
+                                        const emulator_object<RTL_USER_PROCESS_PARAMETERS64> process_parameters,
+                                        const uint64_t /*create_info*/, const uint64_t /*attribute_list*/)
+    {
+        if (!process_parameters)
+        {
+            return STATUS_INVALID_PARAMETER;
+        }
+
+        const auto parameters = process_parameters.read();
+        const auto address = process_parameters.value();
+
+        child_process_request request{
+            .image_path = read_process_parameter(c, address, parameters, parameters.ImagePathName),
+            .command_line = read_process_parameter(c, address, parameters, parameters.CommandLine),
+            .current_directory = read_process_parameter(c, address, parameters, parameters.CurrentDirectory.DosPath),
+        };
+
+        constexpr std::u16string_view nt_prefix = u"\\??\\";
+        if (request.image_path.starts_with(nt_prefix))
+        {
+            request.image_path.erase(0, nt_prefix.size());
+        }
+
+        c.win_emu.log.print(color::pink, "Creating process: %s\n", u16_to_u8(request.command_line).c_str());
+
+        if (!c.win_emu.on_child_process(request))
+        {
+            c.emu.stop();
+            return STATUS_NOT_SUPPORTED;
+        }
+
+        // The child runs elsewhere, the guest continues as if its creation had been denied
+        return STATUS_ACCESS_DENIED;
+    }
+
     NTSTATUS handle_NtQueryDebugFilterState()
     {
         return FALSE;
@@ -3197,7 +3710,7 @@ namespace
 
         if (timeout.value() && !t.await_time.has_value())
         {
-            t.await_time = convert_delay_interval_to_time_point(timeout.read());
+            t.await_time = convert_delay_interval_to_time_point(c.proc.clock, timeout.read());
         }
 
         c.win_emu.yield_thread();
@@ -3224,7 +3737,7 @@ namespace
 
         if (timeout.value() && !t.await_time.has_value())
         {
-            t.await_time = convert_delay_interval_to_time_point(timeout.read());
+            t.await_time = convert_delay_interval_to_time_point(c.proc.clock, timeout.read());
         }
 
         c.win_emu.yield_thread();
@@ -3241,6 +3754,9 @@ namespace
         }
 
         thread->exit_status = exit_status;
+        ++c.proc.thread_changes;
+        c.proc.signal_waiters();
+
         if (thread == c.proc.active_thread)
         {
             c.win_emu.yield_thread();
@@ -3260,13 +3776,19 @@ namespace
         }
 
         auto& t = c.win_emu.current_thread();
-        t.await_time = convert_delay_interval_to_time_point(delay_interval.read());
+        t.await_time = convert_delay_interval_to_time_point(c.proc.clock, delay_interval.read());
 
         c.win_emu.yield_thread();
 
         return STATUS_SUCCESS;
     }
 
+    NTSTATUS handle_NtYieldExecution(const syscall_context& c)
+    {
+        c.win_emu.yield_spinning_thread();
+        return STATUS_SUCCESS;
+    }
+
     NTSTATUS handle_NtAlertThreadByThreadId(const syscall_context& c, const uint64_t thread_id)
     {
         for (auto& t : c.proc.threads)
@@ -3274,6 +3796,7 @@ namespace
             if (t.second.id == thread_id)
             {
                 t.second.alerted = true;
+                c.proc.wake_thread(t.second.self_handle);
                 return STATUS_SUCCESS;
             }
         }
@@ -3302,7 +3825,7 @@ namespace
 
         if (timeout.value() && !t.await_time.has_value())
         {
-            t.await_time = convert_delay_interval_to_time_point(timeout.read());
+            t.await_time = convert_delay_interval_to_time_point(c.proc.clock, timeout.read());
         }
 
         c.win_emu.yield_thread();
@@ -3373,6 +3896,10 @@ void syscall_dispatcher::add_handlers(std::map<std::string, syscall_handler>& ha
     add_handler(NtTraceEvent);
     add_handler(NtAllocateVirtualMemoryEx);
     add_handler(NtCreateIoCompletion);
+    add_handler(NtSetIoCompletion);
+    add_handler(NtSetIoCompletionEx);
+    add_handler(NtRemoveIoCompletion);
+    add_handler(NtRemoveIoCompletionEx);
     add_handler(NtCreateWaitCompletionPacket);
     add_handler(NtCreateWorkerFactory);
     add_handler(NtManageHotPatch);
@@ -3426,10 +3953,12 @@ void syscall_dispatcher::add_handlers(std::map<std::string, syscall_handler>& ha
     add_handler(NtSetSystemInformation);
     add_handler(NtQueryInformationFile);
     add_handler(NtCreateThreadEx);
+    add_handler(NtCreateUserProcess);
     add_handler(NtQueryDebugFilterState);
     add_handler(NtWaitForSingleObject);
     add_handler(NtTerminateThread);
     add_handler(NtDelayExecution);
+    add_handler(NtYieldExecution);
     add_handler(NtWaitForAlertByThreadId);
     add_handler(NtAlertThreadByThreadIdEx);
     add_handler(NtAlertThreadByThreadId);
@@ -3447,6 +3976,7 @@ void syscall_dispatcher::add_handlers(std::map<std::string, syscall_handler>& ha
     add_handler(NtQueryAttributesFile);
     add_handler(NtWaitForMultipleObjects);
     add_handler(NtCreateMutant);
+    add_handler(NtOpenMutant);
     add_handler(NtReleaseMutant);
     add_handler(NtDuplicateToken);
     add_handler(NtQueryTimerResolution);
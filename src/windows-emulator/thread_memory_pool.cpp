@@ -0,0 +1,91 @@
+#include "thread_memory_pool.hpp"
+
+namespace
+{
+    constexpr size_t MAX_POOLED_REGIONS = 64;
+
+    // Guests may have freed or reprotected parts of the region, those aren't reused
+    bool is_intact(memory_manager& memory, const uint64_t address, const uint64_t size)
+    {
+        const auto info = memory.get_region_info(address);
+        return info.is_committed && info.allocation_base == address && info.allocation_length == size &&
+               info.start == address && info.length == size && info.permissions == memory_permission::read_write;
+    }
+
+    // Pages that are still zero are skipped when zeroing, reading them doesn't mark them as written
+    uint64_t get_zero_prefix(memory_manager& memory, const uint64_t address, const uint64_t size)
+    {
+        const auto view = memory.get_readable_view(address, static_cast<size_t>(size));
+        if (view.empty())
+        {
+            return 0;
+        }
+
+        const auto data = std::ranges::find_if(view, [](const std::byte value) { return value != std::byte{}; });
+        return page_align_down(static_cast<uint64_t>(data - view.begin()));
+    }
+
+    void zero_memory(memory_manager& memory, const uint64_t address, const uint64_t size)
+    {
+        if (!size)
+        {
+            return;
+        }
+
+        const auto view = memory.get_writable_view(address, static_cast<size_t>(size));
+        if (!view.empty())
+        {
+            std::ranges::fill(view, std::byte{});
+            return;
+        }
+
+        const std::vector<std::byte> zeros(static_cast<size_t>(size));
+        memory.write_memory(address, zeros.data(), zeros.size());
+    }
+}
+
+uint64_t thread_memory_pool::allocate(memory_manager& memory, const uint64_t size)
+{
+    // Most recently released first, its memory is the most likely to still be cached
+    const auto entry = std::ranges::find(std::ranges::reverse_view(this->free_regions_), size, &region::size);
+    if (entry == this->free_regions_.rend())
+    {
+        return memory.allocate_memory(static_cast<size_t>(size), memory_permission::read_write);
+    }
+
+    const auto r = *entry;
+    this->free_regions_.erase(std::next(entry).base());
+
+    zero_memory(memory, r.address + r.used_offset, r.used_size);
+    return r.address;
+}
+
+void thread_memory_pool::release(memory_manager& memory, const uint64_t address, const uint64_t size,
+                                 const uint64_t used_size)
+{
+    if (this->free_regions_.size() >= MAX_POOLED_REGIONS || !is_intact(memory, address, size))
+    {
+        memory.release_memory(address, 0);
+        return;
+    }
+
+    const auto used = std::min(used_size, size);
+    const auto zero_prefix = get_zero_prefix(memory, address, used);
+
+    this->free_regions_.push_back({
+        .address = address,
+        .size = size,
+        .used_offset = zero_prefix,
+        .used_size = used - zero_prefix,
+    });
+}
+
+void thread_memory_pool::serialize(utils::buffer_serializer& buffer) const
+{
+    buffer.write_vector(this->free_regions_);
+}
+
+void thread_memory_pool::deserialize(utils::buffer_deserializer& buffer)
+{
+    buffer.read_vector(this->free_regions_);
+}
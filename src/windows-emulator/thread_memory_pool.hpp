@@ -0,0 +1,55 @@
+#pragma once
+
+#include "std_include.hpp"
+
+#include <memory_manager.hpp>
+#include <serialization.hpp>
+
+// Keeps the stacks and GS segments of destroyed threads mapped and hands them to new threads, so workloads that
+// churn through threads don't remap memory each time. Recycled regions are zeroed when they are handed out again,
+// only as far as they were used. Stacks grow down, so the zero pages below their deepest use are skipped.
+class thread_memory_pool
+{
+  public:
+    struct region
+    {
+        uint64_t address{};
+        uint64_t size{};
+        // Only this range of the region may have been written, the rest is still zero
+        uint64_t used_offset{};
+        uint64_t used_size{};
+
+        void serialize(utils::buffer_serializer& buffer) const
+        {
+            buffer.write(this->address);
+            buffer.write(this->size);
+            buffer.write(this->used_offset);
+            buffer.write(this->used_size);
+        }
+
+        void deserialize(utils::buffer_deserializer& buffer)
+        {
+            buffer.read(this->address);
+            buffer.read(this->size);
+            buffer.read(this->used_offset);
+            buffer.read(this->used_size);
+        }
+    };
+
+    // Returns a zeroed read-write region, 0 if the memory is exhausted
+    uint64_t allocate(memory_manager& memory, uint64_t size);
+    // Only the first used_size bytes may have been written
+    void release(memory_manager& memory, uint64_t address, uint64_t size, uint64_t used_size);
+
+    size_t get_region_count() const
+    {
+        return this->free_regions_.size();
+    }
+
+    void serialize(utils::buffer_serializer& buffer) const;
+    void deserialize(utils::buffer_deserializer& buffer);
+
+  private:
+    // Few enough to be searched linearly
+    std::vector<region> free_regions_{};
+};
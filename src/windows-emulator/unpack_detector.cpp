@@ -0,0 +1,54 @@
+#include "std_include.hpp"
+#include "unpack_detector.hpp"
+#include "windows_emulator.hpp"
+
+namespace
+{
+    constexpr size_t DUMP_PAGE_SIZE = 0x1000;
+
+    std::vector<std::byte> read_allocation(const x64_emulator& emu, const uint64_t address, const size_t size)
+    {
+        std::vector<std::byte> data(size);
+
+        for (size_t offset = 0; offset < size; offset += DUMP_PAGE_SIZE)
+        {
+            const auto length = std::min(size - offset, DUMP_PAGE_SIZE);
+            (void)emu.try_read_memory(address + offset, data.data() + offset, length);
+        }
+
+        return data;
+    }
+}
+
+unpack_detector::unpack_detector(windows_emulator& win_emu)
+    : win_emu_(&win_emu)
+{
+    win_emu.emu().start_execution_watch([this](const uint64_t page) {
+        this->on_written_execution(page); //
+    });
+}
+
+unpack_detector::~unpack_detector()
+{
+    this->win_emu_->emu().stop_execution_watch();
+}
+
+void unpack_detector::on_written_execution(const uint64_t page)
+{
+    auto& emu = this->win_emu_->emu();
+
+    const auto region = emu.get_region_info(page);
+    if (!region.is_reserved || !this->dumped_allocations_.insert(region.allocation_base).second)
+    {
+        return;
+    }
+
+    this->win_emu_->log.print(color::pink, "Executing written memory at 0x%" PRIx64 " (%s), allocation 0x%" PRIx64 "\n",
+                              page, this->win_emu_->process().mod_manager.find_name(page), region.allocation_base);
+
+    this->unpacked_memory_.push_back({
+        .executed_page = page,
+        .allocation_base = region.allocation_base,
+        .data = read_allocation(emu, region.allocation_base, region.allocation_length),
+    });
+}
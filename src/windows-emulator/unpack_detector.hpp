@@ -0,0 +1,43 @@
+#pragma once
+
+#include "std_include.hpp"
+
+class windows_emulator;
+
+struct unpacked_memory
+{
+    // Page whose execution revealed the allocation
+    uint64_t executed_page{};
+    uint64_t allocation_base{};
+    // The allocation at the first execution, pages that aren't readable are zero
+    std::vector<std::byte> data{};
+};
+
+// Finds code the guest wrote and then ran, the way unpackers and loaders produce their payload. Writes of the host,
+// like the images it maps, don't count. Pages the guest writes while the detector runs lose their execute permission
+// in the backend until they execute, so the cost depends on the transitions between writing and executing pages, not
+// on the instructions. Every allocation is dumped once, when the first of its written pages executes.
+class unpack_detector
+{
+  public:
+    unpack_detector(windows_emulator& win_emu);
+    ~unpack_detector();
+
+    unpack_detector(const unpack_detector&) = delete;
+    unpack_detector& operator=(const unpack_detector&) = delete;
+    unpack_detector(unpack_detector&&) = delete;
+    unpack_detector& operator=(unpack_detector&&) = delete;
+
+    const std::vector<unpacked_memory>& get_unpacked_memory() const
+    {
+        return this->unpacked_memory_;
+    }
+
+  private:
+    windows_emulator* win_emu_{};
+
+    std::set<uint64_t> dumped_allocations_{};
+    std::vector<unpacked_memory> unpacked_memory_{};
+
+    void on_written_execution(uint64_t page);
+};
@@ -1,12 +1,37 @@
 #include "std_include.hpp"
 #include "windows_emulator.hpp"
 
+#include "event_trace.hpp"
+#include "execution_trace.hpp"
+#include "function_hle.hpp"
+#include "heap_sanitizer.hpp"
+#include "api_tracer.hpp"
+#include "input_recorder.hpp"
 #include "context_frame.hpp"
+#include "socket_provider.hpp"
 
 #include <unicorn_x64_emulator.hpp>
+#include <serialization_stream.hpp>
+#include <utils/timer.hpp>
 #include <utils/finally.hpp>
+#include <utils/mapped_file.hpp>
+#include <network/poller.hpp>
 
-constexpr auto MAX_INSTRUCTIONS_PER_TIME_SLICE = 100000;
+// Bounds of the adaptive time slice, relative to the configured quantum
+constexpr uint64_t MIN_TIME_SLICE_DIVISOR = 8;
+constexpr uint64_t MAX_TIME_SLICE_MULTIPLIER = 16;
+
+// A slice that never left a code window this small is treated as a spin-wait
+constexpr uint64_t SPIN_WAIT_WINDOW = 0x100;
+
+// Loops of up to this many blocks spin if their registers are the same after this many more iterations
+constexpr size_t SPIN_LOOP_MAX_BLOCKS = 4;
+constexpr uint64_t SPIN_LOOP_ITERATIONS = 64;
+
+// Read-only pages checked for duplicates between time slices
+constexpr size_t DEDUPLICATION_PAGES_PER_SLICE = 16;
+
+constexpr uint32_t BOOT_TEMPLATE_VERSION = 3;
 
 namespace
 {
@@ -171,16 +196,28 @@ namespace
         return canonical(absolute(path)).make_preferred();
     }
 
-    void setup_context(windows_emulator& win_emu, const emulator_settings& settings)
+    void setup_context(windows_emulator& win_emu, const emulator_settings& settings, startup_statistics& statistics)
     {
         auto& emu = win_emu.emu();
         auto& context = win_emu.process();
 
+        {
+            const utils::scoped_timer _{statistics.registry};
+            context.registry = registry_manager(settings.registry_directory);
+        }
+
+        const utils::scoped_timer _{statistics.process_context};
+
         setup_gdt(emu);
 
-        context.registry = registry_manager(settings.registry_directory);
+        context.kusd.setup(settings.use_relative_time, settings.kusd_as_memory, settings.instructions_per_second);
+        context.virtualize_file_writes = settings.virtualize_file_writes;
+        context.emulate_library_functions = settings.emulate_library_functions;
 
-        context.kusd.setup(settings.use_relative_time);
+        if (settings.emulate_heap || settings.sanitize_heap)
+        {
+            context.heap.enable(settings.heap_redzone_size, settings.sanitize_heap);
+        }
 
         context.base_allocator = create_allocator(emu, PEB_SEGMENT_SIZE);
         auto& allocator = context.base_allocator;
@@ -268,50 +305,6 @@ namespace
         });
     }
 
-    using exception_record_map = std::unordered_map<const EMU_EXCEPTION_RECORD<EmulatorTraits<Emu64>>*,
-                                                    emulator_object<EMU_EXCEPTION_RECORD<EmulatorTraits<Emu64>>>>;
-
-    emulator_object<EMU_EXCEPTION_RECORD<EmulatorTraits<Emu64>>> save_exception_record(
-        emulator_allocator& allocator, const EMU_EXCEPTION_RECORD<EmulatorTraits<Emu64>>& record,
-        exception_record_map& record_mapping)
-    {
-        const auto record_obj = allocator.reserve<EMU_EXCEPTION_RECORD<EmulatorTraits<Emu64>>>();
-        record_obj.write(record);
-
-        if (record.ExceptionRecord)
-        {
-            record_mapping.emplace(&record, record_obj);
-
-            emulator_object<EMU_EXCEPTION_RECORD<EmulatorTraits<Emu64>>> nested_record_obj{allocator.get_emulator()};
-            const auto nested_record = record_mapping.find(
-                reinterpret_cast<EMU_EXCEPTION_RECORD<EmulatorTraits<Emu64>>*>(record.ExceptionRecord));
-
-            if (nested_record != record_mapping.end())
-            {
-                nested_record_obj = nested_record->second;
-            }
-            else
-            {
-                nested_record_obj = save_exception_record(
-                    allocator, *reinterpret_cast<EMU_EXCEPTION_RECORD<EmulatorTraits<Emu64>>*>(record.ExceptionRecord),
-                    record_mapping);
-            }
-
-            record_obj.access([&](EMU_EXCEPTION_RECORD<EmulatorTraits<Emu64>>& r) {
-                r.ExceptionRecord = reinterpret_cast<EmulatorTraits<Emu64>::PVOID>(nested_record_obj.ptr());
-            });
-        }
-
-        return record_obj;
-    }
-
-    emulator_object<EMU_EXCEPTION_RECORD<EmulatorTraits<Emu64>>> save_exception_record(
-        emulator_allocator& allocator, const EMU_EXCEPTION_RECORD<EmulatorTraits<Emu64>>& record)
-    {
-        exception_record_map record_mapping{};
-        return save_exception_record(allocator, record, record_mapping);
-    }
-
     uint32_t map_violation_operation_to_parameter(const memory_operation operation)
     {
         switch (operation)
@@ -339,12 +332,50 @@ namespace
             }
 
             total_size += sizeof(*current_record);
-            current_record = reinterpret_cast<EMU_EXCEPTION_RECORD<EmulatorTraits<Emu64>>*>(record.ExceptionRecord);
+            current_record =
+                reinterpret_cast<EMU_EXCEPTION_RECORD<EmulatorTraits<Emu64>>*>(current_record->ExceptionRecord);
         }
 
         return total_size;
     }
 
+    // Copies the chain of records into the buffer, nested records point to their copies at buffer_address
+    void write_exception_records(const std::span<std::byte> buffer, const uint64_t buffer_address,
+                                 const EMU_EXCEPTION_RECORD<EmulatorTraits<Emu64>>& record)
+    {
+        using record_type = EMU_EXCEPTION_RECORD<EmulatorTraits<Emu64>>;
+
+        std::unordered_map<const record_type*, uint64_t> record_addresses{};
+        size_t offset = 0;
+
+        for (const auto* current_record = &record; current_record;)
+        {
+            if (offset + sizeof(record_type) > buffer.size())
+            {
+                throw std::runtime_error("Bad exception record position on stack");
+            }
+
+            record_addresses.emplace(current_record, buffer_address + offset);
+
+            auto copy = *current_record;
+            const auto* nested_record = reinterpret_cast<const record_type*>(current_record->ExceptionRecord);
+
+            if (const auto entry = record_addresses.find(nested_record); entry != record_addresses.end())
+            {
+                copy.ExceptionRecord = entry->second;
+                nested_record = nullptr;
+            }
+            else if (nested_record)
+            {
+                copy.ExceptionRecord = buffer_address + offset + sizeof(record_type);
+            }
+
+            memcpy(buffer.data() + offset, &copy, sizeof(copy));
+            offset += sizeof(copy);
+            current_record = nested_record;
+        }
+    }
+
     struct machine_frame
     {
         uint64_t rip;
@@ -354,54 +385,48 @@ namespace
         uint64_t ss;
     };
 
+    // The context must hold the current registers, the frame is built below its stack pointer
     void dispatch_exception_pointers(x64_emulator& emu, const uint64_t dispatcher,
                                      const EMU_EXCEPTION_POINTERS<EmulatorTraits<Emu64>> pointers)
     {
         constexpr auto mach_frame_size = 0x40;
         constexpr auto context_record_size = 0x4F0;
-        const auto exception_record_size = calculate_exception_record_size(
-            *reinterpret_cast<EMU_EXCEPTION_RECORD<EmulatorTraits<Emu64>>*>(pointers.ExceptionRecord));
+
+        const auto& context = *reinterpret_cast<CONTEXT64*>(pointers.ContextRecord);
+        const auto& record = *reinterpret_cast<EMU_EXCEPTION_RECORD<EmulatorTraits<Emu64>>*>(pointers.ExceptionRecord);
+
+        const auto exception_record_size = calculate_exception_record_size(record);
         const auto combined_size = align_up(exception_record_size + context_record_size, 0x10);
 
         assert(combined_size == 0x590);
 
         const auto allocation_size = combined_size + mach_frame_size;
 
-        const auto initial_sp = emu.reg(x64_register::rsp);
+        const auto initial_sp = context.Rsp;
         const auto new_sp = align_down(initial_sp - allocation_size, 0x100);
 
         const auto total_size = initial_sp - new_sp;
         assert(total_size >= allocation_size);
 
-        std::vector<uint8_t> zero_memory{};
-        zero_memory.resize(total_size, 0);
-
-        emu.write_memory(new_sp, zero_memory.data(), zero_memory.size());
-
-        emu.reg(x64_register::rsp, new_sp);
-        emu.reg(x64_register::rip, dispatcher);
+        // The whole frame is assembled on the host, so it takes a single memory write
+        std::vector<std::byte> frame(total_size);
+        memcpy(frame.data(), &context, sizeof(context));
 
-        const emulator_object<CONTEXT64> context_record_obj{emu, new_sp};
-        context_record_obj.write(*reinterpret_cast<CONTEXT64*>(pointers.ContextRecord));
+        write_exception_records(std::span(frame).subspan(context_record_size, exception_record_size),
+                                new_sp + context_record_size, record);
 
-        emulator_allocator allocator{emu, new_sp + context_record_size, exception_record_size};
-        const auto exception_record_obj = save_exception_record(
-            allocator, *reinterpret_cast<EMU_EXCEPTION_RECORD<EmulatorTraits<Emu64>>*>(pointers.ExceptionRecord));
+        const machine_frame mach_frame{
+            .rip = context.Rip,
+            .cs = context.SegCs,
+            .eflags = context.EFlags,
+            .rsp = context.Rsp,
+            .ss = context.SegSs,
+        };
 
-        if (exception_record_obj.value() != allocator.get_base())
-        {
-            throw std::runtime_error("Bad exception record position on stack");
-        }
+        memcpy(frame.data() + combined_size, &mach_frame, sizeof(mach_frame));
 
-        const emulator_object<machine_frame> machine_frame_obj{emu, new_sp + combined_size};
-        machine_frame_obj.access([&](machine_frame& frame) {
-            const auto& record = *reinterpret_cast<CONTEXT64*>(pointers.ContextRecord);
-            frame.rip = record.Rip;
-            frame.rsp = record.Rsp;
-            frame.ss = record.SegSs;
-            frame.cs = record.SegCs;
-            frame.eflags = record.EFlags;
-        });
+        emu.write_memory(new_sp, frame.data(), frame.size());
+        emu.write_registers(std::array{x64_register::rsp, x64_register::rip}, std::array{new_sp, dispatcher});
     }
 
     void dispatch_access_violation(x64_emulator& emu, const uint64_t dispatcher, const uint64_t address,
@@ -416,7 +441,7 @@ namespace
         record.ExceptionCode = static_cast<DWORD>(STATUS_ACCESS_VIOLATION);
         record.ExceptionFlags = 0;
         record.ExceptionRecord = 0;
-        record.ExceptionAddress = static_cast<EmulatorTraits<Emu64>::PVOID>(emu.read_instruction_pointer());
+        record.ExceptionAddress = static_cast<EmulatorTraits<Emu64>::PVOID>(ctx.Rip);
         record.NumberParameters = 2;
         record.ExceptionInformation[0] = map_violation_operation_to_parameter(operation);
         record.ExceptionInformation[1] = address;
@@ -439,7 +464,7 @@ namespace
         record.ExceptionCode = static_cast<DWORD>(STATUS_ILLEGAL_INSTRUCTION);
         record.ExceptionFlags = 0;
         record.ExceptionRecord = 0;
-        record.ExceptionAddress = static_cast<EmulatorTraits<Emu64>::PVOID>(emu.read_instruction_pointer());
+        record.ExceptionAddress = static_cast<EmulatorTraits<Emu64>::PVOID>(ctx.Rip);
         record.NumberParameters = 0;
 
         EMU_EXCEPTION_POINTERS<EmulatorTraits<Emu64>> pointers{};
@@ -457,6 +482,12 @@ namespace
         const auto was_blocked = devices.block_mutation(true);
         const auto _ = utils::finally([&] { devices.block_mutation(was_blocked); });
 
+        auto& poller = win_emu.socket_poller();
+        if (!poller.empty())
+        {
+            poller.wait(0ms);
+        }
+
         for (auto& device : devices)
         {
             device.second.work(win_emu);
@@ -483,15 +514,20 @@ namespace
 
         if (active_thread)
         {
-            win_emu.log.print(color::dark_gray, "Performing thread switch...\n");
+            EMU_LOG(win_emu.log, thread, debug, dark_gray, "Performing thread switch...\n");
             active_thread->save(emu);
         }
 
         context.active_thread = &thread;
+        ++context.thread_changes;
 
         thread.restore(emu);
         thread.setup_if_necessary(emu, context);
 
+        win_emu.events().publish<thread_switch_event>([&] {
+            return thread_switch_event{.previous = active_thread, .next = thread}; //
+        });
+
         return true;
     }
 
@@ -506,41 +542,154 @@ namespace
         return switch_to_thread(win_emu, *thread);
     }
 
+    uint64_t hash_loop_registers(x64_emulator& emu)
+    {
+        constexpr std::array registers{
+            x64_register::rax, x64_register::rbx, x64_register::rcx, x64_register::rdx, x64_register::rsi,
+            x64_register::rdi, x64_register::rbp, x64_register::rsp, x64_register::r8,  x64_register::r9,
+            x64_register::r10, x64_register::r11, x64_register::r12, x64_register::r13, x64_register::r14,
+            x64_register::r15, x64_register::rflags,
+        };
+
+        uint64_t hash = 0xCBF29CE484222325ULL;
+
+        for (const auto reg : registers)
+        {
+            hash = (hash ^ emu.reg(reg)) * 0x100000001B3ULL;
+        }
+
+        return hash;
+    }
+
     bool switch_to_next_thread(windows_emulator& win_emu)
     {
         perform_context_switch_work(win_emu);
 
         auto& context = win_emu.process();
+        context.wake_timed_out_threads(context.clock.steady_now());
 
-        bool next_thread = false;
+        // Queued last, the active thread only runs again after all other ready threads
+        if (context.active_thread)
+        {
+            context.queue_thread(*context.active_thread);
+        }
 
-        for (auto& thread : context.threads)
+        while (!context.ready_threads.empty())
         {
-            if (next_thread)
-            {
-                if (switch_to_thread(win_emu, thread.second))
-                {
-                    return true;
-                }
+            const auto thread_handle = context.ready_threads.front();
+            context.ready_threads.pop_front();
 
+            auto* thread = context.threads.get(thread_handle);
+            if (!thread)
+            {
                 continue;
             }
 
-            if (&thread.second == context.active_thread)
+            thread->queued = false;
+
+            if (switch_to_thread(win_emu, *thread))
+            {
+                return true;
+            }
+
+            if (!thread->exit_status)
             {
-                next_thread = true;
+                context.block_thread(*thread);
             }
         }
 
-        for (auto& thread : context.threads)
+        return false;
+    }
+
+    void wait_for_thread_wakeup(windows_emulator& win_emu)
+    {
+        constexpr auto max_idle_wait = 100ms;
+        constexpr auto device_poll_interval = 1ms;
+
+        auto& context = win_emu.process();
+
+        io_device_wakeup wakeup{};
+
+        for (const auto& device : context.devices)
+        {
+            device.second.collect_wakeup(wakeup);
+        }
+
+        for (const auto& thread : context.threads)
         {
-            if (switch_to_thread(win_emu, thread.second))
+            const auto& await_time = thread.second.await_time;
+            if (!thread.second.exit_status && await_time && (!wakeup.deadline || *await_time < *wakeup.deadline))
             {
-                return true;
+                wakeup.deadline = *await_time;
             }
         }
 
-        return false;
+        auto& clock = context.clock;
+        const auto now = clock.steady_now();
+
+        // Virtual time doesn't pass while no instructions are executed
+        const auto skips = win_emu.skips_idle_waits() || clock.is_virtual();
+
+        if (skips && wakeup.sockets.empty() && !wakeup.needs_polling && wakeup.deadline)
+        {
+            // Nothing can wake a thread before the deadline, so jump there instead of sleeping
+            clock.skip(*wakeup.deadline - now);
+            return;
+        }
+
+        auto wait_until = std::min(wakeup.deadline.value_or(now + max_idle_wait), now + max_idle_wait);
+
+        if (wakeup.needs_polling)
+        {
+            wait_until = std::min(wait_until, now + device_poll_interval);
+        }
+
+        if (wait_until <= now)
+        {
+            return;
+        }
+
+        // The host wait below stands in for the idle virtual time
+        if (clock.is_virtual())
+        {
+            clock.skip(wait_until - now);
+        }
+
+        // Replayed clock readings don't depend on the host clock, so waiting would only slow the replay down
+        if (const auto* recorder = win_emu.recorder(); recorder && recorder->is_replaying())
+        {
+            return;
+        }
+
+        if (wakeup.sockets.empty())
+        {
+            // wait_until is on the emulated clock, which may be ahead of the host clock
+            std::this_thread::sleep_for(wait_until - now);
+            return;
+        }
+
+        const auto timeout = std::chrono::ceil<std::chrono::milliseconds>(wait_until - now);
+        auto& poller = win_emu.socket_poller();
+
+        const auto all_watched = std::ranges::all_of(wakeup.sockets, [&](const auto& entry) {
+            return poller.is_watching(static_cast<SOCKET>(entry.first), entry.second);
+        });
+
+        if (all_watched)
+        {
+            poller.wait(timeout);
+            return;
+        }
+
+        std::vector<std::pair<SOCKET, bool>> sockets{};
+        sockets.reserve(wakeup.sockets.size());
+
+        for (const auto& [s, in_poll] : wakeup.sockets)
+        {
+            sockets.emplace_back(static_cast<SOCKET>(s), in_poll);
+        }
+
+        network::socket::sleep_sockets(sockets, timeout);
     }
 
     bool is_object_signaled(process_context& c, const handle h, uint32_t current_thread_id)
@@ -585,22 +734,119 @@ namespace
 
         throw std::runtime_error("Bad object");
     }
+
+    constexpr auto SYSCALL_TABLE_FILE = "syscall_tables.cache";
+
+    constexpr char BOOT_TEMPLATE_MAGIC[8] = {'E', 'M', 'U', 'B', 'O', 'O', 'T', '\0'};
+
+    // Written raw, the guards change the layout of everything that follows
+    struct boot_template_header
+    {
+        char magic[8]{};
+        uint32_t version{};
+        uint32_t serialization_guards{};
+    };
+
+    constexpr char STATE_FILE_MAGIC[8] = {'E', 'M', 'U', 'S', 'T', 'A', 'T', 'E'};
+    constexpr uint32_t STATE_FILE_VERSION = 1;
+
+    // Followed by the memory image, the state itself comes last and references the image by file offsets
+    struct state_file_header
+    {
+        char magic[8]{};
+        uint32_t version{};
+        uint32_t serialization_guards{};
+        uint64_t state_offset{};
+        uint64_t state_size{};
+    };
+
+    class state_file_writer : public memory_image_writer
+    {
+      public:
+        state_file_writer(FILE* file)
+            : file_(file)
+        {
+        }
+
+        uint64_t write(const std::span<const std::byte> data) override
+        {
+            const std::vector<std::byte> padding(align_up(this->size_, MEMORY_IMAGE_ALIGNMENT) - this->size_);
+            this->append(padding);
+
+            const auto offset = this->size_;
+            this->append(data);
+
+            return offset;
+        }
+
+        void append(const std::span<const std::byte> data)
+        {
+            if (fwrite(data.data(), 1, data.size(), this->file_) != data.size())
+            {
+                throw std::runtime_error("Failed to write state file");
+            }
+
+            this->size_ += data.size();
+        }
+
+        uint64_t get_size() const
+        {
+            return this->size_;
+        }
+
+      private:
+        FILE* file_{};
+        uint64_t size_{};
+    };
+
+    // Everything the state at the entry point depends on, a template is only used if its key matches
+    std::vector<std::byte> get_boot_template_key(const emulator_settings& settings)
+    {
+        utils::buffer_serializer buffer{};
+        buffer.write_string(canonicalize_path(settings.application).u16string());
+        buffer.write_string(settings.working_directory.u16string());
+        buffer.write_string(settings.registry_directory.u16string());
+
+        buffer.write(static_cast<uint64_t>(settings.arguments.size()));
+        for (const auto& argument : settings.arguments)
+        {
+            buffer.write_string(argument);
+        }
+
+        buffer.write(settings.use_relative_time);
+        buffer.write(settings.instructions_per_second);
+        buffer.write(settings.kusd_as_memory);
+        buffer.write(settings.virtualize_file_writes);
+        buffer.write(settings.emulate_library_functions);
+        buffer.write(settings.emulate_heap);
+        buffer.write(settings.heap_redzone_size);
+        buffer.write(settings.sanitize_heap);
+
+        std::error_code ec{};
+        buffer.write(static_cast<uint64_t>(std::filesystem::file_size(settings.application, ec)));
+        const auto write_time = std::filesystem::last_write_time(settings.application, ec);
+        buffer.write(static_cast<int64_t>(write_time.time_since_epoch().count()));
+
+        return buffer.move_buffer();
+    }
 }
 
-emulator_thread::emulator_thread(x64_emulator& emu, const process_context& context, const uint64_t start_address,
-                                 const uint64_t argument, const uint64_t stack_size, const uint32_t id)
+emulator_thread::emulator_thread(x64_emulator& emu, const process_context& context, thread_memory_pool& memory_pool,
+                                 const uint64_t start_address, const uint64_t argument, const uint64_t stack_size,
+                                 const uint32_t id)
     : emu_ptr(&emu),
+      memory_pool(&memory_pool),
       stack_size(page_align_up(std::max(stack_size, static_cast<uint64_t>(STACK_SIZE)))),
       start_address(start_address),
       argument(argument),
       id(id),
       last_registers(context.default_register_set)
 {
-    this->stack_base = emu.allocate_memory(this->stack_size, memory_permission::read_write);
+    this->stack_base = memory_pool.allocate(emu, this->stack_size);
 
     this->gs_segment = emulator_allocator{
         emu,
-        emu.allocate_memory(GS_SEGMENT_SIZE, memory_permission::read_write),
+        memory_pool.allocate(emu, GS_SEGMENT_SIZE),
         GS_SEGMENT_SIZE,
     };
 
@@ -621,6 +867,8 @@ void emulator_thread::mark_as_ready(const NTSTATUS status)
     this->pending_status = status;
     this->await_time = {};
     this->await_objects = {};
+    this->completion_wait = {};
+    this->checked_wait_generation = {};
 
     // TODO: Find out if this is correct
     if (this->waiting_for_alert)
@@ -645,7 +893,7 @@ bool emulator_thread::is_thread_ready(windows_emulator& win_emu)
             this->mark_as_ready(STATUS_ALERTED);
             return true;
         }
-        if (this->is_await_time_over())
+        if (this->is_await_time_over(win_emu.process().clock.steady_now()))
         {
             this->mark_as_ready(STATUS_TIMEOUT);
             return true;
@@ -654,30 +902,69 @@ bool emulator_thread::is_thread_ready(windows_emulator& win_emu)
         return false;
     }
 
-    if (!this->await_objects.empty())
+    if (this->completion_wait)
     {
-        bool all_signaled = true;
-        for (uint32_t i = 0; i < this->await_objects.size(); ++i)
+        auto& context = win_emu.process();
+
+        // Packets are only queued together with a wait generation bump
+        if (this->checked_wait_generation != context.wait_generation)
         {
-            const auto& obj = this->await_objects[i];
+            this->checked_wait_generation = context.wait_generation;
 
-            const auto signaled = is_object_signaled(win_emu.process(), obj, this->id);
-            all_signaled &= signaled;
+            auto* port = context.io_completions.get(this->completion_wait->port);
+            if (!port)
+            {
+                this->mark_as_ready(STATUS_ABANDONED_WAIT_0);
+                return true;
+            }
 
-            if (signaled && this->await_any)
+            if (port->remove_packets(win_emu.emu(), *this->completion_wait))
             {
-                this->mark_as_ready(STATUS_WAIT_0 + i);
+                this->mark_as_ready(STATUS_SUCCESS);
                 return true;
             }
         }
 
-        if (!this->await_any && all_signaled)
+        if (this->is_await_time_over(context.clock.steady_now()))
         {
-            this->mark_as_ready(STATUS_SUCCESS);
+            this->mark_as_ready(STATUS_TIMEOUT);
             return true;
         }
 
-        if (this->is_await_time_over())
+        return false;
+    }
+
+    if (!this->await_objects.empty())
+    {
+        auto& context = win_emu.process();
+
+        if (this->checked_wait_generation != context.wait_generation)
+        {
+            this->checked_wait_generation = context.wait_generation;
+
+            bool all_signaled = true;
+            for (uint32_t i = 0; i < this->await_objects.size(); ++i)
+            {
+                const auto& obj = this->await_objects[i];
+
+                const auto signaled = is_object_signaled(context, obj, this->id);
+                all_signaled &= signaled;
+
+                if (signaled && this->await_any)
+                {
+                    this->mark_as_ready(STATUS_WAIT_0 + i);
+                    return true;
+                }
+            }
+
+            if (!this->await_any && all_signaled)
+            {
+                this->mark_as_ready(STATUS_SUCCESS);
+                return true;
+            }
+        }
+
+        if (this->is_await_time_over(win_emu.process().clock.steady_now()))
         {
             this->mark_as_ready(STATUS_TIMEOUT);
             return true;
@@ -688,7 +975,7 @@ bool emulator_thread::is_thread_ready(windows_emulator& win_emu)
 
     if (this->await_time.has_value())
     {
-        if (this->is_await_time_over())
+        if (this->is_await_time_over(win_emu.process().clock.steady_now()))
         {
             this->mark_as_ready(STATUS_SUCCESS);
             return true;
@@ -733,83 +1020,472 @@ std::unique_ptr<x64_emulator> create_default_x64_emulator()
 windows_emulator::windows_emulator(emulator_settings settings, std::unique_ptr<x64_emulator> emu)
     : windows_emulator(std::move(emu))
 {
+    const utils::scoped_timer total_timer{this->startup_statistics_.total};
+
     this->silent_until_main_ = settings.silent_until_main && !settings.disable_logging;
     this->stdout_callback_ = std::move(settings.stdout_callback);
+    this->child_process_callback_ = std::move(settings.child_process_callback);
     this->use_relative_time_ = settings.use_relative_time;
+    this->skip_idle_waits_ = settings.skip_idle_waits;
+    this->time_slice_instructions_ = std::max(settings.time_slice_instructions, static_cast<uint64_t>(1));
+    this->adaptive_time_slices_ = settings.adaptive_time_slices;
+    this->fast_forward_spin_loops_ = settings.fast_forward_spin_loops;
+    this->socket_provider_ = std::move(settings.sockets);
+    this->setup_input_recording(settings);
     this->log.disable_output(settings.disable_logging || this->silent_until_main_);
-    this->setup_process(settings);
-}
 
-windows_emulator::windows_emulator(std::unique_ptr<x64_emulator> emu)
-    : emu_(std::move(emu)),
-      process_(*emu_)
-{
-    this->setup_hooks();
-}
+    if (!settings.log_file.empty())
+    {
+        this->log.set_output_file(settings.log_file);
+    }
 
-void windows_emulator::setup_process(const emulator_settings& settings)
-{
-    auto& emu = this->emu();
+    this->log.set_async(settings.async_logging);
 
-    auto& context = this->process();
-    context.mod_manager = module_manager(emu); // TODO: Cleanup module manager
+    if (settings.deduplicate_memory_pages)
+    {
+        this->emu().set_page_deduplication(true, std::move(settings.memory_page_store));
+    }
 
-    setup_context(*this, settings);
+    this->emu().set_serialization_threads(settings.serialization_threads);
+    this->emu().set_commit_limit(settings.memory_commit_limit);
+    this->emu().set_huge_pages(settings.use_huge_pages);
+    this->emu().set_page_deduplicator(std::move(settings.shared_page_deduplicator));
 
-    context.executable = context.mod_manager.map_module(settings.application, this->log);
+    if (!settings.trace_file.empty())
+    {
+        this->trace_ = std::make_unique<event_trace>(this->process_, settings.trace_file, settings.trace_buffer_size);
+    }
 
-    context.peb.access(
-        [&](PEB64& peb) { peb.ImageBaseAddress = reinterpret_cast<std::uint64_t*>(context.executable->image_base); });
+    if (this->trace_ && !settings.traced_apis.empty())
+    {
+        this->api_tracer_ = std::make_unique<api_tracer>(this->emu(), *this->trace_, settings.traced_apis);
+    }
 
-    context.ntdll = context.mod_manager.map_module(R"(C:\Windows\System32\ntdll.dll)", this->log);
-    context.win32u = context.mod_manager.map_module(R"(C:\Windows\System32\win32u.dll)", this->log);
+    if (settings.emulate_library_functions || settings.emulate_heap || settings.sanitize_heap)
+    {
+        this->function_hle_ = std::make_unique<function_hle>(this->emu(), this->process_);
+    }
 
-    const auto ntdll_data = emu.read_memory(context.ntdll->image_base, context.ntdll->size_of_image);
-    const auto win32u_data = emu.read_memory(context.win32u->image_base, context.win32u->size_of_image);
+    if (!settings.execution_trace_file.empty())
+    {
+        this->execution_trace_ =
+            std::make_unique<execution_trace>(settings.execution_trace_file, settings.execution_trace_registers);
+    }
 
-    this->dispatcher_.setup(context.ntdll->exports, ntdll_data, context.win32u->exports, win32u_data);
+    const auto use_boot_template = !settings.boot_template.empty() && !this->recorder_;
 
-    context.ldr_initialize_thunk = context.ntdll->find_export("LdrInitializeThunk");
-    context.rtl_user_thread_start = context.ntdll->find_export("RtlUserThreadStart");
-    context.ki_user_exception_dispatcher = context.ntdll->find_export("KiUserExceptionDispatcher");
+    auto& statistics = this->startup_statistics_;
 
-    context.default_register_set = emu.save_registers();
+    const auto load_boot_template = [&] {
+        const utils::scoped_timer _{statistics.boot_template};
+        return this->load_boot_template(settings);
+    };
 
-    const auto main_thread_id = context.create_thread(emu, context.executable->entry_point, 0, 0);
-    switch_to_thread(*this, main_thread_id);
+    if (!use_boot_template || !load_boot_template())
+    {
+        this->setup_process(settings);
+
+        if (use_boot_template)
+        {
+            const utils::scoped_timer _{statistics.boot_template};
+            this->create_boot_template(settings);
+        }
+    }
+
+    if (!this->heap_sanitizer_ && this->process_.heap.is_sanitizing())
+    {
+        this->heap_sanitizer_ = std::make_unique<heap_sanitizer>(this->emu(), this->process_, this->log);
+    }
 }
 
-void windows_emulator::yield_thread()
+windows_emulator::windows_emulator(std::unique_ptr<x64_emulator> emu)
+    : emu_(std::move(emu)),
+      process_(*emu_)
 {
-    this->switch_thread = true;
-    this->emu().stop();
+    this->process_.mod_manager = module_manager(this->emu(), nullptr, nullptr, nullptr, &this->events_);
+    this->setup_hooks();
 }
 
-void windows_emulator::perform_thread_switch()
+windows_emulator::~windows_emulator() = default;
+
+network::poller& windows_emulator::socket_poller()
 {
-    this->switch_thread = false;
-    while (!switch_to_next_thread(*this))
+    if (!this->socket_poller_)
     {
-        // TODO: Optimize that
-        std::this_thread::sleep_for(1ms);
+        this->socket_poller_ = std::make_unique<network::poller>();
     }
+
+    return *this->socket_poller_;
 }
 
-void windows_emulator::on_instruction_execution(uint64_t address)
+void windows_emulator::setup_input_recording(const emulator_settings& settings)
 {
-    auto& process = this->process();
-    auto& thread = this->current_thread();
-
-    ++process.executed_instructions;
-    const auto thread_insts = ++thread.executed_instructions;
-    if (thread_insts % MAX_INSTRUCTIONS_PER_TIME_SLICE == 0)
+    if (!settings.input_recording_file.empty() && !settings.input_replay_file.empty())
     {
-        this->switch_thread = true;
-        this->emu().stop();
+        throw std::runtime_error("Inputs can't be recorded and replayed at once");
     }
 
-    process.previous_ip = process.current_ip;
-    process.current_ip = this->emu().read_instruction_pointer();
+    if (!settings.input_replay_file.empty())
+    {
+        this->recorder_ = std::make_unique<input_recorder>(this->process_, settings.input_replay_file,
+                                                           input_recorder::mode::replay);
+    }
+    else if (!settings.input_recording_file.empty())
+    {
+        this->recorder_ = std::make_unique<input_recorder>(this->process_, settings.input_recording_file,
+                                                           input_recorder::mode::record);
+
+        if (!this->socket_provider_)
+        {
+            this->socket_provider_ = create_host_socket_provider();
+        }
+    }
+    else
+    {
+        return;
+    }
+
+    this->process_.clock.set_recorder(this->recorder_.get());
+    this->socket_provider_ = create_recording_socket_provider(std::move(this->socket_provider_), *this->recorder_);
+}
+
+socket_provider& windows_emulator::get_socket_provider()
+{
+    if (!this->socket_provider_)
+    {
+        this->socket_provider_ = create_host_socket_provider();
+    }
+
+    return *this->socket_provider_;
+}
+
+void windows_emulator::setup_process(const emulator_settings& settings)
+{
+    auto& emu = this->emu();
+
+    auto& context = this->process();
+    // TODO: Cleanup module manager
+    context.mod_manager = module_manager(emu, this->trace_.get(), this->function_hle_.get(),
+                                         this->api_tracer_.get(), &this->events_);
+
+    auto& statistics = this->startup_statistics_;
+    setup_context(*this, settings, statistics);
+
+    {
+        const utils::scoped_timer _{statistics.module_mapping};
+
+        context.executable = context.mod_manager.map_module(settings.application, this->log);
+        context.ntdll = context.mod_manager.map_module(R"(C:\Windows\System32\ntdll.dll)", this->log);
+        context.win32u = context.mod_manager.map_module(R"(C:\Windows\System32\win32u.dll)", this->log);
+    }
+
+    context.peb.access(
+        [&](PEB64& peb) { peb.ImageBaseAddress = reinterpret_cast<std::uint64_t*>(context.executable->image_base); });
+
+    {
+        const utils::scoped_timer _{statistics.syscall_setup};
+
+        const auto ntdll_data = emu.read_memory(context.ntdll->image_base, context.ntdll->size_of_image);
+        const auto win32u_data = emu.read_memory(context.win32u->image_base, context.win32u->size_of_image);
+
+        const auto table_file = settings.registry_directory / SYSCALL_TABLE_FILE;
+        syscall_dispatcher::load_syscall_tables(table_file);
+
+        this->dispatcher_.setup(context.ntdll->exports, ntdll_data, context.win32u->exports, win32u_data);
+
+        if (settings.persist_syscall_tables && !syscall_dispatcher::save_syscall_tables(table_file))
+        {
+            this->log.warn("Failed to write syscall tables to %s\n", table_file.string().c_str());
+        }
+    }
+
+    const utils::scoped_timer _{statistics.thread_setup};
+
+    context.ldr_initialize_thunk = context.ntdll->find_export("LdrInitializeThunk");
+    context.rtl_user_thread_start = context.ntdll->find_export("RtlUserThreadStart");
+    context.ki_user_exception_dispatcher = context.ntdll->find_export("KiUserExceptionDispatcher");
+
+    context.default_register_set = emu.save_registers();
+
+    const auto main_thread_id = context.create_thread(emu, context.executable->entry_point, 0, 0);
+    switch_to_thread(*this, main_thread_id);
+
+    this->start_time_slice(nullptr);
+}
+
+bool windows_emulator::load_boot_template(const emulator_settings& settings)
+{
+    std::error_code ec{};
+    if (!std::filesystem::exists(settings.boot_template, ec))
+    {
+        return false;
+    }
+
+    // Deserializing straight from the mapping leaves the template in the page cache, shared by all emulators
+    const utils::mapped_file mapping(settings.boot_template);
+    const auto data = mapping.get_buffer();
+
+    boot_template_header header{};
+    if (data.size() < sizeof(header))
+    {
+        return false;
+    }
+
+    memcpy(&header, data.data(), sizeof(header));
+    if (memcmp(header.magic, BOOT_TEMPLATE_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != BOOT_TEMPLATE_VERSION || header.serialization_guards != utils::SERIALIZATION_GUARDS)
+    {
+        return false;
+    }
+
+    utils::buffer_deserializer buffer{data.subspan(sizeof(header))};
+    if (buffer.read_vector<std::byte>() != get_boot_template_key(settings))
+    {
+        return false;
+    }
+
+    this->process_.mod_manager = module_manager(this->emu(), this->trace_.get(), this->function_hle_.get(),
+                                                this->api_tracer_.get(), &this->events_);
+    this->deserialize(buffer);
+
+    // Process settings are part of the key, the remaining ones may differ from the template
+    this->use_relative_time_ = settings.use_relative_time;
+    this->skip_idle_waits_ = settings.skip_idle_waits;
+    this->time_slice_instructions_ = std::max(settings.time_slice_instructions, static_cast<uint64_t>(1));
+    this->adaptive_time_slices_ = settings.adaptive_time_slices;
+    this->fast_forward_spin_loops_ = settings.fast_forward_spin_loops;
+
+    return true;
+}
+
+void windows_emulator::create_boot_template(const emulator_settings& settings)
+{
+    const auto entry_point = this->process_.executable->entry_point;
+
+    auto* hook = this->emu().hook_memory_execution(entry_point, 1, [this](uint64_t, size_t, uint64_t) {
+        this->emu().stop(); //
+    });
+
+    this->start();
+    this->emu().delete_hook(hook);
+
+    if (this->process_.exit_status.has_value() || this->emu().read_instruction_pointer() != entry_point)
+    {
+        this->log.warn("Process did not reach its entry point, no boot template was created\n");
+        return;
+    }
+
+    // Emulators on other threads may be creating the same template
+    auto temporary_file = settings.boot_template;
+    temporary_file += "." + std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id())) + ".tmp";
+
+    FILE* file = fopen(temporary_file.string().c_str(), "wb");
+    if (!file)
+    {
+        throw std::runtime_error("Failed to create boot template: " + temporary_file.string());
+    }
+
+    auto closer = utils::finally([&] {
+        if (file)
+        {
+            (void)fclose(file);
+        }
+    });
+
+    boot_template_header header{};
+    memcpy(header.magic, BOOT_TEMPLATE_MAGIC, sizeof(header.magic));
+    header.version = BOOT_TEMPLATE_VERSION;
+    header.serialization_guards = utils::SERIALIZATION_GUARDS;
+
+    if (fwrite(&header, sizeof(header), 1, file) != 1)
+    {
+        throw std::runtime_error("Failed to write boot template: " + temporary_file.string());
+    }
+
+    utils::file_sink sink{file};
+    utils::buffer_serializer buffer{sink};
+    buffer.write_vector(get_boot_template_key(settings));
+    this->serialize(buffer);
+    buffer.flush();
+
+    const auto closed = fclose(file) == 0;
+    file = nullptr;
+
+    std::error_code ec{};
+    if (closed)
+    {
+        std::filesystem::rename(temporary_file, settings.boot_template, ec);
+    }
+
+    if (!closed || ec)
+    {
+        std::filesystem::remove(temporary_file, ec);
+        throw std::runtime_error("Failed to write boot template: " + settings.boot_template.string());
+    }
+}
+
+void windows_emulator::yield_thread()
+{
+    this->switch_thread = true;
+    this->emu().stop();
+}
+
+void windows_emulator::yield_spinning_thread()
+{
+    this->spinning_thread_ = true;
+    this->yield_thread();
+}
+
+void windows_emulator::perform_thread_switch()
+{
+    const auto* previous_thread = this->process().active_thread;
+    const auto was_spinning = std::exchange(this->spinning_thread_, false);
+
+    this->switch_thread = false;
+    while (!switch_to_next_thread(*this))
+    {
+        wait_for_thread_wakeup(*this);
+    }
+
+    // Emulating the spin would only pass the time until something wakes up, skipping or sleeping passes it cheaper
+    if (was_spinning && previous_thread && this->process().active_thread == previous_thread)
+    {
+        wait_for_thread_wakeup(*this);
+
+        while (!switch_to_next_thread(*this))
+        {
+            wait_for_thread_wakeup(*this);
+        }
+    }
+
+    this->start_time_slice(previous_thread);
+}
+
+void windows_emulator::start_time_slice(const emulator_thread* previous_thread)
+{
+    const auto base = this->time_slice_instructions_;
+
+    if (!this->adaptive_time_slices_)
+    {
+        this->current_time_slice_ = base;
+    }
+    else if (this->time_slice_expired_ && this->time_slice_max_ip_ - this->time_slice_min_ip_ < SPIN_WAIT_WINDOW)
+    {
+        this->current_time_slice_ = std::max(base / MIN_TIME_SLICE_DIVISOR, this->current_time_slice_ / 2);
+    }
+    else if (this->time_slice_expired_ && previous_thread == this->process().active_thread)
+    {
+        this->current_time_slice_ = std::min(base * MAX_TIME_SLICE_MULTIPLIER, this->current_time_slice_ * 2);
+    }
+    else
+    {
+        this->current_time_slice_ = base;
+    }
+
+    this->current_time_slice_ = std::max(this->current_time_slice_, static_cast<uint64_t>(1));
+    this->time_slice_end_ = this->current_thread().executed_instructions + this->current_time_slice_;
+
+    this->time_slice_expired_ = false;
+    this->time_slice_min_ip_ = std::numeric_limits<uint64_t>::max();
+    this->time_slice_max_ip_ = 0;
+
+    this->spin_loop_head_ = 0;
+    this->spin_loop_distance_ = 0;
+    this->spin_loop_iterations_ = 0;
+
+    this->process().kusd.refresh();
+}
+
+void windows_emulator::on_block_execution(const basic_block& block)
+{
+    if (this->execution_trace_)
+    {
+        const auto* thread = this->process().active_thread;
+        this->execution_trace_->record_block(this->emu(), thread ? thread->id : 0, block);
+    }
+
+    if (this->count_instructions_per_block)
+    {
+        this->on_code_execution(block.address, block.instruction_count);
+
+        if (this->fast_forward_spin_loops_ && !this->switch_thread)
+        {
+            this->detect_spin_loop(block);
+        }
+    }
+}
+
+// Loops are found by their head block coming back within a few blocks. Loops that make progress change their
+// registers, so only the ones with the same registers at both sampled iterations yield.
+void windows_emulator::detect_spin_loop(const basic_block& block)
+{
+    if (block.address != this->spin_loop_head_)
+    {
+        if (++this->spin_loop_distance_ > SPIN_LOOP_MAX_BLOCKS)
+        {
+            this->spin_loop_head_ = block.address;
+            this->spin_loop_distance_ = 0;
+            this->spin_loop_iterations_ = 0;
+        }
+
+        return;
+    }
+
+    this->spin_loop_distance_ = 0;
+
+    if (++this->spin_loop_iterations_ % SPIN_LOOP_ITERATIONS)
+    {
+        return;
+    }
+
+    const auto registers = hash_loop_registers(this->emu());
+    const auto is_spinning =
+        this->spin_loop_iterations_ > SPIN_LOOP_ITERATIONS && registers == this->spin_loop_registers_;
+    this->spin_loop_registers_ = registers;
+
+    if (is_spinning)
+    {
+        ++this->spin_loop_yields_;
+        this->yield_spinning_thread();
+    }
+}
+
+void windows_emulator::on_code_execution(const uint64_t address, const size_t instructions)
+{
+    auto& process = this->process();
+    auto& thread = this->current_thread();
+
+    process.executed_instructions += instructions;
+
+    thread.executed_instructions += instructions;
+
+    if (this->adaptive_time_slices_)
+    {
+        this->time_slice_min_ip_ = std::min(this->time_slice_min_ip_, address);
+        this->time_slice_max_ip_ = std::max(this->time_slice_max_ip_, address);
+    }
+
+    if (thread.executed_instructions >= this->time_slice_end_ && !this->time_slice_expired_)
+    {
+        this->time_slice_expired_ = true;
+        this->switch_thread = true;
+        this->emu().stop();
+    }
+
+    process.previous_ip = process.current_ip;
+    process.current_ip = address;
+
+    // The api tracer only hooks the exports it's interested in
+    if (this->trace_ && !this->api_tracer_)
+    {
+        const auto* binary = process.mod_manager.find_by_address(address);
+        const auto* export_name = binary ? binary->find_export_name(address) : nullptr;
+
+        if (export_name)
+        {
+            this->trace_->log_function_entry(address, binary->name, *export_name);
+        }
+    }
 
     const auto is_main_exe = process.executable->is_within(address);
     const auto is_interesting_call = process.executable->is_within(process.previous_ip) || is_main_exe;
@@ -825,36 +1501,83 @@ void windows_emulator::on_instruction_execution(uint64_t address)
         return;
     }
 
+    if (!this->log.is_enabled(log_category::calls, is_interesting_call ? log_level::info : log_level::debug))
+    {
+        return;
+    }
+
     const auto* binary = this->process().mod_manager.find_by_address(address);
 
     if (binary)
     {
-        const auto export_entry = binary->address_names.find(address);
-        if (export_entry != binary->address_names.end())
+        const auto* export_name = binary->find_export_name(address);
+        if (export_name)
         {
-            log.print(is_interesting_call ? color::yellow : color::dark_gray,
-                      "Executing function: %s - %s (0x%" PRIx64 ")\n", binary->name.c_str(),
-                      export_entry->second.c_str(), address);
+            log.print(log_category::calls, is_interesting_call ? log_level::info : log_level::debug,
+                      is_interesting_call ? color::yellow : color::dark_gray,
+                      "Executing function: %s - %s (0x%" PRIx64 ")\n", binary->name.c_str(), export_name->c_str(),
+                      address);
         }
         else if (address == binary->entry_point)
         {
-            log.print(is_interesting_call ? color::yellow : color::gray, "Executing entry point: %s (0x%" PRIx64 ")\n",
+            log.print(log_category::calls, is_interesting_call ? log_level::info : log_level::debug,
+                      is_interesting_call ? color::yellow : color::gray, "Executing entry point: %s (0x%" PRIx64 ")\n",
                       binary->name.c_str(), address);
         }
     }
+}
+
+void windows_emulator::on_instruction_execution(const uint64_t address)
+{
+    if (!this->count_instructions_per_block)
+    {
+        this->on_code_execution(address, 1);
+    }
 
     if (!this->verbose)
     {
         return;
     }
 
-    auto& emu = this->emu();
+    const auto* binary = this->process().mod_manager.find_by_address(address);
+    const auto regs = this->emu().read_registers(std::array{
+        x64_register::rax, x64_register::rbx, x64_register::rcx, x64_register::rdx, //
+        x64_register::r8, x64_register::r9, x64_register::rdi, x64_register::rsi,   //
+    });
 
     printf("Inst: %16" PRIx64 " - RAX: %16" PRIx64 " - RBX: %16" PRIx64 " - RCX: %16" PRIx64 " - RDX: %16" PRIx64
            " - R8: %16" PRIx64 " - R9: %16" PRIx64 " - RDI: %16" PRIx64 " - RSI: %16" PRIx64 " - %s\n",
-           address, emu.reg(x64_register::rax), emu.reg(x64_register::rbx), emu.reg(x64_register::rcx),
-           emu.reg(x64_register::rdx), emu.reg(x64_register::r8), emu.reg(x64_register::r9), emu.reg(x64_register::rdi),
-           emu.reg(x64_register::rsi), binary ? binary->name.c_str() : "<N/A>");
+           address, regs[0], regs[1], regs[2], regs[3], regs[4], regs[5], regs[6], regs[7],
+           binary ? binary->name.c_str() : "<N/A>");
+}
+
+void windows_emulator::update_execution_hooks()
+{
+    const auto needs_instruction_hook = !this->count_instructions_per_block || this->verbose;
+    const auto needs_block_hook = this->count_instructions_per_block || this->execution_trace_;
+
+    if (needs_instruction_hook && !this->instruction_hook_)
+    {
+        this->instruction_hook_ = this->emu().hook_memory_execution(
+            0, std::numeric_limits<size_t>::max(),
+            [&](const uint64_t address, const size_t, const uint64_t) { this->on_instruction_execution(address); });
+    }
+    else if (!needs_instruction_hook && this->instruction_hook_)
+    {
+        this->emu().delete_hook(this->instruction_hook_);
+        this->instruction_hook_ = nullptr;
+    }
+
+    if (needs_block_hook && !this->block_hook_)
+    {
+        this->block_hook_ =
+            this->emu().hook_basic_block([&](const basic_block& block) { this->on_block_execution(block); });
+    }
+    else if (!needs_block_hook && this->block_hook_)
+    {
+        this->emu().delete_hook(this->block_hook_);
+        this->block_hook_ = nullptr;
+    }
 }
 
 void windows_emulator::setup_hooks()
@@ -873,9 +1596,16 @@ void windows_emulator::setup_hooks()
     });
 
     this->emu().hook_instruction(x64_hookable_instructions::rdtsc, [&] {
-        const auto instructions = this->process().executed_instructions;
-        this->emu().reg(x64_register::rax, instructions & 0xFFFFFFFF);
-        this->emu().reg(x64_register::rdx, (instructions >> 32) & 0xFFFFFFFF);
+        const auto& clock = this->process().clock;
+        const auto ticks = clock.is_virtual() ? clock.performance_counter() : this->process().executed_instructions;
+        this->emu().reg(x64_register::rax, ticks & 0xFFFFFFFF);
+        this->emu().reg(x64_register::rdx, (ticks >> 32) & 0xFFFFFFFF);
+
+        for (const auto& hook : this->rdtsc_hooks_)
+        {
+            hook();
+        }
+
         return instruction_hook_continuation::skip_instruction;
     });
 
@@ -890,6 +1620,19 @@ void windows_emulator::setup_hooks()
     this->emu().hook_interrupt([&](const int interrupt) {
         if (interrupt == 6)
         {
+            if (this->trace_)
+            {
+                this->trace_->log_exception(this->emu().read_instruction_pointer(),
+                                            static_cast<uint32_t>(STATUS_ILLEGAL_INSTRUCTION));
+            }
+
+            this->events_.publish<exception_event>([&] {
+                return exception_event{
+                    .rip = this->emu().read_instruction_pointer(),
+                    .status = STATUS_ILLEGAL_INSTRUCTION,
+                };
+            });
+
             dispatch_illegal_instruction_violation(this->emu(), this->process().ki_user_exception_dispatcher);
             return;
         }
@@ -906,21 +1649,47 @@ void windows_emulator::setup_hooks()
 
     this->emu().hook_memory_violation([&](const uint64_t address, const size_t size, const memory_operation operation,
                                           const memory_violation_type type) {
-        const auto permission = get_permission_string(operation);
+        // Written pages lose their execute permission while an execution watch runs
+        if (operation == memory_operation::exec && type == memory_violation_type::protection &&
+            this->emu().handle_watched_execution(address))
+        {
+            return memory_violation_continuation::resume;
+        }
+
         const auto ip = this->emu().read_instruction_pointer();
-        const char* name = this->process().mod_manager.find_name(ip);
 
-        if (type == memory_violation_type::protection)
+        if (EMU_LOG_ENABLED(this->log, memory, info))
         {
-            this->log.print(color::gray, "Protection violation: 0x%" PRIx64 " (%zX) - %s at 0x%" PRIx64 " (%s)\n",
-                            address, size, permission.c_str(), ip, name);
+            const auto permission = get_permission_string(operation);
+            const char* name = this->process().mod_manager.find_name(ip);
+
+            if (type == memory_violation_type::protection)
+            {
+                this->log.print(log_category::memory, log_level::info, color::gray,
+                                "Protection violation: 0x%" PRIx64 " (%zX) - %s at 0x%" PRIx64 " (%s)\n", address,
+                                size, permission.c_str(), ip, name);
+            }
+            else if (type == memory_violation_type::unmapped)
+            {
+                this->log.print(log_category::memory, log_level::info, color::gray,
+                                "Mapping violation: 0x%" PRIx64 " (%zX) - %s at 0x%" PRIx64 " (%s)\n", address, size,
+                                permission.c_str(), ip, name);
+            }
         }
-        else if (type == memory_violation_type::unmapped)
+
+        if (this->trace_)
         {
-            this->log.print(color::gray, "Mapping violation: 0x%" PRIx64 " (%zX) - %s at 0x%" PRIx64 " (%s)\n", address,
-                            size, permission.c_str(), ip, name);
+            this->trace_->log_exception(ip, static_cast<uint32_t>(STATUS_ACCESS_VIOLATION), address, operation);
         }
 
+        this->events_.publish<exception_event>([&] {
+            return exception_event{
+                .rip = ip,
+                .status = STATUS_ACCESS_VIOLATION,
+                .address = address,
+            };
+        });
+
         if (this->fuzzing)
         {
             this->process().exception_rip = ip;
@@ -932,12 +1701,36 @@ void windows_emulator::setup_hooks()
         return memory_violation_continuation::resume;
     });
 
-    this->emu().hook_memory_execution(
-        0, std::numeric_limits<size_t>::max(),
-        [&](const uint64_t address, const size_t, const uint64_t) { this->on_instruction_execution(address); });
+    this->update_execution_hooks();
+}
+
+void windows_emulator::start(const std::chrono::nanoseconds timeout, const size_t count)
+{
+    if (!this->recorder_ || timeout == std::chrono::nanoseconds{})
+    {
+        this->run(timeout, count);
+        return;
+    }
+
+    // Where a timeout stops depends on the host, replays stop at the recorded instruction count instead
+    if (!this->recorder_->is_replaying())
+    {
+        this->run(timeout, count);
+        this->recorder_->record_value(recorded_input::stop_position, this->process_.executed_instructions);
+        return;
+    }
+
+    const auto stop_position = this->recorder_->replay_value(recorded_input::stop_position);
+    const auto position = this->process_.executed_instructions;
+
+    if (stop_position > position)
+    {
+        const auto remaining = static_cast<size_t>(stop_position - position);
+        this->run({}, count ? std::min(count, remaining) : remaining);
+    }
 }
 
-void windows_emulator::start(std::chrono::nanoseconds timeout, size_t count)
+void windows_emulator::run(std::chrono::nanoseconds timeout, size_t count)
 {
     const auto use_count = count > 0;
     const auto use_timeout = timeout != std::chrono::nanoseconds{};
@@ -948,11 +1741,16 @@ void windows_emulator::start(std::chrono::nanoseconds timeout, size_t count)
     const auto target_time = start_time + timeout;
     const auto target_instructions = start_instructions + count;
 
+    this->update_execution_hooks();
+
     while (true)
     {
         if (this->switch_thread)
         {
             this->perform_thread_switch();
+
+            // Remapping is only safe while the backend doesn't run
+            this->emu().deduplicate_pages(DEDUPLICATION_PAGES_PER_SLICE);
         }
 
         this->emu().start_from_ip(timeout, count);
@@ -988,51 +1786,295 @@ void windows_emulator::start(std::chrono::nanoseconds timeout, size_t count)
     }
 }
 
-void windows_emulator::serialize(utils::buffer_serializer& buffer) const
+void windows_emulator::serialize_clock(utils::buffer_serializer& buffer) const
 {
     buffer.write(this->use_relative_time_);
+    buffer.write(this->skip_idle_waits_);
+    buffer.write(this->time_slice_instructions_);
+    buffer.write(this->adaptive_time_slices_);
+    buffer.write(this->fast_forward_spin_loops_);
+    buffer.write(this->current_time_slice_);
+    buffer.write(this->time_slice_end_);
+}
+
+void windows_emulator::deserialize_clock(utils::buffer_deserializer& buffer)
+{
+    buffer.read(this->use_relative_time_);
+    buffer.read(this->skip_idle_waits_);
+    buffer.read(this->time_slice_instructions_);
+    buffer.read(this->adaptive_time_slices_);
+    buffer.read(this->fast_forward_spin_loops_);
+    buffer.read(this->current_time_slice_);
+    buffer.read(this->time_slice_end_);
+}
+
+void windows_emulator::serialize(utils::buffer_serializer& buffer) const
+{
+    this->serialize_clock(buffer);
     this->emu().serialize(buffer);
     this->process_.serialize(buffer);
     this->dispatcher_.serialize(buffer);
 }
 
-void windows_emulator::deserialize(utils::buffer_deserializer& buffer)
+void windows_emulator::serialize_migration_base(utils::buffer_serializer& buffer)
+{
+    this->emu().start_migration_tracking();
+    this->serialize(buffer);
+}
+
+void windows_emulator::serialize_migration_delta(utils::buffer_serializer& buffer)
+{
+    this->serialize_clock(buffer);
+    this->emu().serialize_migration_delta(buffer);
+    this->process_.serialize(buffer);
+    this->dispatcher_.serialize(buffer);
+}
+
+void windows_emulator::register_factories(utils::buffer_deserializer& buffer)
 {
     buffer.register_factory<x64_emulator_wrapper>([this] { return x64_emulator_wrapper{this->emu()}; });
 
     buffer.register_factory<windows_emulator_wrapper>([this] { return windows_emulator_wrapper{*this}; });
+}
 
-    buffer.read(this->use_relative_time_);
-
+void windows_emulator::deserialize(utils::buffer_deserializer& buffer)
+{
+    this->register_factories(buffer);
+    this->deserialize_clock(buffer);
     this->emu().deserialize(buffer);
+    this->deserialize_process(buffer);
+}
+
+void windows_emulator::save_state_file(const std::filesystem::path& file) const
+{
+    FILE* handle = fopen(file.string().c_str(), "wb");
+    if (!handle)
+    {
+        throw std::runtime_error("Failed to create state file: " + file.string());
+    }
+
+    auto closer = utils::finally([&] {
+        if (handle)
+        {
+            (void)fclose(handle);
+        }
+    });
+
+    state_file_header header{};
+    memcpy(header.magic, STATE_FILE_MAGIC, sizeof(header.magic));
+    header.version = STATE_FILE_VERSION;
+    header.serialization_guards = utils::SERIALIZATION_GUARDS;
+
+    // Written again once the state size is known
+    state_file_writer writer{handle};
+    writer.append(std::as_bytes(std::span(&header, 1)));
+
+    utils::buffer_serializer buffer{};
+    this->serialize_clock(buffer);
+    this->emu().serialize(buffer, writer);
+    this->process_.serialize(buffer);
+    this->dispatcher_.serialize(buffer);
+
+    header.state_offset = writer.get_size();
+    header.state_size = buffer.get_buffer().size();
+    writer.append(buffer.get_buffer());
+
+    const auto written = fseek(handle, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, handle) == 1;
+    const auto closed = fclose(handle) == 0;
+    handle = nullptr;
+
+    if (!written || !closed)
+    {
+        throw std::runtime_error("Failed to write state file: " + file.string());
+    }
+}
+
+void windows_emulator::load_state_file(const std::filesystem::path& file)
+{
+    // Shared by the guest memory mapped from it, the emulator keeps it alive as long as needed
+    auto mapping = std::make_shared<utils::mapped_file>(file, utils::mapped_file::access::copy_on_write);
+    const auto data = std::as_const(*mapping).get_buffer();
+
+    state_file_header header{};
+    if (data.size() < sizeof(header))
+    {
+        throw std::runtime_error("Bad state file: " + file.string());
+    }
+
+    memcpy(&header, data.data(), sizeof(header));
+    if (memcmp(header.magic, STATE_FILE_MAGIC, sizeof(header.magic)) != 0 || header.version != STATE_FILE_VERSION ||
+        header.serialization_guards != utils::SERIALIZATION_GUARDS || header.state_offset > data.size() ||
+        header.state_size > data.size() - header.state_offset)
+    {
+        throw std::runtime_error("Bad state file: " + file.string());
+    }
+
+    utils::buffer_deserializer buffer{
+        data.subspan(static_cast<size_t>(header.state_offset), static_cast<size_t>(header.state_size))};
+
+    this->register_factories(buffer);
+    this->deserialize_clock(buffer);
+    this->emu().deserialize(buffer, std::move(mapping));
+    this->deserialize_process(buffer);
+}
+
+void windows_emulator::deserialize_migration_delta(utils::buffer_deserializer& buffer)
+{
+    this->register_factories(buffer);
+    this->deserialize_clock(buffer);
+    this->emu().deserialize_migration_delta(buffer);
+    this->deserialize_process(buffer);
+}
+
+void windows_emulator::deserialize_process(utils::buffer_deserializer& buffer)
+{
     this->process_.deserialize(buffer);
     this->dispatcher_.deserialize(buffer);
+
+    // The emulator drops its snapshots on deserialization
+    this->process_snapshots_.clear();
+    this->default_snapshot_.reset();
+
+    // States of emulators that weren't created with the same settings carry the functions to emulate
+    if (!this->function_hle_ && (this->process_.emulate_library_functions || this->process_.heap.is_enabled()))
+    {
+        this->function_hle_ = std::make_unique<function_hle>(this->emu(), this->process_);
+        this->process_.mod_manager.set_function_hle(this->function_hle_.get());
+    }
+
+    // Synchronizes itself through the heap from now on
+    if (!this->heap_sanitizer_ && this->process_.heap.is_sanitizing())
+    {
+        this->heap_sanitizer_ = std::make_unique<heap_sanitizer>(this->emu(), this->process_, this->log);
+    }
 }
 
-void windows_emulator::save_snapshot()
+snapshot_id windows_emulator::create_snapshot()
 {
-    this->emu().save_snapshot();
+    const auto id = this->emu().create_snapshot();
+
+    auto& snapshot = this->process_snapshots_[id];
+
+    for (size_t i = 0; i < process_context::component_count; ++i)
+    {
+        const auto c = static_cast<process_context::component>(i);
 
-    utils::buffer_serializer serializer{};
-    this->process_.serialize(serializer);
+        utils::buffer_serializer serializer{};
+        this->process_.serialize_component(serializer, c);
+        snapshot.components[i] = serializer.move_buffer();
+        snapshot.modifications[i] = this->process_.get_component_modifications(c);
+    }
 
-    this->process_snapshot_ = serializer.move_buffer();
+    snapshot.thread_changes = this->process_.thread_changes;
+    snapshot.executed_instructions = this->process_.executed_instructions;
+    snapshot.clock = this->process_.clock;
 
-    // TODO: Make process copyable
-    // this->process_snapshot_ = this->process();
+    this->snapshot_thread_ = this->process_.active_thread;
+    return id;
+}
+
+bool windows_emulator::restore_snapshot(const snapshot_id id)
+{
+    const auto entry = this->process_snapshots_.find(id);
+    if (entry == this->process_snapshots_.end() || !this->emu().restore_snapshot(id))
+    {
+        return false;
+    }
+
+    auto& snapshot = entry->second;
+    this->restore_modified_components(snapshot, false);
+
+    snapshot.thread_changes = this->process_.thread_changes;
+    this->snapshot_thread_ = this->process_.active_thread;
+    return true;
+}
+
+// Components that weren't modified since are kept, the others are rebuilt
+void windows_emulator::restore_modified_components(process_snapshot& snapshot, const bool tracked_only)
+{
+    for (size_t i = 0; i < process_context::component_count; ++i)
+    {
+        const auto c = static_cast<process_context::component>(i);
+
+        auto& modifications = snapshot.modifications[i];
+        if (modifications ? modifications == this->process_.get_component_modifications(c) : tracked_only)
+        {
+            continue;
+        }
+
+        utils::buffer_deserializer deserializer{snapshot.components[i]};
+        this->register_factories(deserializer);
+        this->process_.deserialize_component(deserializer, c);
+
+        // The counts only grow, so they can't match those of other snapshots by accident
+        if (modifications)
+        {
+            modifications = this->process_.get_component_modifications(c);
+        }
+    }
+}
+
+void windows_emulator::delete_snapshot(const snapshot_id id)
+{
+    this->emu().delete_snapshot(id);
+    this->process_snapshots_.erase(id);
+
+    if (this->default_snapshot_ == id)
+    {
+        this->default_snapshot_.reset();
+    }
+}
+
+void windows_emulator::save_snapshot()
+{
+    const auto previous = this->default_snapshot_;
+    this->default_snapshot_ = this->create_snapshot();
+
+    if (previous)
+    {
+        this->delete_snapshot(*previous);
+    }
 }
 
 void windows_emulator::restore_snapshot()
 {
-    if (this->process_snapshot_.empty())
+    if (!this->default_snapshot_)
     {
         assert(false);
         return;
     }
 
-    this->emu().restore_snapshot();
+    this->restore_snapshot(*this->default_snapshot_);
+}
+
+bool windows_emulator::reset_to_snapshot()
+{
+    const auto id = this->emu().get_current_snapshot();
+    const auto entry = id ? this->process_snapshots_.find(*id) : this->process_snapshots_.end();
+    if (entry == this->process_snapshots_.end())
+    {
+        return false;
+    }
+
+    auto& snapshot = entry->second;
 
-    utils::buffer_deserializer deserializer{this->process_snapshot_};
-    this->process_.deserialize(deserializer);
-    // this->process_ = *this->process_snapshot_;
+    // The registers of the snapshot belong to the thread that was active back then, the threads own memory
+    // and are never rebuilt here
+    if (this->process_.exit_status || this->process_.thread_changes != snapshot.thread_changes ||
+        this->process_.active_thread != this->snapshot_thread_)
+    {
+        return false;
+    }
+
+    if (!this->emu().reset_to_snapshot())
+    {
+        return false;
+    }
+
+    this->restore_modified_components(snapshot, true);
+
+    this->process_.executed_instructions = snapshot.executed_instructions;
+    this->process_.clock = snapshot.clock;
+
+    return true;
 }
@@ -6,20 +6,115 @@
 #include "syscall_dispatcher.hpp"
 #include "process_context.hpp"
 #include "logger.hpp"
+#include "event_bus.hpp"
 
 std::unique_ptr<x64_emulator> create_default_x64_emulator();
 
+namespace network
+{
+    class poller;
+}
+
+class socket_provider;
+class event_trace;
+class execution_trace;
+class function_hle;
+class heap_sanitizer;
+class api_tracer;
+class input_recorder;
+
+// A process the guest tried to create
+struct child_process_request
+{
+    std::u16string image_path{};
+    std::u16string command_line{};
+    std::u16string current_directory{};
+};
+
 // TODO: Split up into application and emulator settings
 struct emulator_settings
 {
     std::filesystem::path application{};
     std::filesystem::path working_directory{};
     std::filesystem::path registry_directory{"./registry"};
+    // Syscall tables of the ntdll and win32u builds are loaded from the registry directory if present. This writes
+    // the ones found by scanning there as well, so later processes skip the scan.
+    bool persist_syscall_tables{false};
     std::vector<std::u16string> arguments{};
     std::function<void(std::string_view)> stdout_callback{};
+    // Children aren't emulated within the process, callers can run them in sibling emulators and share their caches.
+    // Without a callback, or if it returns false, process creation fails in the guest and emulation stops.
+    std::function<bool(const child_process_request&)> child_process_callback{};
     bool disable_logging{false};
+    // Writes JSON lines to this file instead of colored text to stdout
+    std::filesystem::path log_file{};
+    // Writes log messages on a background thread
+    bool async_logging{false};
     bool silent_until_main{false};
+    // Derives every clock of the guest from the executed instructions, see emulator_clock
     bool use_relative_time{false};
+    uint64_t instructions_per_second{1000};
+    // Maps KUSER_SHARED_DATA as memory that is refreshed at time slices and syscalls instead of as MMIO
+    bool kusd_as_memory{false};
+    // Keeps files the guest writes in memory, they become part of snapshots and never reach the host
+    bool virtualize_file_writes{false};
+    bool skip_idle_waits{false};
+    uint64_t time_slice_instructions{100000};
+    // Lengthens slices while a single thread is runnable and shortens them for spin-waits
+    bool adaptive_time_slices{false};
+    // Threads running a short loop whose registers don't change yield at once, and wait like idle threads if no
+    // other thread is ready. Detected from block hooks, so it needs count_instructions_per_block.
+    bool fast_forward_spin_loops{false};
+    // Creates the guest's sockets, host sockets are used if not set
+    std::shared_ptr<socket_provider> sockets{};
+    // Serializes every distinct memory page only once, optionally into a shared page store
+    bool deduplicate_memory_pages{false};
+    std::shared_ptr<page_store> memory_page_store{};
+    // Merges read-only guest pages with identical ones of the other emulators using it, a few pages per time slice
+    std::shared_ptr<page_deduplicator> shared_page_deduplicator{};
+    // Committed guest memory in bytes beyond which allocations fail with STATUS_NO_MEMORY, 0 means no limit
+    uint64_t memory_commit_limit{};
+    // Backs large guest allocations with host huge pages where the backend supports it
+    bool use_huge_pages{false};
+    // Threads used to serialize and deserialize memory
+    size_t serialization_threads{1};
+    // Records module loads, function entries, syscalls and exceptions into this memory-mapped ring
+    std::filesystem::path trace_file{};
+    size_t trace_buffer_size{64ULL * 1024 * 1024};
+    // Records every executed block, and the registers at its start if requested, into this file
+    std::filesystem::path execution_trace_file{};
+    bool execution_trace_registers{false};
+    // Exports whose calls are recorded into the trace file with their arguments, see api_tracer
+    std::vector<std::string> traced_apis{};
+    // Records clock readings, socket results, file reads and timeout stops, or replays them from this file
+    std::filesystem::path input_recording_file{};
+    std::filesystem::path input_replay_file{};
+    // Process state at the entry point of the application. The first emulator runs the loader up to the entry
+    // point and writes it, later ones with the same application and process settings map it instead of booting.
+    // Ignored while recording or replaying inputs.
+    std::filesystem::path boot_template{};
+    // Runs memory and string routines of ntdll and the CRTs on the host, see function_hle
+    bool emulate_library_functions{false};
+    // Services the guest heap functions with emulated_heap, optionally with redzones of this size around chunks
+    bool emulate_heap{false};
+    uint64_t heap_redzone_size{};
+    // Reports guest accesses of heap redzones and freed chunks, see heap_sanitizer. Implies emulate_heap.
+    bool sanitize_heap{false};
+};
+
+// Time spent in the phases of constructing a windows_emulator, phases that didn't run stay zero
+struct startup_statistics
+{
+    std::chrono::nanoseconds registry{};
+    // GDT, shared user data, PEB and process parameters
+    std::chrono::nanoseconds process_context{};
+    std::chrono::nanoseconds module_mapping{};
+    // Scanning the ntdll and win32u exports for syscall stubs
+    std::chrono::nanoseconds syscall_setup{};
+    std::chrono::nanoseconds thread_setup{};
+    // Loading or writing the boot template
+    std::chrono::nanoseconds boot_template{};
+    std::chrono::nanoseconds total{};
 };
 
 class windows_emulator
@@ -33,7 +128,7 @@ class windows_emulator
     windows_emulator& operator=(windows_emulator&&) = delete;
     windows_emulator& operator=(const windows_emulator&) = delete;
 
-    ~windows_emulator() = default;
+    ~windows_emulator();
 
     x64_emulator& emu()
     {
@@ -80,14 +175,49 @@ class windows_emulator
     void serialize(utils::buffer_serializer& buffer) const;
     void deserialize(utils::buffer_deserializer& buffer);
 
+    // State files keep the memory page aligned apart from the rest of the state. Loading maps it copy-on-write into
+    // the guest instead of copying it, so only the pages the emulation touches are ever read from the file.
+    void save_state_file(const std::filesystem::path& file) const;
+    void load_state_file(const std::filesystem::path& file);
+
+    // Live migration, to be called between time slices. The base is a full state, each delta carries the memory
+    // changed since the previous call. A receiver deserializes the base and applies the deltas in order. The final
+    // delta is taken after the sender stopped running.
+    void serialize_migration_base(utils::buffer_serializer& buffer);
+    void serialize_migration_delta(utils::buffer_serializer& buffer);
+    void deserialize_migration_delta(utils::buffer_deserializer& buffer);
+
+    // Snapshots of the whole process, see emulator::create_snapshot for their memory
+    snapshot_id create_snapshot();
+    bool restore_snapshot(snapshot_id id);
+    void delete_snapshot(snapshot_id id);
+
+    // Replaces and restores the default snapshot
     void save_snapshot();
     void restore_snapshot();
 
+    // Persistent mode reset, see emulator::reset_to_snapshot. Modified handles, modules and process data are
+    // restored with the memory, the thread and memory allocator state is kept. Returns false if the process
+    // exited or its threads changed, restore_snapshot is needed then.
+    bool reset_to_snapshot();
+
+    // Serves the sockets created from now on, including the ones recreated when deserializing
+    void set_socket_provider(std::shared_ptr<socket_provider> provider)
+    {
+        this->socket_provider_ = std::move(provider);
+    }
+
     void add_syscall_hook(instruction_hook_callback callback)
     {
         this->syscall_hooks_.push_back(std::move(callback));
     }
 
+    // Called after the guest read the time stamp counter, which is in rdx and rax then
+    void add_rdtsc_hook(std::function<void()> callback)
+    {
+        this->rdtsc_hooks_.push_back(std::move(callback));
+    }
+
     void on_stdout(const std::string_view data) const
     {
         if (this->stdout_callback_)
@@ -96,6 +226,11 @@ class windows_emulator
         }
     }
 
+    bool on_child_process(const child_process_request& request) const
+    {
+        return this->child_process_callback_ && this->child_process_callback_(request);
+    }
+
     logger log{};
     bool verbose{false};
     bool verbose_calls{false};
@@ -103,28 +238,140 @@ class windows_emulator
     bool fuzzing{false};
     bool switch_thread{false};
 
+    // Counts instructions and preempts threads from block hooks instead of a hook on every instruction.
+    // Counts become block granular, so counted starts may overshoot by up to one block.
+    bool count_instructions_per_block{false};
+
     void yield_thread();
+    // The thread can't make progress on its own, if no other thread is ready it waits for a wakeup first
+    void yield_spinning_thread();
     void perform_thread_switch();
 
+    // Spin loops found by fast_forward_spin_loops that yielded their thread
+    uint64_t get_spin_loop_yields() const
+    {
+        return this->spin_loop_yields_;
+    }
+
     bool time_is_relative() const
     {
         return this->use_relative_time_;
     }
 
+    bool skips_idle_waits() const
+    {
+        return this->skip_idle_waits_;
+    }
+
+    // Readiness multiplexer shared by all sockets of the guest, created on first use
+    network::poller& socket_poller();
+
+    socket_provider& get_socket_provider();
+
+    // Binary event trace, null if tracing is disabled
+    event_trace* trace() const
+    {
+        return this->trace_.get();
+    }
+
+    // Typed events for analyses, see event_bus
+    event_bus& events()
+    {
+        return this->events_;
+    }
+
+    // Records or replays nondeterministic inputs, null if neither is enabled
+    input_recorder* recorder() const
+    {
+        return this->recorder_.get();
+    }
+
+    const startup_statistics& get_startup_statistics() const
+    {
+        return this->startup_statistics_;
+    }
+
   private:
     bool use_relative_time_{false};
+    bool skip_idle_waits_{false};
     bool silent_until_main_{false};
     std::unique_ptr<x64_emulator> emu_{};
     std::vector<instruction_hook_callback> syscall_hooks_{};
+    std::vector<std::function<void()>> rdtsc_hooks_{};
     std::function<void(std::string_view)> stdout_callback_{};
+    std::function<bool(const child_process_request&)> child_process_callback_{};
+
+    emulator_hook* instruction_hook_{};
+    emulator_hook* block_hook_{};
+
+    uint64_t time_slice_instructions_{100000};
+    bool adaptive_time_slices_{false};
+    uint64_t current_time_slice_{100000};
+    uint64_t time_slice_end_{100000};
+    bool time_slice_expired_{false};
+    uint64_t time_slice_min_ip_{};
+    uint64_t time_slice_max_ip_{};
+
+    bool fast_forward_spin_loops_{false};
+    bool spinning_thread_{false};
+    // The block the current loop returns to, blocks executed since and the registers at its iterations
+    uint64_t spin_loop_head_{};
+    size_t spin_loop_distance_{};
+    uint64_t spin_loop_iterations_{};
+    uint64_t spin_loop_registers_{};
+    uint64_t spin_loop_yields_{};
+
+    startup_statistics startup_statistics_{};
+
+    // Declared before process_, so they outlive the devices and modules using them
+    event_bus events_{};
+    std::unique_ptr<network::poller> socket_poller_{};
+    std::shared_ptr<socket_provider> socket_provider_{};
+    std::unique_ptr<event_trace> trace_{};
+    std::unique_ptr<execution_trace> execution_trace_{};
+    std::unique_ptr<input_recorder> recorder_{};
+    std::unique_ptr<function_hle> function_hle_{};
+    std::unique_ptr<api_tracer> api_tracer_{};
 
     process_context process_;
     syscall_dispatcher dispatcher_;
 
-    std::vector<std::byte> process_snapshot_{};
+    // Declared after process_, it detaches from the heap when destroyed
+    std::unique_ptr<heap_sanitizer> heap_sanitizer_{};
+
+    // Serialized process_context components by snapshot, along with their modification counts back then
+    struct process_snapshot
+    {
+        std::array<std::vector<std::byte>, process_context::component_count> components{};
+        std::array<std::optional<uint64_t>, process_context::component_count> modifications{};
+        uint64_t thread_changes{};
+
+        // Restored by the persistent reset, which keeps the rest of the execution component
+        uint64_t executed_instructions{};
+        emulator_clock clock{};
+    };
+
+    std::map<snapshot_id, process_snapshot> process_snapshots_{};
+    std::optional<snapshot_id> default_snapshot_{};
+    // Active thread of the current snapshot
+    const emulator_thread* snapshot_thread_{};
     // std::optional<process_context> process_snapshot_{};
 
     void setup_hooks();
+    void register_factories(utils::buffer_deserializer& buffer);
+    void restore_modified_components(process_snapshot& snapshot, bool tracked_only);
+    void serialize_clock(utils::buffer_serializer& buffer) const;
+    void deserialize_clock(utils::buffer_deserializer& buffer);
+    void deserialize_process(utils::buffer_deserializer& buffer);
     void setup_process(const emulator_settings& settings);
+    bool load_boot_template(const emulator_settings& settings);
+    void create_boot_template(const emulator_settings& settings);
+    void setup_input_recording(const emulator_settings& settings);
+    void run(std::chrono::nanoseconds timeout, size_t count);
+    void update_execution_hooks();
+    void start_time_slice(const emulator_thread* previous_thread);
+    void on_block_execution(const basic_block& block);
+    void detect_spin_loop(const basic_block& block);
+    void on_code_execution(uint64_t address, size_t instructions);
     void on_instruction_execution(uint64_t address);
 };